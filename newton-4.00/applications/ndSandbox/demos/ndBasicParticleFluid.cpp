@@ -189,7 +189,10 @@ static void AddWaterVolume(ndDemoEntityManager* const scene, const dMatrix& loca
 	//dInt32 particleCountPerAxis = 32;
 	//dInt32 particleCountPerAxis = 25;
 	dInt32 particleCountPerAxis = 32;
-	dFloat32 spacing = diameter * 1.0f;
+	// the rest density of the fluid is the density of particles packed one radius apart, 
+	// so the volume starts at rest. one diameter apart, the particles are at the edge of 
+	// each other kernel, the volume has almost no pressure and collapses like a gas.
+	dFloat32 spacing = diameter * 0.5f;
 
 	dFloat32 offset = spacing * particleCountPerAxis / 2.0f;
 	dVector origin(-offset, 1.0f, -offset, dFloat32(0.0f));
@@ -71,9 +71,9 @@ void ndContactCallback::PlaySoundTest(const ndContact* const contactJoint)
 	dFloat32 maxTangentSpeed = dFloat32(0.0f);
 	const ndContactMaterial* normalContact = nullptr;
 	const ndContactMaterial* tangentContact = nullptr;
-	for (ndContactPointList::dNode* contactNode = contactPoints.GetFirst(); contactNode; contactNode = contactNode->GetNext())
+	for (dInt32 i = 0; i < contactPoints.GetCount(); i++)
 	{
-		const ndContactMaterial& contactPoint = contactNode->GetInfo();
+		const ndContactMaterial& contactPoint = contactPoints[i];
 		const dVector pointVeloc0(body0->GetVelocityAtPoint(contactPoint.m_point));
 		const dVector pointVeloc1(body1->GetVelocityAtPoint(contactPoint.m_point));
 		const dVector veloc(pointVeloc1 - pointVeloc0);
@@ -293,37 +293,19 @@ void ndConvexFracture::ExplodeLocation(ndBodyDynamic* const body, const dMatrix&
 
 void ndConvexFracture::GenerateEffect(ndDemoEntityManager* const scene)
 {
-	ndMeshEffect* const debrisMeshPieces = m_singleManifoldMesh->CreateVoronoiConvexDecomposition(m_pointCloud, m_interiorMaterialIndex, &m_textureMatrix[0][0]);
+	// clip the voronoi cells against the mesh in the world thread pool
+	dArray<ndMeshEffect::ndFracturePiece> pieces;
+	m_singleManifoldMesh->CreateVoronoiFracture(scene->GetWorld()->GetScene(), m_pointCloud, m_interiorMaterialIndex, &m_textureMatrix[0][0], pieces);
 
 	dArray<glDebrisPoint> vertexArray;
 	m_debriRootEnt = new ndConvexFractureRootEntity(m_singleManifoldMesh, m_mass);
-
-	dInt32 enumerator = 0;
-	ndMeshEffect* nextDebris;
-	for (ndMeshEffect* debri = debrisMeshPieces->GetFirstLayer(); debri; debri = nextDebris)
+	for (dInt32 i = 0; i < pieces.GetCount(); i++)
 	{
-		// get next segment piece
-		nextDebris = debrisMeshPieces->GetNextLayer(debri);
-
-		//clip the voronoi cell convexes against the mesh 
-		ndMeshEffect* const fracturePiece = m_singleManifoldMesh->ConvexMeshIntersection(debri);
-		if (fracturePiece)
-		{
-			// make a convex hull collision shape
-			ndShapeInstance* const collision = fracturePiece->CreateConvexCollision(dFloat32(0.0f));
-			if (collision)
-			{
-				new ndConvexFractureEntity(fracturePiece, vertexArray, m_debriRootEnt, scene->GetShaderCache(), collision, enumerator);
-				enumerator++;
-			}
-			delete fracturePiece;
-		}
-
-		delete debri;
+		new ndConvexFractureEntity(pieces[i].m_mesh, vertexArray, m_debriRootEnt, scene->GetShaderCache(), pieces[i].m_collision, i);
+		delete pieces[i].m_mesh;
 	}
 	m_debriRootEnt->FinalizeConstruction(vertexArray);
 
-	delete debrisMeshPieces;
 	ndConvexFractureRootEntity* const rootEntity = (ndConvexFractureRootEntity*)m_debriRootEnt;
 
 	// calculate joint graph pairs, brute force for now
@@ -216,9 +216,9 @@ void ndConvexFractureModel_2::Update(ndWorld* const, dFloat32)
 			if (contact->IsActive())
 			{
 				const ndContactPointList& contactPoints = contact->GetContactPoints();
-				for (ndContactPointList::dNode* contactNode = contactPoints.GetFirst(); contactNode; contactNode = contactNode->GetNext())
+				for (dInt32 i = 0; i < contactPoints.GetCount(); i++)
 				{
-					const ndContactMaterial& contactPoint = contactNode->GetInfo();
+					const ndContactMaterial& contactPoint = contactPoints[i];
 					const dFloat32 impulseImpact = contactPoint.m_normal_Force.m_impact;
 					if (impulseImpact > maxImpactImpulse)
 					{
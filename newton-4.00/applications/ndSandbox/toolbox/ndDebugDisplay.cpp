@@ -188,9 +188,9 @@ void RenderContactPoints(ndDemoEntityManager* const scene)
 		if (contact->IsActive())
 		{
 			const ndContactPointList& contactPoints = contact->GetContactPoints();
-			for (ndContactPointList::dNode* contactPointsNode = contactPoints.GetFirst(); contactPointsNode; contactPointsNode = contactPointsNode->GetNext())
+			for (dInt32 i = 0; i < contactPoints.GetCount(); i++)
 			{
-				const ndContactPoint& contactPoint = contactPointsNode->GetInfo();
+				const ndContactPoint& contactPoint = contactPoints[i];
 				dVector point(viewProjectionMatrix.TransformVector1x4(contactPoint.m_point));
 				dFloat32 zDist = point.m_w;
 				point = point.Scale(1.0f / zDist);
@@ -10,6 +10,39 @@
 */
 
 #include "testStdafx.h"
+#include "ndTestUtils.h"
+
+dInt32 ndDeterminismTest();
+dInt32 ndDeterminismBenchmark();
+dInt32 ndConvexCastBatchTest();
+dInt32 ndConvexCastBatchBenchmark();
+dInt32 ndContactCacheTest();
+dInt32 ndContactCacheBenchmark();
+dInt32 ndConvexHullCookTest();
+dInt32 ndBvhImageTest();
+dInt32 ndBvhImageBenchmark();
+dInt32 ndBvhBuildTest();
+dInt32 ndWorldSnapshotTest();
+dInt32 ndWorldSnapshotBenchmark();
+dInt32 ndReplicationTest();
+dInt32 ndWorldCheckpointTest();
+dInt32 ndWorldCheckpointBenchmark();
+dInt32 ndSphFluidTest();
+dInt32 ndSphFluidBenchmark();
+dInt32 ndHullPredicateTest();
+dInt32 ndSceneAggregateTest();
+dInt32 ndTriggerEventTest();
+dInt32 ndIsoSurfaceTest();
+dInt32 ndIsoSurfaceBenchmark();
+dInt32 ndMassSpringDamperTest();
+dInt32 ndMassSpringDamperBenchmark();
+dInt32 ndHeightfieldPyramidTest();
+dInt32 ndHeightfieldTiledTest();
+dInt32 ndConvexHullTest();
+dInt32 ndConvexHullBenchmark();
+dInt32 ndVoronoiFractureTest();
+dInt32 ndShapeCompoundTest();
+dInt32 ndPbfFluidTest();
 
 
 // memory allocation for Newton
@@ -104,9 +137,8 @@ dVector FindFloor(const ndWorld& world, const dVector& origin, dFloat32 dist)
 	dVector p0(origin);
 	dVector p1(origin - dVector(0.0f, dAbs(dist), 0.0f, 0.0f));
 
-	ndRayCastClosestHitCallback rayCaster(world.GetScene());
-	dFloat32 param = rayCaster.TraceRay(p0, p1);
-	return (param < 1.0f) ? rayCaster.m_contact.m_point : p0;
+	ndRayCastClosestHitCallback rayCaster;
+	return world.RayCast(rayCaster, p0, p1) ? rayCaster.m_contact.m_point : p0;
 }
 
 void BuildFloorBox(ndWorld& world)
@@ -140,7 +172,7 @@ ndShapeInstance xxx(new ndShapeSphere(1.0f));
 	// get the dimension from shape itself
 	dVector minP(0.0f);
 	dVector maxP(0.0f);
-	box.CalculateAABB(dGetIdentityMatrix(), minP, maxP);
+	box.CalculateAabb(dGetIdentityMatrix(), minP, maxP);
 
 	dFloat32 stepz = maxP.m_z - minP.m_z + 0.03125f;
 	dFloat32 stepy = (maxP.m_y - minP.m_y) - 0.01f;
@@ -206,15 +238,15 @@ matrix.m_posit.m_y += xxxx;
 	}
 }
 
-int main (int argc, const char * argv[]) 
+static dInt32 ndSmokeTest()
 {
 	ndWorld world;
 	world.SetSubSteps(2);
 	//world.SetThreadCount(2);
 
 	// test allocation
-	ndFixSizeBuffer<dVector, 10> buffer0;
-	ndFixSizeBuffer<dVector, 10>* const buffer1 = new ndFixSizeBuffer<dVector, 10>;
+	dFixSizeArray<dVector, 10> buffer0;
+	dFixSizeArray<dVector, 10>* const buffer1 = new dFixSizeArray<dVector, 10>;
 	(*buffer1)[0] = dVector (0.5f, 0.25f, 0.8f, 0.0f);
 	(*buffer1)[0] = (*buffer1)[0] + (*buffer1)[0];
 	delete buffer1;
@@ -239,3 +271,72 @@ int main (int argc, const char * argv[])
 
 	return 0;
 }
+
+class ndTestEntry
+{
+	public:
+	const char* m_name;
+	ndTestFunction m_function;
+	bool m_isBenchmark;
+};
+
+static ndTestEntry testList[] =
+{
+	{ "smoke", ndSmokeTest, false },
+	{ "determinism", ndDeterminismTest, false },
+	{ "determinism_benchmark", ndDeterminismBenchmark, true },
+	{ "convex_cast_batch", ndConvexCastBatchTest, false },
+	{ "convex_cast_batch_benchmark", ndConvexCastBatchBenchmark, true },
+	{ "contact_cache", ndContactCacheTest, false },
+	{ "contact_cache_benchmark", ndContactCacheBenchmark, true },
+	{ "convex_hull_cook", ndConvexHullCookTest, false },
+	{ "bvh_image", ndBvhImageTest, false },
+	{ "bvh_image_benchmark", ndBvhImageBenchmark, true },
+	{ "bvh_build", ndBvhBuildTest, false },
+	{ "world_snapshot", ndWorldSnapshotTest, false },
+	{ "world_snapshot_benchmark", ndWorldSnapshotBenchmark, true },
+	{ "replication", ndReplicationTest, false },
+	{ "world_checkpoint", ndWorldCheckpointTest, false },
+	{ "world_checkpoint_benchmark", ndWorldCheckpointBenchmark, true },
+	{ "sph_fluid", ndSphFluidTest, false },
+	{ "sph_fluid_benchmark", ndSphFluidBenchmark, true },
+	{ "hull_predicates", ndHullPredicateTest, false },
+	{ "scene_aggregate", ndSceneAggregateTest, false },
+	{ "trigger_events", ndTriggerEventTest, false },
+	{ "iso_surface", ndIsoSurfaceTest, false },
+	{ "iso_surface_benchmark", ndIsoSurfaceBenchmark, true },
+	{ "mass_spring_damper", ndMassSpringDamperTest, false },
+	{ "mass_spring_damper_benchmark", ndMassSpringDamperBenchmark, true },
+	{ "heightfield_pyramid", ndHeightfieldPyramidTest, false },
+	{ "heightfield_tiled", ndHeightfieldTiledTest, false },
+	{ "convex_hull", ndConvexHullTest, false },
+	{ "convex_hull_benchmark", ndConvexHullBenchmark, true },
+	{ "voronoi_fracture", ndVoronoiFractureTest, false },
+	{ "shape_compound", ndShapeCompoundTest, false },
+	{ "pbf_fluid", ndPbfFluidTest, false },
+};
+
+// no arguments runs every test, "benchmarks" runs every benchmark,
+// otherwise each argument is the name of a test or benchmark to run.
+int main (int argc, const char * argv[]) 
+{
+	dInt32 failed = 0;
+	const dInt32 testCount = dInt32(sizeof(testList) / sizeof(testList[0]));
+	const bool benchmarks = (argc == 2) && !strcmp(argv[1], "benchmarks");
+	for (dInt32 i = 0; i < testCount; i++)
+	{
+		bool run = (argc == 1) ? !testList[i].m_isBenchmark : (benchmarks && testList[i].m_isBenchmark);
+		for (dInt32 j = 1; j < argc; j++)
+		{
+			run = run || !strcmp(argv[j], testList[i].m_name);
+		}
+		if (run)
+		{
+			printf("%s\n", testList[i].m_name);
+			const dInt32 errors = testList[i].m_function();
+			printf("%s: %s\n", testList[i].m_name, errors ? "failed" : "passed");
+			failed += errors;
+		}
+	}
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,102 @@
+/* Copyright (c) <2003-2019> <Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely
+*/
+
+#include "testStdafx.h"
+#include "ndTestUtils.h"
+
+static void AddTriangle(dPolygonSoupBuilder& meshBuilder, const dVector& p0, const dVector& p1, const dVector& p2)
+{
+	dVector face[3];
+	face[0] = p0;
+	face[1] = p1;
+	face[2] = p2;
+	meshBuilder.AddFace(&face[0].m_x, sizeof(dVector), 3, 0);
+}
+
+// a bumpy grid of count x count quads split in triangles, the non manifold
+// mesh also has repeated faces, flipped faces and fins standing on shared edges
+static void BuildImage(dInt32 count, bool optimize, bool manifold, dThreadPool* const threadPool, dArray<char>& image)
+{
+	dSetRandSeed(23);
+	dArray<dVector> heights;
+	heights.SetCount((count + 1) * (count + 1));
+	for (dInt32 i = 0; i < heights.GetCount(); i++)
+	{
+		const dFloat32 x = dFloat32(i % (count + 1));
+		const dFloat32 z = dFloat32(i / (count + 1));
+		heights[i] = dVector(x, dRand() * dFloat32(0.5f), z, dFloat32(0.0f));
+	}
+
+	dPolygonSoupBuilder meshBuilder;
+	meshBuilder.SetThreadPool(threadPool);
+	meshBuilder.Begin();
+	for (dInt32 z = 0; z < count; z++)
+	{
+		for (dInt32 x = 0; x < count; x++)
+		{
+			const dInt32 i0 = z * (count + 1) + x;
+			const dInt32 i1 = i0 + count + 1;
+			AddTriangle(meshBuilder, heights[i0], heights[i1], heights[i0 + 1]);
+			AddTriangle(meshBuilder, heights[i0 + 1], heights[i1], heights[i1 + 1]);
+			if (!manifold && ((x * 7 + z * 3) % 11 == 0))
+			{
+				const dVector top((heights[i0] + heights[i1]) * dVector::m_half + dVector(dFloat32(0.0f), dFloat32(1.0f), dFloat32(0.0f), dFloat32(0.0f)));
+				switch ((x + z) % 3)
+				{
+					case 0:
+						AddTriangle(meshBuilder, heights[i0], heights[i1], heights[i0 + 1]);
+						break;
+					case 1:
+						AddTriangle(meshBuilder, heights[i0 + 1], heights[i1], heights[i0]);
+						break;
+					default:
+						AddTriangle(meshBuilder, heights[i1], heights[i0], top);
+						AddTriangle(meshBuilder, heights[i0], heights[i1], top);
+						break;
+				}
+			}
+		}
+	}
+	meshBuilder.End(optimize);
+
+	ndShapeStatic_bvh* const mesh = new ndShapeStatic_bvh(meshBuilder);
+	image.SetCount(dInt32(mesh->SerializeToBuffer(nullptr)));
+	mesh->SerializeToBuffer(&image[0]);
+	delete mesh;
+}
+
+// a mesh cooked with a thread pool must have the same image as the serial one
+static dInt32 CompareImages(dInt32 count, bool optimize, bool manifold)
+{
+	dInt32 failed = 0;
+	dArray<char> serialImage;
+	BuildImage(count, optimize, manifold, nullptr, serialImage);
+	for (dInt32 threadCount = 1; threadCount <= 4; threadCount++)
+	{
+		ndWorld world;
+		world.SetThreadCount(threadCount);
+		dArray<char> image;
+		BuildImage(count, optimize, manifold, world.GetScene(), image);
+		failed += ndTestCheck(image.GetCount() == serialImage.GetCount());
+		failed += ndTestCheck((image.GetCount() == serialImage.GetCount()) && !memcmp(&image[0], &serialImage[0], size_t(image.GetCount())));
+	}
+	return failed;
+}
+
+dInt32 ndBvhBuildTest()
+{
+	dInt32 failed = 0;
+	failed += CompareImages(48, false, true);
+	failed += CompareImages(48, false, false);
+	failed += CompareImages(32, true, true);
+	failed += CompareImages(32, true, false);
+	return failed;
+}
@@ -0,0 +1,222 @@
+/* Copyright (c) <2003-2019> <Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely
+*/
+
+#include "testStdafx.h"
+#include "ndTestUtils.h"
+
+// a bumpy grid of count x count quads split in triangles
+static ndShapeStatic_bvh* BuildTerrain(dInt32 count, dThreadPool* const threadPool)
+{
+	dArray<dVector> heights;
+	heights.SetCount((count + 1) * (count + 1));
+	for (dInt32 i = 0; i < heights.GetCount(); i++)
+	{
+		const dFloat32 x = dFloat32(i % (count + 1));
+		const dFloat32 z = dFloat32(i / (count + 1));
+		heights[i] = dVector(x, dRand() * dFloat32(0.5f), z, dFloat32(0.0f));
+	}
+
+	dPolygonSoupBuilder meshBuilder;
+	meshBuilder.SetThreadPool(threadPool);
+	meshBuilder.Begin();
+	for (dInt32 z = 0; z < count; z++)
+	{
+		for (dInt32 x = 0; x < count; x++)
+		{
+			const dInt32 i0 = z * (count + 1) + x;
+			const dInt32 i1 = i0 + count + 1;
+			dVector face[3];
+			face[0] = heights[i0];
+			face[1] = heights[i1];
+			face[2] = heights[i0 + 1];
+			meshBuilder.AddFace(&face[0].m_x, sizeof(dVector), 3, 0);
+			face[0] = heights[i0 + 1];
+			face[1] = heights[i1];
+			face[2] = heights[i1 + 1];
+			meshBuilder.AddFace(&face[0].m_x, sizeof(dVector), 3, 0);
+		}
+	}
+	meshBuilder.End(false);
+	return new ndShapeStatic_bvh(meshBuilder);
+}
+
+// corrupt one word of a mesh image at the time, the image must either 
+// be rejected or load into a mesh that can be traversed
+static dInt32 CheckImage(dInt32 threadCount, dInt32 corruptions)
+{
+	dInt32 failed = 0;
+	ndWorld world;
+	world.SetThreadCount(threadCount);
+	ndShapeStatic_bvh* const mesh = BuildTerrain(16, (threadCount > 1) ? world.GetScene() : nullptr);
+	const dInt64 size = mesh->SerializeToBuffer(nullptr);
+	dArray<char> image;
+	dArray<char> corrupted;
+	image.SetCount(dInt32(size));
+	corrupted.SetCount(dInt32(size));
+	mesh->SerializeToBuffer(&image[0]);
+	delete mesh;
+
+	failed += ndTestCheck(dAabbPolygonSoup::ValidateImage(&image[0], size));
+	failed += ndTestCheck(!dAabbPolygonSoup::ValidateImage(&image[0], size - 1));
+
+	const dInt32 wordCount = dInt32(size / sizeof(dInt32));
+	const dInt32 values[] = { -1, 1, 0x7fff, 0x7fffffff, -0x7fffffff };
+	dInt32 rejected = 0;
+	for (dInt32 i = 0; i < corruptions; i++)
+	{
+		memcpy(&corrupted[0], &image[0], size_t(size));
+		const dInt32 word = dInt32(dRand() * dFloat32(wordCount - 1));
+		dInt32* const data = (dInt32*)&corrupted[0];
+		data[word] = (i & 1) ? values[i % 5] : data[word] + dInt32(dRand() * dFloat32(64.0f)) - 32;
+		if (dAabbPolygonSoup::ValidateImage(&corrupted[0], size))
+		{
+			// the constructor walks every face to count the triangles
+			ndShapeInstance instance(new ndShapeStatic_bvh(&corrupted[0], size));
+		}
+		else
+		{
+			rejected++;
+		}
+	}
+	failed += ndTestCheck(rejected > 0);
+
+	// a mapped file with a bad image is not loaded
+	const char* const path = "ndBvhImageTest.bin";
+	for (dInt32 i = 0; i < 2; i++)
+	{
+		FILE* const file = fopen(path, "wb");
+		failed += ndTestCheck(file != nullptr);
+		if (file)
+		{
+			memcpy(&corrupted[0], &image[0], size_t(size));
+			if (i)
+			{
+				// a vertex offset inside the header
+				dInt32* const data = (dInt32*)&corrupted[0];
+				data[6] = 4;
+			}
+			fwrite(&corrupted[0], size_t(size), 1, file);
+			fclose(file);
+
+			dMappedFile* const mappedFile = dMappedFile::Open(path);
+			failed += ndTestCheck(mappedFile != nullptr);
+			if (mappedFile)
+			{
+				ndShapeStatic_bvh* const mappedMesh = ndShapeStatic_bvh::Load(mappedFile);
+				failed += ndTestCheck((mappedMesh != nullptr) == (i == 0));
+				if (mappedMesh)
+				{
+					ndShapeInstance instance(mappedMesh);
+				}
+				mappedFile->Release();
+			}
+		}
+	}
+	remove(path);
+	return failed;
+}
+
+dInt32 ndBvhImageTest()
+{
+	dInt32 failed = 0;
+	dSetRandSeed(11);
+	failed += CheckImage(1, 1000);
+	failed += CheckImage(2, 1000);
+	return failed;
+}
+
+// loads count images of a terrain, all at once, read into memory or mapped. 
+// the mapped images are validated on load, so their pages are resident after it,
+// but they are backed by the files and the os can drop them under pressure.
+// the resident memory of the read path can be lower than its allocations, 
+// when the heap reuses memory freed before the call.
+static void TimeLoad(const char* const name, dInt32 count, bool mapped)
+{
+	char path[256];
+	dArray<ndShapeInstance*> shapes;
+	const dUnsigned64 resident = ndGetResidentMemory();
+	const dUnsigned64 privateMemory = ndGetPrivateMemory();
+	const dUnsigned64 engineMemory = dMemory::GetMemoryUsed();
+	const dFloat64 start = ndGetTimeInMs();
+	for (dInt32 i = 0; i < count; i++)
+	{
+		sprintf(path, "ndBvhImageBenchmark%d.bin", i);
+		ndShapeStatic_bvh* mesh = nullptr;
+		if (mapped)
+		{
+			dMappedFile* const mappedFile = dMappedFile::Open(path);
+			if (mappedFile)
+			{
+				mesh = ndShapeStatic_bvh::Load(mappedFile);
+				mappedFile->Release();
+			}
+		}
+		else
+		{
+			FILE* const file = fopen(path, "rb");
+			if (file)
+			{
+				fseek(file, 0, SEEK_END);
+				const dInt64 size = dInt64(ftell(file));
+				fseek(file, 0, SEEK_SET);
+				dArray<char> image;
+				image.SetCount(dInt32(size));
+				if (fread(&image[0], size_t(size), 1, file) == 1)
+				{
+					mesh = new ndShapeStatic_bvh(&image[0], size);
+				}
+				fclose(file);
+			}
+		}
+		if (mesh)
+		{
+			shapes.PushBack(new ndShapeInstance(mesh));
+		}
+	}
+	const dFloat64 time = ndGetTimeInMs() - start;
+	const dFloat64 residentGrowth = dFloat64(dInt64(ndGetResidentMemory() - resident)) / (1024.0 * 1024.0);
+	const dFloat64 privateGrowth = dFloat64(dInt64(ndGetPrivateMemory() - privateMemory)) / (1024.0 * 1024.0);
+	const dFloat64 engineGrowth = dFloat64(dInt64(dMemory::GetMemoryUsed() - engineMemory)) / (1024.0 * 1024.0);
+	printf("  %s: %d of %d images: %.2f ms  resident %.1f mb  private %.1f mb  engine allocations %.1f mb\n", name, shapes.GetCount(), count, time, residentGrowth, privateGrowth, engineGrowth);
+
+	for (dInt32 i = 0; i < shapes.GetCount(); i++)
+	{
+		delete shapes[i];
+	}
+}
+
+dInt32 ndBvhImageBenchmark()
+{
+	const dInt32 count = 16;
+	dSetRandSeed(11);
+	char path[256];
+	dInt64 imageSize = 0;
+	for (dInt32 i = 0; i < count; i++)
+	{
+		ndShapeStatic_bvh* const mesh = BuildTerrain(128, nullptr);
+		sprintf(path, "ndBvhImageBenchmark%d.bin", i);
+		mesh->Serialize(path);
+		imageSize = mesh->SerializeToBuffer(nullptr);
+		delete mesh;
+	}
+	printf("  %d images of %.1f kb\n", count, dFloat64(imageSize) / 1024.0);
+
+	// the mapped path runs first, so it does not reuse memory freed by the read path
+	TimeLoad("mapped", count, true);
+	TimeLoad("read", count, false);
+
+	for (dInt32 i = 0; i < count; i++)
+	{
+		sprintf(path, "ndBvhImageBenchmark%d.bin", i);
+		remove(path);
+	}
+	return 0;
+}
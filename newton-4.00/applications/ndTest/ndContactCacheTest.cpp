@@ -0,0 +1,72 @@
+/* Copyright (c) <2003-2019> <Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely
+*/
+
+#include "testStdafx.h"
+#include "ndTestUtils.h"
+
+// steps a box pile and returns the lowest box height,
+// the average contact cache hit rate and the time per step
+static dFloat32 SimulatePile(dInt32 count, dInt32 layers, dInt32 steps, dInt32 threadCount, dFloat32* const hitRate, dFloat64* const msPerStep)
+{
+	ndWorld world;
+	world.SetThreadCount(threadCount);
+	ndBuildBoxPile(world, count, layers);
+
+	dInt32 hits = 0;
+	dInt32 misses = 0;
+	const dFloat64 start = ndGetTimeInMs();
+	for (dInt32 i = 0; i < steps; i++)
+	{
+		world.Update(dFloat32(1.0f / 60.0f));
+		world.Sync();
+		hits += world.GetScene()->GetContactCacheHits();
+		misses += world.GetScene()->GetContactCacheMisses();
+	}
+	*msPerStep = (ndGetTimeInMs() - start) / steps;
+	*hitRate = (hits + misses) ? dFloat32(hits) / dFloat32(hits + misses) : dFloat32(0.0f);
+
+	dFloat32 lowest = dFloat32(1.0e10f);
+	const ndBodyList& bodyList = world.GetBodyList();
+	for (ndBodyList::dNode* node = bodyList.GetFirst(); node; node = node->GetNext())
+	{
+		const ndBodyKinematic* const body = node->GetInfo();
+		if (body->GetInvMass() > dFloat32(0.0f))
+		{
+			lowest = dMin(lowest, body->GetMatrix().m_posit.m_y);
+		}
+	}
+	return lowest;
+}
+
+// a collapsing pile must reuse part of its manifolds and no box may sink through the floor
+dInt32 ndContactCacheTest()
+{
+	dFloat32 hitRate;
+	dFloat64 msPerStep;
+	dInt32 failed = 0;
+	const dFloat32 lowest = SimulatePile(4, 4, 300, 1, &hitRate, &msPerStep);
+	failed += ndTestCheck(lowest > dFloat32(0.1f));
+	failed += ndTestCheck(hitRate > dFloat32(0.1f));
+	return failed;
+}
+
+dInt32 ndContactCacheBenchmark()
+{
+	const dInt32 threadCounts[] = { 1, 2, 4 };
+	for (dInt32 i = 0; i < dInt32(sizeof(threadCounts) / sizeof(threadCounts[0])); i++)
+	{
+		dFloat32 hitRate;
+		dFloat64 msPerStep;
+		const dFloat32 lowest = SimulatePile(8, 8, 300, threadCounts[i], &hitRate, &msPerStep);
+		printf("  %d threads: %.3f ms/step  contact cache hit rate %.1f%%  lowest box %.3f\n", threadCounts[i], msPerStep, hitRate * 100.0f, lowest);
+	}
+	return 0;
+}
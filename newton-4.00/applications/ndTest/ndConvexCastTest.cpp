@@ -0,0 +1,143 @@
+/* Copyright (c) <2003-2019> <Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely
+*/
+
+#include "testStdafx.h"
+#include "ndTestUtils.h"
+
+class ndConvexCastHit: public ndConvexCastNotify
+{
+	public:
+	ndConvexCastHit()
+		:ndConvexCastNotify()
+	{
+	}
+
+	virtual dUnsigned32 OnRayPrecastAction(const ndBody* const, const ndShapeInstance* const)
+	{
+		return 1;
+	}
+};
+
+// a grid of static boxes of random heights
+static void BuildBoxField(ndWorld& world, dInt32 count)
+{
+	dSetRandSeed(1);
+	for (dInt32 z = 0; z < count; z++)
+	{
+		for (dInt32 x = 0; x < count; x++)
+		{
+			const dFloat32 height = dFloat32(0.5f) + dRand() * dFloat32(2.0f);
+			ndShapeInstance box(new ndShapeBox(dFloat32(0.8f), height, dFloat32(0.8f)));
+			dMatrix matrix(dYawMatrix(dRand() * dFloat32(3.0f)));
+			matrix.m_posit = dVector(dFloat32(x) - dFloat32(count) * dFloat32(0.5f), height * dFloat32(0.5f), dFloat32(z) - dFloat32(count) * dFloat32(0.5f), dFloat32(1.0f));
+
+			ndBodyDynamic* const body = new ndBodyDynamic();
+			body->SetNotifyCallback(new ndBodyNotify(dVector::m_zero));
+			body->SetMatrix(matrix);
+			body->SetCollisionShape(box);
+			world.AddBody(body);
+		}
+	}
+	world.Update(dFloat32(1.0f / 60.0f));
+	world.Sync();
+}
+
+// short sweeps from random points above the field in random directions,
+// returns the number of sweeps whose batched result differs from the single query
+static dInt32 CompareSweeps(dInt32 fieldSize, dInt32 sweepCount, dInt32 threadCount, bool report)
+{
+	ndWorld world;
+	world.SetThreadCount(threadCount);
+	BuildBoxField(world, fieldSize);
+
+	ndShapeInstance capsule(new ndShapeCapsule(dFloat32(0.25f), dFloat32(0.25f), dFloat32(0.5f)));
+	dArray<ndConvexCastHit> singleHits;
+	dArray<ndConvexCastHit> batchHits;
+	dArray<ndConvexCastQuery> queries;
+	singleHits.SetCount(sweepCount);
+	batchHits.SetCount(sweepCount);
+	queries.SetCount(sweepCount);
+
+	const dFloat32 extent = dFloat32(fieldSize) * dFloat32(0.5f);
+	for (dInt32 i = 0; i < sweepCount; i++)
+	{
+		dMatrix origin(dPitchMatrix(dRand() * dFloat32(3.0f)) * dYawMatrix(dRand() * dFloat32(3.0f)));
+		origin.m_posit = dVector((dRand() * dFloat32(2.0f) - dFloat32(1.0f)) * extent, dFloat32(1.0f) + dRand() * dFloat32(2.0f), (dRand() * dFloat32(2.0f) - dFloat32(1.0f)) * extent, dFloat32(1.0f));
+		const dVector dir(dRand() * dFloat32(2.0f) - dFloat32(1.0f), -dRand(), dRand() * dFloat32(2.0f) - dFloat32(1.0f), dFloat32(0.0f));
+		const dVector dest(origin.m_posit + dir.Scale(dFloat32(3.0f)));
+		new (&singleHits[i]) ndConvexCastHit();
+		new (&batchHits[i]) ndConvexCastHit();
+		queries[i] = ndConvexCastQuery(&batchHits[i], &capsule, origin, dest);
+	}
+
+	dFloat64 start = ndGetTimeInMs();
+	for (dInt32 i = 0; i < sweepCount; i++)
+	{
+		world.ConvexCast(singleHits[i], capsule, queries[i].m_origin, queries[i].m_dest);
+	}
+	const dFloat64 singleTime = ndGetTimeInMs() - start;
+
+	start = ndGetTimeInMs();
+	world.ConvexCastBatch(&queries[0], sweepCount);
+	const dFloat64 batchTime = ndGetTimeInMs() - start;
+
+	dInt32 hits = 0;
+	dInt32 mismatches = 0;
+	for (dInt32 i = 0; i < sweepCount; i++)
+	{
+		const ndConvexCastHit& a = singleHits[i];
+		const ndConvexCastHit& b = batchHits[i];
+		hits += a.m_contacts.GetCount() ? 1 : 0;
+		const bool same = (a.m_param == b.m_param) && (a.m_contacts.GetCount() == b.m_contacts.GetCount());
+		mismatches += same ? 0 : 1;
+	}
+
+	if (report)
+	{
+		printf("  %d sweeps over %d boxes, %d threads, %d hits: single %.3f ms  batch %.3f ms  mismatches %d\n",
+			sweepCount, fieldSize * fieldSize, threadCount, hits, singleTime, batchTime, mismatches);
+	}
+	return mismatches;
+}
+
+// a batch over an empty scene clears the results left by a previous cast
+static dInt32 CheckEmptyScene()
+{
+	dInt32 failed = 0;
+	ndWorld world;
+	ndShapeInstance capsule(new ndShapeCapsule(dFloat32(0.25f), dFloat32(0.25f), dFloat32(0.5f)));
+	ndConvexCastHit hit;
+	hit.m_param = dFloat32(0.5f);
+	hit.m_contacts.PushBack(ndContactPoint());
+	ndConvexCastQuery query(&hit, &capsule, dGetIdentityMatrix(), dVector(dFloat32(1.0f), dFloat32(0.0f), dFloat32(0.0f), dFloat32(1.0f)));
+	world.ConvexCastBatch(&query, 1);
+	failed += ndTestCheck(hit.m_param == dFloat32(1.2f));
+	failed += ndTestCheck(hit.m_contacts.GetCount() == 0);
+	return failed;
+}
+
+// batched sweeps must return the same hits as the same sweeps issued one at the time
+dInt32 ndConvexCastBatchTest()
+{
+	dInt32 failed = 0;
+	failed += ndTestCheck(CompareSweeps(20, 1000, 1, false) == 0);
+	failed += ndTestCheck(CompareSweeps(20, 1000, 3, false) == 0);
+	failed += CheckEmptyScene();
+	return failed;
+}
+
+dInt32 ndConvexCastBatchBenchmark()
+{
+	CompareSweeps(40, 10000, 1, true);
+	CompareSweeps(40, 10000, 2, true);
+	CompareSweeps(40, 10000, 4, true);
+	return 0;
+}
@@ -0,0 +1,90 @@
+/* Copyright (c) <2003-2019> <Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely
+*/
+
+#include "testStdafx.h"
+#include "ndTestUtils.h"
+
+// points on a unit sphere, enough of them make a hull with a support tree
+static ndShapeConvexHull* BuildHull(dInt32 count)
+{
+	dArray<dVector> points;
+	points.SetCount(count);
+	for (dInt32 i = 0; i < count; i++)
+	{
+		const dVector p(dRand() * dFloat32(2.0f) - dFloat32(1.0f), dRand() * dFloat32(2.0f) - dFloat32(1.0f), dRand() * dFloat32(2.0f) - dFloat32(1.0f), dFloat32(0.0f));
+		points[i] = p.Normalize();
+	}
+	return new ndShapeConvexHull(count, sizeof(dVector), dFloat32(0.0f), &points[0].m_x);
+}
+
+static dInt32 SupportChecksum(const ndShapeInstance& instance)
+{
+	dInt32 checksum = 0;
+	for (dInt32 i = 0; i < 64; i++)
+	{
+		const dVector dir(dVector(dRand() - dFloat32(0.5f), dRand() - dFloat32(0.5f), dRand() - dFloat32(0.5f), dFloat32(0.0f)).Normalize());
+		const dVector support(instance.SupportVertex(dir));
+		checksum += (support.DotProduct(dir).GetScalar() > dFloat32(0.0f)) ? 1 : 0;
+	}
+	return checksum;
+}
+
+// corrupt one word of a cooked hull at the time, the data must either 
+// be rejected or load into a shape that can be queried
+static dInt32 CheckCookedHull(dInt32 pointCount, dInt32 corruptions)
+{
+	dInt32 failed = 0;
+	ndShapeConvexHull* const hull = BuildHull(pointCount);
+	const dInt64 size = hull->SerializeToBuffer(nullptr);
+	dArray<char> cooked;
+	dArray<char> corrupted;
+	cooked.SetCount(dInt32(size));
+	corrupted.SetCount(dInt32(size));
+	hull->SerializeToBuffer(&cooked[0]);
+	delete hull;
+
+	failed += ndTestCheck(ndShapeConvexHull::ValidateCookedData(&cooked[0], size));
+	failed += ndTestCheck(!ndShapeConvexHull::ValidateCookedData(&cooked[0], size - 1));
+	ndShapeInstance loaded(new ndShapeConvexHull(&cooked[0]));
+	failed += ndTestCheck(loaded.GetConvexVertexCount() > 4);
+	failed += ndTestCheck(SupportChecksum(loaded) == 64);
+
+	const dInt32 wordCount = dInt32(size / sizeof(dInt32));
+	const dInt32 values[] = { -1, 1, 0x7fff, 0x7fffffff, -0x7fffffff };
+	dInt32 rejected = 0;
+	for (dInt32 i = 0; i < corruptions; i++)
+	{
+		memcpy(&corrupted[0], &cooked[0], size_t(size));
+		const dInt32 word = dInt32(dRand() * dFloat32(wordCount - 1));
+		dInt32* const data = (dInt32*)&corrupted[0];
+		data[word] = (i & 1) ? values[i % 5] : data[word] + dInt32(dRand() * dFloat32(64.0f)) - 32;
+		if (ndShapeConvexHull::ValidateCookedData(&corrupted[0], size))
+		{
+			ndShapeInstance instance(new ndShapeConvexHull(&corrupted[0]));
+			SupportChecksum(instance);
+		}
+		else
+		{
+			rejected++;
+		}
+	}
+	failed += ndTestCheck(rejected > 0);
+	return failed;
+}
+
+dInt32 ndConvexHullCookTest()
+{
+	dInt32 failed = 0;
+	dSetRandSeed(7);
+	failed += CheckCookedHull(20, 2000);
+	failed += CheckCookedHull(400, 2000);
+	return failed;
+}
@@ -0,0 +1,286 @@
+/* Copyright (c) <2003-2019> <Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely
+*/
+
+#include "testStdafx.h"
+#include "ndTestUtils.h"
+
+// a face of a 3d hull as its three vertices, starting with the smallest one so the winding is kept
+class ndHullTestFace
+{
+	public:
+	dFloat64 m_points[9];
+};
+
+// a face of a 4d hull as the sorted indices of its four vertices in the cloud
+class ndHullTestTetra
+{
+	public:
+	dInt32 m_index[4];
+};
+
+static dInt32 ComparePoints(const dFloat64* const a, const dFloat64* const b)
+{
+	for (dInt32 i = 0; i < 3; i++)
+	{
+		if (a[i] != b[i])
+		{
+			return (a[i] < b[i]) ? -1 : 1;
+		}
+	}
+	return 0;
+}
+
+static dInt32 CompareFaces(const ndHullTestFace* const faceA, const ndHullTestFace* const faceB, void* const)
+{
+	for (dInt32 i = 0; i < 3; i++)
+	{
+		const dInt32 test = ComparePoints(&faceA->m_points[i * 3], &faceB->m_points[i * 3]);
+		if (test)
+		{
+			return test;
+		}
+	}
+	return 0;
+}
+
+static dInt32 CompareTetras(const ndHullTestTetra* const tetraA, const ndHullTestTetra* const tetraB, void* const)
+{
+	for (dInt32 i = 0; i < 4; i++)
+	{
+		if (tetraA->m_index[i] != tetraB->m_index[i])
+		{
+			return (tetraA->m_index[i] < tetraB->m_index[i]) ? -1 : 1;
+		}
+	}
+	return 0;
+}
+
+static void GetFaces(const dConvexHull3d& hull, dArray<ndHullTestFace>& faces)
+{
+	faces.SetCount(0);
+	for (dConvexHull3d::dNode* node = hull.GetFirst(); node; node = node->GetNext())
+	{
+		const dConvexHull3dFace& face = node->GetInfo();
+		dInt32 first = 0;
+		for (dInt32 i = 1; i < 3; i++)
+		{
+			const dInt32 test = ComparePoints(&hull.GetVertex(face.m_index[i]).m_x, &hull.GetVertex(face.m_index[first]).m_x);
+			first = (test < 0) ? i : first;
+		}
+
+		ndHullTestFace key;
+		for (dInt32 i = 0; i < 3; i++)
+		{
+			const dBigVector& p = hull.GetVertex(face.m_index[(first + i) % 3]);
+			key.m_points[i * 3 + 0] = p.m_x;
+			key.m_points[i * 3 + 1] = p.m_y;
+			key.m_points[i * 3 + 2] = p.m_z;
+		}
+		faces.PushBack(key);
+	}
+	if (faces.GetCount())
+	{
+		dSort(&faces[0], faces.GetCount(), CompareFaces);
+	}
+}
+
+static void GetTetras(const dConvexHull4d& hull, dArray<ndHullTestTetra>& tetras)
+{
+	tetras.SetCount(0);
+	for (dConvexHull4d::dNode* node = hull.GetFirst(); node; node = node->GetNext())
+	{
+		const dConvexHull4dTetraherum& tetra = node->GetInfo();
+		ndHullTestTetra key;
+		for (dInt32 i = 0; i < 4; i++)
+		{
+			key.m_index[i] = hull.GetVertexIndex(tetra.m_faces[0].m_index[i]);
+		}
+		for (dInt32 i = 1; i < 4; i++)
+		{
+			for (dInt32 j = i; (j > 0) && (key.m_index[j - 1] > key.m_index[j]); j--)
+			{
+				dSwap(key.m_index[j - 1], key.m_index[j]);
+			}
+		}
+		tetras.PushBack(key);
+	}
+	if (tetras.GetCount())
+	{
+		dSort(&tetras[0], tetras.GetCount(), CompareTetras);
+	}
+}
+
+// points inside a ball, one in surfaceStride moved to its surface
+static void BuildCloud3d(dInt32 count, dInt32 surfaceStride, dArray<dBigVector>& cloud)
+{
+	cloud.SetCount(0);
+	while (cloud.GetCount() < count)
+	{
+		dBigVector p(dFloat64(dRand()) * 2.0 - 1.0, dFloat64(dRand()) * 2.0 - 1.0, dFloat64(dRand()) * 2.0 - 1.0, dFloat64(0.0f));
+		const dFloat64 mag2 = p.DotProduct(p).GetScalar();
+		if ((mag2 > dFloat64(1.0e-3f)) && (mag2 < dFloat64(1.0f)))
+		{
+			if (surfaceStride && !(cloud.GetCount() % surfaceStride))
+			{
+				p = p.Scale(dFloat64(1.0f) / sqrt(mag2));
+			}
+			cloud.PushBack(p);
+		}
+	}
+}
+
+// the same in four dimensions, the 4d hull keeps the w component
+static void BuildCloud4d(dInt32 count, dInt32 surfaceStride, dArray<dBigVector>& cloud)
+{
+	cloud.SetCount(0);
+	while (cloud.GetCount() < count)
+	{
+		dBigVector p(dFloat64(dRand()) * 2.0 - 1.0, dFloat64(dRand()) * 2.0 - 1.0, dFloat64(dRand()) * 2.0 - 1.0, dFloat64(dRand()) * 2.0 - 1.0);
+		const dFloat64 mag2 = p.DotProduct(p).GetScalar();
+		if ((mag2 > dFloat64(1.0e-3f)) && (mag2 < dFloat64(1.0f)))
+		{
+			if (surfaceStride && !(cloud.GetCount() % surfaceStride))
+			{
+				p = p.Scale(dFloat64(1.0f) / sqrt(mag2));
+			}
+			cloud.PushBack(p);
+		}
+	}
+}
+
+// the chunked hull built on a pool of any size has the same faces as the serial hull
+static dInt32 CheckHull3d(const dArray<dBigVector>& cloud)
+{
+	dInt32 failed = 0;
+	dArray<ndHullTestFace> serialFaces;
+	dConvexHull3d serial(&cloud[0].m_x, sizeof(dBigVector), cloud.GetCount(), dFloat64(0.0f));
+	GetFaces(serial, serialFaces);
+	failed += ndTestCheck(serialFaces.GetCount() > 1000);
+
+	for (dInt32 threadCount = 1; threadCount <= 4; threadCount++)
+	{
+		ndWorld world;
+		world.SetThreadCount(threadCount);
+		dArray<ndHullTestFace> faces;
+		dConvexHull3d hull(&cloud[0].m_x, sizeof(dBigVector), cloud.GetCount(), dFloat64(0.0f), 0x7fffffff, world.GetScene());
+		GetFaces(hull, faces);
+		failed += ndTestCheck(faces.GetCount() == serialFaces.GetCount());
+		if (faces.GetCount() == serialFaces.GetCount())
+		{
+			failed += ndTestCheck(!memcmp(&faces[0], &serialFaces[0], size_t(faces.GetCount()) * sizeof(ndHullTestFace)));
+		}
+	}
+	return failed;
+}
+
+static dInt32 CheckHull4d(const dArray<dBigVector>& cloud)
+{
+	dInt32 failed = 0;
+	dArray<ndHullTestTetra> serialTetras;
+	dConvexHull4d serial(&cloud[0].m_x, sizeof(dBigVector), cloud.GetCount(), dFloat64(0.0f));
+	GetTetras(serial, serialTetras);
+	failed += ndTestCheck(serialTetras.GetCount() > 1000);
+
+	for (dInt32 threadCount = 1; threadCount <= 4; threadCount++)
+	{
+		ndWorld world;
+		world.SetThreadCount(threadCount);
+		dArray<ndHullTestTetra> tetras;
+		dConvexHull4d hull(&cloud[0].m_x, sizeof(dBigVector), cloud.GetCount(), dFloat64(0.0f), world.GetScene());
+		GetTetras(hull, tetras);
+		failed += ndTestCheck(tetras.GetCount() == serialTetras.GetCount());
+		if (tetras.GetCount() == serialTetras.GetCount())
+		{
+			failed += ndTestCheck(!memcmp(&tetras[0], &serialTetras[0], size_t(tetras.GetCount()) * sizeof(ndHullTestTetra)));
+		}
+	}
+	return failed;
+}
+
+// clouds of three chunks and a partial one, so the pools take the chunked path
+dInt32 ndConvexHullTest()
+{
+	dInt32 failed = 0;
+	dSetRandSeed(38);
+	dArray<dBigVector> cloud;
+	BuildCloud3d(3 * 4096 + 517, 4, cloud);
+	failed += CheckHull3d(cloud);
+
+	BuildCloud4d(2 * 4096 + 517, 16, cloud);
+	failed += CheckHull4d(cloud);
+	return failed;
+}
+
+static void TimeHull3d(const char* const name, const dArray<dBigVector>& cloud, dInt32 repeats)
+{
+	dFloat64 start = ndGetTimeInMs();
+	dInt32 faceCount = 0;
+	for (dInt32 i = 0; i < repeats; i++)
+	{
+		dConvexHull3d hull(&cloud[0].m_x, sizeof(dBigVector), cloud.GetCount(), dFloat64(0.0f));
+		faceCount = hull.GetCount();
+	}
+	printf("  %s: %d points, %d faces: serial %.2f ms", name, cloud.GetCount(), faceCount, (ndGetTimeInMs() - start) / dFloat64(repeats));
+
+	for (dInt32 threadCount = 2; threadCount <= 4; threadCount += 2)
+	{
+		ndWorld world;
+		world.SetThreadCount(threadCount);
+		start = ndGetTimeInMs();
+		for (dInt32 i = 0; i < repeats; i++)
+		{
+			dConvexHull3d hull(&cloud[0].m_x, sizeof(dBigVector), cloud.GetCount(), dFloat64(0.0f), 0x7fffffff, world.GetScene());
+		}
+		printf("  %d threads %.2f ms", world.GetThreadCount(), (ndGetTimeInMs() - start) / dFloat64(repeats));
+	}
+	printf("\n");
+}
+
+static void TimeHull4d(const char* const name, const dArray<dBigVector>& cloud, dInt32 repeats)
+{
+	dFloat64 start = ndGetTimeInMs();
+	dInt32 tetraCount = 0;
+	for (dInt32 i = 0; i < repeats; i++)
+	{
+		dConvexHull4d hull(&cloud[0].m_x, sizeof(dBigVector), cloud.GetCount(), dFloat64(0.0f));
+		tetraCount = hull.GetCount();
+	}
+	printf("  %s: %d points, %d tetrahedra: serial %.2f ms", name, cloud.GetCount(), tetraCount, (ndGetTimeInMs() - start) / dFloat64(repeats));
+
+	for (dInt32 threadCount = 2; threadCount <= 4; threadCount += 2)
+	{
+		ndWorld world;
+		world.SetThreadCount(threadCount);
+		start = ndGetTimeInMs();
+		for (dInt32 i = 0; i < repeats; i++)
+		{
+			dConvexHull4d hull(&cloud[0].m_x, sizeof(dBigVector), cloud.GetCount(), dFloat64(0.0f), world.GetScene());
+		}
+		printf("  %d threads %.2f ms", world.GetThreadCount(), (ndGetTimeInMs() - start) / dFloat64(repeats));
+	}
+	printf("\n");
+}
+
+// the speed up depends on how many points of each chunk are hull vertices
+dInt32 ndConvexHullBenchmark()
+{
+	dSetRandSeed(38);
+	dArray<dBigVector> cloud;
+	BuildCloud3d(200000, 0, cloud);
+	TimeHull3d("3d ball", cloud, 3);
+
+	BuildCloud3d(2 * 4096, 1, cloud);
+	TimeHull3d("3d sphere", cloud, 1);
+
+	BuildCloud4d(50000, 0, cloud);
+	TimeHull4d("4d ball", cloud, 1);
+	return 0;
+}
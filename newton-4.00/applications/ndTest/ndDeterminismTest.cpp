@@ -0,0 +1,65 @@
+/* Copyright (c) <2003-2019> <Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely
+*/
+
+#include "testStdafx.h"
+#include "ndTestUtils.h"
+
+static dUnsigned64 SimulatePile(dInt32 count, dInt32 layers, dInt32 steps, dInt32 threadCount, bool deterministic, dFloat64* const msPerStep)
+{
+	ndWorld world;
+	world.SetThreadCount(threadCount);
+	world.SetDeterministic(deterministic);
+	ndBuildBoxPile(world, count, layers);
+
+	const dFloat64 start = ndGetTimeInMs();
+	for (dInt32 i = 0; i < steps; i++)
+	{
+		world.Update(dFloat32(1.0f / 60.0f));
+		world.Sync();
+	}
+	if (msPerStep)
+	{
+		*msPerStep = (ndGetTimeInMs() - start) / steps;
+	}
+	return ndHashBodies(world);
+}
+
+// the same scene stepped with 1, 2 and 4 threads must end in the same state
+dInt32 ndDeterminismTest()
+{
+	dInt32 failed = 0;
+	const dUnsigned64 hash1 = SimulatePile(4, 4, 300, 1, true, nullptr);
+	const dUnsigned64 hash2 = SimulatePile(4, 4, 300, 2, true, nullptr);
+	const dUnsigned64 hash4 = SimulatePile(4, 4, 300, 4, true, nullptr);
+	const dUnsigned64 hash1Again = SimulatePile(4, 4, 300, 1, true, nullptr);
+	failed += ndTestCheck(hash1 == hash1Again);
+	failed += ndTestCheck(hash1 == hash2);
+	failed += ndTestCheck(hash1 == hash4);
+	return failed;
+}
+
+// cost of the deterministic mode on a 512 box pile
+dInt32 ndDeterminismBenchmark()
+{
+	const dInt32 threadCounts[] = { 1, 2, 4 };
+	for (dInt32 i = 0; i < dInt32(sizeof(threadCounts) / sizeof(threadCounts[0])); i++)
+	{
+		dFloat64 defaultTime;
+		dFloat64 deterministicTime;
+		const dInt32 threads = threadCounts[i];
+		const dUnsigned64 defaultHash = SimulatePile(8, 8, 300, threads, false, &defaultTime);
+		const dUnsigned64 deterministicHash = SimulatePile(8, 8, 300, threads, true, &deterministicTime);
+		printf("  %d threads: default %.3f ms/step (hash %016llx)  deterministic %.3f ms/step (hash %016llx)  cost %+.1f%%\n",
+			threads, defaultTime, (unsigned long long)defaultHash, deterministicTime, (unsigned long long)deterministicHash,
+			(deterministicTime / defaultTime - 1.0) * 100.0);
+	}
+	return 0;
+}
@@ -0,0 +1,265 @@
+/* Copyright (c) <2003-2019> <Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely
+*/
+
+#include "testStdafx.h"
+#include "ndTestUtils.h"
+
+#define D_PYRAMID_TEST_SCALE_Y	dFloat32 (1.0f / 64.0f)
+#define D_PYRAMID_TEST_SCALE_X	dFloat32 (0.5f)
+#define D_PYRAMID_TEST_SCALE_Z	dFloat32 (0.75f)
+
+// exposes the protected queries, and a reference for each of them
+// that visits every cell or every vertex of the grid
+class ndTestHeightfield: public ndShapeHeightfield
+{
+	public:
+	ndTestHeightfield(dInt32 width, dInt32 height, ndGridConstruction constructionMode)
+		:ndShapeHeightfield(width, height, constructionMode, D_PYRAMID_TEST_SCALE_Y, D_PYRAMID_TEST_SCALE_X, D_PYRAMID_TEST_SCALE_Z)
+		,m_width(width)
+		,m_height(height)
+		,m_mode(constructionMode)
+	{
+	}
+
+	dFloat32 CastRay(const dVector& p0, const dVector& p1, dVector& normal) const
+	{
+		ndContactPoint contact;
+		ndRayCastClosestHitCallback callback;
+		const dFloat32 t = RayCast(callback, p0, p1, dFloat32(1.0f), nullptr, contact);
+		normal = contact.m_normal;
+		return t;
+	}
+
+	void GetMinMax(dInt32 x0, dInt32 x1, dInt32 z0, dInt32 z1, dFloat32& minHeight, dFloat32& maxHeight) const
+	{
+		CalculateMinAndMaxElevation(x0, x1, z0, z1, minHeight, maxHeight);
+	}
+
+	// the two triangles of every cell, with the same split and normals as RayCastCell
+	dFloat32 CastRayAllCells(const dVector& p0, const dVector& p1, dVector& normalOut) const
+	{
+		const dFastRayTest ray(p0, p1);
+		const dArray<dInt16>& elevation = GetElevationMap();
+		dFloat32 maxT = dFloat32(1.0f);
+		dFloat32 hit = dFloat32(1.2f);
+		for (dInt32 z = 0; z < m_height - 1; z++)
+		{
+			for (dInt32 x = 0; x < m_width - 1; x++)
+			{
+				const dInt32 base = z * m_width + x;
+				dVector points[4];
+				points[0] = Point(x, z, elevation[base]);
+				points[1] = Point(x + 1, z, elevation[base + 1]);
+				points[3] = Point(x + 1, z + 1, elevation[base + m_width + 1]);
+				points[2] = Point(x, z + 1, elevation[base + m_width]);
+
+				const dInt32 normalTriangles[2][3] = { { 1, 2, 3 }, { 1, 0, 2 } };
+				const dInt32 invertedTriangles[2][3] = { { 0, 2, 3 }, { 0, 3, 1 } };
+				const dInt32 (*triangles)[3] = (m_mode == m_normalDiagonals) ? normalTriangles : invertedTriangles;
+				for (dInt32 i = 0; i < 2; i++)
+				{
+					const dInt32* const triangle = triangles[i];
+					const dVector e10(points[triangle[1]] - points[triangle[0]]);
+					const dVector e20(points[triangle[2]] - points[triangle[0]]);
+					const dVector normal(e10.CrossProduct(e20).Normalize());
+					const dFloat32 t = ray.PolygonIntersect(normal, maxT, &points[0].m_x, sizeof(dVector), triangle, 3);
+					if (t < hit)
+					{
+						hit = t;
+						maxT = t;
+						normalOut = normal;
+					}
+				}
+			}
+		}
+		return hit;
+	}
+
+	void GetMinMaxAllVertices(dInt32 x0, dInt32 x1, dInt32 z0, dInt32 z1, dFloat32& minHeight, dFloat32& maxHeight) const
+	{
+		dInt16 minVal = 0x7fff;
+		dInt16 maxVal = -0x7fff;
+		const dArray<dInt16>& elevation = GetElevationMap();
+		for (dInt32 z = z0; z <= z1; z++)
+		{
+			for (dInt32 x = x0; x <= x1; x++)
+			{
+				minVal = dMin(minVal, elevation[z * m_width + x]);
+				maxVal = dMax(maxVal, elevation[z * m_width + x]);
+			}
+		}
+		minHeight = dFloat32(minVal) * D_PYRAMID_TEST_SCALE_Y;
+		maxHeight = dFloat32(maxVal) * D_PYRAMID_TEST_SCALE_Y;
+	}
+
+	dVector Point(dInt32 x, dInt32 z, dInt16 elevation) const
+	{
+		return dVector(dFloat32(x) * D_PYRAMID_TEST_SCALE_X, dFloat32(elevation) * D_PYRAMID_TEST_SCALE_Y, dFloat32(z) * D_PYRAMID_TEST_SCALE_Z, dFloat32(0.0f));
+	}
+
+	dInt32 m_width;
+	dInt32 m_height;
+	ndGridConstruction m_mode;
+};
+
+// rolling hills with some noise, between -2048 and 2048
+static void FillElevation(ndTestHeightfield* const heightfield)
+{
+	dArray<dInt16>& elevation = heightfield->GetElevationMap();
+	for (dInt32 z = 0; z < heightfield->m_height; z++)
+	{
+		for (dInt32 x = 0; x < heightfield->m_width; x++)
+		{
+			const dFloat32 hills = dFloat32(1536.0f) * dSin(dFloat32(x) * dFloat32(0.3f)) * dCos(dFloat32(z) * dFloat32(0.2f));
+			elevation[z * heightfield->m_width + x] = dInt16(hills + dRand() * dFloat32(1024.0f) - dFloat32(512.0f));
+		}
+	}
+	heightfield->UpdateElevationMapAabb();
+}
+
+static dInt32 RandIndex(dInt32 count)
+{
+	return dMin(dInt32(dRand() * dFloat32(count)), count - 1);
+}
+
+// random vertex rectangles, rows and columns included
+static dInt32 CheckMinMax(const ndTestHeightfield* const heightfield, dInt32 count)
+{
+	dInt32 mismatches = 0;
+	for (dInt32 i = 0; i < count; i++)
+	{
+		dInt32 x0 = RandIndex(heightfield->m_width);
+		dInt32 x1 = RandIndex(heightfield->m_width);
+		dInt32 z0 = RandIndex(heightfield->m_height);
+		dInt32 z1 = RandIndex(heightfield->m_height);
+		if (x0 > x1)
+		{
+			dSwap(x0, x1);
+		}
+		if (z0 > z1)
+		{
+			dSwap(z0, z1);
+		}
+		if (i == 0)
+		{
+			x0 = 0;
+			z0 = 0;
+			x1 = heightfield->m_width - 1;
+			z1 = heightfield->m_height - 1;
+		}
+
+		dFloat32 minHeight;
+		dFloat32 maxHeight;
+		dFloat32 minHeightRef;
+		dFloat32 maxHeightRef;
+		heightfield->GetMinMax(x0, x1, z0, z1, minHeight, maxHeight);
+		heightfield->GetMinMaxAllVertices(x0, x1, z0, z1, minHeightRef, maxHeightRef);
+		mismatches += ((minHeight == minHeightRef) && (maxHeight == maxHeightRef)) ? 0 : 1;
+	}
+	return mismatches;
+}
+
+// steep rays through the grid, shallow rays that cross many cells and
+// rays that start or end outside of the grid
+static dInt32 CheckRays(const ndTestHeightfield* const heightfield, dInt32 count, dInt32& hits)
+{
+	dInt32 mismatches = 0;
+	const dFloat32 sizeX = dFloat32(heightfield->m_width - 1) * D_PYRAMID_TEST_SCALE_X;
+	const dFloat32 sizeZ = dFloat32(heightfield->m_height - 1) * D_PYRAMID_TEST_SCALE_Z;
+	const dFloat32 top = dFloat32(40.0f);
+	for (dInt32 i = 0; i < count; i++)
+	{
+		const dVector p0(dRand() * sizeX * dFloat32(1.2f) - sizeX * dFloat32(0.1f), top, dRand() * sizeZ * dFloat32(1.2f) - sizeZ * dFloat32(0.1f), dFloat32(0.0f));
+		dVector p1(dRand() * sizeX * dFloat32(1.2f) - sizeX * dFloat32(0.1f), -top, dRand() * sizeZ * dFloat32(1.2f) - sizeZ * dFloat32(0.1f), dFloat32(0.0f));
+		dVector q0(p0);
+		if (i & 1)
+		{
+			q0.m_y = dRand() * dFloat32(64.0f) - dFloat32(32.0f);
+			p1.m_y = q0.m_y - dRand() * dFloat32(8.0f);
+		}
+		else if ((i & 3) == 2)
+		{
+			p1.m_x = q0.m_x;
+			p1.m_z = q0.m_z;
+		}
+
+		dVector normal(dVector::m_zero);
+		dVector normalRef(dVector::m_zero);
+		const dFloat32 t = heightfield->CastRay(q0, p1, normal);
+		const dFloat32 tRef = heightfield->CastRayAllCells(q0, p1, normalRef);
+		bool same = (t < dFloat32(1.0f)) == (tRef < dFloat32(1.0f));
+		if (same && (tRef < dFloat32(1.0f)))
+		{
+			hits++;
+			same = (dAbs(t - tRef) < dFloat32(1.0e-5f)) && (normal.DotProduct(normalRef).GetScalar() > dFloat32(0.999f));
+		}
+		mismatches += same ? 0 : 1;
+	}
+	return mismatches;
+}
+
+// raise or dig a rectangle of vertices, and refresh only the cells around it
+static void EditElevation(ndTestHeightfield* const heightfield)
+{
+	const dInt32 x0 = RandIndex(heightfield->m_width);
+	const dInt32 z0 = RandIndex(heightfield->m_height);
+	const dInt32 x1 = dMin(x0 + RandIndex(6), heightfield->m_width - 1);
+	const dInt32 z1 = dMin(z0 + RandIndex(6), heightfield->m_height - 1);
+	const dInt16 value = dInt16(dRand() * dFloat32(8000.0f) - dFloat32(4000.0f));
+
+	dArray<dInt16>& elevation = heightfield->GetElevationMap();
+	for (dInt32 z = z0; z <= z1; z++)
+	{
+		for (dInt32 x = x0; x <= x1; x++)
+		{
+			elevation[z * heightfield->m_width + x] = value;
+		}
+	}
+	heightfield->UpdateElevationMapAabb(x0, z0, x1, z1);
+}
+
+static dInt32 CheckGrid(dInt32 width, dInt32 height, ndShapeHeightfield::ndGridConstruction mode)
+{
+	dInt32 failed = 0;
+	ndTestHeightfield* const heightfield = new ndTestHeightfield(width, height, mode);
+	ndShapeInstance instance(heightfield);
+	FillElevation(heightfield);
+
+	dInt32 hits = 0;
+	failed += ndTestCheck(CheckMinMax(heightfield, 500) == 0);
+	failed += ndTestCheck(CheckRays(heightfield, 500, hits) == 0);
+
+	// the pyramid follows edits that raise and lower the ground past the old bounds
+	for (dInt32 i = 0; i < 20; i++)
+	{
+		EditElevation(heightfield);
+		failed += ndTestCheck(CheckMinMax(heightfield, 50) == 0);
+		failed += ndTestCheck(CheckRays(heightfield, 50, hits) == 0);
+	}
+	failed += ndTestCheck(hits > 0);
+	return failed;
+}
+
+// the min max pyramid returns the same bounds as the vertices it covers and
+// its ray cast the same closest hit as testing every cell, before and after
+// edits, on power of two and odd grids
+dInt32 ndHeightfieldPyramidTest()
+{
+	dInt32 failed = 0;
+	dSetRandSeed(34);
+	failed += CheckGrid(33, 33, ndShapeHeightfield::m_normalDiagonals);
+	failed += CheckGrid(33, 33, ndShapeHeightfield::m_invertedDiagonals);
+	failed += CheckGrid(37, 21, ndShapeHeightfield::m_normalDiagonals);
+	failed += CheckGrid(64, 5, ndShapeHeightfield::m_invertedDiagonals);
+	failed += CheckGrid(2, 2, ndShapeHeightfield::m_normalDiagonals);
+	failed += CheckGrid(3, 70, ndShapeHeightfield::m_normalDiagonals);
+	return failed;
+}
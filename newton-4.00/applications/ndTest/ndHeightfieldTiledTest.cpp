@@ -0,0 +1,326 @@
+/* Copyright (c) <2003-2019> <Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely
+*/
+
+#include "testStdafx.h"
+#include "ndTestUtils.h"
+
+#define D_TILED_TEST_WIDTH		150
+#define D_TILED_TEST_HEIGHT		110
+#define D_TILED_TEST_TILE_SIZE	16
+#define D_TILED_TEST_SCALE_Y	dFloat32 (1.0f / 64.0f)
+#define D_TILED_TEST_SCALE_XZ	dFloat32 (0.5f)
+
+// the shapes are cast on their own, without a body
+class ndTiledTestRayNotify: public ndRayCastNotify
+{
+	public:
+	dFloat32 OnRayCastAction(const ndContactPoint&, dFloat32 intersetParam)
+	{
+		return intersetParam;
+	}
+};
+
+// rolling hills with some noise, the attribute changes every few cells
+static void BuildTerrainData(dArray<dInt16>& elevation, dArray<dInt8>& attributes)
+{
+	dSetRandSeed(35);
+	elevation.SetCount(D_TILED_TEST_WIDTH * D_TILED_TEST_HEIGHT);
+	attributes.SetCount(D_TILED_TEST_WIDTH * D_TILED_TEST_HEIGHT);
+	for (dInt32 z = 0; z < D_TILED_TEST_HEIGHT; z++)
+	{
+		for (dInt32 x = 0; x < D_TILED_TEST_WIDTH; x++)
+		{
+			const dFloat32 hills = dFloat32(192.0f) * dSin(dFloat32(x) * dFloat32(0.13f)) * dCos(dFloat32(z) * dFloat32(0.11f));
+			elevation[z * D_TILED_TEST_WIDTH + x] = dInt16(hills + dRand() * dFloat32(32.0f));
+			attributes[z * D_TILED_TEST_WIDTH + x] = dInt8(((x / 5) + (z / 3)) & 7);
+		}
+	}
+}
+
+static ndShapeHeightfieldTiled* CreateTiled(const char* const path, dInt64 memoryBudget)
+{
+	ndShapeHeightfieldTiled::ndMappedFileSource* const source = ndShapeHeightfieldTiled::ndMappedFileSource::Open(path);
+	if (!source)
+	{
+		return nullptr;
+	}
+	return new ndShapeHeightfieldTiled(source, D_TILED_TEST_WIDTH, D_TILED_TEST_HEIGHT, D_TILED_TEST_TILE_SIZE,
+		ndShapeHeightfield::m_normalDiagonals, D_TILED_TEST_SCALE_Y, D_TILED_TEST_SCALE_XZ, D_TILED_TEST_SCALE_XZ, memoryBudget);
+}
+
+static ndShapeHeightfield* CreateMonolithic()
+{
+	return new ndShapeHeightfield(D_TILED_TEST_WIDTH, D_TILED_TEST_HEIGHT,
+		ndShapeHeightfield::m_normalDiagonals, D_TILED_TEST_SCALE_Y, D_TILED_TEST_SCALE_XZ, D_TILED_TEST_SCALE_XZ);
+}
+
+static void FillMonolithic(ndShapeInstance& instance, ndShapeHeightfield* const heightfield, const dArray<dInt16>& elevation, const dArray<dInt8>& attributes)
+{
+	memcpy(&heightfield->GetElevationMap()[0], &elevation[0], size_t(elevation.GetCount()) * sizeof(dInt16));
+	memcpy(instance.GetShapeInfo().m_heightfield.m_atributes, &attributes[0], size_t(attributes.GetCount()) * sizeof(dInt8));
+	heightfield->UpdateElevationMapAabb();
+}
+
+// waits for the background loader to bring every requested tile in
+static bool WaitForTiles(ndShapeHeightfieldTiled* const tiled, dInt32 count)
+{
+	const dFloat64 start = ndGetTimeInMs();
+	tiled->Update();
+	while ((tiled->GetResidentTilesCount() < count) && ((ndGetTimeInMs() - start) < dFloat64(10000.0f)))
+	{
+		std::this_thread::yield();
+		tiled->Update();
+	}
+	return tiled->GetResidentTilesCount() == count;
+}
+
+// long shallow rays that cross many tile borders, and steep rays at the seams,
+// the tiled shape must return the same hit as the monolithic one
+static dInt32 CompareRays(const ndShapeInstance& tiled, const ndShapeInstance& monolithic, dInt32 count, dInt32& hits)
+{
+	dInt32 mismatches = 0;
+	ndTiledTestRayNotify callback;
+	const dFloat32 sizeX = dFloat32(D_TILED_TEST_WIDTH - 1) * D_TILED_TEST_SCALE_XZ;
+	const dFloat32 sizeZ = dFloat32(D_TILED_TEST_HEIGHT - 1) * D_TILED_TEST_SCALE_XZ;
+	const dFloat32 tileSize = dFloat32(D_TILED_TEST_TILE_SIZE) * D_TILED_TEST_SCALE_XZ;
+	for (dInt32 i = 0; i < count; i++)
+	{
+		dVector p0(dRand() * sizeX, dFloat32(8.0f), dRand() * sizeZ, dFloat32(0.0f));
+		dVector p1(dRand() * sizeX, dFloat32(-8.0f), dRand() * sizeZ, dFloat32(0.0f));
+		if (i & 1)
+		{
+			p0.m_y = dRand() * dFloat32(4.0f) - dFloat32(1.0f);
+			p1.m_y = p0.m_y - dFloat32(1.0f);
+		}
+		else if ((i & 3) == 2)
+		{
+			p0.m_x = dFloor(p0.m_x / tileSize) * tileSize;
+			p1.m_x = p0.m_x + dRand() * dFloat32(0.1f);
+			p1.m_z = p0.m_z + dRand() * dFloat32(0.1f);
+		}
+
+		ndContactPoint contact;
+		ndContactPoint contactRef;
+		const dFloat32 t = tiled.RayCast(callback, p0, p1, nullptr, contact);
+		const dFloat32 tRef = monolithic.RayCast(callback, p0, p1, nullptr, contactRef);
+		bool same = (t < dFloat32(1.0f)) == (tRef < dFloat32(1.0f));
+		if (same && (tRef < dFloat32(1.0f)))
+		{
+			hits++;
+			same = (dAbs(t - tRef) < dFloat32(1.0e-4f)) && (contact.m_normal.DotProduct(contactRef.m_normal).GetScalar() > dFloat32(0.999f));
+			same = same && (contact.m_shapeId0 == contactRef.m_shapeId0);
+		}
+		mismatches += same ? 0 : 1;
+	}
+	return mismatches;
+}
+
+// a vertical ray through the middle of a tile, returns the tiles loaded by the ray
+static dInt32 CastTileRay(const ndShapeInstance& instance, ndRayCastNotify& callback, dInt32 tileX, dInt32 tileZ)
+{
+	ndContactPoint contact;
+	const ndShapeHeightfieldTiled* const tiled = (ndShapeHeightfieldTiled*)instance.GetShape();
+	const dFloat32 tileSize = dFloat32(D_TILED_TEST_TILE_SIZE) * D_TILED_TEST_SCALE_XZ;
+	const dVector p0((dFloat32(tileX) + dFloat32(0.5f)) * tileSize, dFloat32(8.0f), (dFloat32(tileZ) + dFloat32(0.5f)) * tileSize, dFloat32(0.0f));
+	const dVector p1(p0.m_x, dFloat32(-8.0f), p0.m_z, dFloat32(0.0f));
+	const dInt32 stalls = tiled->GetStallsCount();
+	instance.RayCast(callback, p0, p1, nullptr, contact);
+	return tiled->GetStallsCount() - stalls;
+}
+
+// spheres and boxes dropped on the tile corners and borders
+static void BuildDropScene(ndWorld& world, ndShape* const terrain)
+{
+	world.SetThreadCount(2);
+	ndShapeInstance terrainInstance(terrain);
+	ndBodyDynamic* const terrainBody = new ndBodyDynamic();
+	terrainBody->SetNotifyCallback(new ndBodyNotify(dVector::m_zero));
+	terrainBody->SetMatrix(dGetIdentityMatrix());
+	terrainBody->SetCollisionShape(terrainInstance);
+	world.AddBody(terrainBody);
+
+	const dVector gravity(dFloat32(0.0f), dFloat32(-10.0f), dFloat32(0.0f), dFloat32(0.0f));
+	ndShapeInstance sphere(new ndShapeSphere(dFloat32(0.4f)));
+	ndShapeInstance box(new ndShapeBox(dFloat32(1.5f), dFloat32(0.5f), dFloat32(1.5f)));
+	const dFloat32 tileSize = dFloat32(D_TILED_TEST_TILE_SIZE) * D_TILED_TEST_SCALE_XZ;
+	for (dInt32 z = 1; z < 7; z++)
+	{
+		for (dInt32 x = 1; x < 9; x++)
+		{
+			const ndShapeInstance& shape = ((x + z) & 1) ? sphere : box;
+			dMatrix matrix(dYawMatrix(dFloat32(x * z) * dFloat32(0.3f)));
+			matrix.m_posit = dVector(dFloat32(x) * tileSize + dFloat32(z & 1) * dFloat32(0.3f), dFloat32(6.0f), dFloat32(z) * tileSize - dFloat32(x & 1) * dFloat32(0.4f), dFloat32(1.0f));
+			ndBodyDynamic* const body = new ndBodyDynamic();
+			body->SetNotifyCallback(new ndBodyNotify(gravity));
+			body->SetMatrix(matrix);
+			body->SetCollisionShape(shape);
+			body->SetMassMatrix(dFloat32(1.0f), shape);
+			world.AddBody(body);
+		}
+	}
+}
+
+// the same bodies fall on the tiled and on the monolithic terrain, the tiled one
+// is paged with a budget smaller than the tiles under the bodies
+static dInt32 CompareDrop(ndShapeHeightfieldTiled* const tiled, ndShapeHeightfield* const monolithic)
+{
+	dInt32 failed = 0;
+	ndWorld world;
+	ndWorld worldRef;
+	BuildDropScene(world, tiled);
+	BuildDropScene(worldRef, monolithic);
+
+	dInt32 maxResident = 0;
+	for (dInt32 i = 0; i < 180; i++)
+	{
+		// the request runs ahead of the update, tiles that are not in by then stall the query
+		tiled->RequestBodies(world.GetBodyList(), dGetIdentityMatrix(), dFloat32(0.5f));
+		world.Update(dFloat32(1.0f / 60.0f));
+		worldRef.Update(dFloat32(1.0f / 60.0f));
+		world.Sync();
+		worldRef.Sync();
+		tiled->Update();
+		maxResident = dMax(maxResident, tiled->GetResidentTilesCount());
+	}
+
+	failed += ndTestCheck(ndHashBodies(world) == ndHashBodies(worldRef));
+	dFloat32 maxError = dFloat32(0.0f);
+	dFloat32 minHeight = dFloat32(1.0e10f);
+	for (ndBodyList::dNode* node = world.GetBodyList().GetFirst(), *nodeRef = worldRef.GetBodyList().GetFirst(); node; node = node->GetNext(), nodeRef = nodeRef->GetNext())
+	{
+		const dVector posit(node->GetInfo()->GetMatrix().m_posit);
+		const dVector positRef(nodeRef->GetInfo()->GetMatrix().m_posit);
+		const dVector error(posit - positRef);
+		maxError = dMax(maxError, dSqrt(error.DotProduct(error & dVector::m_triplexMask).GetScalar()));
+		const bool overTerrain = (posit.m_x > dFloat32(0.0f)) && (posit.m_x < dFloat32(D_TILED_TEST_WIDTH - 1) * D_TILED_TEST_SCALE_XZ) &&
+			(posit.m_z > dFloat32(0.0f)) && (posit.m_z < dFloat32(D_TILED_TEST_HEIGHT - 1) * D_TILED_TEST_SCALE_XZ);
+		minHeight = overTerrain ? dMin(minHeight, posit.m_y) : minHeight;
+	}
+	failed += ndTestCheck(maxError < dFloat32(1.0e-3f));
+	// nothing fell through the seams, the ground is never lower than -3.5
+	failed += ndTestCheck(minHeight > dFloat32(-4.0f));
+	// the tiles under the bodies do not fit in the budget
+	failed += ndTestCheck(maxResident > 6);
+	return failed;
+}
+
+// a tiled height field read from a mapped file must behave as the monolithic height field
+// built from the same data: the background loader brings every requested tile in, the
+// least recently used tiles are evicted to stay in budget, evicted tiles stall and reload
+// when used, and rays and contacts are the same across the tile borders
+dInt32 ndHeightfieldTiledTest()
+{
+	dInt32 failed = 0;
+	dArray<dInt16> elevation;
+	dArray<dInt8> attributes;
+	BuildTerrainData(elevation, attributes);
+
+	const char* const path = "ndHeightfieldTiledTest.bin";
+	failed += ndTestCheck(ndShapeHeightfieldTiled::ndMappedFileSource::Save(path, D_TILED_TEST_WIDTH, D_TILED_TEST_HEIGHT, &elevation[0], &attributes[0]));
+
+	// a file that is not a height field is rejected
+	const char* const badPath = "ndHeightfieldTiledTest.txt";
+	FILE* const file = fopen(badPath, "wb");
+	if (file)
+	{
+		fputs("not a height field, but long enough to hold a header", file);
+		fclose(file);
+	}
+	failed += ndTestCheck(ndShapeHeightfieldTiled::ndMappedFileSource::Open(badPath) == nullptr);
+	remove(badPath);
+
+	ndShapeHeightfield* const monolithic = CreateMonolithic();
+	ndShapeInstance monolithicInstance(monolithic);
+	FillMonolithic(monolithicInstance, monolithic, elevation, attributes);
+
+	const dInt32 tilesCount_x = (D_TILED_TEST_WIDTH - 2) / D_TILED_TEST_TILE_SIZE + 1;
+	const dInt32 tilesCount_z = (D_TILED_TEST_HEIGHT - 2) / D_TILED_TEST_TILE_SIZE + 1;
+	const dInt32 tilesCount = tilesCount_x * tilesCount_z;
+	const dFloat32 tileSize = dFloat32(D_TILED_TEST_TILE_SIZE) * D_TILED_TEST_SCALE_XZ;
+	dInt64 tileMemory = 0;
+	{
+		// the background loader brings in every tile of the terrain
+		ndShapeHeightfieldTiled* const tiled = CreateTiled(path, dInt64(1) << 40);
+		failed += ndTestCheck(tiled != nullptr);
+		if (tiled)
+		{
+			ndShapeInstance tiledInstance(tiled);
+			const dVector center(tileSize * dFloat32(1.5f), dFloat32(0.0f), tileSize * dFloat32(1.5f), dFloat32(0.0f));
+			tiled->RequestRegion(center, center);
+			failed += ndTestCheck(WaitForTiles(tiled, 1));
+			tileMemory = tiled->GetResidentMemory();
+
+			tiled->RequestRegion(dVector(dFloat32(-10.0f)), dVector(dFloat32(1000.0f)));
+			failed += ndTestCheck(WaitForTiles(tiled, tilesCount));
+			failed += ndTestCheck(tiled->GetStallsCount() == 0);
+
+			dInt32 hits = 0;
+			failed += ndTestCheck(CompareRays(tiledInstance, monolithicInstance, 1000, hits) == 0);
+			failed += ndTestCheck(hits > 500);
+			failed += ndTestCheck(tiled->GetStallsCount() == 0);
+		}
+	}
+
+	{
+		// the budget holds six interior tiles
+		const dInt64 budget = tileMemory * 6;
+		ndShapeHeightfieldTiled* const tiled = CreateTiled(path, budget);
+		failed += ndTestCheck(tiled != nullptr);
+		if (tiled)
+		{
+			ndShapeInstance tiledInstance(tiled);
+			tiled->RequestRegion(dVector(tileSize * dFloat32(1.5f)), dVector(tileSize * dFloat32(2.5f)));
+			failed += ndTestCheck(WaitForTiles(tiled, 4));
+			tiled->Update();
+			tiled->Update();
+
+			// a ray in one of the four tiles makes it the most recently used
+			ndTiledTestRayNotify callback;
+			failed += ndTestCheck(CastTileRay(tiledInstance, callback, 1, 1) == 0);
+			tiled->Update();
+
+			// four more tiles loaded by the rays that use them go over the budget,
+			// the two tiles not used with the lowest index are evicted
+			failed += ndTestCheck(CastTileRay(tiledInstance, callback, 5, 5) == 1);
+			failed += ndTestCheck(CastTileRay(tiledInstance, callback, 6, 5) == 1);
+			failed += ndTestCheck(CastTileRay(tiledInstance, callback, 5, 6) == 1);
+			failed += ndTestCheck(CastTileRay(tiledInstance, callback, 6, 6) == 1);
+			failed += ndTestCheck(tiled->GetResidentTilesCount() == 8);
+			tiled->Update();
+			failed += ndTestCheck(tiled->GetResidentTilesCount() == 6);
+			failed += ndTestCheck(tiled->GetResidentMemory() <= budget);
+
+			failed += ndTestCheck(CastTileRay(tiledInstance, callback, 1, 1) == 0);
+			failed += ndTestCheck(CastTileRay(tiledInstance, callback, 2, 2) == 0);
+			failed += ndTestCheck(CastTileRay(tiledInstance, callback, 6, 6) == 0);
+			failed += ndTestCheck(CastTileRay(tiledInstance, callback, 2, 1) == 1);
+			failed += ndTestCheck(CastTileRay(tiledInstance, callback, 1, 2) == 1);
+
+			// rays all over the terrain reload the evicted tiles, once the rays
+			// stop the update evicts the tiles down to the budget again
+			dInt32 hits = 0;
+			dInt32 mismatches = 0;
+			for (dInt32 i = 0; i < 20; i++)
+			{
+				mismatches += CompareRays(tiledInstance, monolithicInstance, 50, hits);
+				tiled->Update();
+				tiled->Update();
+				failed += ndTestCheck(tiled->GetResidentMemory() <= budget);
+			}
+			failed += ndTestCheck(mismatches == 0);
+			failed += ndTestCheck(tiled->GetStallsCount() > tilesCount);
+
+			failed += CompareDrop(tiled, monolithic);
+		}
+	}
+	remove(path);
+	return failed;
+}
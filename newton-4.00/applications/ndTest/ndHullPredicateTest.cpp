@@ -0,0 +1,192 @@
+/* Copyright (c) <2003-2019> <Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely
+*/
+
+#include "testStdafx.h"
+#include "ndTestUtils.h"
+
+// the clouds are integer points scaled by a power of two, the scale is exact and the
+// coordinates are below 2^19, so the orientation determinant is exact in dInt64
+#define D_HULL_TEST_SCALE		dFloat64 (1.0f / 1024.0f)
+
+class ndIntPoint
+{
+	public:
+	ndIntPoint()
+	{
+	}
+
+	ndIntPoint(dInt64 x, dInt64 y, dInt64 z)
+		:m_x(x), m_y(y), m_z(z)
+	{
+	}
+
+	ndIntPoint operator+ (const ndIntPoint& p) const
+	{
+		return ndIntPoint(m_x + p.m_x, m_y + p.m_y, m_z + p.m_z);
+	}
+
+	ndIntPoint operator- (const ndIntPoint& p) const
+	{
+		return ndIntPoint(m_x - p.m_x, m_y - p.m_y, m_z - p.m_z);
+	}
+
+	ndIntPoint Scale(dInt64 s) const
+	{
+		return ndIntPoint(m_x * s, m_y * s, m_z * s);
+	}
+
+	dInt64 m_x;
+	dInt64 m_y;
+	dInt64 m_z;
+};
+
+static dInt64 RandInt(dInt64 range)
+{
+	return dInt64(dRand() * dFloat32(2 * range)) - range;
+}
+
+// with the sign of the hull face orientation test, which expands the last row starting with a minus
+static dInt64 ExactDeterminant(const ndIntPoint& a, const ndIntPoint& b, const ndIntPoint& c)
+{
+	return -a.m_x * (b.m_y * c.m_z - b.m_z * c.m_y) + a.m_y * (b.m_x * c.m_z - b.m_z * c.m_x) - a.m_z * (b.m_x * c.m_y - b.m_y * c.m_x);
+}
+
+static ndIntPoint ToInt(const dBigVector& p)
+{
+	return ndIntPoint(dInt64(p.m_x / D_HULL_TEST_SCALE), dInt64(p.m_y / D_HULL_TEST_SCALE), dInt64(p.m_z / D_HULL_TEST_SCALE));
+}
+
+// no point of the cloud is in front of a face of the hull, every
+// face has three neighbors and the expected points are hull vertices
+static dInt32 CheckHull(const dArray<ndIntPoint>& cloud, const ndIntPoint* const expected, dInt32 expectedCount)
+{
+	dInt32 failed = 0;
+	dArray<dBigVector> points;
+	points.SetCount(cloud.GetCount());
+	for (dInt32 i = 0; i < cloud.GetCount(); i++)
+	{
+		points[i] = dBigVector(dFloat64(cloud[i].m_x) * D_HULL_TEST_SCALE, dFloat64(cloud[i].m_y) * D_HULL_TEST_SCALE, dFloat64(cloud[i].m_z) * D_HULL_TEST_SCALE, dFloat64(0.0f));
+	}
+
+	dConvexHull3d hull(&points[0].m_x, sizeof(dBigVector), points.GetCount(), dFloat64(0.0f));
+	failed += ndTestCheck(hull.GetCount() > 0);
+	for (dInt32 i = 0; i < expectedCount; i++)
+	{
+		bool found = false;
+		for (dInt32 j = 0; !found && (j < hull.GetVertexCount()); j++)
+		{
+			const ndIntPoint vertex(ToInt(hull.GetVertex(j)));
+			found = (vertex.m_x == expected[i].m_x) && (vertex.m_y == expected[i].m_y) && (vertex.m_z == expected[i].m_z);
+		}
+		failed += ndTestCheck(found);
+	}
+	for (dConvexHull3d::dNode* node = hull.GetFirst(); node; node = node->GetNext())
+	{
+		const dConvexHull3dFace& face = node->GetInfo();
+		failed += ndTestCheck(face.GetTwin(0) && face.GetTwin(1) && face.GetTwin(2));
+
+		const ndIntPoint p0(ToInt(hull.GetVertex(face.m_index[0])));
+		const ndIntPoint p1(ToInt(hull.GetVertex(face.m_index[1])));
+		const ndIntPoint p2(ToInt(hull.GetVertex(face.m_index[2])));
+		dInt32 outside = 0;
+		for (dInt32 i = 0; i < cloud.GetCount(); i++)
+		{
+			outside += (ExactDeterminant(p2 - p0, p1 - p0, cloud[i] - p0) > 0) ? 1 : 0;
+		}
+		failed += ndTestCheck(outside == 0);
+	}
+	return failed;
+}
+
+// a thin slab of points around a tilted plane, one lattice step thick
+static dInt32 CheckNearCoplanarHull(dInt32 count)
+{
+	const ndIntPoint u(317, 41, -93);
+	const ndIntPoint v(-29, 263, 157);
+	const ndIntPoint n(1, -2, 1);
+	dArray<ndIntPoint> cloud;
+	for (dInt32 i = 0; i < count; i++)
+	{
+		cloud.PushBack(u.Scale(RandInt(1500)) + v.Scale(RandInt(1500)) + n.Scale(RandInt(1)));
+	}
+	// at least one point on each side of the plane
+	cloud.PushBack(n);
+	cloud.PushBack(n.Scale(-1));
+	return CheckHull(cloud, nullptr, 0);
+}
+
+// cube corners repeated many times and points exactly on the faces 
+// and edges of the cube, the corners are vertices of the hull
+static dInt32 CheckDegenerateCube(dInt32 count)
+{
+	const dInt64 size = 1 << 12;
+	ndIntPoint corners[8];
+	dArray<ndIntPoint> cloud;
+	for (dInt32 i = 0; i < count; i++)
+	{
+		const dInt64 corner[] = { (i & 1) ? size : -size, (i & 2) ? size : -size, (i & 4) ? size : -size };
+		corners[i & 7] = ndIntPoint(corner[0], corner[1], corner[2]);
+		cloud.PushBack(corners[i & 7]);
+
+		dInt64 face[3];
+		face[0] = RandInt(size);
+		face[1] = RandInt(size);
+		face[2] = RandInt(size);
+		face[i % 3] = ((i / 3) & 1) ? size : -size;
+		cloud.PushBack(ndIntPoint(face[0], face[1], face[2]));
+
+		dInt64 edge[3];
+		edge[0] = (i & 8) ? size : -size;
+		edge[1] = (i & 16) ? size : -size;
+		edge[2] = RandInt(size);
+		cloud.PushBack(ndIntPoint(edge[(i + 0) % 3], edge[(i + 1) % 3], edge[(i + 2) % 3]));
+	}
+	return CheckHull(cloud, corners, 8);
+}
+
+// clouds with no volume must not make a hull
+static dInt32 CheckFlatClouds(dInt32 count)
+{
+	dInt32 failed = 0;
+	const ndIntPoint u(317, 41, -93);
+	const ndIntPoint v(-29, 263, 157);
+
+	dArray<dBigVector> coplanar;
+	dArray<dBigVector> collinear;
+	dArray<dBigVector> coincident;
+	for (dInt32 i = 0; i < count; i++)
+	{
+		const ndIntPoint p(u.Scale(RandInt(1500)) + v.Scale(RandInt(1500)));
+		const ndIntPoint q(u.Scale(RandInt(1500)));
+		coplanar.PushBack(dBigVector(dFloat64(p.m_x) * D_HULL_TEST_SCALE, dFloat64(p.m_y) * D_HULL_TEST_SCALE, dFloat64(p.m_z) * D_HULL_TEST_SCALE, dFloat64(0.0f)));
+		collinear.PushBack(dBigVector(dFloat64(q.m_x) * D_HULL_TEST_SCALE, dFloat64(q.m_y) * D_HULL_TEST_SCALE, dFloat64(q.m_z) * D_HULL_TEST_SCALE, dFloat64(0.0f)));
+		coincident.PushBack(dBigVector(dFloat64(1.5f), dFloat64(-2.25f), dFloat64(0.125f), dFloat64(0.0f)));
+	}
+
+	dConvexHull3d coplanarHull(&coplanar[0].m_x, sizeof(dBigVector), count, dFloat64(0.0f));
+	dConvexHull3d collinearHull(&collinear[0].m_x, sizeof(dBigVector), count, dFloat64(0.0f));
+	dConvexHull3d coincidentHull(&coincident[0].m_x, sizeof(dBigVector), count, dFloat64(0.0f));
+	failed += ndTestCheck(coplanarHull.GetCount() == 0);
+	failed += ndTestCheck(collinearHull.GetCount() == 0);
+	failed += ndTestCheck(coincidentHull.GetCount() == 0);
+	return failed;
+}
+
+// the orientation filter on near coplanar and degenerate clouds
+dInt32 ndHullPredicateTest()
+{
+	dInt32 failed = 0;
+	dSetRandSeed(17);
+	failed += CheckNearCoplanarHull(2000);
+	failed += CheckDegenerateCube(200);
+	failed += CheckFlatClouds(500);
+	return failed;
+}
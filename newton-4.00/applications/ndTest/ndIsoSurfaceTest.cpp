@@ -0,0 +1,252 @@
+/* Copyright (c) <2003-2019> <Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely
+*/
+
+#include "testStdafx.h"
+#include "ndTestUtils.h"
+
+// the grid is moved away from the coordinates zero and one, which are not valid
+#define D_ISO_TEST_BORDER	4
+
+// the field goes up one per cell toward the inside, the surface is at value one
+#define D_ISO_TEST_VALUE	dFloat32 (1.0f)
+
+// the grid points of a ball of radius cells in a grid of size cells, sorted by z, y and x
+static void BuildSphereField(dInt32 size, dFloat32 radius, dArray<dIsoSurface::dIsoPoint>& points)
+{
+	points.SetCount(0);
+	const dFloat32 center = dFloat32(size) * dFloat32(0.5f);
+	for (dInt32 z = 0; z < size; z++)
+	{
+		for (dInt32 y = 0; y < size; y++)
+		{
+			for (dInt32 x = 0; x < size; x++)
+			{
+				const dFloat32 dx = dFloat32(x) - center;
+				const dFloat32 dy = dFloat32(y) - center;
+				const dFloat32 dz = dFloat32(z) - center;
+				const dFloat32 value = radius + D_ISO_TEST_VALUE - dSqrt(dx * dx + dy * dy + dz * dz);
+				if (value > dFloat32(0.0f))
+				{
+					dIsoSurface::dIsoPoint point;
+					point.m_x = x + D_ISO_TEST_BORDER;
+					point.m_y = y + D_ISO_TEST_BORDER;
+					point.m_z = z + D_ISO_TEST_BORDER;
+					point.m_value = value;
+					points.PushBack(point);
+				}
+			}
+		}
+	}
+}
+
+// a box of water of size x size cells with a wavy surface, the walls and the floor
+// are the faces of the grid, so most points are deep inside like in a fluid at rest
+static void BuildPoolField(dInt32 size, dFloat32 depth, dArray<dIsoSurface::dIsoPoint>& points)
+{
+	points.SetCount(0);
+	const dInt32 height = dInt32(depth) + 4;
+	for (dInt32 z = 0; z < size; z++)
+	{
+		for (dInt32 y = 0; y < height; y++)
+		{
+			for (dInt32 x = 0; x < size; x++)
+			{
+				const dFloat32 level = depth + dFloat32(2.0f) * dSin(dFloat32(x) * dFloat32(0.15f)) * dCos(dFloat32(z) * dFloat32(0.1f));
+				const dFloat32 value = dMin(level + D_ISO_TEST_VALUE - dFloat32(y), dFloat32(4.0f));
+				if (value > dFloat32(0.0f))
+				{
+					dIsoSurface::dIsoPoint point;
+					point.m_x = x + D_ISO_TEST_BORDER;
+					point.m_y = y + D_ISO_TEST_BORDER;
+					point.m_z = z + D_ISO_TEST_BORDER;
+					point.m_value = value;
+					points.PushBack(point);
+				}
+			}
+		}
+	}
+}
+
+static dInt32 CompareEdges(const dUnsigned64* const edgeA, const dUnsigned64* const edgeB, void* const)
+{
+	return (*edgeA < *edgeB) ? -1 : ((*edgeA > *edgeB) ? 1 : 0);
+}
+
+static bool FindEdge(const dArray<dUnsigned64>& edges, dUnsigned64 edge)
+{
+	dInt32 i0 = 0;
+	dInt32 i1 = edges.GetCount() - 1;
+	while (i0 <= i1)
+	{
+		const dInt32 i = (i0 + i1) >> 1;
+		if (edges[i] == edge)
+		{
+			return true;
+		}
+		(edges[i] < edge) ? i0 = i + 1 : i1 = i - 1;
+	}
+	return false;
+}
+
+// every edge is shared by two triangles with opposite winding,
+// a vertex that was not welded leaves a border in the mesh
+static dInt32 CheckClosedMesh(const dIsoSurface& isoSurface, dInt32 eulerCharacteristic)
+{
+	dInt32 failed = 0;
+	const dInt32 indexCount = isoSurface.GetIndexCount();
+	const dInt32 vertexCount = isoSurface.GetVertexCount();
+	const dUnsigned64* const indices = isoSurface.GetIndexList();
+	failed += ndTestCheck(indexCount > 0);
+
+	dArray<dUnsigned64> edges;
+	for (dInt32 i = 0; i < indexCount; i += 3)
+	{
+		for (dInt32 j = 0; j < 3; j++)
+		{
+			const dUnsigned64 i0 = indices[i + j];
+			const dUnsigned64 i1 = indices[i + (j + 1) % 3];
+			failed += ndTestCheck((i0 < dUnsigned64(vertexCount)) && (i0 != i1));
+			edges.PushBack((i0 << 32) | i1);
+		}
+	}
+	dSort(&edges[0], edges.GetCount(), CompareEdges);
+
+	dInt32 repeated = 0;
+	dInt32 unmatched = 0;
+	for (dInt32 i = 0; i < edges.GetCount(); i++)
+	{
+		repeated += ((i > 0) && (edges[i] == edges[i - 1])) ? 1 : 0;
+		unmatched += FindEdge(edges, (edges[i] << 32) | (edges[i] >> 32)) ? 0 : 1;
+	}
+	failed += ndTestCheck(repeated == 0);
+	failed += ndTestCheck(unmatched == 0);
+
+	const dInt32 faceCount = indexCount / 3;
+	const dInt32 edgeCount = edges.GetCount() / 2;
+	failed += ndTestCheck(vertexCount - edgeCount + faceCount == eulerCharacteristic);
+	return failed;
+}
+
+// the vertices are on the sphere and the normals point out of it
+static dInt32 CheckSphereMesh(const dIsoSurface& isoSurface, dInt32 size, dFloat32 radius, dFloat32 gridSize)
+{
+	dInt32 failed = 0;
+	const dVector center(dVector(dFloat32(size / 2 + D_ISO_TEST_BORDER)).Scale(gridSize) & dVector::m_triplexMask);
+	const dVector* const points = isoSurface.GetPoints();
+	const dVector* const normals = isoSurface.GetNormals();
+	dFloat32 maxError = dFloat32(0.0f);
+	dFloat32 minAlign = dFloat32(1.0f);
+	for (dInt32 i = 0; i < isoSurface.GetVertexCount(); i++)
+	{
+		const dVector dir((points[i] - center) & dVector::m_triplexMask);
+		const dFloat32 dist = dSqrt(dir.DotProduct(dir).GetScalar());
+		maxError = dMax(maxError, dAbs(dist - radius * gridSize));
+		minAlign = dMin(minAlign, normals[i].DotProduct(dir.Scale(dFloat32(1.0f) / dist)).GetScalar());
+	}
+	failed += ndTestCheck(maxError < dFloat32(0.1f) * gridSize);
+	failed += ndTestCheck(minAlign > dFloat32(0.9f));
+	return failed;
+}
+
+// the mesh made by the threads of a pool is the same as the serial one
+static dInt32 CheckThreads(const dArray<dIsoSurface::dIsoPoint>& points, dFloat32 gridSize)
+{
+	dInt32 failed = 0;
+	dIsoSurface serial;
+	serial.GenerateMesh(&points[0], points.GetCount(), dVector::m_zero, gridSize, D_ISO_TEST_VALUE);
+	for (dInt32 threadCount = 2; threadCount <= 4; threadCount++)
+	{
+		ndWorld world;
+		world.SetThreadCount(threadCount);
+		dIsoSurface isoSurface;
+		dThreadPool* const threadPool = world.GetScene();
+		threadPool->Begin();
+		isoSurface.GenerateMesh(&points[0], points.GetCount(), dVector::m_zero, gridSize, D_ISO_TEST_VALUE, threadPool);
+		threadPool->End();
+		failed += ndTestCheck(isoSurface.GetVertexCount() == serial.GetVertexCount());
+		failed += ndTestCheck(isoSurface.GetIndexCount() == serial.GetIndexCount());
+		if ((isoSurface.GetVertexCount() == serial.GetVertexCount()) && (isoSurface.GetIndexCount() == serial.GetIndexCount()))
+		{
+			failed += ndTestCheck(!memcmp(isoSurface.GetPoints(), serial.GetPoints(), size_t(serial.GetVertexCount()) * sizeof(dVector)));
+			failed += ndTestCheck(!memcmp(isoSurface.GetNormals(), serial.GetNormals(), size_t(serial.GetVertexCount()) * sizeof(dVector)));
+			failed += ndTestCheck(!memcmp(isoSurface.GetIndexList(), serial.GetIndexList(), size_t(serial.GetIndexCount()) * sizeof(dUnsigned64)));
+		}
+	}
+	return failed;
+}
+
+dInt32 ndIsoSurfaceTest()
+{
+	dInt32 failed = 0;
+	const dFloat32 gridSize = dFloat32(0.125f);
+	dArray<dIsoSurface::dIsoPoint> points;
+	{
+		BuildSphereField(32, dFloat32(11.3f), points);
+		dIsoSurface isoSurface;
+		isoSurface.GenerateMesh(&points[0], points.GetCount(), dVector::m_zero, gridSize, D_ISO_TEST_VALUE);
+		failed += CheckClosedMesh(isoSurface, 2);
+		failed += CheckSphereMesh(isoSurface, 32, dFloat32(11.3f), gridSize);
+		failed += CheckThreads(points, gridSize);
+	}
+
+	{
+		BuildPoolField(40, dFloat32(9.5f), points);
+		dIsoSurface isoSurface;
+		isoSurface.GenerateMesh(&points[0], points.GetCount(), dVector::m_zero, gridSize, D_ISO_TEST_VALUE);
+		failed += CheckClosedMesh(isoSurface, 2);
+		failed += CheckThreads(points, gridSize);
+	}
+	return failed;
+}
+
+static void TimeMesh(const char* const name, const dArray<dIsoSurface::dIsoPoint>& points, dInt32 repeats)
+{
+	const dFloat32 gridSize = dFloat32(0.125f);
+	ndWorld world;
+	dIsoSurface isoSurface;
+	isoSurface.GenerateMesh(&points[0], points.GetCount(), dVector::m_zero, gridSize, D_ISO_TEST_VALUE);
+
+	dFloat64 start = ndGetTimeInMs();
+	for (dInt32 i = 0; i < repeats; i++)
+	{
+		isoSurface.GenerateMesh(&points[0], points.GetCount(), dVector::m_zero, gridSize, D_ISO_TEST_VALUE);
+	}
+	const dFloat64 serialTime = (ndGetTimeInMs() - start) / dFloat64(repeats);
+
+	// the pool runs like it does during a world update
+	dThreadPool* const threadPool = world.GetScene();
+	threadPool->Begin();
+	start = ndGetTimeInMs();
+	for (dInt32 i = 0; i < repeats; i++)
+	{
+		isoSurface.GenerateMesh(&points[0], points.GetCount(), dVector::m_zero, gridSize, D_ISO_TEST_VALUE, threadPool);
+	}
+	const dFloat64 poolTime = (ndGetTimeInMs() - start) / dFloat64(repeats);
+	threadPool->End();
+
+	printf("  %s: %d points, %d vertices, %d triangles: serial %.2f ms  %d threads %.2f ms\n", name,
+		points.GetCount(), isoSurface.GetVertexCount(), isoSurface.GetIndexCount() / 3, serialTime, world.GetThreadCount(), poolTime);
+}
+
+// the cost depends on the points in the list, not on the grid size
+dInt32 ndIsoSurfaceBenchmark()
+{
+	dArray<dIsoSurface::dIsoPoint> points;
+	BuildSphereField(64, dFloat32(26.3f), points);
+	TimeMesh("64^3 sphere", points, 20);
+
+	BuildSphereField(256, dFloat32(107.3f), points);
+	TimeMesh("256^3 sphere", points, 3);
+
+	BuildPoolField(256, dFloat32(24.5f), points);
+	TimeMesh("256^3 pool", points, 3);
+	return 0;
+}
@@ -0,0 +1,171 @@
+/* Copyright (c) <2003-2019> <Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely
+*/
+
+#include "testStdafx.h"
+#include "ndTestUtils.h"
+
+static void AddFloor(ndWorld& world)
+{
+	ndShapeInstance floor(new ndShapeBox(dFloat32(200.0f), dFloat32(1.0f), dFloat32(200.0f)));
+	ndBodyDynamic* const floorBody = new ndBodyDynamic();
+	dMatrix matrix(dGetIdentityMatrix());
+	matrix.m_posit.m_y = dFloat32(-0.5f);
+	floorBody->SetNotifyCallback(new ndBodyNotify(dVector::m_zero));
+	floorBody->SetMatrix(matrix);
+	floorBody->SetCollisionShape(floor);
+	world.AddBody(floorBody);
+}
+
+// a horizontal sheet of count x count particles, one unit above the floor
+static ndBodyMassSpringDamper* AddCloth(ndWorld& world, dInt32 count, dFloat32 spacing, dInt32 substeps)
+{
+	const dVector gravity(dFloat32(0.0f), dFloat32(-10.0f), dFloat32(0.0f), dFloat32(0.0f));
+	ndBodyMassSpringDamper* const cloth = new ndBodyMassSpringDamper();
+	cloth->SetNotifyCallback(new ndBodyNotify(gravity));
+	cloth->SetMatrix(dGetIdentityMatrix());
+	cloth->SetParticleRadius(spacing * dFloat32(0.25f));
+	cloth->SetSubsteps(substeps);
+
+	dMatrix matrix(dGetIdentityMatrix());
+	matrix.m_posit = dVector(dFloat32(count) * spacing * dFloat32(-0.5f), dFloat32(1.0f), dFloat32(count) * spacing * dFloat32(-0.5f), dFloat32(1.0f));
+	cloth->AddClothPatch(matrix, count, count, spacing, dFloat32(0.01f), dFloat32(0.0f), dFloat32(1.0e-4f));
+	world.AddBody(cloth);
+	return cloth;
+}
+
+static void Step(ndWorld& world, dInt32 steps)
+{
+	for (dInt32 i = 0; i < steps; i++)
+	{
+		world.Update(dFloat32(1.0f / 60.0f));
+		world.Sync();
+	}
+}
+
+// the longest stretch spring over its rest length
+static dFloat32 MaxStretch(const ndBodyMassSpringDamper* const cloth, dInt32 count, dFloat32 spacing)
+{
+	dFloat32 stretch = dFloat32(0.0f);
+	const dArray<dVector>& posit = cloth->GetPositions();
+	for (dInt32 z = 0; z < count; z++)
+	{
+		for (dInt32 x = 0; x < count - 1; x++)
+		{
+			const dInt32 i0 = z * count + x;
+			const dInt32 i1 = x * count + z;
+			const dVector dir0((posit[i0 + 1] - posit[i0]) & dVector::m_triplexMask);
+			const dVector dir1((posit[i1 + count] - posit[i1]) & dVector::m_triplexMask);
+			stretch = dMax(stretch, dSqrt(dir0.DotProduct(dir0).GetScalar()) / spacing);
+			stretch = dMax(stretch, dSqrt(dir1.DotProduct(dir1).GetScalar()) / spacing);
+		}
+	}
+	return stretch;
+}
+
+// the stretch, shear and bend springs of the sheet fit in the colors
+static dInt32 CheckSprings(const ndBodyMassSpringDamper* const cloth, dInt32 count)
+{
+	dInt32 failed = 0;
+	const dInt32 stretch = 2 * (count - 1) * count;
+	const dInt32 shear = 2 * (count - 1) * (count - 1);
+	const dInt32 bend = 2 * (count - 2) * count;
+	failed += ndTestCheck(cloth->GetSpringCount() == stretch + shear + bend);
+	failed += ndTestCheck(cloth->GetColorCount() > 0);
+	failed += ndTestCheck(cloth->GetColorCount() <= D_MSD_MAX_COLORS + 1);
+	return failed;
+}
+
+// a flag pinned by two corners hangs without stretching, a free
+// cloth falls on the floor, stays above it and comes to rest
+dInt32 ndMassSpringDamperTest()
+{
+	dInt32 failed = 0;
+	const dInt32 count = 32;
+	const dFloat32 spacing = dFloat32(0.05f);
+	{
+		ndWorld world;
+		ndBodyMassSpringDamper* const cloth = AddCloth(world, count, spacing, 32);
+		cloth->SetParticleMass(0, dFloat32(0.0f));
+		cloth->SetParticleMass(count - 1, dFloat32(0.0f));
+		const dVector pin0(cloth->GetPositions()[0]);
+		const dVector pin1(cloth->GetPositions()[count - 1]);
+
+		Step(world, 120);
+		failed += CheckSprings(cloth, count);
+		failed += ndTestCheck(cloth->GetInvMasses()[0] == dFloat32(0.0f));
+		failed += ndTestCheck(cloth->GetPositions()[0].m_x == pin0.m_x);
+		failed += ndTestCheck(cloth->GetPositions()[0].m_y == pin0.m_y);
+		failed += ndTestCheck(cloth->GetPositions()[count - 1].m_z == pin1.m_z);
+		failed += ndTestCheck(cloth->GetPositions()[count * count - 1].m_y < dFloat32(0.5f));
+		failed += ndTestCheck(MaxStretch(cloth, count, spacing) < dFloat32(1.1f));
+	}
+
+	{
+		ndWorld world;
+		AddFloor(world);
+		ndBodyMassSpringDamper* const cloth = AddCloth(world, count, spacing, 8);
+		Step(world, 180);
+
+		dFloat32 minHeight = dFloat32(1.0e10f);
+		dFloat32 maxSpeed2 = dFloat32(0.0f);
+		const dArray<dVector>& posit = cloth->GetPositions();
+		const dArray<dVector>& veloc = cloth->GetVelocities();
+		for (dInt32 i = 0; i < posit.GetCount(); i++)
+		{
+			minHeight = dMin(minHeight, posit[i].m_y);
+			maxSpeed2 = dMax(maxSpeed2, veloc[i].DotProduct(veloc[i] & dVector::m_triplexMask).GetScalar());
+		}
+		failed += ndTestCheck(minHeight > -cloth->GetParticleRadius());
+		failed += ndTestCheck(minHeight < dFloat32(0.1f));
+		failed += ndTestCheck(maxSpeed2 < dFloat32(0.01f));
+	}
+	return failed;
+}
+
+// a cloth pinned by two corners falling over a box on the floor
+static void StepCloth(dInt32 count, dInt32 substeps, dInt32 steps)
+{
+	ndWorld world;
+	AddFloor(world);
+	ndShapeInstance box(new ndShapeBox(dFloat32(1.0f), dFloat32(1.0f), dFloat32(1.0f)));
+	ndBodyDynamic* const boxBody = new ndBodyDynamic();
+	dMatrix matrix(dGetIdentityMatrix());
+	matrix.m_posit.m_y = dFloat32(0.5f);
+	boxBody->SetNotifyCallback(new ndBodyNotify(dVector(dFloat32(0.0f), dFloat32(-10.0f), dFloat32(0.0f), dFloat32(0.0f))));
+	boxBody->SetMatrix(matrix);
+	boxBody->SetCollisionShape(box);
+	boxBody->SetMassMatrix(dFloat32(10.0f), box);
+	world.AddBody(boxBody);
+
+	ndBodyMassSpringDamper* const cloth = AddCloth(world, count, dFloat32(2.0f) / dFloat32(count), substeps);
+	cloth->SetParticleMass(0, dFloat32(0.0f));
+	cloth->SetParticleMass(count - 1, dFloat32(0.0f));
+
+	// the first step colors the springs
+	Step(world, 1);
+
+	const dFloat64 start = ndGetTimeInMs();
+	Step(world, steps);
+	const dFloat64 time = (ndGetTimeInMs() - start) / dFloat64(steps);
+	const dInt32 particleCount = cloth->GetPositions().GetCount();
+	printf("  %d particles, %d springs, %d colors, %d substeps, %d threads: %.2f ms per step  %.2f M particle substeps per second\n",
+		particleCount, cloth->GetSpringCount(), cloth->GetColorCount(), substeps, world.GetThreadCount(), time,
+		dFloat64(particleCount) * dFloat64(substeps) / (time * 1.0e3));
+}
+
+dInt32 ndMassSpringDamperBenchmark()
+{
+	StepCloth(100, 8, 20);
+	StepCloth(224, 8, 10);
+	StepCloth(316, 8, 5);
+	StepCloth(100, 32, 10);
+	return 0;
+}
@@ -0,0 +1,225 @@
+/* Copyright (c) <2003-2019> <Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely
+*/
+
+#include "testStdafx.h"
+#include "ndTestUtils.h"
+
+#define D_PBF_TEST_RADIUS	dFloat32 (0.1f)
+
+// a block of countX x countY x countZ particles one radius apart, all with the same velocity
+static ndBodyPbfFluid* AddPbfBlock(ndWorld& world, dInt32 countX, dInt32 countY, dInt32 countZ, const dVector& origin, const dVector& veloc, const dVector& gravity, dFloat32 friction)
+{
+	ndBodyPbfFluid* const fluid = new ndBodyPbfFluid();
+	fluid->SetNotifyCallback(new ndBodyNotify(gravity));
+	fluid->SetMatrix(dGetIdentityMatrix());
+	fluid->SetParticleRadius(D_PBF_TEST_RADIUS);
+	fluid->SetFriction(friction);
+	for (dInt32 z = 0; z < countZ; z++)
+	{
+		for (dInt32 y = 0; y < countY; y++)
+		{
+			for (dInt32 x = 0; x < countX; x++)
+			{
+				const dVector posit(origin + dVector(dFloat32(x), dFloat32(y), dFloat32(z), dFloat32(0.0f)).Scale(D_PBF_TEST_RADIUS));
+				fluid->AddParticle(dFloat32(0.1f), posit, veloc);
+			}
+		}
+	}
+	world.AddBody(fluid);
+	return fluid;
+}
+
+static ndBodyDynamic* AddBox(ndWorld& world, const dVector& size, const dVector& posit, dFloat32 mass)
+{
+	ndShapeInstance box(new ndShapeBox(size.m_x, size.m_y, size.m_z));
+	ndBodyDynamic* const body = new ndBodyDynamic();
+	body->SetNotifyCallback(new ndBodyNotify(dVector::m_zero));
+	dMatrix matrix(dGetIdentityMatrix());
+	matrix.m_posit = posit;
+	body->SetMatrix(matrix);
+	body->SetCollisionShape(box);
+	if (mass > dFloat32(0.0f))
+	{
+		body->SetMassMatrix(mass, box);
+	}
+	world.AddBody(body);
+	return body;
+}
+
+static void StepWorld(ndWorld& world, dInt32 steps)
+{
+	for (dInt32 i = 0; i < steps; i++)
+	{
+		world.Update(dFloat32(1.0f / 60.0f));
+		world.Sync();
+	}
+}
+
+// a block of fluid breaks in the corner of a pool of static boxes, the inside
+// of the pool goes from -1 to 1 in x and z and from 0 up in y
+static dInt32 CheckPool(dInt32 threadCount, dArray<dVector>& positOut, dArray<dVector>& velocOut)
+{
+	dInt32 failed = 0;
+	ndWorld world;
+	world.SetThreadCount(threadCount);
+	const dVector gravity(dFloat32(0.0f), dFloat32(-10.0f), dFloat32(0.0f), dFloat32(0.0f));
+	const dVector origin(dFloat32(-0.95f), dFloat32(0.05f), dFloat32(-0.95f), dFloat32(1.0f));
+	ndBodyPbfFluid* const fluid = AddPbfBlock(world, 12, 12, 12, origin, dVector::m_zero, gravity, dFloat32(0.0f));
+
+	const dVector floorSize(dFloat32(2.4f), dFloat32(0.2f), dFloat32(2.4f), dFloat32(0.0f));
+	const dVector wallSizeX(dFloat32(0.2f), dFloat32(2.0f), dFloat32(2.4f), dFloat32(0.0f));
+	const dVector wallSizeZ(dFloat32(2.4f), dFloat32(2.0f), dFloat32(0.2f), dFloat32(0.0f));
+	AddBox(world, floorSize, dVector(dFloat32(0.0f), dFloat32(-0.1f), dFloat32(0.0f), dFloat32(1.0f)), dFloat32(0.0f));
+	AddBox(world, wallSizeX, dVector(dFloat32(1.1f), dFloat32(1.0f), dFloat32(0.0f), dFloat32(1.0f)), dFloat32(0.0f));
+	AddBox(world, wallSizeX, dVector(dFloat32(-1.1f), dFloat32(1.0f), dFloat32(0.0f), dFloat32(1.0f)), dFloat32(0.0f));
+	AddBox(world, wallSizeZ, dVector(dFloat32(0.0f), dFloat32(1.0f), dFloat32(1.1f), dFloat32(1.0f)), dFloat32(0.0f));
+	AddBox(world, wallSizeZ, dVector(dFloat32(0.0f), dFloat32(1.0f), dFloat32(-1.1f), dFloat32(1.0f)), dFloat32(0.0f));
+	StepWorld(world, 90);
+
+	dInt32 escaped = 0;
+	dFloat32 maxX = dFloat32(-1.0e10f);
+	const dArray<dVector>& posit = fluid->GetPositions();
+	for (dInt32 i = 0; i < posit.GetCount(); i++)
+	{
+		const bool out = (posit[i].m_y < dFloat32(0.0f)) || (dAbs(posit[i].m_x) > dFloat32(1.0f)) || (dAbs(posit[i].m_z) > dFloat32(1.0f));
+		escaped += out ? 1 : 0;
+		maxX = dMax(maxX, posit[i].m_x);
+	}
+	failed += ndTestCheck(posit.GetCount() == 12 * 12 * 12);
+	failed += ndTestCheck(escaped == 0);
+	// the block broke and the fluid ran to the far wall
+	failed += ndTestCheck(maxX > dFloat32(0.5f));
+
+	// by particle id, the grid order is not part of the result
+	const dArray<dInt32>& ids = fluid->GetParticleIds();
+	const dArray<dVector>& veloc = fluid->GetVelocities();
+	positOut.SetCount(posit.GetCount());
+	velocOut.SetCount(posit.GetCount());
+	for (dInt32 i = 0; i < posit.GetCount(); i++)
+	{
+		positOut[ids[i]] = posit[i];
+		velocOut[ids[i]] = veloc[i];
+	}
+	return failed;
+}
+
+// a block of particles at 2 m/s hits a free box in zero gravity, the momentum
+// the fluid loses is what the box gains within the accuracy of the solver
+static dInt32 CheckMomentumTransfer(dInt32 threadCount, dVector& boxVelocOut)
+{
+	dInt32 failed = 0;
+	ndWorld world;
+	world.SetThreadCount(threadCount);
+	const dVector veloc(dFloat32(2.0f), dFloat32(0.0f), dFloat32(0.0f), dFloat32(0.0f));
+	const dVector origin(dFloat32(-0.9f), dFloat32(-0.35f), dFloat32(-0.35f), dFloat32(1.0f));
+	ndBodyPbfFluid* const fluid = AddPbfBlock(world, 8, 8, 8, origin, veloc, dVector::m_zero, dFloat32(0.0f));
+
+	const dFloat32 boxMass = dFloat32(20.0f);
+	const dVector boxSize(dFloat32(0.5f), dFloat32(1.2f), dFloat32(1.2f), dFloat32(0.0f));
+	ndBodyDynamic* const box = AddBox(world, boxSize, dVector(dFloat32(0.5f), dFloat32(0.0f), dFloat32(0.0f), dFloat32(1.0f)), boxMass);
+
+	const dFloat32 startMomentum = fluid->GetParticleMass() * veloc.m_x * dFloat32(fluid->GetPositions().GetCount());
+	StepWorld(world, 60);
+
+	dVector fluidMomentum(dVector::m_zero);
+	const dArray<dVector>& particleVeloc = fluid->GetVelocities();
+	for (dInt32 i = 0; i < particleVeloc.GetCount(); i++)
+	{
+		fluidMomentum += particleVeloc[i] & dVector::m_triplexMask;
+	}
+	fluidMomentum = fluidMomentum.Scale(fluid->GetParticleMass());
+	boxVelocOut = box->GetVelocity();
+	const dVector boxMomentum(boxVelocOut.Scale(boxMass));
+
+	// the position corrections lose about 3% of the momentum
+	failed += ndTestCheck(boxMomentum.m_x > startMomentum * dFloat32(0.2f));
+	failed += ndTestCheck(dAbs(fluidMomentum.m_x + boxMomentum.m_x - startMomentum) < startMomentum * dFloat32(0.04f));
+	return failed;
+}
+
+// a column of particles falls on a floor, returns the kinetic energy per particle,
+// the farthest particle from the axis of the column and the highest particle
+static void DropColumn(dFloat32 friction, dFloat32& kineticEnergy, dFloat32& spread, dFloat32& height)
+{
+	ndWorld world;
+	world.SetThreadCount(2);
+	const dVector gravity(dFloat32(0.0f), dFloat32(-10.0f), dFloat32(0.0f), dFloat32(0.0f));
+	const dVector origin(dFloat32(-0.25f), dFloat32(0.05f), dFloat32(-0.25f), dFloat32(1.0f));
+	ndBodyPbfFluid* const fluid = AddPbfBlock(world, 6, 18, 6, origin, dVector::m_zero, gravity, friction);
+	const dVector floorSize(dFloat32(20.0f), dFloat32(0.2f), dFloat32(20.0f), dFloat32(0.0f));
+	AddBox(world, floorSize, dVector(dFloat32(0.0f), dFloat32(-0.1f), dFloat32(0.0f), dFloat32(1.0f)), dFloat32(0.0f));
+	StepWorld(world, 240);
+
+	spread = dFloat32(0.0f);
+	height = dFloat32(0.0f);
+	kineticEnergy = dFloat32(0.0f);
+	const dArray<dVector>& posit = fluid->GetPositions();
+	const dArray<dVector>& veloc = fluid->GetVelocities();
+	for (dInt32 i = 0; i < posit.GetCount(); i++)
+	{
+		spread = dMax(spread, dSqrt(posit[i].m_x * posit[i].m_x + posit[i].m_z * posit[i].m_z));
+		height = dMax(height, posit[i].m_y);
+		kineticEnergy += dFloat32(0.5f) * fluid->GetParticleMass() * veloc[i].DotProduct(veloc[i] & dVector::m_triplexMask).GetScalar();
+	}
+	kineticEnergy /= dFloat32(posit.GetCount());
+}
+
+// with friction the particles settle in a pile, a liquid keeps spreading
+static dInt32 CheckGranularPile()
+{
+	dInt32 failed = 0;
+	dFloat32 sandEnergy;
+	dFloat32 sandSpread;
+	dFloat32 sandHeight;
+	dFloat32 liquidEnergy;
+	dFloat32 liquidSpread;
+	dFloat32 liquidHeight;
+	DropColumn(dFloat32(0.7f), sandEnergy, sandSpread, sandHeight);
+	DropColumn(dFloat32(0.0f), liquidEnergy, liquidSpread, liquidHeight);
+	failed += ndTestCheck(sandEnergy < dFloat32(1.0e-3f));
+	failed += ndTestCheck(sandSpread < dFloat32(2.0f));
+	// the column collapses in a low pile that keeps more than one layer
+	failed += ndTestCheck(sandHeight > D_PBF_TEST_RADIUS * dFloat32(1.5f));
+	failed += ndTestCheck(liquidSpread > sandSpread * dFloat32(3.0f));
+	failed += ndTestCheck(liquidHeight < sandHeight);
+	return failed;
+}
+
+// the position based fluid stays inside a pool on any number of threads with the
+// same result on all of them, pushes a free box with the momentum it loses and
+// with friction behaves like sand
+dInt32 ndPbfFluidTest()
+{
+	dInt32 failed = 0;
+	dArray<dVector> posit;
+	dArray<dVector> veloc;
+	dArray<dVector> positRef;
+	dArray<dVector> velocRef;
+	failed += CheckPool(1, positRef, velocRef);
+	for (dInt32 threadCount = 2; threadCount <= 4; threadCount++)
+	{
+		failed += CheckPool(threadCount, posit, veloc);
+		failed += ndTestCheck(posit.GetCount() == positRef.GetCount());
+		if (posit.GetCount() == positRef.GetCount())
+		{
+			failed += ndTestCheck(!memcmp(&posit[0], &positRef[0], size_t(posit.GetCount()) * sizeof(dVector)));
+			failed += ndTestCheck(!memcmp(&veloc[0], &velocRef[0], size_t(veloc.GetCount()) * sizeof(dVector)));
+		}
+	}
+
+	dVector boxVeloc;
+	dVector boxVeloc3;
+	failed += CheckMomentumTransfer(1, boxVeloc);
+	failed += CheckMomentumTransfer(3, boxVeloc3);
+	failed += ndTestCheck(dAbs(boxVeloc.m_x - boxVeloc3.m_x) < dFloat32(1.0e-3f));
+	failed += CheckGranularPile();
+	return failed;
+}
@@ -0,0 +1,75 @@
+/* Copyright (c) <2003-2019> <Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely
+*/
+
+#include "testStdafx.h"
+#include "ndTestUtils.h"
+
+static ndBodyKinematic* AddPlatform(ndWorld& world, bool kinematic)
+{
+	ndShapeInstance box(new ndShapeBox(dFloat32(2.0f), dFloat32(0.2f), dFloat32(2.0f)));
+	ndBodyKinematic* const body = kinematic ? new ndBodyKinematic() : new ndBodyDynamic();
+	body->SetNotifyCallback(new ndBodyNotify(dVector::m_zero));
+	body->SetMatrix(dGetIdentityMatrix());
+	body->SetCollisionShape(box);
+	if (!kinematic)
+	{
+		body->SetMassMatrix(dFloat32(0.0f), box);
+	}
+	world.AddBody(body);
+	return body;
+}
+
+// bodies the application teleports are reported at rest by the solver,
+// the stream must still follow them
+dInt32 ndReplicationTest()
+{
+	dInt32 failed = 0;
+	const dFloat32 positionStep = dFloat32(1.0f / 256.0f);
+	const dVector origin(dVector::m_zero);
+
+	ndWorld server;
+	ndWorld client;
+	ndBodyKinematic* const serverBodies[] = { AddPlatform(server, true), AddPlatform(server, false) };
+	ndBodyKinematic* const clientBodies[] = { AddPlatform(client, true), AddPlatform(client, false) };
+
+	ndReplicationExporter exporter(origin, positionStep, dFloat32(1.0f / 64.0f), dFloat32(1.0f / 64.0f));
+	ndReplicationImporter importer(origin, positionStep, dFloat32(1.0f / 64.0f), dFloat32(1.0f / 64.0f));
+	importer.BindBody(serverBodies[0]->GetId(), clientBodies[0]);
+	importer.BindBody(serverBodies[1]->GetId(), clientBodies[1]);
+
+	dArray<dUnsigned8> packet;
+	packet.SetCount(dInt32(exporter.CalculateBufferSize(&server)));
+	for (dInt32 frame = 0; frame < 60; frame++)
+	{
+		for (dInt32 i = 0; i < 2; i++)
+		{
+			dMatrix matrix(dYawMatrix(dFloat32(frame) * dFloat32(0.05f)));
+			matrix.m_posit = dVector(dFloat32(frame) * dFloat32(0.1f), dFloat32(i), dFloat32(0.0f), dFloat32(1.0f));
+			serverBodies[i]->SetMatrix(matrix);
+		}
+		server.Update(dFloat32(1.0f / 60.0f));
+		server.Sync();
+
+		const dInt64 size = exporter.Export(&server, &packet[0], packet.GetCount());
+		failed += ndTestCheck(size > 0);
+		const dInt64 sequence = importer.Import(&packet[0], size);
+		failed += ndTestCheck(sequence >= 0);
+		exporter.Acknowledge(dUnsigned32(sequence));
+		importer.Apply(&client, dFloat64(sequence));
+
+		for (dInt32 i = 0; i < 2; i++)
+		{
+			const dVector error(clientBodies[i]->GetMatrix().m_posit - serverBodies[i]->GetMatrix().m_posit);
+			failed += ndTestCheck(dSqrt(error.DotProduct(error & dVector::m_triplexMask).GetScalar()) < positionStep * dFloat32(2.0f));
+		}
+	}
+	return failed;
+}
@@ -0,0 +1,143 @@
+/* Copyright (c) <2003-2019> <Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely
+*/
+
+#include "testStdafx.h"
+#include "ndTestUtils.h"
+
+static bool BoxContains(const ndSceneNode* const parent, const ndSceneNode* const child)
+{
+	dVector parentP0;
+	dVector parentP1;
+	dVector childP0;
+	dVector childP1;
+	parent->GetAabb(parentP0, parentP1);
+	child->GetAabb(childP0, childP1);
+	const dVector inside((parentP0 <= childP0) & (childP1 <= parentP1));
+	return (inside.GetSignMask() & 0x07) == 0x07;
+}
+
+// every tree node encloses its children, returns the number of leaves
+static dInt32 CheckTree(const ndSceneNode* const node, dInt32& failed)
+{
+	if (node->GetBody())
+	{
+		return 1;
+	}
+	const ndSceneNode* const left = node->GetLeft();
+	const ndSceneNode* const right = node->GetRight();
+	failed += ndTestCheck(left && right);
+	failed += ndTestCheck(left && (left->m_parent == node) && BoxContains(node, left));
+	failed += ndTestCheck(right && (right->m_parent == node) && BoxContains(node, right));
+	return (left ? CheckTree(left, failed) : 0) + (right ? CheckTree(right, failed) : 0);
+}
+
+static dInt32 CheckAggregateTree(const ndSceneAggregate* const aggregate)
+{
+	dInt32 failed = 0;
+	failed += ndTestCheck(aggregate->m_root && (aggregate->m_root->m_parent == aggregate));
+	failed += ndTestCheck(BoxContains(aggregate, aggregate->m_root));
+	failed += ndTestCheck(CheckTree(aggregate->m_root, failed) == aggregate->GetCount());
+	failed += ndTestCheck(aggregate->m_fitness.GetCount() == aggregate->GetCount() - 1);
+	return failed;
+}
+
+static dFloat32 HighestBody(const ndWorld& world)
+{
+	dFloat32 y = dFloat32(-1.0e10f);
+	const ndBodyList& bodyList = world.GetBodyList();
+	for (ndBodyList::dNode* node = bodyList.GetFirst(); node; node = node->GetNext())
+	{
+		y = dMax(y, node->GetInfo()->GetMatrix().m_posit.m_y);
+	}
+	return y;
+}
+
+// columns of two axis aligned boxes on a static floor, they settle and go to sleep
+static void BuildColumns(ndWorld& world, dInt32 count)
+{
+	const dVector gravity(dFloat32(0.0f), dFloat32(-10.0f), dFloat32(0.0f), dFloat32(0.0f));
+	ndShapeInstance floor(new ndShapeBox(dFloat32(200.0f), dFloat32(1.0f), dFloat32(200.0f)));
+	ndBodyDynamic* const floorBody = new ndBodyDynamic();
+	dMatrix matrix(dGetIdentityMatrix());
+	matrix.m_posit.m_y = dFloat32(-0.5f);
+	floorBody->SetNotifyCallback(new ndBodyNotify(gravity));
+	floorBody->SetMatrix(matrix);
+	floorBody->SetCollisionShape(floor);
+	world.AddBody(floorBody);
+
+	ndShapeInstance box(new ndShapeBox(dFloat32(0.9f), dFloat32(0.5f), dFloat32(0.9f)));
+	for (dInt32 i = 0; i < count * count * 2; i++)
+	{
+		matrix.m_posit = dVector(dFloat32((i / 2) % count) * dFloat32(1.5f), dFloat32(0.25f) + dFloat32(i & 1) * dFloat32(0.5f), dFloat32((i / 2) / count) * dFloat32(1.5f), dFloat32(1.0f));
+		ndBodyDynamic* const body = new ndBodyDynamic();
+		body->SetNotifyCallback(new ndBodyNotify(gravity));
+		body->SetMatrix(matrix);
+		body->SetCollisionShape(box);
+		body->SetMassMatrix(dFloat32(1.0f), box);
+		world.AddBody(body);
+	}
+}
+
+// every body after the floor goes in one aggregate with self collision
+static ndSceneAggregate* AddAggregate(ndWorld& world, dInt32& failed)
+{
+	ndSceneAggregate* const aggregate = world.CreateAggregate();
+	aggregate->SetSelfCollision(true);
+	const ndBodyList& bodyList = world.GetBodyList();
+	for (ndBodyList::dNode* node = bodyList.GetFirst()->GetNext(); node; node = node->GetNext())
+	{
+		failed += ndTestCheck(world.AddToAggregate(aggregate, node->GetInfo()));
+	}
+	failed += ndTestCheck(aggregate->GetCount() == bodyList.GetCount() - 1);
+	return aggregate;
+}
+
+// the private tree of an aggregate stays valid while its members move and the
+// members collide with each other, the aggregate goes to sleep with all its
+// members and wakes up with any of them
+dInt32 ndSceneAggregateTest()
+{
+	dInt32 failed = 0;
+	{
+		ndWorld world;
+		ndBuildBoxPile(world, 4, 3);
+		ndSceneAggregate* const aggregate = AddAggregate(world, failed);
+		for (dInt32 i = 0; i < 60; i++)
+		{
+			world.Update(dFloat32(1.0f / 60.0f));
+			world.Sync();
+			failed += CheckAggregateTree(aggregate);
+		}
+		// the top layer rests on the others instead of falling to the floor
+		failed += ndTestCheck(HighestBody(world) > dFloat32(0.8f));
+	}
+
+	{
+		ndWorld world;
+		BuildColumns(world, 3);
+		ndSceneAggregate* const aggregate = AddAggregate(world, failed);
+		for (dInt32 i = 0; (i < 600) && !aggregate->IsSleeping(); i++)
+		{
+			world.Update(dFloat32(1.0f / 60.0f));
+			world.Sync();
+		}
+		failed += ndTestCheck(aggregate->IsSleeping());
+		failed += ndTestCheck(HighestBody(world) > dFloat32(0.7f));
+
+		ndBodyKinematic* const body = world.GetBodyList().GetLast()->GetInfo();
+		body->SetVelocity(dVector(dFloat32(0.0f), dFloat32(5.0f), dFloat32(0.0f), dFloat32(0.0f)));
+		world.Update(dFloat32(1.0f / 60.0f));
+		world.Sync();
+		failed += ndTestCheck(!aggregate->IsSleeping());
+		failed += CheckAggregateTree(aggregate);
+	}
+	return failed;
+}
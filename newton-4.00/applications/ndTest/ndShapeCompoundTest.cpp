@@ -0,0 +1,307 @@
+/* Copyright (c) <2003-2019> <Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely
+*/
+
+#include "testStdafx.h"
+#include "ndTestUtils.h"
+
+typedef ndShapeCompound::ndTreeArray::dNode ndCompoundTestNode;
+
+// the closest hit, nothing is filtered
+class ndCompoundTestRayNotify: public ndRayCastNotify
+{
+	public:
+	dFloat32 OnRayCastAction(const ndContactPoint&, dFloat32 intersetParam)
+	{
+		return intersetParam;
+	}
+};
+
+static dInt32 RandIndex(dInt32 count)
+{
+	return dMin(dInt32(dRand() * dFloat32(count)), count - 1);
+}
+
+static dVector RandPoint(dFloat32 size)
+{
+	return dVector(dRand() * size - size * dFloat32(0.5f), dRand() * size - size * dFloat32(0.5f), dRand() * size - size * dFloat32(0.5f), dFloat32(0.0f));
+}
+
+// a box, a sphere or a capsule at a random place and orientation
+static void AddRandomChild(ndShapeCompound* const compound, dFloat32 spread, dArray<ndCompoundTestNode*>& nodes)
+{
+	ndShapeInstance box(new ndShapeBox(dFloat32(0.3f) + dRand(), dFloat32(0.3f) + dRand(), dFloat32(0.3f) + dRand()));
+	ndShapeInstance sphere(new ndShapeSphere(dFloat32(0.2f) + dRand() * dFloat32(0.5f)));
+	ndShapeInstance capsule(new ndShapeCapsule(dFloat32(0.2f), dFloat32(0.3f), dFloat32(1.0f)));
+	ndShapeInstance* const shapes[] = { &box, &sphere, &capsule };
+	ndShapeInstance* const child = shapes[RandIndex(3)];
+
+	dMatrix matrix(dPitchMatrix(dRand() * dFloat32(6.0f)) * dYawMatrix(dRand() * dFloat32(6.0f)) * dRollMatrix(dRand() * dFloat32(6.0f)));
+	matrix.m_posit = RandPoint(spread);
+	matrix.m_posit.m_w = dFloat32(1.0f);
+	child->SetLocalMatrix(matrix);
+	nodes.PushBack(compound->AddCollision(child));
+}
+
+static bool BoxContains(const dVector& p0, const dVector& p1, const dVector& q0, const dVector& q1)
+{
+	bool contains = true;
+	for (dInt32 i = 0; i < 3; i++)
+	{
+		contains = contains && (p0[i] <= q0[i]) && (p1[i] >= q1[i]);
+	}
+	return contains;
+}
+
+// every flat node box holds the boxes of its children, every leaf box holds
+// the box of its sub shape, and every sub shape is a leaf of the flat tree
+static dInt32 CheckFlatTree(const ndShapeCompound* const compound, dInt32 leafCount)
+{
+	const ndShapeCompound::ndFlatNode* const root = compound->GetFlatRoot();
+	if (!root)
+	{
+		return leafCount ? 1 : 0;
+	}
+
+	dInt32 errors = 0;
+	dInt32 leaves = 0;
+	dArray<const ndShapeCompound::ndFlatNode*> stackPool;
+	stackPool.PushBack(root);
+	while (stackPool.GetCount())
+	{
+		const ndShapeCompound::ndFlatNode* const node = stackPool[stackPool.GetCount() - 1];
+		stackPool.SetCount(stackPool.GetCount() - 1);
+
+		dVector p0;
+		dVector p1;
+		compound->GetFlatBox(node, p0, p1);
+		if (node->IsLeaf())
+		{
+			dVector q0;
+			dVector q1;
+			const ndShapeInstance* const shape = compound->GetFlatShape(node);
+			shape->CalculateAabb(shape->GetLocalMatrix(), q0, q1);
+			errors += BoxContains(p0, p1, q0, q1) ? 0 : 1;
+			leaves++;
+		}
+		else
+		{
+			const ndShapeCompound::ndFlatNode* const children[] = { compound->GetFlatLeft(node), compound->GetFlatRight(node) };
+			for (dInt32 i = 0; i < 2; i++)
+			{
+				dVector q0;
+				dVector q1;
+				compound->GetFlatBox(children[i], q0, q1);
+				errors += BoxContains(p0, p1, q0, q1) ? 0 : 1;
+				stackPool.PushBack(children[i]);
+			}
+		}
+	}
+	return errors + ((leaves == leafCount) ? 0 : 1);
+}
+
+// the ray cast through the flat tree finds the same closest hit as casting against every
+// sub shape, the convex ray cast takes the scale of the body shape so it needs a body
+static dInt32 CheckRays(const ndShapeInstance& compoundInstance, const dArray<ndCompoundTestNode*>& nodes, dFloat32 spread, dInt32 count, dInt32& hits)
+{
+	dInt32 mismatches = 0;
+	ndBodyDynamic body;
+	ndCompoundTestRayNotify callback;
+	for (dInt32 i = 0; i < count; i++)
+	{
+		const dVector p0(RandPoint(spread * dFloat32(1.5f)));
+		const dVector p1(RandPoint(spread * dFloat32(1.5f)));
+
+		ndContactPoint contact;
+		const dFloat32 t = compoundInstance.RayCast(callback, p0, p1, &body, contact);
+
+		dFloat32 tRef = dFloat32(1.2f);
+		for (dInt32 j = 0; j < nodes.GetCount(); j++)
+		{
+			ndContactPoint childContact;
+			const ndShapeInstance* const shape = nodes[j]->GetInfo()->GetShape();
+			const dVector q0(shape->GetLocalMatrix().UntransformVector(p0) & dVector::m_triplexMask);
+			const dVector q1(shape->GetLocalMatrix().UntransformVector(p1) & dVector::m_triplexMask);
+			tRef = dMin(tRef, shape->RayCast(callback, q0, q1, &body, childContact));
+		}
+
+		bool same = (t < dFloat32(1.0f)) == (tRef < dFloat32(1.0f));
+		if (same && (tRef < dFloat32(1.0f)))
+		{
+			hits++;
+			same = (t == tRef);
+		}
+		mismatches += same ? 0 : 1;
+	}
+	return mismatches;
+}
+
+// the flat tree of a compound built in one go, and kept valid while its sub shapes
+// are removed in random batches until the compound is empty
+static dInt32 CheckTree(dInt32 childCount, dInt32 rayCount, dFloat32 spread)
+{
+	dInt32 failed = 0;
+	dInt32 hits = 0;
+	ndShapeInstance compoundInstance(new ndShapeCompound());
+	ndShapeCompound* const compound = compoundInstance.GetShape()->GetAsShapeCompound();
+
+	dArray<ndCompoundTestNode*> nodes;
+	compound->BeginAddRemove();
+	for (dInt32 i = 0; i < childCount; i++)
+	{
+		AddRandomChild(compound, spread, nodes);
+	}
+	compound->EndAddRemove();
+	failed += ndTestCheck(CheckFlatTree(compound, nodes.GetCount()) == 0);
+	failed += ndTestCheck(CheckRays(compoundInstance, nodes, spread, rayCount, hits) == 0);
+
+	for (dInt32 i = nodes.GetCount() - 1; i > 0; i--)
+	{
+		dSwap(nodes[i], nodes[RandIndex(i + 1)]);
+	}
+
+	dInt32 batch = 0;
+	while (nodes.GetCount())
+	{
+		compound->BeginAddRemove();
+		for (dInt32 i = dMin(1 + RandIndex(32), nodes.GetCount()); i > 0; i--)
+		{
+			compound->RemoveCollision(nodes[nodes.GetCount() - 1]);
+			nodes.SetCount(nodes.GetCount() - 1);
+		}
+		compound->EndAddRemove();
+		failed += ndTestCheck(CheckFlatTree(compound, nodes.GetCount()) == 0);
+		if (!(batch & 7))
+		{
+			failed += ndTestCheck(CheckRays(compoundInstance, nodes, spread, 20, hits) == 0);
+		}
+		batch++;
+	}
+
+	// nothing is left to hit
+	failed += ndTestCheck(compound->GetFlatRoot() == nullptr);
+	failed += ndTestCheck(CheckRays(compoundInstance, nodes, spread, 20, hits) == 0);
+	failed += ndTestCheck(hits > rayCount / 4);
+	return failed;
+}
+
+// a table top with four legs
+static void BuildTable(ndShapeInstance& compoundInstance)
+{
+	ndShapeCompound* const compound = compoundInstance.GetShape()->GetAsShapeCompound();
+	ndShapeInstance top(new ndShapeBox(dFloat32(1.0f), dFloat32(0.1f), dFloat32(0.8f)));
+	ndShapeInstance leg(new ndShapeBox(dFloat32(0.1f), dFloat32(0.5f), dFloat32(0.1f)));
+
+	compound->BeginAddRemove();
+	compound->AddCollision(&top);
+	for (dInt32 i = 0; i < 4; i++)
+	{
+		dMatrix matrix(dGetIdentityMatrix());
+		matrix.m_posit = dVector((i & 1) ? dFloat32(0.45f) : dFloat32(-0.45f), dFloat32(-0.3f), (i & 2) ? dFloat32(0.35f) : dFloat32(-0.35f), dFloat32(1.0f));
+		leg.SetLocalMatrix(matrix);
+		compound->AddCollision(&leg);
+	}
+	compound->EndAddRemove();
+}
+
+static void AddBody(ndWorld& world, const ndShapeInstance& shape, const dMatrix& matrix, dFloat32 mass)
+{
+	const dVector gravity(dFloat32(0.0f), dFloat32(-10.0f), dFloat32(0.0f), dFloat32(0.0f));
+	ndBodyDynamic* const body = new ndBodyDynamic();
+	body->SetNotifyCallback(new ndBodyNotify(gravity));
+	body->SetMatrix(matrix);
+	body->SetCollisionShape(shape);
+	if (mass > dFloat32(0.0f))
+	{
+		body->SetMassMatrix(mass, shape);
+	}
+	world.AddBody(body);
+}
+
+// tables falling on a floor, on each other and through a static compound
+// that had all its sub shapes removed
+static void BuildTableScene(ndWorld& world)
+{
+	world.SetThreadCount(2);
+	ndShapeInstance floor(new ndShapeBox(dFloat32(200.0f), dFloat32(1.0f), dFloat32(200.0f)));
+	dMatrix matrix(dGetIdentityMatrix());
+	matrix.m_posit.m_y = dFloat32(-0.5f);
+	AddBody(world, floor, matrix, dFloat32(0.0f));
+
+	ndShapeInstance empty(new ndShapeCompound());
+	ndShapeCompound* const compound = empty.GetShape()->GetAsShapeCompound();
+	ndShapeInstance box(new ndShapeBox(dFloat32(1.0f), dFloat32(1.0f), dFloat32(1.0f)));
+	compound->BeginAddRemove();
+	ndCompoundTestNode* const node = compound->AddCollision(&box);
+	compound->EndAddRemove();
+	compound->BeginAddRemove();
+	compound->RemoveCollision(node);
+	compound->EndAddRemove();
+	matrix.m_posit.m_y = dFloat32(1.0f);
+	AddBody(world, empty, matrix, dFloat32(0.0f));
+
+	ndShapeInstance table(new ndShapeCompound());
+	BuildTable(table);
+	const dInt32 count = 3;
+	for (dInt32 y = 0; y < 4; y++)
+	{
+		for (dInt32 z = 0; z < count; z++)
+		{
+			for (dInt32 x = 0; x < count; x++)
+			{
+				matrix = dYawMatrix(dFloat32(x + y * 2) * dFloat32(0.4f)) * dRollMatrix(dFloat32(z - y) * dFloat32(0.1f));
+				matrix.m_posit = dVector(dFloat32(x - 1) * dFloat32(0.7f), dFloat32(1.0f) + dFloat32(y) * dFloat32(1.2f), dFloat32(z - 1) * dFloat32(0.6f), dFloat32(1.0f));
+				AddBody(world, table, matrix, dFloat32(1.0f));
+			}
+		}
+	}
+}
+
+// two runs of the same scene end in the same state, and nothing sinks in the floor
+static dInt32 CheckTableScene()
+{
+	dInt32 failed = 0;
+	ndWorld world;
+	ndWorld worldRef;
+	BuildTableScene(world);
+	BuildTableScene(worldRef);
+	const dUnsigned64 startHash = ndHashBodies(world);
+	for (dInt32 i = 0; i < 300; i++)
+	{
+		world.Update(dFloat32(1.0f / 60.0f));
+		worldRef.Update(dFloat32(1.0f / 60.0f));
+		world.Sync();
+		worldRef.Sync();
+	}
+
+	failed += ndTestCheck(ndHashBodies(world) == ndHashBodies(worldRef));
+	failed += ndTestCheck(ndHashBodies(world) != startHash);
+	dFloat32 minHeight = dFloat32(1.0e10f);
+	for (ndBodyList::dNode* node = world.GetBodyList().GetFirst()->GetNext(); node; node = node->GetNext())
+	{
+		minHeight = dMin(minHeight, node->GetInfo()->GetMatrix().m_posit.m_y);
+	}
+	// the legs are 0.55 below the body origin
+	failed += ndTestCheck(minHeight > dFloat32(0.0f));
+	return failed;
+}
+
+// the flat tree bounds its sub shapes, its ray cast matches casting against every
+// sub shape, it stays valid while sub shapes are removed, and compound bodies,
+// empty ones included, simulate the same way every run
+dInt32 ndShapeCompoundTest()
+{
+	dInt32 failed = 0;
+	dSetRandSeed(40);
+	failed += CheckTree(300, 2000, dFloat32(20.0f));
+	failed += CheckTree(2048, 200, dFloat32(40.0f));
+	failed += CheckTableScene();
+	return failed;
+}
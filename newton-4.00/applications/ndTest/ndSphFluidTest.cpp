@@ -0,0 +1,354 @@
+/* Copyright (c) <2003-2019> <Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely
+*/
+
+#include "testStdafx.h"
+#include "ndTestUtils.h"
+
+// a cube of count x count x count particles, all with the same velocity
+static ndBodySphFluid* AddFluidBlock(ndWorld& world, dInt32 count, dFloat32 radius, dFloat32 spacing, const dVector& origin, const dVector& veloc, const dVector& gravity)
+{
+	ndBodySphFluid* const fluid = new ndBodySphFluid();
+	fluid->SetNotifyCallback(new ndBodyNotify(gravity));
+	fluid->SetMatrix(dGetIdentityMatrix());
+	fluid->SetParticleRadius(radius);
+	for (dInt32 z = 0; z < count; z++)
+	{
+		for (dInt32 y = 0; y < count; y++)
+		{
+			for (dInt32 x = 0; x < count; x++)
+			{
+				const dVector posit(origin + dVector(dFloat32(x) * spacing, dFloat32(y) * spacing, dFloat32(z) * spacing, dFloat32(0.0f)));
+				fluid->AddParticle(dFloat32(0.1f), posit, veloc);
+			}
+		}
+	}
+	world.AddBody(fluid);
+	return fluid;
+}
+
+static ndBodySphFluid* AddFluidCube(ndWorld& world, dInt32 count, dFloat32 radius, dFloat32 spacing, const dVector& gravity)
+{
+	const dVector origin(dFloat32(0.0f), dFloat32(0.0f), dFloat32(0.0f), dFloat32(1.0f));
+	return AddFluidBlock(world, count, radius, spacing, origin, dVector::m_zero, gravity);
+}
+
+static ndBodyDynamic* AddBox(ndWorld& world, const dVector& size, const dVector& posit, dFloat32 mass)
+{
+	ndShapeInstance box(new ndShapeBox(size.m_x, size.m_y, size.m_z));
+	ndBodyDynamic* const body = new ndBodyDynamic();
+	body->SetNotifyCallback(new ndBodyNotify(dVector::m_zero));
+	dMatrix matrix(dGetIdentityMatrix());
+	matrix.m_posit = posit;
+	body->SetMatrix(matrix);
+	body->SetCollisionShape(box);
+	if (mass > dFloat32(0.0f))
+	{
+		body->SetMassMatrix(mass, box);
+	}
+	world.AddBody(body);
+	return body;
+}
+
+// the particles that are deeper than tolerance inside the box of a body
+static dInt32 ParticlesInside(const ndBodySphFluid* const fluid, const ndBodyKinematic* const body, const dVector& size, dFloat32 tolerance)
+{
+	dInt32 count = 0;
+	const dMatrix matrix(body->GetMatrix());
+	const dVector halfSize(size.Scale(dFloat32(0.5f)) - dVector(tolerance));
+	const dArray<dVector>& posit = fluid->GetPositions();
+	for (dInt32 i = 0; i < posit.GetCount(); i++)
+	{
+		const dVector local(matrix.UntransformVector(posit[i]));
+		const bool inside = (dAbs(local.m_x) < halfSize.m_x) && (dAbs(local.m_y) < halfSize.m_y) && (dAbs(local.m_z) < halfSize.m_z);
+		count += inside ? 1 : 0;
+	}
+	return count;
+}
+
+static dFloat32 MaxSpeed(const ndBodySphFluid* const fluid)
+{
+	dFloat32 speed2 = dFloat32(0.0f);
+	const dArray<dVector>& veloc = fluid->GetVelocities();
+	for (dInt32 i = 0; i < veloc.GetCount(); i++)
+	{
+		speed2 = dMax(speed2, veloc[i].DotProduct(veloc[i] & dVector::m_triplexMask).GetScalar());
+	}
+	return dSqrt(speed2);
+}
+
+// the particles are reordered by cell, the id of a particle at rest 
+// must still find the lattice point it was added at
+static dInt32 CheckParticleIds(const ndBodySphFluid* const fluid, dInt32 count, dFloat32 spacing)
+{
+	dInt32 failed = 0;
+	const dArray<dInt32>& ids = fluid->GetParticleIds();
+	const dArray<dVector>& posit = fluid->GetPositions();
+	failed += ndTestCheck(ids.GetCount() == posit.GetCount());
+
+	dInt32 reordered = 0;
+	dArray<dInt32> found;
+	found.SetCount(ids.GetCount());
+	memset(&found[0], 0, size_t(found.GetCount()) * sizeof(dInt32));
+	for (dInt32 i = 0; i < ids.GetCount(); i++)
+	{
+		const dInt32 id = ids[i];
+		failed += ndTestCheck((id >= 0) && (id < ids.GetCount()));
+		if ((id >= 0) && (id < ids.GetCount()))
+		{
+			found[id]++;
+			reordered += (id != i) ? 1 : 0;
+			const dVector lattice(dFloat32(id % count) * spacing, dFloat32((id / count) % count) * spacing, dFloat32(id / (count * count)) * spacing, dFloat32(1.0f));
+			const dVector error((posit[i] - lattice) & dVector::m_triplexMask);
+			failed += ndTestCheck(error.DotProduct(error).GetScalar() < dFloat32(1.0e-6f));
+		}
+	}
+	for (dInt32 i = 0; i < found.GetCount(); i++)
+	{
+		failed += ndTestCheck(found[i] == 1);
+	}
+	failed += ndTestCheck(reordered > 0);
+	return failed;
+}
+
+// a ray down the center of a lattice column hits the top particle
+static dInt32 CheckRayHitId(const ndBodySphFluid* const fluid, dInt32 count, dFloat32 spacing)
+{
+	dInt32 failed = 0;
+	const dVector p0(dFloat32(2.0f) * spacing, dFloat32(count + 2) * spacing, dFloat32(3.0f) * spacing, dFloat32(1.0f));
+	const dVector p1(dFloat32(2.0f) * spacing, dFloat32(-2.0f) * spacing, dFloat32(3.0f) * spacing, dFloat32(1.0f));
+	ndRayCastClosestHitCallback callback;
+	failed += ndTestCheck(fluid->RayCast(callback, dFastRayTest(p0, p1), dFloat32(1.0f)));
+	const dInt32 index = callback.m_contact.m_shapeId0;
+	const dInt32 id = callback.m_contact.m_shapeId1;
+	failed += ndTestCheck(id == fluid->GetParticleIds()[index]);
+	failed += ndTestCheck(id == ((3 * count + count - 1) * count + 2));
+	return failed;
+}
+
+// a block of particles falls in a container of static boxes and stays inside of it
+static dInt32 CheckContainer(dInt32 threadCount)
+{
+	dInt32 failed = 0;
+	ndWorld world;
+	world.SetThreadCount(threadCount);
+	const dFloat32 radius = dFloat32(0.1f);
+	const dVector gravity(dFloat32(0.0f), dFloat32(-10.0f), dFloat32(0.0f), dFloat32(0.0f));
+	const dVector origin(dFloat32(-0.45f), dFloat32(0.5f), dFloat32(-0.45f), dFloat32(1.0f));
+	ndBodySphFluid* const fluid = AddFluidBlock(world, 10, radius, radius, origin, dVector::m_zero, gravity);
+
+	// the inside of the container goes from -0.6 to 0.6 in x and z, and from 0 up in y
+	const dVector floorSize(dFloat32(1.6f), dFloat32(0.2f), dFloat32(1.6f), dFloat32(0.0f));
+	const dVector wallSizeX(dFloat32(0.2f), dFloat32(2.0f), dFloat32(1.6f), dFloat32(0.0f));
+	const dVector wallSizeZ(dFloat32(1.6f), dFloat32(2.0f), dFloat32(0.2f), dFloat32(0.0f));
+	ndBodyDynamic* const walls[] = {
+		AddBox(world, floorSize, dVector(dFloat32(0.0f), dFloat32(-0.1f), dFloat32(0.0f), dFloat32(1.0f)), dFloat32(0.0f)),
+		AddBox(world, wallSizeX, dVector(dFloat32(0.7f), dFloat32(1.0f), dFloat32(0.0f), dFloat32(1.0f)), dFloat32(0.0f)),
+		AddBox(world, wallSizeX, dVector(dFloat32(-0.7f), dFloat32(1.0f), dFloat32(0.0f), dFloat32(1.0f)), dFloat32(0.0f)),
+		AddBox(world, wallSizeZ, dVector(dFloat32(0.0f), dFloat32(1.0f), dFloat32(0.7f), dFloat32(1.0f)), dFloat32(0.0f)),
+		AddBox(world, wallSizeZ, dVector(dFloat32(0.0f), dFloat32(1.0f), dFloat32(-0.7f), dFloat32(1.0f)), dFloat32(0.0f)),
+	};
+	const dVector* const sizes[] = { &floorSize, &wallSizeX, &wallSizeX, &wallSizeZ, &wallSizeZ };
+
+	dInt32 inside = 0;
+	for (dInt32 i = 0; i < 120; i++)
+	{
+		world.Update(dFloat32(1.0f / 60.0f));
+		world.Sync();
+		for (dInt32 j = 0; j < dInt32(sizeof(walls) / sizeof(walls[0])); j++)
+		{
+			inside += ParticlesInside(fluid, walls[j], *sizes[j], dFloat32(0.0f));
+		}
+	}
+
+	dInt32 escaped = 0;
+	dFloat32 minHeight = dFloat32(1.0e10f);
+	const dArray<dVector>& posit = fluid->GetPositions();
+	for (dInt32 i = 0; i < posit.GetCount(); i++)
+	{
+		const bool out = (posit[i].m_y < dFloat32(0.0f)) || (dAbs(posit[i].m_x) > dFloat32(0.6f)) || (dAbs(posit[i].m_z) > dFloat32(0.6f));
+		escaped += out ? 1 : 0;
+		minHeight = dMin(minHeight, posit[i].m_y);
+	}
+	failed += ndTestCheck(posit.GetCount() == 1000);
+	failed += ndTestCheck(inside == 0);
+	failed += ndTestCheck(escaped == 0);
+	// the fluid fell on the floor
+	failed += ndTestCheck(minHeight < radius * dFloat32(2.0f));
+	return failed;
+}
+
+// a block of particles at 2 m/s hits a free box in zero gravity, the momentum the
+// fluid loses is what the box gains and no particle goes through the box
+static dInt32 CheckMomentumTransfer(dInt32 threadCount, dVector& boxVelocOut)
+{
+	dInt32 failed = 0;
+	ndWorld world;
+	world.SetThreadCount(threadCount);
+	const dFloat32 radius = dFloat32(0.1f);
+	const dVector veloc(dFloat32(2.0f), dFloat32(0.0f), dFloat32(0.0f), dFloat32(0.0f));
+	const dVector origin(dFloat32(-0.9f), dFloat32(-0.35f), dFloat32(-0.35f), dFloat32(1.0f));
+	ndBodySphFluid* const fluid = AddFluidBlock(world, 8, radius, radius, origin, veloc, dVector::m_zero);
+
+	const dFloat32 boxMass = dFloat32(20.0f);
+	const dVector boxSize(dFloat32(0.5f), dFloat32(1.2f), dFloat32(1.2f), dFloat32(0.0f));
+	ndBodyDynamic* const box = AddBox(world, boxSize, dVector(dFloat32(0.5f), dFloat32(0.0f), dFloat32(0.0f), dFloat32(1.0f)), boxMass);
+
+	const dFloat32 startMomentum = fluid->GetParticleMass() * veloc.m_x * dFloat32(fluid->GetPositions().GetCount());
+	dInt32 inside = 0;
+	for (dInt32 i = 0; i < 60; i++)
+	{
+		world.Update(dFloat32(1.0f / 60.0f));
+		world.Sync();
+		inside += ParticlesInside(fluid, box, boxSize, dFloat32(0.0f));
+	}
+
+	dVector fluidMomentum(dVector::m_zero);
+	const dArray<dVector>& particleVeloc = fluid->GetVelocities();
+	for (dInt32 i = 0; i < particleVeloc.GetCount(); i++)
+	{
+		fluidMomentum += particleVeloc[i] & dVector::m_triplexMask;
+	}
+	fluidMomentum = fluidMomentum.Scale(fluid->GetParticleMass());
+	boxVelocOut = box->GetVelocity();
+	const dVector boxMomentum(boxVelocOut.Scale(boxMass));
+
+	failed += ndTestCheck(inside == 0);
+	// the box took a good part of the fluid momentum
+	failed += ndTestCheck(boxMomentum.m_x > startMomentum * dFloat32(0.25f));
+	failed += ndTestCheck(dAbs(fluidMomentum.m_x + boxMomentum.m_x - startMomentum) < startMomentum * dFloat32(0.03f));
+	return failed;
+}
+
+// a lattice at rest density stays at rest, a compressed one pushes out,
+// and the fluid collides with rigid bodies and pushes the free ones
+dInt32 ndSphFluidTest()
+{
+	dInt32 failed = 0;
+	const dFloat32 radius = dFloat32(0.1f);
+	{
+		ndWorld world;
+		ndBodySphFluid* const fluid = AddFluidCube(world, 10, radius, radius, dVector::m_zero);
+		for (dInt32 i = 0; i < 30; i++)
+		{
+			world.Update(dFloat32(1.0f / 60.0f));
+			world.Sync();
+		}
+		failed += ndTestCheck(fluid->GetPositions().GetCount() == 1000);
+		failed += ndTestCheck(MaxSpeed(fluid) < dFloat32(1.0e-4f));
+		failed += CheckParticleIds(fluid, 10, radius);
+		failed += CheckRayHitId(fluid, 10, radius);
+	}
+
+	{
+		ndWorld world;
+		ndBodySphFluid* const fluid = AddFluidCube(world, 10, radius, radius * dFloat32(0.75f), dVector::m_zero);
+		for (dInt32 i = 0; i < 5; i++)
+		{
+			world.Update(dFloat32(1.0f / 60.0f));
+			world.Sync();
+		}
+		failed += ndTestCheck(MaxSpeed(fluid) > dFloat32(1.0e-2f));
+	}
+
+	dVector boxVeloc;
+	dVector boxVeloc3;
+	failed += CheckContainer(1);
+	failed += CheckContainer(3);
+	failed += CheckMomentumTransfer(1, boxVeloc);
+	failed += CheckMomentumTransfer(3, boxVeloc3);
+	failed += ndTestCheck(dAbs(boxVeloc.m_x - boxVeloc3.m_x) < dFloat32(1.0e-3f));
+	return failed;
+}
+
+// a falling cube of particles one radius apart
+static void StepFluidCube(dInt32 count, dInt32 steps)
+{
+	ndWorld world;
+	const dFloat32 radius = dFloat32(0.1f);
+	const dVector gravity(dFloat32(0.0f), dFloat32(-10.0f), dFloat32(0.0f), dFloat32(0.0f));
+	ndBodySphFluid* const fluid = AddFluidCube(world, count, radius, radius, gravity);
+
+	// the first step sorts the grid from scratch
+	world.Update(dFloat32(1.0f / 60.0f));
+	world.Sync();
+
+	const dFloat64 start = ndGetTimeInMs();
+	for (dInt32 i = 0; i < steps; i++)
+	{
+		world.Update(dFloat32(1.0f / 60.0f));
+		world.Sync();
+	}
+	const dFloat64 time = (ndGetTimeInMs() - start) / dFloat64(steps);
+	const dInt32 particleCount = fluid->GetPositions().GetCount();
+	printf("  %d particles, %d threads: %.2f ms per step  %.3f M particles per second\n",
+		particleCount, world.GetThreadCount(), time, dFloat64(particleCount) / (time * 1.0e3));
+}
+
+// exposes the grid update of the fluid to time it apart from the solver
+class ndGridBenchmarkFluid: public ndBodySphFluid
+{
+	public:
+	dFloat64 TimeGrids(const ndWorld* const world)
+	{
+		m_accel.SetCount(m_posit.GetCount());
+		const dFloat64 start = ndGetTimeInMs();
+		dVector boxP0;
+		dVector boxP1;
+		CaculateAABB(world, boxP0, boxP1);
+		UpdateGrids(world, boxP0, boxP1);
+		return ndGetTimeInMs() - start;
+	}
+
+	// moves one in every stride particles to the next cell
+	void MoveParticles(dInt32 stride)
+	{
+		const dVector step(CalculateGridSize(), dFloat32(0.0f), dFloat32(0.0f), dFloat32(0.0f));
+		for (dInt32 i = 0; i < m_posit.GetCount(); i += stride)
+		{
+			m_posit[i] += step;
+		}
+	}
+};
+
+// the cost of sorting the grid of a million particles from scratch, 
+// against repairing it when none or some of the particles changed cell
+static void GridCost(dInt32 count, dFloat32 spacing)
+{
+	ndWorld world;
+	ndGridBenchmarkFluid fluid;
+	fluid.SetParticleRadius(dFloat32(0.1f));
+	for (dInt32 i = 0; i < count * count * count; i++)
+	{
+		const dVector posit(dFloat32(i % count) * spacing, dFloat32((i / count) % count) * spacing, dFloat32(i / (count * count)) * spacing, dFloat32(1.0f));
+		fluid.AddParticle(dFloat32(0.1f), posit, dVector::m_zero);
+	}
+
+	const dFloat64 sortTime = fluid.TimeGrids(&world);
+	const dFloat64 restTime = fluid.TimeGrids(&world);
+	printf("  %d particles, %d threads: sorted %.2f ms  repaired at rest %.2f ms\n", 
+		fluid.GetPositions().GetCount(), world.GetThreadCount(), sortTime, restTime);
+
+	const dInt32 strides[] = { 101, 11, 3 };
+	for (dInt32 i = 0; i < dInt32(sizeof(strides) / sizeof(strides[0])); i++)
+	{
+		fluid.MoveParticles(strides[i]);
+		const dFloat64 time = fluid.TimeGrids(&world);
+		printf("  %d moved: %.2f ms\n", fluid.GetMovedParticlesCount(), time);
+	}
+}
+
+dInt32 ndSphFluidBenchmark()
+{
+	StepFluidCube(46, 10);
+	StepFluidCube(100, 3);
+	GridCost(100, dFloat32(0.1f));
+	return 0;
+}
@@ -0,0 +1,159 @@
+/* Copyright (c) <2003-2019> <Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely
+*/
+
+#include "testStdafx.h"
+#include "ndTestUtils.h"
+
+dInt32 ndTestReport(bool condition, const char* const expression, const char* const file, dInt32 line)
+{
+	if (!condition)
+	{
+		printf("  check failed: %s (%s:%d)\n", expression, file, line);
+	}
+	return condition ? 0 : 1;
+}
+
+static dUnsigned32 randSeed = 0;
+
+void dSetRandSeed(dUnsigned32 seed)
+{
+	randSeed = seed;
+}
+
+dFloat32 dRand()
+{
+	// numerical recipe in c
+	randSeed = 1664525u * randSeed + 1013904223u;
+	return dFloat32(randSeed & dRAND_MAX) * (dFloat32(1.0f) / dRAND_MAX);
+}
+
+dFloat64 ndGetTimeInMs()
+{
+	return dFloat64(dGetTimeInMicrosenconds()) * dFloat64(1.0e-3f);
+}
+
+void ndBuildBoxPile(ndWorld& world, dInt32 count, dInt32 layers)
+{
+	const dVector gravity(dFloat32(0.0f), dFloat32(-10.0f), dFloat32(0.0f), dFloat32(0.0f));
+
+	ndShapeInstance floor(new ndShapeBox(dFloat32(200.0f), dFloat32(1.0f), dFloat32(200.0f)));
+	ndBodyDynamic* const floorBody = new ndBodyDynamic();
+	dMatrix matrix(dGetIdentityMatrix());
+	matrix.m_posit.m_y = dFloat32(-0.5f);
+	floorBody->SetNotifyCallback(new ndBodyNotify(gravity));
+	floorBody->SetMatrix(matrix);
+	floorBody->SetCollisionShape(floor);
+	world.AddBody(floorBody);
+
+	// odd layers are shifted so the pile collapses and keeps bodies awake
+	ndShapeInstance box(new ndShapeBox(dFloat32(0.9f), dFloat32(0.5f), dFloat32(0.9f)));
+	for (dInt32 y = 0; y < layers; y++)
+	{
+		for (dInt32 z = 0; z < count; z++)
+		{
+			for (dInt32 x = 0; x < count; x++)
+			{
+				const dFloat32 px = dFloat32(x) - dFloat32(count) * dFloat32(0.5f) + dFloat32(0.1f * (y & 1));
+				const dFloat32 pz = dFloat32(z) - dFloat32(count) * dFloat32(0.5f);
+				matrix = dPitchMatrix(px * dFloat32(0.3f)) * dYawMatrix(pz * dFloat32(0.2f));
+				matrix.m_posit = dVector(px, dFloat32(0.5f) + dFloat32(y) * dFloat32(0.55f), pz, dFloat32(1.0f));
+
+				ndBodyDynamic* const body = new ndBodyDynamic();
+				body->SetNotifyCallback(new ndBodyNotify(gravity));
+				body->SetMatrix(matrix);
+				body->SetCollisionShape(box);
+				body->SetMassMatrix(dFloat32(1.0f), box);
+				world.AddBody(body);
+			}
+		}
+	}
+}
+
+dUnsigned64 ndHashBodies(const ndWorld& world)
+{
+	dUnsigned64 hash = 1469598103934665603ull;
+	const ndBodyList& bodyList = world.GetBodyList();
+	for (ndBodyList::dNode* node = bodyList.GetFirst(); node; node = node->GetNext())
+	{
+		const ndBodyKinematic* const body = node->GetInfo();
+		const dMatrix matrix(body->GetMatrix());
+		const dVector veloc(body->GetVelocity());
+		const dVector omega(body->GetOmega());
+
+		const dUnsigned8* ptr = (const dUnsigned8*)&matrix;
+		for (size_t i = 0; i < sizeof(matrix); i++)
+		{
+			hash = (hash ^ ptr[i]) * 1099511628211ull;
+		}
+		ptr = (const dUnsigned8*)&veloc;
+		for (size_t i = 0; i < 3 * sizeof(dFloat32); i++)
+		{
+			hash = (hash ^ ptr[i]) * 1099511628211ull;
+		}
+		ptr = (const dUnsigned8*)&omega;
+		for (size_t i = 0; i < 3 * sizeof(dFloat32); i++)
+		{
+			hash = (hash ^ ptr[i]) * 1099511628211ull;
+		}
+	}
+	return hash;
+}
+
+// linux only, the values come from /proc/self/status and the peak is reset through clear_refs
+static dUnsigned64 ndReadProcessStatus(const char* const key)
+{
+	dUnsigned64 value = 0;
+#ifdef __linux__
+	FILE* const file = fopen("/proc/self/status", "rb");
+	if (file)
+	{
+		char line[256];
+		const size_t keySize = strlen(key);
+		while (fgets(line, sizeof(line), file))
+		{
+			if (!strncmp(line, key, keySize))
+			{
+				value = dUnsigned64(strtoull(&line[keySize], nullptr, 10)) * 1024;
+				break;
+			}
+		}
+		fclose(file);
+	}
+#endif
+	return value;
+}
+
+dUnsigned64 ndGetPeakMemory()
+{
+	return ndReadProcessStatus("VmHWM:");
+}
+
+dUnsigned64 ndGetResidentMemory()
+{
+	return ndReadProcessStatus("VmRSS:");
+}
+
+dUnsigned64 ndGetPrivateMemory()
+{
+	return ndReadProcessStatus("RssAnon:");
+}
+
+void ndResetPeakMemory()
+{
+#ifdef __linux__
+	FILE* const file = fopen("/proc/self/clear_refs", "wb");
+	if (file)
+	{
+		fputs("5", file);
+		fclose(file);
+	}
+#endif
+}
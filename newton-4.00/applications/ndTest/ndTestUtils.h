@@ -0,0 +1,48 @@
+/* Copyright (c) <2003-2019> <Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely
+*/
+
+#ifndef _TEST_UTILS_H_
+#define _TEST_UTILS_H_
+
+#include "testStdafx.h"
+
+// a test returns the number of failed checks, a benchmark prints its timings
+typedef dInt32 (*ndTestFunction)();
+
+#define ndTestCheck(condition)	ndTestReport(condition, #condition, __FILE__, __LINE__)
+
+dInt32 ndTestReport(bool condition, const char* const expression, const char* const file, dInt32 line);
+
+#define dRAND_MAX		0x00ffffff
+
+// repeatable random numbers between 0.0 and 1.0
+void dSetRandSeed(dUnsigned32 seed);
+dFloat32 dRand();
+
+// wall time in milliseconds
+dFloat64 ndGetTimeInMs();
+
+// a static floor and a grid of count x count x layers boxes resting on it
+void ndBuildBoxPile(ndWorld& world, dInt32 count, dInt32 layers);
+
+// hash of the matrix and velocities of every body, in the order they were added
+dUnsigned64 ndHashBodies(const ndWorld& world);
+
+// the highest resident memory of the process in bytes since the last reset,
+// zero on systems where it can not be read
+dUnsigned64 ndGetPeakMemory();
+void ndResetPeakMemory();
+
+// the resident memory of the process in bytes, and the part of it that is not backed by files
+dUnsigned64 ndGetResidentMemory();
+dUnsigned64 ndGetPrivateMemory();
+
+#endif
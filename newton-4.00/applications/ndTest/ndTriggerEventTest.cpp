@@ -0,0 +1,167 @@
+/* Copyright (c) <2003-2019> <Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely
+*/
+
+#include "testStdafx.h"
+#include "ndTestUtils.h"
+
+// counts the bodies inside the volume
+class ndCountingTrigger: public ndBodyTriggerVolume
+{
+	public:
+	ndCountingTrigger()
+		:ndBodyTriggerVolume()
+		,m_inside(0)
+		,m_enter(0)
+		,m_exit(0)
+		,m_lastExit(nullptr)
+	{
+	}
+
+	virtual void OnTriggerEnter(ndBodyKinematic* const, dFloat32)
+	{
+		m_inside++;
+		m_enter++;
+	}
+
+	virtual void OnTriggerExit(ndBodyKinematic* const body, dFloat32)
+	{
+		m_inside--;
+		m_exit++;
+		m_lastExit = body;
+	}
+
+	dInt32 m_inside;
+	dInt32 m_enter;
+	dInt32 m_exit;
+	ndBodyKinematic* m_lastExit;
+};
+
+static ndCountingTrigger* AddTrigger(ndWorld& world)
+{
+	ndShapeInstance box(new ndShapeBox(dFloat32(4.0f), dFloat32(4.0f), dFloat32(4.0f)));
+	ndCountingTrigger* const trigger = new ndCountingTrigger();
+	trigger->SetMatrix(dGetIdentityMatrix());
+	trigger->SetCollisionShape(box);
+	world.AddBody(trigger);
+	return trigger;
+}
+
+// a sphere at rest in the middle of the volume, with no gravity
+static ndBodyDynamic* AddSphere(ndWorld& world, const dVector& posit)
+{
+	ndShapeInstance sphere(new ndShapeSphere(dFloat32(0.25f)));
+	ndBodyDynamic* const body = new ndBodyDynamic();
+	dMatrix matrix(dGetIdentityMatrix());
+	matrix.m_posit = posit;
+	body->SetNotifyCallback(new ndBodyNotify(dVector::m_zero));
+	body->SetMatrix(matrix);
+	body->SetCollisionShape(sphere);
+	body->SetMassMatrix(dFloat32(1.0f), sphere);
+	body->SetAutoSleep(false);
+	world.AddBody(body);
+	return body;
+}
+
+static void Step(ndWorld& world, dInt32 steps)
+{
+	for (dInt32 i = 0; i < steps; i++)
+	{
+		world.Update(dFloat32(1.0f / 60.0f));
+		world.Sync();
+	}
+}
+
+static bool EventsReference(const ndWorld& world, const ndBody* const body)
+{
+	const dArray<ndTriggerEvent>& events = world.GetScene()->GetTriggerEvents();
+	for (dInt32 i = 0; i < events.GetCount(); i++)
+	{
+		if ((events[i].m_body == body) || (events[i].m_trigger == body))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// removing a body inside a trigger sends its exit event and
+// takes the body out of the events of the last step
+static dInt32 CheckRemoveBody()
+{
+	dInt32 failed = 0;
+	ndWorld world;
+	ndCountingTrigger* const trigger = AddTrigger(world);
+	ndBodyDynamic* const body0 = AddSphere(world, dVector(dFloat32(-1.0f), dFloat32(0.0f), dFloat32(0.0f), dFloat32(1.0f)));
+	ndBodyDynamic* const body1 = AddSphere(world, dVector(dFloat32(1.0f), dFloat32(0.0f), dFloat32(0.0f), dFloat32(1.0f)));
+	Step(world, 4);
+	failed += ndTestCheck(trigger->m_enter == 2);
+	failed += ndTestCheck(trigger->m_inside == 2);
+	failed += ndTestCheck(EventsReference(world, body0));
+
+	world.RemoveBody(body0);
+	failed += ndTestCheck(trigger->m_exit == 1);
+	failed += ndTestCheck(trigger->m_lastExit == body0);
+	failed += ndTestCheck(!EventsReference(world, body0));
+	failed += ndTestCheck(EventsReference(world, body1));
+	delete body0;
+
+	Step(world, 4);
+	failed += ndTestCheck(trigger->m_inside == 1);
+	failed += ndTestCheck(trigger->m_exit == 1);
+	return failed;
+}
+
+// removing the trigger itself ends the overlap of every body inside it
+static dInt32 CheckRemoveTrigger()
+{
+	dInt32 failed = 0;
+	ndWorld world;
+	ndCountingTrigger* const trigger = AddTrigger(world);
+	AddSphere(world, dVector(dFloat32(-1.0f), dFloat32(0.0f), dFloat32(0.0f), dFloat32(1.0f)));
+	AddSphere(world, dVector(dFloat32(1.0f), dFloat32(0.0f), dFloat32(0.0f), dFloat32(1.0f)));
+	Step(world, 4);
+	failed += ndTestCheck(trigger->m_inside == 2);
+
+	world.RemoveBody(trigger);
+	failed += ndTestCheck(trigger->m_inside == 0);
+	failed += ndTestCheck(trigger->m_exit == 2);
+	failed += ndTestCheck(!EventsReference(world, trigger));
+	delete trigger;
+
+	Step(world, 4);
+	failed += ndTestCheck(world.GetScene()->GetTriggerEvents().GetCount() == 0);
+	return failed;
+}
+
+// a body moving through the volume enters and exits it once
+static dInt32 CheckPassThrough()
+{
+	dInt32 failed = 0;
+	ndWorld world;
+	ndCountingTrigger* const trigger = AddTrigger(world);
+	ndBodyDynamic* const body = AddSphere(world, dVector(dFloat32(-4.0f), dFloat32(0.0f), dFloat32(0.0f), dFloat32(1.0f)));
+	body->SetVelocity(dVector(dFloat32(4.0f), dFloat32(0.0f), dFloat32(0.0f), dFloat32(0.0f)));
+	Step(world, 150);
+	failed += ndTestCheck(body->GetMatrix().m_posit.m_x > dFloat32(3.0f));
+	failed += ndTestCheck(trigger->m_enter == 1);
+	failed += ndTestCheck(trigger->m_exit == 1);
+	failed += ndTestCheck(trigger->m_inside == 0);
+	return failed;
+}
+
+dInt32 ndTriggerEventTest()
+{
+	dInt32 failed = 0;
+	failed += CheckPassThrough();
+	failed += CheckRemoveBody();
+	failed += CheckRemoveTrigger();
+	return failed;
+}
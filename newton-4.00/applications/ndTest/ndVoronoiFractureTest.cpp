@@ -0,0 +1,155 @@
+/* Copyright (c) <2003-2019> <Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely
+*/
+
+#include "testStdafx.h"
+#include "ndTestUtils.h"
+
+static dInt32 CompareVolumes(const dFloat32* const volumeA, const dFloat32* const volumeB, void* const)
+{
+	return (*volumeA < *volumeB) ? -1 : ((*volumeA > *volumeB) ? 1 : 0);
+}
+
+static dFloat32 GetVolumes(const dArray<ndMeshEffect::ndFracturePiece>& pieces, dArray<dFloat32>& volumes)
+{
+	dFloat32 volume = dFloat32(0.0f);
+	volumes.SetCount(0);
+	for (dInt32 i = 0; i < pieces.GetCount(); i++)
+	{
+		volumes.PushBack(pieces[i].m_collision->GetVolume());
+		volume += volumes[i];
+	}
+	return volume;
+}
+
+static void DeletePieces(dArray<ndMeshEffect::ndFracturePiece>& pieces)
+{
+	for (dInt32 i = 0; i < pieces.GetCount(); i++)
+	{
+		delete pieces[i].m_mesh;
+		delete pieces[i].m_collision;
+	}
+	pieces.SetCount(0);
+}
+
+// the voronoi cells of the decomposition clipped against the mesh one at the time, like the sandbox does
+static void ClipDecomposition(ndMeshEffect& mesh, const dArray<dVector>& pointCloud, const dMatrix& textureMatrix, dArray<ndMeshEffect::ndFracturePiece>& pieces)
+{
+	ndMeshEffect* const decomposition = mesh.CreateVoronoiConvexDecomposition(pointCloud, 1, textureMatrix);
+	ndMeshEffect* nextCell;
+	for (ndMeshEffect* cell = decomposition->GetFirstLayer(); cell; cell = nextCell)
+	{
+		nextCell = decomposition->GetNextLayer(cell);
+		ndMeshEffect* const fracturePiece = mesh.ConvexMeshIntersection(cell);
+		if (fracturePiece)
+		{
+			ndShapeInstance* const collision = fracturePiece->CreateConvexCollision(dFloat32(0.0f));
+			if (collision)
+			{
+				ndMeshEffect::ndFracturePiece piece;
+				piece.m_mesh = fracturePiece;
+				piece.m_collision = collision;
+				pieces.PushBack(piece);
+			}
+			else
+			{
+				delete fracturePiece;
+			}
+		}
+		delete cell;
+	}
+	delete decomposition;
+}
+
+// the fracture made in the calling thread, on a pool of four threads and by clipping the
+// cells of the convex decomposition have the same pieces, and the pieces fill the box
+static dInt32 CheckFracture(dInt32 pointsCount)
+{
+	dInt32 failed = 0;
+	ndShapeInstance box(new ndShapeBox(dFloat32(2.0f), dFloat32(1.0f), dFloat32(1.5f)));
+	ndMeshEffect mesh(box);
+	mesh.GetMaterials().PushBack(ndMeshEffect::dMaterial());
+	const dFloat32 boxVolume = dFloat32(mesh.CalculateVolume());
+
+	dMatrix textureMatrix(dGetIdentityMatrix());
+	textureMatrix[0][0] = dFloat32(0.5f);
+	textureMatrix.m_posit.m_x = dFloat32(-0.5f);
+	mesh.UniformBoxMapping(0, textureMatrix);
+
+	dArray<dVector> pointCloud;
+	for (dInt32 i = 0; i < pointsCount; i++)
+	{
+		pointCloud.PushBack(dVector(dRand() * dFloat32(1.8f) - dFloat32(0.9f), dRand() * dFloat32(0.8f) - dFloat32(0.4f), dRand() * dFloat32(1.3f) - dFloat32(0.65f), dFloat32(0.0f)));
+	}
+
+	dArray<ndMeshEffect::ndFracturePiece> serialPieces;
+	mesh.CreateVoronoiFracture(nullptr, pointCloud, 1, textureMatrix, serialPieces);
+
+	ndWorld world;
+	world.SetThreadCount(4);
+	dArray<ndMeshEffect::ndFracturePiece> poolPieces;
+	mesh.CreateVoronoiFracture(world.GetScene(), pointCloud, 1, textureMatrix, poolPieces);
+
+	dArray<ndMeshEffect::ndFracturePiece> decompositionPieces;
+	ClipDecomposition(mesh, pointCloud, textureMatrix, decompositionPieces);
+
+	dArray<dFloat32> serialVolumes;
+	dArray<dFloat32> poolVolumes;
+	dArray<dFloat32> decompositionVolumes;
+	const dFloat32 serialVolume = GetVolumes(serialPieces, serialVolumes);
+	const dFloat32 poolVolume = GetVolumes(poolPieces, poolVolumes);
+	const dFloat32 decompositionVolume = GetVolumes(decompositionPieces, decompositionVolumes);
+
+	// the corners of the bounding box are cells too, points closer than the weld tolerance share a cell
+	failed += ndTestCheck(serialPieces.GetCount() > pointsCount / 2);
+	failed += ndTestCheck(serialPieces.GetCount() <= pointsCount + 8);
+	failed += ndTestCheck(poolPieces.GetCount() == serialPieces.GetCount());
+	failed += ndTestCheck(decompositionPieces.GetCount() == serialPieces.GetCount());
+	failed += ndTestCheck(dAbs(serialVolume - boxVolume) < boxVolume * dFloat32(1.0e-3f));
+	failed += ndTestCheck(poolVolume == serialVolume);
+	failed += ndTestCheck(dAbs(decompositionVolume - serialVolume) < boxVolume * dFloat32(1.0e-3f));
+
+	// the pool makes the same pieces in the same order
+	if (poolPieces.GetCount() == serialPieces.GetCount())
+	{
+		for (dInt32 i = 0; i < serialPieces.GetCount(); i++)
+		{
+			failed += ndTestCheck(poolVolumes[i] == serialVolumes[i]);
+			failed += ndTestCheck(poolPieces[i].m_mesh->GetVertexCount() == serialPieces[i].m_mesh->GetVertexCount());
+		}
+	}
+
+	// the decomposition visits the cells in its own order
+	if (decompositionPieces.GetCount() == serialPieces.GetCount())
+	{
+		dSort(&serialVolumes[0], serialVolumes.GetCount(), CompareVolumes);
+		dSort(&decompositionVolumes[0], decompositionVolumes.GetCount(), CompareVolumes);
+		dFloat32 maxError = dFloat32(0.0f);
+		for (dInt32 i = 0; i < serialVolumes.GetCount(); i++)
+		{
+			maxError = dMax(maxError, dAbs(decompositionVolumes[i] - serialVolumes[i]));
+		}
+		failed += ndTestCheck(maxError < boxVolume * dFloat32(1.0e-4f));
+	}
+
+	DeletePieces(serialPieces);
+	DeletePieces(poolPieces);
+	DeletePieces(decompositionPieces);
+	return failed;
+}
+
+dInt32 ndVoronoiFractureTest()
+{
+	dInt32 failed = 0;
+	dSetRandSeed(39);
+	failed += CheckFracture(8);
+	failed += CheckFracture(64);
+	return failed;
+}
@@ -0,0 +1,105 @@
+/* Copyright (c) <2003-2019> <Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely
+*/
+
+#include "testStdafx.h"
+#include "ndTestUtils.h"
+
+static void StepWorld(ndWorld& world, dInt32 steps)
+{
+	for (dInt32 i = 0; i < steps; i++)
+	{
+		world.Update(dFloat32(1.0f / 60.0f));
+		world.Sync();
+	}
+}
+
+// restoring a full or a delta checkpoint and stepping again replays the same frames
+dInt32 ndWorldCheckpointTest()
+{
+	dInt32 failed = 0;
+	ndWorld world;
+	world.SetDeterministic(true);
+	ndBuildBoxPile(world, 6, 3);
+	StepWorld(world, 30);
+
+	ndWorldCheckpoint base;
+	base.Save(&world);
+	const dUnsigned64 baseHash = ndHashBodies(world);
+
+	StepWorld(world, 10);
+	ndWorldCheckpoint delta;
+	delta.Save(&world, &base);
+	const dUnsigned64 deltaHash = ndHashBodies(world);
+	failed += ndTestCheck(delta.GetBodyCount() <= base.GetBodyCount());
+
+	StepWorld(world, 20);
+	const dUnsigned64 endHash = ndHashBodies(world);
+
+	delta.Restore(&world);
+	failed += ndTestCheck(ndHashBodies(world) == deltaHash);
+	StepWorld(world, 20);
+	failed += ndTestCheck(ndHashBodies(world) == endHash);
+
+	base.Restore(&world);
+	failed += ndTestCheck(ndHashBodies(world) == baseHash);
+	StepWorld(world, 10);
+	failed += ndTestCheck(ndHashBodies(world) == deltaHash);
+
+	// the delta again, now from a world that is behind it
+	base.Restore(&world);
+	delta.Restore(&world);
+	failed += ndTestCheck(ndHashBodies(world) == deltaHash);
+	StepWorld(world, 20);
+	failed += ndTestCheck(ndHashBodies(world) == endHash);
+	return failed;
+}
+
+// save and restore cost on a box pile of about 10k bodies
+static void CheckpointPile(dInt32 count, dInt32 layers, dInt32 settleSteps)
+{
+	ndWorld world;
+	ndBuildBoxPile(world, count, layers);
+	StepWorld(world, settleSteps);
+
+	ndWorldCheckpoint base;
+	ndWorldCheckpoint delta;
+	dFloat64 start = ndGetTimeInMs();
+	base.Save(&world);
+	const dFloat64 saveTime = ndGetTimeInMs() - start;
+
+	StepWorld(world, 5);
+	start = ndGetTimeInMs();
+	delta.Save(&world, &base);
+	const dFloat64 deltaSaveTime = ndGetTimeInMs() - start;
+
+	StepWorld(world, 5);
+	start = ndGetTimeInMs();
+	delta.Restore(&world);
+	const dFloat64 deltaRestoreTime = ndGetTimeInMs() - start;
+
+	StepWorld(world, 5);
+	start = ndGetTimeInMs();
+	base.Restore(&world);
+	const dFloat64 restoreTime = ndGetTimeInMs() - start;
+
+	printf("  after %d steps, %d bodies, %d contacts, %.1f MB: save %.3f ms  restore %.3f ms\n",
+		settleSteps, world.GetBodyList().GetCount(), base.GetContactCount(), dFloat64(base.GetSize()) / (1024.0 * 1024.0), saveTime, restoreTime);
+	printf("  delta of %d bodies, %.1f MB: save %.3f ms  restore %.3f ms\n",
+		delta.GetBodyCount(), dFloat64(delta.GetSize()) / (1024.0 * 1024.0), deltaSaveTime, deltaRestoreTime);
+}
+
+// a collapsing pile where every body moves, and a single layer at rest
+dInt32 ndWorldCheckpointBenchmark()
+{
+	CheckpointPile(71, 2, 10);
+	CheckpointPile(100, 1, 60);
+	return 0;
+}
@@ -0,0 +1,252 @@
+/* Copyright (c) <2003-2019> <Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely
+*/
+
+#include "testStdafx.h"
+#include "ndTestUtils.h"
+
+static ndBodyDynamic* AddLink(ndWorld& world, const dVector& posit)
+{
+	ndShapeInstance box(new ndShapeBox(dFloat32(0.2f), dFloat32(1.0f), dFloat32(0.2f)));
+	dMatrix matrix(dGetIdentityMatrix());
+	matrix.m_posit = posit;
+
+	ndBodyDynamic* const body = new ndBodyDynamic();
+	body->SetNotifyCallback(new ndBodyNotify(dVector(dFloat32(0.0f), dFloat32(-10.0f), dFloat32(0.0f), dFloat32(0.0f))));
+	body->SetMatrix(matrix);
+	body->SetCollisionShape(box);
+	body->SetMassMatrix(dFloat32(1.0f), box);
+	world.AddBody(body);
+	return body;
+}
+
+// a box pile and a chain of links hanging from the world, one joint of each saved type
+static void BuildScene(ndWorld& world)
+{
+	ndBuildBoxPile(world, 3, 2);
+
+	ndBodyDynamic* const link0 = AddLink(world, dVector(dFloat32(10.0f), dFloat32(5.0f), dFloat32(0.0f), dFloat32(1.0f)));
+	ndBodyDynamic* const link1 = AddLink(world, dVector(dFloat32(10.0f), dFloat32(4.0f), dFloat32(0.0f), dFloat32(1.0f)));
+	ndBodyDynamic* const link2 = AddLink(world, dVector(dFloat32(10.0f), dFloat32(3.0f), dFloat32(0.0f), dFloat32(1.0f)));
+	ndBodyDynamic* const link3 = AddLink(world, dVector(dFloat32(10.0f), dFloat32(2.0f), dFloat32(0.0f), dFloat32(1.0f)));
+
+	dMatrix frame(dGetIdentityMatrix());
+	frame.m_posit = dVector(dFloat32(10.0f), dFloat32(5.5f), dFloat32(0.0f), dFloat32(1.0f));
+	ndJointBallAndSocket* const ball = new ndJointBallAndSocket(frame, link0, world.GetSentinelBody());
+	ball->SetConeLimit(dFloat32(0.5f));
+	world.AddJoint(ball);
+
+	frame.m_posit.m_y = dFloat32(4.5f);
+	ndJointHinge* const hinge = new ndJointHinge(frame, link1, link0);
+	hinge->EnableLimits(true, dFloat32(-0.75f), dFloat32(0.5f));
+	hinge->SetCollidable(true);
+	world.AddJoint(hinge);
+
+	frame.m_posit.m_y = dFloat32(3.5f);
+	ndJointSlider* const slider = new ndJointSlider(frame, link2, link1);
+	slider->SetAsSpringDamper(true, dFloat32(0.1f), dFloat32(100.0f), dFloat32(5.0f));
+	world.AddJoint(slider);
+
+	frame.m_posit.m_y = dFloat32(2.5f);
+	ndJointFix6dof* const fix = new ndJointFix6dof(frame, link3, link2);
+	fix->SetSolverModel(m_jointkinematicCloseLoop);
+	world.AddJoint(fix);
+
+	for (dInt32 i = 0; i < 10; i++)
+	{
+		world.Update(dFloat32(1.0f / 60.0f));
+		world.Sync();
+	}
+}
+
+static bool SameJoints(const ndWorld& world0, const ndWorld& world1)
+{
+	const ndJointList& list0 = world0.GetJointList();
+	const ndJointList& list1 = world1.GetJointList();
+	if (list0.GetCount() != list1.GetCount())
+	{
+		return false;
+	}
+	for (ndJointList::dNode* node0 = list0.GetFirst(), *node1 = list1.GetFirst(); node0; node0 = node0->GetNext(), node1 = node1->GetNext())
+	{
+		const ndJointBilateralConstraint* const joint0 = node0->GetInfo();
+		const ndJointBilateralConstraint* const joint1 = node1->GetInfo();
+		if (strcmp(joint0->ClassName(), joint1->ClassName()) || (joint0->GetSolverModel() != joint1->GetSolverModel()) || (joint0->IsCollidable() != joint1->IsCollidable()))
+		{
+			return false;
+		}
+		if (memcmp(&joint0->GetLocalMatrix0(), &joint1->GetLocalMatrix0(), sizeof(dMatrix)) || memcmp(&joint0->GetLocalMatrix1(), &joint1->GetLocalMatrix1(), sizeof(dMatrix)))
+		{
+			return false;
+		}
+		const bool world0Sentinel = joint0->GetBody1() == world0.GetSentinelBody();
+		const bool world1Sentinel = joint1->GetBody1() == world1.GetSentinelBody();
+		if (world0Sentinel != world1Sentinel)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// a snapshot loads back to the same bodies and joints, and an image that fails
+// to load leaves the world with the bodies and joints it already had
+dInt32 ndWorldSnapshotTest()
+{
+	dInt32 failed = 0;
+	ndWorld world;
+	BuildScene(world);
+
+	for (dInt32 compress = 0; compress < 2; compress++)
+	{
+		dArray<dUnsigned8> image;
+		ndWorldSnapshot::Save(&world, image, compress ? true : false);
+
+		ndWorld loaded;
+		failed += ndTestCheck(ndWorldSnapshot::Load(&loaded, &image[0], image.GetCount()));
+		failed += ndTestCheck(loaded.GetBodyList().GetCount() == world.GetBodyList().GetCount());
+		failed += ndTestCheck(ndHashBodies(loaded) == ndHashBodies(world));
+		failed += ndTestCheck(SameJoints(world, loaded));
+
+		for (dInt32 i = 0; i < 60; i++)
+		{
+			loaded.Update(dFloat32(1.0f / 60.0f));
+			loaded.Sync();
+		}
+	}
+
+	dArray<dUnsigned8> image;
+	ndWorldSnapshot::Save(&world, image, false);
+	ndWorldSnapshot::ndHeader header;
+	memcpy(&header, &image[0], sizeof(header));
+	failed += ndTestCheck(header.m_sections[ndWorldSnapshot::m_joints].m_count == 4);
+
+	ndWorld target;
+	ndBuildBoxPile(target, 2, 1);
+	const dInt32 bodyCount = target.GetBodyList().GetCount();
+
+	// a joint pointing past the bodies is found after every body record was read
+	dArray<dUnsigned8> corrupted;
+	corrupted.SetCount(image.GetCount());
+	memcpy(&corrupted[0], &image[0], image.GetCount());
+	ndWorldSnapshot::ndJointRecord joint;
+	dUnsigned8* const lastJoint = &corrupted[0] + header.m_sections[ndWorldSnapshot::m_joints].m_offset + sizeof(joint) * 3;
+	memcpy((void*)&joint, lastJoint, sizeof(joint));
+	joint.m_body1 = 1000;
+	memcpy(lastJoint, (void*)&joint, sizeof(joint));
+	failed += ndTestCheck(!ndWorldSnapshot::Load(&target, &corrupted[0], corrupted.GetCount()));
+	failed += ndTestCheck(target.GetBodyList().GetCount() == bodyCount);
+	failed += ndTestCheck(target.GetJointList().GetCount() == 0);
+
+	// a shape data offset that wraps around the shape blob
+	memcpy(&corrupted[0], &image[0], image.GetCount());
+	ndWorldSnapshot::ndShapeRecord shape;
+	dUnsigned8* const firstShape = &corrupted[0] + header.m_sections[ndWorldSnapshot::m_shapes].m_offset;
+	memcpy(&shape, firstShape, sizeof(shape));
+	shape.m_dataOffset = 0x7fffffffffffff00ll;
+	shape.m_dataSize = 0x200;
+	memcpy(firstShape, &shape, sizeof(shape));
+	failed += ndTestCheck(!ndWorldSnapshot::Load(&target, &corrupted[0], corrupted.GetCount()));
+	failed += ndTestCheck(target.GetBodyList().GetCount() == bodyCount);
+
+	// random bytes anywhere in the image
+	dSetRandSeed(7);
+	for (dInt32 i = 0; i < 200; i++)
+	{
+		memcpy(&corrupted[0], &image[0], image.GetCount());
+		for (dInt32 j = 0; j < 4; j++)
+		{
+			const dInt32 index = dInt32(dRand() * dFloat32(corrupted.GetCount() - 1));
+			corrupted[index] = dUnsigned8(dRand() * 255.0f);
+		}
+		ndWorld fuzzed;
+		if (!ndWorldSnapshot::Load(&fuzzed, &corrupted[0], corrupted.GetCount()))
+		{
+			failed += ndTestCheck(fuzzed.GetBodyList().GetCount() == 0);
+			failed += ndTestCheck(fuzzed.GetJointList().GetCount() == 0);
+		}
+	}
+
+	failed += ndTestCheck(!ndWorldSnapshot::Load(&target, &image[0], image.GetCount() / 2));
+	failed += ndTestCheck(target.GetBodyList().GetCount() == bodyCount);
+
+	// a file that can not be written is reported
+	const char* const path = "ndWorldSnapshotTest.bin";
+	failed += ndTestCheck(!world.SaveSnapshot("ndWorldSnapshotTest/missing/world.bin"));
+	failed += ndTestCheck(world.SaveSnapshot(path));
+	ndWorld fromFile;
+	failed += ndTestCheck(fromFile.LoadSnapshot(path));
+	failed += ndTestCheck(ndHashBodies(fromFile) == ndHashBodies(world));
+	remove(path);
+	return failed;
+}
+
+static dInt64 FileSize(const char* const path)
+{
+	dInt64 size = 0;
+	FILE* const file = fopen(path, "rb");
+	if (file)
+	{
+		fseek(file, 0, SEEK_END);
+		size = dInt64(ftell(file));
+		fclose(file);
+	}
+	return size;
+}
+
+// the peak memory is the growth of the process peak over the resident memory 
+// before the call. memory freed by an earlier call may be reused, so the xml path 
+// runs last and the snapshot numbers are not lowered by it.
+static void TimeSave(const ndWorld& world, const char* const name, const char* const path, bool xml, bool compress)
+{
+	ndResetPeakMemory();
+	const dUnsigned64 base = ndGetPeakMemory();
+	dFloat64 start = ndGetTimeInMs();
+	xml ? world.Save(path) : (void)world.SaveSnapshot(path, compress);
+	const dFloat64 saveTime = ndGetTimeInMs() - start;
+	const dUnsigned64 savePeak = ndGetPeakMemory() - base;
+
+	dFloat64 loadTime;
+	dUnsigned64 loadPeak;
+	dInt32 bodyCount;
+	{
+		ndWorld loaded;
+		ndResetPeakMemory();
+		const dUnsigned64 loadBase = ndGetPeakMemory();
+		start = ndGetTimeInMs();
+		xml ? loaded.Load(path) : (void)loaded.LoadSnapshot(path);
+		loadTime = ndGetTimeInMs() - start;
+		loadPeak = ndGetPeakMemory() - loadBase;
+		bodyCount = loaded.GetBodyList().GetCount();
+	}
+
+	printf("  %s: %d bodies, %.1f kb file: save %.2f ms %.1f mb peak  load %.2f ms %.1f mb peak\n", name, bodyCount,
+		dFloat64(FileSize(path)) / 1024.0, saveTime, dFloat64(savePeak) / (1024.0 * 1024.0), loadTime, dFloat64(loadPeak) / (1024.0 * 1024.0));
+}
+
+dInt32 ndWorldSnapshotBenchmark()
+{
+	ndWorld world;
+	ndBuildBoxPile(world, 40, 5);
+	for (dInt32 i = 0; i < 10; i++)
+	{
+		world.Update(dFloat32(1.0f / 60.0f));
+		world.Sync();
+	}
+
+	TimeSave(world, "snapshot", "ndWorldSnapshotBenchmark.bin", false, false);
+	TimeSave(world, "compressed snapshot", "ndWorldSnapshotBenchmark.bin", false, true);
+	TimeSave(world, "xml", "ndWorldSnapshotBenchmark.xml", true, false);
+	remove("ndWorldSnapshotBenchmark.bin");
+	remove("ndWorldSnapshotBenchmark.xml");
+	// the xml path saves its assets in a folder named after the file
+	remove("ndWorldSnapshotBenchmark");
+	return 0;
+}
@@ -162,6 +162,12 @@ ndBodyKinematic::~ndBodyKinematic()
 void ndBodyKinematic::SetSleepState(bool state)
 {
 	m_equilibrium = state ? 1 : 0;
+	if (!state)
+	{
+		// the island state is taken when the step begins, a body woken 
+		// after that by forces added before the solver must move this step.
+		m_islandSleep = 0;
+	}
 	if ((m_invMass.m_w > dFloat32(0.0f)) && (m_veloc.DotProduct(m_veloc).GetScalar() < dFloat32(1.0e-10f)) && (m_omega.DotProduct(m_omega).GetScalar() < dFloat32(1.0e-10f))) 
 	{
 		dVector invalidateVeloc(dFloat32(10.0f));
@@ -208,6 +208,7 @@ class ndBodyKinematic: public ndBody
 	friend class ndDynamicsUpdateAvx2;
 	friend class ndDynamicsUpdateOpencl;
 	friend class ndJointBilateralConstraint;
+	friend class ndWorldCheckpoint;
 } D_GCC_NEWTON_ALIGN_32;
 
 inline dUnsigned32 ndBodyKinematic::GetIndex() const
@@ -40,6 +40,29 @@ ndBodyTriggerVolume::~ndBodyTriggerVolume()
 {
 }
 
+void ndBodyTriggerVolume::OnTriggerEvents(const ndTriggerEvent* const events, dInt32 count, dFloat32 timestep)
+{
+	for (dInt32 i = 0; i < count; i++)
+	{
+		const ndTriggerEvent& event = events[i];
+		dAssert(event.m_trigger == this);
+		switch (event.m_type)
+		{
+			case ndTriggerEvent::m_enter:
+				OnTriggerEnter(event.m_body, timestep);
+				break;
+
+			case ndTriggerEvent::m_stay:
+				OnTrigger(event.m_body, timestep);
+				break;
+
+			case ndTriggerEvent::m_exit:
+				OnTriggerExit(event.m_body, timestep);
+				break;
+		}
+	}
+}
+
 void ndBodyTriggerVolume::Save(nd::TiXmlElement* const rootNode, const char* const assetPath, dInt32 nodeid, const dTree<dUnsigned32, const ndShape*>& shapesCache) const
 {
 	nd::TiXmlElement* const paramNode = CreateRootElement(rootNode, "ndBodyTriggerVolume", nodeid);
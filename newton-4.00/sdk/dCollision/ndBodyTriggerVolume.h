@@ -25,6 +25,23 @@
 #include "ndCollisionStdafx.h"
 #include "ndBodyKinematic.h"
 
+class ndBodyTriggerVolume;
+
+class ndTriggerEvent
+{
+	public:
+	enum ndEventType
+	{
+		m_enter,
+		m_stay,
+		m_exit,
+	};
+
+	ndBodyTriggerVolume* m_trigger;
+	ndBodyKinematic* m_body;
+	ndEventType m_type;
+};
+
 D_MSV_NEWTON_ALIGN_32
 class ndBodyTriggerVolume : public ndBodyKinematic
 {
@@ -39,6 +56,10 @@ class ndBodyTriggerVolume : public ndBodyKinematic
 	virtual void OnTriggerEnter(ndBodyKinematic* const body, dFloat32 timestep);
 	virtual void OnTriggerExit(ndBodyKinematic* const body, dFloat32 timestep);
 
+	// called once per step with all the events of this trigger sorted by body id,
+	// the default implementation forwards each event to the functions above.
+	D_COLLISION_API virtual void OnTriggerEvents(const ndTriggerEvent* const events, dInt32 count, dFloat32 timestep);
+
 	D_COLLISION_API virtual void Save(nd::TiXmlElement* const rootNode, const char* const assetPath, dInt32 nodeid, const dTree<dUnsigned32, const ndShape*>& shapesCache) const;
 
 	private:
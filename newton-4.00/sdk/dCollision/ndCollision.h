@@ -57,8 +57,10 @@
 #include <ndContactOptions.h>
 #include <ndShapeStatic_bvh.h>
 #include <ndShapeConvexHull.h>
+#include <ndShapeConvexHullCache.h>
 #include <ndShapeStaticMesh.h>
 #include <ndShapeHeightfield.h>
+#include <ndShapeHeightfieldTiled.h>
 #include <ndConvexCastNotify.h>
 #include <ndBodyPlayerCapsule.h>
 #include <ndBodyTriggerVolume.h>
@@ -40,6 +40,7 @@ ndContact::ndContact()
 	,m_positAcc(dFloat32(10.0f))
 	,m_rotationAcc()
 	,m_separatingVector(m_initialSeparatingVector)
+	,m_manifoldRotation()
 	,m_contacPointsList()
 	,m_body0(nullptr)
 	,m_body1(nullptr)
@@ -79,6 +80,27 @@ void ndContact::SetBodies(ndBodyKinematic* const body0, ndBodyKinematic* const b
 	dAssert(m_body0->GetInvMass() > dFloat32(0.0f));
 }
 
+// clears the cached separation and manifold of a contact that is reused for another pair
+void ndContact::ResetState()
+{
+	m_positAcc = dVector(dFloat32(10.0f));
+	m_rotationAcc = dQuaternion();
+	m_separatingVector = m_initialSeparatingVector;
+	m_manifoldRotation = dQuaternion();
+	m_contacPointsList.SetCount(0);
+	m_material = ndMaterial();
+	m_timeOfImpact = dFloat32(1.0e10f);
+	m_separationDistance = dFloat32(0.0f);
+	m_contactPruningTolereance = D_PRUNE_CONTACT_TOLERANCE;
+	m_maxDOF = 0;
+	m_sceneLru = 0;
+	m_isDead = 0;
+	m_isIntersetionTestOnly = 0;
+	m_skeletonIntraCollision = 1;
+	m_skeletonSelftCollision = 1;
+	m_active = false;
+}
+
 void ndContact::AttachToBodies()
 {
 	m_isAttached = true;
@@ -98,13 +120,12 @@ void ndContact::JacobianDerivative(ndConstraintDescritor& desc)
 	dInt32 frictionIndex = 0;
 	if (m_maxDOF) 
 	{
-		dInt32 i = 0;
-		frictionIndex = m_contacPointsList.GetCount();
-		for (ndContactPointList::dNode* node = m_contacPointsList.GetFirst(); node; node = node->GetNext())
+		const dInt32 count = m_contacPointsList.GetCount();
+		frictionIndex = count;
+		for (dInt32 i = 0; i < count; i++)
 		{
-			const ndContactMaterial& contact = node->GetInfo();
+			const ndContactMaterial& contact = m_contacPointsList[i];
 			JacobianContactDerivative(desc, contact, i, frictionIndex);
-			i++;
 		}
 	}
 	desc.m_rowsCount = frictionIndex;
@@ -32,6 +32,7 @@ class ndShapeInstance;
 
 #define D_MAX_CONTATCS					128
 #define D_CONSTRAINT_MAX_ROWS			(3 * 16)
+#define D_MAX_CONTACT_POINTS			(D_CONSTRAINT_MAX_ROWS / 3)
 #define D_RESTING_CONTACT_PENETRATION	(D_PENETRATION_TOL + dFloat32 (1.0f / 1024.0f))
 #define D_DIAGONAL_PRECONDITIONER		dFloat32 (25.0f)
 
@@ -57,6 +58,9 @@ class ndContactMaterial: public ndContactPoint
 	ndContactMaterial()
 		:m_dir0(dVector::m_zero)
 		,m_dir1(dVector::m_zero)
+		,m_localPoint0(dVector::m_wOne)
+		,m_localPoint1(dVector::m_wOne)
+		,m_localNormal(dVector::m_zero)
 		,m_material()
 	{
 		m_dir0_Force.Clear();
@@ -65,19 +69,26 @@ class ndContactMaterial: public ndContactPoint
 	}
 	dVector m_dir0;
 	dVector m_dir1;
+	dVector m_localPoint0;
+	dVector m_localPoint1;
+	dVector m_localNormal;
 	ndForceImpactPair m_normal_Force;
 	ndForceImpactPair m_dir0_Force;
 	ndForceImpactPair m_dir1_Force;
 	ndMaterial m_material;
 } D_GCC_NEWTON_ALIGN_32;
 
-class ndContactPointList : public dList<ndContactMaterial, dContainersFreeListAlloc<ndContactMaterial>>
+// contact points live inline in the contact, 
+// a manifold never has more points than the solver has rows for them
+class ndContactPointList: public dFixSizeArray<ndContactMaterial, D_MAX_CONTACT_POINTS>
 {
 	public:
 	ndContactPointList()
-		:dList<ndContactMaterial, dContainersFreeListAlloc<ndContactMaterial>>()
+		:dFixSizeArray<ndContactMaterial, D_MAX_CONTACT_POINTS>()
 	{
 	}
+
+	void Remove(dInt32 index);
 };
 
 D_MSV_NEWTON_ALIGN_32 
@@ -110,12 +121,14 @@ class ndContact: public ndConstraint, public dContainersFreeListAlloc<ndContact*
 	
 	private:
 	void SetBodies(ndBodyKinematic* const body0, ndBodyKinematic* const body1);
+	void ResetState();
 	void CalculatePointDerivative(dInt32 index, ndConstraintDescritor& desc, const dVector& dir, const dgPointParam& param) const;
 	void JacobianContactDerivative(ndConstraintDescritor& desc, const ndContactMaterial& contact, dInt32 normalIndex, dInt32& frictionIndex);
 
 	dVector m_positAcc;
 	dQuaternion m_rotationAcc;
 	dVector m_separatingVector;
+	dQuaternion m_manifoldRotation;
 	ndContactPointList m_contacPointsList;
 	ndBodyKinematic* m_body0;
 	ndBodyKinematic* m_body1;
@@ -141,6 +154,7 @@ class ndContact: public ndConstraint, public dContainersFreeListAlloc<ndContact*
 	friend class ndConvexCastNotify;
 	friend class ndShapeConvexPolygon;
 	friend class ndBodyPlayerCapsuleContactSolver;
+	friend class ndWorldCheckpoint;
 } D_GCC_NEWTON_ALIGN_32 ;
 
 inline const ndMaterial& ndContact::GetMaterial() const
@@ -168,6 +182,18 @@ inline ndBodyKinematic* ndContact::GetBody1() const
 	return m_body1;
 }
 
+inline void ndContactPointList::Remove(dInt32 index)
+{
+	// order of the points is not relevant, fill the hole with the last point
+	dAssert(index >= 0);
+	dAssert(index < m_count);
+	m_count--;
+	if (index != m_count)
+	{
+		m_array[index] = m_array[m_count];
+	}
+}
+
 inline ndContactPointList& ndContact::GetContactPoints()
 {
 	return m_contacPointsList;
@@ -230,7 +230,7 @@ class ndContactSolver::ndBoxBoxDistance2
 class ndStackBvhStackEntry
 {
 	public:
-	const ndShapeCompound::ndNodeBase* m_compoundNode;
+	const ndShapeCompound::ndFlatNode* m_compoundNode;
 	const dAabbPolygonSoup::dNode* m_collisionTreeNode;
 	dFloat32 m_dist2;
 	dInt32 m_treeNodeIsLeaf;
@@ -240,7 +240,8 @@ D_INLINE static void PushStackEntry(
 	ndContactSolver::ndBoxBoxDistance2& data,
 	dInt32& stack,
 	ndStackBvhStackEntry* const stackPool,
-	const ndShapeCompound::ndNodeBase* const compoundNode,
+	const ndShapeCompound* const compoundShape,
+	const ndShapeCompound::ndFlatNode* const compoundNode,
 	ndShapeStatic_bvh* const bvhTreeCollision,
 	dInt32 treeNodeType,
 	const dAabbPolygonSoup::dNode* const treeNode)
@@ -251,8 +252,12 @@ D_INLINE static void PushStackEntry(
 	const dVector bvhSize((bvhp1 - bvhp0) * dVector::m_half);
 	const dVector bvhOrigin((bvhp1 + bvhp0) * dVector::m_half);
 
+	dVector compoundSize;
+	dVector compoundOrigin;
+	compoundShape->GetFlatObb(compoundNode, compoundOrigin, compoundSize);
+
 	dInt32 j = stack;
-	dFloat32 dist2 = data.CalculateDistance2(compoundNode->m_origin, compoundNode->m_size, bvhOrigin, bvhSize);
+	dFloat32 dist2 = data.CalculateDistance2(compoundOrigin, compoundSize, bvhOrigin, bvhSize);
 	for (; j && (dist2 > stackPool[j - 1].m_dist2); j--)
 	{
 		stackPool[j] = stackPool[j - 1];
@@ -268,8 +273,8 @@ D_INLINE static void PushStackEntry(
 class ndStackEntry
 {
 	public:
-	const ndShapeCompound::ndNodeBase* m_node0;
-	const ndShapeCompound::ndNodeBase* m_node1;
+	const ndShapeCompound::ndFlatNode* m_node0;
+	const ndShapeCompound::ndFlatNode* m_node1;
 	dFloat32 m_dist2;
 };
 
@@ -277,13 +282,31 @@ D_INLINE static void PushStackEntry(
 	ndContactSolver::ndBoxBoxDistance2& data,
 	dInt32& stack,
 	ndStackEntry* const stackPool,
-	const ndShapeCompound::ndNodeBase* const node0,
-	const ndShapeCompound::ndNodeBase* const node1)
+	const ndShapeCompound* const compoundShape0,
+	const ndShapeCompound::ndFlatNode* const node0,
+	const ndShapeCompound* const compoundShape1,
+	const ndShapeCompound::ndFlatNode* const node1,
+	dFloat32& closestDist)
 {
 	dAssert(node0);
 	dAssert(node1);
+	dVector size0;
+	dVector size1;
+	dVector origin0;
+	dVector origin1;
+	compoundShape0->GetFlatObb(node0, origin0, size0);
+	compoundShape1->GetFlatObb(node1, origin1, size1);
+
+	// separated pairs only contribute to the closest distance, keeping 
+	// them in the stack overflows it when many sub shapes are close.
+	dFloat32 subDist2 = data.CalculateDistance2(origin0, size0, origin1, size1);
+	if (subDist2 > dFloat32(0.0f))
+	{
+		closestDist = dMin(closestDist, subDist2);
+		return;
+	}
+
 	dInt32 j = stack;
-	dFloat32 subDist2 = data.CalculateDistance2(node0->m_origin, node0->m_size, node1->m_origin, node1->m_size);
 	for (; j && (subDist2 > stackPool[j - 1].m_dist2); j--)
 	{
 		stackPool[j] = stackPool[j - 1];
@@ -295,12 +318,16 @@ D_INLINE static void PushStackEntry(
 	dAssert(stack < 2 * D_COMPOUND_STACK_DEPTH);
 }
 
-D_INLINE static dFloat32 CalculateFightfieldDist2(const ndContactSolver::ndBoxBoxDistance2& data, const ndShapeCompound::ndNodeBase* const compoundNode, ndShapeInstance* const heightfieldInstance)
+D_INLINE static dFloat32 CalculateFightfieldDist2(const ndContactSolver::ndBoxBoxDistance2& data, const ndShapeCompound* const compoundShape, const ndShapeCompound::ndFlatNode* const compoundNode, ndShapeInstance* const heightfieldInstance)
 {
+	dVector compoundSize;
+	dVector compoundOrigin;
+	compoundShape->GetFlatObb(compoundNode, compoundOrigin, compoundSize);
+
 	const dVector scale(heightfieldInstance->GetScale());
 	const dVector invScale(heightfieldInstance->GetInvScale());
-	const dVector size(invScale * data.m_localMatrixAbs1.RotateVector(compoundNode->m_size));
-	const dVector origin(invScale * data.m_localMatrix1.TransformVector(compoundNode->m_origin));
+	const dVector size(invScale * data.m_localMatrixAbs1.RotateVector(compoundSize));
+	const dVector origin(invScale * data.m_localMatrix1.TransformVector(compoundOrigin));
 	const dVector p0(origin - size);
 	const dVector p1(origin + size);
 
@@ -311,7 +338,7 @@ D_INLINE static dFloat32 CalculateFightfieldDist2(const ndContactSolver::ndBoxBo
 	const dVector boxSize((boxP1 - boxP0) * dVector::m_half * scale);
 	const dVector boxOrigin((boxP1 + boxP0) * dVector::m_half * scale);
 
-	dFloat32 dist2 = data.CalculateDistance2(compoundNode->m_origin, compoundNode->m_size, boxOrigin, boxSize);
+	dFloat32 dist2 = data.CalculateDistance2(compoundOrigin, compoundSize, boxOrigin, boxSize);
 	return dist2;
 }
 
@@ -2419,8 +2446,66 @@ dInt32 ndContactSolver::ConvexToConvexContactsDiscrete()
 	return count;
 }
 
+dInt32 ndContactSolver::ConvexClosestPointDiscrete()
+{
+	// one point at the deepest feature of a convex pair, the scene uses it to 
+	// refill a cached manifold without clipping and pruning a new one.
+	dAssert(m_instance0.GetShape()->GetAsShapeConvex());
+	dAssert(m_instance1.GetShape()->GetAsShapeConvex());
+	if (!(m_instance0.GetCollisionMode() & m_instance1.GetCollisionMode()))
+	{
+		return 0;
+	}
+
+	const dVector origin0(m_instance0.m_globalMatrix.m_posit);
+	const dVector origin1(m_instance1.m_globalMatrix.m_posit);
+	m_instance0.m_globalMatrix.m_posit = dVector::m_wOne;
+	m_instance1.m_globalMatrix.m_posit -= (origin0 & dVector::m_triplexMask);
+
+	const dVector error(m_instance1.m_globalMatrix.m_posit - m_instance0.m_globalMatrix.m_posit);
+	if (error.DotProduct(error).GetScalar() < dFloat32(1.0e-6f))
+	{
+		m_instance1.m_globalMatrix.m_posit.m_y += dFloat32(1.0e-3f);
+	}
+
+	dInt32 count = 0;
+	const bool colliding = CalculateClosestPoints();
+	const dFloat32 penetration = m_separatingVector.DotProduct(m_closestPoint1 - m_closestPoint0).GetScalar() - m_skinThickness - D_PENETRATION_TOL;
+	m_separationDistance = penetration;
+	if (colliding && (penetration <= dFloat32(1.0e-5f)))
+	{
+		ndBodyKinematic* const body0 = m_contact->GetBody0();
+		ndBodyKinematic* const body1 = m_contact->GetBody1();
+		const dVector offset(origin0 & dVector::m_triplexMask);
+
+		ndContactPoint& contactOut = m_contactBuffer[0];
+		contactOut.m_point = (dVector::m_half * (m_closestPoint0 + m_closestPoint1) & dVector::m_triplexMask) + offset;
+		contactOut.m_normal = m_separatingVector * dVector::m_negOne;
+		contactOut.m_body0 = body0;
+		contactOut.m_body1 = body1;
+		contactOut.m_shapeInstance0 = &body0->GetCollisionShape();
+		contactOut.m_shapeInstance1 = &body1->GetCollisionShape();
+		contactOut.m_shapeId0 = 0;
+		contactOut.m_shapeId1 = 0;
+		contactOut.m_penetration = -penetration;
+		count = 1;
+	}
+
+	m_instance0.m_globalMatrix.m_posit = origin0;
+	m_instance1.m_globalMatrix.m_posit = origin1;
+	return count;
+}
+
 dInt32 ndContactSolver::CompoundContactsDiscrete()
 {
+	// a compound with every child removed has no flat tree to collide
+	const ndShapeCompound* const compound0 = m_instance0.GetShape()->GetAsShapeCompound();
+	const ndShapeCompound* const compound1 = m_instance1.GetShape()->GetAsShapeCompound();
+	if ((compound0 && !compound0->GetFlatRoot()) || (compound1 && !compound1->GetFlatRoot()))
+	{
+		return 0;
+	}
+
 	if (!m_instance1.GetShape()->GetAsShapeCompound())
 	{
 		dAssert(m_instance0.GetShape()->GetAsShapeCompound());
@@ -2482,10 +2567,13 @@ dInt32 ndContactSolver::ConvexToCompoundContactsDiscrete()
 	dInt32 stack = 1;
 	dInt32 contactCount = 0;
 	dFloat32 stackDistance[D_SCENE_MAX_STACK_DEPTH];
-	const ndShapeCompound::ndNodeBase* stackPool[D_COMPOUND_STACK_DEPTH];
+	const ndShapeCompound::ndFlatNode* stackPool[D_COMPOUND_STACK_DEPTH];
 
-	stackPool[0] = compoundShape->m_root;
-	stackDistance[0] = data.CalculateDistance2(origin, size, compoundShape->m_root->m_origin, compoundShape->m_root->m_size);
+	dVector nodeSize;
+	dVector nodeOrigin;
+	stackPool[0] = compoundShape->GetFlatRoot();
+	compoundShape->GetFlatObb(stackPool[0], nodeOrigin, nodeSize);
+	stackDistance[0] = data.CalculateDistance2(origin, size, nodeOrigin, nodeSize);
 	dFloat32 closestDist = (stackDistance[0] > dFloat32(0.0f)) ? stackDistance[0] : dFloat32(1.0e10f);
 
 	while (stack)
@@ -2499,12 +2587,12 @@ dInt32 ndContactSolver::ConvexToCompoundContactsDiscrete()
 			break;
 		}
 
-		const ndShapeCompound::ndNodeBase* const node = stackPool[stack];
+		const ndShapeCompound::ndFlatNode* const node = stackPool[stack];
 		dAssert(node);
 
-		if (node->m_type == ndShapeCompound::m_leaf)
+		if (node->IsLeaf())
 		{
-			ndShapeInstance* const subShape = node->GetShape();
+			ndShapeInstance* const subShape = compoundShape->GetFlatShape(node);
 			if (subShape->GetCollisionMode())
 			{
 				bool processContacts = m_notification->OnCompoundSubShapeOverlap(contactJoint, m_timestep, convexInstance, subShape);
@@ -2521,7 +2609,16 @@ dInt32 ndContactSolver::ConvexToCompoundContactsDiscrete()
 					dInt32 count = contactSolver.ConvexContactsDiscrete();
 					dFloat32 dist = dMax(contactSolver.m_separationDistance, dFloat32(0.0f));
 					closestDist = dMin(closestDist, dist * dist);
-					if (!m_intersectionTestOnly)
+					if (m_intersectionTestOnly)
+					{
+						// one overlapping sub shape is enough for an intersection test
+						if (count)
+						{
+							contactCount = 1;
+							break;
+						}
+					}
+					else
 					{
 						for (dInt32 i = 0; i < count; i++)
 						{
@@ -2538,11 +2635,12 @@ dInt32 ndContactSolver::ConvexToCompoundContactsDiscrete()
 		}
 		else
 		{
-			dAssert(node->m_type == ndShapeCompound::m_node);
+			dAssert(!node->IsLeaf());
 			{
-				const ndShapeCompound::ndNodeBase* const left = node->m_left;
+				const ndShapeCompound::ndFlatNode* const left = compoundShape->GetFlatLeft(node);
 				dAssert(left);
-				dFloat32 subDist2 = data.CalculateDistance2(origin, size, left->m_origin, left->m_size);
+				compoundShape->GetFlatObb(left, nodeOrigin, nodeSize);
+				dFloat32 subDist2 = data.CalculateDistance2(origin, size, nodeOrigin, nodeSize);
 				dInt32 j = stack;
 				for (; j && (subDist2 > stackDistance[j - 1]); j--)
 				{
@@ -2556,9 +2654,10 @@ dInt32 ndContactSolver::ConvexToCompoundContactsDiscrete()
 			}
 
 			{
-				const ndShapeCompound::ndNodeBase* const right = node->m_right;
+				const ndShapeCompound::ndFlatNode* const right = compoundShape->GetFlatRight(node);
 				dAssert(right);
-				dFloat32 subDist2 = data.CalculateDistance2(origin, size, right->m_origin, right->m_size);
+				compoundShape->GetFlatObb(right, nodeOrigin, nodeSize);
+				dFloat32 subDist2 = data.CalculateDistance2(origin, size, nodeOrigin, nodeSize);
 				dInt32 j = stack;
 				for (; j && (subDist2 > stackDistance[j - 1]); j--)
 				{
@@ -2603,12 +2702,15 @@ dInt32 ndContactSolver::CompoundToConvexContactsDiscrete()
 	dAssert(compoundShape);
 
 	dFloat32 stackDistance[D_SCENE_MAX_STACK_DEPTH];
-	const ndShapeCompound::ndNodeBase* stackPool[D_COMPOUND_STACK_DEPTH];
+	const ndShapeCompound::ndFlatNode* stackPool[D_COMPOUND_STACK_DEPTH];
 
 	dInt32 stack = 1;
 	dInt32 contactCount = 0;
-	stackPool[0] = compoundShape->m_root;
-	stackDistance[0] = data.CalculateDistance2(compoundShape->m_root->m_origin, compoundShape->m_root->m_size, origin, size);
+	dVector nodeSize;
+	dVector nodeOrigin;
+	stackPool[0] = compoundShape->GetFlatRoot();
+	compoundShape->GetFlatObb(stackPool[0], nodeOrigin, nodeSize);
+	stackDistance[0] = data.CalculateDistance2(nodeOrigin, nodeSize, origin, size);
 	dFloat32 closestDist = (stackDistance[0] > dFloat32(0.0f)) ? stackDistance[0] : dFloat32(1.0e10f);
 
 	while (stack)
@@ -2621,12 +2723,12 @@ dInt32 ndContactSolver::CompoundToConvexContactsDiscrete()
 			closestDist = dMin(closestDist, dist2);
 			break;
 		}
-		const ndShapeCompound::ndNodeBase* const node = stackPool[stack];
+		const ndShapeCompound::ndFlatNode* const node = stackPool[stack];
 		dAssert(node);
 
-		if (node->m_type == ndShapeCompound::m_leaf)
+		if (node->IsLeaf())
 		{
-			ndShapeInstance* const subShape = node->GetShape();
+			ndShapeInstance* const subShape = compoundShape->GetFlatShape(node);
 			if (subShape->GetCollisionMode())
 			{
 				bool processContacts = m_notification->OnCompoundSubShapeOverlap(contactJoint, m_timestep, subShape, convexInstance);
@@ -2643,7 +2745,16 @@ dInt32 ndContactSolver::CompoundToConvexContactsDiscrete()
 					dInt32 count = contactSolver.ConvexContactsDiscrete();
 					dFloat32 dist = dMax(contactSolver.m_separationDistance, dFloat32(0.0f));
 					closestDist = dMin(closestDist, dist * dist);
-					if (!m_intersectionTestOnly)
+					if (m_intersectionTestOnly)
+					{
+						// one overlapping sub shape is enough for an intersection test
+						if (count)
+						{
+							contactCount = 1;
+							break;
+						}
+					}
+					else
 					{
 						for (dInt32 i = 0; i < count; i++)
 						{
@@ -2660,11 +2771,12 @@ dInt32 ndContactSolver::CompoundToConvexContactsDiscrete()
 		}
 		else
 		{
-			dAssert(node->m_type == ndShapeCompound::m_node);
+			dAssert(!node->IsLeaf());
 			{
-				const ndShapeCompound::ndNodeBase* const left = node->m_left;
+				const ndShapeCompound::ndFlatNode* const left = compoundShape->GetFlatLeft(node);
 				dAssert(left);
-				dFloat32 subDist2 = data.CalculateDistance2(left->m_origin, left->m_size, origin, size);
+				compoundShape->GetFlatObb(left, nodeOrigin, nodeSize);
+				dFloat32 subDist2 = data.CalculateDistance2(nodeOrigin, nodeSize, origin, size);
 				dInt32 j = stack;
 				for (; j && (subDist2 > stackDistance[j - 1]); j--)
 				{
@@ -2678,9 +2790,10 @@ dInt32 ndContactSolver::CompoundToConvexContactsDiscrete()
 			}
 
 			{
-				const ndShapeCompound::ndNodeBase* const right = node->m_right;
+				const ndShapeCompound::ndFlatNode* const right = compoundShape->GetFlatRight(node);
 				dAssert(right);
-				dFloat32 subDist2 = data.CalculateDistance2(right->m_origin, right->m_size, origin, size);
+				compoundShape->GetFlatObb(right, nodeOrigin, nodeSize);
+				dFloat32 subDist2 = data.CalculateDistance2(nodeOrigin, nodeSize, origin, size);
 				dInt32 j = stack;
 				for (; j && (subDist2 > stackDistance[j - 1]); j--)
 				{
@@ -2723,34 +2836,24 @@ dInt32 ndContactSolver::CompoundToCompoundContactsDiscrete()
 	dAssert(compoundShape0);
 	dAssert(compoundShape1);
 
-	dInt32 stack = 1;
+	dInt32 stack = 0;
 	dInt32 contactCount = 0;
 	ndStackEntry stackPool[2 * D_COMPOUND_STACK_DEPTH];
 
-	stackPool[0].m_node0 = compoundShape0->m_root;
-	stackPool[0].m_node1 = compoundShape1->m_root;
-	stackPool[0].m_dist2 = data.CalculateDistance2(compoundShape0->m_root->m_origin, compoundShape0->m_root->m_size, compoundShape1->m_root->m_origin, compoundShape1->m_root->m_size);
-
-	dFloat32 closestDist = (stackPool[0].m_dist2 > dFloat32(0.0f)) ? stackPool[0].m_dist2 : dFloat32(1.0e10f);
+	dFloat32 closestDist = dFloat32(1.0e10f);
+	PushStackEntry(data, stack, stackPool, compoundShape0, compoundShape0->GetFlatRoot(), compoundShape1, compoundShape1->GetFlatRoot(), closestDist);
 
 	while (stack)
 	{
 		stack--;
-		dFloat32 dist2 = stackPool[stack].m_dist2;
-		if (dist2 > dFloat32(0.0f))
-		{
-			closestDist = dMin(closestDist, dist2);
-			break;
-		}
-
-		const ndShapeCompound::ndNodeBase* const node0 = stackPool[stack].m_node0;
-		const ndShapeCompound::ndNodeBase* const node1 = stackPool[stack].m_node1;
+		const ndShapeCompound::ndFlatNode* const node0 = stackPool[stack].m_node0;
+		const ndShapeCompound::ndFlatNode* const node1 = stackPool[stack].m_node1;
 		dAssert(node0 && node1);
 
-		if ((node0->m_type == ndShapeCompound::m_leaf) && (node1->m_type == ndShapeCompound::m_leaf))
+		if (node0->IsLeaf() && node1->IsLeaf())
 		{
-			ndShapeInstance* const subShape0 = node0->GetShape();
-			ndShapeInstance* const subShape1 = node1->GetShape();
+			ndShapeInstance* const subShape0 = compoundShape0->GetFlatShape(node0);
+			ndShapeInstance* const subShape1 = compoundShape1->GetFlatShape(node1);
 
 			if (subShape0->GetCollisionMode() & subShape1->GetCollisionMode())
 			{
@@ -2770,7 +2873,16 @@ dInt32 ndContactSolver::CompoundToCompoundContactsDiscrete()
 					dInt32 count = contactSolver.ConvexContactsDiscrete();
 					dFloat32 dist = dMax(contactSolver.m_separationDistance, dFloat32(0.0f));
 					closestDist = dMin(closestDist, dist * dist);
-					if (!m_intersectionTestOnly)
+					if (m_intersectionTestOnly)
+					{
+						// one overlapping sub shape is enough for an intersection test
+						if (count)
+						{
+							contactCount = 1;
+							break;
+						}
+					}
+					else
 					{
 						for (dInt32 i = 0; i < count; i++)
 						{
@@ -2786,62 +2898,32 @@ dInt32 ndContactSolver::CompoundToCompoundContactsDiscrete()
 				}
 			}
 		}
-		else if (node0->m_type == ndShapeCompound::m_leaf)
-		{
-			dAssert(node1->m_type == ndShapeCompound::m_node);
-			{
-				const ndShapeCompound::ndNodeBase* const subNode0 = node0;
-				const ndShapeCompound::ndNodeBase* const subNode1 = node1->m_left;
-				PushStackEntry(data, stack, stackPool, subNode0, subNode1);
-			}
-
-			{
-				const ndShapeCompound::ndNodeBase* const subNode0 = node0;
-				const ndShapeCompound::ndNodeBase* const subNode1 = node1->m_right;
-				PushStackEntry(data, stack, stackPool, subNode0, subNode1);
-			}
-		}
-		else if (node1->m_type == ndShapeCompound::m_leaf)
-		{
-			dAssert(node0->m_type == ndShapeCompound::m_node);
-			{
-				const ndShapeCompound::ndNodeBase* const subNode0 = node0->m_left;
-				const ndShapeCompound::ndNodeBase* const subNode1 = node1;
-				PushStackEntry(data, stack, stackPool, subNode0, subNode1);
-			}
-
-			{
-				const ndShapeCompound::ndNodeBase* const subNode0 = node0->m_right;
-				const ndShapeCompound::ndNodeBase* const subNode1 = node1;
-				PushStackEntry(data, stack, stackPool, subNode0, subNode1);
-			}
-		}
 		else
 		{
-			dAssert(node0->m_type == ndShapeCompound::m_node);
-			dAssert(node1->m_type == ndShapeCompound::m_node);
+			// descend the larger node only, so the pairs stay balanced in size
+			bool splitNode0 = !node0->IsLeaf();
+			if (splitNode0 && !node1->IsLeaf())
 			{
-				const ndShapeCompound::ndNodeBase* const subNode0 = node0->m_left;
-				const ndShapeCompound::ndNodeBase* const subNode1 = node1->m_left;
-				PushStackEntry(data, stack, stackPool, subNode0, subNode1);
+				dVector size0;
+				dVector size1;
+				dVector origin0;
+				dVector origin1;
+				compoundShape0->GetFlatObb(node0, origin0, size0);
+				compoundShape1->GetFlatObb(node1, origin1, size1);
+				const dFloat32 area0 = size0.DotProduct(size0.ShiftTripleRight()).GetScalar();
+				const dFloat32 area1 = size1.DotProduct(size1.ShiftTripleRight()).GetScalar();
+				splitNode0 = area0 >= area1;
 			}
 
+			if (splitNode0)
 			{
-				const ndShapeCompound::ndNodeBase* const subNode0 = node0->m_left;
-				const ndShapeCompound::ndNodeBase* const subNode1 = node1->m_right;
-				PushStackEntry(data, stack, stackPool, subNode0, subNode1);
+				PushStackEntry(data, stack, stackPool, compoundShape0, compoundShape0->GetFlatLeft(node0), compoundShape1, node1, closestDist);
+				PushStackEntry(data, stack, stackPool, compoundShape0, compoundShape0->GetFlatRight(node0), compoundShape1, node1, closestDist);
 			}
-
-			{
-				const ndShapeCompound::ndNodeBase* const subNode0 = node0->m_right;
-				const ndShapeCompound::ndNodeBase* const subNode1 = node1->m_left;
-				PushStackEntry(data, stack, stackPool, subNode0, subNode1);
-			}
-
+			else
 			{
-				const ndShapeCompound::ndNodeBase* const subNode0 = node0->m_right;
-				const ndShapeCompound::ndNodeBase* const subNode1 = node1->m_right;
-				PushStackEntry(data, stack, stackPool, subNode0, subNode1);
+				PushStackEntry(data, stack, stackPool, compoundShape0, node0, compoundShape1, compoundShape1->GetFlatLeft(node1), closestDist);
+				PushStackEntry(data, stack, stackPool, compoundShape0, node0, compoundShape1, compoundShape1->GetFlatRight(node1), closestDist);
 			}
 		}
 	}
@@ -3092,9 +3174,12 @@ dInt32 ndContactSolver::CompoundToShapeStaticBvhContactsDiscrete()
 	ndStackBvhStackEntry stackPool[2 * D_COMPOUND_STACK_DEPTH];
 
 	stackPool[0].m_treeNodeIsLeaf = 0;
-	stackPool[0].m_compoundNode = compoundShape->m_root;
+	dVector compoundSize;
+	dVector compoundOrigin;
+	compoundShape->GetFlatObb(compoundShape->GetFlatRoot(), compoundOrigin, compoundSize);
+	stackPool[0].m_compoundNode = compoundShape->GetFlatRoot();
 	stackPool[0].m_collisionTreeNode = bvhTreeCollision->GetRootNode();
-	stackPool[0].m_dist2 = data.CalculateDistance2(compoundShape->m_root->m_origin, compoundShape->m_root->m_size, bvhOrigin, bvhSize);
+	stackPool[0].m_dist2 = data.CalculateDistance2(compoundOrigin, compoundSize, bvhOrigin, bvhSize);
 
 	dFloat32 closestDist = (stackPool[0].m_dist2 > dFloat32(0.0f)) ? stackPool[0].m_dist2 : dFloat32(1.0e10f);
 	while (stack)
@@ -3108,15 +3193,15 @@ dInt32 ndContactSolver::CompoundToShapeStaticBvhContactsDiscrete()
 			break;
 		}
 
-		const ndShapeCompound::ndNodeBase* const compoundNode = stackPool[stack].m_compoundNode;
+		const ndShapeCompound::ndFlatNode* const compoundNode = stackPool[stack].m_compoundNode;
 		const dAabbPolygonSoup::dNode* const collisionTreeNode = stackPool[stack].m_collisionTreeNode;
 		const dInt32 treeNodeIsLeaf = stackPool[stack].m_treeNodeIsLeaf;
 
 		dAssert(compoundNode && collisionTreeNode);
 
-		if (treeNodeIsLeaf && (compoundNode->m_type == ndShapeCompound::m_leaf))
+		if (treeNodeIsLeaf && compoundNode->IsLeaf())
 		{
-			ndShapeInstance* const subShape = compoundNode->GetShape();
+			ndShapeInstance* const subShape = compoundShape->GetFlatShape(compoundNode);
 			if (subShape->GetCollisionMode())
 			{
 				bool processContacts = m_notification->OnCompoundSubShapeOverlap(contactJoint, m_timestep, subShape, bvhTreeInstance);
@@ -3133,7 +3218,16 @@ dInt32 ndContactSolver::CompoundToShapeStaticBvhContactsDiscrete()
 					dInt32 count = contactSolver.ConvexToSaticStaticBvhContactsNodeDescrete(collisionTreeNode);
 					dFloat32 dist = dMax(contactSolver.m_separationDistance, dFloat32(0.0f));
 					closestDist = dMin(closestDist, dist * dist);
-					if (!m_intersectionTestOnly)
+					if (m_intersectionTestOnly)
+					{
+						// one overlapping sub shape is enough for an intersection test
+						if (count)
+						{
+							contactCount = 1;
+							break;
+						}
+					}
+					else
 					{
 						for (dInt32 i = 0; i < count; i++)
 						{
@@ -3148,7 +3242,7 @@ dInt32 ndContactSolver::CompoundToShapeStaticBvhContactsDiscrete()
 				}
 			}
 		}
-		else if (compoundNode->m_type == ndShapeCompound::m_leaf)
+		else if (compoundNode->IsLeaf())
 		{
 			dAssert(!treeNodeIsLeaf);
 			const dAabbPolygonSoup::dNode* const backNode = bvhTreeCollision->GetBackNode(collisionTreeNode);
@@ -3156,33 +3250,33 @@ dInt32 ndContactSolver::CompoundToShapeStaticBvhContactsDiscrete()
 
 			if (backNode && frontNode)
 			{
-				PushStackEntry(data, stack, stackPool, compoundNode, bvhTreeCollision, 0, backNode);
-				PushStackEntry(data, stack, stackPool, compoundNode, bvhTreeCollision, 0, frontNode);
+				PushStackEntry(data, stack, stackPool, compoundShape, compoundNode, bvhTreeCollision, 0, backNode);
+				PushStackEntry(data, stack, stackPool, compoundShape, compoundNode, bvhTreeCollision, 0, frontNode);
 			}
 			else if (backNode && !frontNode)
 			{
-				PushStackEntry(data, stack, stackPool, compoundNode, bvhTreeCollision, 0, backNode);
-				PushStackEntry(data, stack, stackPool, compoundNode, bvhTreeCollision, 1, collisionTreeNode);
+				PushStackEntry(data, stack, stackPool, compoundShape, compoundNode, bvhTreeCollision, 0, backNode);
+				PushStackEntry(data, stack, stackPool, compoundShape, compoundNode, bvhTreeCollision, 1, collisionTreeNode);
 			}
 			else if (!backNode && frontNode)
 			{
-				PushStackEntry(data, stack, stackPool, compoundNode, bvhTreeCollision, 0, frontNode);
-				PushStackEntry(data, stack, stackPool, compoundNode, bvhTreeCollision, 1, collisionTreeNode);
+				PushStackEntry(data, stack, stackPool, compoundShape, compoundNode, bvhTreeCollision, 0, frontNode);
+				PushStackEntry(data, stack, stackPool, compoundShape, compoundNode, bvhTreeCollision, 1, collisionTreeNode);
 			}
 			else
 			{
-				PushStackEntry(data, stack, stackPool, compoundNode, bvhTreeCollision, 1, collisionTreeNode);
+				PushStackEntry(data, stack, stackPool, compoundShape, compoundNode, bvhTreeCollision, 1, collisionTreeNode);
 			}
 		}
 		else if (treeNodeIsLeaf)
 		{
-			dAssert(compoundNode->m_type == ndShapeCompound::m_node);
-			PushStackEntry(data, stack, stackPool, compoundNode->m_left, bvhTreeCollision, 1, collisionTreeNode);
-			PushStackEntry(data, stack, stackPool, compoundNode->m_right, bvhTreeCollision, 1, collisionTreeNode);
+			dAssert(!compoundNode->IsLeaf());
+			PushStackEntry(data, stack, stackPool, compoundShape, compoundShape->GetFlatLeft(compoundNode), bvhTreeCollision, 1, collisionTreeNode);
+			PushStackEntry(data, stack, stackPool, compoundShape, compoundShape->GetFlatRight(compoundNode), bvhTreeCollision, 1, collisionTreeNode);
 		}
 		else
 		{
-			dAssert(compoundNode->m_type == ndShapeCompound::m_node);
+			dAssert(!compoundNode->IsLeaf());
 			dAssert(!treeNodeIsLeaf);
 
 			dVector p0;
@@ -3193,39 +3287,39 @@ dInt32 ndContactSolver::CompoundToShapeStaticBvhContactsDiscrete()
 			dVector size((p1 - p0) * dVector::m_half);
 			dFloat32 area = size.DotProduct(size.ShiftTripleRight()).GetScalar();
 
-			if (area > compoundNode->m_area)
+			compoundShape->GetFlatObb(compoundNode, compoundOrigin, compoundSize);
+			dFloat32 compoundArea = compoundSize.DotProduct(compoundSize.ShiftTripleRight()).GetScalar();
+			if (area > compoundArea)
 			{
 				const dAabbPolygonSoup::dNode* const backNode = bvhTreeCollision->GetBackNode(collisionTreeNode);
 				const dAabbPolygonSoup::dNode* const frontNode = bvhTreeCollision->GetFrontNode(collisionTreeNode);
 				if (backNode && frontNode)
 				{
-					PushStackEntry(data, stack, stackPool, compoundNode, bvhTreeCollision, 0, backNode);
-					PushStackEntry(data, stack, stackPool, compoundNode, bvhTreeCollision, 0, frontNode);
+					PushStackEntry(data, stack, stackPool, compoundShape, compoundNode, bvhTreeCollision, 0, backNode);
+					PushStackEntry(data, stack, stackPool, compoundShape, compoundNode, bvhTreeCollision, 0, frontNode);
 				}
 				else if (backNode && !frontNode)
 				{
-					PushStackEntry(data, stack, stackPool, compoundNode, bvhTreeCollision, 0, backNode);
-					PushStackEntry(data, stack, stackPool, compoundNode->m_left, bvhTreeCollision, 1, collisionTreeNode);
-					PushStackEntry(data, stack, stackPool, compoundNode->m_right, bvhTreeCollision, 1, collisionTreeNode);
+					PushStackEntry(data, stack, stackPool, compoundShape, compoundNode, bvhTreeCollision, 0, backNode);
+					PushStackEntry(data, stack, stackPool, compoundShape, compoundShape->GetFlatLeft(compoundNode), bvhTreeCollision, 1, collisionTreeNode);
+					PushStackEntry(data, stack, stackPool, compoundShape, compoundShape->GetFlatRight(compoundNode), bvhTreeCollision, 1, collisionTreeNode);
 				}
 				else if (!backNode && frontNode)
 				{
-					PushStackEntry(data, stack, stackPool, compoundNode, bvhTreeCollision, 0, frontNode);
-					PushStackEntry(data, stack, stackPool, compoundNode->m_left, bvhTreeCollision, 1, collisionTreeNode);
-					PushStackEntry(data, stack, stackPool, compoundNode->m_right, bvhTreeCollision, 1, collisionTreeNode);
+					PushStackEntry(data, stack, stackPool, compoundShape, compoundNode, bvhTreeCollision, 0, frontNode);
+					PushStackEntry(data, stack, stackPool, compoundShape, compoundShape->GetFlatLeft(compoundNode), bvhTreeCollision, 1, collisionTreeNode);
+					PushStackEntry(data, stack, stackPool, compoundShape, compoundShape->GetFlatRight(compoundNode), bvhTreeCollision, 1, collisionTreeNode);
 				}
 				else
 				{
-					PushStackEntry(data, stack, stackPool, compoundNode, bvhTreeCollision, 1, collisionTreeNode);
+					PushStackEntry(data, stack, stackPool, compoundShape, compoundNode, bvhTreeCollision, 1, collisionTreeNode);
 				}
 			}
 			else
 			{
 				dAssert(!treeNodeIsLeaf);
-				dAssert(compoundNode->m_left);
-				dAssert(compoundNode->m_right);
-				PushStackEntry(data, stack, stackPool, compoundNode->m_left, bvhTreeCollision, 0, collisionTreeNode);
-				PushStackEntry(data, stack, stackPool, compoundNode->m_right, bvhTreeCollision, 0, collisionTreeNode);
+				PushStackEntry(data, stack, stackPool, compoundShape, compoundShape->GetFlatLeft(compoundNode), bvhTreeCollision, 0, collisionTreeNode);
+				PushStackEntry(data, stack, stackPool, compoundShape, compoundShape->GetFlatRight(compoundNode), bvhTreeCollision, 0, collisionTreeNode);
 			}
 		}
 	}
@@ -3252,9 +3346,6 @@ dInt32 ndContactSolver::CompoundToStaticHeightfieldContactsDiscrete()
 	ndShapeCompound* const compoundShape = compoundInstance->GetShape()->GetAsShapeCompound();
 	//ndShapeHeightfield* const heightfieldShape = heightfieldInstance->GetShape()->GetAsShapeHeightfield();
 
-	ndShapeCompound::ndNodeBase nodeProxi;
-	nodeProxi.m_left = nullptr;
-	nodeProxi.m_right = nullptr;
 	const dVector heighFieldScale(heightfieldInstance->GetScale());
 	const dVector heighFieldInvScale(heightfieldInstance->GetInvScale());
 	
@@ -3263,12 +3354,12 @@ dInt32 ndContactSolver::CompoundToStaticHeightfieldContactsDiscrete()
 	ndBoxBoxDistance2 data(compoundMatrix, heightfieldMatrix);
 
 	dFloat32 stackDistance[D_SCENE_MAX_STACK_DEPTH];
-	const ndShapeCompound::ndNodeBase* stackPool[D_COMPOUND_STACK_DEPTH];
+	const ndShapeCompound::ndFlatNode* stackPool[D_COMPOUND_STACK_DEPTH];
 
 	dInt32 stack = 1;
 	dInt32 contactCount = 0;
-	stackPool[0] = compoundShape->m_root;
-	stackDistance[0] = CalculateFightfieldDist2(data, compoundShape->m_root, heightfieldInstance);
+	stackPool[0] = compoundShape->GetFlatRoot();
+	stackDistance[0] = CalculateFightfieldDist2(data, compoundShape, stackPool[0], heightfieldInstance);
 	dFloat32 closestDist = (stackDistance[0] > dFloat32(0.0f)) ? stackDistance[0] : dFloat32(1.0e10f);
 
 	while (stack)
@@ -3282,12 +3373,12 @@ dInt32 ndContactSolver::CompoundToStaticHeightfieldContactsDiscrete()
 			break;
 		}
 
-		const ndShapeCompound::ndNodeBase* const node = stackPool[stack];
+		const ndShapeCompound::ndFlatNode* const node = stackPool[stack];
 		dAssert(node);
 
-		if (node->m_type == ndShapeCompound::m_leaf)
+		if (node->IsLeaf())
 		{
-			ndShapeInstance* const subShape = node->GetShape();
+			ndShapeInstance* const subShape = compoundShape->GetFlatShape(node);
 			if (subShape->GetCollisionMode())
 			{
 				bool processContacts = m_notification->OnCompoundSubShapeOverlap(contactJoint, m_timestep, subShape, heightfieldInstance);
@@ -3305,7 +3396,16 @@ dInt32 ndContactSolver::CompoundToStaticHeightfieldContactsDiscrete()
 					//closestDist = dMin(closestDist, contactSolver.m_separationDistance);
 					dFloat32 dist = dMax(contactSolver.m_separationDistance, dFloat32(0.0f));
 					closestDist = dMin(closestDist, dist * dist);
-					if (!m_intersectionTestOnly)
+					if (m_intersectionTestOnly)
+					{
+						// one overlapping sub shape is enough for an intersection test
+						if (count)
+						{
+							contactCount = 1;
+							break;
+						}
+					}
+					else
 					{
 						for (dInt32 i = 0; i < count; i++)
 						{
@@ -3322,11 +3422,11 @@ dInt32 ndContactSolver::CompoundToStaticHeightfieldContactsDiscrete()
 		}
 		else
 		{
-			dAssert(node->m_type == ndShapeCompound::m_node);
+			dAssert(!node->IsLeaf());
 			{
-				const ndShapeCompound::ndNodeBase* const left = node->m_left;
+				const ndShapeCompound::ndFlatNode* const left = compoundShape->GetFlatLeft(node);
 				dAssert(left);
-				dFloat32 subDist2 = CalculateFightfieldDist2(data, left, heightfieldInstance);
+				dFloat32 subDist2 = CalculateFightfieldDist2(data, compoundShape, left, heightfieldInstance);
 				dInt32 j = stack;
 				for (; j && (subDist2 > stackDistance[j - 1]); j--)
 				{
@@ -3340,9 +3440,9 @@ dInt32 ndContactSolver::CompoundToStaticHeightfieldContactsDiscrete()
 			}
 
 			{
-				const ndShapeCompound::ndNodeBase* const right = node->m_right;
+				const ndShapeCompound::ndFlatNode* const right = compoundShape->GetFlatRight(node);
 				dAssert(right);
-				dFloat32 subDist2 = CalculateFightfieldDist2(data, right, heightfieldInstance);
+				dFloat32 subDist2 = CalculateFightfieldDist2(data, compoundShape, right, heightfieldInstance);
 				dInt32 j = stack;
 				for (; j && (subDist2 > stackDistance[j - 1]); j--)
 				{
@@ -3394,6 +3494,14 @@ dInt32 ndContactSolver::CalculateContactsContinue()
 
 dInt32 ndContactSolver::CompoundContactsContinue()
 {
+	// a compound with every child removed has no flat tree to collide
+	const ndShapeCompound* const compound0 = m_instance0.GetShape()->GetAsShapeCompound();
+	const ndShapeCompound* const compound1 = m_instance1.GetShape()->GetAsShapeCompound();
+	if ((compound0 && !compound0->GetFlatRoot()) || (compound1 && !compound1->GetFlatRoot()))
+	{
+		return 0;
+	}
+
 	if (!m_instance1.GetShape()->GetAsShapeCompound())
 	{
 		dAssert(0);
@@ -3608,21 +3716,24 @@ dInt32 ndContactSolver::ConvexToCompoundContactsContinue()
 	const dVector relVeloc(matrix.UnrotateVector(convexBody->GetVelocity() - compoundBody->GetVelocity()));
 	dFastRayTest ray(dVector::m_zero, relVeloc);
 
-	const dVector rootMinBox(compoundShape->m_root->m_p0 - boxP1);
-	const dVector rootMaxBox(compoundShape->m_root->m_p1 - boxP0);
+	dVector nodeP0;
+	dVector nodeP1;
+	compoundShape->GetFlatBox(compoundShape->GetFlatRoot(), nodeP0, nodeP1);
+	const dVector rootMinBox(nodeP0 - boxP1);
+	const dVector rootMaxBox(nodeP1 - boxP0);
 
 	dVector closestPoint0(dVector::m_zero);
 	dVector closestPoint1(dVector::m_zero);
 	dVector separatingVector(dFloat32(0.0f), dFloat32(1.0f), dFloat32(0.0f), dFloat32(0.0f));
 
 	dFloat32 impactTime[D_SCENE_MAX_STACK_DEPTH];
-	const ndShapeCompound::ndNodeBase* stackPool[D_COMPOUND_STACK_DEPTH];
+	const ndShapeCompound::ndFlatNode* stackPool[D_COMPOUND_STACK_DEPTH];
 
 	dInt32 stack = 1;
 	dInt32 contactCount = 0;
 	dFloat32 minTimeStep = m_timestep;
 
-	stackPool[0] = compoundShape->m_root;
+	stackPool[0] = compoundShape->GetFlatRoot();
 	impactTime[0] = ray.BoxIntersect(rootMinBox, rootMaxBox);
 	while (stack)
 	{
@@ -3634,10 +3745,10 @@ dInt32 ndContactSolver::ConvexToCompoundContactsContinue()
 		}
 
 		dAssert(stackPool[stack]);
-		const ndShapeCompound::ndNodeBase* const node = stackPool[stack];
-		if (node->m_type == ndShapeCompound::m_leaf)
+		const ndShapeCompound::ndFlatNode* const node = stackPool[stack];
+		if (node->IsLeaf())
 		{
-			ndShapeInstance* const subShape = node->GetShape();
+			ndShapeInstance* const subShape = compoundShape->GetFlatShape(node);
 			if (subShape->GetCollisionMode())
 			{
 				bool processContacts = m_notification->OnCompoundSubShapeOverlap(contactJoint, m_timestep, convexInstance, subShape);
@@ -3692,12 +3803,13 @@ dInt32 ndContactSolver::ConvexToCompoundContactsContinue()
 		}
 		else
 		{
-			dAssert(node->m_type == ndShapeCompound::m_node);
+			dAssert(!node->IsLeaf());
 			{
-				const ndShapeCompound::ndNodeBase* const left = node->m_left;
+				const ndShapeCompound::ndFlatNode* const left = compoundShape->GetFlatLeft(node);
 				dAssert(left);
-				const dVector minBox(left->m_p0 - boxP1);
-				const dVector maxBox(left->m_p1 - boxP0);
+				compoundShape->GetFlatBox(left, nodeP0, nodeP1);
+				const dVector minBox(nodeP0 - boxP1);
+				const dVector maxBox(nodeP1 - boxP0);
 				dFloat32 dist1 = ray.BoxIntersect(minBox, maxBox);
 				if (dist1 <= dFloat32 (1.0f))
 				{
@@ -3715,10 +3827,11 @@ dInt32 ndContactSolver::ConvexToCompoundContactsContinue()
 			}
 
 			{
-				const ndShapeCompound::ndNodeBase* const right = node->m_right;
+				const ndShapeCompound::ndFlatNode* const right = compoundShape->GetFlatRight(node);
 				dAssert(right);
-				const dVector minBox(right->m_p0 - boxP1);
-				const dVector maxBox = right->m_p1 - boxP0;
+				compoundShape->GetFlatBox(right, nodeP0, nodeP1);
+				const dVector minBox(nodeP0 - boxP1);
+				const dVector maxBox(nodeP1 - boxP0);
 				dFloat32 dist1 = ray.BoxIntersect(minBox, maxBox);
 				if (dist1 <= dFloat32(1.0f))
 				{
@@ -73,6 +73,7 @@ class ndContactSolver: public dDownHeap<ndMinkFace *, dFloat32>
 	dInt32 ConvexContactsDiscrete(); // done
 	dInt32 CompoundContactsDiscrete(); // done
 	dInt32 ConvexToConvexContactsDiscrete(); // done
+	dInt32 ConvexClosestPointDiscrete();
 	dInt32 ConvexToCompoundContactsDiscrete(); // done
 	dInt32 CompoundToConvexContactsDiscrete(); // done
 	dInt32 CompoundToCompoundContactsDiscrete(); // done
@@ -29,20 +29,23 @@
 
 bool ndConvexCastNotify::CastShape(const ndShapeInstance& castingInstance, const dMatrix& globalOrigin, const dVector& globalDest, const ndShapeInstance& targetShape, const dMatrix& targetMatrix)
 {
-	ndContact contact;
-	ndBodyKinematic body0;
-	ndBodyKinematic body1;
-	ndContactNotify notify;
-	dFixSizeArray<ndContactPoint, D_MAX_CONTATCS> contactBuffer;
-	contactBuffer.SetCount(D_MAX_CONTATCS);
+	ndConvexCastContext context;
+	return CastShape(context, castingInstance, globalOrigin, globalDest, targetShape, targetMatrix);
+}
+
+bool ndConvexCastNotify::CastShape(ndConvexCastContext& context, const ndShapeInstance& castingInstance, const dMatrix& globalOrigin, const dVector& globalDest, const ndShapeInstance& targetShape, const dMatrix& targetMatrix)
+{
+	ndBodyKinematic& body0 = context.m_body0;
+	ndBodyKinematic& body1 = context.m_body1;
 
 	body0.SetCollisionShape(castingInstance);
 	body1.SetCollisionShape(targetShape);
 	body0.SetMatrix(globalOrigin);
 	body1.SetMatrix(targetMatrix);
-	body0.SetMassMatrix(dVector::m_one);
 	body0.SetVelocity(globalDest - globalOrigin.m_posit);
 
+	ndContact& contact = context.m_contact;
+	contact.ResetState();
 	contact.SetBodies(&body0, &body1);
 
 	ndShapeInstance& shape0 = body0.GetCollisionShape();
@@ -51,8 +54,8 @@ bool ndConvexCastNotify::CastShape(const ndShapeInstance& castingInstance, const
 	shape1.SetGlobalMatrix(shape1.GetLocalMatrix() * body1.GetMatrix());
 
 	m_contacts.SetCount(0);
-	ndContactSolver contactSolver(&contact, &notify, dFloat32(1.0f));
-	contactSolver.m_contactBuffer = &contactBuffer[0];
+	ndContactSolver contactSolver(&contact, &context.m_notify, dFloat32(1.0f));
+	contactSolver.m_contactBuffer = &context.m_contactBuffer[0];
 
 	m_param = dFloat32(1.2f);
 	const dInt32 count = dMin(contactSolver.CalculateContactsContinue(), m_contacts.GetCapacity());
@@ -60,7 +63,7 @@ bool ndConvexCastNotify::CastShape(const ndShapeInstance& castingInstance, const
 	{
 		for (dInt32 i = 0; i < count; i++)
 		{
-			m_contacts.PushBack(contactBuffer[i]);
+			m_contacts.PushBack(context.m_contactBuffer[i]);
 		}
 		m_param = contactSolver.m_timestep;
 		m_normal = contactSolver.m_separatingVector;
@@ -69,3 +72,37 @@ bool ndConvexCastNotify::CastShape(const ndShapeInstance& castingInstance, const
 	}
 	return count > 0;
 }
+
+void ndConvexCastNotify::MergeHit(const ndConvexCastNotify& hit)
+{
+	// the result is the earliest hit, so it does not depend on
+	// the order the bodies are visited
+	const dFloat32 paramDiff = hit.m_param - m_param;
+	if (paramDiff > dFloat32(1.0e-3f))
+	{
+		return;
+	}
+	if (paramDiff < dFloat32(-1.0e-3f))
+	{
+		m_contacts.SetCount(0);
+	}
+
+	dInt32 count = hit.m_contacts.GetCount();
+	if ((count + m_contacts.GetCount()) >= m_contacts.GetCapacity())
+	{
+		dAssert(0);
+		count = m_contacts.GetCapacity() - m_contacts.GetCount();
+	}
+
+	for (dInt32 i = count - 1; i >= 0; i--)
+	{
+		m_contacts.PushBack(hit.m_contacts[i]);
+	}
+	if (paramDiff < dFloat32(0.0f))
+	{
+		m_param = hit.m_param;
+		m_normal = hit.m_normal;
+		m_closestPoint0 = hit.m_closestPoint0;
+		m_closestPoint1 = hit.m_closestPoint1;
+	}
+}
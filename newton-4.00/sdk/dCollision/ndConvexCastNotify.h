@@ -24,10 +24,61 @@
 
 #include "ndCollisionStdafx.h"
 #include "ndContact.h"
+#include "ndBodyKinematic.h"
 
 class ndBody;
 class ndScene;
 class ndShapeInstance;
+class ndConvexCastNotify;
+
+// proxy bodies and contact buffer shared by all the casts issued from one thread. 
+D_MSV_NEWTON_ALIGN_32
+class ndConvexCastContext
+{
+	public:
+	ndConvexCastContext()
+		:m_contact()
+		,m_body0()
+		,m_body1()
+		,m_notify()
+	{
+		m_body0.SetMassMatrix(dVector::m_one);
+		m_contactBuffer.SetCount(D_MAX_CONTATCS);
+	}
+
+	ndContact m_contact;
+	ndBodyKinematic m_body0;
+	ndBodyKinematic m_body1;
+	ndContactNotify m_notify;
+	dFixSizeArray<ndContactPoint, D_MAX_CONTATCS> m_contactBuffer;
+} D_GCC_NEWTON_ALIGN_32;
+
+// one entry of a batched convex cast, see ndScene::ConvexCastBatch
+D_MSV_NEWTON_ALIGN_32
+class ndConvexCastQuery
+{
+	public:
+	ndConvexCastQuery()
+		:m_origin(dGetIdentityMatrix())
+		,m_dest(dVector::m_wOne)
+		,m_shape(nullptr)
+		,m_notify(nullptr)
+	{
+	}
+
+	ndConvexCastQuery(ndConvexCastNotify* const notify, const ndShapeInstance* const shape, const dMatrix& globalOrigin, const dVector& globalDest)
+		:m_origin(globalOrigin)
+		,m_dest(globalDest)
+		,m_shape(shape)
+		,m_notify(notify)
+	{
+	}
+
+	dMatrix m_origin;
+	dVector m_dest;
+	const ndShapeInstance* m_shape;
+	ndConvexCastNotify* m_notify;
+} D_GCC_NEWTON_ALIGN_32;
 
 D_MSV_NEWTON_ALIGN_32
 class ndConvexCastNotify
@@ -60,6 +111,8 @@ class ndConvexCastNotify
 	}
 
 	D_COLLISION_API bool CastShape(const ndShapeInstance& castingInstance, const dMatrix& globalOrigin, const dVector& globalDest, const ndShapeInstance& targetShape, const dMatrix& targetMatrix);
+	D_COLLISION_API bool CastShape(ndConvexCastContext& context, const ndShapeInstance& castingInstance, const dMatrix& globalOrigin, const dVector& globalDest, const ndShapeInstance& targetShape, const dMatrix& targetMatrix);
+	D_COLLISION_API void MergeHit(const ndConvexCastNotify& hit);
 
 	dVector m_normal;
 	dVector m_closestPoint0;
@@ -118,6 +118,8 @@ class ndJointBilateralConstraint: public ndConstraint, public dClassAlloc
 	friend class ndDynamicsUpdateSoa;
 	friend class ndDynamicsUpdateAvx2;
 	friend class ndDynamicsUpdateOpencl;
+	friend class ndWorldCheckpoint;
+	friend class ndWorldSnapshot;
 };
 
 inline ndJointBilateralSolverModel ndJointBilateralConstraint::GetSolverModel() const
@@ -380,6 +380,13 @@ class ndMeshEffect: public dPolyhedra
 	{
 	};
 	
+	class ndFracturePiece
+	{
+		public:
+		ndMeshEffect* m_mesh;
+		ndShapeInstance* m_collision;
+	};
+
 	D_COLLISION_API ndMeshEffect();
 	D_COLLISION_API ndMeshEffect(const ndMeshEffect& source);
 	D_COLLISION_API ndMeshEffect(const ndShapeInstance& shape);
@@ -467,7 +474,14 @@ class ndMeshEffect: public dPolyhedra
 	D_COLLISION_API ndMeshEffect* InverseConvexMeshIntersection(const ndMeshEffect* const convexMesh) const;
 	D_COLLISION_API ndMeshEffect* CreateVoronoiConvexDecomposition(const dArray<dVector>& pointCloud, dInt32 interiorMaterialIndex, const dMatrix& textureProjectionMatrix);
 
+	// tessellate the point cloud once and clip the mesh against each voronoi cell on the thread pool.
+	// each piece is a clipped mesh and its convex collision, the caller owns both. pieces are in cell 
+	// order and can be added to a compound in a single BeginAddRemove EndAddRemove block.
+	// the pool must be idle, a null pool clips the cells in the calling thread.
+	D_COLLISION_API void CreateVoronoiFracture(dThreadPool* const threadPool, const dArray<dVector>& pointCloud, dInt32 interiorMaterialIndex, const dMatrix& textureProjectionMatrix, dArray<ndFracturePiece>& pieces) const;
+
 	protected:
+	friend class ndVoronoiFractureJob;
 	D_COLLISION_API void Init();
 	D_COLLISION_API virtual void BeginFace();
 	D_COLLISION_API virtual bool EndFace();
@@ -482,6 +496,8 @@ class ndMeshEffect: public dPolyhedra
 	dInt32 AddInterpolatedHalfAttribute(dEdge* const edge, dInt32 midPoint);
 	
 	void MergeFaces(const ndMeshEffect* const source);
+	void CalculateVoronoiCells(const dArray<dVector>& pointCloud, dArray<dBigVector>& cellPoints, dArray<dInt32>& cellFirstPoint) const;
+	ndMeshEffect* ClipVoronoiCell(const dBigVector* const cellPoints, dInt32 count, dInt32 interiorMaterialIndex, const dMatrix& textureProjectionMatrix) const;
 	D_COLLISION_API ndMeshEffect* GetNextLayer(dInt32 mark);
 
 	dString m_name;
@@ -1103,7 +1103,7 @@ dAssert(0);
 }
 #endif
 
-ndMeshEffect* ndMeshEffect::CreateVoronoiConvexDecomposition(const dArray<dVector>& pointCloud, dInt32 interiorMaterialIndex, const dMatrix& textureProjectionMatrix)
+void ndMeshEffect::CalculateVoronoiCells(const dArray<dVector>& pointCloud, dArray<dBigVector>& cellPoints, dArray<dInt32>& cellFirstPoint) const
 {
 	dStack<dBigVector> buffer(pointCloud.GetCount() + 32);
 	dBigVector* const pool = &buffer[0];
@@ -1196,10 +1196,10 @@ ndMeshEffect* ndMeshEffect::CreateVoronoiConvexDecomposition(const dArray<dVecto
 		index++;
 	}
 	
-	const dFloat32 normalAngleInRadians = dFloat32(30.0f * dDegreeToRad);
-	ndMeshEffect* const voronoiPartition = new ndMeshEffect;
-	voronoiPartition->BeginBuild();
-	dInt32 layer = 0;
+	// the cells are listed in delaunay vertex order, 
+	// each cell is the points from cellFirstPoint[i] to cellFirstPoint[i + 1]
+	cellPoints.SetCount(0);
+	cellFirstPoint.SetCount(0);
 	dTree<dList<dInt32>, dInt32>::Iterator iter(delaunayNodes);
 	for (iter.Begin(); iter; iter++) 
 	{
@@ -1224,22 +1224,45 @@ ndMeshEffect* ndMeshEffect::CreateVoronoiConvexDecomposition(const dArray<dVecto
 			count1 = dVertexListToIndexList(&pointArray[0].m_x, sizeof(dBigVector), 3, count1, &indexArray[0], dFloat64(1.0e-3f));
 			if (count1 >= 4) 
 			{
-				ndMeshEffect convexMesh(&pointArray[0].m_x, count1, sizeof(dBigVector), dFloat64(0.0f));
-				if (convexMesh.GetCount()) 
+				cellFirstPoint.PushBack(cellPoints.GetCount());
+				for (dInt32 i = 0; i < count1; i++)
 				{
-					convexMesh.m_materials.SetCount(interiorMaterialIndex + 1);
-					convexMesh.CalculateNormals(normalAngleInRadians);
-					convexMesh.UniformBoxMapping(interiorMaterialIndex, textureProjectionMatrix);
-					for (dInt32 i = 0; i < convexMesh.m_points.m_vertex.GetCount(); i++) 
-					{
-						convexMesh.m_points.m_layers[i] = layer;
-					}
-					voronoiPartition->MergeFaces(&convexMesh);
-					layer++;
+					cellPoints.PushBack(pointArray[i]);
 				}
 			}
 		}
 	}
+	cellFirstPoint.PushBack(cellPoints.GetCount());
+}
+
+ndMeshEffect* ndMeshEffect::CreateVoronoiConvexDecomposition(const dArray<dVector>& pointCloud, dInt32 interiorMaterialIndex, const dMatrix& textureProjectionMatrix)
+{
+	dArray<dBigVector> cellPoints;
+	dArray<dInt32> cellFirstPoint;
+	CalculateVoronoiCells(pointCloud, cellPoints, cellFirstPoint);
+
+	const dFloat32 normalAngleInRadians = dFloat32(30.0f * dDegreeToRad);
+	ndMeshEffect* const voronoiPartition = new ndMeshEffect;
+	voronoiPartition->BeginBuild();
+	dInt32 layer = 0;
+	for (dInt32 i = 0; i < cellFirstPoint.GetCount() - 1; i++)
+	{
+		const dInt32 first = cellFirstPoint[i];
+		const dInt32 count = cellFirstPoint[i + 1] - first;
+		ndMeshEffect convexMesh(&cellPoints[first].m_x, count, sizeof(dBigVector), dFloat64(0.0f));
+		if (convexMesh.GetCount()) 
+		{
+			convexMesh.m_materials.SetCount(interiorMaterialIndex + 1);
+			convexMesh.CalculateNormals(normalAngleInRadians);
+			convexMesh.UniformBoxMapping(interiorMaterialIndex, textureProjectionMatrix);
+			for (dInt32 j = 0; j < convexMesh.m_points.m_vertex.GetCount(); j++) 
+			{
+				convexMesh.m_points.m_layers[j] = layer;
+			}
+			voronoiPartition->MergeFaces(&convexMesh);
+			layer++;
+		}
+	}
 
 	voronoiPartition->EndBuild(dFloat64(1.0e-8f), false);
 	//voronoiPartition->SaveOFF("xxx0.off");
@@ -1252,3 +1275,114 @@ ndMeshEffect* ndMeshEffect::CreateVoronoiConvexDecomposition(const dArray<dVecto
 	}
 	return voronoiPartition;
 }
+
+class ndVoronoiFractureJob: public dThreadPoolJob
+{
+	public:
+	class ndContext
+	{
+		public:
+		const ndMeshEffect* m_mesh;
+		const dBigVector* m_cellPoints;
+		const dInt32* m_cellFirstPoint;
+		ndMeshEffect::ndFracturePiece* m_pieces;
+		const dMatrix* m_textureProjectionMatrix;
+		dInt32 m_interiorMaterialIndex;
+		dInt32 m_cellsCount;
+		dAtomic<dInt32> m_cell;
+	};
+
+	virtual void Execute()
+	{
+		D_TRACKTIME();
+		ndContext* const context = (ndContext*)m_context;
+		for (dInt32 i = context->m_cell.fetch_add(1); i < context->m_cellsCount; i = context->m_cell.fetch_add(1))
+		{
+			ndMeshEffect::ndFracturePiece& piece = context->m_pieces[i];
+			piece.m_mesh = nullptr;
+			piece.m_collision = nullptr;
+
+			const dInt32 first = context->m_cellFirstPoint[i];
+			const dInt32 count = context->m_cellFirstPoint[i + 1] - first;
+			ndMeshEffect* const fracturePiece = context->m_mesh->ClipVoronoiCell(&context->m_cellPoints[first], count, context->m_interiorMaterialIndex, *context->m_textureProjectionMatrix);
+			if (fracturePiece)
+			{
+				ndShapeInstance* const collision = fracturePiece->CreateConvexCollision(dFloat32(0.0f));
+				if (collision)
+				{
+					piece.m_mesh = fracturePiece;
+					piece.m_collision = collision;
+				}
+				else
+				{
+					delete fracturePiece;
+				}
+			}
+		}
+	}
+
+	void* m_context;
+};
+
+ndMeshEffect* ndMeshEffect::ClipVoronoiCell(const dBigVector* const cellPoints, dInt32 count, dInt32 interiorMaterialIndex, const dMatrix& textureProjectionMatrix) const
+{
+	ndMeshEffect convexMesh(&cellPoints[0].m_x, count, sizeof(dBigVector), dFloat64(0.0f));
+	if (!convexMesh.GetCount())
+	{
+		return nullptr;
+	}
+
+	const dFloat32 normalAngleInRadians = dFloat32(30.0f * dDegreeToRad);
+	convexMesh.m_materials.SetCount(interiorMaterialIndex + 1);
+	convexMesh.CalculateNormals(normalAngleInRadians);
+	convexMesh.UniformBoxMapping(interiorMaterialIndex, textureProjectionMatrix);
+	return ConvexMeshIntersection(&convexMesh);
+}
+
+void ndMeshEffect::CreateVoronoiFracture(dThreadPool* const threadPool, const dArray<dVector>& pointCloud, dInt32 interiorMaterialIndex, const dMatrix& textureProjectionMatrix, dArray<ndFracturePiece>& pieces) const
+{
+	D_TRACKTIME();
+	dAssert(interiorMaterialIndex < m_materials.GetCount());
+
+	dArray<dBigVector> cellPoints;
+	dArray<dInt32> cellFirstPoint;
+	CalculateVoronoiCells(pointCloud, cellPoints, cellFirstPoint);
+
+	const dInt32 cellsCount = cellFirstPoint.GetCount() - 1;
+	dArray<ndFracturePiece> cellPieces;
+	cellPieces.SetCount(cellsCount);
+
+	ndVoronoiFractureJob::ndContext context;
+	context.m_mesh = this;
+	context.m_cellPoints = cellPoints.GetCount() ? &cellPoints[0] : nullptr;
+	context.m_cellFirstPoint = &cellFirstPoint[0];
+	context.m_pieces = cellsCount ? &cellPieces[0] : nullptr;
+	context.m_textureProjectionMatrix = &textureProjectionMatrix;
+	context.m_interiorMaterialIndex = interiorMaterialIndex;
+	context.m_cellsCount = cellsCount;
+	context.m_cell.store(0);
+	if (threadPool)
+	{
+		threadPool->Begin();
+		ndVoronoiFractureJob voronoiFractureJob;
+		voronoiFractureJob.m_context = &context;
+		threadPool->SubmitJobs(voronoiFractureJob);
+		threadPool->End();
+	}
+	else
+	{
+		ndVoronoiFractureJob job;
+		job.m_context = &context;
+		job.Execute();
+	}
+
+	// pieces are emitted in cell order, so the result does not depend on the thread count
+	pieces.SetCount(0);
+	for (dInt32 i = 0; i < cellsCount; i++)
+	{
+		if (cellPieces[i].m_mesh)
+		{
+			pieces.PushBack(cellPieces[i]);
+		}
+	}
+}
@@ -38,6 +38,9 @@
 #define D_NARROW_PHASE_DIST			dFloat32 (0.2f)
 #define D_CONTACT_TRANSLATION_ERROR	dFloat32 (1.0e-3f)
 #define D_CONTACT_ANGULAR_ERROR		(dFloat32 (0.25f * dDegreeToRad))
+#define D_CONVEX_CAST_GROUP_SIZE	32
+#define D_CONTACT_MANIFOLD_DRIFT	dFloat32 (0.1f)
+#define D_CONTACT_MANIFOLD_ANGLE	(dFloat32 (2.0f * dDegreeToRad))
 
 dVector ndScene::m_velocTol(dFloat32(1.0e-16f));
 dVector ndScene::m_angularContactError2(D_CONTACT_ANGULAR_ERROR * D_CONTACT_ANGULAR_ERROR);
@@ -58,7 +61,7 @@ class ndScene::ndSpliteInfo
 			for (dInt32 i = 0; i < boxCount; i++)
 			{
 				ndSceneNode* const node = boxArray[i];
-				dAssert(node->GetAsSceneBodyNode());
+				dAssert(node->GetAsSceneBodyNode() || node->GetAsSceneAggregate());
 				minP = minP.GetMin(node->m_minBox);
 				maxP = maxP.GetMax(node->m_maxBox);
 			}
@@ -70,7 +73,7 @@ class ndScene::ndSpliteInfo
 			for (dInt32 i = 0; i < boxCount; i++)
 			{
 				ndSceneNode* const node = boxArray[i];
-				dAssert(node->GetAsSceneBodyNode());
+				dAssert(node->GetAsSceneBodyNode() || node->GetAsSceneAggregate());
 				minP = minP.GetMin(node->m_minBox);
 				maxP = maxP.GetMax(node->m_maxBox);
 				dVector p(dVector::m_half * (node->m_minBox + node->m_maxBox));
@@ -151,41 +154,6 @@ class ndScene::ndSpliteInfo
 	dInt32 m_axis;
 } D_GCC_NEWTON_ALIGN_32 ;
 
-ndScene::ndFitnessList::ndFitnessList()
-	:dList <ndSceneTreeNode*, dContainersFreeListAlloc<ndSceneTreeNode*>>()
-	,m_currentCost(dFloat32(0.0f))
-	,m_currentNode(nullptr)
-	,m_index(0)
-{
-}
-
-void ndScene::ndFitnessList::AddNode(ndSceneTreeNode* const node)
-{
-	node->m_fitnessNode = Append(node);
-}
-
-void ndScene::ndFitnessList::RemoveNode(ndSceneTreeNode* const node)
-{
-	dAssert(node->m_fitnessNode);
-	if (node->m_fitnessNode == m_currentNode)
-	{
-		m_currentNode = node->m_fitnessNode->GetNext();
-	}
-	Remove(node->m_fitnessNode);
-	node->m_fitnessNode = nullptr;
-}
-
-dFloat64 ndScene::ndFitnessList::TotalCost() const
-{
-	D_TRACKTIME();
-	dFloat64 cost = dFloat32(0.0f);
-	for (dNode* node = GetFirst(); node; node = node->GetNext()) {
-		ndSceneNode* const box = node->GetInfo();
-		cost += box->m_surfaceArea;
-	}
-	return cost;
-}
-	
 ndScene::ndScene()
 	:dClassAlloc()
 	,dThreadPool("newtonWorker")
@@ -194,6 +162,7 @@ ndScene::ndScene()
 	,m_activeConstraintArray()
 	,m_sceneBodyArray(1024)
 	,m_activeBodyArray(1024)
+	,m_triggerEvents(256)
 	,m_contactLock()
 	,m_rootNode(nullptr)
 	,m_contactNotifyCallback(new ndContactNotify())
@@ -201,7 +170,11 @@ ndScene::ndScene()
 	,m_fitness()
 	,m_timestep(dFloat32 (0.0f))
 	,m_lru(D_CONTACT_DELAY_FRAMES)
+	,m_contactCacheHits(0)
+	,m_contactCacheMisses(0)
+	,m_deterministic(false)
 {
+	memset(m_threadCacheCounters, 0, sizeof(m_threadCacheCounters));
 	m_contactNotifyCallback->m_scene = this;
 }
 
@@ -211,7 +184,6 @@ ndScene::~ndScene()
 	Finish();
 	delete m_contactNotifyCallback;
 	ndContactList::FlushFreeList();
-	ndContactPointList::FlushFreeList();
 	ndShapeCompound::ndTreeArray::FlushFreeList();
 }
 
@@ -248,6 +220,12 @@ void ndScene::Update(dFloat32 timestep)
 	TickOne();
 }
 
+dFloat32 ndScene::GetContactCacheHitRate() const
+{
+	const dInt32 total = m_contactCacheHits + m_contactCacheMisses;
+	return total ? dFloat32(m_contactCacheHits) / dFloat32(total) : dFloat32(0.0f);
+}
+
 ndContactNotify* ndScene::GetContactNotify() const
 {
 	return m_contactNotifyCallback;
@@ -273,11 +251,13 @@ void ndScene::DebugScene(ndSceneTreeNotiFy* const notify)
 {
 	for (ndFitnessList::dNode* node = m_fitness.GetFirst(); node; node = node->GetNext())
 	{
-		if (node->GetInfo()->GetLeft()->GetAsSceneBodyNode())
+		ndSceneNode* const left = node->GetInfo()->GetLeft();
+		if (left->GetAsSceneBodyNode() || left->GetAsSceneAggregate())
 		{
 			notify->OnDebugNode(node->GetInfo()->GetLeft());
 		}
-		if (node->GetInfo()->GetRight()->GetAsSceneBodyNode())
+		ndSceneNode* const right = node->GetInfo()->GetRight();
+		if (right->GetAsSceneBodyNode() || right->GetAsSceneAggregate())
 		{
 			notify->OnDebugNode(node->GetInfo()->GetRight());
 		}
@@ -305,15 +285,35 @@ bool ndScene::RemoveBody(ndBodyKinematic* const body)
 	ndSceneBodyNode* const node = body->GetSceneBodyNode();
 	if (node)
 	{
-		RemoveNode(node);
+		if (node->m_aggregate)
+		{
+			RemoveAggregateNode(node);
+		}
+		else
+		{
+			RemoveNode(node);
+		}
 	}
 
 	ndBodyKinematic::ndContactMap& contactMap = body->GetContactMap();
 	while (contactMap.GetRoot())
 	{
 		ndContact* const contact = contactMap.GetRoot()->GetInfo();
-		m_contactList.DeleteContact(contact);
+		DeleteContact(contact);
+	}
+
+	// the events of the last step can not keep pointing to the body
+	dInt32 eventCount = 0;
+	for (dInt32 i = 0; i < m_triggerEvents.GetCount(); i++)
+	{
+		const ndTriggerEvent& event = m_triggerEvents[i];
+		if ((event.m_body != body) && (event.m_trigger != body))
+		{
+			m_triggerEvents[eventCount] = event;
+			eventCount++;
+		}
 	}
+	m_triggerEvents.SetCount(eventCount);
 
 	if (body->m_scene && body->m_sceneNode)
 	{
@@ -325,6 +325,168 @@ bool ndScene::RemoveBody(ndBodyKinematic* const body)
 	return false;
 }
 
+ndSceneAggregate* ndScene::CreateAggregate()
+{
+	ndSceneAggregate* const aggregate = new ndSceneAggregate();
+	aggregate->m_listNode = m_aggregateList.Append(aggregate);
+	return aggregate;
+}
+
+void ndScene::DestroyAggregate(ndSceneAggregate* const aggregate)
+{
+	// the members go back to the scene as independent bodies
+	while (aggregate->m_root)
+	{
+		ndSceneNode* node = aggregate->m_root;
+		while (node->GetAsSceneTreeNode())
+		{
+			node = node->GetLeft();
+		}
+		ndBodyKinematic* const body = node->GetBody();
+		RemoveAggregateNode(node->GetAsSceneBodyNode());
+		AddNode(new ndSceneBodyNode(body));
+	}
+	m_aggregateList.Remove(aggregate->m_listNode);
+	delete aggregate;
+}
+
+bool ndScene::AddToAggregate(ndSceneAggregate* const aggregate, ndBodyKinematic* const body)
+{
+	ndSceneBodyNode* const bodyNode = body->GetSceneBodyNode();
+	if ((body->m_scene == this) && bodyNode && !bodyNode->m_aggregate)
+	{
+		RemoveNode(bodyNode);
+		AddAggregateNode(aggregate, new ndSceneBodyNode(body));
+		return true;
+	}
+	return false;
+}
+
+bool ndScene::RemoveFromAggregate(ndSceneAggregate* const aggregate, ndBodyKinematic* const body)
+{
+	ndSceneBodyNode* const bodyNode = body->GetSceneBodyNode();
+	if (bodyNode && (bodyNode->m_aggregate == aggregate))
+	{
+		RemoveAggregateNode(bodyNode);
+		AddNode(new ndSceneBodyNode(body));
+		return true;
+	}
+	return false;
+}
+
+void ndScene::AddAggregateNode(ndSceneAggregate* const aggregate, ndSceneBodyNode* const node)
+{
+	node->m_aggregate = aggregate;
+	aggregate->m_count++;
+	if (aggregate->m_root)
+	{
+		// the private tree is detached from the aggregate while the new leaf is inserted
+		ndSceneNode* const root = aggregate->m_root;
+		root->m_parent = nullptr;
+		ndSceneTreeNode* const parent = InsertNode(root, node);
+		aggregate->m_fitness.AddNode(parent);
+		if (!parent->m_parent)
+		{
+			aggregate->m_root = parent;
+		}
+		aggregate->m_root->m_parent = aggregate;
+		UpdateAggregateAabb(aggregate, parent);
+	}
+	else
+	{
+		aggregate->m_root = node;
+		node->m_parent = aggregate;
+		aggregate->m_isSleeping = false;
+		aggregate->m_minBox = node->m_minBox;
+		aggregate->m_maxBox = node->m_maxBox;
+		aggregate->m_surfaceArea = node->m_surfaceArea;
+		AddNode(aggregate);
+	}
+}
+
+void ndScene::RemoveAggregateNode(ndSceneBodyNode* const node)
+{
+	ndSceneAggregate* const aggregate = node->m_aggregate;
+	dAssert(aggregate && aggregate->m_count);
+	aggregate->m_count--;
+	node->m_aggregate = nullptr;
+
+	ndSceneNode* const parent = node->m_parent;
+	if (parent == aggregate)
+	{
+		// the last member leaves, so does the aggregate leave the scene tree
+		dAssert(aggregate->m_root == node);
+		aggregate->m_root = nullptr;
+		node->m_parent = nullptr;
+		DetachNode(aggregate);
+	}
+	else
+	{
+		ndSceneTreeNode* const treeNode = parent->GetAsSceneTreeNode();
+		ndSceneNode* const sibling = (treeNode->m_left == node) ? treeNode->m_right : treeNode->m_left;
+		ndSceneNode* const grandParent = treeNode->m_parent;
+		sibling->m_parent = grandParent;
+		if (grandParent == aggregate)
+		{
+			aggregate->m_root = sibling;
+		}
+		else
+		{
+			ndSceneTreeNode* const grandParentNode = grandParent->GetAsSceneTreeNode();
+			if (grandParentNode->m_left == treeNode)
+			{
+				grandParentNode->m_left = sibling;
+			}
+			else
+			{
+				dAssert(grandParentNode->m_right == treeNode);
+				grandParentNode->m_right = sibling;
+			}
+		}
+		aggregate->m_fitness.RemoveNode(treeNode);
+		treeNode->m_left = nullptr;
+		treeNode->m_right = nullptr;
+		node->m_parent = nullptr;
+		delete treeNode;
+		UpdateAggregateAabb(aggregate, sibling);
+	}
+	delete node;
+}
+
+void ndScene::UpdateAggregateAabb(ndSceneAggregate* const aggregate, ndSceneNode* const node)
+{
+	// refit the boxes from the node up to the root of the scene, 
+	// called when the membership or the private tree of the aggregate changes
+	dAssert(aggregate->m_root);
+	for (ndSceneNode* parent = node->m_parent; parent; parent = parent->m_parent)
+	{
+		dVector minBox;
+		dVector maxBox;
+		if (parent == aggregate)
+		{
+			parent->m_surfaceArea = CalculateSurfaceArea(aggregate->m_root, aggregate->m_root, minBox, maxBox);
+		}
+		else
+		{
+			parent->m_surfaceArea = CalculateSurfaceArea(parent->GetLeft(), parent->GetRight(), minBox, maxBox);
+		}
+		parent->m_minBox = minBox;
+		parent->m_maxBox = maxBox;
+	}
+}
+
+ndSceneNode* ndScene::GetPairSearchLeaf(ndSceneBodyNode* const bodyNode) const
+{
+	// the members of an aggregate only look for pairs inside the 
+	// group when self collision is enabled and the group is awake
+	ndSceneAggregate* const aggregate = bodyNode->m_aggregate;
+	if (aggregate && (!aggregate->m_selfCollision || aggregate->m_isSleeping))
+	{
+		return aggregate;
+	}
+	return bodyNode;
+}
+
 ndSceneTreeNode* ndScene::InsertNode(ndSceneNode* const root, ndSceneNode* const node)
 {
 	dVector p0;
@@ -332,7 +494,7 @@ ndSceneTreeNode* ndScene::InsertNode(ndSceneNode* const root, ndSceneNode* const
 
 	ndSceneNode* sibling = root;
 	dFloat32 surfaceArea = CalculateSurfaceArea(node, sibling, p0, p1);
-	while (!sibling->GetAsSceneBodyNode() && (surfaceArea >= sibling->m_surfaceArea))
+	while (sibling->GetAsSceneTreeNode() && (surfaceArea >= sibling->m_surfaceArea))
 	{
 		sibling->m_minBox = p0;
 		sibling->m_maxBox = p1;
@@ -624,6 +786,11 @@ void ndScene::UpdateFitness(ndFitnessList& fitness, dFloat64& oldEntropy, ndScen
 						leafArray[leafNodesCount] = leftNode;
 						leafNodesCount++;
 					}
+					else if (leftNode->GetAsSceneAggregate())
+					{
+						leafArray[leafNodesCount] = leftNode;
+						leafNodesCount++;
+					}
 
 					ndSceneNode* const rightNode = node->GetRight();
 					ndBodyKinematic* const rightBody = rightNode->GetBody();
@@ -633,6 +800,11 @@ void ndScene::UpdateFitness(ndFitnessList& fitness, dFloat64& oldEntropy, ndScen
 						leafArray[leafNodesCount] = rightNode;
 						leafNodesCount++;
 					}
+					else if (rightNode->GetAsSceneAggregate())
+					{
+						leafArray[leafNodesCount] = rightNode;
+						leafNodesCount++;
+					}
 				}
 				
 				ndFitnessList::dNode* nodePtr = fitness.GetFirst();
@@ -652,6 +824,17 @@ void ndScene::UpdateFitness(ndFitnessList& fitness, dFloat64& oldEntropy, ndScen
 void ndScene::BalanceScene()
 {
 	D_TRACKTIME();
+	// the private trees of the awake aggregates go first, 
+	// so the scene tree is balanced with their new boxes
+	for (dList<ndSceneAggregate*>::dNode* node = m_aggregateList.GetFirst(); node; node = node->GetNext())
+	{
+		ndSceneAggregate* const aggregate = node->GetInfo();
+		if (aggregate->m_root && aggregate->m_root->GetAsSceneTreeNode() && !aggregate->m_isSleeping)
+		{
+			UpdateFitness(aggregate->m_fitness, aggregate->m_treeEntropy, &aggregate->m_root);
+			UpdateAggregateAabb(aggregate, aggregate->m_root);
+		}
+	}
 	UpdateFitness(m_fitness, m_treeEntropy, &m_rootNode);
 }
 
@@ -758,25 +941,31 @@ void ndScene::UpdateAabb(dInt32, ndBodyKinematic* const body)
 	{
 		//body->m_broaphaseEquilibrium = 0;
 		bodyNode->SetAabb(body->m_minAabb, body->m_maxAabb);
+		UpdateParentsAabb(bodyNode);
+	}
+}
 
-		if (!m_rootNode->GetAsSceneBodyNode()) 
-		{
-			const ndSceneNode* const root = (m_rootNode->GetLeft() && m_rootNode->GetRight()) ? nullptr : m_rootNode;
-			dAssert(root == nullptr);
-			for (ndSceneNode* parent = bodyNode->m_parent; parent != root; parent = parent->m_parent) 
+void ndScene::UpdateParentsAabb(ndSceneNode* const node)
+{
+	if (!m_rootNode->GetAsSceneBodyNode()) 
+	{
+		// the walk goes through the private tree of an aggregate, if any, and then up to the scene root
+		for (ndSceneNode* parent = node->m_parent; parent; parent = parent->m_parent) 
+		{
+			dScopeSpinLock lock(parent->m_lock);
+			dVector minBox;
+			dVector maxBox;
+			const ndSceneAggregate* const aggregate = parent->GetAsSceneAggregate();
+			dFloat32 area = aggregate ?
+				CalculateSurfaceArea(aggregate->m_root, aggregate->m_root, minBox, maxBox) :
+				CalculateSurfaceArea(parent->GetLeft(), parent->GetRight(), minBox, maxBox);
+			if (dBoxInclusionTest(minBox, maxBox, parent->m_minBox, parent->m_maxBox)) 
 			{
-				dScopeSpinLock lock(parent->m_lock);
-				dVector minBox;
-				dVector maxBox;
-				dFloat32 area = CalculateSurfaceArea(parent->GetLeft(), parent->GetRight(), minBox, maxBox);
-				if (dBoxInclusionTest(minBox, maxBox, parent->m_minBox, parent->m_maxBox)) 
-				{
-					break;
-				}
-				parent->m_minBox = minBox;
-				parent->m_maxBox = maxBox;
-				parent->m_surfaceArea = area;
+				break;
 			}
+			parent->m_minBox = minBox;
+			parent->m_maxBox = maxBox;
+			parent->m_surfaceArea = area;
 		}
 	}
 }
@@ -811,6 +1000,161 @@ bool ndScene::ValidateContactCache(ndContact* const contact, const dVector& time
 	return false;
 }
 
+bool ndScene::ValidateContactManifold(dInt32 threadIndex, ndContact* const contact)
+{
+	dAssert(contact->m_maxDOF);
+	ndBodyKinematic* const body0 = contact->GetBody0();
+	ndBodyKinematic* const body1 = contact->GetBody1();
+
+	// a large relative rotation can bring new features into contact
+	const dFloat32 cosHalfAngle = dCos(D_CONTACT_MANIFOLD_ANGLE * dFloat32(0.5f));
+	const dQuaternion rotation(body1->m_rotation.Inverse() * body0->m_rotation);
+	if (dAbs(rotation.DotProduct(contact->m_manifoldRotation).GetScalar()) < cosHalfAngle)
+	{
+		return false;
+	}
+
+	// the drift tolerance is a fraction of the smallest shape, static meshes 
+	// and heightfields can be flat so only the moving shape sets the scale
+	ndShapeInstance& shape0 = body0->GetCollisionShape();
+	ndShapeInstance& shape1 = body1->GetCollisionShape();
+	const dFloat32 radius0 = shape0.GetBoxMinRadius();
+	const dFloat32 radius = shape1.GetShape()->GetAsShapeStaticMesh() ? radius0 : dMin(radius0, shape1.GetBoxMinRadius());
+	const dFloat32 maxDrift = dMax(radius * D_CONTACT_MANIFOLD_DRIFT, dFloat32(1.0e-3f));
+
+	// re project the cached points, the manifold is invalid if any point slid away from its anchor 
+	const dMatrix& matrix0 = body0->m_matrix;
+	const dMatrix& matrix1 = body1->m_matrix;
+	const dFloat32 maxDrift2 = maxDrift * maxDrift;
+	ndContactPointList& contactPointList = contact->m_contacPointsList;
+	for (dInt32 i = 0; i < contactPointList.GetCount(); i++)
+	{
+		const ndContactMaterial& contactPoint = contactPointList[i];
+		const dVector p0(matrix0.TransformVector(contactPoint.m_localPoint0));
+		const dVector p1(matrix1.TransformVector(contactPoint.m_localPoint1));
+		const dVector normal(matrix1.RotateVector(contactPoint.m_localNormal));
+		const dVector step((p0 - p1) & dVector::m_triplexMask);
+		const dVector drift(step - normal.Scale(step.DotProduct(normal).GetScalar()));
+		if (drift.DotProduct(drift).GetScalar() > maxDrift2)
+		{
+			return false;
+		}
+	}
+
+	// update the surviving points and drop the ones that separated
+	const dInt32 cachedCount = contactPointList.GetCount();
+	for (dInt32 i = contactPointList.GetCount() - 1; i >= 0; i--)
+	{
+		ndContactMaterial& contactPoint = contactPointList[i];
+		const dVector p0(matrix0.TransformVector(contactPoint.m_localPoint0));
+		const dVector p1(matrix1.TransformVector(contactPoint.m_localPoint1));
+		const dVector normal(matrix1.RotateVector(contactPoint.m_localNormal));
+		const dVector step((p0 - p1) & dVector::m_triplexMask);
+		const dFloat32 penetration = contactPoint.m_penetration - step.DotProduct(normal).GetScalar();
+		if (penetration < -maxDrift)
+		{
+			contactPointList.Remove(i);
+		}
+		else
+		{
+			const dFloat32 w = contactPoint.m_point.m_w;
+			contactPoint.m_point = dVector::m_half * (p0 + p1);
+			contactPoint.m_point.m_w = w;
+			contactPoint.m_penetration = penetration;
+			contactPoint.m_normal = normal;
+		}
+	}
+
+	// the dropped points leave the manifold short, 
+	// add the current deepest point of convex pairs
+	if ((contactPointList.GetCount() < cachedCount) && shape0.GetShape()->GetAsShapeConvex() && shape1.GetShape()->GetAsShapeConvex())
+	{
+		AddManifoldPoint(contact, maxDrift);
+	}
+
+	if (!contactPointList.GetCount())
+	{
+		return false;
+	}
+
+	contact->m_positAcc = dVector::m_zero;
+	contact->m_rotationAcc = dQuaternion();
+	UpdateContactMaterials(threadIndex, contact);
+	return true;
+}
+
+void ndScene::AddManifoldPoint(ndContact* const contact, dFloat32 maxDrift)
+{
+	ndContactPoint contactBuffer[D_MAX_CONTATCS];
+	ndContactSolver contactSolver(contact, m_contactNotifyCallback, m_timestep);
+	contactSolver.m_separatingVector = contact->m_separatingVector;
+	contactSolver.m_contactBuffer = contactBuffer;
+	const dInt32 count = contactSolver.ConvexClosestPointDiscrete();
+	contact->m_separatingVector = contactSolver.m_separatingVector;
+	if (!count)
+	{
+		return;
+	}
+
+	// a point close to a cached one refreshes it and keeps its forces, 
+	// otherwise it takes a free slot or replaces the shallowest point
+	const ndContactPoint& newPoint = contactBuffer[0];
+	ndContactPointList& contactPointList = contact->m_contacPointsList;
+	dInt32 index = -1;
+	dFloat32 minDist2 = maxDrift * maxDrift;
+	for (dInt32 i = 0; i < contactPointList.GetCount(); i++)
+	{
+		const dVector step((contactPointList[i].m_point - newPoint.m_point) & dVector::m_triplexMask);
+		const dFloat32 dist2 = step.DotProduct(step).GetScalar();
+		if (dist2 < minDist2)
+		{
+			index = i;
+			minDist2 = dist2;
+		}
+	}
+
+	if (index == -1)
+	{
+		if (contactPointList.GetCount() < contactPointList.GetCapacity())
+		{
+			index = contactPointList.GetCount();
+			contactPointList.SetCount(index + 1);
+		}
+		else
+		{
+			index = 0;
+			for (dInt32 i = 1; i < contactPointList.GetCount(); i++)
+			{
+				if (contactPointList[i].m_penetration < contactPointList[index].m_penetration)
+				{
+					index = i;
+				}
+			}
+		}
+		ndContactMaterial& contactPoint = contactPointList[index];
+		contactPoint.m_normal_Force.Clear();
+		contactPoint.m_dir0_Force.Clear();
+		contactPoint.m_dir1_Force.Clear();
+		contactPoint.m_body0 = newPoint.m_body0;
+		contactPoint.m_body1 = newPoint.m_body1;
+		contactPoint.m_shapeInstance0 = newPoint.m_shapeInstance0;
+		contactPoint.m_shapeInstance1 = newPoint.m_shapeInstance1;
+		contactPoint.m_shapeId0 = newPoint.m_shapeId0;
+		contactPoint.m_shapeId1 = newPoint.m_shapeId1;
+		contactPoint.m_dir0 = dVector::m_zero;
+	}
+
+	const ndBodyKinematic* const body0 = contact->GetBody0();
+	const ndBodyKinematic* const body1 = contact->GetBody1();
+	ndContactMaterial& contactPoint = contactPointList[index];
+	contactPoint.m_point = newPoint.m_point;
+	contactPoint.m_normal = newPoint.m_normal;
+	contactPoint.m_penetration = newPoint.m_penetration;
+	contactPoint.m_localPoint0 = body0->m_matrix.UntransformVector(contactPoint.m_point);
+	contactPoint.m_localPoint1 = body1->m_matrix.UntransformVector(contactPoint.m_point);
+	contactPoint.m_localNormal = body1->m_matrix.UnrotateVector(contactPoint.m_normal);
+}
+
 void ndScene::CalculateJointContacts(dInt32 threadIndex, ndContact* const contact)
 {
 	//DG_TRACKTIME();
@@ -832,44 +1176,130 @@ void ndScene::CalculateJointContacts(dInt32 threadIndex, ndContact* const contac
 		ndContactSolver contactSolver(contact, m_contactNotifyCallback, m_timestep);
 		contactSolver.m_separatingVector = contact->m_separatingVector;
 		contactSolver.m_contactBuffer = contactBuffer;
-		contactSolver.m_intersectionTestOnly = body0->m_contactTestOnly | body1->m_contactTestOnly;
-		
-		dInt32 count = contactSolver.CalculateContactsDiscrete ();
-		if (count)
+
+		if (body0->m_contactTestOnly | body1->m_contactTestOnly)
 		{
-			if (contactSolver.m_intersectionTestOnly)
-			{
-				if (!contact->m_isIntersetionTestOnly)
-				{
-					ndBodyTriggerVolume* const trigger = body1->GetAsBodyTriggerVolume();
-					if (trigger)
-					{
-						trigger->OnTriggerEnter(body0, m_timestep);
-					}
-				}
-				contact->m_isIntersetionTestOnly = 1;
-			}
-			else
+			CalculateTriggerContacts(contact, &contactSolver);
+		}
+		else
+		{
+			dInt32 count = contactSolver.CalculateContactsDiscrete();
+			if (count)
 			{
 				dAssert(count <= (D_CONSTRAINT_MAX_ROWS / 3));
 				ProcessContacts(threadIndex, count, &contactSolver);
 				dAssert(contact->m_maxDOF);
-				contact->m_isIntersetionTestOnly = 0;
 			}
+			else
+			{
+				contact->m_maxDOF = 0;
+			}
+			contact->m_isIntersetionTestOnly = 0;
 		}
-		else
+	}
+}
+
+void ndScene::CalculateTriggerContacts(ndContact* const contact, ndContactSolver* const contactSolver)
+{
+	// sensor pairs only need to know if the shapes overlap, the solver 
+	// runs the closest distance query but no contact points are generated, 
+	// pruned or added to the contact manifold.
+	contactSolver->m_pruneContacts = 0;
+	contactSolver->m_intersectionTestOnly = 1;
+	const dInt32 count = contactSolver->CalculateContactsDiscrete();
+	contact->m_maxDOF = 0;
+	contact->m_isIntersetionTestOnly = count ? 1 : 0;
+}
+
+void ndScene::AddTriggerEvent(dInt32 threadIndex, ndContact* const contact, ndTriggerEvent::ndEventType type)
+{
+	ndBodyTriggerVolume* const trigger = contact->GetBody1()->GetAsBodyTriggerVolume();
+	if (trigger)
+	{
+		ndTriggerEvent event;
+		event.m_trigger = trigger;
+		event.m_body = contact->GetBody0();
+		event.m_type = type;
+		m_threadTriggerEvents[threadIndex].PushBack(event);
+	}
+}
+
+void ndScene::DeleteContact(ndContact* const contact)
+{
+	// a contact deleted outside CalculateContacts while the shapes still 
+	// overlap owes the trigger its exit event, it is delivered right away
+	ndBodyTriggerVolume* const trigger = contact->GetBody1()->GetAsBodyTriggerVolume();
+	if (trigger && contact->m_isIntersetionTestOnly)
+	{
+		ndTriggerEvent event;
+		event.m_trigger = trigger;
+		event.m_body = contact->GetBody0();
+		event.m_type = ndTriggerEvent::m_exit;
+		trigger->OnTriggerEvents(&event, 1, m_timestep);
+	}
+	m_contactList.DeleteContact(contact);
+}
+
+void ndScene::ProcessTriggerEvents()
+{
+	D_TRACKTIME();
+	class ndSortTriggerEvents
+	{
+		public:
+		static dInt32 Compare(const ndTriggerEvent* const eventA, const ndTriggerEvent* const eventB, void* const)
 		{
-			if (contact->m_isIntersetionTestOnly)
+			const dUnsigned32 triggerIdA = eventA->m_trigger->GetId();
+			const dUnsigned32 triggerIdB = eventB->m_trigger->GetId();
+			if (triggerIdA != triggerIdB)
 			{
-				ndBodyTriggerVolume* const trigger = body1->GetAsBodyTriggerVolume();
-				if (trigger)
-				{
-					body1->GetAsBodyTriggerVolume()->OnTriggerExit(body0, m_timestep);
-				}
-				contact->m_isIntersetionTestOnly = 0;
+				return (triggerIdA < triggerIdB) ? -1 : 1;
+			}
+			const dUnsigned32 bodyIdA = eventA->m_body->GetId();
+			const dUnsigned32 bodyIdB = eventB->m_body->GetId();
+			if (bodyIdA != bodyIdB)
+			{
+				return (bodyIdA < bodyIdB) ? -1 : 1;
 			}
-			contact->m_maxDOF = 0;
+			return 0;
 		}
+	};
+
+	// merge the per thread buffers and sort them so that the events 
+	// are delivered in the same order regardless of the thread count.
+	dInt32 count = 0;
+	const dInt32 threadCount = GetThreadCount();
+	for (dInt32 i = 0; i < threadCount; i++)
+	{
+		count += m_threadTriggerEvents[i].GetCount();
+	}
+
+	m_triggerEvents.SetCount(count);
+	if (!count)
+	{
+		return;
+	}
+
+	count = 0;
+	for (dInt32 i = 0; i < threadCount; i++)
+	{
+		dArray<ndTriggerEvent>& threadEvents = m_threadTriggerEvents[i];
+		for (dInt32 j = 0; j < threadEvents.GetCount(); j++)
+		{
+			m_triggerEvents[count] = threadEvents[j];
+			count++;
+		}
+		threadEvents.SetCount(0);
+	}
+	dSort(&m_triggerEvents[0], count, ndSortTriggerEvents::Compare);
+
+	// each trigger gets all of its events in a single call
+	for (dInt32 i = 0; i < count; )
+	{
+		dInt32 j = i + 1;
+		ndBodyTriggerVolume* const trigger = m_triggerEvents[i].m_trigger;
+		for (; (j < count) && (m_triggerEvents[j].m_trigger == trigger); j++);
+		trigger->OnTriggerEvents(&m_triggerEvents[i], j - i, m_timestep);
+		i = j;
 	}
 }
 
@@ -885,20 +1315,99 @@ void ndScene::ProcessContacts(dInt32 threadIndex, dInt32 contactCount, ndContact
 	dAssert(body1);
 	dAssert(body0 != body1);
 
-	contact->m_material = m_contactNotifyCallback->GetMaterial(contact, body0->GetCollisionShape(), body1->GetCollisionShape());
 	const ndContactPoint* const contactArray = contactSolver->m_contactBuffer;
 	
-	dInt32 count = 0;
-	dVector cachePosition[D_MAX_CONTATCS];
-	ndContactPointList::dNode* nodes[D_MAX_CONTATCS];
+	// only the accumulated forces of the old manifold are carried over, 
+	// everything else is overwritten by the new points
 	ndContactPointList& contactPointList = contact->m_contacPointsList;
-	for (ndContactPointList::dNode* contactNode = contactPointList.GetFirst(); contactNode; contactNode = contactNode->GetNext()) 
+	dInt32 count = contactPointList.GetCount();
+	dVector cachePosition[D_MAX_CONTACT_POINTS];
+	ndForceImpactPair cacheForces[D_MAX_CONTACT_POINTS][3];
+	for (dInt32 i = 0; i < count; i++)
+	{
+		const ndContactMaterial& cachePoint = contactPointList[i];
+		cachePosition[i] = cachePoint.m_point;
+		cacheForces[i][0] = cachePoint.m_normal_Force;
+		cacheForces[i][1] = cachePoint.m_dir0_Force;
+		cacheForces[i][2] = cachePoint.m_dir1_Force;
+	}
+	dAssert(contactCount <= contactPointList.GetCapacity());
+	contactPointList.SetCount(contactCount);
+	
+	for (dInt32 i = 0; i < contactCount; i++) 
 	{
-		nodes[count] = contactNode;
-		cachePosition[count] = contactNode->GetInfo().m_point;
-		count++;
+		dInt32 index = -1;
+		dFloat32 min = dFloat32(1.0e20f);
+		for (dInt32 j = 0; j < count; j++) 
+		{
+			dVector v(cachePosition[j] - contactArray[i].m_point);
+			dAssert(v.m_w == dFloat32(0.0f));
+			const dFloat32 diff = v.DotProduct(v).GetScalar();
+			if (diff < min) 
+			{
+				index = j;
+				min = diff;
+			}
+		}
+	
+		ndContactMaterial* const contactPoint = &contactPointList[i];
+		if (index != -1) 
+		{
+			contactPoint->m_normal_Force = cacheForces[index][0];
+			contactPoint->m_dir0_Force = cacheForces[index][1];
+			contactPoint->m_dir1_Force = cacheForces[index][2];
+
+			count--;
+			cachePosition[index] = cachePosition[count];
+			cacheForces[index][0] = cacheForces[count][0];
+			cacheForces[index][1] = cacheForces[count][1];
+			cacheForces[index][2] = cacheForces[count][2];
+		}
+		else 
+		{
+			contactPoint->m_normal_Force.Clear();
+			contactPoint->m_dir0_Force.Clear();
+			contactPoint->m_dir1_Force.Clear();
+		}
+	
+		dAssert(dCheckFloat(contactArray[i].m_point.m_x));
+		dAssert(dCheckFloat(contactArray[i].m_point.m_y));
+		dAssert(dCheckFloat(contactArray[i].m_point.m_z));
+		dAssert(contactArray[i].m_body0);
+		dAssert(contactArray[i].m_body1);
+		dAssert(contactArray[i].m_shapeInstance0);
+		dAssert(contactArray[i].m_shapeInstance1);
+		dAssert(contactArray[i].m_body0 == body0);
+		dAssert(contactArray[i].m_body1 == body1);
+		contactPoint->m_point = contactArray[i].m_point;
+		contactPoint->m_normal = contactArray[i].m_normal;
+		contactPoint->m_penetration = contactArray[i].m_penetration;
+		contactPoint->m_body0 = contactArray[i].m_body0;
+		contactPoint->m_body1 = contactArray[i].m_body1;
+		contactPoint->m_shapeInstance0 = contactArray[i].m_shapeInstance0;
+		contactPoint->m_shapeInstance1 = contactArray[i].m_shapeInstance1;
+		contactPoint->m_shapeId0 = contactArray[i].m_shapeId0;
+		contactPoint->m_shapeId1 = contactArray[i].m_shapeId1;
+		contactPoint->m_localPoint0 = body0->m_matrix.UntransformVector(contactPoint->m_point);
+		contactPoint->m_localPoint1 = body1->m_matrix.UntransformVector(contactPoint->m_point);
+		contactPoint->m_localNormal = body1->m_matrix.UnrotateVector(contactPoint->m_normal);
 	}
 	
+	contact->m_manifoldRotation = body1->m_rotation.Inverse() * body0->m_rotation;
+	UpdateContactMaterials(threadIndex, contact);
+}
+
+void ndScene::UpdateContactMaterials(dInt32 threadIndex, ndContact* const contact)
+{
+	// material and friction directions are set every time the manifold 
+	// is used, either from the narrow phase or from the cached points
+	ndBodyKinematic* const body0 = contact->m_body0;
+	ndBodyKinematic* const body1 = contact->m_body1;
+	ndContactPointList& contactPointList = contact->m_contacPointsList;
+	dAssert(contactPointList.GetCount());
+
+	contact->m_material = m_contactNotifyCallback->GetMaterial(contact, body0->GetCollisionShape(), body1->GetCollisionShape());
+
 	const dVector& v0 = body0->m_veloc;
 	const dVector& w0 = body0->m_omega;
 	const dVector& com0 = body0->m_globalCentreOfMass;
@@ -909,9 +1418,9 @@ void ndScene::ProcessContacts(dInt32 threadIndex, dInt32 contactCount, ndContact
 
 	dVector controlDir0(dVector::m_zero);
 	dVector controlDir1(dVector::m_zero);
-	dVector controlNormal(contactArray[0].m_normal);
-	dVector vel0(v0 + w0.CrossProduct(contactArray[0].m_point - com0));
-	dVector vel1(v1 + w1.CrossProduct(contactArray[0].m_point - com1));
+	dVector controlNormal(contactPointList[0].m_normal);
+	dVector vel0(v0 + w0.CrossProduct(contactPointList[0].m_point - com0));
+	dVector vel1(v1 + w1.CrossProduct(contactPointList[0].m_point - com1));
 	dVector vRel(vel1 - vel0);
 	dAssert(controlNormal.m_w == dFloat32(0.0f));
 	dVector tangDir(vRel - controlNormal * vRel.DotProduct(controlNormal));
@@ -939,59 +1448,10 @@ void ndScene::ProcessContacts(dInt32 threadIndex, dInt32 contactCount, ndContact
 	}
 	
 	dFloat32 maxImpulse = dFloat32(-1.0f);
-	for (dInt32 i = 0; i < contactCount; i++) 
+	for (dInt32 i = 0; i < contactPointList.GetCount(); i++) 
 	{
-		dInt32 index = -1;
-		dFloat32 min = dFloat32(1.0e20f);
-		ndContactPointList::dNode* contactNode = nullptr;
-		for (dInt32 j = 0; j < count; j++) 
-		{
-			dVector v(cachePosition[j] - contactArray[i].m_point);
-			dAssert(v.m_w == dFloat32(0.0f));
-			diff = v.DotProduct(v).GetScalar();
-			if (diff < min) 
-			{
-				index = j;
-				min = diff;
-				contactNode = nodes[j];
-			}
-		}
-	
-		if (contactNode) 
-		{
-			count--;
-			dAssert(index != -1);
-			nodes[index] = nodes[count];
-			cachePosition[index] = cachePosition[count];
-		}
-		else 
-		{
-			//dScopeSpinLock lock(m_contactLock);
-			contactNode = contactPointList.Append();
-		}
-
-		ndContactMaterial* const contactPoint = &contactNode->GetInfo();
-	
-		dAssert(dCheckFloat(contactArray[i].m_point.m_x));
-		dAssert(dCheckFloat(contactArray[i].m_point.m_y));
-		dAssert(dCheckFloat(contactArray[i].m_point.m_z));
-		dAssert(contactArray[i].m_body0);
-		dAssert(contactArray[i].m_body1);
-		dAssert(contactArray[i].m_shapeInstance0);
-		dAssert(contactArray[i].m_shapeInstance1);
-		dAssert(contactArray[i].m_body0 == body0);
-		dAssert(contactArray[i].m_body1 == body1);
-		contactPoint->m_point = contactArray[i].m_point;
-		contactPoint->m_normal = contactArray[i].m_normal;
-		contactPoint->m_penetration = contactArray[i].m_penetration;
-		contactPoint->m_body0 = contactArray[i].m_body0;
-		contactPoint->m_body1 = contactArray[i].m_body1;
-		contactPoint->m_shapeInstance0 = contactArray[i].m_shapeInstance0;
-		contactPoint->m_shapeInstance1 = contactArray[i].m_shapeInstance1;
-		contactPoint->m_shapeId0 = contactArray[i].m_shapeId0;
-		contactPoint->m_shapeId1 = contactArray[i].m_shapeId1;
+		ndContactMaterial* const contactPoint = &contactPointList[i];
 		contactPoint->m_material = contact->m_material;
-	
 		if (staticMotion) 
 		{
 			if (contactPoint->m_normal.DotProduct(controlNormal).GetScalar() > dFloat32(0.9995f)) 
@@ -1061,15 +1521,6 @@ void ndScene::ProcessContacts(dInt32 threadIndex, dInt32 contactCount, ndContact
 		dAssert(contactPoint->m_normal.m_w == dFloat32(0.0f));
 	}
 	
-	if (count) 
-	{
-		//dScopeSpinLock lock(m_contactLock);
-		for (dInt32 i = 0; i < count; i++) 
-		{
-			contactPointList.Remove(nodes[i]);
-		}
-	}
-	
 	contact->m_maxDOF = dUnsigned32(3 * contactPointList.GetCount());
 	m_contactNotifyCallback->OnContactCallback(threadIndex, contact, m_timestep);
 }
@@ -1080,6 +1531,7 @@ void ndScene::SubmitPairs(ndSceneNode* const leafNode, ndSceneNode* const node)
 	const dVector boxP0(body0 ? body0->m_minAabb : leafNode->m_minBox);
 	const dVector boxP1(body0 ? body0->m_maxAabb : leafNode->m_maxBox);
 	const bool test0 = body0 ? (body0->m_invMass.m_w != dFloat32(0.0f)) : true;
+	const bool sleeping0 = body0 ? (body0->m_equilibrium & body0->m_autoSleep) : false;
 
 	dInt32 stack = 1;
 	ndSceneNode* pool[D_SCENE_MAX_STACK_DEPTH];
@@ -1111,6 +1563,17 @@ void ndScene::SubmitPairs(ndSceneNode* const leafNode, ndSceneNode* const node)
 					}
 				}
 			}
+			else if (rootNode->GetAsSceneAggregate())
+			{
+				// a sleeping body can not start touching a sleeping group
+				const ndSceneAggregate* const aggregate = rootNode->GetAsSceneAggregate();
+				if (!(sleeping0 & aggregate->m_isSleeping))
+				{
+					pool[stack] = aggregate->m_root;
+					stack++;
+					dAssert(stack < dInt32(sizeof(pool) / sizeof(pool[0])));
+				}
+			}
 			else 
 			{
 				ndSceneTreeNode* const tmpNode = rootNode->GetAsSceneTreeNode();
@@ -1241,7 +1704,15 @@ void ndScene::AddPair(ndBodyKinematic* const body0, ndBodyKinematic* const body1
 		const bool isCollidable = bilateral ? bilateral->IsCollidable() : true;
 		if (isCollidable) 
 		{
-			m_contactList.CreateContact(body0, body1);
+			// which body finds the pair depends on the shape of the tree
+			if (m_deterministic && (body0->GetId() > body1->GetId()))
+			{
+				m_contactList.CreateContact(body1, body0);
+			}
+			else
+			{
+				m_contactList.CreateContact(body0, body1);
+			}
 		}
 	}
 }
@@ -1323,10 +1794,35 @@ void ndScene::BuildBodyArray()
 		ndBodyKinematic* m_buffer[D_LOCAL_POOL_SIZE];
 	};
 
+	class ndSortBodies
+	{
+		public:
+		static dInt32 Compare(ndBodyKinematic* const* const bodyA, ndBodyKinematic* const* const bodyB, void* const)
+		{
+			const dUnsigned32 idA = (*bodyA)->GetId();
+			const dUnsigned32 idB = (*bodyB)->GetId();
+			if (idA != idB)
+			{
+				return (idA < idB) ? -1 : 1;
+			}
+			return 0;
+		}
+	};
+
 	dAtomic<dUnsigned32> activeBodyCount(0);
 	m_activeBodyArray.SetCount(m_bodyList.GetCount());
 	SubmitJobs<ndBuildBodyArray>(&activeBodyCount);
 	m_activeBodyArray.SetCount(activeBodyCount);
+
+	if (m_deterministic && m_activeBodyArray.GetCount())
+	{
+		// the threads take slots in the order they finish
+		dSort(&m_activeBodyArray[0], m_activeBodyArray.GetCount(), ndSortBodies::Compare);
+		for (dInt32 i = 0; i < m_activeBodyArray.GetCount(); i++)
+		{
+			m_activeBodyArray[i]->PrepareStep(i);
+		}
+	}
 }
 
 void ndScene::CalculateContacts()
@@ -1351,7 +1847,47 @@ void ndScene::CalculateContacts()
 		}
 	};
 
+	const dInt32 contactCount = m_activeConstraintArray.GetCount();
+	if (m_deterministic)
+	{
+		m_contactActiveState.SetCount(contactCount);
+		for (dInt32 i = 0; i < contactCount; i++)
+		{
+			m_contactActiveState[i] = m_activeConstraintArray[i]->IsActive() ? 1 : 0;
+		}
+	}
+
+	memset(m_threadCacheCounters, 0, sizeof(m_threadCacheCounters));
 	SubmitJobs<ndCalculateContacts>();
+
+	if (m_deterministic)
+	{
+		for (dInt32 i = 0; i < contactCount; i++)
+		{
+			ndContact* const contact = m_activeConstraintArray[i]->GetAsContact();
+			if (m_contactActiveState[i] ^ (contact->IsActive() ? 1 : 0))
+			{
+				ndBodyKinematic* const body0 = contact->GetBody0();
+				ndBodyKinematic* const body1 = contact->GetBody1();
+				dAssert(body0->GetInvMass() > dFloat32(0.0f));
+				body0->m_equilibrium = false;
+				if (body1->GetInvMass() > dFloat32(0.0f))
+				{
+					body1->m_equilibrium = false;
+				}
+			}
+		}
+	}
+
+	m_contactCacheHits = 0;
+	m_contactCacheMisses = 0;
+	for (dInt32 i = 0; i < GetThreadCount(); i++)
+	{
+		m_contactCacheHits += m_threadCacheCounters[i].m_hits;
+		m_contactCacheMisses += m_threadCacheCounters[i].m_misses;
+	}
+
+	ProcessTriggerEvents();
 }
 
 void ndScene::UpdateAabb()
@@ -1375,24 +1911,34 @@ void ndScene::UpdateAabb()
 				{
 					m_owner->UpdateAabb(threadIndex, body);
 				}
+
+				// one awake member wakes the aggregate
+				ndSceneAggregate* const aggregate = body->GetSceneBodyNode()->m_aggregate;
+				if (aggregate && !(body->m_equilibrium & body->m_autoSleep))
+				{
+					aggregate->m_isSleeping.store(false);
+				}
 			}
 		}
 	};
 
+	for (dList<ndSceneAggregate*>::dNode* node = m_aggregateList.GetFirst(); node; node = node->GetNext())
+	{
+		node->GetInfo()->m_isSleeping.store(true);
+	}
 	SubmitJobs<ndUpdateAabbJob>();
 }
 
 void ndScene::FindCollidingPairs(ndBodyKinematic* const body)
 {
 	ndSceneBodyNode* const bodyNode = body->GetSceneBodyNode();
-	for (ndSceneNode* ptr = bodyNode; ptr->m_parent; ptr = ptr->m_parent)
+	for (ndSceneNode* ptr = GetPairSearchLeaf(bodyNode); ptr->m_parent; ptr = ptr->m_parent)
 	{
 		ndSceneTreeNode* const parent = ptr->m_parent->GetAsSceneTreeNode();
-		dAssert(!parent->GetAsSceneBodyNode());
-		ndSceneNode* const sibling = parent->m_right;
-		if (sibling != ptr)
+		dAssert(parent || ptr->m_parent->GetAsSceneAggregate());
+		if (parent && (parent->m_right != ptr))
 		{
-			SubmitPairs(bodyNode, sibling);
+			SubmitPairs(bodyNode, parent->m_right);
 		}
 	}
 }
@@ -1400,14 +1946,13 @@ void ndScene::FindCollidingPairs(ndBodyKinematic* const body)
 void ndScene::FindCollidingPairsForward(ndBodyKinematic* const body)
 {
 	ndSceneBodyNode* const bodyNode = body->GetSceneBodyNode();
-	for (ndSceneNode* ptr = bodyNode; ptr->m_parent; ptr = ptr->m_parent)
+	for (ndSceneNode* ptr = GetPairSearchLeaf(bodyNode); ptr->m_parent; ptr = ptr->m_parent)
 	{
 		ndSceneTreeNode* const parent = ptr->m_parent->GetAsSceneTreeNode();
-		dAssert(!parent->GetAsSceneBodyNode());
-		ndSceneNode* const sibling = parent->m_right;
-		if (sibling != ptr)
+		dAssert(parent || ptr->m_parent->GetAsSceneAggregate());
+		if (parent && (parent->m_right != ptr))
 		{
-			SubmitPairs(bodyNode, sibling);
+			SubmitPairs(bodyNode, parent->m_right);
 		}
 	}
 }
@@ -1415,14 +1960,13 @@ void ndScene::FindCollidingPairsForward(ndBodyKinematic* const body)
 void ndScene::FindCollidingPairsBackward(ndBodyKinematic* const body)
 {
 	ndSceneBodyNode* const bodyNode = body->GetSceneBodyNode();
-	for (ndSceneNode* ptr = bodyNode; ptr->m_parent; ptr = ptr->m_parent)
+	for (ndSceneNode* ptr = GetPairSearchLeaf(bodyNode); ptr->m_parent; ptr = ptr->m_parent)
 	{
 		ndSceneTreeNode* const parent = ptr->m_parent->GetAsSceneTreeNode();
-		dAssert(!parent->GetAsSceneBodyNode());
-		ndSceneNode* const sibling = parent->m_left;
-		if (sibling != ptr)
+		dAssert(parent || ptr->m_parent->GetAsSceneAggregate());
+		if (parent && (parent->m_left != ptr))
 		{
-			SubmitPairs(bodyNode, sibling);
+			SubmitPairs(bodyNode, parent->m_left);
 		}
 	}
 }
@@ -1547,11 +2091,19 @@ void ndScene::CalculateContacts(dInt32 threadIndex, ndContact* const contact)
 	ndBodyKinematic* const body1 = contact->GetBody1();
 
 	dAssert(!contact->m_isDead);
+	const dUnsigned32 wasOverlapping = contact->m_isIntersetionTestOnly;
 	if (!(body0->m_equilibrium & body1->m_equilibrium))
 	{
 		bool active = contact->IsActive();
 		if (ValidateContactCache(contact, deltaTime))
 		{
+			m_threadCacheCounters[threadIndex].m_hits++;
+			contact->m_sceneLru = m_lru;
+			contact->m_timeOfImpact = dFloat32(1.0e10f);
+		}
+		else if (active && contact->m_maxDOF && !contact->m_isIntersetionTestOnly && ValidateContactManifold(threadIndex, contact))
+		{
+			m_threadCacheCounters[threadIndex].m_hits++;
 			contact->m_sceneLru = m_lru;
 			contact->m_timeOfImpact = dFloat32(1.0e10f);
 		}
@@ -1583,6 +2135,7 @@ void ndScene::CalculateContacts(dInt32 threadIndex, ndContact* const contact)
 			}
 			if (distance < D_NARROW_PHASE_DIST)
 			{
+				m_threadCacheCounters[threadIndex].m_misses++;
 				CalculateJointContacts(threadIndex, contact);
 				if (contact->m_maxDOF || contact->m_isIntersetionTestOnly)
 				{
@@ -1606,7 +2159,9 @@ void ndScene::CalculateContacts(dInt32 threadIndex, ndContact* const contact)
 			}
 		}
 
-		if (active ^ contact->IsActive())
+		// in deterministic mode the bodies are woken after all contacts 
+		// are updated, so no contact sees the flags of another one.
+		if ((active ^ contact->IsActive()) && !m_deterministic)
 		{
 			dAssert(body0->GetInvMass() > dFloat32(0.0f));
 			body0->m_equilibrium = false;
@@ -1630,11 +2185,51 @@ void ndScene::CalculateContacts(dInt32 threadIndex, ndContact* const contact)
 			contact->m_isDead = 1;
 		}
 	}
+
+	if (contact->m_isDead)
+	{
+		contact->m_isIntersetionTestOnly = 0;
+	}
+
+	if (wasOverlapping | contact->m_isIntersetionTestOnly)
+	{
+		ndTriggerEvent::ndEventType type = ndTriggerEvent::m_stay;
+		if (!wasOverlapping)
+		{
+			type = ndTriggerEvent::m_enter;
+		}
+		else if (!contact->m_isIntersetionTestOnly)
+		{
+			type = ndTriggerEvent::m_exit;
+		}
+		AddTriggerEvent(threadIndex, contact, type);
+	}
 }
 
 void ndScene::BuildContactArray()
 {
 	D_TRACKTIME();
+	class ndSortContacts
+	{
+		public:
+		static dInt32 Compare(ndConstraint* const* const contactA, ndConstraint* const* const contactB, void* const)
+		{
+			const dUnsigned32 id0A = (*contactA)->GetBody0()->GetId();
+			const dUnsigned32 id0B = (*contactB)->GetBody0()->GetId();
+			if (id0A != id0B)
+			{
+				return (id0A < id0B) ? -1 : 1;
+			}
+			const dUnsigned32 id1A = (*contactA)->GetBody1()->GetId();
+			const dUnsigned32 id1B = (*contactB)->GetBody1()->GetId();
+			if (id1A != id1B)
+			{
+				return (id1A < id1B) ? -1 : 1;
+			}
+			return 0;
+		}
+	};
+
 	dInt32 count = 0;
 	m_activeConstraintArray.SetCount(m_contactList.GetCount());
 	for (ndContactList::dNode* node = m_contactList.GetFirst(); node; node = node->GetNext())
@@ -1643,13 +2238,14 @@ void ndScene::BuildContactArray()
 		dAssert(contact->m_isAttached);
 		m_activeConstraintArray[count] = contact;
 		count++;
-		ndBodyTriggerVolume* const trigger = contact->GetBody1()->GetAsBodyTriggerVolume();
-		if (trigger)
-		{
-			trigger->OnTrigger(contact->GetBody0(), m_timestep);
-		}
 	}
 	m_activeConstraintArray.SetCount(count);
+
+	if (m_deterministic && count)
+	{
+		// the contacts are appended in the order the threads find them
+		dSort(&m_activeConstraintArray[0], count, ndSortContacts::Compare);
+	}
 }
 
 void ndScene::DeleteDeadContact()
@@ -1707,25 +2303,7 @@ bool ndScene::ConvexCast(ndConvexCastNotify& callback, const ndSceneNode** stack
 					ndBodyKinematic* const kinBody = body->GetAsBodyKinematic();
 					if (castShape.CastShape(convexShape, globalOrigin, globalDest, kinBody->GetCollisionShape(), kinBody->GetMatrix()))
 					{
-						if ((castShape.m_param - callback.m_param) < dFloat32(-1.0e-3f))
-						{
-							callback.m_contacts.SetCount(0);
-						}
-
-						callback.m_param = castShape.m_param;
-						if ((castShape.m_contacts.GetCount() + callback.m_contacts.GetCount()) >= callback.m_contacts.GetCapacity())
-						{
-							dAssert(0);
-							//count = maxContacts - totalCount;
-						}
-
-						for (dInt32 i = castShape.m_contacts.GetCount() - 1; i >= 0; i--)
-						{
-							callback.m_contacts.PushBack(castShape.m_contacts[i]);
-						}
-						callback.m_normal = castShape.m_normal;
-						callback.m_closestPoint0 = castShape.m_closestPoint0;
-						callback.m_closestPoint1 = castShape.m_closestPoint1;
+						callback.MergeHit(castShape);
 					}
 					if (callback.m_param < dFloat32 (1.0e-8f)) 
 					{
@@ -1733,6 +2311,13 @@ bool ndScene::ConvexCast(ndConvexCastNotify& callback, const ndSceneNode** stack
 					}
 				}
 			}
+			else if (me->GetAsSceneAggregate())
+			{
+				// the private tree of the aggregate has the same bounding box
+				stackPool[stack] = me->GetAsSceneAggregate()->m_root;
+				stackDistance[stack] = dist;
+				stack++;
+			}
 			else 
 			{
 				{
@@ -1814,6 +2399,13 @@ bool ndScene::RayCast(ndRayCastNotify& callback, const ndSceneNode** stackPool,
 					}
 				}
 			}
+			else if (me->GetAsSceneAggregate())
+			{
+				// the private tree of the aggregate has the same bounding box
+				stackPool[stack] = me->GetAsSceneAggregate()->m_root;
+				stackDistance[stack] = dist;
+				stack++;
+			}
 			else
 			{
 				const ndSceneNode* const left = me->GetLeft();
@@ -1874,6 +2466,11 @@ void ndScene::BodiesInAabb(ndBodiesInAabbNotify& callback, const ndSceneNode** s
 				callback.m_bodyArray.PushBack(body);
 			}
 		}
+		else if (me->GetAsSceneAggregate())
+		{
+			stackPool[stack] = me->GetAsSceneAggregate()->m_root;
+			stack++;
+		}
 		else
 		{
 			const ndSceneNode* const left = me->GetLeft();
@@ -1901,6 +2498,10 @@ void ndScene::Cleanup()
 		RemoveBody(body);
 		delete body;
 	}
+	while (m_aggregateList.GetFirst())
+	{
+		DestroyAggregate(m_aggregateList.GetFirst()->GetInfo());
+	}
 	ndContact::FlushFreeList();
 	ndBodyList::FlushFreeList();
 	ndFitnessList::FlushFreeList();
@@ -1927,6 +2528,12 @@ void ndScene::AddNode(ndSceneNode* const newNode)
 }
 
 void ndScene::RemoveNode(ndSceneNode* const node)
+{
+	DetachNode(node);
+	delete node;
+}
+
+void ndScene::DetachNode(ndSceneNode* const node)
 {
 	if (node->m_parent)
 	{
@@ -1991,11 +2598,14 @@ void ndScene::RemoveNode(ndSceneNode* const node)
 		{
 			m_fitness.RemoveNode(parent);
 		}
+		parent->m_left = nullptr;
+		parent->m_right = nullptr;
+		node->m_parent = nullptr;
 		delete parent;
 	}
 	else
 	{
-		delete node;
+		dAssert(m_rootNode == node);
 		m_rootNode = nullptr;
 	}
 }
@@ -2053,6 +2663,268 @@ bool ndScene::ConvexCast(ndConvexCastNotify& callback, const ndShapeInstance& co
 	return state;
 }
 
+void ndScene::ConvexCastBatch(ndConvexCastQuery* const queries, dInt32 count)
+{
+	D_TRACKTIME();
+	class ndSweepInfo
+	{
+		public:
+		dVector m_minBox;
+		dVector m_maxBox;
+		dUnsigned32 m_key;
+		dInt32 m_index;
+	};
+
+	class ndSweepGroup
+	{
+		public:
+		dVector m_minBox;
+		dVector m_maxBox;
+		dInt32 m_start;
+		dInt32 m_count;
+	};
+
+	class ndConvexCastBatchContext
+	{
+		public:
+		ndConvexCastQuery* m_queries;
+		dArray<ndSweepInfo>* m_sweeps;
+		dArray<ndSweepGroup>* m_groups;
+		dAtomic<dInt32> m_groupIndex;
+	};
+
+	class ndConvexCastBatchJob : public ndBaseJob
+	{
+		public:
+		class ndCandidate
+		{
+			public:
+			const ndSceneNode* m_node;
+			dFloat32 m_dist;
+		};
+
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndConvexCastBatchContext* const context = (ndConvexCastBatchContext*)m_context;
+			const dArray<ndSweepGroup>& groups = *context->m_groups;
+			const dArray<ndSweepInfo>& sweeps = *context->m_sweeps;
+
+			// proxy bodies are build once per thread and reused by every cast in the batch. 
+			ndConvexCastContext castContext;
+			dArray<const ndSceneNode*> leafs(256);
+			dArray<ndCandidate> candidates(256);
+
+			for (dInt32 i = context->m_groupIndex.fetch_add(1); i < groups.GetCount(); i = context->m_groupIndex.fetch_add(1))
+			{
+				const ndSweepGroup& group = groups[i];
+
+				// one broadphase traversal for all the sweeps in the group
+				dInt32 stack = 1;
+				const ndSceneNode* stackPool[D_SCENE_MAX_STACK_DEPTH];
+				stackPool[0] = m_owner->m_rootNode;
+				leafs.SetCount(0);
+				while (stack)
+				{
+					stack--;
+					const ndSceneNode* const node = stackPool[stack];
+					if (dOverlapTest(node->m_minBox, node->m_maxBox, group.m_minBox, group.m_maxBox))
+					{
+						if (node->GetBody())
+						{
+							leafs.PushBack(node);
+						}
+						else if (node->GetAsSceneAggregate())
+						{
+							stackPool[stack] = node->GetAsSceneAggregate()->m_root;
+							stack++;
+						}
+						else
+						{
+							stackPool[stack] = node->GetLeft();
+							stack++;
+							stackPool[stack] = node->GetRight();
+							stack++;
+							dAssert(stack < D_SCENE_MAX_STACK_DEPTH);
+						}
+					}
+				}
+
+				for (dInt32 j = 0; j < group.m_count; j++)
+				{
+					const ndSweepInfo& sweep = sweeps[group.m_start + j];
+					ndConvexCastQuery& query = context->m_queries[sweep.m_index];
+					CastSweep(castContext, query, sweep, leafs, candidates);
+				}
+			}
+		}
+
+		void CastSweep(ndConvexCastContext& castContext, ndConvexCastQuery& query, const ndSweepInfo& sweep, const dArray<const ndSceneNode*>& leafs, dArray<ndCandidate>& candidates) const
+		{
+			ndConvexCastNotify& callback = *query.m_notify;
+			const ndShapeInstance& convexShape = *query.m_shape;
+
+			dVector boxP0;
+			dVector boxP1;
+			convexShape.CalculateAabb(query.m_origin, boxP0, boxP1);
+			const dVector velocA((query.m_dest - query.m_origin.m_posit) & dVector::m_triplexMask);
+			dFastRayTest ray(dVector::m_zero, velocA);
+
+			// sort the group candidates touched by this sweep by time of entry 
+			candidates.SetCount(0);
+			for (dInt32 i = 0; i < leafs.GetCount(); i++)
+			{
+				const ndSceneNode* const node = leafs[i];
+				if (dOverlapTest(node->m_minBox, node->m_maxBox, sweep.m_minBox, sweep.m_maxBox))
+				{
+					ndCandidate candidate;
+					candidate.m_node = node;
+					candidate.m_dist = ray.BoxIntersect(node->m_minBox - boxP1, node->m_maxBox - boxP0);
+					if (candidate.m_dist < dFloat32(1.0f))
+					{
+						dInt32 k = candidates.GetCount();
+						candidates.PushBack(candidate);
+						for (; k && (candidates[k - 1].m_dist > candidate.m_dist); k--)
+						{
+							candidates[k] = candidates[k - 1];
+						}
+						candidates[k] = candidate;
+					}
+				}
+			}
+
+			for (dInt32 i = 0; i < candidates.GetCount(); i++)
+			{
+				if (candidates[i].m_dist > callback.m_param)
+				{
+					break;
+				}
+				ndBodyKinematic* const body = candidates[i].m_node->GetBody();
+				if (callback.OnRayPrecastAction(body, &convexShape))
+				{
+					ndConvexCastNotify castShape;
+					if (castShape.CastShape(castContext, convexShape, query.m_origin, query.m_dest, body->GetCollisionShape(), body->GetMatrix()))
+					{
+						callback.MergeHit(castShape);
+					}
+					if (callback.m_param < dFloat32(1.0e-8f))
+					{
+						break;
+					}
+				}
+			}
+		}
+	};
+
+	class ndSortKey
+	{
+		public:
+		static dInt32 Compare(const ndSweepInfo* const A, const ndSweepInfo* const B, void* const)
+		{
+			if (A->m_key < B->m_key)
+			{
+				return -1;
+			}
+			else if (A->m_key > B->m_key)
+			{
+				return 1;
+			}
+			return A->m_index - B->m_index;
+		}
+
+		static dUnsigned32 SpreadBits(dUnsigned32 x)
+		{
+			x = (x | (x << 16)) & 0x030000FF;
+			x = (x | (x << 8)) & 0x0300F00F;
+			x = (x | (x << 4)) & 0x030C30C3;
+			x = (x | (x << 2)) & 0x09249249;
+			return x;
+		}
+	};
+
+	Sync();
+	// every query reports a miss, even when the scene is empty
+	for (dInt32 i = 0; i < count; i++)
+	{
+		dAssert(queries[i].m_notify);
+		queries[i].m_notify->m_contacts.SetCount(0);
+		queries[i].m_notify->m_param = dFloat32(1.2f);
+	}
+
+	if (!m_rootNode || !count)
+	{
+		return;
+	}
+
+	// calculate the swept box of each query 
+	dArray<ndSweepInfo> sweeps(count);
+	sweeps.SetCount(count);
+	dVector minP(dFloat32(1.0e15f));
+	dVector maxP(dFloat32(-1.0e15f));
+	for (dInt32 i = 0; i < count; i++)
+	{
+		const ndConvexCastQuery& query = queries[i];
+		dAssert(query.m_shape);
+		dAssert(query.m_notify);
+		dAssert(query.m_origin.TestOrthogonal());
+
+		dVector boxP0;
+		dVector boxP1;
+		query.m_shape->CalculateAabb(query.m_origin, boxP0, boxP1);
+		const dVector step((query.m_dest - query.m_origin.m_posit) & dVector::m_triplexMask);
+
+		ndSweepInfo& sweep = sweeps[i];
+		sweep.m_minBox = boxP0.GetMin(boxP0 + step);
+		sweep.m_maxBox = boxP1.GetMax(boxP1 + step);
+		sweep.m_index = i;
+
+		const dVector center(dVector::m_half * (sweep.m_minBox + sweep.m_maxBox));
+		minP = minP.GetMin(center);
+		maxP = maxP.GetMax(center);
+	}
+
+	// sort the sweeps along a morton curve so that consecutive entries are spatially close 
+	const dVector size((maxP - minP).GetMax(dVector(dFloat32(1.0e-3f))) & dVector::m_triplexMask);
+	const dVector scale(dVector(dFloat32(1023.0f)) * (size | dVector::m_wOne).Reciproc());
+	for (dInt32 i = 0; i < count; i++)
+	{
+		ndSweepInfo& sweep = sweeps[i];
+		const dVector center(dVector::m_half * (sweep.m_minBox + sweep.m_maxBox));
+		const dVector cell((center - minP) * scale);
+		const dUnsigned32 x = dUnsigned32(dClamp(dInt32(cell.m_x), 0, 1023));
+		const dUnsigned32 y = dUnsigned32(dClamp(dInt32(cell.m_y), 0, 1023));
+		const dUnsigned32 z = dUnsigned32(dClamp(dInt32(cell.m_z), 0, 1023));
+		sweep.m_key = ndSortKey::SpreadBits(x) | (ndSortKey::SpreadBits(y) << 1) | (ndSortKey::SpreadBits(z) << 2);
+	}
+	dSort(&sweeps[0], count, ndSortKey::Compare);
+
+	dArray<ndSweepGroup> groups(count / D_CONVEX_CAST_GROUP_SIZE + 1);
+	for (dInt32 i = 0; i < count; i += D_CONVEX_CAST_GROUP_SIZE)
+	{
+		ndSweepGroup group;
+		group.m_start = i;
+		group.m_count = dMin(count - i, D_CONVEX_CAST_GROUP_SIZE);
+		group.m_minBox = sweeps[i].m_minBox;
+		group.m_maxBox = sweeps[i].m_maxBox;
+		for (dInt32 j = 1; j < group.m_count; j++)
+		{
+			group.m_minBox = group.m_minBox.GetMin(sweeps[i + j].m_minBox);
+			group.m_maxBox = group.m_maxBox.GetMax(sweeps[i + j].m_maxBox);
+		}
+		groups.PushBack(group);
+	}
+
+	ndConvexCastBatchContext context;
+	context.m_queries = queries;
+	context.m_sweeps = &sweeps;
+	context.m_groups = &groups;
+	context.m_groupIndex.store(0);
+
+	Begin();
+	SubmitJobs<ndConvexCastBatchJob>(&context);
+	End();
+}
+
 void ndScene::BodiesInAabb(ndBodiesInAabbNotify& callback) const
 {
 	callback.m_bodyArray.SetCount(0);
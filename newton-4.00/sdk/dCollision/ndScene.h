@@ -26,6 +26,7 @@
 #include "ndBodyList.h"
 #include "ndSceneNode.h"
 #include "ndContactList.h"
+#include "ndBodyTriggerVolume.h"
 
 #define D_SCENE_MAX_STACK_DEPTH	256
 #define D_PRUNE_CONTACT_TOLERANCE		dFloat32 (5.0e-2f)
@@ -36,6 +37,7 @@ class ndContact;
 class ndRayCastNotify;
 class ndContactNotify;
 class ndConvexCastNotify;
+class ndConvexCastQuery;
 class ndBodiesInAabbNotify;
 class ndJointBilateralConstraint;
 
@@ -71,18 +73,13 @@ class ndScene
 
 	protected:
 	class ndSpliteInfo;
-	class ndFitnessList: public dList <ndSceneTreeNode*, dContainersFreeListAlloc<ndSceneTreeNode*>>
+	// each thread counts in its own cache line
+	class ndContactCacheCounters
 	{
 		public:
-		ndFitnessList();
-		dFloat64 TotalCost() const;
-
-		void AddNode(ndSceneTreeNode* const node);
-		void RemoveNode(ndSceneTreeNode* const node);
-		
-		dFloat64 m_currentCost;
-		dNode* m_currentNode;
-		dInt32 m_index;
+		dInt32 m_hits;
+		dInt32 m_misses;
+		dInt32 m_padding[14];
 	};
 
 	public:
@@ -106,9 +103,19 @@ class ndScene
 	dFloat32 GetTimestep() const;
 	void SetTimestep(dFloat32 timestep);
 
+	// the active bodies are sorted by id and the contacts by the ids of 
+	// their bodies, so the solver sees the same order with any thread count
+	bool IsDeterministic() const;
+	void SetDeterministic(bool state);
+
 	D_COLLISION_API virtual bool AddBody(ndBodyKinematic* const body);
 	D_COLLISION_API virtual bool RemoveBody(ndBodyKinematic* const body);
 
+	D_COLLISION_API ndSceneAggregate* CreateAggregate();
+	D_COLLISION_API void DestroyAggregate(ndSceneAggregate* const aggregate);
+	D_COLLISION_API bool AddToAggregate(ndSceneAggregate* const aggregate, ndBodyKinematic* const body);
+	D_COLLISION_API bool RemoveFromAggregate(ndSceneAggregate* const aggregate, ndBodyKinematic* const body);
+
 	D_COLLISION_API virtual void Cleanup();
 	D_COLLISION_API void Update(dFloat32 timestep);
 
@@ -117,12 +124,23 @@ class ndScene
 
 	D_COLLISION_API virtual void DebugScene(ndSceneTreeNotiFy* const notify);
 
+	dInt32 GetContactCacheHits() const;
+	dInt32 GetContactCacheMisses() const;
+	D_COLLISION_API dFloat32 GetContactCacheHitRate() const;
+
+	const dArray<ndTriggerEvent>& GetTriggerEvents() const;
+
 	D_COLLISION_API virtual void BodiesInAabb(ndBodiesInAabbNotify& callback) const;
 	D_COLLISION_API virtual bool RayCast(ndRayCastNotify& callback, const dVector& globalOrigin, const dVector& globalDest) const;
 	D_COLLISION_API virtual bool ConvexCast(ndConvexCastNotify& callback, const ndShapeInstance& convexShape, const dMatrix& globalOrigin, const dVector& globalDest) const;
+	// the queries run on the worker threads of the scene, so the notify callbacks,
+	// OnRayPrecastAction included, must be thread safe. each query needs its own notify
+	D_COLLISION_API virtual void ConvexCastBatch(ndConvexCastQuery* const queries, dInt32 count);
 
 	private:
 	bool ValidateContactCache(ndContact* const contact, const dVector& timestep) const;
+	bool ValidateContactManifold(dInt32 threadIndex, ndContact* const contact);
+	void AddManifoldPoint(ndContact* const contact, dFloat32 maxDrift);
 	dFloat32 CalculateSurfaceArea(const ndSceneNode* const node0, const ndSceneNode* const node1, dVector& minBox, dVector& maxBox) const;
 
 	D_COLLISION_API virtual void FindCollidingPairs(ndBodyKinematic* const body);
@@ -130,13 +148,23 @@ class ndScene
 	D_COLLISION_API virtual void FindCollidingPairsBackward(ndBodyKinematic* const body);
 	void AddNode(ndSceneNode* const newNode);
 	void RemoveNode(ndSceneNode* const newNode);
+	void DetachNode(ndSceneNode* const node);
+	void AddAggregateNode(ndSceneAggregate* const aggregate, ndSceneBodyNode* const node);
+	void RemoveAggregateNode(ndSceneBodyNode* const node);
+	void UpdateAggregateAabb(ndSceneAggregate* const aggregate, ndSceneNode* const node);
+	ndSceneNode* GetPairSearchLeaf(ndSceneBodyNode* const bodyNode) const;
 
 	D_COLLISION_API virtual void UpdateAabb(dInt32 threadIndex, ndBodyKinematic* const body);
+	D_COLLISION_API void UpdateParentsAabb(ndSceneNode* const node);
 	D_COLLISION_API virtual void UpdateTransformNotify(dInt32 threadIndex, ndBodyKinematic* const body);
 	D_COLLISION_API virtual void CalculateContacts(dInt32 threadIndex, ndContact* const contact);
 
 	void CalculateJointContacts(dInt32 threadIndex, ndContact* const contact);
+	void CalculateTriggerContacts(ndContact* const contact, ndContactSolver* const contactSolver);
+	void AddTriggerEvent(dInt32 threadIndex, ndContact* const contact, ndTriggerEvent::ndEventType type);
+	void DeleteContact(ndContact* const contact);
 	void ProcessContacts(dInt32 threadIndex, dInt32 contactCount, ndContactSolver* const contactSolver);
+	void UpdateContactMaterials(dInt32 threadIndex, ndContact* const contact);
 
 	void RotateLeft(ndSceneTreeNode* const node, ndSceneNode** const root);
 	void RotateRight(ndSceneTreeNode* const node, ndSceneNode** const root);
@@ -171,6 +199,7 @@ class ndScene
 	D_COLLISION_API void BuildContactArray();
 	D_COLLISION_API void CalculateContacts();
 	D_COLLISION_API void DeleteDeadContact();
+	D_COLLISION_API void ProcessTriggerEvents();
 	D_COLLISION_API void FindCollidingPairs();
 	D_COLLISION_API virtual void BalanceScene();
 	D_COLLISION_API virtual void ThreadFunction();
@@ -180,6 +209,10 @@ class ndScene
 	ndConstraintArray m_activeConstraintArray;
 	dArray<ndBodyKinematic*> m_sceneBodyArray;
 	dArray<ndBodyKinematic*> m_activeBodyArray;
+	dArray<dUnsigned8> m_contactActiveState;
+	dArray<ndTriggerEvent> m_triggerEvents;
+	dArray<ndTriggerEvent> m_threadTriggerEvents[D_MAX_THREADS_COUNT];
+	dList<ndSceneAggregate*> m_aggregateList;
 	dSpinLock m_contactLock;
 	ndSceneNode* m_rootNode;
 	ndContactNotify* m_contactNotifyCallback;
@@ -187,6 +220,10 @@ class ndScene
 	ndFitnessList m_fitness;
 	dFloat32 m_timestep;
 	dUnsigned32 m_lru;
+	dInt32 m_contactCacheHits;
+	dInt32 m_contactCacheMisses;
+	ndContactCacheCounters m_threadCacheCounters[D_MAX_THREADS_COUNT];
+	bool m_deterministic;
 
 	static dVector m_velocTol;
 	static dVector m_linearContactError2;
@@ -196,8 +233,14 @@ class ndScene
 	friend class ndRayCastNotify;
 	friend class ndConvexCastNotify;
 	friend class ndSkeletonContainer;
+	friend class ndWorldCheckpoint;
 } D_GCC_NEWTON_ALIGN_32 ;
 
+inline const dArray<ndTriggerEvent>& ndScene::GetTriggerEvents() const
+{
+	return m_triggerEvents;
+}
+
 inline void ndScene::Sync()
 {
 	dThreadPool::Sync();
@@ -239,6 +282,16 @@ inline const dArray<ndBodyKinematic*>& ndScene::GetActiveBodyArray() const
 	return m_activeBodyArray;
 }
 
+inline dInt32 ndScene::GetContactCacheHits() const
+{
+	return m_contactCacheHits;
+}
+
+inline dInt32 ndScene::GetContactCacheMisses() const
+{
+	return m_contactCacheMisses;
+}
+
 inline const ndContactList& ndScene::GetContactList() const
 {
 	return m_contactList;
@@ -247,18 +300,11 @@ inline const ndContactList& ndScene::GetContactList() const
 template <class T>
 void ndScene::SubmitJobs(void* const context)
 {
-	T extJob[D_MAX_THREADS_COUNT];
-	dThreadPoolJob* extJobPtr[D_MAX_THREADS_COUNT];
-
-	const dInt32 threadCount = GetThreadCount();
-	for (dInt32 i = 0; i < threadCount; i++)
-	{
-		extJob[i].m_owner = this;
-		extJob[i].m_context = context;
-		extJob[i].m_timestep = m_timestep;
-		extJobPtr[i] = &extJob[i];
-	}
-	ExecuteJobs(extJobPtr);
+	T job;
+	job.m_owner = this;
+	job.m_context = context;
+	job.m_timestep = m_timestep;
+	dThreadPool::SubmitJobs(job);
 }
 
 inline dFloat32 ndScene::GetTimestep() const
@@ -271,6 +317,16 @@ inline void ndScene::SetTimestep(dFloat32 timestep)
 	m_timestep = timestep;
 }
 
+inline bool ndScene::IsDeterministic() const
+{
+	return m_deterministic;
+}
+
+inline void ndScene::SetDeterministic(bool state)
+{
+	m_deterministic = state;
+}
+
 D_INLINE dFloat32 ndScene::CalculateSurfaceArea(const ndSceneNode* const node0, const ndSceneNode* const node1, dVector& minBox, dVector& maxBox) const
 {
 	minBox = node0->m_minBox.GetMin(node1->m_minBox);
@@ -34,6 +34,7 @@ dVector ndSceneNode::m_aabbInvQuantization(D_AABB_INV_QUANTIZATION, D_AABB_INV_Q
 ndSceneBodyNode::ndSceneBodyNode(ndBodyKinematic* const body)
 	:ndSceneNode(nullptr)
 	,m_body(body)
+	,m_aggregate(nullptr)
 {
 	SetAabb(body->m_minAabb, body->m_maxAabb);
 	m_body->SetSceneBodyNode(this);
@@ -44,6 +45,59 @@ ndSceneBodyNode::~ndSceneBodyNode()
 	m_body->SetSceneBodyNode(nullptr);
 }
 
+ndFitnessList::ndFitnessList()
+	:dList <ndSceneTreeNode*, dContainersFreeListAlloc<ndSceneTreeNode*>>()
+	,m_currentCost(dFloat32(0.0f))
+	,m_currentNode(nullptr)
+	,m_index(0)
+{
+}
+
+void ndFitnessList::AddNode(ndSceneTreeNode* const node)
+{
+	node->m_fitnessNode = Append(node);
+}
+
+void ndFitnessList::RemoveNode(ndSceneTreeNode* const node)
+{
+	dAssert(node->m_fitnessNode);
+	if (node->m_fitnessNode == m_currentNode)
+	{
+		m_currentNode = node->m_fitnessNode->GetNext();
+	}
+	Remove(node->m_fitnessNode);
+	node->m_fitnessNode = nullptr;
+}
+
+dFloat64 ndFitnessList::TotalCost() const
+{
+	D_TRACKTIME();
+	dFloat64 cost = dFloat32(0.0f);
+	for (dNode* node = GetFirst(); node; node = node->GetNext()) {
+		ndSceneNode* const box = node->GetInfo();
+		cost += box->m_surfaceArea;
+	}
+	return cost;
+}
+
+ndSceneAggregate::ndSceneAggregate()
+	:ndSceneNode(nullptr)
+	,m_root(nullptr)
+	,m_listNode(nullptr)
+	,m_fitness()
+	,m_treeEntropy(dFloat32(0.0f))
+	,m_count(0)
+	,m_isSleeping(false)
+	,m_selfCollision(false)
+{
+}
+
+ndSceneAggregate::~ndSceneAggregate()
+{
+	dAssert(!m_root);
+	dAssert(!m_count);
+}
+
 ndSceneTreeNode::ndSceneTreeNode(ndSceneNode* const sibling, ndSceneNode* const myNode)
 	:ndSceneNode(sibling->m_parent)
 	,m_left(sibling)
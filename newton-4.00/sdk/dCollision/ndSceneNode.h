@@ -27,6 +27,7 @@
 class ndBodyKinematic;
 class ndSceneBodyNode;
 class ndSceneTreeNode;
+class ndSceneAggregate;
 
 D_MSV_NEWTON_ALIGN_32
 class ndSceneNode: public dClassAlloc
@@ -52,6 +53,8 @@ class ndSceneNode: public dClassAlloc
 	virtual ndSceneNode* GetAsSceneNode() { return this; }
 	virtual ndSceneBodyNode* GetAsSceneBodyNode() { return nullptr; }
 	virtual ndSceneTreeNode* GetAsSceneTreeNode() { return nullptr; }
+	virtual ndSceneAggregate* GetAsSceneAggregate() { return nullptr; }
+	virtual const ndSceneAggregate* GetAsSceneAggregate() const { return nullptr; }
 
 	virtual ndBodyKinematic* GetBody() const
 	{
@@ -93,6 +96,7 @@ class ndSceneBodyNode: public ndSceneNode
 	}
 
 	ndBodyKinematic* m_body;
+	ndSceneAggregate* m_aggregate;
 } D_GCC_NEWTON_ALIGN_32 ;
 
 class ndSceneTreeNode: public ndSceneNode
@@ -118,6 +122,70 @@ class ndSceneTreeNode: public ndSceneNode
 	dList<ndSceneTreeNode*, dContainersFreeListAlloc<ndSceneTreeNode*>>::dNode* m_fitnessNode;
 } D_GCC_NEWTON_ALIGN_32;
 
+// the tree nodes of a scene tree, the fitness pass rotates them 
+// and reuses them when the tree is rebuilt
+class ndFitnessList: public dList <ndSceneTreeNode*, dContainersFreeListAlloc<ndSceneTreeNode*>>
+{
+	public:
+	ndFitnessList();
+	dFloat64 TotalCost() const;
+
+	void AddNode(ndSceneTreeNode* const node);
+	void RemoveNode(ndSceneTreeNode* const node);
+		
+	dFloat64 m_currentCost;
+	dNode* m_currentNode;
+	dInt32 m_index;
+};
+
+// a group of bodies, usually the parts of an articulated model, 
+// that occupies a single leaf of the scene tree. 
+// the member bodies are kept in a small private tree under the aggregate, 
+// the fitness pass balances the private tree of an awake aggregate.
+D_MSV_NEWTON_ALIGN_32
+class ndSceneAggregate: public ndSceneNode
+{
+	public:
+	D_COLLISION_API ndSceneAggregate();
+	D_COLLISION_API virtual ~ndSceneAggregate();
+
+	virtual ndSceneAggregate* GetAsSceneAggregate() { return this; }
+	virtual const ndSceneAggregate* GetAsSceneAggregate() const { return this; }
+
+	dInt32 GetCount() const;
+	bool IsSleeping() const;
+	bool GetSelfCollision() const;
+	void SetSelfCollision(bool state);
+
+	ndSceneNode* m_root;
+	dList<ndSceneAggregate*>::dNode* m_listNode;
+	ndFitnessList m_fitness;
+	dFloat64 m_treeEntropy;
+	dInt32 m_count;
+	dAtomic<bool> m_isSleeping;
+	bool m_selfCollision;
+} D_GCC_NEWTON_ALIGN_32;
+
+
+inline dInt32 ndSceneAggregate::GetCount() const
+{
+	return m_count;
+}
+
+inline bool ndSceneAggregate::IsSleeping() const
+{
+	return m_isSleeping;
+}
+
+inline bool ndSceneAggregate::GetSelfCollision() const
+{
+	return m_selfCollision;
+}
+
+inline void ndSceneAggregate::SetSelfCollision(bool state)
+{
+	m_selfCollision = state;
+}
 
 inline void ndSceneNode::GetAabb(dVector& minBox, dVector& maxBox) const
 {
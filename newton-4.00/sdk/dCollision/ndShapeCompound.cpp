@@ -170,6 +170,10 @@ void ndShapeCompound::ndTreeArray::AddNode(ndNodeBase* const node, dInt32 index,
 ndShapeCompound::ndShapeCompound()
 	:ndShape(m_compound)
 	,m_array()
+	,m_flatTree()
+	,m_flatShapes()
+	,m_quantizeOrigin(dVector::m_zero)
+	,m_quantizeScale(dVector::m_zero)
 	,m_treeEntropy(dFloat32(0.0f))
 	,m_boxMinRadius(dFloat32(0.0f))
 	,m_boxMaxRadius(dFloat32(0.0f))
@@ -182,6 +186,10 @@ ndShapeCompound::ndShapeCompound()
 ndShapeCompound::ndShapeCompound(const ndShapeCompound& source, const ndShapeInstance* const myInstance)
 	:ndShape(source)
 	,m_array()
+	,m_flatTree()
+	,m_flatShapes()
+	,m_quantizeOrigin(dVector::m_zero)
+	,m_quantizeScale(dVector::m_zero)
 	,m_treeEntropy(dFloat32(0.0f))
 	,m_boxMinRadius(dFloat32(0.0f))
 	,m_boxMaxRadius(dFloat32(0.0f))
@@ -276,11 +284,16 @@ ndShapeCompound::ndShapeCompound(const ndShapeCompound& source, const ndShapeIns
 			}
 		}
 	}
+	FlattenTree();
 }
 
 ndShapeCompound::ndShapeCompound(const nd::TiXmlNode* const xmlNode)
 	:ndShape(m_compound)
 	,m_array()
+	,m_flatTree()
+	,m_flatShapes()
+	,m_quantizeOrigin(dVector::m_zero)
+	,m_quantizeScale(dVector::m_zero)
 	,m_treeEntropy(dFloat32 (0.0f))
 	,m_boxMinRadius(dFloat32(0.0f))
 	,m_boxMaxRadius(dFloat32(0.0f))
@@ -447,20 +460,25 @@ dVector ndShapeCompound::CalculateVolumeIntegral(const dMatrix&, const dVector&,
 
 dFloat32 ndShapeCompound::RayCast(ndRayCastNotify& callback, const dVector& localP0, const dVector& localP1, dFloat32 maxT, const ndBody* const body, ndContactPoint& contactOut) const
 {
-	if (!m_root) 
+	const ndFlatNode* const root = GetFlatRoot();
+	if (!root) 
 	{
 		return dFloat32 (1.2f);
 	}
 
 	dFloat32 distance[D_COMPOUND_STACK_DEPTH];
-	const ndNodeBase* stackPool[D_COMPOUND_STACK_DEPTH];
+	const ndFlatNode* stackPool[D_COMPOUND_STACK_DEPTH];
 
 //	dFloat32 maxParam = maxT;
 	dFastRayTest ray (localP0, localP1);
 
+	dVector p0;
+	dVector p1;
+	GetFlatBox(root, p0, p1);
+
 	dInt32 stack = 1;
-	stackPool[0] = m_root;
-	distance[0] = ray.BoxIntersect(m_root->m_p0, m_root->m_p1);
+	stackPool[0] = root;
+	distance[0] = ray.BoxIntersect(p0, p1);
 	while (stack) 
 	{
 		stack --;
@@ -472,16 +490,16 @@ dFloat32 ndShapeCompound::RayCast(ndRayCastNotify& callback, const dVector& loca
 		} 
 		else 
 		{
-			const ndNodeBase* const me = stackPool[stack];
+			const ndFlatNode* const me = stackPool[stack];
 			dAssert (me);
-			if (me->m_type == m_leaf) 
+			if (me->IsLeaf()) 
 			{
 				ndContactPoint tmpContactOut;
-				ndShapeInstance* const shape = me->GetShape();
-				const dVector p0 (shape->GetLocalMatrix().UntransformVector (localP0) & dVector::m_triplexMask);
-				const dVector p1 (shape->GetLocalMatrix().UntransformVector (localP1) & dVector::m_triplexMask);
+				ndShapeInstance* const shape = GetFlatShape(me);
+				const dVector q0 (shape->GetLocalMatrix().UntransformVector (localP0) & dVector::m_triplexMask);
+				const dVector q1 (shape->GetLocalMatrix().UntransformVector (localP1) & dVector::m_triplexMask);
 				//dFloat32 param = shape->RayCast (p0, p1, maxT, tmpContactOut, preFilter, body, userData);
-				dFloat32 param = shape->RayCast(callback, p0, p1, body, tmpContactOut);
+				dFloat32 param = shape->RayCast(callback, q0, q1, body, tmpContactOut);
 				if (param < maxT) 
 				{
 					maxT = param;
@@ -494,10 +512,9 @@ dFloat32 ndShapeCompound::RayCast(ndRayCastNotify& callback, const dVector& loca
 			} 
 			else 
 			{
-				dAssert (me->m_type == m_node);
-				const ndNodeBase* const left = me->m_left;
-				dAssert (left);
-				dFloat32 dist1 = ray.BoxIntersect(left->m_p0, left->m_p1);
+				const ndFlatNode* const left = GetFlatLeft(me);
+				GetFlatBox(left, p0, p1);
+				dFloat32 dist1 = ray.BoxIntersect(p0, p1);
 				if (dist1 < maxT) 
 				{
 					dInt32 j = stack;
@@ -512,9 +529,9 @@ dFloat32 ndShapeCompound::RayCast(ndRayCastNotify& callback, const dVector& loca
 					dAssert (stack < dInt32 (sizeof (stackPool) / sizeof (stackPool[0])));
 				}
 				
-				const ndNodeBase* const right = me->m_right;
-				dAssert (right);
-				dist1 = ray.BoxIntersect(right->m_p0, right->m_p1);
+				const ndFlatNode* const right = GetFlatRight(me);
+				GetFlatBox(right, p0, p1);
+				dist1 = ray.BoxIntersect(p0, p1);
 				if (dist1 < maxT) 
 				{
 					dInt32 j = stack;
@@ -838,7 +855,15 @@ ndShapeCompound::ndNodeBase* ndShapeCompound::BuildTopDownBig(ndNodeBase** const
 
 void ndShapeCompound::EndAddRemove()
 {
-	if (m_root) 
+	if (!m_root)
+	{
+		m_boxMinRadius = dFloat32(0.0f);
+		m_boxMaxRadius = dFloat32(0.0f);
+		m_boxSize = dVector::m_zero;
+		m_boxOrigin = dVector::m_zero;
+		FlattenTree();
+	}
+	else
 	{
 		//dgScopeSpinLock lock(&m_criticalSectionLock);
 
@@ -878,6 +903,14 @@ void ndShapeCompound::EndAddRemove()
 		
 		if (nodeCount)
 		{
+			// nodes are in depth first order, refit the boxes bottom up 
+			// after sub shapes moved or were removed.
+			for (dInt32 i = nodeCount - 1; i >= 0; i--)
+			{
+				ndNodeBase* const node = nodeArray[i];
+				node->SetBox(node->m_left->m_p0.GetMin(node->m_right->m_p0), node->m_left->m_p1.GetMax(node->m_right->m_p1));
+			}
+
 			dFloat64 cost = CalculateEntropy(nodeCount, nodeArray);
 			if ((cost > m_treeEntropy * dFloat32(2.0f)) || (cost < m_treeEntropy * dFloat32(0.5f))) 
 			{
@@ -927,7 +960,99 @@ void ndShapeCompound::EndAddRemove()
 		m_boxSize = m_root->m_size;
 		m_boxOrigin = m_root->m_origin;
 		MassProperties();
+		FlattenTree();
+	}
+}
+
+void ndShapeCompound::QuantizeBox(ndFlatNode& flatNode, const dVector& p0, const dVector& p1) const
+{
+	for (dInt32 i = 0; i < 3; i++)
+	{
+		// round out, and step once more when the float error makes the decoded box smaller
+		const dFloat32 scale = m_quantizeScale[i];
+		const dFloat32 invScale = dFloat32(1.0f) / scale;
+		dInt32 q0 = dClamp(dInt32(dFloor((p0[i] - m_quantizeOrigin[i]) * invScale)), 0, 0xffff);
+		dInt32 q1 = dClamp(dInt32(dCeil((p1[i] - m_quantizeOrigin[i]) * invScale)), 0, 0xffff);
+		if ((q0 > 0) && ((m_quantizeOrigin[i] + dFloat32(q0) * scale) > p0[i]))
+		{
+			q0--;
+		}
+		if ((q1 < 0xffff) && ((m_quantizeOrigin[i] + dFloat32(q1) * scale) < p1[i]))
+		{
+			q1++;
+		}
+		flatNode.m_min[i] = dUnsigned16(q0);
+		flatNode.m_max[i] = dUnsigned16(q1);
+	}
+}
+
+void ndShapeCompound::FlattenTree()
+{
+	m_flatTree.SetCount(0);
+	m_flatShapes.SetCount(0);
+	if (!m_root)
+	{
+		return;
+	}
+
+	// pad the quantization box so that the ends of the range are never clamped
+	const dVector size(m_root->m_p1 - m_root->m_p0);
+	const dVector padding(size.Scale(dFloat32(1.0f / 1024.0f)) + dVector(dFloat32(1.0e-3f)));
+	const dVector p0((m_root->m_p0 - padding) & dVector::m_triplexMask);
+	const dVector p1((m_root->m_p1 + padding) & dVector::m_triplexMask);
+	m_quantizeOrigin = p0;
+	m_quantizeScale = ((p1 - p0).Scale(dFloat32(1.0f / 65535.0f))) & dVector::m_triplexMask;
+
+	const dInt32 leafCount = m_array.GetCount();
+	m_flatTree.SetCount(2 * leafCount - 1);
+	m_flatShapes.SetCount(leafCount);
+
+	// the right child is pushed first, so the left child is always the next node. 
+	// the right child patches the index of its parent when it is emitted
+	dInt32 stack = 1;
+	dInt32 nodeCount = 0;
+	dInt32 shapeCount = 0;
+	const ndNodeBase* stackPool[D_COMPOUND_STACK_DEPTH];
+	dInt32 parentIndex[D_COMPOUND_STACK_DEPTH];
+	stackPool[0] = m_root;
+	parentIndex[0] = -1;
+	while (stack)
+	{
+		stack--;
+		const ndNodeBase* const node = stackPool[stack];
+		const dInt32 parent = parentIndex[stack];
+		const dInt32 index = nodeCount;
+		nodeCount++;
+		dAssert(nodeCount <= m_flatTree.GetCount());
+
+		if (parent >= 0)
+		{
+			m_flatTree[parent].m_index = index;
+		}
+
+		ndFlatNode& flatNode = m_flatTree[index];
+		QuantizeBox(flatNode, node->m_p0, node->m_p1);
+		if (node->m_type == m_leaf)
+		{
+			m_flatShapes[shapeCount] = node->m_shape;
+			flatNode.m_index = -(shapeCount + 1);
+			shapeCount++;
+		}
+		else
+		{
+			stackPool[stack] = node->m_right;
+			parentIndex[stack] = index;
+			stack++;
+			dAssert(stack < D_COMPOUND_STACK_DEPTH);
+
+			stackPool[stack] = node->m_left;
+			parentIndex[stack] = -1;
+			stack++;
+			dAssert(stack < D_COMPOUND_STACK_DEPTH);
+		}
 	}
+	dAssert(shapeCount == leafCount);
+	dAssert(nodeCount == m_flatTree.GetCount());
 }
 
 ndShapeCompound::ndTreeArray::dNode* ndShapeCompound::AddCollision(ndShapeInstance* const subInstance)
@@ -1007,6 +1132,45 @@ ndShapeCompound::ndTreeArray::dNode* ndShapeCompound::AddCollision(ndShapeInstan
 	return newNode->m_myNode;
 }
 
+void ndShapeCompound::RemoveCollision(ndTreeArray::dNode* const node)
+{
+	// the sibling takes the place of the parent, the boxes of the ancestors 
+	// and the flat tree are updated by EndAddRemove
+	ndNodeBase* const treeNode = node->GetInfo();
+	dAssert(treeNode->m_type == m_leaf);
+	m_array.Remove(node);
+
+	ndNodeBase* const parent = treeNode->m_parent;
+	if (parent)
+	{
+		ndNodeBase* const sibling = (parent->m_left == treeNode) ? parent->m_right : parent->m_left;
+		ndNodeBase* const grandParent = parent->m_parent;
+		sibling->m_parent = grandParent;
+		if (!grandParent)
+		{
+			m_root = sibling;
+		}
+		else if (grandParent->m_left == parent)
+		{
+			grandParent->m_left = sibling;
+		}
+		else
+		{
+			dAssert(grandParent->m_right == parent);
+			grandParent->m_right = sibling;
+		}
+		parent->m_left = nullptr;
+		parent->m_right = nullptr;
+		delete parent;
+	}
+	else
+	{
+		dAssert(m_root == treeNode);
+		m_root = nullptr;
+	}
+	delete treeNode;
+}
+
 void ndShapeCompound::MassProperties()
 {
 #ifdef _DEBUG
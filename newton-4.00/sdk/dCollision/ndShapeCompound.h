@@ -25,6 +25,8 @@
 #include "ndCollisionStdafx.h"
 #include "ndShape.h"
 
+// the traversal stacks are small fixed arrays on the stack of the caller, 
+// not dThreadScratch slots, the child shape queries run while they are in use.
 #define D_COMPOUND_STACK_DEPTH	256
 
 class ndShapeCompound: public ndShape
@@ -37,6 +39,7 @@ class ndShapeCompound: public ndShape
 	};
 
 	class ndNodeBase;
+	class ndFlatNode;
 	class ndTreeArray : public dTree<ndNodeBase*, dInt32, dContainersFreeListAlloc<ndNodeBase*>>
 	{
 		public:
@@ -52,8 +55,16 @@ class ndShapeCompound: public ndShape
 
 	D_COLLISION_API virtual void BeginAddRemove();
 	D_COLLISION_API virtual ndTreeArray::dNode* AddCollision(ndShapeInstance* const part);
+	D_COLLISION_API virtual void RemoveCollision(ndTreeArray::dNode* const node);
 	D_COLLISION_API virtual void EndAddRemove();
 
+	const ndFlatNode* GetFlatRoot() const;
+	const ndFlatNode* GetFlatLeft(const ndFlatNode* const node) const;
+	const ndFlatNode* GetFlatRight(const ndFlatNode* const node) const;
+	ndShapeInstance* GetFlatShape(const ndFlatNode* const node) const;
+	void GetFlatBox(const ndFlatNode* const node, dVector& p0, dVector& p1) const;
+	void GetFlatObb(const ndFlatNode* const node, dVector& origin, dVector& size) const;
+
 	protected:
 	class ndSpliteInfo;
 	ndShapeCompound(const ndShapeCompound& source, const ndShapeInstance* const myInstance);
@@ -87,7 +98,14 @@ class ndShapeCompound: public ndShape
 	dMatrix CalculateInertiaAndCenterOfMass(const dMatrix& alignMatrix, const dVector& localScale, const dMatrix& matrix) const;
 	dFloat32 CalculateMassProperties(const dMatrix& offset, dVector& inertia, dVector& crossInertia, dVector& centerOfMass) const;
 
+	void FlattenTree();
+	void QuantizeBox(ndFlatNode& flatNode, const dVector& p0, const dVector& p1) const;
+
 	ndTreeArray m_array;
+	dArray<ndFlatNode> m_flatTree;
+	dArray<ndShapeInstance*> m_flatShapes;
+	dVector m_quantizeOrigin;
+	dVector m_quantizeScale;
 	dFloat64 m_treeEntropy;
 	dFloat32 m_boxMinRadius;
 	dFloat32 m_boxMaxRadius;
@@ -110,6 +128,62 @@ inline void ndShapeCompound::SetOwner(const ndShapeInstance* const instance)
 	m_myInstance = instance;
 }
 
+// the queries walk a copy of the tree flattened in depth first order, the left child 
+// of a node is the next node in the array and m_index is the index of the right child.
+// leaves have a negative m_index that encodes the sub shape index. bounds are 
+// quantized to 16 bits in the compound box, rounded out so they are never smaller.
+class ndShapeCompound::ndFlatNode
+{
+	public:
+	bool IsLeaf() const
+	{
+		return m_index < 0;
+	}
+
+	dUnsigned16 m_min[3];
+	dUnsigned16 m_max[3];
+	dInt32 m_index;
+};
+
+inline const ndShapeCompound::ndFlatNode* ndShapeCompound::GetFlatRoot() const
+{
+	return m_flatTree.GetCount() ? &m_flatTree[0] : nullptr;
+}
+
+inline const ndShapeCompound::ndFlatNode* ndShapeCompound::GetFlatLeft(const ndFlatNode* const node) const
+{
+	dAssert(!node->IsLeaf());
+	return node + 1;
+}
+
+inline const ndShapeCompound::ndFlatNode* ndShapeCompound::GetFlatRight(const ndFlatNode* const node) const
+{
+	dAssert(!node->IsLeaf());
+	return &m_flatTree[node->m_index];
+}
+
+inline ndShapeInstance* ndShapeCompound::GetFlatShape(const ndFlatNode* const node) const
+{
+	dAssert(node->IsLeaf());
+	return m_flatShapes[-node->m_index - 1];
+}
+
+inline void ndShapeCompound::GetFlatBox(const ndFlatNode* const node, dVector& p0, dVector& p1) const
+{
+	const dVector q0(dFloat32(node->m_min[0]), dFloat32(node->m_min[1]), dFloat32(node->m_min[2]), dFloat32(0.0f));
+	const dVector q1(dFloat32(node->m_max[0]), dFloat32(node->m_max[1]), dFloat32(node->m_max[2]), dFloat32(0.0f));
+	p0 = m_quantizeOrigin + q0 * m_quantizeScale;
+	p1 = m_quantizeOrigin + q1 * m_quantizeScale;
+}
+
+inline void ndShapeCompound::GetFlatObb(const ndFlatNode* const node, dVector& origin, dVector& size) const
+{
+	dVector p0;
+	dVector p1;
+	GetFlatBox(node, p0, p1);
+	size = dVector::m_half * (p1 - p0);
+	origin = dVector::m_half * (p1 + p0);
+}
 
 class ndShapeCompound::ndNodeBase: public dClassAlloc
 {
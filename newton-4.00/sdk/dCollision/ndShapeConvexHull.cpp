@@ -25,6 +25,8 @@
 #include "ndShapeConvexHull.h"
 
 #define D_CONVEX_VERTEX_SPLITE_SIZE	48
+#define D_CONVEX_HULL_COOKED_VERSION	1
+#define D_CONVEX_HULL_COOKED_ALIGNMENT	32
 
 D_MSV_NEWTON_ALIGN_32
 class ndShapeConvexHull::ndConvexBox
@@ -39,6 +41,35 @@ class ndShapeConvexHull::ndConvexBox
 	dInt32 m_rightBox;
 } D_GCC_NEWTON_ALIGN_32;
 
+// all offsets are in bytes from the start of the header, 
+// edges are saved as four indices: twin, next, prev and vertex
+class ndShapeConvexHull::ndCookedHeader
+{
+	public:
+	char m_magic[8];
+	dInt32 m_version;
+	dInt32 m_floatSize;
+	dInt32 m_vertexCount;
+	dInt32 m_edgeCount;
+	dInt32 m_faceCount;
+	dInt32 m_soaVertexCount;
+	dInt32 m_supportTreeCount;
+	dInt32 m_reserved;
+	dInt64 m_vertexOffset;
+	dInt64 m_edgeOffset;
+	dInt64 m_faceOffset;
+	dInt64 m_soaOffset;
+	dInt64 m_supportTreeOffset;
+	dInt64 m_size;
+};
+
+static const char ndConvexHullCookedMagic[8] = { 'n', 'd', 'H', 'u', 'l', 'l', 'C', 0 };
+
+static inline dInt64 ndConvexHullCookedAlign(dInt64 size)
+{
+	return (size + D_CONVEX_HULL_COOKED_ALIGNMENT - 1) & -D_CONVEX_HULL_COOKED_ALIGNMENT;
+}
+
 
 ndShapeConvexHull::ndShapeConvexHull (dInt32 count, dInt32 strideInBytes, dFloat32 tolerance, const dFloat32* const vertexArray)
 	:ndShapeConvex(m_convexHull)
@@ -83,6 +114,86 @@ ndShapeConvexHull::ndShapeConvexHull(const nd::TiXmlNode* const xmlNode)
 	Create(array.GetCount(), sizeof (dVector), &array[0].m_x, dFloat32 (0.0f));
 }
 
+ndShapeConvexHull::ndShapeConvexHull(const void* const cookedData)
+	:ndShapeConvex(m_convexHull)
+	,m_supportTree(nullptr)
+	,m_faceArray(nullptr)
+	,m_soa_x(nullptr)
+	,m_soa_y(nullptr)
+	,m_soa_z(nullptr)
+	,m_soa_index(nullptr)
+	,m_vertexToEdgeMapping(nullptr)
+	,m_faceCount(0)
+	,m_soaVertexCount(0)
+	,m_supportTreeCount(0)
+{
+	m_edgeCount = 0;
+	m_vertexCount = 0;
+	m_vertex = nullptr;
+	m_simplex = nullptr;
+
+	ndCookedHeader header;
+	const char* const ptr = (char*)cookedData;
+	memcpy(&header, ptr, sizeof(header));
+	if (!ValidateCookedData(cookedData, -1))
+	{
+		dAssert(0);
+		return;
+	}
+	if (!header.m_vertexCount)
+	{
+		// the points did not make a hull, same as the point constructor
+		return;
+	}
+
+	m_vertexCount = dUnsigned16(header.m_vertexCount);
+	m_edgeCount = dUnsigned16(header.m_edgeCount);
+	m_faceCount = header.m_faceCount;
+	m_soaVertexCount = header.m_soaVertexCount;
+	m_supportTreeCount = header.m_supportTreeCount;
+
+	m_vertex = (dVector*)dMemory::Malloc(dInt32(m_vertexCount * sizeof(dVector)));
+	m_simplex = (ndConvexSimplexEdge*)dMemory::Malloc(dInt32(m_edgeCount * sizeof(ndConvexSimplexEdge)));
+	m_vertexToEdgeMapping = (const ndConvexSimplexEdge**)dMemory::Malloc(dInt32(m_vertexCount * sizeof(ndConvexSimplexEdge*)));
+	m_faceArray = (ndConvexSimplexEdge **)dMemory::Malloc(dInt32(m_faceCount * sizeof(ndConvexSimplexEdge *)));
+	memcpy(m_vertex, &ptr[header.m_vertexOffset], m_vertexCount * sizeof(dVector));
+
+	const dInt32* const edges = (dInt32*)&ptr[header.m_edgeOffset];
+	for (dInt32 i = 0; i < m_edgeCount; i++)
+	{
+		ndConvexSimplexEdge* const edge = &m_simplex[i];
+		edge->m_twin = &m_simplex[edges[i * 4 + 0]];
+		edge->m_next = &m_simplex[edges[i * 4 + 1]];
+		edge->m_prev = &m_simplex[edges[i * 4 + 2]];
+		edge->m_vertex = edges[i * 4 + 3];
+		m_vertexToEdgeMapping[edge->m_vertex] = edge;
+	}
+
+	const dInt32* const faces = (dInt32*)&ptr[header.m_faceOffset];
+	for (dInt32 i = 0; i < m_faceCount; i++)
+	{
+		m_faceArray[i] = &m_simplex[faces[i]];
+	}
+
+	const dVector* const soa = (dVector*)&ptr[header.m_soaOffset];
+	m_soa_x = (dVector*)dMemory::Malloc(m_soaVertexCount * sizeof(dVector));
+	m_soa_y = (dVector*)dMemory::Malloc(m_soaVertexCount * sizeof(dVector));
+	m_soa_z = (dVector*)dMemory::Malloc(m_soaVertexCount * sizeof(dVector));
+	m_soa_index = (dVector*)dMemory::Malloc(m_soaVertexCount * sizeof(dVector));
+	memcpy(m_soa_x, &soa[m_soaVertexCount * 0], m_soaVertexCount * sizeof(dVector));
+	memcpy(m_soa_y, &soa[m_soaVertexCount * 1], m_soaVertexCount * sizeof(dVector));
+	memcpy(m_soa_z, &soa[m_soaVertexCount * 2], m_soaVertexCount * sizeof(dVector));
+	memcpy(m_soa_index, &soa[m_soaVertexCount * 3], m_soaVertexCount * sizeof(dVector));
+
+	if (m_supportTreeCount)
+	{
+		m_supportTree = (ndConvexBox*)dMemory::Malloc(dInt32(m_supportTreeCount * sizeof(ndConvexBox)));
+		memcpy(m_supportTree, &ptr[header.m_supportTreeOffset], m_supportTreeCount * sizeof(ndConvexBox));
+	}
+
+	SetVolumeAndCG();
+}
+
 ndShapeConvexHull::~ndShapeConvexHull()
 {
 	if (m_vertexToEdgeMapping) 
@@ -964,3 +1075,217 @@ D_COLLISION_API void ndShapeConvexHull::Save( nd::TiXmlElement* const xmlNode, c
 
 	xmlSaveParam(paramNode, "vextexArray3", m_vertexCount, m_vertex);
 }
+
+static inline bool ndConvexHullCookedSectionIsValid(dInt64 offset, dInt64 count, dInt64 itemSize, dInt64 start, dInt64 end)
+{
+	// a section starts after the header, is aligned and ends inside the buffer
+	if (!count)
+	{
+		return true;
+	}
+	if ((offset < start) || (offset > end) || (offset & (D_CONVEX_HULL_COOKED_ALIGNMENT - 1)))
+	{
+		return false;
+	}
+	return (count * itemSize) <= (end - offset);
+}
+
+bool ndShapeConvexHull::ValidateCookedData(const void* const cookedData, dInt64 size)
+{
+	ndCookedHeader header;
+	if ((size >= 0) && (size < dInt64(sizeof(header))))
+	{
+		return false;
+	}
+	memcpy(&header, cookedData, sizeof(header));
+	if (memcmp(header.m_magic, ndConvexHullCookedMagic, sizeof(ndConvexHullCookedMagic)) || 
+		(header.m_version != D_CONVEX_HULL_COOKED_VERSION) || 
+		(header.m_floatSize != sizeof(dFloat32)))
+	{
+		return false;
+	}
+	if ((header.m_vertexCount < 0) || (header.m_vertexCount > 0xffff) || (header.m_edgeCount < 0) || (header.m_edgeCount > 0xffff))
+	{
+		return false;
+	}
+	if ((header.m_size < dInt64(sizeof(header))) || ((size >= 0) && (header.m_size > size)))
+	{
+		return false;
+	}
+	if (!header.m_vertexCount)
+	{
+		// the loader does not read past the header of an empty hull
+		return true;
+	}
+
+	const dInt32 vertexCount = header.m_vertexCount;
+	const dInt32 edgeCount = header.m_edgeCount;
+	const dInt32 faceCount = header.m_faceCount;
+	const dInt32 soaCount = header.m_soaVertexCount;
+	const dInt32 treeCount = header.m_supportTreeCount;
+	if ((edgeCount < 6) || (faceCount < 4) || (faceCount > edgeCount) || (soaCount <= 0) || (soaCount > vertexCount) || (treeCount < 0) || (treeCount > vertexCount))
+	{
+		return false;
+	}
+
+	const dInt64 start = sizeof(header);
+	const dInt64 end = header.m_size;
+	if (!ndConvexHullCookedSectionIsValid(header.m_vertexOffset, vertexCount, sizeof(dVector), start, end) ||
+		!ndConvexHullCookedSectionIsValid(header.m_soaOffset, 4 * dInt64(soaCount), sizeof(dVector), start, end) ||
+		!ndConvexHullCookedSectionIsValid(header.m_supportTreeOffset, treeCount, sizeof(ndConvexBox), start, end) ||
+		!ndConvexHullCookedSectionIsValid(header.m_edgeOffset, 4 * dInt64(edgeCount), sizeof(dInt32), start, end) ||
+		!ndConvexHullCookedSectionIsValid(header.m_faceOffset, faceCount, sizeof(dInt32), start, end))
+	{
+		return false;
+	}
+
+	// the twin and next links must be consistent, that makes every face loop 
+	// close on itself, and every vertex needs an edge for the vertex to edge map
+	const char* const ptr = (const char*)cookedData;
+	const dInt32* const edges = (const dInt32*)&ptr[header.m_edgeOffset];
+	dStack<dInt8> vertexMarks(vertexCount);
+	memset(&vertexMarks[0], 0, size_t(vertexCount));
+	for (dInt32 i = 0; i < edgeCount; i++)
+	{
+		const dInt32 twin = edges[i * 4 + 0];
+		const dInt32 next = edges[i * 4 + 1];
+		const dInt32 prev = edges[i * 4 + 2];
+		const dInt32 vertex = edges[i * 4 + 3];
+		if ((twin < 0) || (twin >= edgeCount) || (next < 0) || (next >= edgeCount) || (prev < 0) || (prev >= edgeCount) || (vertex < 0) || (vertex >= vertexCount))
+		{
+			return false;
+		}
+		if ((edges[twin * 4 + 0] != i) || (edges[next * 4 + 2] != i) || (edges[prev * 4 + 1] != i))
+		{
+			return false;
+		}
+		vertexMarks[vertex] = 1;
+	}
+	for (dInt32 i = 0; i < vertexCount; i++)
+	{
+		if (!vertexMarks[i])
+		{
+			return false;
+		}
+	}
+
+	const dInt32* const faces = (const dInt32*)&ptr[header.m_faceOffset];
+	for (dInt32 i = 0; i < faceCount; i++)
+	{
+		if ((faces[i] < 0) || (faces[i] >= edgeCount))
+		{
+			return false;
+		}
+	}
+
+	// the support functions use the soa index lanes to read the vertex array
+	const dFloat32* const soaIndex = (const dFloat32*)&ptr[header.m_soaOffset + 3 * dInt64(soaCount) * dInt64(sizeof(dVector))];
+	for (dInt32 i = 0; i < soaCount * 4; i++)
+	{
+		const dFloat32 index = soaIndex[i];
+		if (!((index >= dFloat32(0.0f)) && (index < dFloat32(vertexCount)) && (index == dFloor(index))))
+		{
+			return false;
+		}
+	}
+
+	if (vertexCount <= D_CONVEX_VERTEX_SPLITE_SIZE)
+	{
+		// the brute force support reads the soa arrays two entries at the time
+		const dInt32 expectedCount = 2 * ((((vertexCount + 3) & -4) / 4 + 1) / 2);
+		return (soaCount == expectedCount) && !treeCount;
+	}
+
+	// children always come after their parent, so the tree has no cycles, 
+	// and the depth is bounded by the traversal stack of the support function
+	if (treeCount < 3)
+	{
+		return false;
+	}
+	const ndConvexBox* const boxes = (const ndConvexBox*)&ptr[header.m_supportTreeOffset];
+	dStack<dInt32> depth(treeCount);
+	memset(&depth[0], 0, size_t(treeCount) * sizeof(dInt32));
+	for (dInt32 i = 0; i < treeCount; i++)
+	{
+		const ndConvexBox& box = boxes[i];
+		if ((box.m_leftBox > 0) || !i)
+		{
+			if ((box.m_leftBox <= i) || (box.m_leftBox >= treeCount) || (box.m_rightBox <= i) || (box.m_rightBox >= treeCount))
+			{
+				return false;
+			}
+			const dInt32 childDepth = depth[i] + 1;
+			if (childDepth > 28)
+			{
+				return false;
+			}
+			depth[box.m_leftBox] = dMax(depth[box.m_leftBox], childDepth);
+			depth[box.m_rightBox] = dMax(depth[box.m_rightBox], childDepth);
+		}
+		else if ((box.m_soaVertexStart < 0) || (box.m_soaVertexCount < 0) || (box.m_soaVertexCount > soaCount - box.m_soaVertexStart))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+dInt64 ndShapeConvexHull::SerializeToBuffer(void* const buffer) const
+{
+	ndCookedHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.m_magic, ndConvexHullCookedMagic, sizeof(ndConvexHullCookedMagic));
+	header.m_version = D_CONVEX_HULL_COOKED_VERSION;
+	header.m_floatSize = sizeof(dFloat32);
+	header.m_vertexCount = m_vertexCount;
+	header.m_edgeCount = m_edgeCount;
+	header.m_faceCount = m_faceCount;
+	header.m_soaVertexCount = m_soaVertexCount;
+	header.m_supportTreeCount = m_supportTreeCount;
+
+	header.m_vertexOffset = ndConvexHullCookedAlign(sizeof(header));
+	header.m_soaOffset = ndConvexHullCookedAlign(header.m_vertexOffset + dInt64(sizeof(dVector)) * m_vertexCount);
+	header.m_supportTreeOffset = ndConvexHullCookedAlign(header.m_soaOffset + dInt64(sizeof(dVector)) * 4 * m_soaVertexCount);
+	header.m_edgeOffset = ndConvexHullCookedAlign(header.m_supportTreeOffset + dInt64(sizeof(ndConvexBox)) * m_supportTreeCount);
+	header.m_faceOffset = ndConvexHullCookedAlign(header.m_edgeOffset + dInt64(sizeof(dInt32)) * 4 * m_edgeCount);
+	header.m_size = ndConvexHullCookedAlign(header.m_faceOffset + dInt64(sizeof(dInt32)) * m_faceCount);
+
+	if (buffer)
+	{
+		char* const ptr = (char*)buffer;
+		memset(ptr, 0, size_t(header.m_size));
+		memcpy(ptr, &header, sizeof(header));
+		if (m_vertexCount)
+		{
+			memcpy(&ptr[header.m_vertexOffset], m_vertex, m_vertexCount * sizeof(dVector));
+
+			dVector* const soa = (dVector*)&ptr[header.m_soaOffset];
+			memcpy(&soa[m_soaVertexCount * 0], m_soa_x, m_soaVertexCount * sizeof(dVector));
+			memcpy(&soa[m_soaVertexCount * 1], m_soa_y, m_soaVertexCount * sizeof(dVector));
+			memcpy(&soa[m_soaVertexCount * 2], m_soa_z, m_soaVertexCount * sizeof(dVector));
+			memcpy(&soa[m_soaVertexCount * 3], m_soa_index, m_soaVertexCount * sizeof(dVector));
+
+			if (m_supportTreeCount)
+			{
+				memcpy(&ptr[header.m_supportTreeOffset], m_supportTree, m_supportTreeCount * sizeof(ndConvexBox));
+			}
+
+			dInt32* const edges = (dInt32*)&ptr[header.m_edgeOffset];
+			for (dInt32 i = 0; i < m_edgeCount; i++)
+			{
+				const ndConvexSimplexEdge* const edge = &m_simplex[i];
+				edges[i * 4 + 0] = dInt32(edge->m_twin - m_simplex);
+				edges[i * 4 + 1] = dInt32(edge->m_next - m_simplex);
+				edges[i * 4 + 2] = dInt32(edge->m_prev - m_simplex);
+				edges[i * 4 + 3] = edge->m_vertex;
+			}
+
+			dInt32* const faces = (dInt32*)&ptr[header.m_faceOffset];
+			for (dInt32 i = 0; i < m_faceCount; i++)
+			{
+				faces[i] = dInt32(m_faceArray[i] - m_simplex);
+			}
+		}
+	}
+	return header.m_size;
+}
@@ -30,12 +30,20 @@ D_MSV_NEWTON_ALIGN_32
 class ndShapeConvexHull : public ndShapeConvex
 {
 	class ndConvexBox;
+	class ndCookedHeader;
 
 	public:
 	D_COLLISION_API ndShapeConvexHull(const nd::TiXmlNode* const xmlNode);
 	D_COLLISION_API ndShapeConvexHull(dInt32 count, dInt32 strideInBytes, dFloat32 tolerance, const dFloat32* const vertexArray);
+	D_COLLISION_API ndShapeConvexHull(const void* const cookedData);
 	D_COLLISION_API virtual ~ndShapeConvexHull();
 
+	// write the finished hull, topology and support tree, to a buffer that can be
+	// loaded with the cooked data constructor without building the hull again.
+	// return the size in bytes, call with a null buffer to get the size.
+	D_COLLISION_API dInt64 SerializeToBuffer(void* const buffer) const;
+	D_COLLISION_API static bool ValidateCookedData(const void* const cookedData, dInt64 size);
+
 	protected:
 	ndShapeInfo GetShapeInfo() const;
 	dBigVector FaceNormal(const dEdge *face, const dBigVector* const pool) const;
@@ -0,0 +1,262 @@
+/* Copyright (c) <2003-2021> <Julio Jerez, Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "dCoreStdafx.h"
+#include "ndCollisionStdafx.h"
+#include "ndShapeConvexHullCache.h"
+
+#define D_CONVEX_HULL_CACHE_VERSION		1
+#define D_CONVEX_HULL_CACHE_ALIGNMENT	32
+
+static const char ndConvexHullCacheMagic[8] = { 'n', 'd', 'H', 'u', 'l', 'l', 'D', 'b' };
+
+// the file is the header, the entry table and the cooked images,
+// image offsets are in bytes from the start of the file.
+class ndShapeConvexHullCache::ndFileHeader
+{
+	public:
+	char m_magic[8];
+	dInt32 m_version;
+	dInt32 m_count;
+};
+
+class ndShapeConvexHullCache::ndFileEntry
+{
+	public:
+	dUnsigned64 m_key;
+	dInt64 m_offset;
+	dInt64 m_size;
+};
+
+static inline dInt64 ndConvexHullCacheAlign(dInt64 size)
+{
+	return (size + D_CONVEX_HULL_CACHE_ALIGNMENT - 1) & -D_CONVEX_HULL_CACHE_ALIGNMENT;
+}
+
+ndShapeConvexHullCache::ndShapeConvexHullCache()
+	:dClassAlloc()
+	,m_entries()
+	,m_files()
+	,m_lock()
+	,m_hitCount(0)
+	,m_missCount(0)
+{
+}
+
+ndShapeConvexHullCache::~ndShapeConvexHullCache()
+{
+	RemoveAll();
+}
+
+void ndShapeConvexHullCache::RemoveAll()
+{
+	dTree<ndEntry, dUnsigned64>::Iterator iter(m_entries);
+	for (iter.Begin(); iter; iter++)
+	{
+		const ndEntry& entry = iter.GetNode()->GetInfo();
+		if (entry.m_owned)
+		{
+			dMemory::Free((void*)entry.m_data);
+		}
+	}
+	m_entries.RemoveAll();
+
+	for (dInt32 i = 0; i < m_files.GetCount(); i++)
+	{
+		m_files[i]->Release();
+	}
+	m_files.SetCount(0);
+}
+
+dUnsigned64 ndShapeConvexHullCache::CalculateKey(dInt32 count, dInt32 strideInBytes, dFloat32 tolerance, const dFloat32* const vertexArray)
+{
+	dUnsigned64 key = dCRC64(&count, sizeof(count), 0);
+	key = dCRC64(&tolerance, sizeof(tolerance), key);
+
+	const dInt32 stride = dInt32(strideInBytes / sizeof(dFloat32));
+	for (dInt32 i = 0; i < count; i++)
+	{
+		// adding zero makes negative zeros positive, both make the same hull
+		const dFloat32 point[3] =
+		{
+			vertexArray[i * stride + 0] + dFloat32(0.0f),
+			vertexArray[i * stride + 1] + dFloat32(0.0f),
+			vertexArray[i * stride + 2] + dFloat32(0.0f)
+		};
+		key = dCRC64(point, sizeof(point), key);
+	}
+	return key;
+}
+
+ndShapeConvexHull* ndShapeConvexHullCache::CreateConvexHull(dInt32 count, dInt32 strideInBytes, dFloat32 tolerance, const dFloat32* const vertexArray)
+{
+	const dUnsigned64 key = CalculateKey(count, strideInBytes, tolerance, vertexArray);
+
+	// images are never removed while the cache is in use,
+	// so the pointer is good after the lock is released
+	m_lock.Lock();
+	dTree<ndEntry, dUnsigned64>::dNode* const node = m_entries.Find(key);
+	const void* const cookedData = node ? node->GetInfo().m_data : nullptr;
+	m_lock.Unlock();
+
+	if (cookedData)
+	{
+		m_hitCount.fetch_add(1);
+		return new ndShapeConvexHull(cookedData);
+	}
+
+	// build the hull outside the lock, if two threads build the same
+	// hull at the same time the first one to finish adds the image
+	m_missCount.fetch_add(1);
+	ndShapeConvexHull* const hull = new ndShapeConvexHull(count, strideInBytes, tolerance, vertexArray);
+
+	ndEntry entry;
+	entry.m_size = hull->SerializeToBuffer(nullptr);
+	entry.m_data = dMemory::Malloc(size_t(entry.m_size));
+	entry.m_owned = true;
+	hull->SerializeToBuffer((void*)entry.m_data);
+
+	m_lock.Lock();
+	bool wasFound = false;
+	m_entries.Insert(entry, key, wasFound);
+	m_lock.Unlock();
+	if (wasFound)
+	{
+		dMemory::Free((void*)entry.m_data);
+	}
+	return hull;
+}
+
+bool ndShapeConvexHullCache::Save(const char* const path) const
+{
+	FILE* const file = fopen(path, "wb");
+	if (!file)
+	{
+		return false;
+	}
+
+	m_lock.Lock();
+	ndFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.m_magic, ndConvexHullCacheMagic, sizeof(ndConvexHullCacheMagic));
+	header.m_version = D_CONVEX_HULL_CACHE_VERSION;
+	header.m_count = m_entries.GetCount();
+
+	dArray<ndFileEntry> table;
+	dInt64 offset = ndConvexHullCacheAlign(sizeof(header) + dInt64(sizeof(ndFileEntry)) * header.m_count);
+	dTree<ndEntry, dUnsigned64>::Iterator iter(m_entries);
+	for (iter.Begin(); iter; iter++)
+	{
+		ndFileEntry fileEntry;
+		fileEntry.m_key = iter.GetKey();
+		fileEntry.m_offset = offset;
+		fileEntry.m_size = iter.GetNode()->GetInfo().m_size;
+		table.PushBack(fileEntry);
+		offset = ndConvexHullCacheAlign(offset + fileEntry.m_size);
+	}
+
+	bool ret = fwrite(&header, sizeof(header), 1, file) == 1;
+	if (header.m_count)
+	{
+		ret = ret && (fwrite(&table[0], sizeof(ndFileEntry), size_t(header.m_count), file) == size_t(header.m_count));
+	}
+
+	char padding[D_CONVEX_HULL_CACHE_ALIGNMENT];
+	memset(padding, 0, sizeof(padding));
+	dInt64 position = sizeof(header) + dInt64(sizeof(ndFileEntry)) * header.m_count;
+	dInt32 index = 0;
+	for (iter.Begin(); ret && iter; iter++)
+	{
+		const ndFileEntry& fileEntry = table[index];
+		const size_t pad = size_t(fileEntry.m_offset - position);
+		ret = (pad == 0) || (fwrite(padding, 1, pad, file) == pad);
+		ret = ret && (fwrite(iter.GetNode()->GetInfo().m_data, size_t(fileEntry.m_size), 1, file) == 1);
+		position = fileEntry.m_offset + fileEntry.m_size;
+		index++;
+	}
+	m_lock.Unlock();
+
+	fclose(file);
+	return ret;
+}
+
+bool ndShapeConvexHullCache::Load(const char* const path)
+{
+	dMappedFile* const file = dMappedFile::Open(path);
+	if (!file)
+	{
+		return false;
+	}
+
+	const char* const ptr = (char*)file->GetData();
+	const dInt64 size = file->GetSize();
+
+	ndFileHeader header;
+	bool isValid = size >= dInt64(sizeof(header));
+	if (isValid)
+	{
+		memcpy(&header, ptr, sizeof(header));
+		isValid = !memcmp(header.m_magic, ndConvexHullCacheMagic, sizeof(ndConvexHullCacheMagic));
+		isValid = isValid && (header.m_version == D_CONVEX_HULL_CACHE_VERSION) && (header.m_count >= 0);
+		isValid = isValid && (size >= dInt64(sizeof(header)) + dInt64(sizeof(ndFileEntry)) * header.m_count);
+	}
+	if (!isValid)
+	{
+		dTrace(("%s is not a convex hull cache file\n", path));
+		file->Release();
+		return false;
+	}
+
+	dInt32 added = 0;
+	m_lock.Lock();
+	const ndFileEntry* const table = (ndFileEntry*)&ptr[sizeof(header)];
+	for (dInt32 i = 0; i < header.m_count; i++)
+	{
+		ndFileEntry fileEntry;
+		memcpy(&fileEntry, &table[i], sizeof(fileEntry));
+		if ((fileEntry.m_offset < 0) || (fileEntry.m_size < 0) || (fileEntry.m_offset + fileEntry.m_size > size))
+		{
+			continue;
+		}
+
+		ndEntry entry;
+		entry.m_data = &ptr[fileEntry.m_offset];
+		entry.m_size = fileEntry.m_size;
+		entry.m_owned = false;
+		if (ndShapeConvexHull::ValidateCookedData(entry.m_data, entry.m_size))
+		{
+			bool wasFound = false;
+			m_entries.Insert(entry, fileEntry.m_key, wasFound);
+			added += wasFound ? 0 : 1;
+		}
+	}
+
+	if (added)
+	{
+		m_files.PushBack(file);
+	}
+	else
+	{
+		file->Release();
+	}
+	m_lock.Unlock();
+	return true;
+}
@@ -0,0 +1,92 @@
+/* Copyright (c) <2003-2021> <Julio Jerez, Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef __D_SHAPE_CONVEXHULL_CACHE_H__
+#define __D_SHAPE_CONVEXHULL_CACHE_H__
+
+#include "ndCollisionStdafx.h"
+#include "ndShapeConvexHull.h"
+
+// building a convex hull runs the exact arithmetic hull, the coplanar edge
+// removal and the support tree. the cache keeps the cooked image of every hull
+// it builds keyed by a hash of the input points and tolerance, so the same input
+// makes a copy of the finished shape without doing the work again.
+// the cache can be saved to a file and loaded in a later session, the images
+// of a loaded cache are read in place from a memory mapping.
+class ndShapeConvexHullCache: public dClassAlloc
+{
+	public:
+	D_COLLISION_API ndShapeConvexHullCache();
+	D_COLLISION_API ~ndShapeConvexHullCache();
+
+	D_COLLISION_API static dUnsigned64 CalculateKey(dInt32 count, dInt32 strideInBytes, dFloat32 tolerance, const dFloat32* const vertexArray);
+
+	// return a hull made from the cached image, or build a new one and add
+	// its image to the cache. it can be called from many threads at once.
+	D_COLLISION_API ndShapeConvexHull* CreateConvexHull(dInt32 count, dInt32 strideInBytes, dFloat32 tolerance, const dFloat32* const vertexArray);
+
+	// add the entries of a cache file, entries already in the cache are kept
+	D_COLLISION_API bool Load(const char* const path);
+	D_COLLISION_API bool Save(const char* const path) const;
+
+	// not thread safe, no other thread can be using the cache
+	D_COLLISION_API void RemoveAll();
+
+	dInt32 GetCount() const;
+	dInt32 GetHitCount() const;
+	dInt32 GetMissCount() const;
+
+	private:
+	class ndEntry
+	{
+		public:
+		const void* m_data;
+		dInt64 m_size;
+		bool m_owned;
+	};
+
+	class ndFileHeader;
+	class ndFileEntry;
+
+	dTree<ndEntry, dUnsigned64> m_entries;
+	dArray<dMappedFile*> m_files;
+	mutable dSpinLock m_lock;
+	dAtomic<dInt32> m_hitCount;
+	dAtomic<dInt32> m_missCount;
+};
+
+inline dInt32 ndShapeConvexHullCache::GetCount() const
+{
+	return m_entries.GetCount();
+}
+
+inline dInt32 ndShapeConvexHullCache::GetHitCount() const
+{
+	return m_hitCount.load();
+}
+
+inline dInt32 ndShapeConvexHullCache::GetMissCount() const
+{
+	return m_missCount.load();
+}
+
+#endif
+
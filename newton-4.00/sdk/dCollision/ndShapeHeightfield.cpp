@@ -26,9 +26,9 @@
 #include "ndShapeInstance.h"
 #include "ndShapeHeightfield.h"
 
+dInt32 ndShapeHeightfield::m_vertexScratchSlot = dThreadScratch::AllocateSlot();
 dVector ndShapeHeightfield::m_yMask(0xffffffff, 0, 0xffffffff, 0);
 dVector ndShapeHeightfield::m_padding(dFloat32(0.25f), dFloat32(0.25f), dFloat32(0.25f), dFloat32(0.0f));
-dVector ndShapeHeightfield::m_elevationPadding(dFloat32(0.0f), dFloat32(1.0e10f), dFloat32(0.0f), dFloat32(0.0f));
 
 dInt32 ndShapeHeightfield::m_cellIndices[][4] =
 {
@@ -56,6 +56,7 @@ ndShapeHeightfield::ndShapeHeightfield(
 	,m_maxBox(dVector::m_zero)
 	,m_atributeMap(width * height)
 	,m_elevationMap(width * height)
+	,m_minMaxPyramid()
 	,m_verticalScale(verticalScale)
 	,m_horizontalScale_x(horizontalScale_x)
 	,m_horizontalScale_z(horizontalScale_z)
@@ -63,8 +64,8 @@ ndShapeHeightfield::ndShapeHeightfield(
 	,m_horizontalScaleInv_z(dFloat32(1.0f) / horizontalScale_z)
 	,m_width(width)
 	,m_height(height)
+	,m_pyramidLevels(0)
 	,m_diagonalMode(constructionMode)
-	,m_localData()
 {
 	dAssert(width >= 2);
 	dAssert(height >= 2);
@@ -74,9 +75,40 @@ ndShapeHeightfield::ndShapeHeightfield(
 	memset(&m_atributeMap[0], 0, sizeof(dInt8) * m_atributeMap.GetCount());
 	memset(&m_elevationMap[0], 0, sizeof(dInt16) * m_elevationMap.GetCount());
 
+	InitMinMaxPyramid();
 	CalculateAABB();
 }
 
+ndShapeHeightfield::ndShapeHeightfield(
+	dInt32 width, dInt32 height, ndGridConstruction constructionMode,
+	dFloat32 verticalScale, dFloat32 horizontalScale_x, dFloat32 horizontalScale_z,
+	dInt16 minElevation, dInt16 maxElevation)
+	:ndShapeStaticMesh(m_heightField)
+	,m_minBox(dVector::m_zero)
+	,m_maxBox(dVector::m_zero)
+	,m_atributeMap()
+	,m_elevationMap()
+	,m_minMaxPyramid()
+	,m_verticalScale(verticalScale)
+	,m_horizontalScale_x(horizontalScale_x)
+	,m_horizontalScale_z(horizontalScale_z)
+	,m_horizontalScaleInv_x(dFloat32(1.0f) / horizontalScale_x)
+	,m_horizontalScaleInv_z(dFloat32(1.0f) / horizontalScale_z)
+	,m_width(width)
+	,m_height(height)
+	,m_pyramidLevels(0)
+	,m_diagonalMode(constructionMode)
+{
+	dAssert(width >= 2);
+	dAssert(height >= 2);
+	const dFloat32 y0 = dFloat32(minElevation) * m_verticalScale;
+	const dFloat32 y1 = dFloat32(maxElevation) * m_verticalScale;
+	m_minBox = dVector(dFloat32(0.0f), dMin(y0, y1), dFloat32(0.0f), dFloat32(0.0f));
+	m_maxBox = dVector(dFloat32(m_width - 1) * m_horizontalScale_x, dMax(y0, y1), dFloat32(m_height - 1) * m_horizontalScale_z, dFloat32(0.0f));
+	m_boxSize = (m_maxBox - m_minBox) * dVector::m_half;
+	m_boxOrigin = (m_maxBox + m_minBox) * dVector::m_half;
+}
+
 //ndShapeHeightfield::ndShapeHeightfield(const nd::TiXmlNode* const xmlNode, const char* const assetPath)
 ndShapeHeightfield::ndShapeHeightfield(const nd::TiXmlNode* const, const char* const)
 	:ndShapeStaticMesh(m_heightField)
@@ -112,13 +144,10 @@ ndShapeInfo ndShapeHeightfield::GetShapeInfo() const
 
 void ndShapeHeightfield::CalculateAABB()
 {
-	dInt16 y0 = dInt16(0x7fff);
-	dInt16 y1 = dInt16 (-0x7fff);
-	for (dInt32 i = m_elevationMap.GetCount()-1; i >= 0; i--)
-	{
-		y0 = dMin(y0, m_elevationMap[i]);
-		y1 = dMax(y1, m_elevationMap[i]);
-	}
+	// the pyramid root covers all the cells
+	const ndMinMax bounds(GetNodeMinMax(m_pyramidLevels - 1, 0, 0));
+	const dInt16 y0 = bounds.m_min;
+	const dInt16 y1 = bounds.m_max;
 
 	m_minBox = dVector(dFloat32(dFloat32(0.0f)), dFloat32 (y0) * m_verticalScale, dFloat32(0.0f), dFloat32(0.0f));
 	m_maxBox = dVector(dFloat32(m_width-1) * m_horizontalScale_x, dFloat32(y1) * m_verticalScale, dFloat32(m_height-1) * m_horizontalScale_z, dFloat32(0.0f));
@@ -129,9 +158,106 @@ void ndShapeHeightfield::CalculateAABB()
 
 void ndShapeHeightfield::UpdateElevationMapAabb()
 {
+	dAssert(m_pyramidLevels);
+	UpdateMinMaxPyramid(0, 0, m_width - 2, m_height - 2);
+	CalculateAABB();
+}
+
+void ndShapeHeightfield::UpdateElevationMapAabb(dInt32 x0, dInt32 z0, dInt32 x1, dInt32 z1)
+{
+	dAssert(m_pyramidLevels);
+	// a vertex is shared by the four cells around it
+	const dInt32 cx0 = dClamp(dMin(x0, x1) - 1, 0, m_width - 2);
+	const dInt32 cz0 = dClamp(dMin(z0, z1) - 1, 0, m_height - 2);
+	const dInt32 cx1 = dClamp(dMax(x0, x1), 0, m_width - 2);
+	const dInt32 cz1 = dClamp(dMax(z0, z1), 0, m_height - 2);
+	UpdateMinMaxPyramid(cx0, cz0, cx1, cz1);
 	CalculateAABB();
 }
 
+void ndShapeHeightfield::InitMinMaxPyramid()
+{
+	dInt32 nodeCount = 0;
+	m_pyramidLevels = 1;
+	m_pyramidOffset[0] = 0;
+	while ((GetLevelWidth(m_pyramidLevels - 1) > 1) || (GetLevelHeight(m_pyramidLevels - 1) > 1))
+	{
+		dAssert(m_pyramidLevels < D_HEIGHTFIELD_MAX_LEVELS);
+		m_pyramidOffset[m_pyramidLevels] = nodeCount;
+		nodeCount += GetLevelWidth(m_pyramidLevels) * GetLevelHeight(m_pyramidLevels);
+		m_pyramidLevels++;
+	}
+	m_minMaxPyramid.SetCount(nodeCount);
+	UpdateMinMaxPyramid(0, 0, m_width - 2, m_height - 2);
+}
+
+void ndShapeHeightfield::UpdateMinMaxPyramid(dInt32 x0, dInt32 z0, dInt32 x1, dInt32 z1)
+{
+	// [x0, x1] x [z0, z1] is an inclusive rectangle of cells, 
+	// each level is refreshed from the four children of the level below
+	for (dInt32 level = 1; level < m_pyramidLevels; level++)
+	{
+		x0 = x0 >> 1;
+		z0 = z0 >> 1;
+		x1 = x1 >> 1;
+		z1 = z1 >> 1;
+		const dInt32 width = GetLevelWidth(level);
+		const dInt32 childWidth = GetLevelWidth(level - 1);
+		const dInt32 childHeight = GetLevelHeight(level - 1);
+		ndMinMax* const nodes = &m_minMaxPyramid[m_pyramidOffset[level]];
+		for (dInt32 z = z0; z <= z1; z++)
+		{
+			const dInt32 cz0 = z * 2;
+			const dInt32 cz1 = dMin(cz0 + 1, childHeight - 1);
+			for (dInt32 x = x0; x <= x1; x++)
+			{
+				const dInt32 cx0 = x * 2;
+				const dInt32 cx1 = dMin(cx0 + 1, childWidth - 1);
+				const ndMinMax n0(GetNodeMinMax(level - 1, cx0, cz0));
+				const ndMinMax n1(GetNodeMinMax(level - 1, cx1, cz0));
+				const ndMinMax n2(GetNodeMinMax(level - 1, cx0, cz1));
+				const ndMinMax n3(GetNodeMinMax(level - 1, cx1, cz1));
+
+				ndMinMax& node = nodes[z * width + x];
+				node.m_min = dMin(dMin(n0.m_min, n1.m_min), dMin(n2.m_min, n3.m_min));
+				node.m_max = dMax(dMax(n0.m_max, n1.m_max), dMax(n2.m_max, n3.m_max));
+			}
+		}
+	}
+}
+
+ndShapeHeightfield::ndMinMax ndShapeHeightfield::GetNodeMinMax(dInt32 level, dInt32 x, dInt32 z) const
+{
+	dAssert(x < GetLevelWidth(level));
+	dAssert(z < GetLevelHeight(level));
+	if (level)
+	{
+		return m_minMaxPyramid[m_pyramidOffset[level] + z * GetLevelWidth(level) + x];
+	}
+
+	const dInt32 base = z * m_width + x;
+	const dInt16 y0 = m_elevationMap[base];
+	const dInt16 y1 = m_elevationMap[base + 1];
+	const dInt16 y2 = m_elevationMap[base + m_width];
+	const dInt16 y3 = m_elevationMap[base + m_width + 1];
+
+	ndMinMax cell;
+	cell.m_min = dMin(dMin(y0, y1), dMin(y2, y3));
+	cell.m_max = dMax(dMax(y0, y1), dMax(y2, y3));
+	return cell;
+}
+
+void ndShapeHeightfield::GetNodeBox(dInt32 level, dInt32 x, dInt32 z, dVector& boxP0, dVector& boxP1) const
+{
+	const ndMinMax node(GetNodeMinMax(level, x, z));
+	const dFloat32 y0 = m_verticalScale * dFloat32(node.m_min);
+	const dFloat32 y1 = m_verticalScale * dFloat32(node.m_max);
+	const dInt32 x1 = dMin((x + 1) << level, m_width - 1);
+	const dInt32 z1 = dMin((z + 1) << level, m_height - 1);
+	boxP0 = dVector(dFloat32(x << level) * m_horizontalScale_x, dMin(y0, y1), dFloat32(z << level) * m_horizontalScale_z, dFloat32(0.0f)) - m_padding;
+	boxP1 = dVector(dFloat32(x1) * m_horizontalScale_x, dMax(y0, y1), dFloat32(z1) * m_horizontalScale_z, dFloat32(0.0f)) + m_padding;
+}
+
 const dInt32* ndShapeHeightfield::GetIndexList() const
 {
 	return &m_cellIndices[(m_diagonalMode == m_normalDiagonals) ? 0 : 1][0];
@@ -185,25 +311,6 @@ void ndShapeHeightfield::DebugShape(const dMatrix& matrix, ndShapeDebugCallback&
 	}
 }
 
-void ndShapeHeightfield::CalculateMinExtend2d(const dVector& p0, const dVector& p1, dVector& boxP0, dVector& boxP1) const
-{
-	const dVector scale(m_horizontalScale_x, dFloat32(0.0f), m_horizontalScale_z, dFloat32(0.0f));
-	const dVector q0(p0.GetMin(p1) - m_padding);
-	const dVector q1(p0.GetMax(p1) + scale + m_padding);
-
-	const dVector invScale(m_horizontalScaleInv_x, dFloat32(0.0f), m_horizontalScaleInv_z, dFloat32(0.0f));
-	boxP0 = (((q0 * invScale).Floor() * scale)         & m_yMask) - m_elevationPadding;
-	boxP1 = (((q1 * invScale).Floor() * scale + scale) & m_yMask) + m_elevationPadding;
-	dAssert(boxP0.m_w == dFloat32(0.0f));
-	dAssert(boxP1.m_w == dFloat32(0.0f));
-
-	const dVector minBox(boxP0.Select(m_minBox, m_yMask));
-	const dVector maxBox(boxP1.Select(m_maxBox, m_yMask));
-
-	boxP0 = boxP0.GetMax(minBox);
-	boxP1 = boxP1.GetMin(maxBox);
-}
-
 void ndShapeHeightfield::CalculateMinExtend3d(const dVector& p0, const dVector& p1, dVector& boxP0, dVector& boxP1) const
 {
 	dAssert(p0.m_x <= p1.m_x);
@@ -340,113 +447,103 @@ dFloat32 ndShapeHeightfield::RayCastCell(const dFastRayTest& ray, dInt32 xIndex0
 
 dFloat32 ndShapeHeightfield::RayCast(ndRayCastNotify&, const dVector& localP0, const dVector& localP1, dFloat32 maxT, const ndBody* const, ndContactPoint& contactOut) const
 {
+	class ndStackEntry
+	{
+		public:
+		dFloat32 m_dist;
+		dInt32 m_level;
+		dInt32 m_x;
+		dInt32 m_z;
+	};
+
 	dVector boxP0;
 	dVector boxP1;
-
-	// calculate the ray bounding box
-	CalculateMinExtend2d(localP0, localP1, boxP0, boxP1);
-
-	dVector p0(localP0);
-	dVector p1(localP1);
-	
-	// clip the line against the bounding box
-	if (dRayBoxClip(p0, p1, boxP0, boxP1)) 
+	const dFastRayTest ray(localP0, localP1);
+
+	// walk the min max pyramid front to back, skipping the nodes the ray 
+	// does not touch and the nodes farther than the closest hit so far
+	ndStackEntry stackPool[4 * D_HEIGHTFIELD_MAX_LEVELS];
+	stackPool[0].m_level = m_pyramidLevels - 1;
+	stackPool[0].m_x = 0;
+	stackPool[0].m_z = 0;
+	GetNodeBox(stackPool[0].m_level, 0, 0, boxP0, boxP1);
+	stackPool[0].m_dist = ray.BoxIntersect(boxP0, boxP1);
+
+	dInt32 hitCell = -1;
+	dVector normalOut(dVector::m_zero);
+	dInt32 stack = (stackPool[0].m_dist < maxT) ? 1 : 0;
+	while (stack)
 	{
-		dVector dp(p1 - p0);
-		dVector normalOut(dVector::m_zero);
-	
-		dFloat32 scale_x = m_horizontalScale_x;
-		dFloat32 invScale_x = m_horizontalScaleInv_x;
-		dFloat32 scale_z = m_horizontalScale_z;
-		dFloat32 invScale_z = m_horizontalScaleInv_z;
-		dInt32 ix0 = FastInt(p0.m_x * invScale_x);
-		dInt32 iz0 = FastInt(p0.m_z * invScale_z);
-	
-		// implement a 3ddda line algorithm 
-		dInt32 xInc;
-		dFloat32 tx;
-		dFloat32 stepX;
-		if (dp.m_x > dFloat32(0.0f)) 
-		{
-			xInc = 1;
-			dFloat32 val = dFloat32(1.0f) / dp.m_x;
-			stepX = scale_x * val;
-			tx = (scale_x * (ix0 + dFloat32(1.0f)) - p0.m_x) * val;
-		}
-		else if (dp.m_x < dFloat32(0.0f)) 
-		{
-			xInc = -1;
-			dFloat32 val = -dFloat32(1.0f) / dp.m_x;
-			stepX = scale_x * val;
-			tx = -(scale_x * ix0 - p0.m_x) * val;
-		}
-		else 
-		{
-			xInc = 0;
-			stepX = dFloat32(0.0f);
-			tx = dFloat32(1.0e10f);
-		}
-	
-		dInt32 zInc;
-		dFloat32 tz;
-		dFloat32 stepZ;
-		if (dp.m_z > dFloat32(0.0f)) 
-		{
-			zInc = 1;
-			dFloat32 val = dFloat32(1.0f) / dp.m_z;
-			stepZ = scale_z * val;
-			tz = (scale_z * (iz0 + dFloat32(1.0f)) - p0.m_z) * val;
-		}
-		else if (dp.m_z < dFloat32(0.0f)) 
+		stack--;
+		const ndStackEntry entry(stackPool[stack]);
+		if (entry.m_dist >= maxT)
 		{
-			zInc = -1;
-			dFloat32 val = -dFloat32(1.0f) / dp.m_z;
-			stepZ = scale_z * val;
-			tz = -(scale_z * iz0 - p0.m_z) * val;
+			continue;
 		}
-		else 
-		{
-			zInc = 0;
-			stepZ = dFloat32(0.0f);
-			tz = dFloat32(1.0e10f);
-		}
-	
-		dFloat32 txAcc = tx;
-		dFloat32 tzAcc = tz;
-		dInt32 xIndex0 = ix0;
-		dInt32 zIndex0 = iz0;
-		dFastRayTest ray(localP0, localP1);
-	
-		// for each cell touched by the line
-		do 
+
+		if (!entry.m_level)
 		{
-			dFloat32 t = RayCastCell(ray, xIndex0, zIndex0, normalOut, maxT);
-			if (t < maxT) 
+			dVector normal;
+			dFloat32 t = RayCastCell(ray, entry.m_x, entry.m_z, normal, maxT);
+			if (t < maxT)
 			{
-				// bail out at the first intersection and copy the data into the descriptor
-				dAssert(normalOut.m_w == dFloat32(0.0f));
-				contactOut.m_normal = normalOut.Normalize();
-				contactOut.m_shapeId0 = m_atributeMap[zIndex0 * m_width + xIndex0];
-				contactOut.m_shapeId1 = m_atributeMap[zIndex0 * m_width + xIndex0];
-	
-				return t;
+				maxT = t;
+				normalOut = normal;
+				hitCell = entry.m_z * m_width + entry.m_x;
 			}
-	
-			if (txAcc < tzAcc) 
+		}
+		else
+		{
+			const dInt32 level = entry.m_level - 1;
+			const dInt32 width = GetLevelWidth(level);
+			const dInt32 height = GetLevelHeight(level);
+
+			dInt32 count = 0;
+			ndStackEntry children[4];
+			for (dInt32 i = 0; i < 4; i++)
 			{
-				xIndex0 += xInc;
-				tx = txAcc;
-				txAcc += stepX;
+				const dInt32 x = entry.m_x * 2 + (i & 1);
+				const dInt32 z = entry.m_z * 2 + (i >> 1);
+				if ((x < width) && (z < height))
+				{
+					GetNodeBox(level, x, z, boxP0, boxP1);
+					dFloat32 dist = ray.BoxIntersect(boxP0, boxP1);
+					if (dist < maxT)
+					{
+						// keep the children sorted far to near so that the nearest is visited first
+						dInt32 j = count;
+						for (; j && (children[j - 1].m_dist < dist); j--)
+						{
+							children[j] = children[j - 1];
+						}
+						children[j].m_dist = dist;
+						children[j].m_level = level;
+						children[j].m_x = x;
+						children[j].m_z = z;
+						count++;
+					}
+				}
 			}
-			else 
+
+			for (dInt32 i = 0; i < count; i++)
 			{
-				zIndex0 += zInc;
-				tz = tzAcc;
-				tzAcc += stepZ;
+				stackPool[stack] = children[i];
+				stack++;
+				dAssert(stack < dInt32(sizeof(stackPool) / sizeof(stackPool[0])));
 			}
-		} while ((tx <= dFloat32(1.0f)) || (tz <= dFloat32(1.0f)));
+		}
 	}
-	
+
+	if (hitCell >= 0)
+	{
+		// copy the data of the closest hit into the descriptor
+		dAssert(normalOut.m_w == dFloat32(0.0f));
+		contactOut.m_normal = normalOut.Normalize();
+		contactOut.m_shapeId0 = m_atributeMap[hitCell];
+		contactOut.m_shapeId1 = m_atributeMap[hitCell];
+		return maxT;
+	}
+
 	// if no cell was hit, return a large value
 	return dFloat32(1.2f);
 }
@@ -490,20 +587,104 @@ void ndShapeHeightfield::CalculateMinAndMaxElevation(dInt32 x0, dInt32 x1, dInt3
 {
 	dInt16 minVal = 0x7fff;
 	dInt16 maxVal = -0x7fff;
+	if ((x1 > x0) && (z1 > z0))
+	{
+		// the vertex rectangle is the union of cells [x0, x1 - 1] x [z0, z1 - 1], 
+		// collect it from the largest pyramid nodes that are fully inside.
+		x1--;
+		z1--;
+		dInt32 stackPool[4 * D_HEIGHTFIELD_MAX_LEVELS][3];
+		stackPool[0][0] = m_pyramidLevels - 1;
+		stackPool[0][1] = 0;
+		stackPool[0][2] = 0;
+		dInt32 stack = 1;
+		while (stack)
+		{
+			stack--;
+			const dInt32 level = stackPool[stack][0];
+			const dInt32 x = stackPool[stack][1];
+			const dInt32 z = stackPool[stack][2];
+
+			const dInt32 nx0 = x << level;
+			const dInt32 nz0 = z << level;
+			const dInt32 nx1 = dMin(((x + 1) << level) - 1, m_width - 2);
+			const dInt32 nz1 = dMin(((z + 1) << level) - 1, m_height - 2);
+			if ((nx0 > x1) || (nx1 < x0) || (nz0 > z1) || (nz1 < z0))
+			{
+				continue;
+			}
+
+			if ((nx0 >= x0) && (nx1 <= x1) && (nz0 >= z0) && (nz1 <= z1))
+			{
+				const ndMinMax node(GetNodeMinMax(level, x, z));
+				minVal = dMin(node.m_min, minVal);
+				maxVal = dMax(node.m_max, maxVal);
+			}
+			else
+			{
+				dAssert(level);
+				const dInt32 width = GetLevelWidth(level - 1);
+				const dInt32 height = GetLevelHeight(level - 1);
+				for (dInt32 i = 0; i < 4; i++)
+				{
+					const dInt32 cx = x * 2 + (i & 1);
+					const dInt32 cz = z * 2 + (i >> 1);
+					if ((cx < width) && (cz < height))
+					{
+						stackPool[stack][0] = level - 1;
+						stackPool[stack][1] = cx;
+						stackPool[stack][2] = cz;
+						stack++;
+						dAssert(stack < dInt32(sizeof(stackPool) / sizeof(stackPool[0])));
+					}
+				}
+			}
+		}
+	}
+	else
+	{
+		// a row or a column of vertices, not worth going to the pyramid
+		dInt32 base = z0 * m_width;
+		for (dInt32 z = z0; z <= z1; z++) 
+		{
+			for (dInt32 x = x0; x <= x1; x++) 
+			{
+				dInt16 high = m_elevationMap[base + x];
+				minVal = dMin(high, minVal);
+				maxVal = dMax(high, maxVal);
+			}
+			base += m_width;
+		}
+	}
+
+	minHeight = minVal * m_verticalScale;
+	maxHeight = maxVal * m_verticalScale;
+}
+
+const dInt8* ndShapeHeightfield::GetElevationPatch(dInt32 x0, dInt32 x1, dInt32 z0, dInt32 z1, dVector*& vertexOut, dInt32& attributeStride) const
+{
+	// fill the grid of vertices [x0, x1] x [z0, z1] followed by the space for the face normals, 
+	// return the attribute of cell (x0, z0), rows of attributes are attributeStride apart.
+	const dInt32 vertexCount = (z1 - z0 + 1) * (x1 - x0 + 1) + 2 * (z1 - z0) * (x1 - x0);
+	dVector* const vertex = dThreadScratch::GetBuffer<dVector>(m_vertexScratchSlot, vertexCount);
+	vertexOut = vertex;
+
+	dInt32 vertexIndex = 0;
 	dInt32 base = z0 * m_width;
 	for (dInt32 z = z0; z <= z1; z++) 
 	{
+		dFloat32 zVal = m_horizontalScale_z * z;
 		for (dInt32 x = x0; x <= x1; x++) 
 		{
-			dInt16 high = m_elevationMap[base + x];
-			minVal = dMin(high, minVal);
-			maxVal = dMax(high, maxVal);
+			vertex[vertexIndex] = dVector(m_horizontalScale_x * x, m_verticalScale * dFloat32(m_elevationMap[base + x]), zVal, dFloat32(0.0f));
+			vertexIndex++;
+			dAssert(vertexIndex <= vertexCount);
 		}
 		base += m_width;
 	}
 
-	minHeight = minVal * m_verticalScale;
-	maxHeight = maxVal * m_verticalScale;
+	attributeStride = m_width;
+	return &m_atributeMap[z0 * m_width + x0];
 }
 
 void ndShapeHeightfield::GetCollidingFaces(ndPolygonMeshDesc* const data) const
@@ -541,42 +722,12 @@ void ndShapeHeightfield::GetCollidingFaces(ndPolygonMeshDesc* const data) const
 
 	if (!((maxHeight < boxP0.m_y) || (minHeight > boxP1.m_y))) 
 	{
-		std::thread::id threadId = std::this_thread::get_id();
-		dList<ndLocalThreadData>::dNode* localDataNode = nullptr;
-		for (dList<ndLocalThreadData>::dNode* node = m_localData.GetFirst(); node; node = node->GetNext())
-		{
-			if (node->GetInfo().m_threadId == threadId)
-			{
-				localDataNode = node;
-				break;
-			}
-		}
-
-		if (!localDataNode)
-		{
-			localDataNode = m_localData.Append();
-			localDataNode->GetInfo().m_threadId = threadId;
-		}
-
 		// scan the vertices's intersected by the box extend
-		dInt32 vertexCount = (z1 - z0 + 1) * (x1 - x0 + 1) + 2 * (z1 - z0) * (x1 - x0);
-		dArray<dVector>& vertex = localDataNode->GetInfo().m_vertex;
-		vertex.SetCount(vertexCount);
-	
-		dInt32 vertexIndex = 0;
-		dInt32 base = z0 * m_width;
-		for (dInt32 z = z0; z <= z1; z++) 
-		{
-			dFloat32 zVal = m_horizontalScale_z * z;
-			for (dInt32 x = x0; x <= x1; x++) 
-			{
-				vertex[vertexIndex] = dVector(m_horizontalScale_x * x, m_verticalScale * dFloat32(m_elevationMap[base + x]), zVal, dFloat32(0.0f));
-				vertexIndex++;
-				dAssert(vertexIndex <= vertex.GetCount());
-			}
-			base += m_width;
-		}
+		dVector* vertex = nullptr;
+		dInt32 attributeStride = 0;
+		const dInt8* const attributes = GetElevationPatch(x0, x1, z0, z1, vertex, attributeStride);
 
+		dInt32 vertexIndex = (z1 - z0 + 1) * (x1 - x0 + 1);
 		dInt32 normalBase = vertexIndex;
 		vertexIndex = 0;
 		dInt32 index = 0;
@@ -589,7 +740,7 @@ void ndShapeHeightfield::GetCollidingFaces(ndPolygonMeshDesc* const data) const
 		const dInt32* const indirectIndex = GetIndexList();
 		for (dInt32 z = z0; (z < z1) && (faceCount < D_MAX_COLLIDING_FACES); z++) 
 		{
-			dInt32 zStep = z * m_width;
+			const dInt8* const zAttributes = &attributes[(z - z0) * attributeStride - x0];
 			for (dInt32 x = x0; (x < x1) && (faceCount < D_MAX_COLLIDING_FACES); x++) 
 			{
 				dInt32 vIndex[4];
@@ -624,7 +775,7 @@ void ndShapeHeightfield::GetCollidingFaces(ndPolygonMeshDesc* const data) const
 				indices[index + 0 + 0] = i2;
 				indices[index + 0 + 1] = i1;
 				indices[index + 0 + 2] = i0;
-				indices[index + 0 + 3] = m_atributeMap[zStep + x];
+				indices[index + 0 + 3] = zAttributes[x];
 				indices[index + 0 + 4] = normalIndex0;
 				indices[index + 0 + 5] = normalIndex0;
 				indices[index + 0 + 6] = normalIndex0;
@@ -635,7 +786,7 @@ void ndShapeHeightfield::GetCollidingFaces(ndPolygonMeshDesc* const data) const
 				indices[index + 9 + 0] = i1;
 				indices[index + 9 + 1] = i2;
 				indices[index + 9 + 2] = i3;
-				indices[index + 9 + 3] = m_atributeMap[zStep + x];
+				indices[index + 9 + 3] = zAttributes[x];
 				indices[index + 9 + 4] = normalIndex1;
 				indices[index + 9 + 5] = normalIndex1;
 				indices[index + 9 + 6] = normalIndex1;
@@ -25,6 +25,8 @@
 #include "ndCollisionStdafx.h"
 #include "ndShapeStaticMesh.h"
 
+#define D_HEIGHTFIELD_MAX_LEVELS	32
+
 class ndShapeHeightfield: public ndShapeStaticMesh
 {
 	public:
@@ -45,41 +47,60 @@ class ndShapeHeightfield: public ndShapeStaticMesh
 	const dArray<dInt16>& GetElevationMap() const;
 	D_COLLISION_API void UpdateElevationMapAabb();
 
-	void GetLocalAabb(const dVector& p0, const dVector& p1, dVector& boxP0, dVector& boxP1) const;
+	// only refresh the bounds of the cells touching the vertices in the rectangle [x0, x1] x [z0, z1]
+	D_COLLISION_API void UpdateElevationMapAabb(dInt32 x0, dInt32 z0, dInt32 x1, dInt32 z1);
+
+	virtual void GetLocalAabb(const dVector& p0, const dVector& p1, dVector& boxP0, dVector& boxP1) const;
 
 	protected:
+	// for shapes that keep the elevation data somewhere else, only the bounding box is initialized
+	D_COLLISION_API ndShapeHeightfield(
+		dInt32 width, dInt32 height, ndGridConstruction contructionMode,
+		dFloat32 verticalScale, dFloat32 horizontalScale_x, dFloat32 horizontalScale_z,
+		dInt16 minElevation, dInt16 maxElevation);
+
 	virtual ndShapeInfo GetShapeInfo() const;
 	virtual ndShapeHeightfield* GetAsShapeHeightfield() { return this; }
 	virtual void DebugShape(const dMatrix& matrix, ndShapeDebugCallback& debugCallback) const;
 	virtual dFloat32 RayCast(ndRayCastNotify& callback, const dVector& localP0, const dVector& localP1, dFloat32 maxT, const ndBody* const body, ndContactPoint& contactOut) const;
+
+	// the vertices of the faces are in a per thread scratch buffer, the output 
+	// must be consumed before the same thread runs the next height field query.
 	virtual void GetCollidingFaces(ndPolygonMeshDesc* const data) const;
 	virtual void Save(nd::TiXmlElement* const xmlNode, const char* const assetPath, dInt32 nodeid) const;
 
+	virtual const dInt8* GetElevationPatch(dInt32 x0, dInt32 x1, dInt32 z0, dInt32 z1, dVector*& vertexOut, dInt32& attributeStride) const;
+	virtual void CalculateMinAndMaxElevation(dInt32 x0, dInt32 x1, dInt32 z0, dInt32 z1, dFloat32& minHeight, dFloat32& maxHeight) const;
+
 	private: 
-	class ndLocalThreadData
+
+	// elevation bounds of a block of cells, level 0 are the cells them self and are
+	// read directly from the elevation map, level n node covers 2^n x 2^n cells
+	class ndMinMax
 	{
 		public:
-		ndLocalThreadData()
-			:m_threadId()
-		{
-		}
-
-		dArray<dVector> m_vertex;
-		std::thread::id m_threadId;
+		dInt16 m_min;
+		dInt16 m_max;
 	};
 
 	void CalculateAABB();
 	dInt32 FastInt(dFloat32 x) const;
 	const dInt32* GetIndexList() const;
-	void CalculateMinExtend2d(const dVector& p0, const dVector& p1, dVector& boxP0, dVector& boxP1) const;
 	void CalculateMinExtend3d(const dVector& p0, const dVector& p1, dVector& boxP0, dVector& boxP1) const;
 	dFloat32 RayCastCell(const dFastRayTest& ray, dInt32 xIndex0, dInt32 zIndex0, dVector& normalOut, dFloat32 maxT) const;
-	void CalculateMinAndMaxElevation(dInt32 x0, dInt32 x1, dInt32 z0, dInt32 z1, dFloat32& minHeight, dFloat32& maxHeight) const;
+
+	void InitMinMaxPyramid();
+	void UpdateMinMaxPyramid(dInt32 x0, dInt32 z0, dInt32 x1, dInt32 z1);
+	ndMinMax GetNodeMinMax(dInt32 level, dInt32 x, dInt32 z) const;
+	void GetNodeBox(dInt32 level, dInt32 x, dInt32 z, dVector& boxP0, dVector& boxP1) const;
+	dInt32 GetLevelWidth(dInt32 level) const;
+	dInt32 GetLevelHeight(dInt32 level) const;
 
 	dVector m_minBox;
 	dVector m_maxBox;
 	dArray<dInt8> m_atributeMap;
 	dArray<dInt16> m_elevationMap;
+	dArray<ndMinMax> m_minMaxPyramid;
 	dFloat32 m_verticalScale;
 	dFloat32 m_horizontalScale_x;
 	dFloat32 m_horizontalScale_z;
@@ -87,16 +108,18 @@ class ndShapeHeightfield: public ndShapeStaticMesh
 	dFloat32 m_horizontalScaleInv_z;
 	dInt32 m_width;
 	dInt32 m_height;
+	dInt32 m_pyramidLevels;
+	dInt32 m_pyramidOffset[D_HEIGHTFIELD_MAX_LEVELS];
 	ndGridConstruction m_diagonalMode;
-	mutable dList<ndLocalThreadData> m_localData;
 
+	static dInt32 m_vertexScratchSlot;
 	static dVector m_yMask;
 	static dVector m_padding;
-	static dVector m_elevationPadding;
 	static dInt32 m_cellIndices[][4];
 	static dInt32 m_verticalEdgeMap[][7];
 	static dInt32 m_horizontalEdgeMap[][7];
 	friend class ndContactSolver;
+	friend class ndShapeHeightfieldTiled;
 };
 
 inline dArray<dInt16>& ndShapeHeightfield::GetElevationMap()
@@ -109,6 +132,16 @@ inline const dArray<dInt16>& ndShapeHeightfield::GetElevationMap() const
 	return m_elevationMap;
 }
 
+inline dInt32 ndShapeHeightfield::GetLevelWidth(dInt32 level) const
+{
+	return ((m_width - 2) >> level) + 1;
+}
+
+inline dInt32 ndShapeHeightfield::GetLevelHeight(dInt32 level) const
+{
+	return ((m_height - 2) >> level) + 1;
+}
+
 inline dInt32 ndShapeHeightfield::FastInt(dFloat32 x) const
 {
 	dInt32 i = dInt32(x);
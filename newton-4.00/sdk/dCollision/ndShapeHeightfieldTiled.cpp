@@ -0,0 +1,648 @@
+/* Copyright (c) <2003-2021> <Julio Jerez, Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "dCoreStdafx.h"
+#include "ndCollisionStdafx.h"
+#include "ndContact.h"
+#include "ndBodyList.h"
+#include "ndBodyKinematic.h"
+#include "ndShapeInstance.h"
+#include "ndShapeHeightfieldTiled.h"
+
+#define D_HEIGHTFIELD_FILE_MAGIC	"ndhfield"
+
+dInt32 ndShapeHeightfieldTiled::m_attributeScratchSlot = dThreadScratch::AllocateSlot();
+
+ndShapeHeightfieldTiled::ndMappedFileSource::ndMappedFileSource(dMappedFile* const file)
+	:ndTileSource()
+	,m_file(file)
+	,m_header((ndHeader*)file->GetData())
+	,m_elevation((dInt16*)(m_header + 1))
+	,m_attributes((dInt8*)(m_elevation + m_header->m_width * m_header->m_height))
+{
+}
+
+ndShapeHeightfieldTiled::ndMappedFileSource::~ndMappedFileSource()
+{
+	m_file->Release();
+}
+
+ndShapeHeightfieldTiled::ndMappedFileSource* ndShapeHeightfieldTiled::ndMappedFileSource::Open(const char* const path)
+{
+	dMappedFile* const file = dMappedFile::Open(path);
+	if (!file)
+	{
+		return nullptr;
+	}
+
+	const ndHeader* const header = (ndHeader*)file->GetData();
+	bool isValid = file->GetSize() >= dInt64(sizeof(ndHeader));
+	isValid = isValid && !memcmp(header->m_magic, D_HEIGHTFIELD_FILE_MAGIC, sizeof(header->m_magic));
+	isValid = isValid && (header->m_width >= 2) && (header->m_height >= 2);
+	isValid = isValid && (file->GetSize() >= dInt64(sizeof(ndHeader)) + dInt64(header->m_width) * header->m_height * (sizeof(dInt16) + sizeof(dInt8)));
+	if (!isValid)
+	{
+		dTrace(("%s is not a height field file\n", path));
+		file->Release();
+		return nullptr;
+	}
+	return new ndMappedFileSource(file);
+}
+
+bool ndShapeHeightfieldTiled::ndMappedFileSource::Save(const char* const path, dInt32 width, dInt32 height, const dInt16* const elevation, const dInt8* const attributes)
+{
+	FILE* const file = fopen(path, "wb");
+	if (!file)
+	{
+		return false;
+	}
+
+	ndHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.m_magic, D_HEIGHTFIELD_FILE_MAGIC, sizeof(header.m_magic));
+	header.m_width = width;
+	header.m_height = height;
+	header.m_minElevation = dInt16(0x7fff);
+	header.m_maxElevation = dInt16(-0x7fff);
+	const dInt32 count = width * height;
+	for (dInt32 i = 0; i < count; i++)
+	{
+		header.m_minElevation = dMin(header.m_minElevation, elevation[i]);
+		header.m_maxElevation = dMax(header.m_maxElevation, elevation[i]);
+	}
+
+	bool ret = fwrite(&header, sizeof(header), 1, file) == 1;
+	ret = ret && (fwrite(elevation, sizeof(dInt16), size_t(count), file) == size_t(count));
+	if (attributes)
+	{
+		ret = ret && (fwrite(attributes, sizeof(dInt8), size_t(count), file) == size_t(count));
+	}
+	else
+	{
+		dInt8 zeros[1024];
+		memset(zeros, 0, sizeof(zeros));
+		for (dInt32 i = 0; ret && (i < count); i += dInt32(sizeof(zeros)))
+		{
+			const size_t size = size_t(dMin(count - i, dInt32(sizeof(zeros))));
+			ret = fwrite(zeros, sizeof(dInt8), size, file) == size;
+		}
+	}
+	fclose(file);
+	return ret;
+}
+
+bool ndShapeHeightfieldTiled::ndMappedFileSource::LoadRegion(dInt32 x0, dInt32 z0, dInt32 width, dInt32 height, dInt16* const elevation, dInt8* const attributes)
+{
+	if ((x0 < 0) || (z0 < 0) || ((x0 + width) > m_header->m_width) || ((z0 + height) > m_header->m_height))
+	{
+		return false;
+	}
+
+	for (dInt32 z = 0; z < height; z++)
+	{
+		const dInt64 base = dInt64(z0 + z) * m_header->m_width + x0;
+		memcpy(&elevation[z * width], &m_elevation[base], width * sizeof(dInt16));
+		memcpy(&attributes[z * width], &m_attributes[base], width * sizeof(dInt8));
+	}
+	return true;
+}
+
+void ndShapeHeightfieldTiled::ndMappedFileSource::GetElevationRange(dInt16& minElevation, dInt16& maxElevation) const
+{
+	minElevation = m_header->m_minElevation;
+	maxElevation = m_header->m_maxElevation;
+}
+
+ndShapeHeightfieldTiled::ndTileLoader::ndTileLoader(ndShapeHeightfieldTiled* const owner)
+	:dThread()
+	,m_owner(owner)
+	,m_requests()
+	,m_loaded()
+	,m_lock()
+{
+	SetName("heightfieldLoader");
+}
+
+ndShapeHeightfieldTiled::ndTileLoader::~ndTileLoader()
+{
+	Finish();
+	for (dList<ndLoadedTile>::dNode* node = m_loaded.GetFirst(); node; node = node->GetNext())
+	{
+		node->GetInfo().m_tile->Release();
+	}
+}
+
+void ndShapeHeightfieldTiled::ndTileLoader::Request(dInt32 index)
+{
+	{
+		dScopeSpinLock lock(m_lock);
+		m_requests.Append(index);
+	}
+	Signal();
+}
+
+void ndShapeHeightfieldTiled::ndTileLoader::ThreadFunction()
+{
+	D_TRACKTIME();
+	dInt32 index = -1;
+	{
+		dScopeSpinLock lock(m_lock);
+		dList<dInt32>::dNode* const node = m_requests.GetFirst();
+		if (node)
+		{
+			index = node->GetInfo();
+			m_requests.Remove(node);
+		}
+	}
+
+	// the tile may had been loaded by a collision thread in the mean time
+	if ((index >= 0) && !m_owner->m_slots[index].m_tile.load())
+	{
+		ndLoadedTile loaded;
+		loaded.m_index = index;
+		loaded.m_tile = m_owner->LoadTile(index);
+
+		dScopeSpinLock lock(m_lock);
+		m_loaded.Append(loaded);
+	}
+}
+
+ndShapeHeightfieldTiled::ndShapeHeightfieldTiled(
+	ndTileSource* const source, dInt32 width, dInt32 height, dInt32 tileSize,
+	ndGridConstruction constructionMode, dFloat32 verticalScale,
+	dFloat32 horizontalScale_x, dFloat32 horizontalScale_z, dInt64 memoryBudget)
+	:ndShapeHeightfield(width, height, constructionMode, verticalScale, horizontalScale_x, horizontalScale_z, dInt16(0), dInt16(0))
+	,m_source(source)
+	,m_slots(nullptr)
+	,m_loader(nullptr)
+	,m_loadLock()
+	,m_residentMemory(0)
+	,m_residentCount(0)
+	,m_stallsCount(0)
+	,m_memoryBudget(memoryBudget)
+	,m_tileSize(tileSize)
+	,m_tilesCount_x((width - 2) / tileSize + 1)
+	,m_tilesCount_z((height - 2) / tileSize + 1)
+	,m_frame(1)
+{
+	dAssert(tileSize >= 1);
+
+	// the bounding box comes from the source since tiles are not loaded yet
+	dInt16 minElevation;
+	dInt16 maxElevation;
+	m_source->GetElevationRange(minElevation, maxElevation);
+	const dFloat32 y0 = dFloat32(minElevation) * m_verticalScale;
+	const dFloat32 y1 = dFloat32(maxElevation) * m_verticalScale;
+	m_minBox.m_y = dMin(y0, y1);
+	m_maxBox.m_y = dMax(y0, y1);
+	m_boxSize = (m_maxBox - m_minBox) * dVector::m_half;
+	m_boxOrigin = (m_maxBox + m_minBox) * dVector::m_half;
+
+	m_slots = new ndTileSlot[m_tilesCount_x * m_tilesCount_z];
+	m_loader = new ndTileLoader(this);
+}
+
+ndShapeHeightfieldTiled::~ndShapeHeightfieldTiled()
+{
+	delete m_loader;
+	for (dInt32 i = m_tilesCount_x * m_tilesCount_z - 1; i >= 0; i--)
+	{
+		ndShapeHeightfield* const tile = m_slots[i].m_tile.load();
+		if (tile)
+		{
+			tile->Release();
+		}
+	}
+	delete[] m_slots;
+	delete m_source;
+}
+
+ndShapeInfo ndShapeHeightfieldTiled::GetShapeInfo() const
+{
+	ndShapeInfo info(ndShapeStaticMesh::GetShapeInfo());
+
+	info.m_heightfield.m_width = m_width;
+	info.m_heightfield.m_height = m_height;
+	info.m_heightfield.m_gridsDiagonals = m_diagonalMode;
+	info.m_heightfield.m_verticalScale = m_verticalScale;
+	info.m_heightfield.m_horizonalScale_x = m_horizontalScale_x;
+	info.m_heightfield.m_horizonalScale_z = m_horizontalScale_z;
+	info.m_heightfield.m_elevation = nullptr;
+	info.m_heightfield.m_atributes = nullptr;
+
+	return info;
+}
+
+//void ndShapeHeightfieldTiled::Save(nd::TiXmlElement* const xmlNode, const char* const assetPath, dInt32 nodeid) const
+void ndShapeHeightfieldTiled::Save(nd::TiXmlElement* const, const char* const, dInt32) const
+{
+	dAssert(0);
+}
+
+dInt64 ndShapeHeightfieldTiled::CalculateTileMemory(const ndShapeHeightfield* const tile)
+{
+	dInt64 memory = sizeof(ndShapeHeightfield);
+	memory += tile->m_elevationMap.GetCapacity() * sizeof(dInt16);
+	memory += tile->m_atributeMap.GetCapacity() * sizeof(dInt8);
+	memory += tile->m_minMaxPyramid.GetCapacity() * sizeof(ndMinMax);
+	return memory;
+}
+
+dVector ndShapeHeightfieldTiled::GetTileOrigin(dInt32 tileX, dInt32 tileZ) const
+{
+	return dVector(dFloat32(tileX * m_tileSize) * m_horizontalScale_x, dFloat32(0.0f), dFloat32(tileZ * m_tileSize) * m_horizontalScale_z, dFloat32(0.0f));
+}
+
+void ndShapeHeightfieldTiled::GetTileRange(dInt32 x0, dInt32 x1, dInt32& tile0, dInt32& tile1, dInt32 tilesCount) const
+{
+	// vertex x1 is the last column of the tile that owns cell x1 - 1
+	tile0 = dMin(x0 / m_tileSize, tilesCount - 1);
+	tile1 = dMin(dMax(x1 - 1, x0) / m_tileSize, tilesCount - 1);
+}
+
+ndShapeHeightfield* ndShapeHeightfieldTiled::LoadTile(dInt32 index) const
+{
+	D_TRACKTIME();
+	const dInt32 x0 = (index % m_tilesCount_x) * m_tileSize;
+	const dInt32 z0 = (index / m_tilesCount_x) * m_tileSize;
+	const dInt32 width = dMin(m_tileSize + 1, m_width - x0);
+	const dInt32 height = dMin(m_tileSize + 1, m_height - z0);
+
+	ndShapeHeightfield* const tile = new ndShapeHeightfield(width, height, m_diagonalMode, m_verticalScale, m_horizontalScale_x, m_horizontalScale_z);
+	if (!m_source->LoadRegion(x0, z0, width, height, &tile->m_elevationMap[0], &tile->m_atributeMap[0]))
+	{
+		dTrace(("failed to load height field tile at %d %d\n", x0, z0));
+	}
+	tile->UpdateElevationMapAabb();
+	tile->AddRef();
+	return tile;
+}
+
+void ndShapeHeightfieldTiled::InstallTile(dInt32 index, ndShapeHeightfield* const tile) const
+{
+	ndTileSlot& slot = m_slots[index];
+	dAssert(!slot.m_tile.load());
+	m_residentMemory.fetch_add(CalculateTileMemory(tile));
+	m_residentCount.fetch_add(1);
+	slot.m_tile.store(tile);
+	slot.m_state.store(m_tileResident);
+}
+
+void ndShapeHeightfieldTiled::EvictTile(dInt32 index)
+{
+	ndTileSlot& slot = m_slots[index];
+	ndShapeHeightfield* const tile = slot.m_tile.load();
+	dAssert(tile);
+	m_residentMemory.fetch_add(-CalculateTileMemory(tile));
+	m_residentCount.fetch_add(-1);
+	slot.m_tile.store(nullptr);
+	slot.m_state.store(m_tileEmpty);
+	tile->Release();
+}
+
+ndShapeHeightfield* ndShapeHeightfieldTiled::GetTile(dInt32 tileX, dInt32 tileZ) const
+{
+	const dInt32 index = tileZ * m_tilesCount_x + tileX;
+	ndTileSlot& slot = m_slots[index];
+	slot.m_lastUsed.store(m_frame);
+	ndShapeHeightfield* const tile = slot.m_tile.load();
+	return tile ? tile : GetTileSlow(index);
+}
+
+ndShapeHeightfield* ndShapeHeightfieldTiled::GetTileSlow(dInt32 index) const
+{
+	// the tile was not requested ahead of time,
+	// the calling thread has to wait for it to load.
+	std::unique_lock<std::mutex> lock(m_loadLock);
+	ndShapeHeightfield* tile = m_slots[index].m_tile.load();
+	if (!tile)
+	{
+		m_stallsCount.fetch_add(1);
+		tile = LoadTile(index);
+		InstallTile(index, tile);
+	}
+	return tile;
+}
+
+void ndShapeHeightfieldTiled::RequestRegion(const dVector& p0, const dVector& p1)
+{
+	const dVector q0(p0.GetMin(p1));
+	const dVector q1(p0.GetMax(p1));
+	const dInt32 x0 = dClamp(FastInt(q0.m_x * m_horizontalScaleInv_x), 0, m_width - 1);
+	const dInt32 z0 = dClamp(FastInt(q0.m_z * m_horizontalScaleInv_z), 0, m_height - 1);
+	const dInt32 x1 = dClamp(FastInt(q1.m_x * m_horizontalScaleInv_x) + 1, 0, m_width - 1);
+	const dInt32 z1 = dClamp(FastInt(q1.m_z * m_horizontalScaleInv_z) + 1, 0, m_height - 1);
+
+	dInt32 tileX0;
+	dInt32 tileX1;
+	dInt32 tileZ0;
+	dInt32 tileZ1;
+	GetTileRange(x0, x1, tileX0, tileX1, m_tilesCount_x);
+	GetTileRange(z0, z1, tileZ0, tileZ1, m_tilesCount_z);
+	for (dInt32 tileZ = tileZ0; tileZ <= tileZ1; tileZ++)
+	{
+		for (dInt32 tileX = tileX0; tileX <= tileX1; tileX++)
+		{
+			const dInt32 index = tileZ * m_tilesCount_x + tileX;
+			ndTileSlot& slot = m_slots[index];
+			slot.m_lastUsed.store(m_frame);
+			if (slot.m_state.load() == m_tileEmpty)
+			{
+				dInt32 state = m_tileEmpty;
+				if (slot.m_state.compare_exchange_weak(state, m_tileQueued))
+				{
+					m_loader->Request(index);
+				}
+			}
+		}
+	}
+}
+
+void ndShapeHeightfieldTiled::RequestBodies(const ndBodyList& bodyList, const dMatrix& terrainMatrix, dFloat32 padding)
+{
+	D_TRACKTIME();
+	const dMatrix invMatrix(terrainMatrix.Inverse());
+	const dVector pad(padding, padding, padding, dFloat32(0.0f));
+	for (ndBodyList::dNode* node = bodyList.GetFirst(); node; node = node->GetNext())
+	{
+		ndBodyKinematic* const body = node->GetInfo();
+		if ((body->GetInvMass() > dFloat32(0.0f)) && !body->GetSleepState())
+		{
+			dVector p0;
+			dVector p1;
+			dVector q0;
+			dVector q1;
+			body->GetAABB(p0, p1);
+			invMatrix.TransformBBox(p0 & dVector::m_triplexMask, p1 & dVector::m_triplexMask, q0, q1);
+			RequestRegion(q0 - pad, q1 + pad);
+		}
+	}
+}
+
+dInt32 ndShapeHeightfieldTiled::CompareLastUsed(const dInt32* const indexA, const dInt32* const indexB, void* const context)
+{
+	const ndTileSlot* const slots = (ndTileSlot*)context;
+	const dInt32 frameA = slots[*indexA].m_lastUsed.load();
+	const dInt32 frameB = slots[*indexB].m_lastUsed.load();
+	if (frameA < frameB)
+	{
+		return -1;
+	}
+	else if (frameA > frameB)
+	{
+		return 1;
+	}
+	return *indexA - *indexB;
+}
+
+void ndShapeHeightfieldTiled::Update()
+{
+	D_TRACKTIME();
+	{
+		// install the tiles loaded in the background
+		dScopeSpinLock lock(m_loader->m_lock);
+		while (dList<ndLoadedTile>::dNode* const node = m_loader->m_loaded.GetFirst())
+		{
+			const ndLoadedTile& loaded = node->GetInfo();
+			if (m_slots[loaded.m_index].m_tile.load())
+			{
+				loaded.m_tile->Release();
+			}
+			else
+			{
+				InstallTile(loaded.m_index, loaded.m_tile);
+			}
+			m_loader->m_loaded.Remove(node);
+		}
+	}
+
+	if (m_residentMemory.load() > m_memoryBudget)
+	{
+		// evict the least recently used tiles, tiles used since the last update stay
+		dArray<dInt32> candidates;
+		for (dInt32 i = m_tilesCount_x * m_tilesCount_z - 1; i >= 0; i--)
+		{
+			if (m_slots[i].m_tile.load() && (m_slots[i].m_lastUsed.load() < m_frame))
+			{
+				candidates.PushBack(i);
+			}
+		}
+
+		if (candidates.GetCount())
+		{
+			dSort(&candidates[0], candidates.GetCount(), CompareLastUsed, m_slots);
+			for (dInt32 i = 0; (i < candidates.GetCount()) && (m_residentMemory.load() > m_memoryBudget); i++)
+			{
+				EvictTile(candidates[i]);
+			}
+		}
+	}
+	m_frame++;
+}
+
+void ndShapeHeightfieldTiled::CalculateMinAndMaxElevation(dInt32 x0, dInt32 x1, dInt32 z0, dInt32 z1, dFloat32& minHeight, dFloat32& maxHeight) const
+{
+	dInt32 tileX0;
+	dInt32 tileX1;
+	dInt32 tileZ0;
+	dInt32 tileZ1;
+	GetTileRange(x0, x1, tileX0, tileX1, m_tilesCount_x);
+	GetTileRange(z0, z1, tileZ0, tileZ1, m_tilesCount_z);
+
+	minHeight = dFloat32(1.0e10f);
+	maxHeight = dFloat32(-1.0e10f);
+	for (dInt32 tileZ = tileZ0; tileZ <= tileZ1; tileZ++)
+	{
+		const dInt32 baseZ = tileZ * m_tileSize;
+		for (dInt32 tileX = tileX0; tileX <= tileX1; tileX++)
+		{
+			const dInt32 baseX = tileX * m_tileSize;
+			const ndShapeHeightfield* const tile = GetTile(tileX, tileZ);
+
+			dFloat32 tileMinHeight;
+			dFloat32 tileMaxHeight;
+			const dInt32 tx0 = dMax(x0, baseX) - baseX;
+			const dInt32 tz0 = dMax(z0, baseZ) - baseZ;
+			const dInt32 tx1 = dMin(x1, baseX + tile->m_width - 1) - baseX;
+			const dInt32 tz1 = dMin(z1, baseZ + tile->m_height - 1) - baseZ;
+			tile->ndShapeHeightfield::CalculateMinAndMaxElevation(tx0, tx1, tz0, tz1, tileMinHeight, tileMaxHeight);
+			minHeight = dMin(minHeight, tileMinHeight);
+			maxHeight = dMax(maxHeight, tileMaxHeight);
+		}
+	}
+}
+
+const dInt8* ndShapeHeightfieldTiled::GetElevationPatch(dInt32 x0, dInt32 x1, dInt32 z0, dInt32 z1, dVector*& vertexOut, dInt32& attributeStride) const
+{
+	// vertices on a seam are copied from both tiles, they are the same value
+	// and the position is calculated from the global grid index in both cases.
+	const dInt32 vertexStride = x1 - x0 + 1;
+	const dInt32 vertexCount = (z1 - z0 + 1) * (x1 - x0 + 1) + 2 * (z1 - z0) * (x1 - x0);
+	dVector* const vertex = dThreadScratch::GetBuffer<dVector>(m_vertexScratchSlot, vertexCount);
+	vertexOut = vertex;
+
+	attributeStride = x1 - x0;
+	dInt8* const attributes = dThreadScratch::GetBuffer<dInt8>(m_attributeScratchSlot, dMax((z1 - z0) * (x1 - x0), 1));
+
+	dInt32 tileX0;
+	dInt32 tileX1;
+	dInt32 tileZ0;
+	dInt32 tileZ1;
+	GetTileRange(x0, x1, tileX0, tileX1, m_tilesCount_x);
+	GetTileRange(z0, z1, tileZ0, tileZ1, m_tilesCount_z);
+	for (dInt32 tileZ = tileZ0; tileZ <= tileZ1; tileZ++)
+	{
+		const dInt32 baseZ = tileZ * m_tileSize;
+		for (dInt32 tileX = tileX0; tileX <= tileX1; tileX++)
+		{
+			const dInt32 baseX = tileX * m_tileSize;
+			const ndShapeHeightfield* const tile = GetTile(tileX, tileZ);
+			const dInt32 tileWidth = tile->m_width;
+
+			const dInt32 vx0 = dMax(x0, baseX);
+			const dInt32 vz0 = dMax(z0, baseZ);
+			const dInt32 vx1 = dMin(x1, baseX + tileWidth - 1);
+			const dInt32 vz1 = dMin(z1, baseZ + tile->m_height - 1);
+			for (dInt32 z = vz0; z <= vz1; z++)
+			{
+				const dFloat32 zVal = m_horizontalScale_z * z;
+				const dInt16* const elevation = &tile->m_elevationMap[(z - baseZ) * tileWidth] - baseX;
+				dVector* const row = &vertex[(z - z0) * vertexStride] - x0;
+				for (dInt32 x = vx0; x <= vx1; x++)
+				{
+					row[x] = dVector(m_horizontalScale_x * x, m_verticalScale * dFloat32(elevation[x]), zVal, dFloat32(0.0f));
+				}
+			}
+
+			// each cell belongs to one tile
+			const dInt32 cx1 = dMin(x1 - 1, baseX + tileWidth - 2);
+			const dInt32 cz1 = dMin(z1 - 1, baseZ + tile->m_height - 2);
+			for (dInt32 z = vz0; z <= cz1; z++)
+			{
+				const dInt8* const src = &tile->m_atributeMap[(z - baseZ) * tileWidth] - baseX;
+				dInt8* const dst = &attributes[(z - z0) * attributeStride] - x0;
+				for (dInt32 x = vx0; x <= cx1; x++)
+				{
+					dst[x] = src[x];
+				}
+			}
+		}
+	}
+	return attributes;
+}
+
+dInt32 ndShapeHeightfieldTiled::CompareRayTiles(const ndRayTile* const tileA, const ndRayTile* const tileB, void* const)
+{
+	if (tileA->m_dist < tileB->m_dist)
+	{
+		return -1;
+	}
+	else if (tileA->m_dist > tileB->m_dist)
+	{
+		return 1;
+	}
+	return 0;
+}
+
+dFloat32 ndShapeHeightfieldTiled::RayCast(ndRayCastNotify& callback, const dVector& localP0, const dVector& localP1, dFloat32 maxT, const ndBody* const body, ndContactPoint& contactOut) const
+{
+	const dVector q0(localP0.GetMin(localP1));
+	const dVector q1(localP0.GetMax(localP1));
+	const dInt32 x0 = dClamp(FastInt(q0.m_x * m_horizontalScaleInv_x), 0, m_width - 1);
+	const dInt32 z0 = dClamp(FastInt(q0.m_z * m_horizontalScaleInv_z), 0, m_height - 1);
+	const dInt32 x1 = dClamp(FastInt(q1.m_x * m_horizontalScaleInv_x) + 1, 0, m_width - 1);
+	const dInt32 z1 = dClamp(FastInt(q1.m_z * m_horizontalScaleInv_z) + 1, 0, m_height - 1);
+
+	dInt32 tileX0;
+	dInt32 tileX1;
+	dInt32 tileZ0;
+	dInt32 tileZ1;
+	GetTileRange(x0, x1, tileX0, tileX1, m_tilesCount_x);
+	GetTileRange(z0, z1, tileZ0, tileZ1, m_tilesCount_z);
+
+	// collect the tiles under the ray sorted by entry distance, resident tiles
+	// use their own bounds, the others the bounds of the whole terrain.
+	const dFastRayTest ray(localP0, localP1);
+	dArray<ndRayTile> tiles;
+	for (dInt32 tileZ = tileZ0; tileZ <= tileZ1; tileZ++)
+	{
+		for (dInt32 tileX = tileX0; tileX <= tileX1; tileX++)
+		{
+			const dVector origin(GetTileOrigin(tileX, tileZ));
+			const ndShapeHeightfield* const tile = m_slots[tileZ * m_tilesCount_x + tileX].m_tile.load();
+			const dFloat32 y0 = tile ? tile->m_minBox.m_y : m_minBox.m_y;
+			const dFloat32 y1 = tile ? tile->m_maxBox.m_y : m_maxBox.m_y;
+			const dVector boxP0(dVector(origin.m_x, y0, origin.m_z, dFloat32(0.0f)) - m_padding);
+			const dVector boxP1(dVector(origin.m_x + dFloat32(m_tileSize) * m_horizontalScale_x, y1, origin.m_z + dFloat32(m_tileSize) * m_horizontalScale_z, dFloat32(0.0f)) + m_padding);
+			dFloat32 dist = ray.BoxIntersect(boxP0, boxP1);
+			if (dist < maxT)
+			{
+				ndRayTile entry;
+				entry.m_dist = dist;
+				entry.m_tileX = tileX;
+				entry.m_tileZ = tileZ;
+				tiles.PushBack(entry);
+			}
+		}
+	}
+
+	bool hit = false;
+	if (tiles.GetCount())
+	{
+		dSort(&tiles[0], tiles.GetCount(), CompareRayTiles);
+		for (dInt32 i = 0; (i < tiles.GetCount()) && (tiles[i].m_dist < maxT); i++)
+		{
+			const ndRayTile& entry = tiles[i];
+			const dVector origin(GetTileOrigin(entry.m_tileX, entry.m_tileZ));
+			const ndShapeHeightfield* const tile = GetTile(entry.m_tileX, entry.m_tileZ);
+
+			ndContactPoint tileContact;
+			dFloat32 t = tile->ndShapeHeightfield::RayCast(callback, localP0 - origin, localP1 - origin, maxT, body, tileContact);
+			if (t < maxT)
+			{
+				hit = true;
+				maxT = t;
+				contactOut.m_normal = tileContact.m_normal;
+				contactOut.m_shapeId0 = tileContact.m_shapeId0;
+				contactOut.m_shapeId1 = tileContact.m_shapeId1;
+			}
+		}
+	}
+	return hit ? maxT : dFloat32(1.2f);
+}
+
+void ndShapeHeightfieldTiled::DebugShape(const dMatrix& matrix, ndShapeDebugCallback& debugCallback) const
+{
+	// only the resident tiles are drawn
+	for (dInt32 tileZ = 0; tileZ < m_tilesCount_z; tileZ++)
+	{
+		for (dInt32 tileX = 0; tileX < m_tilesCount_x; tileX++)
+		{
+			const ndShapeHeightfield* const tile = m_slots[tileZ * m_tilesCount_x + tileX].m_tile.load();
+			if (tile)
+			{
+				dMatrix tileMatrix(dGetIdentityMatrix());
+				tileMatrix.m_posit = GetTileOrigin(tileX, tileZ) | dVector::m_wOne;
+				tile->ndShapeHeightfield::DebugShape(tileMatrix * matrix, debugCallback);
+			}
+		}
+	}
+}
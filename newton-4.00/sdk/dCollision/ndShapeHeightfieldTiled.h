@@ -0,0 +1,240 @@
+/* Copyright (c) <2003-2021> <Julio Jerez, Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef __D_SHAPE_HEIGHT_FIELD_TILED__
+#define __D_SHAPE_HEIGHT_FIELD_TILED__
+
+#include "ndCollisionStdafx.h"
+#include "ndShapeHeightfield.h"
+
+class ndBodyList;
+
+// a height field too large to be kept in memory, the grid is split in square tiles
+// of tileSize x tileSize cells that are loaded from a tile source on demand.
+// each resident tile is a small height field that shares its last row and column
+// of vertices with its neighbors, collision queries gather the vertices from all the
+// tiles they touch into one contiguous grid, so contacts do not see the seams.
+// tiles are requested ahead of time with RequestRegion or RequestBodies and loaded
+// in a background thread, a query that finds a tile missing loads it right away.
+// Update installs the loaded tiles and evicts the least recently used ones until
+// the memory is below the budget, it must be called while the world is not updating.
+class ndShapeHeightfieldTiled: public ndShapeHeightfield
+{
+	public:
+	class ndTileSource: public dClassAlloc
+	{
+		public:
+		ndTileSource()
+		{
+		}
+
+		virtual ~ndTileSource()
+		{
+		}
+
+		// fill the elevation and attributes of the vertices in the rectangle [x0, x0 + width) x [z0, z0 + height)
+		// one row after the other. it is called from the loader and from the collision threads at the same time.
+		virtual bool LoadRegion(dInt32 x0, dInt32 z0, dInt32 width, dInt32 height, dInt16* const elevation, dInt8* const attributes) = 0;
+
+		// bounds of all the elevations in the source, used for the shape bounding box
+		virtual void GetElevationRange(dInt16& minElevation, dInt16& maxElevation) const
+		{
+			minElevation = dInt16(-0x7fff);
+			maxElevation = dInt16(0x7fff);
+		}
+	};
+
+	// tile source reading a height field file through a memory mapping,
+	// the file is a header followed by the elevation and attribute grids.
+	class ndMappedFileSource: public ndTileSource
+	{
+		public:
+		class ndHeader
+		{
+			public:
+			char m_magic[8];
+			dInt32 m_width;
+			dInt32 m_height;
+			dInt16 m_minElevation;
+			dInt16 m_maxElevation;
+			dInt32 m_reserved;
+		};
+
+		D_COLLISION_API static ndMappedFileSource* Open(const char* const path);
+		D_COLLISION_API static bool Save(const char* const path, dInt32 width, dInt32 height, const dInt16* const elevation, const dInt8* const attributes);
+
+		D_COLLISION_API virtual ~ndMappedFileSource();
+		D_COLLISION_API virtual bool LoadRegion(dInt32 x0, dInt32 z0, dInt32 width, dInt32 height, dInt16* const elevation, dInt8* const attributes);
+		D_COLLISION_API virtual void GetElevationRange(dInt16& minElevation, dInt16& maxElevation) const;
+
+		dInt32 GetWidth() const;
+		dInt32 GetHeight() const;
+
+		private:
+		ndMappedFileSource(dMappedFile* const file);
+
+		dMappedFile* m_file;
+		const ndHeader* m_header;
+		const dInt16* m_elevation;
+		const dInt8* m_attributes;
+	};
+
+	// the shape takes ownership of the source
+	D_COLLISION_API ndShapeHeightfieldTiled(
+		ndTileSource* const source, dInt32 width, dInt32 height, dInt32 tileSize,
+		ndGridConstruction contructionMode, dFloat32 verticalScale,
+		dFloat32 horizontalScale_x, dFloat32 horizontalScale_z, dInt64 memoryBudget);
+	D_COLLISION_API virtual ~ndShapeHeightfieldTiled();
+
+	// queue the tiles under a box in shape space for loading
+	D_COLLISION_API void RequestRegion(const dVector& p0, const dVector& p1);
+
+	// queue the tiles under the aabb of all the moving bodies of the list,
+	// terrainMatrix is the global matrix of the terrain shape instance.
+	D_COLLISION_API void RequestBodies(const ndBodyList& bodyList, const dMatrix& terrainMatrix, dFloat32 padding);
+
+	// install the tiles loaded in the background and evict tiles over the memory budget
+	D_COLLISION_API void Update();
+
+	dInt32 GetTileSize() const;
+	dInt32 GetResidentTilesCount() const;
+	dInt64 GetResidentMemory() const;
+	dInt32 GetStallsCount() const;
+
+	protected:
+	virtual ndShapeInfo GetShapeInfo() const;
+	virtual void DebugShape(const dMatrix& matrix, ndShapeDebugCallback& debugCallback) const;
+	virtual dFloat32 RayCast(ndRayCastNotify& callback, const dVector& localP0, const dVector& localP1, dFloat32 maxT, const ndBody* const body, ndContactPoint& contactOut) const;
+	virtual void Save(nd::TiXmlElement* const xmlNode, const char* const assetPath, dInt32 nodeid) const;
+	virtual const dInt8* GetElevationPatch(dInt32 x0, dInt32 x1, dInt32 z0, dInt32 z1, dVector*& vertexOut, dInt32& attributeStride) const;
+	virtual void CalculateMinAndMaxElevation(dInt32 x0, dInt32 x1, dInt32 z0, dInt32 z1, dFloat32& minHeight, dFloat32& maxHeight) const;
+
+	private:
+	enum ndTileState
+	{
+		m_tileEmpty = 0,
+		m_tileQueued,
+		m_tileResident,
+	};
+
+	class ndTileSlot
+	{
+		public:
+		ndTileSlot()
+			:m_tile(nullptr)
+			,m_state(m_tileEmpty)
+			,m_lastUsed(0)
+		{
+		}
+
+		dAtomic<ndShapeHeightfield*> m_tile;
+		dAtomic<dInt32> m_state;
+		dAtomic<dInt32> m_lastUsed;
+	};
+
+	class ndLoadedTile
+	{
+		public:
+		ndShapeHeightfield* m_tile;
+		dInt32 m_index;
+	};
+
+	class ndRayTile
+	{
+		public:
+		dFloat32 m_dist;
+		dInt32 m_tileX;
+		dInt32 m_tileZ;
+	};
+
+	class ndTileLoader: public dThread
+	{
+		public:
+		ndTileLoader(ndShapeHeightfieldTiled* const owner);
+		~ndTileLoader();
+
+		void Request(dInt32 index);
+		virtual void ThreadFunction();
+
+		ndShapeHeightfieldTiled* m_owner;
+		dList<dInt32> m_requests;
+		dList<ndLoadedTile> m_loaded;
+		dSpinLock m_lock;
+	};
+
+	ndShapeHeightfield* LoadTile(dInt32 index) const;
+	ndShapeHeightfield* GetTile(dInt32 tileX, dInt32 tileZ) const;
+	ndShapeHeightfield* GetTileSlow(dInt32 index) const;
+	void InstallTile(dInt32 index, ndShapeHeightfield* const tile) const;
+	void EvictTile(dInt32 index);
+	void GetTileRange(dInt32 x0, dInt32 x1, dInt32& tile0, dInt32& tile1, dInt32 tilesCount) const;
+	dVector GetTileOrigin(dInt32 tileX, dInt32 tileZ) const;
+	static dInt64 CalculateTileMemory(const ndShapeHeightfield* const tile);
+	static dInt32 CompareLastUsed(const dInt32* const indexA, const dInt32* const indexB, void* const context);
+	static dInt32 CompareRayTiles(const ndRayTile* const tileA, const ndRayTile* const tileB, void* const context);
+
+	ndTileSource* m_source;
+	ndTileSlot* m_slots;
+	ndTileLoader* m_loader;
+	mutable std::mutex m_loadLock;
+	mutable dAtomic<dInt64> m_residentMemory;
+	mutable dAtomic<dInt32> m_residentCount;
+	mutable dAtomic<dInt32> m_stallsCount;
+	dInt64 m_memoryBudget;
+	dInt32 m_tileSize;
+	dInt32 m_tilesCount_x;
+	dInt32 m_tilesCount_z;
+	dInt32 m_frame;
+
+	static dInt32 m_attributeScratchSlot;
+};
+
+inline dInt32 ndShapeHeightfieldTiled::ndMappedFileSource::GetWidth() const
+{
+	return m_header->m_width;
+}
+
+inline dInt32 ndShapeHeightfieldTiled::ndMappedFileSource::GetHeight() const
+{
+	return m_header->m_height;
+}
+
+inline dInt32 ndShapeHeightfieldTiled::GetTileSize() const
+{
+	return m_tileSize;
+}
+
+inline dInt32 ndShapeHeightfieldTiled::GetResidentTilesCount() const
+{
+	return m_residentCount.load();
+}
+
+inline dInt64 ndShapeHeightfieldTiled::GetResidentMemory() const
+{
+	return m_residentMemory.load();
+}
+
+inline dInt32 ndShapeHeightfieldTiled::GetStallsCount() const
+{
+	return m_stallsCount.load();
+}
+
+#endif
@@ -37,6 +37,9 @@ class ndShapeStaticMesh;
 typedef void (*dgCollisionMeshCollisionCallback) (const ndBodyKinematic* const bodyWithTreeCollision, const ndBodyKinematic* const body, dInt32 faceID, 
 												  dInt32 vertexCount, const dFloat32* const vertex, dInt32 vertexStrideInBytes); 
 
+// the face and index buffers are part of the descriptor, which the callers 
+// keep on their stack. that is already per thread and lock free, and unlike 
+// a dThreadScratch slot it stays valid when a query runs inside another one.
 D_MSV_NEWTON_ALIGN_32 
 class ndPolygonMeshDesc: public dFastAabbInfo
 {
@@ -55,10 +55,11 @@ class ndBvhRay: public dFastRayTest
 ndShapeStatic_bvh::ndShapeStatic_bvh(const dPolygonSoupBuilder& builder)
 	:ndShapeStaticMesh(m_boundingBoxHierachy)
 	,dAabbPolygonSoup()
+	,m_mappedImage(nullptr)
 	,m_trianglesCount(0)
 {
 	Create(builder);
-	CalculateAdjacendy();
+	CalculateAdjacendy(builder.GetThreadPool());
 
 	dVector p0;
 	dVector p1;
@@ -80,6 +81,7 @@ ndShapeStatic_bvh::ndShapeStatic_bvh(const dPolygonSoupBuilder& builder)
 ndShapeStatic_bvh::ndShapeStatic_bvh(const nd::TiXmlNode* const xmlNode, const char* const assetPath)
 	:ndShapeStaticMesh(m_boundingBoxHierachy)
 	,dAabbPolygonSoup()
+	,m_mappedImage(nullptr)
 	,m_trianglesCount(0)
 {
 	D_CORE_API const char* xmlGetString(const nd::TiXmlNode* const rootNode, const char* const name);
@@ -105,8 +107,67 @@ ndShapeStatic_bvh::ndShapeStatic_bvh(const nd::TiXmlNode* const xmlNode, const c
 	m_trianglesCount = data.m_triangleCount;
 }
 
+ndShapeStatic_bvh::ndShapeStatic_bvh(const void* const serializedData, dInt64 size)
+	:ndShapeStaticMesh(m_boundingBoxHierachy)
+	,dAabbPolygonSoup()
+	,m_mappedImage(nullptr)
+	,m_trianglesCount(0)
+{
+	// callers validate the image first, an invalid one makes an empty mesh
+	const bool isValid = DeserializeFromBuffer(serializedData, size);
+	dAssert(isValid);
+
+	dVector p0;
+	dVector p1;
+	GetAABB(p0, p1);
+	m_boxSize = (p1 - p0) * dVector::m_half;
+	m_boxOrigin = (p1 + p0) * dVector::m_half;
+
+	ndMeshVertexListIndexList data;
+	data.m_indexList = nullptr;
+	data.m_userDataList = nullptr;
+	data.m_maxIndexCount = 1000000000;
+	data.m_triangleCount = 0;
+	dVector zero(dVector::m_zero);
+	dFastAabbInfo box(dGetIdentityMatrix(), dVector(dFloat32(1.0e15f)));
+	ForAllSectors(box, zero, dFloat32(1.0f), GetTriangleCount, &data);
+	m_trianglesCount = data.m_triangleCount;
+}
+
+ndShapeStatic_bvh::ndShapeStatic_bvh(dMappedFile* const mappedImage)
+	:ndShapeStaticMesh(m_boundingBoxHierachy)
+	,dAabbPolygonSoup()
+	,m_mappedImage(mappedImage->AddRef())
+	,m_trianglesCount(-1)
+{
+}
+
+ndShapeStatic_bvh* ndShapeStatic_bvh::Load(dMappedFile* const mappedImage)
+{
+	// the mesh is used in place, pages are loaded by the os as the mesh is queried 
+	// and shared by all shapes and processes using the same file. 
+	// validation reads the whole image once, the os can drop the pages after that.
+	ndShapeStatic_bvh* const shape = new ndShapeStatic_bvh(mappedImage);
+	if (!shape->AttachImage(mappedImage->GetData(), mappedImage->GetSize()))
+	{
+		delete shape;
+		return nullptr;
+	}
+
+	dVector p0;
+	dVector p1;
+	shape->GetAABB(p0, p1);
+	shape->m_boxSize = (p1 - p0) * dVector::m_half;
+	shape->m_boxOrigin = (p1 + p0) * dVector::m_half;
+	return shape;
+}
+
 ndShapeStatic_bvh::~ndShapeStatic_bvh(void)
 {
+	if (m_mappedImage)
+	{
+		m_mappedImage->Release();
+	}
 }
 
 void ndShapeStatic_bvh::Save(nd::TiXmlElement* const xmlNode, const char* const assetPath, dInt32 nodeid) const
@@ -142,6 +203,10 @@ ndShapeInfo ndShapeStatic_bvh::GetShapeInfo() const
 {
 	ndShapeInfo info(ndShapeStaticMesh::GetShapeInfo());
 
+	if (m_trianglesCount < 0)
+	{
+		m_trianglesCount = CalculateTrianglesCount();
+	}
 	info.m_bvh.m_vertexCount = GetVertexCount();
 	info.m_bvh.m_indexCount = m_trianglesCount * 3;
 	return info;
@@ -30,8 +30,12 @@ class ndShapeStatic_bvh: public ndShapeStaticMesh, public dAabbPolygonSoup
 	public:
 	D_COLLISION_API ndShapeStatic_bvh(const dPolygonSoupBuilder& builder);
 	D_COLLISION_API ndShapeStatic_bvh(const nd::TiXmlNode* const xmlNode, const char* const assetPath);
+	D_COLLISION_API ndShapeStatic_bvh(const void* const serializedData, dInt64 size);
 	D_COLLISION_API virtual ~ndShapeStatic_bvh();
 
+	// use the image of a mapped file in place, return null if the image is not valid
+	D_COLLISION_API static ndShapeStatic_bvh* Load(dMappedFile* const mappedImage);
+
 	protected:
 	virtual ndShapeInfo GetShapeInfo() const;
 	virtual ndShapeStatic_bvh* GetAsShapeStaticBVH() { return this; }
@@ -46,7 +50,10 @@ class ndShapeStatic_bvh: public ndShapeStaticMesh, public dAabbPolygonSoup
 	static dIntersectStatus GetPolygon(void* const context, const dFloat32* const polygon, dInt32 strideInBytes, const dInt32* const indexArray, dInt32 indexCount, dFloat32 hitDistance);
 
 	private: 
-	dInt32 m_trianglesCount;
+	ndShapeStatic_bvh(dMappedFile* const mappedImage);
+
+	dMappedFile* m_mappedImage;
+	mutable dInt32 m_trianglesCount;
 
 	friend class ndContactSolver;
 };
@@ -25,11 +25,15 @@
 #include "dStack.h"
 #include "dList.h"
 #include "dMatrix.h"
+#include "dSort.h"
 #include "dPolyhedra.h"
+#include "dThreadPool.h"
 #include "dAabbPolygonSoup.h"
 #include "dPolygonSoupBuilder.h"
 
 #define DG_STACK_DEPTH 512
+#define D_AABB_SOUP_IMAGE_VERSION 1
+#define D_AABB_SOUP_IMAGE_ALIGNMENT 64
 
 D_MSV_NEWTON_ALIGN_32
 class dAabbPolygonSoup::dgNodeBuilder: public dAabbPolygonSoup::dNode
@@ -245,18 +249,601 @@ class dAabbPolygonSoup::dgSpliteInfo
 	dVector m_p1;
 };
 
+// multi threaded path of Create, it builds the same tree as BuildTopDown.
+// the top of the tree is split serially until there are enough sub trees to keep 
+// all threads busy, and the sub trees are built by the worker threads. internal nodes
+// are stored at the slot of their split point, so the tree does not depend on the 
+// order the threads complete their work.
+class dAabbPolygonSoup::dgParallelBuilder
+{
+	public:
+	class dgSubTree
+	{
+		public:
+		dgNodeBuilder* m_parent;
+		dInt32 m_first;
+		dInt32 m_last;
+		dInt32 m_isLeft;
+	};
+
+	class dgBuildLeafsJob: public dThreadPoolJob
+	{
+		public:
+		virtual void Execute()
+		{
+			dgParallelBuilder* const me = (dgParallelBuilder*)m_context;
+			const dInt32 faceCount = me->m_builder->m_faceVertexCount.GetCount();
+			const dInt32 start = dInt32((dInt64(faceCount) * GetThreadId()) / GetThreadCount());
+			const dInt32 end = dInt32((dInt64(faceCount) * (GetThreadId() + 1)) / GetThreadCount());
+			const dInt32* const indices = &me->m_builder->m_vertexIndex[0];
+			for (dInt32 i = start; i < end; i++)
+			{
+				const dInt32 indexCount = me->m_builder->m_faceVertexCount[i] - 1;
+				new (&me->m_leafArray[i]) dgNodeBuilder(me->m_vertexArray, i, indexCount, &indices[me->m_faceStart[i]]);
+			}
+		}
+		void* m_context;
+	};
+
+	class dgEmitLeafsJob: public dThreadPoolJob
+	{
+		public:
+		virtual void Execute()
+		{
+			dgParallelBuilder* const me = (dgParallelBuilder*)m_context;
+			const dInt32 leafCount = me->m_leafCount;
+			const dInt32 start = dInt32((dInt64(leafCount) * GetThreadId()) / GetThreadCount());
+			const dInt32 end = dInt32((dInt64(leafCount) * (GetThreadId() + 1)) / GetThreadCount());
+			for (dInt32 i = start; i < end; i++)
+			{
+				me->m_soup->CreateLeafFace(&me->m_soup->m_indices[me->m_leafIndexMap[i]], me->m_leafNodes[i], *me->m_builder, me->m_vertexArray);
+			}
+		}
+		void* m_context;
+	};
+
+	class dgSubTreeJob: public dThreadPoolJob
+	{
+		public:
+		virtual void Execute()
+		{
+			dgParallelBuilder* const me = (dgParallelBuilder*)m_context;
+			const dInt32 count = me->m_subTrees.GetCount();
+			for (dInt32 i = me->m_subTreeIndex.fetch_add(1); i < count; i = me->m_subTreeIndex.fetch_add(1))
+			{
+				const dgSubTree& subTree = me->m_subTrees[i];
+				dgNodeBuilder* const node = me->Build(subTree.m_first, subTree.m_last);
+				me->Link(subTree.m_parent, node, subTree.m_isLeft);
+			}
+		}
+		void* m_context;
+	};
+
+	dgParallelBuilder(dThreadPool* const threadPool, dAabbPolygonSoup* const soup, const dPolygonSoupBuilder& builder, const dVector* const vertexArray, dgNodeBuilder* const leafArray)
+		:m_threadPool(threadPool)
+		,m_soup(soup)
+		,m_builder(&builder)
+		,m_vertexArray(vertexArray)
+		,m_leafArray(leafArray)
+		,m_subTreeRoot(nullptr)
+		,m_faceStart(nullptr)
+		,m_leafNodes(nullptr)
+		,m_leafIndexMap(nullptr)
+		,m_subTrees()
+		,m_subTreeIndex(0)
+		,m_leafCount(builder.m_faceVertexCount.GetCount())
+	{
+	}
+
+	void BuildLeafs()
+	{
+		dStack<dInt32> faceStart(m_leafCount);
+		dInt32 polygonIndex = 0;
+		for (dInt32 i = 0; i < m_leafCount; i++)
+		{
+			faceStart[i] = polygonIndex;
+			polygonIndex += m_builder->m_faceVertexCount[i];
+		}
+		m_faceStart = &faceStart[0];
+		dgBuildLeafsJob buildLeafsJob;
+		buildLeafsJob.m_context = this;
+		m_threadPool->SubmitJobs(buildLeafsJob);
+		m_faceStart = nullptr;
+	}
+
+	void EmitLeafs(const dgNodeBuilder** const leafNodes, const dInt32* const leafIndexMap)
+	{
+		m_leafNodes = leafNodes;
+		m_leafIndexMap = leafIndexMap;
+		dgEmitLeafsJob emitLeafsJob;
+		emitLeafsJob.m_context = this;
+		m_threadPool->SubmitJobs(emitLeafsJob);
+	}
+
+	dgNodeBuilder* BuildTree()
+	{
+		const dInt32 threadCount = m_threadPool->GetCount();
+		const dInt32 minSubTreeSize = dMax(m_leafCount / (threadCount * 8), 1024);
+
+		dArray<dgSubTree> stack;
+		dgSubTree rootTree;
+		rootTree.m_parent = nullptr;
+		rootTree.m_first = 0;
+		rootTree.m_last = m_leafCount - 1;
+		rootTree.m_isLeft = 0;
+		stack.PushBack(rootTree);
+		while (stack.GetCount())
+		{
+			dgSubTree subTree(stack[stack.GetCount() - 1]);
+			stack.SetCount(stack.GetCount() - 1);
+			const dInt32 count = subTree.m_last - subTree.m_first + 1;
+			if (count <= minSubTreeSize)
+			{
+				m_subTrees.PushBack(subTree);
+			}
+			else
+			{
+				dInt32 split;
+				dgNodeBuilder* const node = Split(subTree.m_first, subTree.m_last, split);
+				Link(subTree.m_parent, node, subTree.m_isLeft);
+
+				dgSubTree left;
+				left.m_parent = node;
+				left.m_first = subTree.m_first;
+				left.m_last = split - 1;
+				left.m_isLeft = 1;
+				stack.PushBack(left);
+
+				dgSubTree right;
+				right.m_parent = node;
+				right.m_first = split;
+				right.m_last = subTree.m_last;
+				right.m_isLeft = 0;
+				stack.PushBack(right);
+			}
+		}
+
+		dgSubTreeJob subTreeJob;
+		subTreeJob.m_context = this;
+		m_threadPool->SubmitJobs(subTreeJob);
+		return m_subTreeRoot;
+	}
+
+	private:
+	void Link(dgNodeBuilder* const parent, dgNodeBuilder* const node, dInt32 isLeft)
+	{
+		if (!parent)
+		{
+			m_subTreeRoot = node;
+		}
+		else if (isLeft)
+		{
+			parent->m_left = node;
+			node->m_parent = parent;
+		}
+		else
+		{
+			parent->m_right = node;
+			node->m_parent = parent;
+		}
+	}
+
+	// same split as BuildTopDown, split is the index of the first leaf of the right sub tree
+	dgNodeBuilder* Split(dInt32 first, dInt32 last, dInt32& split) const
+	{
+		dgSpliteInfo info(&m_leafArray[first], last - first + 1);
+		split = first + info.m_axis;
+		dAssert(split > first);
+		dAssert(split <= last);
+		return new (&m_leafArray[m_leafCount + split - 1]) dgNodeBuilder(info.m_p0, info.m_p1);
+	}
+
+	dgNodeBuilder* Build(dInt32 first, dInt32 last)
+	{
+		if (first == last)
+		{
+			return &m_leafArray[first];
+		}
+
+		dInt32 split;
+		dgNodeBuilder* const node = Split(first, last, split);
+		Link(node, Build(split, last), 0);
+		Link(node, Build(first, split - 1), 1);
+		return node;
+	}
+
+	dThreadPool* m_threadPool;
+	dAabbPolygonSoup* m_soup;
+	const dPolygonSoupBuilder* m_builder;
+	const dVector* m_vertexArray;
+	dgNodeBuilder* m_leafArray;
+	dgNodeBuilder* m_subTreeRoot;
+	const dInt32* m_faceStart;
+	const dgNodeBuilder** m_leafNodes;
+	const dInt32* m_leafIndexMap;
+	dArray<dgSubTree> m_subTrees;
+	dAtomic<dInt32> m_subTreeIndex;
+	dInt32 m_leafCount;
+};
+
+// pairs the face edges the same way the serial path does with a dPolyhedra.
+// faces are visited in ForAllSectors order, a face is accepted unless it repeats an 
+// edge in either direction or one of its edges is already used by an accepted face.
+// each edge of an accepted face pairs with the accepted face that has the reverse edge.
+// the edges are bucketed with a counting sort by start vertex, only faces that share 
+// an edge with another face are resolved serially, and each face only writes its own 
+// edge normal slots, so there are no conflicts.
+class dAabbPolygonSoup::dgParallelAdjacency
+{
+	public:
+	enum dgFaceState
+	{
+		m_rejected,
+		m_accepted,
+		m_shared,
+	};
+
+	class dgFace
+	{
+		public:
+		dInt32 m_indexStart;
+		dInt32 m_indexCount;
+		dInt32 m_edgeStart;
+		dInt32 m_state;
+	};
+
+	class dgEdgeJob: public dThreadPoolJob
+	{
+		public:
+		void GetRange(const dgParallelAdjacency* const me, dInt32& start, dInt32& end) const
+		{
+			const dInt64 count = me->m_faces.GetCount();
+			start = dInt32((count * GetThreadId()) / GetThreadCount());
+			end = dInt32((count * (GetThreadId() + 1)) / GetThreadCount());
+		}
+		void* m_context;
+	};
+
+	class dgClearCountersJob: public dgEdgeJob
+	{
+		public:
+		virtual void Execute()
+		{
+			dgParallelAdjacency* const me = (dgParallelAdjacency*)m_context;
+			const dInt64 count = me->m_vertexCount;
+			const dInt32 start = dInt32((count * GetThreadId()) / GetThreadCount());
+			const dInt32 end = dInt32((count * (GetThreadId() + 1)) / GetThreadCount());
+			for (dInt32 i = start; i < end; i++)
+			{
+				me->m_cursor[i].store(0);
+			}
+		}
+	};
+
+	class dgCountEdgesJob: public dgEdgeJob
+	{
+		public:
+		virtual void Execute()
+		{
+			dInt32 start;
+			dInt32 end;
+			dgParallelAdjacency* const me = (dgParallelAdjacency*)m_context;
+			GetRange(me, start, end);
+			for (dInt32 i = start; i < end; i++)
+			{
+				const dgFace& face = me->m_faces[i];
+				const dInt32* const indexArray = &me->m_indices[face.m_indexStart];
+				for (dInt32 j = 0; j < face.m_indexCount; j++)
+				{
+					me->m_cursor[indexArray[j]].fetch_add(1);
+				}
+			}
+		}
+	};
+
+	class dgSortEdgesJob: public dgEdgeJob
+	{
+		public:
+		virtual void Execute()
+		{
+			dInt32 start;
+			dInt32 end;
+			dgParallelAdjacency* const me = (dgParallelAdjacency*)m_context;
+			GetRange(me, start, end);
+			for (dInt32 i = start; i < end; i++)
+			{
+				const dgFace& face = me->m_faces[i];
+				const dInt32* const indexArray = &me->m_indices[face.m_indexStart];
+				for (dInt32 j = 0; j < face.m_indexCount; j++)
+				{
+					const dInt32 edge = face.m_edgeStart + j;
+					me->m_edgeFace[edge] = i;
+					me->m_sortedEdges[me->m_cursor[indexArray[j]].fetch_add(1)] = edge;
+				}
+			}
+		}
+	};
+
+	class dgClassifyFacesJob: public dgEdgeJob
+	{
+		public:
+		virtual void Execute()
+		{
+			dInt32 start;
+			dInt32 end;
+			dgParallelAdjacency* const me = (dgParallelAdjacency*)m_context;
+			GetRange(me, start, end);
+			for (dInt32 i = start; i < end; i++)
+			{
+				me->ClassifyFace(i);
+			}
+		}
+	};
+
+	class dgMatchEdgesJob: public dgEdgeJob
+	{
+		public:
+		virtual void Execute()
+		{
+			dInt32 start;
+			dInt32 end;
+			dgParallelAdjacency* const me = (dgParallelAdjacency*)m_context;
+			GetRange(me, start, end);
+			for (dInt32 i = start; i < end; i++)
+			{
+				me->MatchFaceEdges(i);
+			}
+		}
+	};
+
+	dgParallelAdjacency(dAabbPolygonSoup* const soup)
+		:m_faces()
+		,m_indices(soup->m_indices)
+		,m_vertexArray((dTriplex*)soup->GetLocalVertexPool())
+		,m_cursor(nullptr)
+		,m_bucketStart(nullptr)
+		,m_sortedEdges(nullptr)
+		,m_edgeFace(nullptr)
+		,m_vertexCount(soup->GetVertexCount())
+		,m_edgeCount(0)
+	{
+		dVector p0;
+		dVector p1;
+		soup->GetAABB(p0, p1);
+		dFastAabbInfo box(p0, p1);
+		soup->ForAllSectors(box, dVector::m_zero, dFloat32(1.0f), AddFace, this);
+	}
+
+	void Execute(dThreadPool& threadPool)
+	{
+		dStack<dAtomic<dInt32>> cursor(m_vertexCount);
+		dStack<dInt32> bucketStart(m_vertexCount + 1);
+		dStack<dInt32> sortedEdges(m_edgeCount);
+		dStack<dInt32> edgeFace(m_edgeCount);
+		m_cursor = &cursor[0];
+		m_bucketStart = &bucketStart[0];
+		m_sortedEdges = &sortedEdges[0];
+		m_edgeFace = &edgeFace[0];
+
+		dgClearCountersJob clearCountersJob;
+		clearCountersJob.m_context = this;
+		threadPool.SubmitJobs(clearCountersJob);
+
+		dgCountEdgesJob countEdgesJob;
+		countEdgesJob.m_context = this;
+		threadPool.SubmitJobs(countEdgesJob);
+
+		dInt32 sum = 0;
+		for (dInt32 i = 0; i < m_vertexCount; i++)
+		{
+			const dInt32 count = cursor[i].load();
+			bucketStart[i] = sum;
+			cursor[i].store(sum);
+			sum += count;
+		}
+		bucketStart[m_vertexCount] = sum;
+
+		dgSortEdgesJob sortEdgesJob;
+		sortEdgesJob.m_context = this;
+		threadPool.SubmitJobs(sortEdgesJob);
+
+		dgClassifyFacesJob classifyFacesJob;
+		classifyFacesJob.m_context = this;
+		threadPool.SubmitJobs(classifyFacesJob);
+
+		// faces sharing an edge are accepted in visiting order, like dPolyhedra::AddFace does.
+		for (dInt32 i = 0; i < m_faces.GetCount(); i++)
+		{
+			dgFace& face = m_faces[i];
+			if (face.m_state == m_shared)
+			{
+				dInt32 state = m_accepted;
+				const dInt32* const indexArray = &m_indices[face.m_indexStart];
+				for (dInt32 j = 0; (j < face.m_indexCount) && (state == m_accepted); j++)
+				{
+					const dInt32 v0 = indexArray[j];
+					const dInt32 v1 = indexArray[(j + 1 < face.m_indexCount) ? j + 1 : 0];
+					state = (FindAcceptedEdge(v0, v1) >= 0) ? m_rejected : m_accepted;
+				}
+				face.m_state = state;
+			}
+		}
+
+		dgMatchEdgesJob matchEdgesJob;
+		matchEdgesJob.m_context = this;
+		threadPool.SubmitJobs(matchEdgesJob);
+	}
+
+	private:
+	static dIntersectStatus AddFace(void* const context, const dFloat32* const, dInt32, const dInt32* const indexArray, dInt32 indexCount, dFloat32)
+	{
+		dgParallelAdjacency* const me = (dgParallelAdjacency*)context;
+		dgFace face;
+		face.m_indexStart = dInt32(indexArray - me->m_indices);
+		face.m_indexCount = indexCount;
+		face.m_edgeStart = me->m_edgeCount;
+		face.m_state = m_rejected;
+		me->m_edgeCount += indexCount;
+		me->m_faces.PushBack(face);
+		return t_ContinueSearh;
+	}
+
+	void GetEdge(dInt32 edge, dInt32& v0, dInt32& v1) const
+	{
+		const dgFace& face = m_faces[m_edgeFace[edge]];
+		const dInt32 j = edge - face.m_edgeStart;
+		const dInt32* const indexArray = &m_indices[face.m_indexStart];
+		v0 = indexArray[j];
+		v1 = indexArray[(j + 1 < face.m_indexCount) ? j + 1 : 0];
+	}
+
+	dInt32 CountEdges(dInt32 v0, dInt32 v1) const
+	{
+		dInt32 count = 0;
+		const dInt32 end = m_bucketStart[v0 + 1];
+		for (dInt32 i = m_bucketStart[v0]; i < end; i++)
+		{
+			dInt32 e0;
+			dInt32 e1;
+			GetEdge(m_sortedEdges[i], e0, e1);
+			dAssert(e0 == v0);
+			count += (e1 == v1) ? 1 : 0;
+		}
+		return count;
+	}
+
+	// accepted faces never share an edge, so there is at most one
+	dInt32 FindAcceptedEdge(dInt32 v0, dInt32 v1) const
+	{
+		const dInt32 end = m_bucketStart[v0 + 1];
+		for (dInt32 i = m_bucketStart[v0]; i < end; i++)
+		{
+			dInt32 e0;
+			dInt32 e1;
+			const dInt32 edge = m_sortedEdges[i];
+			GetEdge(edge, e0, e1);
+			if ((e1 == v1) && (m_faces[m_edgeFace[edge]].m_state == m_accepted))
+			{
+				return edge;
+			}
+		}
+		return -1;
+	}
+
+	// same tests as dPolyhedra::AddFace, without the edges already in the mesh
+	void ClassifyFace(dInt32 faceIndex)
+	{
+		dgFace& face = m_faces[faceIndex];
+		const dInt32* const indexArray = &m_indices[face.m_indexStart];
+		face.m_state = m_accepted;
+		for (dInt32 j = 0; (j < face.m_indexCount) && (face.m_state != m_rejected); j++)
+		{
+			const dInt32 v0 = indexArray[j];
+			const dInt32 v1 = indexArray[(j + 1 < face.m_indexCount) ? j + 1 : 0];
+			if (v0 == v1)
+			{
+				face.m_state = m_rejected;
+			}
+			for (dInt32 k = 0; (k < j) && (face.m_state != m_rejected); k++)
+			{
+				const dInt32 u0 = indexArray[k];
+				const dInt32 u1 = indexArray[k + 1];
+				if (((u0 == v0) && (u1 == v1)) || ((u0 == v1) && (u1 == v0)))
+				{
+					face.m_state = m_rejected;
+				}
+			}
+			if ((face.m_state == m_accepted) && (CountEdges(v0, v1) > 1))
+			{
+				face.m_state = m_shared;
+			}
+		}
+	}
+
+	void MatchFaceEdges(dInt32 faceIndex)
+	{
+		const dgFace& face = m_faces[faceIndex];
+		if (face.m_state != m_accepted)
+		{
+			return;
+		}
+
+		// a face that goes through a vertex more than once has several edges 
+		// that write the same slot, the serial path writes them in edge key order
+		dInt64 slotKey[256];
+		dInt32 slotNormal[256];
+		dInt32* const indexArray0 = &m_indices[face.m_indexStart];
+		for (dInt32 j = 0; j < face.m_indexCount; j++)
+		{
+			slotKey[j] = -1;
+		}
+
+		for (dInt32 j = 0; j < face.m_indexCount; j++)
+		{
+			const dInt32 v0 = indexArray0[j];
+			const dInt32 v1 = indexArray0[(j + 1 < face.m_indexCount) ? j + 1 : 0];
+			const dInt32 twin = FindAcceptedEdge(v1, v0);
+			if (twin < 0)
+			{
+				continue;
+			}
+
+			const dgFace& twinFace = m_faces[m_edgeFace[twin]];
+			const dInt32* const indexArray1 = &m_indices[twinFace.m_indexStart];
+			if (IsEdgeConvex(m_vertexArray, indexArray0, face.m_indexCount, indexArray1, twinFace.m_indexCount))
+			{
+				dInt32 slot = j;
+				for (dInt32 k = j + 1; k < face.m_indexCount; k++)
+				{
+					slot = (indexArray0[k] == v0) ? k : slot;
+				}
+				const dInt64 key = dMin(dPolyhedra::dgPairKey(v0, v1).GetVal(), dPolyhedra::dgPairKey(v1, v0).GetVal());
+				if (key > slotKey[slot])
+				{
+					slotKey[slot] = key;
+					slotNormal[slot] = indexArray1[twinFace.m_indexCount + 1];
+				}
+			}
+		}
+
+		for (dInt32 j = 0; j < face.m_indexCount; j++)
+		{
+			if (slotKey[j] >= 0)
+			{
+				indexArray0[face.m_indexCount + 2 + j] = slotNormal[j];
+			}
+		}
+	}
+
+	dArray<dgFace> m_faces;
+	dInt32* m_indices;
+	const dTriplex* m_vertexArray;
+	dAtomic<dInt32>* m_cursor;
+	dInt32* m_bucketStart;
+	dInt32* m_sortedEdges;
+	dInt32* m_edgeFace;
+	dInt32 m_vertexCount;
+	dInt32 m_edgeCount;
+};
+
 dAabbPolygonSoup::dAabbPolygonSoup ()
 	:dPolygonSoupDatabase()
 	,m_aabb(nullptr)
 	,m_indices(nullptr)
 	,m_nodesCount(0)
 	,m_indexCount(0)
+	,m_externalImage(false)
 {
 }
 
 dAabbPolygonSoup::~dAabbPolygonSoup ()
 {
-	if (m_aabb) 
+	if (m_externalImage)
+	{
+		// the base class must not free the vertex array either
+		m_localVertex = nullptr;
+	}
+	else if (m_aabb) 
 	{
 		dMemory::Free(m_aabb);
 		dMemory::Free(m_indices);
@@ -485,29 +1072,82 @@ void dAabbPolygonSoup::GetAABB (dVector& p0, dVector& p1) const
 	}
 }
 
-void dAabbPolygonSoup::CalculateAdjacendy ()
+bool dAabbPolygonSoup::IsEdgeConvex(const dTriplex* const vertexArray, const dInt32* const indexArray0, dInt32 indexCount0, const dInt32* const indexArray1, dInt32 indexCount1)
+{
+	dVector n0(&vertexArray[indexArray0[indexCount0 + 1]].m_x);
+	dVector q0(&vertexArray[indexArray0[0]].m_x);
+	n0 = n0 & dVector::m_triplexMask;
+	q0 = q0 & dVector::m_triplexMask;
+
+	dVector n1(&vertexArray[indexArray1[indexCount1 + 1]].m_x);
+	dVector q1(&vertexArray[indexArray1[0]].m_x);
+	n1 = n1 & dVector::m_triplexMask;
+	q1 = q1 & dVector::m_triplexMask;
+
+	dPlane plane0(n0, -n0.DotProduct(q0).GetScalar());
+	dPlane plane1(n1, -n1.DotProduct(q1).GetScalar());
+
+	dFloat32 maxDist0 = dFloat32(-1.0f);
+	for (dInt32 i = 0; i < indexCount1; i++)
+	{
+		dVector point(&vertexArray[indexArray1[i]].m_x);
+		dFloat32 dist(plane0.Evalue(point & dVector::m_triplexMask));
+		maxDist0 = dMax(maxDist0, dist);
+	}
+
+	dFloat32 maxDist1 = dFloat32(-1.0f);
+	for (dInt32 i = 0; i < indexCount0; i++)
+	{
+		dVector point(&vertexArray[indexArray0[i]].m_x);
+		dFloat32 dist(plane1.Evalue(point & dVector::m_triplexMask));
+		maxDist1 = dMax(maxDist1, dist);
+	}
+
+	bool edgeIsConvex = (maxDist0 <= dFloat32(1.0e-3f));
+	edgeIsConvex = edgeIsConvex && (maxDist1 <= dFloat32(1.0e-3f));
+	edgeIsConvex = edgeIsConvex || (n0.DotProduct(n1).GetScalar() > dFloat32(0.9991f));
+
+	//hacks for testing adjacency
+	//edgeIsConvex = edgeIsConvex || (n0.DotProduct(n1).GetScalar() > dFloat32(0.5f));
+	//edgeIsConvex = true;
+	return edgeIsConvex;
+}
+
+void dAabbPolygonSoup::CalculateAdjacendy (dThreadPool* const threadPool)
 {
-	dVector p0;
-	dVector p1;
-	GetAABB (p0, p1);
-	dFastAabbInfo box (p0, p1);
-
-	dPolyhedra adjacenyMesh;
-	adjacenyMesh.BeginFace();
-	ForAllSectors(box, dVector::m_zero, dFloat32(1.0f), CalculateAllFaceEdgeNormals, &adjacenyMesh);
-	adjacenyMesh.EndFace();
-
-	dInt32 mark = adjacenyMesh.IncLRU();
-	dPolyhedra::Iterator iter(adjacenyMesh);
 	const dTriplex* const vertexArray = (dTriplex*)GetLocalVertexPool();
-	for (iter.Begin(); iter; iter++)
+	if (threadPool)
+	{
+		threadPool->Begin();
+		dgParallelAdjacency adjacency(this);
+		adjacency.Execute(*threadPool);
+		threadPool->End();
+	}
+	else
 	{
-		dEdge* const edge = &(*iter);
-		if ((edge->m_mark != mark) && (edge->m_incidentFace >= 0) && (edge->m_twin->m_incidentFace >= 0))
+		dVector p0;
+		dVector p1;
+		GetAABB (p0, p1);
+		dFastAabbInfo box (p0, p1);
+
+		dPolyhedra adjacenyMesh;
+		adjacenyMesh.BeginFace();
+		ForAllSectors(box, dVector::m_zero, dFloat32(1.0f), CalculateAllFaceEdgeNormals, &adjacenyMesh);
+		adjacenyMesh.EndFace();
+
+		dInt32 mark = adjacenyMesh.IncLRU();
+		dPolyhedra::Iterator iter(adjacenyMesh);
+		for (iter.Begin(); iter; iter++)
 		{
-			#if 0
+			dEdge* const edge = &(*iter);
+			if ((edge->m_mark != mark) && (edge->m_incidentFace >= 0) && (edge->m_twin->m_incidentFace >= 0))
 			{
 				dInt32 indexCount0 = 0;
+				dInt32 indexCount1 = 0;
+				dInt32 offsetIndex0 = -1;
+				dInt32 offsetIndex1 = -1;
+				dInt32* const indexArray0 = (dInt32*)edge->m_userData;
+				dInt32* const indexArray1 = (dInt32*)edge->m_twin->m_userData;
 				dEdge* ptr = edge;
 				do
 				{
@@ -515,13 +1155,6 @@ void dAabbPolygonSoup::CalculateAdjacendy ()
 					ptr = ptr->m_next;
 				} while (ptr != edge);
 
-				dInt32* const indexArray0 = (dInt32*)edge->m_userData;
-				dVector n0(&vertexArray[indexArray0[indexCount0 + 1]].m_x);
-				dVector q0(&vertexArray[indexArray0[0]].m_x);
-				n0 = n0 & dVector::m_triplexMask;
-				q0 = q0 & dVector::m_triplexMask;
-
-				dInt32 indexCount1 = 0;
 				ptr = edge->m_twin;
 				do
 				{
@@ -529,132 +1162,33 @@ void dAabbPolygonSoup::CalculateAdjacendy ()
 					ptr = ptr->m_next;
 				} while (ptr != edge->m_twin);
 
-				dInt32* const indexArray1 = (dInt32*)edge->m_twin->m_userData;
-				dVector n1(&vertexArray[indexArray1[indexCount1 + 1]].m_x);
-				dVector q1(&vertexArray[indexArray1[0]].m_x);
-				n1 = n1 & dVector::m_triplexMask;
-				q1 = q1 & dVector::m_triplexMask;
-
-				dPlane plane0(n0, -n0.DotProduct(q0).GetScalar());
-				dFloat32 maxDist0 = dFloat32(-1.0f);
-				dInt32 offsetIndex1 = -1;
 				for (dInt32 i = 0; i < indexCount1; i++)
 				{
 					if (edge->m_twin->m_incidentVertex == indexArray1[i])
 					{
 						offsetIndex1 = i;
 					}
-					dVector point(&vertexArray[indexArray1[i]].m_x);
-					dFloat32 dist(plane0.Evalue(point & dVector::m_triplexMask));
-					if (dist > maxDist0)
-					{
-						maxDist0 = dist;
-					}
 				}
-				if (maxDist0 < dFloat32(1.0e-3f))
-				{
-					dPlane plane1(n1, -n1.DotProduct(q1).GetScalar());
-					dFloat32 maxDist1 = dFloat32(-1.0f);
-					dInt32 offsetIndex0 = -1;
-					for (dInt32 i = 0; i < indexCount0; i++)
-					{
-						if (edge->m_incidentVertex == indexArray0[i])
-						{
-							offsetIndex0 = i;
-						}
 
-						dVector point(&vertexArray[indexArray0[i]].m_x);
-						dFloat32 dist(plane1.Evalue(point & dVector::m_triplexMask));
-						if (dist > maxDist1)
-						{
-							maxDist1 = dist;
-						}
-					}
-					if (maxDist1 < dFloat32(1.0e-3f))
+				for (dInt32 i = 0; i < indexCount0; i++)
+				{
+					if (edge->m_incidentVertex == indexArray0[i])
 					{
-						dAssert(offsetIndex0 >= 0);
-						dAssert(offsetIndex1 >= 0);
-						indexArray0[indexCount0 + 2 + offsetIndex0] = indexArray1[indexCount1 + 1];
-						indexArray1[indexCount1 + 2 + offsetIndex1] = indexArray0[indexCount0 + 1];
+						offsetIndex0 = i;
 					}
 				}
-			}
-			#endif
-
-			dInt32 indexCount0 = 0;
-			dInt32 indexCount1 = 0;
-			dInt32 offsetIndex0 = -1;
-			dInt32 offsetIndex1 = -1;
-			dInt32* const indexArray0 = (dInt32*)edge->m_userData;
-			dInt32* const indexArray1 = (dInt32*)edge->m_twin->m_userData;
-			dEdge* ptr = edge;
-			do
-			{
-				indexCount0++;
-				ptr = ptr->m_next;
-			} while (ptr != edge);
-
-			ptr = edge->m_twin;
-			do
-			{
-				indexCount1++;
-				ptr = ptr->m_next;
-			} while (ptr != edge->m_twin);
-
-			dVector n0(&vertexArray[indexArray0[indexCount0 + 1]].m_x);
-			dVector q0(&vertexArray[indexArray0[0]].m_x);
-			n0 = n0 & dVector::m_triplexMask;
-			q0 = q0 & dVector::m_triplexMask;
-
-			dVector n1(&vertexArray[indexArray1[indexCount1 + 1]].m_x);
-			dVector q1(&vertexArray[indexArray1[0]].m_x);
-			n1 = n1 & dVector::m_triplexMask;
-			q1 = q1 & dVector::m_triplexMask;
-
-			dPlane plane0(n0, -n0.DotProduct(q0).GetScalar());
-			dPlane plane1(n1, -n1.DotProduct(q1).GetScalar());
-
-			dFloat32 maxDist0 = dFloat32(-1.0f);
-			for (dInt32 i = 0; i < indexCount1; i++)
-			{
-				if (edge->m_twin->m_incidentVertex == indexArray1[i])
-				{
-					offsetIndex1 = i;
-				}
-				dVector point(&vertexArray[indexArray1[i]].m_x);
-				dFloat32 dist(plane0.Evalue(point & dVector::m_triplexMask));
-				maxDist0 = dMax(maxDist0, dist);
-			}
 
-			dFloat32 maxDist1 = dFloat32(-1.0f);
-			for (dInt32 i = 0; i < indexCount0; i++)
-			{
-				if (edge->m_incidentVertex == indexArray0[i])
+				if (IsEdgeConvex(vertexArray, indexArray0, indexCount0, indexArray1, indexCount1))
 				{
-					offsetIndex0 = i;
+					dAssert(offsetIndex0 >= 0);
+					dAssert(offsetIndex1 >= 0);
+					indexArray0[indexCount0 + 2 + offsetIndex0] = indexArray1[indexCount1 + 1];
+					indexArray1[indexCount1 + 2 + offsetIndex1] = indexArray0[indexCount0 + 1];
 				}
-				dVector point(&vertexArray[indexArray0[i]].m_x);
-				dFloat32 dist(plane1.Evalue(point & dVector::m_triplexMask));
-				maxDist1 = dMax(maxDist1, dist);
-			}
-
-			bool edgeIsConvex = (maxDist0 <= dFloat32(1.0e-3f));
-			edgeIsConvex = edgeIsConvex && (maxDist1 <= dFloat32(1.0e-3f));
-			edgeIsConvex = edgeIsConvex || (n0.DotProduct(n1).GetScalar() > dFloat32(0.9991f));
-
-			//hacks for testing adjacency
-			//edgeIsConvex = edgeIsConvex || (n0.DotProduct(n1).GetScalar() > dFloat32(0.5f));
-			//edgeIsConvex = true;
-			if (edgeIsConvex)
-			{
-				dAssert(offsetIndex0 >= 0);
-				dAssert(offsetIndex1 >= 0);
-				indexArray0[indexCount0 + 2 + offsetIndex0] = indexArray1[indexCount1 + 1];
-				indexArray1[indexCount1 + 2 + offsetIndex1] = indexArray0[indexCount0 + 1];
 			}
+			edge->m_mark = mark;
+			edge->m_twin->m_mark = mark;
 		}
-		edge->m_mark = mark;
-		edge->m_twin->m_mark = mark;
 	}
 
 	dStack<dTriplex> pool ((m_indexCount / 2) - 1);
@@ -989,24 +1523,41 @@ void dAabbPolygonSoup::Create (const dPolygonSoupBuilder& builder)
 	const dInt32* const indices = &builder.m_vertexIndex[0];
 	dStack<dgNodeBuilder> constructor (builder.m_faceVertexCount.GetCount() * 2 + 16); 
 
-	dInt32 polygonIndex = 0;
-	dInt32 allocatorIndex = 0;
-	if (builder.m_faceVertexCount.GetCount() == 1) 
+	dThreadPool* const threadPool = (builder.m_faceVertexCount.GetCount() > 1) ? builder.GetThreadPool() : nullptr;
+	if (threadPool)
 	{
-		dInt32 indexCount = builder.m_faceVertexCount[0] - 1;
-		new (&constructor[allocatorIndex]) dgNodeBuilder (&tmpVertexArray[0], 0, indexCount, &indices[0]);
-		allocatorIndex ++;
+		threadPool->Begin();
 	}
-	for (dInt32 i = 0; i < builder.m_faceVertexCount.GetCount(); i ++) 
+
+	dgNodeBuilder* root = nullptr;
+	dInt32 allocatorIndex = 0;
+	dgParallelBuilder parallelBuilder(threadPool, this, builder, tmpVertexArray, &constructor[0]);
+	if (threadPool)
 	{
-		dInt32 indexCount = builder.m_faceVertexCount[i] - 1;
-		new (&constructor[allocatorIndex]) dgNodeBuilder (&tmpVertexArray[0], i, indexCount, &indices[polygonIndex]);
-		allocatorIndex ++;
-		polygonIndex += (indexCount + 1);
+		parallelBuilder.BuildLeafs();
+		allocatorIndex = builder.m_faceVertexCount.GetCount();
+		root = parallelBuilder.BuildTree();
 	}
+	else
+	{
+		dInt32 polygonIndex = 0;
+		if (builder.m_faceVertexCount.GetCount() == 1) 
+		{
+			dInt32 indexCount = builder.m_faceVertexCount[0] - 1;
+			new (&constructor[allocatorIndex]) dgNodeBuilder (&tmpVertexArray[0], 0, indexCount, &indices[0]);
+			allocatorIndex ++;
+		}
+		for (dInt32 i = 0; i < builder.m_faceVertexCount.GetCount(); i ++) 
+		{
+			dInt32 indexCount = builder.m_faceVertexCount[i] - 1;
+			new (&constructor[allocatorIndex]) dgNodeBuilder (&tmpVertexArray[0], i, indexCount, &indices[polygonIndex]);
+			allocatorIndex ++;
+			polygonIndex += (indexCount + 1);
+		}
 
-	dgNodeBuilder* contructorAllocator = &constructor[allocatorIndex];
-	dgNodeBuilder* root = BuildTopDown (&constructor[0], 0, allocatorIndex - 1, &contructorAllocator);
+		dgNodeBuilder* contructorAllocator = &constructor[allocatorIndex];
+		root = BuildTopDown (&constructor[0], 0, allocatorIndex - 1, &contructorAllocator);
+	}
 
 	dAssert (root);
 	dTrace(("*****->this is broken\n"));
@@ -1057,38 +1608,40 @@ void dAabbPolygonSoup::Create (const dPolygonSoupBuilder& builder)
 	//	}
 	//}
 
-	dList<dgNodeBuilder*> list;
-	list.Append(root);
+	// enumerate the nodes in breadth first order
+	dInt32 queueCount = 0;
+	dStack<dgNodeBuilder*> queue (allocatorIndex * 2);
+	queue[queueCount] = root;
+	queueCount ++;
 	dInt32 nodeIndex = 0;
-	while (list.GetCount())
+	for (dInt32 i = 0; i < queueCount; i ++)
 	{
-		dgNodeBuilder* const node = list.GetFirst()->GetInfo();
-		list.Remove(list.GetFirst());
-
+		dgNodeBuilder* const node = queue[i];
 		if (node->m_left) 
 		{
 			node->m_enumeration = nodeIndex;
 			nodeIndex ++;
 			dAssert (node->m_right);
-			list.Append(node->m_left);
-			list.Append(node->m_right);
+			queue[queueCount] = node->m_left;
+			queue[queueCount + 1] = node->m_right;
+			queueCount += 2;
 		}
 	}
-	dAssert(!list.GetCount());
 
 	dInt32 aabbBase = builder.m_vertexPoints.GetCount() + builder.m_normalPoints.GetCount();
 
 	dVector* const aabbPoints = &tmpVertexArray[aabbBase];
 
+	dInt32 leafCount = 0;
+	dStack<const dgNodeBuilder*> leafNodes (queueCount);
+	dStack<dInt32> leafIndexMap (queueCount);
+
 	dInt32 vertexIndex = 0;
 	dInt32 aabbNodeIndex = 0;
-	list.Append(root);
 	dInt32 indexMap = 0;
-	while (list.GetCount())
+	for (dInt32 i = 0; i < queueCount; i ++)
 	{
-		dgNodeBuilder* const node = list.GetFirst()->GetInfo();
-		list.Remove(list.GetFirst());
-
+		dgNodeBuilder* const node = queue[i];
 		if (node->m_enumeration >= 0)
 		{
 			dAssert (node->m_left);
@@ -1136,28 +1689,23 @@ void dAabbPolygonSoup::Create (const dPolygonSoupBuilder& builder)
 				}
 			}
 
-			// index format i0, i1, i2, ... , id, normal, e0Normal, e1Normal, e2Normal, ..., faceSize
-			for (dInt32 j = 0; j < node->m_indexCount; j ++) 
-			{
-				m_indices[indexMap + j] = node->m_faceIndices[j];
-				m_indices[indexMap + j + node->m_indexCount + 2] = D_CONCAVE_EDGE_MASK | 0xffffffff;
-			}
-
-			// face attribute
-			m_indices[indexMap + node->m_indexCount] = node->m_faceIndices[node->m_indexCount];
-			// face normal
-			m_indices[indexMap + node->m_indexCount + 1] = builder.m_vertexPoints.GetCount() + builder.m_normalIndex[node->m_faceIndex];
-			// face size
-			m_indices[indexMap + node->m_indexCount * 2 + 2] = dInt32 (CalculateFaceMaxSize (&tmpVertexArray[0], node->m_indexCount, node->m_faceIndices));
-
+			leafNodes[leafCount] = node;
+			leafIndexMap[leafCount] = indexMap;
+			leafCount ++;
 			indexMap += node->m_indexCount * 2 + 3;
 		}
+	}
 
-		if (node->m_left) 
+	if (threadPool)
+	{
+		dAssert (leafCount == builder.m_faceVertexCount.GetCount());
+		parallelBuilder.EmitLeafs(&leafNodes[0], &leafIndexMap[0]);
+	}
+	else
+	{
+		for (dInt32 i = 0; i < leafCount; i ++)
 		{
-			dAssert (node->m_right);
-			list.Append(node->m_left);
-			list.Append(node->m_right);
+			CreateLeafFace (&m_indices[leafIndexMap[i]], leafNodes[i], builder, &tmpVertexArray[0]);
 		}
 	}
 
@@ -1190,6 +1738,165 @@ void dAabbPolygonSoup::Create (const dPolygonSoupBuilder& builder)
 	{
 		m_aabb[0].m_right = dNode::dgLeafNodePtr (0, 0);
 	}
+
+	if (threadPool)
+	{
+		threadPool->End();
+	}
+}
+
+void dAabbPolygonSoup::CreateLeafFace (dInt32* const face, const dgNodeBuilder* const node, const dPolygonSoupBuilder& builder, const dVector* const vertexArray) const
+{
+	// index format i0, i1, i2, ... , id, normal, e0Normal, e1Normal, e2Normal, ..., faceSize
+	for (dInt32 j = 0; j < node->m_indexCount; j ++) 
+	{
+		face[j] = node->m_faceIndices[j];
+		face[j + node->m_indexCount + 2] = D_CONCAVE_EDGE_MASK | 0xffffffff;
+	}
+
+	// face attribute
+	face[node->m_indexCount] = node->m_faceIndices[node->m_indexCount];
+	// face normal
+	face[node->m_indexCount + 1] = builder.m_vertexPoints.GetCount() + builder.m_normalIndex[node->m_faceIndex];
+	// face size
+	face[node->m_indexCount * 2 + 2] = dInt32 (CalculateFaceMaxSize (vertexArray, node->m_indexCount, node->m_faceIndices));
+}
+
+// the image is position independent, all arrays are at aligned offsets from the header
+// and nodes reference each other by index, so it can be used directly from a mapped file.
+class dAabbPolygonSoup::dImageHeader
+{
+	public:
+	char m_magic[8];
+	dInt32 m_version;
+	dInt32 m_vertexCount;
+	dInt32 m_indexCount;
+	dInt32 m_nodesCount;
+	dInt64 m_vertexOffset;
+	dInt64 m_nodesOffset;
+	dInt64 m_indexOffset;
+	dInt64 m_size;
+};
+
+static const char dAabbPolygonSoupMagic[8] = { 'd', 'A', 'a', 'b', 'b', 'S', 'p', 0 };
+
+static inline dInt64 dAabbPolygonSoupAlign(dInt64 size)
+{
+	return (size + D_AABB_SOUP_IMAGE_ALIGNMENT - 1) & -D_AABB_SOUP_IMAGE_ALIGNMENT;
+}
+
+static inline bool dAabbPolygonSoupSectionIsValid(dInt64 offset, dInt64 count, dInt64 itemSize, dInt64 start, dInt64 end)
+{
+	// an array starts after the header at an aligned offset and ends inside the image
+	if ((offset < start) || (offset > end) || (offset & (D_AABB_SOUP_IMAGE_ALIGNMENT - 1)))
+	{
+		return false;
+	}
+	return (count * itemSize) <= (end - offset);
+}
+
+static inline bool dAabbPolygonSoupFaceIsValid(const dInt32* const indices, dInt32 indexCount, dInt32 vertexCount, dUnsigned32 faceIndex, dUnsigned32 faceCount)
+{
+	// i0, i1, i2, ... , id, normal, e0Normal, e1Normal, e2Normal, ..., faceSize
+	if (!faceCount)
+	{
+		return faceIndex <= dUnsigned32(indexCount);
+	}
+	if ((faceCount < 3) || ((dInt64(faceIndex) + 2 * dInt64(faceCount) + 3) > dInt64(indexCount)))
+	{
+		return false;
+	}
+	const dInt32* const face = &indices[faceIndex];
+	for (dUnsigned32 i = 0; i < faceCount; i++)
+	{
+		const dInt32 vertex = face[i];
+		const dInt32 edgeNormal = face[faceCount + 2 + i] & (~D_CONCAVE_EDGE_MASK);
+		if ((vertex < 0) || (vertex >= vertexCount) || (edgeNormal >= vertexCount))
+		{
+			return false;
+		}
+	}
+	const dInt32 normal = face[faceCount + 1];
+	return (normal >= 0) && (normal < vertexCount);
+}
+
+bool dAabbPolygonSoup::ValidateImage(const void* const image, dInt64 size)
+{
+	dImageHeader header;
+	if ((size >= 0) && (size < dInt64(sizeof(header))))
+	{
+		return false;
+	}
+	memcpy(&header, image, sizeof(header));
+	if (memcmp(header.m_magic, dAabbPolygonSoupMagic, sizeof(dAabbPolygonSoupMagic)) || (header.m_version != D_AABB_SOUP_IMAGE_VERSION))
+	{
+		return false;
+	}
+	if ((header.m_vertexCount < 0) || (header.m_indexCount < 0) || (header.m_nodesCount < 0))
+	{
+		return false;
+	}
+	if ((header.m_size < dInt64(sizeof(header))) || ((size >= 0) && (header.m_size > size)))
+	{
+		return false;
+	}
+	if (!header.m_vertexCount)
+	{
+		// an empty mesh, the arrays are not read
+		return !header.m_nodesCount && !header.m_indexCount;
+	}
+	if (!header.m_nodesCount)
+	{
+		return false;
+	}
+
+	// the arrays are in this order, so that the vertex array, read as four floats, is never last
+	const dInt64 start = sizeof(header);
+	if (!dAabbPolygonSoupSectionIsValid(header.m_vertexOffset, header.m_vertexCount, sizeof(dTriplex), start, header.m_nodesOffset) ||
+		!dAabbPolygonSoupSectionIsValid(header.m_nodesOffset, header.m_nodesCount, sizeof(dNode), start, header.m_indexOffset) ||
+		!dAabbPolygonSoupSectionIsValid(header.m_indexOffset, header.m_indexCount, sizeof(dInt32), start, header.m_size))
+	{
+		return false;
+	}
+
+	// children always come after their parent, so the tree has no cycles, 
+	// and the depth is bounded by the traversal stacks
+	const char* const ptr = (const char*)image;
+	const dNode* const nodes = (const dNode*)&ptr[header.m_nodesOffset];
+	const dInt32* const indices = (const dInt32*)&ptr[header.m_indexOffset];
+	dStack<dInt32> depth(header.m_nodesCount);
+	memset(&depth[0], 0, size_t(header.m_nodesCount) * sizeof(dInt32));
+	for (dInt32 i = 0; i < header.m_nodesCount; i++)
+	{
+		const dNode& node = nodes[i];
+		if ((node.m_indexBox0 < 0) || (node.m_indexBox0 >= header.m_vertexCount) || (node.m_indexBox1 < 0) || (node.m_indexBox1 >= header.m_vertexCount))
+		{
+			return false;
+		}
+
+		const dNode::dgLeafNodePtr* const children[] = { &node.m_left, &node.m_right };
+		for (dInt32 j = 0; j < 2; j++)
+		{
+			const dNode::dgLeafNodePtr& child = *children[j];
+			if (child.IsLeaf())
+			{
+				if (!dAabbPolygonSoupFaceIsValid(indices, header.m_indexCount, header.m_vertexCount, child.GetIndex(), child.GetCount()))
+				{
+					return false;
+				}
+			}
+			else
+			{
+				const dInt32 index = dInt32(child.m_node);
+				if ((index <= i) || (index >= header.m_nodesCount) || (depth[i] >= (DG_STACK_DEPTH - 4)))
+				{
+					return false;
+				}
+				depth[index] = dMax(depth[index], depth[i] + 1);
+			}
+		}
+	}
+	return true;
 }
 
 void dAabbPolygonSoup::Serialize (const char* const path) const
@@ -1197,15 +1904,11 @@ void dAabbPolygonSoup::Serialize (const char* const path) const
 	FILE* const file = fopen(path, "wb");
 	if (file)
 	{
-		fwrite(&m_vertexCount, sizeof(dInt32), 1, file);
-		fwrite(&m_indexCount, sizeof(dInt32), 1, file);
-		fwrite(&m_nodesCount, sizeof(dInt32), 1, file);
-		if (m_aabb)
-		{
-			fwrite(m_localVertex, sizeof(dTriplex) * m_vertexCount, 1, file);
-			fwrite(m_indices, sizeof(dInt32) * m_indexCount, 1, file);
-			fwrite(m_aabb, sizeof(dNode) * m_nodesCount, 1, file);
-		}
+		const dInt64 size = SerializeToBuffer(nullptr);
+		void* const buffer = dMemory::Malloc(size_t(size));
+		SerializeToBuffer(buffer);
+		fwrite(buffer, size_t(size), 1, file);
+		dMemory::Free(buffer);
 		fclose(file);
 	}
 }
@@ -1216,30 +1919,159 @@ void dAabbPolygonSoup::Deserialize (const char* const path)
 	if (file)
 	{
 		size_t readValues = 0; 
-		m_strideInBytes = sizeof(dTriplex);
-		readValues = fread(&m_vertexCount, sizeof(dInt32), 1, file);
-		readValues = fread(&m_indexCount, sizeof(dInt32), 1, file);
-		readValues = fread(&m_nodesCount, sizeof(dInt32), 1, file);
-
-		if (m_vertexCount) 
+		char magic[sizeof(dAabbPolygonSoupMagic)];
+		readValues = fread(magic, sizeof(magic), 1, file);
+		if (readValues && !memcmp(magic, dAabbPolygonSoupMagic, sizeof(magic)))
 		{
-			m_localVertex = (dFloat32*)dMemory::Malloc(sizeof(dTriplex) * m_vertexCount);
-			m_indices = (dInt32*)dMemory::Malloc(sizeof(dInt32) * m_indexCount);
-			m_aabb = (dNode*)dMemory::Malloc(sizeof(dNode) * m_nodesCount);
+			fseek(file, 0, SEEK_END);
+			const long size = ftell(file);
+			fseek(file, 0, SEEK_SET);
+			void* const buffer = dMemory::Malloc(size_t(size));
+			readValues = fread(buffer, size_t(size), 1, file);
+			DeserializeFromBuffer(buffer, readValues ? size : 0);
+			dMemory::Free(buffer);
+		}
+		else
+		{
+			// files saved before the image format, just the three counts followed by the arrays
+			fseek(file, 0, SEEK_SET);
+			m_strideInBytes = sizeof(dTriplex);
+			readValues = fread(&m_vertexCount, sizeof(dInt32), 1, file);
+			readValues = fread(&m_indexCount, sizeof(dInt32), 1, file);
+			readValues = fread(&m_nodesCount, sizeof(dInt32), 1, file);
+
+			if (m_vertexCount) 
+			{
+				m_localVertex = (dFloat32*)dMemory::Malloc(sizeof(dTriplex) * m_vertexCount);
+				m_indices = (dInt32*)dMemory::Malloc(sizeof(dInt32) * m_indexCount);
+				m_aabb = (dNode*)dMemory::Malloc(sizeof(dNode) * m_nodesCount);
 
-			readValues = fread(m_localVertex, sizeof(dTriplex) * m_vertexCount, 1, file);
-			readValues = fread(m_indices, sizeof(dInt32) * m_indexCount, 1, file);
-			readValues = fread(m_aabb, sizeof(dNode) * m_nodesCount, 1, file);
+				readValues = fread(m_localVertex, sizeof(dTriplex) * m_vertexCount, 1, file);
+				readValues = fread(m_indices, sizeof(dInt32) * m_indexCount, 1, file);
+				readValues = fread(m_aabb, sizeof(dNode) * m_nodesCount, 1, file);
+			}
+			else 
+			{
+				m_localVertex = nullptr;
+				m_indices = nullptr;
+				m_aabb = nullptr;
+			}
 		}
-		else 
+		fclose(file);
+	}
+}
+
+dInt64 dAabbPolygonSoup::SerializeToBuffer(void* const buffer) const
+{
+	dImageHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.m_magic, dAabbPolygonSoupMagic, sizeof(dAabbPolygonSoupMagic));
+	header.m_version = D_AABB_SOUP_IMAGE_VERSION;
+	header.m_vertexCount = m_aabb ? m_vertexCount : 0;
+	header.m_indexCount = m_aabb ? m_indexCount : 0;
+	header.m_nodesCount = m_aabb ? m_nodesCount : 0;
+
+	// vertices are never the last array, the aabb code reads them as four floats
+	header.m_vertexOffset = dAabbPolygonSoupAlign(sizeof(header));
+	header.m_nodesOffset = dAabbPolygonSoupAlign(header.m_vertexOffset + dInt64(sizeof(dTriplex)) * header.m_vertexCount);
+	header.m_indexOffset = dAabbPolygonSoupAlign(header.m_nodesOffset + dInt64(sizeof(dNode)) * header.m_nodesCount);
+	header.m_size = dAabbPolygonSoupAlign(header.m_indexOffset + dInt64(sizeof(dInt32)) * header.m_indexCount);
+
+	if (buffer)
+	{
+		char* const ptr = (char*)buffer;
+		memset(ptr, 0, size_t(header.m_size));
+		memcpy(ptr, &header, sizeof(header));
+		if (m_aabb)
 		{
-			m_localVertex = nullptr;
-			m_indices = nullptr;
-			m_aabb = nullptr;
+			memcpy(&ptr[header.m_vertexOffset], m_localVertex, sizeof(dTriplex) * m_vertexCount);
+			memcpy(&ptr[header.m_nodesOffset], m_aabb, sizeof(dNode) * m_nodesCount);
+			memcpy(&ptr[header.m_indexOffset], m_indices, sizeof(dInt32) * m_indexCount);
 		}
+	}
+	return header.m_size;
+}
 
-		fclose(file);
+bool dAabbPolygonSoup::DeserializeFromBuffer(const void* const buffer, dInt64 size)
+{
+	if (!ValidateImage(buffer, size))
+	{
+		return false;
+	}
+
+	dImageHeader header;
+	const char* const ptr = (char*)buffer;
+	memcpy(&header, ptr, sizeof(header));
+
+	m_strideInBytes = sizeof(dTriplex);
+	m_vertexCount = header.m_vertexCount;
+	m_indexCount = header.m_indexCount;
+	m_nodesCount = header.m_nodesCount;
+	if (m_vertexCount)
+	{
+		m_localVertex = (dFloat32*)dMemory::Malloc(sizeof(dTriplex) * m_vertexCount);
+		m_indices = (dInt32*)dMemory::Malloc(sizeof(dInt32) * m_indexCount);
+		m_aabb = (dNode*)dMemory::Malloc(sizeof(dNode) * m_nodesCount);
+
+		memcpy(m_localVertex, &ptr[header.m_vertexOffset], sizeof(dTriplex) * m_vertexCount);
+		memcpy(m_aabb, &ptr[header.m_nodesOffset], sizeof(dNode) * m_nodesCount);
+		memcpy(m_indices, &ptr[header.m_indexOffset], sizeof(dInt32) * m_indexCount);
+	}
+	else
+	{
+		m_localVertex = nullptr;
+		m_indices = nullptr;
+		m_aabb = nullptr;
+	}
+	return true;
+}
+
+bool dAabbPolygonSoup::AttachImage(const void* const image, dInt64 size)
+{
+	dAssert(!m_aabb);
+	dAssert(!m_localVertex);
+
+	if ((size < 0) || !ValidateImage(image, size))
+	{
+		return false;
+	}
+
+	dImageHeader header;
+	memcpy(&header, image, sizeof(header));
+
+	// the arrays are used in place, the memory is owned by the caller
+	const char* const ptr = (char*)image;
+	m_externalImage = true;
+	m_strideInBytes = sizeof(dTriplex);
+	m_vertexCount = header.m_vertexCount;
+	m_indexCount = header.m_indexCount;
+	m_nodesCount = header.m_nodesCount;
+	if (m_vertexCount)
+	{
+		m_localVertex = (dFloat32*)&ptr[header.m_vertexOffset];
+		m_aabb = (dNode*)&ptr[header.m_nodesOffset];
+		m_indices = (dInt32*)&ptr[header.m_indexOffset];
+	}
+	return true;
+}
+
+dInt32 dAabbPolygonSoup::CalculateTrianglesCount() const
+{
+	// only touches the nodes array, so it does not fault the faces of a mapped image
+	dInt32 count = 0;
+	for (dInt32 i = 0; i < m_nodesCount; i++)
+	{
+		const dNode* const node = &m_aabb[i];
+		if (node->m_left.IsLeaf() && node->m_left.GetCount())
+		{
+			count += dInt32(node->m_left.GetCount()) - 2;
+		}
+		if (node->m_right.IsLeaf() && node->m_right.GetCount())
+		{
+			count += dInt32(node->m_right.GetCount()) - 2;
+		}
 	}
+	return count;
 }
 
 dVector dAabbPolygonSoup::ForAllSectorsSupportVectex (const dVector& dir) const
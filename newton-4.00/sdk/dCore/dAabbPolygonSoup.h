@@ -28,6 +28,7 @@
 #include "dIntersections.h"
 #include "dPolygonSoupDatabase.h"
 
+class dThreadPool;
 class dPolygonSoupBuilder;
 
 // index format: i0, i1, i2, ... , id, normal, e0Normal, e1Normal, e2Normal, ..., faceSize
@@ -191,17 +192,28 @@ class dAabbPolygonSoup: public dPolygonSoupDatabase
 
 	class dgSpliteInfo;
 	class dgNodeBuilder;
+	class dImageHeader;
+	class dgParallelBuilder;
+	class dgParallelAdjacency;
 
 	D_CORE_API virtual void GetAABB (dVector& p0, dVector& p1) const;
 	D_CORE_API virtual void Serialize (const char* const path) const;
 	D_CORE_API virtual void Deserialize (const char* const path);
+	D_CORE_API virtual dInt64 SerializeToBuffer (void* const buffer) const;
+	D_CORE_API virtual bool DeserializeFromBuffer (const void* const buffer, dInt64 size);
+	D_CORE_API virtual bool AttachImage (const void* const image, dInt64 size);
+	D_CORE_API dInt32 CalculateTrianglesCount () const;
+
+	// checks the header, array bounds, tree links and face indices of a serialized image,
+	// a negative size trusts the size saved in the header.
+	D_CORE_API static bool ValidateImage (const void* const image, dInt64 size);
 
 	protected:
 	D_CORE_API dAabbPolygonSoup ();
 	D_CORE_API virtual ~dAabbPolygonSoup ();
 
 	D_CORE_API void Create (const dPolygonSoupBuilder& builder);
-	D_CORE_API void CalculateAdjacendy ();
+	D_CORE_API void CalculateAdjacendy (dThreadPool* const threadPool = nullptr);
 	D_CORE_API virtual dVector ForAllSectorsSupportVectex(const dVector& dir) const;
 	D_CORE_API virtual void ForAllSectorsRayHit (const dFastRayTest& ray, dFloat32 maxT, dRayIntersectCallback callback, void* const context) const;
 	D_CORE_API virtual void ForAllSectors (const dFastAabbInfo& obbAabb, const dVector& boxDistanceTravel, dFloat32 maxT, dAaabbIntersectCallback callback, void* const context) const;
@@ -234,6 +246,8 @@ class dAabbPolygonSoup: public dPolygonSoupDatabase
 	private:
 	dgNodeBuilder* BuildTopDown (dgNodeBuilder* const leafArray, dInt32 firstBox, dInt32 lastBox, dgNodeBuilder** const allocator) const;
 	dFloat32 CalculateFaceMaxSize (const dVector* const vertex, dInt32 indexCount, const dInt32* const indexArray) const;
+	void CreateLeafFace (dInt32* const face, const dgNodeBuilder* const node, const dPolygonSoupBuilder& builder, const dVector* const vertexArray) const;
+	static bool IsEdgeConvex (const dTriplex* const vertexArray, const dInt32* const indexArray0, dInt32 indexCount0, const dInt32* const indexArray1, dInt32 indexCount1);
 	static dIntersectStatus CalculateDisjointedFaceEdgeNormals (void* const context, const dFloat32* const polygon, dInt32 strideInBytes, const dInt32* const indexArray, dInt32 indexCount, dFloat32 hitDistance);
 	static dIntersectStatus CalculateAllFaceEdgeNormals(void* const context, const dFloat32* const polygon, dInt32 strideInBytes, const dInt32* const indexArray, dInt32 indexCount, dFloat32 hitDistance);
 	void ImproveNodeFitness (dgNodeBuilder* const node) const;
@@ -242,6 +256,7 @@ class dAabbPolygonSoup: public dPolygonSoupDatabase
 	dInt32* m_indices;
 	dInt32 m_nodesCount;
 	dInt32 m_indexCount;
+	bool m_externalImage;
 	friend class ndContactSolver;
 };
 
@@ -0,0 +1,196 @@
+/* Copyright (c) <2003-2021> <Newton Game Dynamics>
+* 
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely
+*/
+
+#include "dCoreStdafx.h"
+#include "dMemory.h"
+#include "dCompression.h"
+
+// each sequence is a token byte, the literal run, a 16 bit back offset and the match length.
+// the high nibble of the token is the literal count and the low nibble the match length, 
+// a nibble value of 15 is followed by extra bytes of 255 ended by a byte smaller than 255.
+// the last sequence only has literals.
+#define D_LZ_MIN_MATCH		4
+#define D_LZ_HASH_BITS		14
+#define D_LZ_MAX_OFFSET		0xffff
+
+static inline dUnsigned32 dLzRead32(const dUnsigned8* const ptr)
+{
+	dUnsigned32 value;
+	memcpy(&value, ptr, sizeof(value));
+	return value;
+}
+
+static inline dUnsigned32 dLzHash(dUnsigned32 value)
+{
+	return (value * 2654435761u) >> (32 - D_LZ_HASH_BITS);
+}
+
+static inline dUnsigned8* dLzWriteLength(dUnsigned8* dst, dInt64 length)
+{
+	for (; length >= 255; length -= 255)
+	{
+		*dst++ = 255;
+	}
+	*dst++ = dUnsigned8(length);
+	return dst;
+}
+
+static inline dUnsigned8* dLzWriteLiterals(dUnsigned8* dst, dUnsigned8* const token, const dUnsigned8* const literals, dInt64 count)
+{
+	if (count >= 15)
+	{
+		*token = 15 << 4;
+		dst = dLzWriteLength(dst, count - 15);
+	}
+	else
+	{
+		*token = dUnsigned8(count << 4);
+	}
+	memcpy(dst, literals, size_t(count));
+	return dst + count;
+}
+
+dInt64 dCompressBound(dInt64 size)
+{
+	return size + size / 255 + 16;
+}
+
+dInt64 dCompress(const void* const srcBuffer, dInt64 size, void* const dstBuffer)
+{
+	const dUnsigned8* const src = (dUnsigned8*)srcBuffer;
+	dUnsigned8* const dstStart = (dUnsigned8*)dstBuffer;
+	dUnsigned8* dst = dstStart;
+
+	const dInt32 tableSize = 1 << D_LZ_HASH_BITS;
+	dInt64* const table = (dInt64*)dMemory::Malloc(sizeof(dInt64) * tableSize);
+	for (dInt32 i = 0; i < tableSize; i++)
+	{
+		table[i] = -1;
+	}
+
+	dInt64 index = 0;
+	dInt64 anchor = 0;
+	const dInt64 limit = size - D_LZ_MIN_MATCH;
+	while (index <= limit)
+	{
+		const dUnsigned32 value = dLzRead32(&src[index]);
+		const dUnsigned32 hash = dLzHash(value);
+		const dInt64 candidate = table[hash];
+		table[hash] = index;
+		if ((candidate >= 0) && ((index - candidate) <= D_LZ_MAX_OFFSET) && (dLzRead32(&src[candidate]) == value))
+		{
+			dInt64 length = D_LZ_MIN_MATCH;
+			while (((index + length) < size) && (src[candidate + length] == src[index + length]))
+			{
+				length++;
+			}
+
+			dUnsigned8* const token = dst++;
+			dst = dLzWriteLiterals(dst, token, &src[anchor], index - anchor);
+
+			const dInt64 offset = index - candidate;
+			*dst++ = dUnsigned8(offset & 0xff);
+			*dst++ = dUnsigned8(offset >> 8);
+
+			const dInt64 matchCount = length - D_LZ_MIN_MATCH;
+			if (matchCount >= 15)
+			{
+				*token |= 15;
+				dst = dLzWriteLength(dst, matchCount - 15);
+			}
+			else
+			{
+				*token |= dUnsigned8(matchCount);
+			}
+
+			index += length;
+			anchor = index;
+		}
+		else
+		{
+			index++;
+		}
+	}
+
+	dUnsigned8* const token = dst++;
+	dst = dLzWriteLiterals(dst, token, &src[anchor], size - anchor);
+
+	dMemory::Free(table);
+	dAssert((dst - dstStart) <= dCompressBound(size));
+	return dst - dstStart;
+}
+
+dInt64 dDecompress(const void* const srcBuffer, dInt64 size, void* const dstBuffer, dInt64 dstCapacity)
+{
+	const dUnsigned8* src = (dUnsigned8*)srcBuffer;
+	const dUnsigned8* const srcEnd = src + size;
+	dUnsigned8* const dstStart = (dUnsigned8*)dstBuffer;
+	dUnsigned8* const dstEnd = dstStart + dstCapacity;
+	dUnsigned8* dst = dstStart;
+
+	while (src < srcEnd)
+	{
+		const dUnsigned8 token = *src++;
+		dInt64 literalCount = token >> 4;
+		if (literalCount == 15)
+		{
+			dUnsigned8 code = 255;
+			while ((code == 255) && (src < srcEnd))
+			{
+				code = *src++;
+				literalCount += code;
+			}
+		}
+		if (((srcEnd - src) < literalCount) || ((dstEnd - dst) < literalCount))
+		{
+			return -1;
+		}
+		memcpy(dst, src, size_t(literalCount));
+		src += literalCount;
+		dst += literalCount;
+
+		if (src >= srcEnd)
+		{
+			break;
+		}
+
+		if ((srcEnd - src) < 2)
+		{
+			return -1;
+		}
+		const dInt64 offset = dInt64(src[0]) | (dInt64(src[1]) << 8);
+		src += 2;
+
+		dInt64 matchCount = token & 15;
+		if (matchCount == 15)
+		{
+			dUnsigned8 code = 255;
+			while ((code == 255) && (src < srcEnd))
+			{
+				code = *src++;
+				matchCount += code;
+			}
+		}
+		matchCount += D_LZ_MIN_MATCH;
+		if ((offset == 0) || (offset > (dst - dstStart)) || ((dstEnd - dst) < matchCount))
+		{
+			return -1;
+		}
+
+		// the match can overlap the output, so it has to be copied forward one byte at a time
+		const dUnsigned8* match = dst - offset;
+		for (dInt64 i = 0; i < matchCount; i++)
+		{
+			*dst++ = *match++;
+		}
+	}
+	return dst - dstStart;
+}
@@ -0,0 +1,30 @@
+/* Copyright (c) <2003-2021> <Newton Game Dynamics>
+* 
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely
+*/
+
+#ifndef __dCOMPRESSION_H__
+#define __dCOMPRESSION_H__
+
+#include "dCoreStdafx.h"
+#include "dTypes.h"
+
+// simple byte oriented lz77 codec, fast to decode and good enough 
+// for the repeated patterns found in arrays of simulation records.
+
+// worse case size of a compressed buffer
+D_CORE_API dInt64 dCompressBound(dInt64 size);
+
+// return the size of the compressed data, dst must be at least dCompressBound(size) bytes
+D_CORE_API dInt64 dCompress(const void* const src, dInt64 size, void* const dst);
+
+// return the size of the decompressed data or -1 if the stream is corrupted
+D_CORE_API dInt64 dDecompress(const void* const src, dInt64 size, void* const dst, dInt64 dstCapacity);
+
+#endif
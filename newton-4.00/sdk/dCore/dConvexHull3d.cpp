@@ -24,11 +24,13 @@
 #include "dTree.h"
 #include "dStack.h"
 #include "dGoogol.h"
+#include "dThreadPool.h"
 #include "dConvexHull3d.h"
 #include "dSmallDeterminant.h"
 
 
 #define DG_CONVEXHULL_3D_VERTEX_CLUSTER_SIZE		8
+#define DG_CONVEXHULL_3D_PARALLEL_CHUNK_SIZE		4096
 
 #ifdef	D_OLD_CONVEXHULL_3D
 class dConvexHull3d::dNormalMap
@@ -123,6 +125,57 @@ class dgConvexHull3dPointCluster: public dConvexHull3dAABBTreeNode
 };
 
 
+// hull one chunk of the cloud and keep the hull vertices, 
+// the chunks have a fixed size so the result does not depend on the thread count
+class dgConvexHull3dReduceJob: public dThreadPoolJob
+{
+	public:
+	class dgContext
+	{
+		public:
+		const dFloat64* m_vertexCloud;
+		dBigVector* m_candidates;
+		dInt32* m_candidatesCount;
+		dInt32 m_strideInBytes;
+		dInt32 m_count;
+		dInt32 m_chunksCount;
+		dAtomic<dInt32> m_chunk;
+	};
+
+	virtual void Execute()
+	{
+		D_TRACKTIME();
+		dgContext* const context = (dgContext*)m_context;
+		const dInt32 stride = dInt32(context->m_strideInBytes / sizeof(dFloat64));
+		for (dInt32 i = context->m_chunk.fetch_add(1); i < context->m_chunksCount; i = context->m_chunk.fetch_add(1))
+		{
+			const dInt32 start = i * DG_CONVEXHULL_3D_PARALLEL_CHUNK_SIZE;
+			const dInt32 count = dMin(context->m_count - start, dInt32 (DG_CONVEXHULL_3D_PARALLEL_CHUNK_SIZE));
+			const dFloat64* const cloud = &context->m_vertexCloud[start * stride];
+			dBigVector* const candidates = &context->m_candidates[start];
+
+			dConvexHull3d hull(cloud, context->m_strideInBytes, count, dFloat64(0.0f));
+			dInt32 candidatesCount = hull.GetCount() ? hull.GetVertexCount() : 0;
+			for (dInt32 j = 0; j < candidatesCount; j++)
+			{
+				candidates[j] = hull.GetVertex(j);
+			}
+			if (!candidatesCount)
+			{
+				// a flat chunk, all its points are candidates
+				for (dInt32 j = 0; j < count; j++)
+				{
+					candidates[j] = dBigVector(cloud[j * stride + 0], cloud[j * stride + 1], cloud[j * stride + 2], dFloat64(0.0f));
+				}
+				candidatesCount = count;
+			}
+			context->m_candidatesCount[i] = candidatesCount;
+		}
+	}
+
+	void* m_context;
+};
+
 dConvexHull3dFace::dConvexHull3dFace()
 {
 	m_mark = 0;
@@ -224,7 +277,7 @@ dConvexHull3d::dConvexHull3d(const dConvexHull3d& source)
 	}
 }
 
-dConvexHull3d::dConvexHull3d(const dFloat64* const vertexCloud, dInt32 strideInBytes, dInt32 count, dFloat64 distTol, dInt32 maxVertexCount)
+dConvexHull3d::dConvexHull3d(const dFloat64* const vertexCloud, dInt32 strideInBytes, dInt32 count, dFloat64 distTol, dInt32 maxVertexCount, dThreadPool* const threadPool)
 	:dList<dConvexHull3dFace>()
 	,m_aabbP0(dBigVector::m_zero)
 	,m_aabbP1(dBigVector::m_zero)
@@ -232,14 +285,66 @@ dConvexHull3d::dConvexHull3d(const dFloat64* const vertexCloud, dInt32 strideInB
 	,m_diag()
 	,m_points()
 {
-	BuildHull (vertexCloud, strideInBytes, count, distTol, maxVertexCount);
+	BuildHull (vertexCloud, strideInBytes, count, distTol, maxVertexCount, threadPool);
 }
 
 dConvexHull3d::~dConvexHull3d(void)
 {
 }
 
-void dConvexHull3d::BuildHull (const dFloat64* const vertexCloud, dInt32 strideInBytes, dInt32 count, dFloat64 distTol, dInt32 maxVertexCount)
+void dConvexHull3d::BuildHull (const dFloat64* const vertexCloud, dInt32 strideInBytes, dInt32 count, dFloat64 distTol, dInt32 maxVertexCount, dThreadPool* const threadPool)
+{
+	// every hull vertex is a vertex of the hull of the chunk that has it, so the 
+	// hull of the chunk hull vertices is the hull of the cloud. hulls with a vertex
+	// budget are already fast, they do not visit most of the points.
+	const bool parallel = threadPool && (threadPool->GetCount() > 1) && (maxVertexCount >= count);
+	if (parallel && (count >= 2 * DG_CONVEXHULL_3D_PARALLEL_CHUNK_SIZE))
+	{
+		dArray<dBigVector> candidates;
+		const dInt32 candidatesCount = ReduceVertexCloud(threadPool, vertexCloud, strideInBytes, count, candidates);
+		BuildHullSerial(&candidates[0].m_x, sizeof(dBigVector), candidatesCount, distTol, maxVertexCount);
+	}
+	else
+	{
+		BuildHullSerial(vertexCloud, strideInBytes, count, distTol, maxVertexCount);
+	}
+}
+
+dInt32 dConvexHull3d::ReduceVertexCloud(dThreadPool* const threadPool, const dFloat64* const vertexCloud, dInt32 strideInBytes, dInt32 count, dArray<dBigVector>& candidates) const
+{
+	D_TRACKTIME();
+	const dInt32 chunksCount = (count + DG_CONVEXHULL_3D_PARALLEL_CHUNK_SIZE - 1) / DG_CONVEXHULL_3D_PARALLEL_CHUNK_SIZE;
+	dStack<dInt32> candidatesCount(chunksCount);
+	candidates.SetCount(count);
+
+	dgConvexHull3dReduceJob::dgContext context;
+	context.m_vertexCloud = vertexCloud;
+	context.m_candidates = &candidates[0];
+	context.m_candidatesCount = &candidatesCount[0];
+	context.m_strideInBytes = strideInBytes;
+	context.m_count = count;
+	context.m_chunksCount = chunksCount;
+	context.m_chunk.store(0);
+	threadPool->Begin();
+	dgConvexHull3dReduceJob reduceJob;
+	reduceJob.m_context = &context;
+	threadPool->SubmitJobs(reduceJob);
+	threadPool->End();
+
+	dInt32 candidatesAcc = 0;
+	for (dInt32 i = 0; i < chunksCount; i++)
+	{
+		const dInt32 start = i * DG_CONVEXHULL_3D_PARALLEL_CHUNK_SIZE;
+		for (dInt32 j = 0; j < candidatesCount[i]; j++)
+		{
+			candidates[candidatesAcc] = candidates[start + j];
+			candidatesAcc++;
+		}
+	}
+	return candidatesAcc;
+}
+
+void dConvexHull3d::BuildHullSerial (const dFloat64* const vertexCloud, dInt32 strideInBytes, dInt32 count, dFloat64 distTol, dInt32 maxVertexCount)
 {
 	dSetPrecisionDouble precision;
 
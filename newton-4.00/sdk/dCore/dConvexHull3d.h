@@ -32,6 +32,7 @@
 
 #define D_OLD_CONVEXHULL_3D
 
+class dThreadPool;
 class dConvexHull3dVertex;
 class dConvexHull3dAABBTreeNode;
 
@@ -65,7 +66,10 @@ class dConvexHull3d: public dClassAlloc, public dList<dConvexHull3dFace>
 
 	public:
 	D_CORE_API dConvexHull3d(const dConvexHull3d& source);
-	D_CORE_API dConvexHull3d(const dFloat64* const vertexCloud, dInt32 strideInBytes, dInt32 count, dFloat64 distTol, dInt32 maxVertexCount = 0x7fffffff);
+	// when a thread pool is passed, large clouds are split in chunks that are hulled in parallel 
+	// and the hull is made from the vertices of the chunk hulls. the pool must be idle, 
+	// the hull calls Begin and End on it.
+	D_CORE_API dConvexHull3d(const dFloat64* const vertexCloud, dInt32 strideInBytes, dInt32 count, dFloat64 distTol, dInt32 maxVertexCount = 0x7fffffff, dThreadPool* const threadPool = nullptr);
 	D_CORE_API virtual ~dConvexHull3d();
 
 	dInt32 GetVertexCount() const;
@@ -79,7 +83,9 @@ class dConvexHull3d: public dClassAlloc, public dList<dConvexHull3dFace>
 
 	protected:
 	dConvexHull3d();
-	void BuildHull (const dFloat64* const vertexCloud, dInt32 strideInBytes, dInt32 count, dFloat64 distTol, dInt32 maxVertexCount);
+	void BuildHull (const dFloat64* const vertexCloud, dInt32 strideInBytes, dInt32 count, dFloat64 distTol, dInt32 maxVertexCount, dThreadPool* const threadPool = nullptr);
+	void BuildHullSerial (const dFloat64* const vertexCloud, dInt32 strideInBytes, dInt32 count, dFloat64 distTol, dInt32 maxVertexCount);
+	dInt32 ReduceVertexCloud (dThreadPool* const threadPool, const dFloat64* const vertexCloud, dInt32 strideInBytes, dInt32 count, dArray<dBigVector>& candidates) const;
 
 	virtual dNode* AddFace (dInt32 i0, dInt32 i1, dInt32 i2);
 	virtual void DeleteFace (dNode* const node) ;
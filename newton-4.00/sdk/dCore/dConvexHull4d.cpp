@@ -25,10 +25,12 @@
 #include "dHeap.h"
 #include "dStack.h"
 #include "dGoogol.h"
+#include "dThreadPool.h"
 #include "dConvexHull4d.h"
 #include "dSmallDeterminant.h"
 
 #define D_VERTEX_CLUMP_SIZE_4D		8 
+#define D_PARALLEL_CHUNK_SIZE_4D	4096
 
 
 dConvexHull4d::dgNormalMap::dgNormalMap()
@@ -146,6 +148,61 @@ class dgConvexHull4dPointCluster: public dConvexHull4dAABBTreeNode
 	dInt32 m_indices[D_VERTEX_CLUMP_SIZE_4D];
 };
 
+// hull one chunk of the cloud and keep the hull vertices, 
+// the chunks have a fixed size so the result does not depend on the thread count
+class dgConvexHull4dReduceJob: public dThreadPoolJob
+{
+	public:
+	class dgContext
+	{
+		public:
+		const dFloat64* m_vertexCloud;
+		dBigVector* m_candidates;
+		dInt32* m_candidateIndex;
+		dInt32* m_candidatesCount;
+		dInt32 m_strideInBytes;
+		dInt32 m_count;
+		dInt32 m_chunksCount;
+		dAtomic<dInt32> m_chunk;
+	};
+
+	virtual void Execute()
+	{
+		D_TRACKTIME();
+		dgContext* const context = (dgContext*)m_context;
+		const dInt32 stride = dInt32(context->m_strideInBytes / sizeof(dFloat64));
+		for (dInt32 i = context->m_chunk.fetch_add(1); i < context->m_chunksCount; i = context->m_chunk.fetch_add(1))
+		{
+			const dInt32 start = i * D_PARALLEL_CHUNK_SIZE_4D;
+			const dInt32 count = dMin(context->m_count - start, dInt32 (D_PARALLEL_CHUNK_SIZE_4D));
+			const dFloat64* const cloud = &context->m_vertexCloud[start * stride];
+			dBigVector* const candidates = &context->m_candidates[start];
+			dInt32* const candidateIndex = &context->m_candidateIndex[start];
+
+			dConvexHull4d hull(cloud, context->m_strideInBytes, count, dFloat64(0.0f));
+			dInt32 candidatesCount = hull.GetCount() ? hull.GetVertexCount() : 0;
+			for (dInt32 j = 0; j < candidatesCount; j++)
+			{
+				candidates[j] = hull.GetVertex(j);
+				candidateIndex[j] = start + hull.GetVertexIndex(j);
+			}
+			if (!candidatesCount)
+			{
+				// a flat chunk, all its points are candidates
+				for (dInt32 j = 0; j < count; j++)
+				{
+					candidates[j] = dBigVector(cloud[j * stride + 0], cloud[j * stride + 1], cloud[j * stride + 2], cloud[j * stride + 3]);
+					candidateIndex[j] = start + j;
+				}
+				candidatesCount = count;
+			}
+			context->m_candidatesCount[i] = candidatesCount;
+		}
+	}
+
+	void* m_context;
+};
+
 dConvexHull4dTetraherum::dgTetrahedrumPlane::dgTetrahedrumPlane (const dBigVector& p0, const dBigVector& p1, const dBigVector& p2, const dBigVector& p3)
 	:dBigVector ((p1 - p0).CrossProduct (p2 - p0, p3 - p0))
 {
@@ -179,10 +236,9 @@ dConvexHull4dTetraherum::dConvexHull4dTetraherum()
 	m_debugID = debugID;
 	debugID ++;
 #endif
-	static dInt32 m_monotonicID;
-
-	m_uniqueID = m_monotonicID;
-	m_monotonicID ++;
+	// set by the hull that owns the face, a static counter is not safe 
+	// when hulls are built in more than one thread.
+	m_uniqueID = 0;
 }
 
 void dConvexHull4dTetraherum::Init (const dConvexHull4dVector* const, dInt32 v0, dInt32 v1, dInt32 v2, dInt32 v3)
@@ -339,6 +395,7 @@ dConvexHull4d::dConvexHull4d ()
 	:dList<dConvexHull4dTetraherum>()
 	,m_mark(0)
 	,m_count(0)
+	,m_faceUniqueID(0)
 	,m_diag(dFloat32 (0.0f))
 	,m_points() 
 {
@@ -350,14 +407,15 @@ dConvexHull4d::dConvexHull4d(const dConvexHull4d&)
 	dAssert(0);
 }
 
-dConvexHull4d::dConvexHull4d (const dFloat64* const vertexCloud, dInt32 strideInBytes, dInt32 count, dFloat64 distTol)
+dConvexHull4d::dConvexHull4d (const dFloat64* const vertexCloud, dInt32 strideInBytes, dInt32 count, dFloat64 distTol, dThreadPool* const threadPool)
 	:dList<dConvexHull4dTetraherum>()
 	,m_mark(0)
 	,m_count(0)
+	,m_faceUniqueID(0)
 	,m_diag(dFloat32(0.0f))
 	,m_points() 
 {
-	BuildHull (vertexCloud, strideInBytes, count, distTol);
+	BuildHull (vertexCloud, strideInBytes, count, distTol, threadPool);
 }
 
 dConvexHull4d::~dConvexHull4d(void)
@@ -753,6 +811,8 @@ dConvexHull4d::dNode* dConvexHull4d::AddFace (dInt32 i0, dInt32 i1, dInt32 i2, d
 	dNode* const node = Append();
 	dConvexHull4dTetraherum& face = node->GetInfo();
 	face.Init (&m_points[0], i0, i1, i2, i3);
+	face.m_uniqueID = m_faceUniqueID;
+	m_faceUniqueID ++;
 	return node;
 }
 
@@ -1041,7 +1101,68 @@ dInt32 dConvexHull4d::AddVertex (const dBigVector& vertex)
 	return index;
 }
 
-void dConvexHull4d::BuildHull (const dFloat64* const vertexCloud, dInt32 strideInBytes, dInt32 count, dFloat64 distTol)
+void dConvexHull4d::BuildHull (const dFloat64* const vertexCloud, dInt32 strideInBytes, dInt32 count, dFloat64 distTol, dThreadPool* const threadPool)
+{
+	// every hull vertex is a vertex of the hull of the chunk that has it, 
+	// so the hull of the chunk hull vertices is the hull of the cloud.
+	const bool parallel = threadPool && (threadPool->GetCount() > 1);
+	if (parallel && (count >= 2 * D_PARALLEL_CHUNK_SIZE_4D))
+	{
+		dArray<dBigVector> candidates;
+		dArray<dInt32> candidateIndex;
+		const dInt32 candidatesCount = ReduceVertexCloud(threadPool, vertexCloud, strideInBytes, count, candidates, candidateIndex);
+		BuildHullSerial(&candidates[0].m_x, sizeof(dBigVector), candidatesCount, distTol);
+
+		// vertex indices refer to the input cloud, not to the candidates
+		for (dInt32 i = 0; i < m_count; i++)
+		{
+			m_points[i].m_index = candidateIndex[m_points[i].m_index];
+		}
+	}
+	else
+	{
+		BuildHullSerial(vertexCloud, strideInBytes, count, distTol);
+	}
+}
+
+dInt32 dConvexHull4d::ReduceVertexCloud(dThreadPool* const threadPool, const dFloat64* const vertexCloud, dInt32 strideInBytes, dInt32 count, dArray<dBigVector>& candidates, dArray<dInt32>& candidateIndex) const
+{
+	D_TRACKTIME();
+	const dInt32 chunksCount = (count + D_PARALLEL_CHUNK_SIZE_4D - 1) / D_PARALLEL_CHUNK_SIZE_4D;
+	dStack<dInt32> candidatesCount(chunksCount);
+	candidates.SetCount(count);
+	candidateIndex.SetCount(count);
+
+	dgConvexHull4dReduceJob::dgContext context;
+	context.m_vertexCloud = vertexCloud;
+	context.m_candidates = &candidates[0];
+	context.m_candidateIndex = &candidateIndex[0];
+	context.m_candidatesCount = &candidatesCount[0];
+	context.m_strideInBytes = strideInBytes;
+	context.m_count = count;
+	context.m_chunksCount = chunksCount;
+	context.m_chunk.store(0);
+	threadPool->Begin();
+	dgConvexHull4dReduceJob reduceJob;
+	reduceJob.m_context = &context;
+	threadPool->SubmitJobs(reduceJob);
+	threadPool->End();
+
+	dInt32 candidatesAcc = 0;
+	for (dInt32 i = 0; i < chunksCount; i++)
+	{
+		const dInt32 start = i * D_PARALLEL_CHUNK_SIZE_4D;
+		for (dInt32 j = 0; j < candidatesCount[i]; j++)
+		{
+			candidates[candidatesAcc] = candidates[start + j];
+			candidateIndex[candidatesAcc] = candidateIndex[start + j];
+			candidatesAcc++;
+		}
+	}
+	return candidatesAcc;
+}
+
+void dConvexHull4d::BuildHullSerial (const dFloat64* const vertexCloud, dInt32 strideInBytes, dInt32 count, dFloat64 distTol)
 {
 	dInt32 treeCount = count / (D_VERTEX_CLUMP_SIZE_4D>>1); 
 	if (treeCount < 4) 
@@ -30,6 +30,7 @@
 #include "dMatrix.h"
 #include "dQuaternion.h"
 
+class dThreadPool;
 class dConvexHull4dAABBTreeNode;
 
 class dConvexHull4dVector: public dBigVector
@@ -100,7 +101,10 @@ class dConvexHull4d: public dList<dConvexHull4dTetraherum>
 	};
 
 	D_CORE_API dConvexHull4d(const dConvexHull4d& source);
-	D_CORE_API dConvexHull4d(const dFloat64* const vertexCloud, dInt32 strideInBytes, dInt32 count, dFloat64 distTol);
+	// when a thread pool is passed, large clouds are split in chunks that are hulled in parallel 
+	// and the hull is made from the vertices of the chunk hulls. the pool must be idle, 
+	// the hull calls Begin and End on it.
+	D_CORE_API dConvexHull4d(const dFloat64* const vertexCloud, dInt32 strideInBytes, dInt32 count, dFloat64 distTol, dThreadPool* const threadPool = nullptr);
 	D_CORE_API virtual ~dConvexHull4d();
 
 	dInt32 GetVertexCount() const;
@@ -116,7 +120,9 @@ class dConvexHull4d: public dList<dConvexHull4dTetraherum>
 	protected:
 	dConvexHull4d();
 
-	void BuildHull (const dFloat64* const vertexCloud, dInt32 strideInBytes, dInt32 count, dFloat64 distTol);
+	void BuildHull (const dFloat64* const vertexCloud, dInt32 strideInBytes, dInt32 count, dFloat64 distTol, dThreadPool* const threadPool = nullptr);
+	void BuildHullSerial (const dFloat64* const vertexCloud, dInt32 strideInBytes, dInt32 count, dFloat64 distTol);
+	dInt32 ReduceVertexCloud (dThreadPool* const threadPool, const dFloat64* const vertexCloud, dInt32 strideInBytes, dInt32 count, dArray<dBigVector>& candidates, dArray<dInt32>& candidateIndex) const;
 
 	virtual dInt32 AddVertex (const dBigVector& vertex);
 	virtual dInt32 InitVertexArray(dConvexHull4dVector* const points, const dFloat64* const vertexCloud, dInt32 strideInBytes, dInt32 count, void* const memoryPool, dInt32 maxMemSize);
@@ -151,6 +157,7 @@ class dConvexHull4d: public dList<dConvexHull4dTetraherum>
 
 	dInt32 m_mark;
 	dInt32 m_count;
+	dInt32 m_faceUniqueID;
 	dFloat64 m_diag;
 	dArray<dConvexHull4dVector> m_points;
 };
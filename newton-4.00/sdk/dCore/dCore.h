@@ -49,14 +49,17 @@
 #include <dThreadPool.h>
 #include <dIsoSurface.h>
 #include <dQuaternion.h>
+#include <dMappedFile.h>
 #include <dPerlinNoise.h>
 #include <dTinyXmlGlue.h>
+#include <dCompression.h>
 #include <dFixSizeArray.h>
 #include <dConvexHull2d.h>
 #include <dConvexHull3d.h>
 #include <dConvexHull4d.h>
 #include <dBezierSpline.h>
 #include <dNodeHierarchy.h>
+#include <dThreadScratch.h>
 #include <dIntersections.h>
 #include <dSpatialMatrix.h>
 #include <dGeneralVector.h>
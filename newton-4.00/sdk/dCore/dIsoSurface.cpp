@@ -23,6 +23,8 @@
 #include "dDebug.h"
 #include "dVector.h"
 #include "dMatrix.h"
+#include "dSort.h"
+#include "dProfiler.h"
 #include "dIsoSurface.h"
 
 const dInt32 dIsoSurface::m_edgeTable[256] =
@@ -321,15 +323,152 @@ const dInt32 dIsoSurface::m_triangleTable[256][16] =
 	{ -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 }
 };
 
+// grid offsets of the cube corners in x, y, z
+const dInt32 dIsoSurface::m_cornerOffsets[8][3] =
+{
+	{ 0, 0, 0 }, { 0, 1, 0 }, { 1, 1, 0 }, { 1, 0, 0 },
+	{ 0, 0, 1 }, { 0, 1, 1 }, { 1, 1, 1 }, { 1, 0, 1 },
+};
+
+const dInt32 dIsoSurface::m_edgeCorners[12][2] =
+{
+	{ 0, 1 }, { 1, 2 }, { 2, 3 }, { 3, 0 },
+	{ 4, 5 }, { 5, 6 }, { 6, 7 }, { 7, 4 },
+	{ 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 },
+};
+
+// the first inside corner on a crossing edge of each cube configuration, 
+// eight if no edge is crossing. the cube is extracted from this corner
+const dInt32 dIsoSurface::m_cubeOwner[256] =
+{
+	8, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+	4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 1, 2, 0, 1, 1,
+	5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+	4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 1, 2, 0, 1, 2,
+	6, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+	4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 1, 2, 0, 1, 1,
+	5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+	4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 1, 2, 0, 1, 3,
+	7, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+	4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 1, 2, 0, 1, 1,
+	5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+	4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 1, 2, 0, 1, 2,
+	6, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+	4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 1, 2, 0, 1, 1,
+	5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+	4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 1, 2, 0, 1, 8,
+};
+
+class dIsoSurface::dIsoJob: public dThreadPoolJob
+{
+	public:
+	class dContext
+	{
+		public:
+		dIsoSurface* m_me;
+		dIsoPass m_pass;
+	};
+
+	virtual void Execute()
+	{
+		D_TRACKTIME();
+		dContext* const context = (dContext*)m_context;
+		dIsoSurface* const me = context->m_me;
+		dAssert(GetThreadCount() == me->m_threadCount);
+		(me->*context->m_pass)(GetThreadId(), GetThreadCount());
+	}
+
+	void* m_context;
+};
+
+dIsoSurface::dIsoHashMap::dIsoHashMap()
+	:dArray<dIsoHashEntry>()
+	,m_mask(0)
+	,m_shift(64)
+{
+}
+
+void dIsoSurface::dIsoHashMap::Reset(dInt32 count)
+{
+	// keep the table at most half full
+	dInt32 bits = 4;
+	while ((1 << bits) < 2 * count)
+	{
+		bits++;
+	}
+	SetCount(1 << bits);
+	m_mask = (1 << bits) - 1;
+	m_shift = 64 - bits;
+}
+
+void dIsoSurface::dIsoHashMap::Clear(dInt32 threadIndex, dInt32 threadCount)
+{
+	const dInt32 size = GetCount();
+	const dInt32 step = size / threadCount;
+	const dInt32 start = threadIndex * step;
+	const dInt32 count = ((threadIndex + 1) < threadCount) ? step : size - start;
+	dIsoHashEntry* const entries = &(*this)[start];
+	for (dInt32 i = 0; i < count; i++)
+	{
+		entries[i].m_key.store(0);
+		entries[i].m_index = -1;
+	}
+}
+
+void dIsoSurface::dIsoHashMap::Insert(dUnsigned64 key, dInt32 index)
+{
+	// keys are stored plus one, zero marks an empty slot
+	const dUnsigned64 entryKey = key + 1;
+	dInt32 slot = dInt32((entryKey * dUnsigned64(0x9e3779b97f4a7c15)) >> m_shift);
+	for (;;)
+	{
+		dIsoHashEntry& entry = (*this)[slot];
+		dUnsigned64 test = 0;
+		if (entry.m_key.compare_exchange_weak(test, entryKey))
+		{
+			entry.m_index = index;
+			break;
+		}
+		dAssert(entry.m_key.load() != entryKey);
+		if (entry.m_key.load())
+		{
+			slot = (slot + 1) & m_mask;
+		}
+	}
+}
+
+dInt32 dIsoSurface::dIsoHashMap::Find(dUnsigned64 key) const
+{
+	const dUnsigned64 entryKey = key + 1;
+	dInt32 slot = dInt32((entryKey * dUnsigned64(0x9e3779b97f4a7c15)) >> m_shift);
+	for (;;)
+	{
+		const dIsoHashEntry& entry = (*this)[slot];
+		const dUnsigned64 test = entry.m_key.load();
+		if (test == entryKey)
+		{
+			return entry.m_index;
+		}
+		if (!test)
+		{
+			return -1;
+		}
+		slot = (slot + 1) & m_mask;
+	}
+}
+
 dIsoSurface::dIsoSurface()
 	:m_origin(dVector::m_zero)
 	,m_points(1024)
 	,m_normals(1024)
 	,m_trianglesList(1024)
-	,m_vertexMap()
-	,m_xCellSize(0)
-	,m_yCellSize(0)
-	,m_zCellSize(0)
+	,m_sortedPoints()
+	,m_rowStarts()
+	,m_rowMap()
+	,m_edgeMap()
+	,m_isoPoints(nullptr)
+	,m_isoPointsCount(0)
+	,m_threadCount(1)
 	,m_gridSize(dFloat32 (0.0f))
 	,m_isoValue(dFloat32(0.0f))
 {
@@ -339,283 +478,412 @@ dIsoSurface::~dIsoSurface()
 {
 }
 
-void dIsoSurface::Begin(const dVector& origin, dFloat32 isovalue, dFloat32 gridSize, dInt32 sizex, dInt32 sizey, dInt32 sizez)
+inline dUnsigned64 dIsoSurface::GetPointKey(dInt32 x, dInt32 y, dInt32 z)
 {
-	m_origin = origin & dVector::m_triplexMask;
-	m_xCellSize = sizex;
-	m_yCellSize = sizey;
-	m_zCellSize = sizez;
-	m_gridSize = gridSize;
-	m_isoValue = isovalue;
+	return dUnsigned64(x) | (dUnsigned64(y) << 20) | (dUnsigned64(z) << 40);
+}
 
-	m_points.SetCount(0);
-	m_trianglesList.SetCount(0);
+dInt32 dIsoSurface::ComparePoints(const dIsoPoint* const pointA, const dIsoPoint* const pointB, void* const)
+{
+	const dUnsigned64 keyA = GetPointKey(pointA->m_x, pointA->m_y, pointA->m_z);
+	const dUnsigned64 keyB = GetPointKey(pointB->m_x, pointB->m_y, pointB->m_z);
+	if (keyA < keyB)
+	{
+		return -1;
+	}
+	else if (keyA > keyB)
+	{
+		return 1;
+	}
+	return 0;
 }
 
-void dIsoSurface::End()
+dFloat32 dIsoSurface::dIsoRowCache::GetValue(dInt32 x, dInt32 dy, dInt32 dz) const
 {
-	RemapIndexList();
-	CalculateNormals();
+	// empty rows have an empty range
+	const dInt32 x0 = m_x0[dz + 2][dy + 2];
+	const dInt32 x1 = m_x1[dz + 2][dy + 2];
+	if ((x < x0) || (x > x1))
+	{
+		return dFloat32(0.0f);
+	}
+
+	const dInt32 count = m_count[dz + 2][dy + 2];
+	const dIsoPoint* const points = m_points[dz + 2][dy + 2];
+	if ((x1 - x0 + 1) == count)
+	{
+		// a row without holes
+		return points[x - x0].m_value;
+	}
+
+	dInt32 i0 = 0;
+	dInt32 i1 = count - 1;
+	while (i0 <= i1)
+	{
+		const dInt32 i = (i0 + i1) >> 1;
+		if (points[i].m_x < x)
+		{
+			i0 = i + 1;
+		}
+		else if (points[i].m_x > x)
+		{
+			i1 = i - 1;
+		}
+		else
+		{
+			return points[i].m_value;
+		}
+	}
+	return dFloat32(0.0f);
 }
 
-dUnsigned64 dIsoSurface::GetVertexID(dInt32 gridX, dInt32 gridY, dInt32 gridZ)
+dVector dIsoSurface::dIsoRowCache::CalculateGradient(dInt32 x, dInt32 dy, dInt32 dz) const
 {
-	//return 3 * (gridZ*(m_nCellsY + 1)*(m_nCellsX + 1) + gridY*(m_nCellsX + 1) + gridX);
-	return 3 * (m_xCellSize * dUnsigned64(gridZ * m_yCellSize + gridY) + gridX);
+	const dFloat32 gx = GetValue(x + 1, dy, dz) - GetValue(x - 1, dy, dz);
+	const dFloat32 gy = GetValue(x, dy + 1, dz) - GetValue(x, dy - 1, dz);
+	const dFloat32 gz = GetValue(x, dy, dz + 1) - GetValue(x, dy, dz - 1);
+	return dVector(gx, gy, gz, dFloat32(0.0f));
 }
 
-dUnsigned64 dIsoSurface::GetEdgeID(const dIsoCell& cell, dInt32 edgeCode)
+void dIsoSurface::ExecutePass(dIsoPass pass, dThreadPool* const threadPool)
 {
-	const dInt32 gridX = cell.m_x;
-	const dInt32 gridY = cell.m_y;
-	const dInt32 gridZ = cell.m_z;
-	switch (edgeCode)
+	if (threadPool)
+	{
+		dIsoJob::dContext context;
+		context.m_me = this;
+		context.m_pass = pass;
+		dIsoJob isoJob;
+		isoJob.m_context = &context;
+		threadPool->SubmitJobs(isoJob);
+	}
+	else
 	{
-		case 0:
-			return GetVertexID(gridX, gridY, gridZ) + 1;
-		case 1:
-			return GetVertexID(gridX, gridY + 1, gridZ);
-		case 2:
-			return GetVertexID(gridX + 1, gridY, gridZ) + 1;
-		case 3:
-			return GetVertexID(gridX, gridY, gridZ);
-		case 4:
-			return GetVertexID(gridX, gridY, gridZ + 1) + 1;
-		case 5:
-			return GetVertexID(gridX, gridY + 1, gridZ + 1);
-		case 6:
-			return GetVertexID(gridX + 1, gridY, gridZ + 1) + 1;
-		case 7:
-			return GetVertexID(gridX, gridY, gridZ + 1);
-		case 8:
-			return GetVertexID(gridX, gridY, gridZ) + 2;
-		case 9:
-			return GetVertexID(gridX, gridY + 1, gridZ) + 2;
-		case 10:
-			return GetVertexID(gridX + 1, gridY + 1, gridZ) + 2;
-		case 11:
-			return GetVertexID(gridX + 1, gridY, gridZ) + 2;
-		default:
-			// Invalid edge no.
-			return dUnsigned64 (-1);
+		(this->*pass)(0, 1);
 	}
 }
 
-dVector dIsoSurface::InterpolateEdge(dFloat32 fX1, dFloat32 fY1, dFloat32 fZ1, dFloat32 fX2, dFloat32 fY2, dFloat32 fZ2, dFloat32 tVal1, dFloat32 tVal2)
+void dIsoSurface::GenerateMesh(const dIsoPoint* const points, dInt32 count, const dVector& origin, dFloat32 gridSize, dFloat32 isoValue, dThreadPool* const threadPool)
 {
-	dFloat32 mu = (m_isoValue - tVal1) / (tVal2 - tVal1);
-	dFloat32 x = fX1 + mu*(fX2 - fX1);
-	dFloat32 y = fY1 + mu*(fY2 - fY1);
-	dFloat32 z = fZ1 + mu*(fZ2 - fZ1);
-	return dVector(x, y, z, dFloat32 (0.0f));
-}
+	D_TRACKTIME();
+	// points not in the list are zero, so they must be outside
+	dAssert(isoValue >= dFloat32(0.0f));
 
-dVector dIsoSurface::CalculateIntersection(const dIsoCell& cell, dInt32 edgeCode)
-{
-	dInt32 v1x = cell.m_x;
-	dInt32 v1y = cell.m_y;
-	dInt32 v1z = cell.m_z;
-	dInt32 v2x = cell.m_x;
-	dInt32 v2y = cell.m_y;
-	dInt32 v2z = cell.m_z;
-
-	switch (edgeCode)
+	m_origin = origin & dVector::m_triplexMask;
+	m_gridSize = gridSize;
+	m_isoValue = isoValue;
+	m_isoPoints = points;
+	m_isoPointsCount = count;
+	m_threadCount = threadPool ? threadPool->GetCount() : 1;
+	dAssert(m_threadCount <= D_MAX_THREADS_COUNT);
+
+	// a row is the run of points with the same y and z
+	ExecutePass(&dIsoSurface::CountRows, threadPool);
+	bool unsorted = false;
+	for (dInt32 i = 0; i < m_threadCount; i++)
 	{
-		case 0:
-			v2y += 1;
-			break;
-		case 1:
-			v1y += 1;
-			v2x += 1;
-			v2y += 1;
-			break;
-		case 2:
-			v1x += 1;
-			v1y += 1;
-			v2x += 1;
-			break;
-		case 3:
-			v1x += 1;
-			break;
-		case 4:
-			v1z += 1;
-			v2y += 1;
-			v2z += 1;
-			break;
-		case 5:
-			v1y += 1;
-			v1z += 1;
-			v2x += 1;
-			v2y += 1;
-			v2z += 1;
-			break;
-		case 6:
-			v1x += 1;
-			v1y += 1;
-			v1z += 1;
-			v2x += 1;
-			v2z += 1;
-			break;
-		case 7:
-			v1x += 1;
-			v1z += 1;
-			v2z += 1;
-			break;
-		case 8:
-			v2z += 1;
-			break;
-		case 9:
-			v1y += 1;
-			v2y += 1;
-			v2z += 1;
-			break;
-		case 10:
-			v1x += 1;
-			v1y += 1;
-			v2x += 1;
-			v2y += 1;
-			v2z += 1;
-			break;
-		case 11:
-			v1x += 1;
-			v2x += 1;
-			v2z += 1;
-			break;
+		unsorted = unsorted || m_unsorted[i];
+	}
+	if (unsorted)
+	{
+		m_sortedPoints.SetCount(count);
+		memcpy(&m_sortedPoints[0], points, count * sizeof(dIsoPoint));
+		dSort(&m_sortedPoints[0], count, ComparePoints);
+		m_isoPoints = &m_sortedPoints[0];
+		ExecutePass(&dIsoSurface::CountRows, threadPool);
 	}
 
-	dFloat32 x1 = v1x * m_gridSize;
-	dFloat32 y1 = v1y * m_gridSize;
-	dFloat32 z1 = v1z * m_gridSize;
-	dFloat32 x2 = v2x * m_gridSize;
-	dFloat32 y2 = v2y * m_gridSize;
-	dFloat32 z2 = v2z * m_gridSize;
+	dInt32 rowsCount = 0;
+	for (dInt32 i = 0; i < m_threadCount; i++)
+	{
+		const dInt32 rows = m_rowOffsets[i];
+		m_rowOffsets[i] = rowsCount;
+		rowsCount += rows;
+	}
+	m_rowStarts.SetCount(rowsCount + 1);
+	m_rowStarts[rowsCount] = count;
+	m_rowMap.Reset(rowsCount);
+	ExecutePass(&dIsoSurface::ClearRows, threadPool);
+	ExecutePass(&dIsoSurface::InsertRows, threadPool);
+	ExecutePass(&dIsoSurface::ExtractCubes, threadPool);
+
+	m_vertexOffsets[0] = 0;
+	m_triangleOffsets[0] = 0;
+	for (dInt32 i = 0; i < m_threadCount; i++)
+	{
+		m_vertexOffsets[i + 1] = m_vertexOffsets[i] + m_vertexSlabs[i].GetCount();
+		m_triangleOffsets[i + 1] = m_triangleOffsets[i] + m_triangleSlabs[i].GetCount();
+	}
+	const dInt32 vertexCount = m_vertexOffsets[m_threadCount];
+	m_points.SetCount(vertexCount);
+	m_normals.SetCount(vertexCount);
+	m_trianglesList.SetCount(m_triangleOffsets[m_threadCount]);
 
-	dFloat32 val1 = cell.m_isoValues[v1z-cell.m_z][v1y-cell.m_y][v1x-cell.m_x];
-	dFloat32 val2 = cell.m_isoValues[v2z - cell.m_z][v2y - cell.m_y][v2x - cell.m_x];
-	return InterpolateEdge(x1, y1, z1, x2, y2, z2, val1, val2);
+	m_edgeMap.Reset(vertexCount);
+	ExecutePass(&dIsoSurface::ClearEdges, threadPool);
+	ExecutePass(&dIsoSurface::InsertVertices, threadPool);
+	ExecutePass(&dIsoSurface::RemapTriangles, threadPool);
+	m_isoPoints = nullptr;
 }
 
-void dIsoSurface::ProcessCell(const dIsoCell& cell)
+void dIsoSurface::CountRows(dInt32 threadIndex, dInt32 threadCount)
 {
-	dAssert(cell.m_x < m_xCellSize - 1);
-	dAssert(cell.m_y < m_yCellSize - 1);
-	dAssert(cell.m_z < m_zCellSize - 1);
-
-	dInt32 tableIndex = 0;
-	if (cell.m_isoValues[0][0][0] > m_isoValue)
-		tableIndex |= 1;
-	if (cell.m_isoValues[0][1][0] > m_isoValue)
-		tableIndex |= 2;
-	if (cell.m_isoValues[0][1][1] > m_isoValue)
-		tableIndex |= 4;
-	if (cell.m_isoValues[0][0][1] > m_isoValue)
-		tableIndex |= 8;
-	if (cell.m_isoValues[1][0][0] > m_isoValue)
-		tableIndex |= 16;
-	if (cell.m_isoValues[1][1][0] > m_isoValue)
-		tableIndex |= 32;
-	if (cell.m_isoValues[1][1][1] > m_isoValue)
-		tableIndex |= 64;
-	if (cell.m_isoValues[1][0][1] > m_isoValue)
-		tableIndex |= 128;
-
-	// Now create a triangulation of the iso surface in this cell.
-	dInt32 edgeBits = m_edgeTable[tableIndex];
-	if (edgeBits != 0)
+	const dInt32 step = m_isoPointsCount / threadCount;
+	const dInt32 start = threadIndex * step;
+	const dInt32 count = ((threadIndex + 1) < threadCount) ? step : m_isoPointsCount - start;
+
+	dInt32 rows = 0;
+	bool unsorted = false;
+	for (dInt32 i = 0; i < count; i++)
 	{
-		if (edgeBits & 8)
-		{
-			dVector pt (CalculateIntersection(cell, 3));
-			dUnsigned64 id = GetEdgeID(cell, 3);
-			dAssert(!m_vertexMap.Find(id));
-			m_vertexMap.Insert(pt, id);
-		}
-		if (edgeBits & 1)
-		{
-			dVector pt (CalculateIntersection(cell, 0));
-			dUnsigned64 id = GetEdgeID(cell, 0);
-			dAssert(!m_vertexMap.Find(id));
-			m_vertexMap.Insert(pt, id);
-		}
-		if (edgeBits & 256)
+		const dInt32 index = start + i;
+		const dIsoPoint& point = m_isoPoints[index];
+		dAssert((point.m_x > 1) && (point.m_x < (1 << 20) - 2));
+		dAssert((point.m_y > 1) && (point.m_y < (1 << 20) - 2));
+		dAssert((point.m_z > 1) && (point.m_z < (1 << 20) - 2));
+		if (index)
 		{
-			dVector pt (CalculateIntersection(cell, 8));
-			dUnsigned64 id = GetEdgeID(cell, 8);
-			dAssert(!m_vertexMap.Find(id));
-			m_vertexMap.Insert(pt, id);
+			const dIsoPoint& prevPoint = m_isoPoints[index - 1];
+			rows += ((point.m_y != prevPoint.m_y) || (point.m_z != prevPoint.m_z)) ? 1 : 0;
+			unsorted = unsorted || (GetPointKey(point.m_x, point.m_y, point.m_z) <= GetPointKey(prevPoint.m_x, prevPoint.m_y, prevPoint.m_z));
 		}
-	
-		for (dInt32 i = 0; m_triangleTable[tableIndex][i] != -1; i += 3)
+		else
 		{
-			dIsoTriangle triangle;
-			dUnsigned64 pointID0 = GetEdgeID(cell, m_triangleTable[tableIndex][i + 0]);
-			dUnsigned64 pointID1 = GetEdgeID(cell, m_triangleTable[tableIndex][i + 1]);
-			dUnsigned64 pointID2 = GetEdgeID(cell, m_triangleTable[tableIndex][i + 2]);
-			triangle.m_pointId[0] = pointID0;
-			triangle.m_pointId[1] = pointID1;
-			triangle.m_pointId[2] = pointID2;
-			m_trianglesList.PushBack(triangle);
+			rows++;
 		}
 	}
+	m_rowOffsets[threadIndex] = rows;
+	m_unsorted[threadIndex] = unsorted;
+}
+
+void dIsoSurface::ClearRows(dInt32 threadIndex, dInt32 threadCount)
+{
+	m_rowMap.Clear(threadIndex, threadCount);
 }
 
-void dIsoSurface::RemapIndexList()
+void dIsoSurface::ClearEdges(dInt32 threadIndex, dInt32 threadCount)
 {
-	dInt32 nextID = 0;
+	m_edgeMap.Clear(threadIndex, threadCount);
+}
+
+void dIsoSurface::InsertRows(dInt32 threadIndex, dInt32 threadCount)
+{
+	const dInt32 step = m_isoPointsCount / threadCount;
+	const dInt32 start = threadIndex * step;
+	const dInt32 count = ((threadIndex + 1) < threadCount) ? step : m_isoPointsCount - start;
 
-	// calculate monotonic index list
-	m_points.SetCount(m_vertexMap.GetCount());
-	dIsoVertexMap::Iterator iter(m_vertexMap);
-	for (iter.Begin(); iter; iter++)
+	dInt32 row = m_rowOffsets[threadIndex];
+	for (dInt32 i = 0; i < count; i++)
 	{
-		dVector& point = iter.GetNode()->GetInfo();
-		m_points[nextID] = point + m_origin;
-		dAssert(m_points[nextID].m_w == dFloat32(0.0f));
-		point.m_w = dFloat32(nextID);
-		nextID ++;
+		const dInt32 index = start + i;
+		const dIsoPoint& point = m_isoPoints[index];
+		if (!index || (point.m_y != m_isoPoints[index - 1].m_y) || (point.m_z != m_isoPoints[index - 1].m_z))
+		{
+			m_rowStarts[row] = index;
+			m_rowMap.Insert(GetPointKey(0, point.m_y, point.m_z), row);
+			row++;
+		}
 	}
+}
+
+void dIsoSurface::ExtractCubes(dInt32 threadIndex, dInt32 threadCount)
+{
+	// corner index of the grid offsets [z][y][x] inside a cube
+	static const dInt32 offsetToCorner[2][2][2] = { { { 0, 3 }, { 1, 2 } }, { { 4, 7 }, { 5, 6 } } };
+
+	m_vertexSlabs[threadIndex].SetCount(0);
+	m_triangleSlabs[threadIndex].SetCount(0);
 
-	// Now remap triangles.
-	for (dInt32 k = 0; k < m_trianglesList.GetCount(); k++)
+	const dInt32 rowsCount = m_rowStarts.GetCount() - 1;
+	const dInt32 step = rowsCount / threadCount;
+	const dInt32 start = threadIndex * step;
+	const dInt32 count = ((threadIndex + 1) < threadCount) ? step : rowsCount - start;
+	for (dInt32 i = 0; i < count; i++)
 	{
-		for (dInt32 i = 0; i < 3; i++)
+		const dInt32 row = start + i;
+		const dInt32 rowStart = m_rowStarts[row];
+		const dInt32 rowEnd = m_rowStarts[row + 1];
+		const dInt32 y = m_isoPoints[rowStart].m_y;
+		const dInt32 z = m_isoPoints[rowStart].m_z;
+
+		dIsoRowCache rows;
+		for (dInt32 dz = -2; dz <= 2; dz++)
 		{
-			dIsoVertexMap::dNode* const node = m_vertexMap.Find(m_trianglesList[k].m_pointId[i]);
-			dAssert(node);
-			dInt32 id = dInt32 (node->GetInfo().m_w);
-			m_trianglesList[k].m_pointId[i] = id;
+			for (dInt32 dy = -2; dy <= 2; dy++)
+			{
+				const dInt32 rowIndex = m_rowMap.Find(GetPointKey(0, y + dy, z + dz));
+				if (rowIndex >= 0)
+				{
+					const dInt32 rowCount = m_rowStarts[rowIndex + 1] - m_rowStarts[rowIndex];
+					const dIsoPoint* const rowPoints = &m_isoPoints[m_rowStarts[rowIndex]];
+					rows.m_points[dz + 2][dy + 2] = rowPoints;
+					rows.m_count[dz + 2][dy + 2] = rowCount;
+					rows.m_x0[dz + 2][dy + 2] = rowPoints[0].m_x;
+					rows.m_x1[dz + 2][dy + 2] = rowPoints[rowCount - 1].m_x;
+				}
+				else
+				{
+					rows.m_points[dz + 2][dy + 2] = nullptr;
+					rows.m_count[dz + 2][dy + 2] = 0;
+					rows.m_x0[dz + 2][dy + 2] = 1;
+					rows.m_x1[dz + 2][dy + 2] = 0;
+				}
+			}
+		}
+
+		for (dInt32 j = rowStart; j < rowEnd; j++)
+		{
+			const dIsoPoint& point = m_isoPoints[j];
+			if (point.m_value <= m_isoValue)
+			{
+				continue;
+			}
+
+			// only an inside point next to an outside point can be on a crossing edge
+			const dInt32 x = point.m_x;
+			dFloat32 block[3][3][3];
+			block[1][1][1] = point.m_value;
+			block[1][1][0] = ((j > rowStart) && (m_isoPoints[j - 1].m_x == x - 1)) ? m_isoPoints[j - 1].m_value : dFloat32(0.0f);
+			block[1][1][2] = ((j < rowEnd - 1) && (m_isoPoints[j + 1].m_x == x + 1)) ? m_isoPoints[j + 1].m_value : dFloat32(0.0f);
+			block[1][0][1] = rows.GetValue(x, -1, 0);
+			block[1][2][1] = rows.GetValue(x, 1, 0);
+			block[0][1][1] = rows.GetValue(x, 0, -1);
+			block[2][1][1] = rows.GetValue(x, 0, 1);
+			if ((block[1][1][0] > m_isoValue) && (block[1][1][2] > m_isoValue) &&
+				(block[1][0][1] > m_isoValue) && (block[1][2][1] > m_isoValue) &&
+				(block[0][1][1] > m_isoValue) && (block[2][1][1] > m_isoValue))
+			{
+				continue;
+			}
+
+			for (dInt32 iz = 0; iz < 3; iz++)
+			{
+				for (dInt32 iy = 0; iy < 3; iy++)
+				{
+					for (dInt32 ix = 0; ix < 3; ix++)
+					{
+						const dInt32 axisCount = (ix != 1) + (iy != 1) + (iz != 1);
+						if (axisCount > 1)
+						{
+							block[iz][iy][ix] = rows.GetValue(x + ix - 1, iy - 1, iz - 1);
+						}
+					}
+				}
+			}
+
+			// each crossing cube is made by the first of its inside corners on a crossing edge
+			for (dInt32 oz = 0; oz < 2; oz++)
+			{
+				for (dInt32 oy = 0; oy < 2; oy++)
+				{
+					for (dInt32 ox = 0; ox < 2; ox++)
+					{
+						dInt32 tableIndex = 0;
+						dFloat32 values[8];
+						for (dInt32 k = 0; k < 8; k++)
+						{
+							const dInt32* const offset = m_cornerOffsets[k];
+							values[k] = block[oz + offset[2]][oy + offset[1]][ox + offset[0]];
+							tableIndex |= (values[k] > m_isoValue) ? (1 << k) : 0;
+						}
+
+						if (m_cubeOwner[tableIndex] == offsetToCorner[1 - oz][1 - oy][1 - ox])
+						{
+							ProcessCube(threadIndex, rows, x + ox - 1, oy - 1, oz - 1, values, tableIndex);
+						}
+					}
+				}
+			}
 		}
 	}
-	m_vertexMap.RemoveAll();
 }
 
-void dIsoSurface::CalculateNormals()
+void dIsoSurface::ProcessCube(dInt32 threadIndex, const dIsoRowCache& rows, dInt32 x, dInt32 dy, dInt32 dz, const dFloat32* const values, dInt32 tableIndex)
 {
-	m_normals.SetCount(m_points.GetCount());
+	// the edges on the x, y and z axis at the cube origin
+	static const dInt32 originEdges[3] = { 3, 0, 8 };
+	static const dInt32 originEdgesCorner[3] = { 3, 1, 4 };
+
+	// the cube origin is dy and dz rows away from the row being extracted
+	const dIsoPoint& rowPoint = *rows.m_points[2][2];
+	const dInt32 y = rowPoint.m_y + dy;
+	const dInt32 z = rowPoint.m_z + dz;
 
-	// Set all normals to 0.
-	if (m_normals.GetCount())
+	const dInt32 edgeBits = m_edgeTable[tableIndex];
+	dArray<dIsoVertex>& vertexSlab = m_vertexSlabs[threadIndex];
+	const dVector gradient0(rows.CalculateGradient(x, dy, dz));
+	for (dInt32 axis = 0; axis < 3; axis++)
 	{
-		memset(&m_normals[0], 0, m_normals.GetCount() * sizeof(dVector));
+		if (edgeBits & (1 << originEdges[axis]))
+		{
+			const dFloat32 value0 = values[0];
+			const dFloat32 value1 = values[originEdgesCorner[axis]];
+			const dFloat32 t = (m_isoValue - value0) / (value1 - value0);
+
+			dInt32 grid1[3] = { x, dy, dz };
+			grid1[axis] += 1;
+			dVector dir(dVector::m_zero);
+			dir[axis] = dFloat32(1.0f);
+
+			const dVector grid0(dFloat32(x), dFloat32(y), dFloat32(z), dFloat32(0.0f));
+			const dVector gradient1(rows.CalculateGradient(grid1[0], grid1[1], grid1[2]));
+			const dVector gradient(gradient0 + (gradient1 - gradient0).Scale(t));
 
-		for (dInt32 i = 0; i < m_trianglesList.GetCount(); i++)
+			// the field goes up toward the inside
+			const dFloat32 mag2 = gradient.DotProduct(gradient).GetScalar();
+			dIsoVertex vertex;
+			vertex.m_point = m_origin + (grid0 + dir.Scale(t)).Scale(m_gridSize);
+			vertex.m_normal = (mag2 > dFloat32(1.0e-12f)) ? gradient.Scale(-dRsqrt(mag2)) : dir.Scale((value0 > m_isoValue) ? dFloat32(1.0f) : dFloat32(-1.0f));
+			vertex.m_edgeId = (GetPointKey(x, y, z) << 2) + axis;
+			vertexSlab.PushBack(vertex);
+		}
+	}
+
+	dArray<dIsoTriangle>& triangleSlab = m_triangleSlabs[threadIndex];
+	for (dInt32 i = 0; m_triangleTable[tableIndex][i] != -1; i += 3)
+	{
+		dIsoTriangle triangle;
+		for (dInt32 j = 0; j < 3; j++)
 		{
-			dInt32 id0 = dInt32(m_trianglesList[i].m_pointId[0]);
-			dInt32 id1 = dInt32(m_trianglesList[i].m_pointId[1]);
-			dInt32 id2 = dInt32(m_trianglesList[i].m_pointId[2]);
-			dVector vec1(m_points[id1] - m_points[id0]);
-			dVector vec2(m_points[id2] - m_points[id0]);
-			dVector normal = vec1.CrossProduct(vec2);
-			m_normals[id0] += normal;
-			m_normals[id1] += normal;
-			m_normals[id2] += normal;
+			// the edge id is the edge start point key and its axis
+			const dInt32 edge = m_triangleTable[tableIndex][i + j];
+			const dInt32* const offset0 = m_cornerOffsets[m_edgeCorners[edge][0]];
+			const dInt32* const offset1 = m_cornerOffsets[m_edgeCorners[edge][1]];
+			const dInt32 axis = (offset0[0] != offset1[0]) ? 0 : ((offset0[1] != offset1[1]) ? 1 : 2);
+			const dInt32 x0 = x + dMin(offset0[0], offset1[0]);
+			const dInt32 y0 = y + dMin(offset0[1], offset1[1]);
+			const dInt32 z0 = z + dMin(offset0[2], offset1[2]);
+			triangle.m_pointId[j] = (GetPointKey(x0, y0, z0) << 2) + axis;
 		}
+		triangleSlab.PushBack(triangle);
+	}
+}
 
-		// Normalize normals.
-		for (dInt32 i = 0; i < m_normals.GetCount(); i++)
+void dIsoSurface::InsertVertices(dInt32 threadIndex, dInt32)
+{
+	const dInt32 base = m_vertexOffsets[threadIndex];
+	const dArray<dIsoVertex>& vertexSlab = m_vertexSlabs[threadIndex];
+	for (dInt32 i = 0; i < vertexSlab.GetCount(); i++)
+	{
+		const dIsoVertex& vertex = vertexSlab[i];
+		m_points[base + i] = vertex.m_point;
+		m_normals[base + i] = vertex.m_normal;
+		m_edgeMap.Insert(vertex.m_edgeId, base + i);
+	}
+}
+
+void dIsoSurface::RemapTriangles(dInt32 threadIndex, dInt32)
+{
+	const dInt32 base = m_triangleOffsets[threadIndex];
+	const dArray<dIsoTriangle>& triangleSlab = m_triangleSlabs[threadIndex];
+	for (dInt32 i = 0; i < triangleSlab.GetCount(); i++)
+	{
+		const dIsoTriangle& src = triangleSlab[i];
+		dIsoTriangle& dst = m_trianglesList[base + i];
+		for (dInt32 j = 0; j < 3; j++)
 		{
-			//m_normals[i] = m_normals[i].Normalize();
-			m_normals[i] = m_normals[i] * m_normals[i].InvMagSqrt();
+			const dInt32 index = m_edgeMap.Find(src.m_pointId[j]);
+			dAssert(index >= 0);
+			dst.m_pointId[j] = dUnsigned64(index);
 		}
 	}
-}
\ No newline at end of file
+}
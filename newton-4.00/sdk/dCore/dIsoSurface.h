@@ -28,18 +28,24 @@
 #include "dCoreStdafx.h"
 #include "dTypes.h"
 #include "dArray.h"
-#include "dTree.h"
-
+#include "dThreadPool.h"
+
+// sparse marching cubes, the scalar field is given by the list of the grid 
+// points inside or near the surface, all the other points of the grid are outside.
+// the cubes crossing the surface are found from the inside points next to an 
+// outside point, so the cost depends on the points in the list not the grid size.
+// each cube makes the vertices of the three edges at its origin, so every vertex
+// is made once, and triangles are welded by looking up the edge id in a hash table.
 class dIsoSurface: public dClassAlloc
 {
 	public:
-	class dIsoCell
+	class dIsoPoint
 	{
 		public:
-		dFloat32 m_isoValues[2][2][2];
 		dInt32 m_x;
 		dInt32 m_y;
 		dInt32 m_z;
+		dFloat32 m_value;
 	};
 
 	class dIsoTriangle
@@ -48,17 +54,14 @@ class dIsoSurface: public dClassAlloc
 		dUnsigned64 m_pointId[3];
 	};
 
-	class dIsoVertexMap: public dTree<dVector, dUnsigned64, dContainersFreeListAlloc<dVector>>
-	{
-		public: 
-	};
-
 	D_CORE_API dIsoSurface();
 	D_CORE_API ~dIsoSurface();
 
-	D_CORE_API void Begin(const dVector& origin, dFloat32 isovalue, dFloat32 gridSize, dInt32 sizex, dInt32 sizey, dInt32 sizez);
-	D_CORE_API void ProcessCell(const dIsoCell& cell);
-	D_CORE_API void End();
+	// points coordinates must be in [2, 1<<20 - 3] and no point can be repeated, points
+	// sorted by z, then y, then x are used in place, otherwise a sorted copy is made.
+	// when a thread pool is given the work is split over its threads, the pool
+	// must be already running, like the world scene is during an update.
+	D_CORE_API void GenerateMesh(const dIsoPoint* const points, dInt32 count, const dVector& origin, dFloat32 gridSize, dFloat32 isoValue, dThreadPool* const threadPool = nullptr);
 
 	dInt32 GetIndexCount() const;
 	dInt32 GetVertexCount() const;
@@ -67,28 +70,92 @@ class dIsoSurface: public dClassAlloc
 	const dUnsigned64* GetIndexList() const;
 
 	private:
-	dUnsigned64 GetVertexID(dInt32 x, dInt32 y, dInt32 z);
-	dUnsigned64 GetEdgeID(const dIsoCell& cell, dInt32 edgeCode);
-	dVector CalculateIntersection(const dIsoCell& cell, dInt32 edgeCode);
-	dVector InterpolateEdge(dFloat32 fX1, dFloat32 fY1, dFloat32 fZ1, dFloat32 fX2, dFloat32 fY2, dFloat32 fZ2, dFloat32 tVal1, dFloat32 tVal2);
+	class dIsoVertex
+	{
+		public:
+		dVector m_point;
+		dVector m_normal;
+		dUnsigned64 m_edgeId;
+	};
+
+	class dIsoHashEntry
+	{
+		public:
+		dAtomic<dUnsigned64> m_key;
+		dInt32 m_index;
+	};
+
+	class dIsoHashMap: public dArray<dIsoHashEntry>
+	{
+		public:
+		dIsoHashMap();
+
+		void Reset(dInt32 count);
+		void Clear(dInt32 threadIndex, dInt32 threadCount);
+		void Insert(dUnsigned64 key, dInt32 index);
+		dInt32 Find(dUnsigned64 key) const;
+
+		dInt32 m_mask;
+		dInt32 m_shift;
+	};
+
+	// the rows of points around the row being extracted, 
+	// from two rows below to two rows above in y and z
+	class dIsoRowCache
+	{
+		public:
+		dFloat32 GetValue(dInt32 x, dInt32 dy, dInt32 dz) const;
+		dVector CalculateGradient(dInt32 x, dInt32 dy, dInt32 dz) const;
+
+		const dIsoPoint* m_points[5][5];
+		dInt32 m_count[5][5];
+		dInt32 m_x0[5][5];
+		dInt32 m_x1[5][5];
+	};
+
+	class dIsoJob;
+	typedef void (dIsoSurface::*dIsoPass)(dInt32 threadIndex, dInt32 threadCount);
+
+	static dUnsigned64 GetPointKey(dInt32 x, dInt32 y, dInt32 z);
+	static dInt32 ComparePoints(const dIsoPoint* const pointA, const dIsoPoint* const pointB, void* const context);
 
-	void RemapIndexList();
-	void CalculateNormals();
+	void CountRows(dInt32 threadIndex, dInt32 threadCount);
+	void ClearRows(dInt32 threadIndex, dInt32 threadCount);
+	void InsertRows(dInt32 threadIndex, dInt32 threadCount);
+	void ExtractCubes(dInt32 threadIndex, dInt32 threadCount);
+	void ProcessCube(dInt32 threadIndex, const dIsoRowCache& rows, dInt32 x, dInt32 dy, dInt32 dz, const dFloat32* const values, dInt32 tableIndex);
+	void ClearEdges(dInt32 threadIndex, dInt32 threadCount);
+	void InsertVertices(dInt32 threadIndex, dInt32 threadCount);
+	void RemapTriangles(dInt32 threadIndex, dInt32 threadCount);
+	void ExecutePass(dIsoPass pass, dThreadPool* const threadPool);
 
 	dVector m_origin;
 	dArray<dVector> m_points;
 	dArray<dVector> m_normals;
 	dArray<dIsoTriangle> m_trianglesList;
 
-	dIsoVertexMap m_vertexMap;
-	dInt32 m_xCellSize;
-	dInt32 m_yCellSize;
-	dInt32 m_zCellSize;
+	dArray<dIsoPoint> m_sortedPoints;
+	dArray<dInt32> m_rowStarts;
+	dIsoHashMap m_rowMap;
+	dIsoHashMap m_edgeMap;
+	dArray<dIsoVertex> m_vertexSlabs[D_MAX_THREADS_COUNT];
+	dArray<dIsoTriangle> m_triangleSlabs[D_MAX_THREADS_COUNT];
+	dInt32 m_rowOffsets[D_MAX_THREADS_COUNT + 1];
+	dInt32 m_vertexOffsets[D_MAX_THREADS_COUNT + 1];
+	dInt32 m_triangleOffsets[D_MAX_THREADS_COUNT + 1];
+	bool m_unsorted[D_MAX_THREADS_COUNT];
+
+	const dIsoPoint* m_isoPoints;
+	dInt32 m_isoPointsCount;
+	dInt32 m_threadCount;
 	dFloat32 m_gridSize;
 	dFloat32 m_isoValue;
 
 	static const dInt32 m_edgeTable[];
 	static const dInt32 m_triangleTable[][16];
+	static const dInt32 m_cornerOffsets[][3];
+	static const dInt32 m_edgeCorners[][2];
+	static const dInt32 m_cubeOwner[];
 };
 
 inline dInt32 dIsoSurface::GetIndexCount() const
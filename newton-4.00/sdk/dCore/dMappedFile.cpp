@@ -0,0 +1,108 @@
+/* Copyright (c) <2003-2021> <Julio Jerez, Newton Game Dynamics>
+* 
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "dCoreStdafx.h"
+#include "dMappedFile.h"
+
+#if !(defined (_WIN_32_VER) || defined (_WIN_64_VER))
+	#include <fcntl.h>
+	#include <sys/mman.h>
+#endif
+
+dMappedFile::dMappedFile()
+	:dClassAlloc()
+	,dRefCounter<dMappedFile>()
+	,m_data(nullptr)
+	,m_size(0)
+#if defined (_WIN_32_VER) || defined (_WIN_64_VER)
+	,m_file(INVALID_HANDLE_VALUE)
+	,m_mapping(nullptr)
+#endif
+{
+}
+
+dMappedFile::~dMappedFile()
+{
+#if defined (_WIN_32_VER) || defined (_WIN_64_VER)
+	if (m_data)
+	{
+		UnmapViewOfFile(m_data);
+	}
+	if (m_mapping)
+	{
+		CloseHandle(m_mapping);
+	}
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_file);
+	}
+#else
+	if (m_data)
+	{
+		munmap((void*)m_data, size_t(m_size));
+	}
+#endif
+}
+
+dMappedFile* dMappedFile::Open(const char* const path)
+{
+	dMappedFile* const file = new dMappedFile();
+#if defined (_WIN_32_VER) || defined (_WIN_64_VER)
+	file->m_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file->m_file != INVALID_HANDLE_VALUE)
+	{
+		LARGE_INTEGER size;
+		if (GetFileSizeEx(file->m_file, &size) && size.QuadPart)
+		{
+			file->m_mapping = CreateFileMappingA(file->m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (file->m_mapping)
+			{
+				file->m_data = MapViewOfFile(file->m_mapping, FILE_MAP_READ, 0, 0, 0);
+				file->m_size = file->m_data ? size.QuadPart : 0;
+			}
+		}
+	}
+#else
+	const int handle = open(path, O_RDONLY);
+	if (handle >= 0)
+	{
+		struct stat info;
+		if (!fstat(handle, &info) && info.st_size)
+		{
+			void* const data = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_SHARED, handle, 0);
+			if (data != MAP_FAILED)
+			{
+				file->m_data = data;
+				file->m_size = dInt64(info.st_size);
+			}
+		}
+		// the mapping stays valid after the descriptor is closed
+		close(handle);
+	}
+#endif
+
+	if (!file->m_data)
+	{
+		file->Release();
+		return nullptr;
+	}
+	return file;
+}
@@ -0,0 +1,68 @@
+/* Copyright (c) <2003-2021> <Julio Jerez, Newton Game Dynamics>
+* 
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef _D_MAPPED_FILE_H_
+#define _D_MAPPED_FILE_H_
+
+#include "dCoreStdafx.h"
+#include "dClassAlloc.h"
+#include "dRefCounter.h"
+
+/// Read only view of a file mapped in memory. 
+/// Pages are loaded by the os on first access and shared by all 
+/// processes mapping the same file, objects that use the data keep 
+/// a reference to the mapping for as long as they are alive.
+class dMappedFile: public dClassAlloc, public dRefCounter<dMappedFile>
+{
+	public:
+	/// Map the file, return nullptr if the file can not be opened.
+	D_CORE_API static dMappedFile* Open(const char* const path);
+
+	/// Pointer to the first byte of the file.
+	const void* GetData() const;
+
+	/// Size of the file in bytes.
+	dInt64 GetSize() const;
+
+	protected:
+	D_CORE_API dMappedFile();
+	D_CORE_API virtual ~dMappedFile();
+
+	private:
+	const void* m_data;
+	dInt64 m_size;
+#if defined (_WIN_32_VER) || defined (_WIN_64_VER)
+	void* m_file;
+	void* m_mapping;
+#endif
+};
+
+inline const void* dMappedFile::GetData() const
+{
+	return m_data;
+}
+
+inline dInt64 dMappedFile::GetSize() const
+{
+	return m_size;
+}
+
+#endif
@@ -30,6 +30,7 @@
 #include "dTree.h"
 #include "dStack.h"
 #include "dPolyhedra.h"
+#include "dThreadPool.h"
 #include "dPolygonSoupBuilder.h"
 
 //#include "dMatrix.h"
@@ -132,12 +133,108 @@ class dPolygonSoupBuilder::dgPolySoupFilterAllocator: public dPolyhedra
 	}
 };
 
+class dPolygonSoupBuilder::dgFaceRegion
+{
+	public:
+	dInt32 m_faceId;
+	dInt32 m_start;
+	dInt32 m_count;
+};
+
+class dPolygonSoupBuilder::dgFilterFacesJob: public dThreadPoolJob
+{
+	public:
+	class dgContext
+	{
+		public:
+		dPolygonSoupBuilder* m_builder;
+		const dInt32* m_faceStart;
+		dInt32* m_filteredCount;
+	};
+
+	virtual void Execute()
+	{
+		const dgContext& context = *((dgContext*)m_context);
+		dPolygonSoupBuilder* const builder = context.m_builder;
+		const dInt32 faceCount = builder->m_faceVertexCount.GetCount();
+		const dInt32 start = dInt32((dInt64(faceCount) * GetThreadId()) / GetThreadCount());
+		const dInt32 end = dInt32((dInt64(faceCount) * (GetThreadId() + 1)) / GetThreadCount());
+		for (dInt32 i = start; i < end; i++)
+		{
+			dInt32* const face = &builder->m_vertexIndex[context.m_faceStart[i]];
+			context.m_filteredCount[i] = builder->FilterFace(builder->m_faceVertexCount[i] - 1, face);
+		}
+	}
+
+	void* m_context;
+};
+
+class dPolygonSoupBuilder::dgFaceNormalsJob: public dThreadPoolJob
+{
+	public:
+	class dgContext
+	{
+		public:
+		dPolygonSoupBuilder* m_builder;
+		const dInt32* m_faceStart;
+	};
+
+	virtual void Execute()
+	{
+		const dgContext& context = *((dgContext*)m_context);
+		dPolygonSoupBuilder* const builder = context.m_builder;
+		const dInt32 faceCount = builder->m_faceVertexCount.GetCount();
+		const dInt32 start = dInt32((dInt64(faceCount) * GetThreadId()) / GetThreadCount());
+		const dInt32 end = dInt32((dInt64(faceCount) * (GetThreadId() + 1)) / GetThreadCount());
+		for (dInt32 i = start; i < end; i++)
+		{
+			builder->m_normalPoints[i] = builder->CalculateFaceNormal(builder->m_faceVertexCount[i], &builder->m_vertexIndex[context.m_faceStart[i]]);
+		}
+	}
+
+	void* m_context;
+};
+
+class dPolygonSoupBuilder::dgOptimizeRegionsJob: public dThreadPoolJob
+{
+	public:
+	class dgContext
+	{
+		public:
+		dgContext()
+			:m_index(0)
+		{
+		}
+
+		const dPolygonSoupBuilder* m_source;
+		const dgFaceInfo** m_faces;
+		const dgFaceRegion* m_regions;
+		dPolygonSoupBuilder** m_builders;
+		dAtomic<dInt32> m_index;
+		dInt32 m_count;
+	};
+
+	virtual void Execute()
+	{
+		dgContext& context = *((dgContext*)m_context);
+		for (dInt32 i = context.m_index.fetch_add(1); i < context.m_count; i = context.m_index.fetch_add(1))
+		{
+			dPolygonSoupBuilder* const builder = new dPolygonSoupBuilder();
+			builder->OptimizeRegion(context.m_regions[i], context.m_faces, *context.m_source);
+			context.m_builders[i] = builder;
+		}
+	}
+
+	void* m_context;
+};
+
 dPolygonSoupBuilder::dPolygonSoupBuilder ()
 	:m_faceVertexCount()
 	,m_vertexIndex()
 	,m_normalIndex()
 	,m_vertexPoints()
 	,m_normalPoints()
+	,m_threadPool(nullptr)
 {
 	m_run = DG_POINTS_RUN;
 }
@@ -148,6 +245,7 @@ dPolygonSoupBuilder::dPolygonSoupBuilder (const dPolygonSoupBuilder& source)
 	,m_normalIndex()
 	,m_vertexPoints(source.m_vertexPoints.GetCount())
 	,m_normalPoints()
+	,m_threadPool(nullptr)
 {
 	m_run = DG_POINTS_RUN;
 	m_faceVertexCount.SetCount(source.m_faceVertexCount.GetCount());
@@ -174,6 +272,16 @@ dPolygonSoupBuilder::~dPolygonSoupBuilder ()
 {
 }
 
+dThreadPool* dPolygonSoupBuilder::GetThreadPool() const
+{
+	return m_threadPool;
+}
+
+void dPolygonSoupBuilder::SetThreadPool(dThreadPool* const threadPool)
+{
+	m_threadPool = threadPool;
+}
+
 void dPolygonSoupBuilder::Begin()
 {
 	m_run = DG_POINTS_RUN;
@@ -508,13 +616,36 @@ void dPolygonSoupBuilder::OptimizeByIndividualFaces()
 	dInt32* const oldFaceArray = &m_faceVertexCount[0];
 	dInt32* const oldIndexArray = &m_vertexIndex[0];
 
+	const dInt32 faceCount = m_faceVertexCount.GetCount();
+	dStack<dInt32> filteredCount(m_threadPool ? faceCount : 0);
+	if (m_threadPool)
+	{
+		dStack<dInt32> faceStart(faceCount);
+		dInt32 acc = 0;
+		for (dInt32 i = 0; i < faceCount; i++)
+		{
+			faceStart[i] = acc;
+			acc += oldFaceArray[i];
+		}
+
+		dgFilterFacesJob::dgContext context;
+		context.m_builder = this;
+		context.m_faceStart = &faceStart[0];
+		context.m_filteredCount = &filteredCount[0];
+		m_threadPool->Begin();
+		dgFilterFacesJob filterFacesJob;
+		filterFacesJob.m_context = &context;
+		m_threadPool->SubmitJobs(filterFacesJob);
+		m_threadPool->End();
+	}
+
 	dInt32 polygonIndex = 0;
 	dInt32 newFaceCount = 0;
 	dInt32 newIndexCount = 0;
-	for (dInt32 i = 0; i < m_faceVertexCount.GetCount(); i ++)
+	for (dInt32 i = 0; i < faceCount; i ++)
 	{
 		dInt32 oldCount = oldFaceArray[i];
-		dInt32 count = FilterFace (oldCount - 1, &oldIndexArray[polygonIndex]);
+		dInt32 count = m_threadPool ? filteredCount[i] : FilterFace (oldCount - 1, &oldIndexArray[polygonIndex]);
 		if (count) 
 		{
 			faceArray[newFaceCount] = count + 1;
@@ -544,50 +675,18 @@ void dPolygonSoupBuilder::End(bool optimize)
 		dgFaceMap faceMap (copy);
 
 		Begin();
-		dgFaceMap::Iterator iter (faceMap);
-		for (iter.Begin(); iter; iter ++) 
-		{
-			const dgFaceBucket& bucket = iter.GetNode()->GetInfo();
-			Optimize(iter.GetNode()->GetKey(), bucket, copy);
-		}
+		Optimize(faceMap, copy);
 	}
 	Finalize();
 
 	// build the normal array and adjacency array
-	dInt32 indexCount = 0;
 	const dInt32 faceCount = m_faceVertexCount.GetCount();
 	if (faceCount)
 	{
 		// calculate all face the normals
-		m_normalPoints.Resize(faceCount);
-		m_normalPoints.SetCount(faceCount);
-		for (dInt32 i = 0; i < faceCount; i++)
-		{
-			dInt32 faceIndexCount = m_faceVertexCount[i];
+		CalculateFaceNormals();
 
-			const dInt32* const ptr = &m_vertexIndex[indexCount];
-			dBigVector v0(&m_vertexPoints[ptr[0]].m_x);
-			dBigVector v1(&m_vertexPoints[ptr[1]].m_x);
-			dBigVector e0(v1 - v0);
-			dBigVector normal0(dBigVector::m_zero);
-			for (dInt32 j = 2; j < faceIndexCount - 1; j++)
-			{
-				dBigVector v2(&m_vertexPoints[ptr[j]].m_x);
-				dBigVector e1(v2 - v0);
-				normal0 += e0.CrossProduct(e1);
-				e0 = e1;
-			}
-			dBigVector normal(normal0.Normalize());
-
-			m_normalPoints[i].m_x = normal.m_x;
-			m_normalPoints[i].m_y = normal.m_y;
-			m_normalPoints[i].m_z = normal.m_z;
-			m_normalPoints[i].m_w = dFloat32(0.0f);
-			indexCount += faceIndexCount;
-		}
 		// compress normals array
-		//m_normalIndex[m_faceCount] = 0;
-
 		m_normalIndex.Resize(faceCount);;
 		m_normalIndex.SetCount(faceCount);
 		dInt32 normalCount = dVertexListToIndexList(&m_normalPoints[0].m_x, sizeof(dBigVector), 3, faceCount, &m_normalIndex[0], dFloat32(1.0e-6f));
@@ -596,196 +695,265 @@ void dPolygonSoupBuilder::End(bool optimize)
 	}
 }
 
-void dPolygonSoupBuilder::Optimize(dInt32 faceId, const dgFaceBucket& faceBucket, const dPolygonSoupBuilder& source)
+dBigVector dPolygonSoupBuilder::CalculateFaceNormal(dInt32 faceIndexCount, const dInt32* const indexArray) const
+{
+	dBigVector v0(&m_vertexPoints[indexArray[0]].m_x);
+	dBigVector v1(&m_vertexPoints[indexArray[1]].m_x);
+	dBigVector e0(v1 - v0);
+	dBigVector normal0(dBigVector::m_zero);
+	for (dInt32 j = 2; j < faceIndexCount - 1; j++)
+	{
+		dBigVector v2(&m_vertexPoints[indexArray[j]].m_x);
+		dBigVector e1(v2 - v0);
+		normal0 += e0.CrossProduct(e1);
+		e0 = e1;
+	}
+	dBigVector normal(normal0.Normalize());
+	return dBigVector(normal.m_x, normal.m_y, normal.m_z, dFloat64(0.0f));
+}
+
+void dPolygonSoupBuilder::CalculateFaceNormals()
+{
+	const dInt32 faceCount = m_faceVertexCount.GetCount();
+	m_normalPoints.Resize(faceCount);
+	m_normalPoints.SetCount(faceCount);
+	if (m_threadPool)
+	{
+		dStack<dInt32> faceStart(faceCount);
+		dInt32 acc = 0;
+		for (dInt32 i = 0; i < faceCount; i++)
+		{
+			faceStart[i] = acc;
+			acc += m_faceVertexCount[i];
+		}
+
+		dgFaceNormalsJob::dgContext context;
+		context.m_builder = this;
+		context.m_faceStart = &faceStart[0];
+		m_threadPool->Begin();
+		dgFaceNormalsJob faceNormalsJob;
+		faceNormalsJob.m_context = &context;
+		m_threadPool->SubmitJobs(faceNormalsJob);
+		m_threadPool->End();
+	}
+	else
+	{
+		dInt32 indexCount = 0;
+		for (dInt32 i = 0; i < faceCount; i++)
+		{
+			dInt32 faceIndexCount = m_faceVertexCount[i];
+			m_normalPoints[i] = CalculateFaceNormal(faceIndexCount, &m_vertexIndex[indexCount]);
+			indexCount += faceIndexCount;
+		}
+	}
+}
+
+void dPolygonSoupBuilder::PartitionFaces(dInt32 faceId, const dgFaceBucket& faceBucket, const dPolygonSoupBuilder& source, dArray<const dgFaceInfo*>& faces, dArray<dgFaceRegion>& regions) const
 {
 	#define DG_MESH_PARTITION_SIZE (1024 * 4)
 
 	const dInt32* const indexArray = &source.m_vertexIndex[0];
 	const dBigVector* const points = &source.m_vertexPoints[0];
 
-	dVector face[256];
-	dInt32 faceIndex[256];
-	if (faceBucket.GetCount() >= DG_MESH_PARTITION_SIZE) 
+	const dInt32 base = faces.GetCount();
+	for (dgFaceBucket::dNode* node = faceBucket.GetFirst(); node; node = node->GetNext()) 
 	{
-		dStack<dgFaceBucket::dNode*> array(faceBucket.GetCount());
-		dInt32 count = 0;
-		for (dgFaceBucket::dNode* node = faceBucket.GetFirst(); node; node = node->GetNext()) 
-		{
-			array[count] = node;
-			count ++;
-		}
+		faces.PushBack(&node->GetInfo());
+	}
+	const dgFaceInfo** const array = &faces[base];
 
-		dInt32 stack = 1;
-		dInt32 segments[32][2];
-			
-		segments[0][0] = 0;
-		segments[0][1] = count;
-	
-		while (stack) 
-		{
-			stack --;
-			dInt32 faceStart = segments[stack][0];
-			dInt32 faceCount = segments[stack][1];
+	dInt32 stack = 1;
+	dInt32 segments[32][2];
+		
+	segments[0][0] = 0;
+	segments[0][1] = faces.GetCount() - base;
+	while (stack) 
+	{
+		stack --;
+		dInt32 faceStart = segments[stack][0];
+		dInt32 faceCount = segments[stack][1];
 
-			if (faceCount <= DG_MESH_PARTITION_SIZE) 
+		if (faceCount <= DG_MESH_PARTITION_SIZE) 
+		{
+			dgFaceRegion region;
+			region.m_faceId = faceId;
+			region.m_start = base + faceStart;
+			region.m_count = faceCount;
+			regions.PushBack(region);
+		} 
+		else 
+		{
+			dBigVector median (dBigVector::m_zero);
+			dBigVector varian (dBigVector::m_zero);
+			for (dInt32 i = 0; i < faceCount; i ++) 
 			{
-				dPolygonSoupBuilder tmpBuilder;
-				for (dInt32 i = 0; i < faceCount; i ++) 
+				const dgFaceInfo& faceInfo = *array[faceStart + i];
+				dInt32 count1 = faceInfo.indexCount - 1;
+				dInt32 start1 = faceInfo.indexStart;
+				dBigVector p0 (dFloat32 ( 1.0e10f), dFloat32 ( 1.0e10f), dFloat32 ( 1.0e10f), dFloat32 (0.0f));
+				dBigVector p1 (dFloat32 (-1.0e10f), dFloat32 (-1.0e10f), dFloat32 (-1.0e10f), dFloat32 (0.0f));
+				for (dInt32 j = 0; j < count1; j ++) 
 				{
-					const dgFaceInfo& faceInfo = array[faceStart + i]->GetInfo();
-
-					dInt32 count1 = faceInfo.indexCount - 1;
-					dInt32 start1 = faceInfo.indexStart;
-					dAssert (faceId == indexArray[start1 + count1]);
-					for (dInt32 j = 0; j < count1; j ++) 
-					{
-						dInt32 index = indexArray[start1 + j];
-						face[j] = points[index];
-						faceIndex[j] = j;
-					}
-					//dInt32 faceIndexCount = count1;
-					//tmpBuilder.AddMesh (&face[0].m_x, count1, sizeof (dVector), 1, &faceIndexCount, &faceIndex[0], &faceId, dGetIdentityMatrix()); 
-					tmpBuilder.AddFaceIndirect(&face[0].m_x, sizeof(dVector), faceId, faceIndex, count1);
+					dInt32 index = indexArray[start1 + j];
+					const dBigVector& p = points[index];
+					dAssert(p.m_w == dFloat32(0.0f));
+					p0 = p0.GetMin(p);
+					p1 = p1.GetMax(p);
 				}
-				tmpBuilder.FinalizeAndOptimize (faceId);
+				dBigVector p ((p0 + p1).Scale (0.5f));
+				median += p;
+				varian += p * p;
+			}
 
-				dInt32 faceIndexNumber = 0;
-				for (dInt32 i = 0; i < tmpBuilder.m_faceVertexCount.GetCount(); i ++)
-				{
-					dInt32 indexCount = tmpBuilder.m_faceVertexCount[i] - 1;
-					for (dInt32 j = 0; j < indexCount; j ++) 
-					{
-						dInt32 index = tmpBuilder.m_vertexIndex[faceIndexNumber + j];
-						face[j] = tmpBuilder.m_vertexPoints[index];
-						faceIndex[j] = j;
-					}
-					//dInt32 faceArray = indexCount;
-					//AddMesh (&face[0].m_x, indexCount, sizeof (dVector), 1, &faceArray, faceIndex, &faceId, dGetIdentityMatrix());
-					AddFaceIndirect(&face[0].m_x, sizeof(dVector), faceId, faceIndex, indexCount);
-					faceIndexNumber += (indexCount + 1); 
-				}
-			} 
-			else 
+			varian = varian.Scale (dFloat32 (faceCount)) - median * median;
+
+			dInt32 axis = 0;
+			dFloat32 maxVarian = dFloat32 (-1.0e10f);
+			for (dInt32 i = 0; i < 3; i ++) 
 			{
-				dBigVector median (dBigVector::m_zero);
-				dBigVector varian (dBigVector::m_zero);
-				for (dInt32 i = 0; i < faceCount; i ++) 
+				if (varian[i] > maxVarian) 
 				{
-					const dgFaceInfo& faceInfo = array[faceStart + i]->GetInfo();
-					dInt32 count1 = faceInfo.indexCount - 1;
-					dInt32 start1 = faceInfo.indexStart;
-					dBigVector p0 (dFloat32 ( 1.0e10f), dFloat32 ( 1.0e10f), dFloat32 ( 1.0e10f), dFloat32 (0.0f));
-					dBigVector p1 (dFloat32 (-1.0e10f), dFloat32 (-1.0e10f), dFloat32 (-1.0e10f), dFloat32 (0.0f));
-					for (dInt32 j = 0; j < count1; j ++) 
-					{
-						dInt32 index = indexArray[start1 + j];
-						const dBigVector& p = points[index];
-						dAssert(p.m_w == dFloat32(0.0f));
-						p0 = p0.GetMin(p);
-						p1 = p1.GetMax(p);
-					}
-					dBigVector p ((p0 + p1).Scale (0.5f));
-					median += p;
-					varian += p * p;
+					axis = i;
+					maxVarian = dFloat32 (varian[i]);
 				}
+			}
+			dBigVector center = median.Scale (dFloat32 (1.0f) / dFloat32 (faceCount));
+			dFloat64 axisVal = center[axis];
 
-				varian = varian.Scale (dFloat32 (faceCount)) - median * median;
+			dInt32 leftCount = 0;
+			dInt32 lastFace = faceCount;
 
-				dInt32 axis = 0;
-				dFloat32 maxVarian = dFloat32 (-1.0e10f);
-				for (dInt32 i = 0; i < 3; i ++) 
+			for (dInt32 i = 0; i < lastFace; i ++) 
+			{
+				dInt32 side = 0;
+				const dgFaceInfo& faceInfo = *array[faceStart + i];
+
+				dInt32 start1 = faceInfo.indexStart;
+				dInt32 count1 = faceInfo.indexCount - 1;
+				for (dInt32 j = 0; j < count1; j ++) 
 				{
-					if (varian[i] > maxVarian) 
+					dInt32 index = indexArray[start1 + j];
+					const dBigVector& p = points[index];
+					if (p[axis] > axisVal) 
 					{
-						axis = i;
-						maxVarian = dFloat32 (varian[i]);
+						side = 1;
+						break;
 					}
 				}
-				dBigVector center = median.Scale (dFloat32 (1.0f) / dFloat32 (faceCount));
-				dFloat64 axisVal = center[axis];
 
-				dInt32 leftCount = 0;
-				dInt32 lastFace = faceCount;
-
-				for (dInt32 i = 0; i < lastFace; i ++) 
+				if (side) 
 				{
-					dInt32 side = 0;
-					const dgFaceInfo& faceInfo = array[faceStart + i]->GetInfo();
-
-					dInt32 start1 = faceInfo.indexStart;
-					dInt32 count1 = faceInfo.indexCount - 1;
-					for (dInt32 j = 0; j < count1; j ++) 
-					{
-						dInt32 index = indexArray[start1 + j];
-						const dBigVector& p = points[index];
-						if (p[axis] > axisVal) 
-						{
-							side = 1;
-							break;
-						}
-					}
-
-					if (side) 
-					{
-						dSwap (array[faceStart + i], array[faceStart + lastFace - 1]);
-						lastFace --;
-						i --;
-					} 
-					else 
-					{
-						leftCount ++;
-					}
+					dSwap (array[faceStart + i], array[faceStart + lastFace - 1]);
+					lastFace --;
+					i --;
+				} 
+				else 
+				{
+					leftCount ++;
 				}
-				dAssert (leftCount);
-				dAssert (leftCount < faceCount);
+			}
+			dAssert (leftCount);
+			dAssert (leftCount < faceCount);
 
-				segments[stack][0] = faceStart;
-				segments[stack][1] = leftCount;
-				stack ++;
+			segments[stack][0] = faceStart;
+			segments[stack][1] = leftCount;
+			stack ++;
 
-				segments[stack][0] = faceStart + leftCount;
-				segments[stack][1] = faceCount - leftCount;
-				stack ++;
-			}
+			segments[stack][0] = faceStart + leftCount;
+			segments[stack][1] = faceCount - leftCount;
+			stack ++;
 		}
-	} 
-	else 
+	}
+}
+
+void dPolygonSoupBuilder::OptimizeRegion(const dgFaceRegion& region, const dgFaceInfo** const faces, const dPolygonSoupBuilder& source)
+{
+	const dInt32* const indexArray = &source.m_vertexIndex[0];
+	const dBigVector* const points = &source.m_vertexPoints[0];
+
+	dVector face[256];
+	dInt32 faceIndex[256];
+	for (dInt32 i = 0; i < region.m_count; i ++) 
 	{
-		dPolygonSoupBuilder tmpBuilder;
-		for (dgFaceBucket::dNode* node = faceBucket.GetFirst(); node; node = node->GetNext()) 
+		const dgFaceInfo& faceInfo = *faces[region.m_start + i];
+
+		dInt32 count = faceInfo.indexCount - 1;
+		dInt32 start = faceInfo.indexStart;
+		dAssert (region.m_faceId == indexArray[start + count]);
+		for (dInt32 j = 0; j < count; j ++) 
 		{
-			const dgFaceInfo& faceInfo = node->GetInfo();
+			dInt32 index = indexArray[start + j];
+			face[j] = points[index];
+			faceIndex[j] = j;
+		}
+		AddFaceIndirect(&face[0].m_x, sizeof(dVector), region.m_faceId, faceIndex, count);
+	}
+	FinalizeAndOptimize (region.m_faceId);
+}
 
-			dInt32 count = faceInfo.indexCount - 1;
-			dInt32 start = faceInfo.indexStart;
-			dAssert (faceId == indexArray[start + count]);
-			for (dInt32 j = 0; j < count; j ++) 
-			{
-				dInt32 index = indexArray[start + j];
-				face[j] = points[index];
-				faceIndex[j] = j;
-			}
-			//dInt32 faceIndexCount = count;
-			//tmpBuilder.AddMesh (&face[0].m_x, count, sizeof (dVector), 1, &faceIndexCount, &faceIndex[0], &faceId, dGetIdentityMatrix()); 
-			tmpBuilder.AddFaceIndirect(&face[0].m_x, sizeof(dVector), faceId, faceIndex, count);
+void dPolygonSoupBuilder::AddRegion(dInt32 faceId, const dPolygonSoupBuilder& region)
+{
+	dVector face[256];
+	dInt32 faceIndex[256];
+	dInt32 faceIndexNumber = 0;
+	for (dInt32 i = 0; i < region.m_faceVertexCount.GetCount(); i ++)
+	{
+		dInt32 indexCount = region.m_faceVertexCount[i] - 1;
+		for (dInt32 j = 0; j < indexCount; j ++) 
+		{
+			dInt32 index = region.m_vertexIndex[faceIndexNumber + j];
+			face[j] = region.m_vertexPoints[index];
+			faceIndex[j] = j;
 		}
-		tmpBuilder.FinalizeAndOptimize (faceId);
+		AddFaceIndirect(&face[0].m_x, sizeof(dVector), faceId, faceIndex, indexCount);
+		faceIndexNumber += (indexCount + 1); 
+	}
+}
+
+void dPolygonSoupBuilder::Optimize(const dgFaceMap& faceMap, const dPolygonSoupBuilder& source)
+{
+	// split the faces of each material into spatial regions and optimize each one
+	// separately, the regions are added back in the same order, so the
+	// result does not depend on the number of threads.
+	dArray<dgFaceRegion> regions;
+	dArray<const dgFaceInfo*> faces;
+	dgFaceMap::Iterator iter (faceMap);
+	for (iter.Begin(); iter; iter ++) 
+	{
+		const dgFaceBucket& bucket = iter.GetNode()->GetInfo();
+		PartitionFaces(iter.GetNode()->GetKey(), bucket, source, faces, regions);
+	}
 
-		dInt32 faceIndexNumber = 0;
-		for (dInt32 i = 0; i < tmpBuilder.m_faceVertexCount.GetCount(); i ++)
+	if (m_threadPool && regions.GetCount())
+	{
+		dArray<dPolygonSoupBuilder*> builders;
+		builders.SetCount(regions.GetCount());
+
+		dgOptimizeRegionsJob::dgContext context;
+		context.m_source = &source;
+		context.m_faces = &faces[0];
+		context.m_regions = &regions[0];
+		context.m_builders = &builders[0];
+		context.m_count = regions.GetCount();
+		m_threadPool->Begin();
+		dgOptimizeRegionsJob optimizeRegionsJob;
+		optimizeRegionsJob.m_context = &context;
+		m_threadPool->SubmitJobs(optimizeRegionsJob);
+		m_threadPool->End();
+
+		for (dInt32 i = 0; i < regions.GetCount(); i++)
 		{
-			dInt32 indexCount = tmpBuilder.m_faceVertexCount[i] - 1;
-			for (dInt32 j = 0; j < indexCount; j ++) 
-			{
-				dInt32 index = tmpBuilder.m_vertexIndex[faceIndexNumber + j];
-				face[j] = tmpBuilder.m_vertexPoints[index];
-				faceIndex[j] = j;
-			}
-			//dInt32 faceArray = indexCount;
-			//AddMesh (&face[0].m_x, indexCount, sizeof (dVector), 1, &faceArray, faceIndex, &faceId, dGetIdentityMatrix());
-			AddFaceIndirect(&face[0].m_x, sizeof(dVector), faceId, faceIndex, indexCount);
-		
-			faceIndexNumber += (indexCount + 1); 
+			AddRegion(regions[i].m_faceId, *builders[i]);
+			delete builders[i];
+		}
+	}
+	else
+	{
+		for (dInt32 i = 0; i < regions.GetCount(); i++)
+		{
+			dPolygonSoupBuilder tmpBuilder;
+			tmpBuilder.OptimizeRegion(regions[i], &faces[0], source);
+			AddRegion(regions[i].m_faceId, tmpBuilder);
 		}
 	}
 }
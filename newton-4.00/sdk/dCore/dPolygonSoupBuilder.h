@@ -34,6 +34,8 @@
 #include "dVector.h"
 #include "dMatrix.h"
 
+class dThreadPool;
+
 class AdjacentdFace
 {
 	public:
@@ -48,6 +50,10 @@ class dPolygonSoupBuilder: public dClassAlloc
 	class dgFaceMap;
 	class dgFaceInfo;
 	class dgFaceBucket;
+	class dgFaceRegion;
+	class dgFilterFacesJob;
+	class dgFaceNormalsJob;
+	class dgOptimizeRegionsJob;
 	class dgPolySoupFilterAllocator;
 	public:
 
@@ -62,8 +68,20 @@ class dPolygonSoupBuilder: public dClassAlloc
 
 	D_CORE_API void SavePLY(const char* const fileName) const;
 
+	// the pool used to cook the mesh, the default is none and the mesh is cooked serially.
+	// with a pool, face filtering, face optimization and the bvh build of
+	// dAabbPolygonSoup::Create run on its threads and produce the same mesh.
+	// the pool is owned by the caller and must be idle while the mesh is cooked.
+	D_CORE_API dThreadPool* GetThreadPool() const;
+	D_CORE_API void SetThreadPool(dThreadPool* const threadPool);
+
 	private:
-	void Optimize(dInt32 faceId, const dgFaceBucket& faceBucket, const dPolygonSoupBuilder& source);
+	void Optimize(const dgFaceMap& faceMap, const dPolygonSoupBuilder& source);
+	void PartitionFaces(dInt32 faceId, const dgFaceBucket& faceBucket, const dPolygonSoupBuilder& source, dArray<const dgFaceInfo*>& faces, dArray<dgFaceRegion>& regions) const;
+	void OptimizeRegion(const dgFaceRegion& region, const dgFaceInfo** const faces, const dPolygonSoupBuilder& source);
+	void AddRegion(dInt32 faceId, const dPolygonSoupBuilder& region);
+	void CalculateFaceNormals();
+	dBigVector CalculateFaceNormal(dInt32 indexCount, const dInt32* const indexArray) const;
 
 	void Finalize();
 	void OptimizeByIndividualFaces();
@@ -106,6 +124,7 @@ class dPolygonSoupBuilder: public dClassAlloc
 	dgIndexArray m_normalIndex;
 	dgVertexArray m_vertexPoints;
 	dgVertexArray m_normalPoints;
+	dThreadPool* m_threadPool;
 	dInt32 m_run;
 };
 
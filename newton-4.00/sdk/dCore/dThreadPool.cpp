@@ -144,10 +144,12 @@ void dThreadPool::ExecuteJobs(dThreadPoolJob** const jobs)
 		for (dInt32 i = 0; i < m_count; i++)
 		{
 			jobs[i]->m_threadIndex = i;
+			jobs[i]->m_threadCount = m_count + 1;
 			m_lockFreeJobs[i].m_job.store(jobs[i]);
 		}
 
 		jobs[m_count]->m_threadIndex = m_count;
+		jobs[m_count]->m_threadCount = m_count + 1;
 		jobs[m_count]->Execute();
 		while (m_joindInqueue.load())
 		{
@@ -157,6 +159,7 @@ void dThreadPool::ExecuteJobs(dThreadPoolJob** const jobs)
 	else
 	{
 		jobs[0]->m_threadIndex = 0;
+		jobs[0]->m_threadCount = 1;
 		jobs[0]->Execute();
 	}
 }
@@ -48,10 +48,16 @@ class dThreadPoolJob
 		return m_threadIndex; 
 	}
 
+	dInt32 GetThreadCount() const
+	{
+		return m_threadCount;
+	}
+
 	virtual void Execute() = 0;
 
 	private:
 	dInt32 m_threadIndex;
+	dInt32 m_threadCount;
 	friend class dThreadPool;
 };
 
@@ -102,6 +108,9 @@ class dThreadPool: public dSyncMutex, public dThread
 	D_CORE_API void TickOne();
 	D_CORE_API void ExecuteJobs(dThreadPoolJob** const jobs);
 
+	template <class T>
+	void SubmitJobs(const T& job);
+
 	D_CORE_API void Begin();
 	D_CORE_API void End();
 
@@ -116,4 +125,20 @@ class dThreadPool: public dSyncMutex, public dThread
 	dThreadLockFreeUpdate m_lockFreeJobs[D_MAX_THREADS_COUNT];
 };
 
+// run a copy of job on each thread of the pool
+template <class T>
+void dThreadPool::SubmitJobs(const T& job)
+{
+	T extJob[D_MAX_THREADS_COUNT];
+	dThreadPoolJob* extJobPtr[D_MAX_THREADS_COUNT];
+
+	const dInt32 threadCount = GetCount();
+	for (dInt32 i = 0; i < threadCount; i++)
+	{
+		extJob[i] = job;
+		extJobPtr[i] = &extJob[i];
+	}
+	ExecuteJobs(extJobPtr);
+}
+
 #endif
@@ -0,0 +1,82 @@
+/* Copyright (c) <2003-2021> <Julio Jerez, Newton Game Dynamics>
+* 
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "dCoreStdafx.h"
+#include "dTypes.h"
+#include "dUtils.h"
+#include "dMemory.h"
+#include "dThreadScratch.h"
+
+class dThreadScratchTable
+{
+	public:
+	dThreadScratchTable()
+	{
+		memset(m_buffers, 0, sizeof(m_buffers));
+		memset(m_sizes, 0, sizeof(m_sizes));
+	}
+
+	~dThreadScratchTable()
+	{
+		for (dInt32 i = 0; i < D_MAX_THREAD_SCRATCH_SLOTS; i++)
+		{
+			if (m_buffers[i])
+			{
+				dMemory::Free(m_buffers[i]);
+			}
+		}
+	}
+
+	void* m_buffers[D_MAX_THREAD_SCRATCH_SLOTS];
+	dInt32 m_sizes[D_MAX_THREAD_SCRATCH_SLOTS];
+};
+
+static dThreadScratchTable& GetThreadTable()
+{
+	static thread_local dThreadScratchTable table;
+	return table;
+}
+
+dInt32 dThreadScratch::AllocateSlot()
+{
+	static dAtomic<dInt32> slotsCount(0);
+	const dInt32 slot = slotsCount.fetch_add(1);
+	dAssert(slot < D_MAX_THREAD_SCRATCH_SLOTS);
+	return slot;
+}
+
+void* dThreadScratch::GetBuffer(dInt32 slot, dInt32 sizeInBytes)
+{
+	dAssert(slot >= 0);
+	dAssert(slot < D_MAX_THREAD_SCRATCH_SLOTS);
+	dThreadScratchTable& table = GetThreadTable();
+	if (table.m_sizes[slot] < sizeInBytes)
+	{
+		if (table.m_buffers[slot])
+		{
+			dMemory::Free(table.m_buffers[slot]);
+		}
+		const dInt32 size = dMax(sizeInBytes, table.m_sizes[slot] * 2);
+		table.m_buffers[slot] = dMemory::Malloc(size_t(size));
+		table.m_sizes[slot] = size;
+	}
+	return table.m_buffers[slot];
+}
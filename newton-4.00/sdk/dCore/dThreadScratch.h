@@ -0,0 +1,57 @@
+/* Copyright (c) <2003-2021> <Julio Jerez, Newton Game Dynamics>
+* 
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef __D_THREAD_SCRATCH_H__
+#define __D_THREAD_SCRATCH_H__
+
+#include "dCoreStdafx.h"
+#include "dTypes.h"
+
+#define D_MAX_THREAD_SCRATCH_SLOTS	16
+
+/// Per thread scratch buffers for the hot paths of collision queries.
+/// Each thread owns a table of buffers that is found with a thread local 
+/// lookup, so getting a buffer does not search and does not lock.
+/// A buffer is identified by a slot that the code using it allocates 
+/// once, its content stays valid until the same thread asks for the 
+/// same slot again. Buffers are freed when the thread exits.
+class dThreadScratch
+{
+	public:
+	/// Allocate a new slot id, call once and keep the id in a static variable.
+	D_CORE_API static dInt32 AllocateSlot();
+
+	/// Return a buffer of at least sizeInBytes for the calling thread.
+	/// \brief the content is not preserved when the buffer has to grow.
+	D_CORE_API static void* GetBuffer(dInt32 slot, dInt32 sizeInBytes);
+
+	/// Return a buffer of at least count elements of type T for the calling thread.
+	template <class T>
+	static T* GetBuffer(dInt32 slot, dInt32 count);
+};
+
+template <class T>
+T* dThreadScratch::GetBuffer(dInt32 slot, dInt32 count)
+{
+	return (T*)GetBuffer(slot, dInt32(count * sizeof(T)));
+}
+
+#endif
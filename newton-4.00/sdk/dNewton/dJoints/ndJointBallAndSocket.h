@@ -50,6 +50,8 @@ class ndJointBallAndSocket: public ndJointBilateralConstraint
 	dFloat32 m_twistFriction;
 	dFloat32 m_coneFrictionRegularizer;
 	dFloat32 m_twistFrictionRegularizer;
+
+	friend class ndWorldSnapshot;
 };
 
 #endif 
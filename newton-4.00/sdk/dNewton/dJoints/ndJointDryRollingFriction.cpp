@@ -50,9 +50,9 @@ void ndJointDryRollingFriction::JacobianDerivative(ndConstraintDescritor& desc)
 		if (contact->IsActive())
 		{
 			const ndContactPointList& contactPoints = contact->GetContactPoints();
-			for (ndContactPointList::dNode* node = contactPoints.GetFirst(); node; node = node->GetNext())
+			for (dInt32 i = 0; i < contactPoints.GetCount(); i++)
 			{
-				const ndForceImpactPair& normalForce = node->GetInfo().m_normal_Force;
+				const ndForceImpactPair& normalForce = contactPoints[i].m_normal_Force;
 				dFloat32 force = normalForce.GetInitiailGuess();
 				maxForce = dMax(force, maxForce);
 			}
@@ -34,6 +34,8 @@ class ndJointFix6dof: public ndJointBilateralConstraint
 	dFloat32 m_softness;
 	dFloat32 m_maxForce;
 	dFloat32 m_maxTorque;
+
+	friend class ndWorldSnapshot;
 };
 #endif 
 
@@ -53,6 +53,8 @@ class ndJointHinge: public ndJointBilateralConstraint
 
 	bool m_hasLimits;
 	bool m_isSpringDamper;
+
+	friend class ndWorldSnapshot;
 };
 
 #endif 
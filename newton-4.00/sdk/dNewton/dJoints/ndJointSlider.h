@@ -51,6 +51,8 @@ class ndJointSlider: public ndJointBilateralConstraint
 
 	bool m_hasLimits;
 	bool m_isSpringDamper;
+
+	friend class ndWorldSnapshot;
 };
 
 #endif 
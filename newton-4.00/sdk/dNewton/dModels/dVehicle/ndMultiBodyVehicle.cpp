@@ -385,9 +385,9 @@ void ndMultiBodyVehicle::Debug(ndConstraintDebugCallback& context) const
 			if (contact->IsActive())
 			{
 				const ndContactPointList& contactPoints = contact->GetContactPoints();
-				for (ndContactPointList::dNode* contactNode = contactPoints.GetFirst(); contactNode; contactNode = contactNode->GetNext())
+				for (dInt32 i = 0; i < contactPoints.GetCount(); i++)
 				{
-					const ndContactMaterial& contactPoint = contactNode->GetInfo();
+					const ndContactMaterial& contactPoint = contactPoints[i];
 					dMatrix frame(contactPoint.m_normal, contactPoint.m_dir0, contactPoint.m_dir1, contactPoint.m_point);
 
 					dVector localPosit(m_localFrame.UntransformVector(chassisMatrix.UntransformVector(contactPoint.m_point)));
@@ -509,17 +509,17 @@ void ndMultiBodyVehicle::ApplyTireModel()
 					// these are contact produced by two or more polygons, 
 					// that can produce two contact so are close that they can generate 
 					// ill formed rows in the solver mass matrix
-					for (ndContactPointList::dNode* contactNode0 = contactPoints.GetFirst(); contactNode0; contactNode0 = contactNode0->GetNext())
+					for (dInt32 i = 0; i < contactPoints.GetCount(); i++)
 					{
-						const ndContactPoint& contactPoint0 = contactNode0->GetInfo();
-						for (ndContactPointList::dNode* contactNode1 = contactNode0->GetNext(); contactNode1; contactNode1 = contactNode1->GetNext())
+						const ndContactPoint& contactPoint0 = contactPoints[i];
+						for (dInt32 j = i + 1; j < contactPoints.GetCount(); j++)
 						{
-							const ndContactPoint& contactPoint1 = contactNode1->GetInfo();
+							const ndContactPoint& contactPoint1 = contactPoints[j];
 							const dVector error(contactPoint1.m_point - contactPoint0.m_point);
 							dFloat32 err2 = error.DotProduct(error).GetScalar();
 							if (err2 < D_MIN_CONTACT_CLOSE_DISTANCE2)
 							{
-								contactPoints.Remove(contactNode1);
+								contactPoints.Remove(j);
 								break;
 							}
 						}
@@ -528,9 +528,9 @@ void ndMultiBodyVehicle::ApplyTireModel()
 
 				dMatrix tireBasisMatrix (tire->GetLocalMatrix1() * tire->GetBody1()->GetMatrix());
 				tireBasisMatrix.m_posit = tire->GetBody0()->GetMatrix().m_posit;
-				for (ndContactPointList::dNode* contactNode = contactPoints.GetFirst(); contactNode; contactNode = contactNode->GetNext())
+				for (dInt32 i = 0; i < contactPoints.GetCount(); i++)
 				{
-					ndContactMaterial& contactPoint = contactNode->GetInfo();
+					ndContactMaterial& contactPoint = contactPoints[i];
 					dFloat32 contactPathLocation = dAbs (contactPoint.m_normal.DotProduct(tireBasisMatrix.m_front).GetScalar());
 					// contact are consider on the contact patch strip only if the are less than 
 					// 45 degree angle from the tire axle
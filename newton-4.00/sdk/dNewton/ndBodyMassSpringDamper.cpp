@@ -0,0 +1,971 @@
+/* Copyright (c) <2003-2021> <Julio Jerez, Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "dCoreStdafx.h"
+#include "ndNewtonStdafx.h"
+#include "ndWorld.h"
+#include "ndBodyMassSpringDamper.h"
+
+class ndBodyMassSpringDamper::ndSolverContext
+{
+	public:
+	ndBodyMassSpringDamper* m_body;
+	dFloat32 m_substep;
+	dFloat32 m_damping;
+	dInt32 m_color;
+};
+
+ndBodyMassSpringDamper::ndBodyMassSpringDamper()
+	:ndBodyParticleSet()
+	,m_spring0(1024)
+	,m_spring1(1024)
+	,m_restLength(1024)
+	,m_compliance(1024)
+	,m_lambda(1024)
+	,m_colorScans()
+	,m_invMass(1024)
+	,m_prevPosit(1024)
+	,m_contactPlane(1024)
+	,m_contactVeloc(1024)
+	,m_contactImpulse(1024)
+	,m_contactBody(1024)
+	,m_damping(dFloat32(0.5f))
+	,m_friction(dFloat32(0.5f))
+	,m_substeps(8)
+	,m_colorsAreValid(false)
+{
+}
+
+ndBodyMassSpringDamper::ndBodyMassSpringDamper(const nd::TiXmlNode* const xmlNode, const dTree<const ndShape*, dUnsigned32>& shapesCache)
+	:ndBodyParticleSet(xmlNode->FirstChild("ndBodyParticleSet"), shapesCache)
+	,m_spring0()
+	,m_spring1()
+	,m_restLength()
+	,m_compliance()
+	,m_lambda()
+	,m_colorScans()
+	,m_invMass()
+	,m_prevPosit()
+	,m_contactPlane()
+	,m_contactVeloc()
+	,m_contactImpulse()
+	,m_contactBody()
+	,m_damping(dFloat32(0.5f))
+	,m_friction(dFloat32(0.5f))
+	,m_substeps(8)
+	,m_colorsAreValid(false)
+{
+	// nothing was saved
+	dAssert(0);
+}
+
+ndBodyMassSpringDamper::~ndBodyMassSpringDamper()
+{
+}
+
+void ndBodyMassSpringDamper::Save(nd::TiXmlElement* const rootNode, const char* const assetPath, dInt32 nodeid, const dTree<dUnsigned32, const ndShape*>& shapesCache) const
+{
+	dAssert(0);
+	nd::TiXmlElement* const paramNode = CreateRootElement(rootNode, "ndBodyMassSpringDamper", nodeid);
+	ndBodyParticleSet::Save(paramNode, assetPath, nodeid, shapesCache);
+}
+
+void ndBodyMassSpringDamper::AddParticle(const dFloat32 mass, const dVector& position, const dVector& velocity)
+{
+	dVector point(position);
+	point.m_w = dFloat32(1.0f);
+	m_posit.PushBack(point);
+	m_velocity.PushBack(velocity & dVector::m_triplexMask);
+	m_invMass.PushBack((mass > dFloat32(0.0f)) ? dFloat32(1.0f) / mass : dFloat32(0.0f));
+}
+
+void ndBodyMassSpringDamper::SetParticleMass(dInt32 particle, dFloat32 mass)
+{
+	m_invMass[particle] = (mass > dFloat32(0.0f)) ? dFloat32(1.0f) / mass : dFloat32(0.0f);
+	if (mass <= dFloat32(0.0f))
+	{
+		m_velocity[particle] = dVector::m_zero;
+	}
+}
+
+void ndBodyMassSpringDamper::AddSpring(dInt32 particle0, dInt32 particle1, dFloat32 compliance)
+{
+	dAssert(particle0 != particle1);
+	dAssert(particle0 < m_posit.GetCount());
+	dAssert(particle1 < m_posit.GetCount());
+	const dVector dist(m_posit[particle0] - m_posit[particle1]);
+	m_spring0.PushBack(particle0);
+	m_spring1.PushBack(particle1);
+	m_restLength.PushBack(dSqrt(dist.DotProduct(dist & dVector::m_triplexMask).GetScalar()));
+	m_compliance.PushBack(dMax(compliance, dFloat32(0.0f)));
+	m_colorsAreValid = false;
+}
+
+dInt32 ndBodyMassSpringDamper::AddClothPatch(const dMatrix& matrix, dInt32 columns, dInt32 rows, dFloat32 spacing, dFloat32 mass, dFloat32 stretchCompliance, dFloat32 bendCompliance)
+{
+	const dInt32 base = m_posit.GetCount();
+	for (dInt32 z = 0; z < rows; z++)
+	{
+		for (dInt32 x = 0; x < columns; x++)
+		{
+			const dVector point(dFloat32(x) * spacing, dFloat32(0.0f), dFloat32(z) * spacing, dFloat32(1.0f));
+			AddParticle(mass, matrix.TransformVector(point), dVector::m_zero);
+		}
+	}
+
+	// stretch and shear springs between neighbors,
+	// bend springs skip one particle
+	for (dInt32 z = 0; z < rows; z++)
+	{
+		for (dInt32 x = 0; x < columns; x++)
+		{
+			const dInt32 index = base + z * columns + x;
+			if ((x + 1) < columns)
+			{
+				AddSpring(index, index + 1, stretchCompliance);
+			}
+			if ((z + 1) < rows)
+			{
+				AddSpring(index, index + columns, stretchCompliance);
+			}
+			if (((x + 1) < columns) && ((z + 1) < rows))
+			{
+				AddSpring(index, index + columns + 1, stretchCompliance);
+				AddSpring(index + 1, index + columns, stretchCompliance);
+			}
+			if ((x + 2) < columns)
+			{
+				AddSpring(index, index + 2, bendCompliance);
+			}
+			if ((z + 2) < rows)
+			{
+				AddSpring(index, index + 2 * columns, bendCompliance);
+			}
+		}
+	}
+	return base;
+}
+
+dInt32 ndBodyMassSpringDamper::AddSoftLattice(const dMatrix& matrix, dInt32 columns, dInt32 rows, dInt32 layers, dFloat32 spacing, dFloat32 mass, dFloat32 stretchCompliance, dFloat32 bendCompliance)
+{
+	const dInt32 base = m_posit.GetCount();
+	for (dInt32 y = 0; y < layers; y++)
+	{
+		for (dInt32 z = 0; z < rows; z++)
+		{
+			for (dInt32 x = 0; x < columns; x++)
+			{
+				const dVector point(dFloat32(x) * spacing, dFloat32(y) * spacing, dFloat32(z) * spacing, dFloat32(1.0f));
+				AddParticle(mass, matrix.TransformVector(point), dVector::m_zero);
+			}
+		}
+	}
+
+	// a spring to each of the 26 neighbors, each pair is added once,
+	// bend springs along the axis skip one particle
+	const dInt32 layerSize = columns * rows;
+	for (dInt32 y = 0; y < layers; y++)
+	{
+		for (dInt32 z = 0; z < rows; z++)
+		{
+			for (dInt32 x = 0; x < columns; x++)
+			{
+				const dInt32 index = base + y * layerSize + z * columns + x;
+				for (dInt32 dy = 0; dy <= 1; dy++)
+				{
+					for (dInt32 dz = -1; dz <= 1; dz++)
+					{
+						for (dInt32 dx = -1; dx <= 1; dx++)
+						{
+							const dInt32 key = (dy * 3 + dz + 1) * 3 + dx + 1;
+							if (key <= 4)
+							{
+								// the other half of the neighbors
+								continue;
+							}
+							const dInt32 x1 = x + dx;
+							const dInt32 y1 = y + dy;
+							const dInt32 z1 = z + dz;
+							if ((x1 >= 0) && (x1 < columns) && (y1 < layers) && (z1 >= 0) && (z1 < rows))
+							{
+								AddSpring(index, base + y1 * layerSize + z1 * columns + x1, stretchCompliance);
+							}
+						}
+					}
+				}
+				if ((x + 2) < columns)
+				{
+					AddSpring(index, index + 2, bendCompliance);
+				}
+				if ((z + 2) < rows)
+				{
+					AddSpring(index, index + 2 * columns, bendCompliance);
+				}
+				if ((y + 2) < layers)
+				{
+					AddSpring(index, index + 2 * layerSize, bendCompliance);
+				}
+			}
+		}
+	}
+	return base;
+}
+
+void ndBodyMassSpringDamper::BuildColors()
+{
+	D_TRACKTIME();
+	// greedy coloring, a spring takes the lowest color
+	// not used by the other springs of its two particles.
+	const dInt32 springCount = m_spring0.GetCount();
+	dArray<dUnsigned64> particleColors;
+	particleColors.SetCount(m_posit.GetCount());
+	memset(&particleColors[0], 0, particleColors.GetCount() * sizeof(dUnsigned64));
+
+	dArray<dInt32> springColors;
+	springColors.SetCount(springCount);
+	dInt32 histogram[D_MSD_MAX_COLORS + 1];
+	memset(histogram, 0, sizeof(histogram));
+	for (dInt32 i = 0; i < springCount; i++)
+	{
+		const dInt32 i0 = m_spring0[i];
+		const dInt32 i1 = m_spring1[i];
+		const dUnsigned64 used = particleColors[i0] | particleColors[i1];
+		dInt32 color = 0;
+		while ((color < D_MSD_MAX_COLORS) && (used & (dUnsigned64(1) << color)))
+		{
+			color++;
+		}
+		if (color < D_MSD_MAX_COLORS)
+		{
+			particleColors[i0] |= dUnsigned64(1) << color;
+			particleColors[i1] |= dUnsigned64(1) << color;
+		}
+		springColors[i] = color;
+		histogram[color]++;
+	}
+
+	m_colorScans.SetCount(D_MSD_MAX_COLORS + 2);
+	m_colorScans[0] = 0;
+	for (dInt32 i = 0; i <= D_MSD_MAX_COLORS; i++)
+	{
+		m_colorScans[i + 1] = m_colorScans[i] + histogram[i];
+		histogram[i] = m_colorScans[i];
+	}
+
+	dArray<dInt32> spring0;
+	dArray<dInt32> spring1;
+	dArray<dFloat32> restLength;
+	dArray<dFloat32> compliance;
+	spring0.SetCount(springCount);
+	spring1.SetCount(springCount);
+	restLength.SetCount(springCount);
+	compliance.SetCount(springCount);
+	for (dInt32 i = 0; i < springCount; i++)
+	{
+		const dInt32 entry = histogram[springColors[i]];
+		histogram[springColors[i]]++;
+		spring0[entry] = m_spring0[i];
+		spring1[entry] = m_spring1[i];
+		restLength[entry] = m_restLength[i];
+		compliance[entry] = m_compliance[i];
+	}
+	m_spring0.Swap(spring0);
+	m_spring1.Swap(spring1);
+	m_restLength.Swap(restLength);
+	m_compliance.Swap(compliance);
+	m_lambda.SetCount(springCount);
+	m_colorsAreValid = true;
+}
+
+void ndBodyMassSpringDamper::Update(const ndWorld* const world, dFloat32 timestep)
+{
+	const dInt32 particleCount = m_posit.GetCount();
+	if (!particleCount)
+	{
+		return;
+	}
+
+	if (!m_colorsAreValid)
+	{
+		BuildColors();
+	}
+
+	m_prevPosit.SetCount(particleCount);
+	m_contactPlane.SetCount(particleCount);
+	m_contactVeloc.SetCount(particleCount);
+	m_contactImpulse.SetCount(particleCount);
+	m_contactBody.SetCount(particleCount);
+
+	// the contacts are found once along the motion of the whole step, 
+	// the step is then divided in substeps, each substep moves the 
+	// particles freely and the springs and the contacts move them back,
+	// the velocities are the change of position over the substep. 
+	// a chain of springs converges much faster with substeps than 
+	// with iterations of the same substep.
+	dVector sweptBox0;
+	dVector sweptBox1;
+	PredictPositions(world, sweptBox0, sweptBox1);
+	FindBoundaryBodies(world, sweptBox0, sweptBox1);
+	const bool hasContacts = m_boundaryBodies.GetCount() ? true : false;
+	if (hasContacts)
+	{
+		FindContacts(world);
+	}
+
+	ndSolverContext context;
+	context.m_body = this;
+	context.m_substep = timestep / dFloat32(m_substeps);
+	context.m_damping = dMin(m_damping * timestep, dFloat32(1.0f));
+	context.m_color = 0;
+	for (dInt32 i = 0; i < m_substeps; i++)
+	{
+		IntegrateSubstep(world, context);
+		SolveSprings(world, context);
+		if (hasContacts)
+		{
+			SolveContacts(world, context);
+		}
+		UpdateVelocities(world, context);
+	}
+
+	if (context.m_damping > dFloat32(0.0f))
+	{
+		DampSprings(world, context);
+	}
+	if (hasContacts)
+	{
+		ApplyContactForces(world, context);
+	}
+}
+
+void ndBodyMassSpringDamper::PredictPositions(const ndWorld* const world, dVector& sweptBox0, dVector& sweptBox1)
+{
+	D_TRACKTIME();
+	class ndPredictPositions: public ndScene::ndBaseJob
+	{
+		public:
+		class ndContext
+		{
+			public:
+			ndBodyMassSpringDamper* m_body;
+			dVector m_box0[D_MAX_THREADS_COUNT];
+			dVector m_box1[D_MAX_THREADS_COUNT];
+		};
+
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndContext* const context = (ndContext*)m_context;
+			ndBodyMassSpringDamper* const body = context->m_body;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 particleCount = body->m_posit.GetCount();
+
+			const dInt32 step = particleCount / threadCount;
+			const dInt32 start = threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : particleCount - start;
+
+			ndBodyNotify* const notify = body->GetNotifyCallback();
+			const dVector gravity(notify ? notify->GetGravity() & dVector::m_triplexMask : dVector::m_zero);
+			const dVector timestep(m_timestep);
+			const dVector gravityStep(gravity * timestep);
+
+			dVector box0(dFloat32(1.0e20f));
+			dVector box1(dFloat32(-1.0e20f));
+			const dFloat32* const invMass = &body->m_invMass[start];
+			const dVector* const posit = &body->m_posit[start];
+			const dVector* const veloc = &body->m_velocity[start];
+			dVector* const prevPosit = &body->m_prevPosit[start];
+			for (dInt32 i = 0; i < count; i++)
+			{
+				// where the particle will be at the end of the step without springs 
+				const dVector target((invMass[i] > dFloat32(0.0f)) ? posit[i] + (veloc[i] + gravityStep) * timestep : posit[i]);
+				prevPosit[i] = target;
+				box0 = box0.GetMin(posit[i].GetMin(target));
+				box1 = box1.GetMax(posit[i].GetMax(target));
+			}
+			context->m_box0[threadIndex] = box0;
+			context->m_box1[threadIndex] = box1;
+		}
+	};
+
+	ndScene* const scene = world->GetScene();
+	ndPredictPositions::ndContext context;
+	context.m_body = this;
+	scene->SubmitJobs<ndPredictPositions>(&context);
+
+	// the box is padded so the contact probes below the particles find the bodies
+	const dVector padding(dFloat32(2.0f) * m_radius);
+	sweptBox0 = context.m_box0[0];
+	sweptBox1 = context.m_box1[0];
+	for (dInt32 i = 1; i < scene->GetThreadCount(); i++)
+	{
+		sweptBox0 = sweptBox0.GetMin(context.m_box0[i]);
+		sweptBox1 = sweptBox1.GetMax(context.m_box1[i]);
+	}
+	sweptBox0 = (sweptBox0 - padding) & dVector::m_triplexMask;
+	sweptBox1 = (sweptBox1 + padding) & dVector::m_triplexMask;
+}
+
+void ndBodyMassSpringDamper::FindContacts(const ndWorld* const world)
+{
+	D_TRACKTIME();
+	class ndFindContacts: public ndScene::ndBaseJob
+	{
+		public:
+		#define D_MSD_BOUNDARY_BATCH 32
+
+		// a ray from the particle along a direction, extended by the particle radius,
+		// the plane keeps the particle center one radius away from where the surface
+		// will be at the end of the step.
+		bool CastRay(const ndBoundaryBody& boundary, const dVector& origin, const dVector& step, dFloat32 radius, dVector& plane, dVector& surfaceVeloc) const
+		{
+			const dFloat32 dist2 = step.DotProduct(step).GetScalar();
+			if (dist2 < dFloat32(1.0e-12f))
+			{
+				return false;
+			}
+
+			const dVector dir(step.Scale(dRsqrt(dist2)));
+			const dFastRayTest ray(origin, origin + step + dir.Scale(radius));
+			ndRayCastClosestHitCallback callback;
+			if (!boundary.m_body->RayCast(callback, ray, dFloat32(1.0f)))
+			{
+				return false;
+			}
+
+			const dVector normal(callback.m_contact.m_normal & dVector::m_triplexMask);
+			const dVector point(callback.m_contact.m_point | dVector::m_wOne);
+			surfaceVeloc = boundary.m_body->GetVelocityAtPoint(point) & dVector::m_triplexMask;
+			const dVector target((point + surfaceVeloc.Scale(m_timestep)) & dVector::m_triplexMask);
+			plane = normal;
+			plane.m_w = -(normal.DotProduct(target).GetScalar() + radius);
+			return true;
+		}
+
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndBodyMassSpringDamper* const body = (ndBodyMassSpringDamper*)m_context;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 particleCount = body->m_posit.GetCount();
+			const dInt32 blockCount = (particleCount + D_MSD_BOUNDARY_BLOCK - 1) / D_MSD_BOUNDARY_BLOCK;
+
+			const dInt32 step = blockCount / threadCount;
+			const dInt32 start = threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : blockCount - start;
+
+			const dFloat32 radius = body->m_radius;
+			const dVector padding(dFloat32(2.0f) * radius);
+			ndBodyNotify* const notify = body->GetNotifyCallback();
+			const dVector gravity(notify ? notify->GetGravity() & dVector::m_triplexMask : dVector::m_zero);
+			const dFloat32 gravityMag2 = gravity.DotProduct(gravity).GetScalar();
+			const dVector down((gravityMag2 > dFloat32(1.0e-6f)) ? gravity.Scale(dFloat32(0.5f) * radius * dRsqrt(gravityMag2)) : dVector::m_zero);
+
+			const dArray<ndBoundaryBody>& boundaryBodies = body->m_boundaryBodies;
+			const dFloat32* const invMass = &body->m_invMass[0];
+			const dVector* const posit = &body->m_posit[0];
+			// the previous positions are the free targets of the step here
+			const dVector* const prevPosit = &body->m_prevPosit[0];
+			dVector* const contactPlane = &body->m_contactPlane[0];
+			dVector* const contactVeloc = &body->m_contactVeloc[0];
+			dVector* const contactImpulse = &body->m_contactImpulse[0];
+			dInt32* const contactBody = &body->m_contactBody[0];
+			for (dInt32 i = 0; i < count; i++)
+			{
+				const dInt32 blockStart = (start + i) * D_MSD_BOUNDARY_BLOCK;
+				const dInt32 blockEnd = dMin(blockStart + D_MSD_BOUNDARY_BLOCK, particleCount);
+
+				dVector box0(dFloat32(1.0e20f));
+				dVector box1(dFloat32(-1.0e20f));
+				for (dInt32 j = blockStart; j < blockEnd; j++)
+				{
+					box0 = box0.GetMin(posit[j].GetMin(prevPosit[j]));
+					box1 = box1.GetMax(posit[j].GetMax(prevPosit[j]));
+				}
+				box0 = (box0 - padding) & dVector::m_triplexMask;
+				box1 = (box1 + padding) & dVector::m_triplexMask;
+
+				// when too many bodies overlap the block, every body is tested
+				dInt32 overlapCount = 0;
+				dInt32 overlaps[D_MSD_BOUNDARY_BATCH];
+				for (dInt32 k = 0; k < boundaryBodies.GetCount(); k++)
+				{
+					if (dOverlapTest(box0, box1, boundaryBodies[k].m_box0, boundaryBodies[k].m_box1))
+					{
+						if (overlapCount < D_MSD_BOUNDARY_BATCH)
+						{
+							overlaps[overlapCount] = k;
+						}
+						overlapCount++;
+					}
+				}
+				const dInt32 testCount = (overlapCount <= D_MSD_BOUNDARY_BATCH) ? overlapCount : boundaryBodies.GetCount();
+
+				for (dInt32 j = blockStart; j < blockEnd; j++)
+				{
+					const bool hadContact = contactBody[j] >= 0;
+					contactBody[j] = -1;
+					if (!testCount || (invMass[j] == dFloat32(0.0f)))
+					{
+						continue;
+					}
+
+					// a ray along the free motion and a ray along the gravity find 
+					// the surface the particle moves into or rests on, a ray against 
+					// the last contact normal keeps a particle pulled by the springs
+					// against a wall, the closest plane is kept.
+					const dVector origin(posit[j] & dVector::m_triplexMask);
+					const dVector motion((prevPosit[j] - posit[j]) & dVector::m_triplexMask);
+					const dVector lastNormal(hadContact ? contactPlane[j] & dVector::m_triplexMask : dVector::m_zero);
+					const dVector rayStep[] = { motion, down, lastNormal.Scale(dFloat32(-0.5f) * radius) };
+					for (dInt32 k = 0; k < testCount; k++)
+					{
+						const dInt32 bodyIndex = (overlapCount <= D_MSD_BOUNDARY_BATCH) ? overlaps[k] : k;
+						const ndBoundaryBody& boundary = boundaryBodies[bodyIndex];
+						for (dInt32 n = 0; n < dInt32(sizeof(rayStep) / sizeof(rayStep[0])); n++)
+						{
+							dVector plane;
+							dVector surfaceVeloc;
+							if (CastRay(boundary, origin, rayStep[n], radius, plane, surfaceVeloc))
+							{
+								if ((contactBody[j] < 0) || (plane.DotProduct(prevPosit[j]).GetScalar() < contactPlane[j].DotProduct(prevPosit[j]).GetScalar()))
+								{
+									contactPlane[j] = plane;
+									contactVeloc[j] = surfaceVeloc;
+									contactBody[j] = bodyIndex;
+								}
+							}
+						}
+					}
+					// a particle already inside the body is not pushed out in one 
+					// step, that would throw it away, it is only kept from going deeper.
+					if (contactBody[j] >= 0)
+					{
+						const dFloat32 dist = contactPlane[j].DotProduct(posit[j]).GetScalar();
+						contactPlane[j].m_w -= dMin(dist, dFloat32(0.0f));
+					}
+					contactImpulse[j] = dVector::m_zero;
+				}
+			}
+		}
+	};
+
+	ndScene* const scene = world->GetScene();
+	scene->SubmitJobs<ndFindContacts>(this);
+}
+
+void ndBodyMassSpringDamper::SolveSprings(const ndWorld* const world, ndSolverContext& context)
+{
+	D_TRACKTIME();
+	class ndSolveSprings: public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			const ndSolverContext* const context = (ndSolverContext*)m_context;
+			ndBodyMassSpringDamper* const body = context->m_body;
+			dInt32 threadIndex = GetThreadId();
+			dInt32 threadCount = m_owner->GetThreadCount();
+
+			// the springs of the last color can share particles
+			if (context->m_color == D_MSD_MAX_COLORS)
+			{
+				if (threadIndex)
+				{
+					return;
+				}
+				threadCount = 1;
+			}
+
+			const dInt32 colorStart = body->m_colorScans[context->m_color];
+			const dInt32 colorCount = body->m_colorScans[context->m_color + 1] - colorStart;
+			const dInt32 step = colorCount / threadCount;
+			const dInt32 start = colorStart + threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : colorCount - threadIndex * step;
+
+			const dInt32* const spring0 = &body->m_spring0[0];
+			const dInt32* const spring1 = &body->m_spring1[0];
+			const dFloat32* const restLength = &body->m_restLength[0];
+			const dFloat32* const compliance = &body->m_compliance[0];
+			const dFloat32* const invMass = &body->m_invMass[0];
+			dFloat32* const lambda = &body->m_lambda[0];
+			dVector* const posit = &body->m_posit[0];
+
+			// the springs of a color do not share particles,
+			// so four springs are solved side by side.
+			const dFloat32 invSubstep2 = dFloat32(1.0f) / (context->m_substep * context->m_substep);
+			const dVector invTimestep2(invSubstep2);
+			const dInt32 count4 = count & -4;
+			for (dInt32 i = 0; i < count4; i += 4)
+			{
+				const dInt32 j = start + i;
+				const dInt32* const index0 = &spring0[j];
+				const dInt32* const index1 = &spring1[j];
+
+				dVector x0;
+				dVector y0;
+				dVector z0;
+				dVector w0;
+				dVector x1;
+				dVector y1;
+				dVector z1;
+				dVector w1;
+				dVector::Transpose4x4(x0, y0, z0, w0, posit[index0[0]], posit[index0[1]], posit[index0[2]], posit[index0[3]]);
+				dVector::Transpose4x4(x1, y1, z1, w1, posit[index1[0]], posit[index1[1]], posit[index1[2]], posit[index1[3]]);
+				const dVector invMass0(invMass, index0);
+				const dVector invMass1(invMass, index1);
+
+				const dVector dx(x0 - x1);
+				const dVector dy(y0 - y1);
+				const dVector dz(z0 - z1);
+				const dVector length(dVector(dx * dx + dy * dy + dz * dz).Sqrt().GetMax(dVector::m_epsilon));
+				const dVector alpha(dVector(&compliance[j]) * invTimestep2);
+				const dVector lambda0(&lambda[j]);
+				const dVector den((invMass0 + invMass1 + alpha).GetMax(dVector::m_epsilon));
+				const dVector deltaLambda((dVector(&restLength[j]) - length - alpha * lambda0) * den.Reciproc());
+				(lambda0 + deltaLambda).Store(&lambda[j]);
+
+				const dVector scale(deltaLambda * length.Reciproc());
+				dVector c0;
+				dVector c1;
+				dVector c2;
+				dVector c3;
+				dVector::Transpose4x4(c0, c1, c2, c3, dx * scale, dy * scale, dz * scale, dVector::m_zero);
+				posit[index0[0]] += c0 * invMass0.BroadcastX();
+				posit[index0[1]] += c1 * invMass0.BroadcastY();
+				posit[index0[2]] += c2 * invMass0.BroadcastZ();
+				posit[index0[3]] += c3 * invMass0.BroadcastW();
+				posit[index1[0]] -= c0 * invMass1.BroadcastX();
+				posit[index1[1]] -= c1 * invMass1.BroadcastY();
+				posit[index1[2]] -= c2 * invMass1.BroadcastZ();
+				posit[index1[3]] -= c3 * invMass1.BroadcastW();
+			}
+
+			for (dInt32 i = count4; i < count; i++)
+			{
+				const dInt32 j = start + i;
+				const dInt32 i0 = spring0[j];
+				const dInt32 i1 = spring1[j];
+				const dVector dist((posit[i0] - posit[i1]) & dVector::m_triplexMask);
+				const dFloat32 length = dMax(dSqrt(dist.DotProduct(dist).GetScalar()), dFloat32(1.0e-20f));
+				const dFloat32 alpha = compliance[j] * invSubstep2;
+				const dFloat32 den = dMax(invMass[i0] + invMass[i1] + alpha, dFloat32(1.0e-20f));
+				const dFloat32 deltaLambda = (restLength[j] - length - alpha * lambda[j]) / den;
+				lambda[j] += deltaLambda;
+
+				const dVector correction(dist.Scale(deltaLambda / length));
+				posit[i0] += correction.Scale(invMass[i0]);
+				posit[i1] -= correction.Scale(invMass[i1]);
+			}
+		}
+	};
+
+	ndScene* const scene = world->GetScene();
+	for (dInt32 i = 0; i <= D_MSD_MAX_COLORS; i++)
+	{
+		if (m_colorScans[i + 1] > m_colorScans[i])
+		{
+			context.m_color = i;
+			scene->SubmitJobs<ndSolveSprings>(&context);
+		}
+	}
+}
+
+void ndBodyMassSpringDamper::IntegrateSubstep(const ndWorld* const world, ndSolverContext& context)
+{
+	D_TRACKTIME();
+	class ndIntegrateSubstep: public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			const ndSolverContext* const context = (ndSolverContext*)m_context;
+			ndBodyMassSpringDamper* const body = context->m_body;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 particleCount = body->m_posit.GetCount();
+
+			const dInt32 step = particleCount / threadCount;
+			const dInt32 start = threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : particleCount - start;
+
+			ndBodyNotify* const notify = body->GetNotifyCallback();
+			const dVector gravity(notify ? notify->GetGravity() & dVector::m_triplexMask : dVector::m_zero);
+			const dVector substep(context->m_substep);
+			const dVector gravityStep(gravity * substep);
+
+			const dFloat32* const invMass = &body->m_invMass[start];
+			dVector* const posit = &body->m_posit[start];
+			dVector* const veloc = &body->m_velocity[start];
+			dVector* const prevPosit = &body->m_prevPosit[start];
+			for (dInt32 i = 0; i < count; i++)
+			{
+				prevPosit[i] = posit[i];
+				if (invMass[i] > dFloat32(0.0f))
+				{
+					veloc[i] += gravityStep;
+					posit[i] += veloc[i] * substep;
+				}
+			}
+		}
+	};
+
+	ndScene* const scene = world->GetScene();
+	scene->SubmitJobs<ndIntegrateSubstep>(&context);
+	if (m_lambda.GetCount())
+	{
+		memset(&m_lambda[0], 0, m_lambda.GetCount() * sizeof(dFloat32));
+	}
+}
+
+void ndBodyMassSpringDamper::SolveContacts(const ndWorld* const world, ndSolverContext& context)
+{
+	D_TRACKTIME();
+	class ndSolveContacts: public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			const ndSolverContext* const context = (ndSolverContext*)m_context;
+			ndBodyMassSpringDamper* const body = context->m_body;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 particleCount = body->m_posit.GetCount();
+
+			const dInt32 step = particleCount / threadCount;
+			const dInt32 start = threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : particleCount - start;
+
+			// the particle center is moved out of the plane, the tangent move 
+			// relative to the surface is removed up to the friction cone of 
+			// the normal correction.
+			const dFloat32 friction = body->m_friction;
+			const dVector substep(context->m_substep);
+			const dInt32* const contactBody = &body->m_contactBody[start];
+			const dVector* const contactPlane = &body->m_contactPlane[start];
+			const dVector* const contactVeloc = &body->m_contactVeloc[start];
+			const dVector* const prevPosit = &body->m_prevPosit[start];
+			dVector* const contactImpulse = &body->m_contactImpulse[start];
+			dVector* const posit = &body->m_posit[start];
+			for (dInt32 i = 0; i < count; i++)
+			{
+				if (contactBody[i] < 0)
+				{
+					continue;
+				}
+				const dFloat32 dist = contactPlane[i].DotProduct(posit[i]).GetScalar();
+				if (dist >= dFloat32(0.0f))
+				{
+					continue;
+				}
+
+				const dVector normal(contactPlane[i] & dVector::m_triplexMask);
+				dVector correction(normal.Scale(-dist));
+				if (friction > dFloat32(0.0f))
+				{
+					const dVector move((posit[i] - prevPosit[i] - contactVeloc[i] * substep) & dVector::m_triplexMask);
+					const dVector tangent(move - normal.Scale(normal.DotProduct(move).GetScalar()));
+					const dFloat32 tangentMove = dSqrt(tangent.DotProduct(tangent).GetScalar());
+					if (tangentMove > dFloat32(1.0e-6f))
+					{
+						correction -= tangent.Scale(dMin(-friction * dist / tangentMove, dFloat32(1.0f)));
+					}
+				}
+				contactImpulse[i] += correction;
+				posit[i] += correction;
+			}
+		}
+	};
+
+	ndScene* const scene = world->GetScene();
+	scene->SubmitJobs<ndSolveContacts>(&context);
+}
+
+void ndBodyMassSpringDamper::UpdateVelocities(const ndWorld* const world, ndSolverContext& context)
+{
+	D_TRACKTIME();
+	class ndUpdateVelocities: public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			const ndSolverContext* const context = (ndSolverContext*)m_context;
+			ndBodyMassSpringDamper* const body = context->m_body;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 particleCount = body->m_posit.GetCount();
+
+			const dInt32 step = particleCount / threadCount;
+			const dInt32 start = threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : particleCount - start;
+
+			const dVector invSubstep(dFloat32(1.0f) / context->m_substep);
+			const dVector* const posit = &body->m_posit[start];
+			const dVector* const prevPosit = &body->m_prevPosit[start];
+			dVector* const veloc = &body->m_velocity[start];
+			for (dInt32 i = 0; i < count; i++)
+			{
+				veloc[i] = (posit[i] - prevPosit[i]) * invSubstep;
+			}
+		}
+	};
+
+	ndScene* const scene = world->GetScene();
+	scene->SubmitJobs<ndUpdateVelocities>(&context);
+}
+
+void ndBodyMassSpringDamper::DampSprings(const ndWorld* const world, ndSolverContext& context)
+{
+	D_TRACKTIME();
+	class ndDampSprings: public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			const ndSolverContext* const context = (ndSolverContext*)m_context;
+			ndBodyMassSpringDamper* const body = context->m_body;
+			dInt32 threadIndex = GetThreadId();
+			dInt32 threadCount = m_owner->GetThreadCount();
+			if (context->m_color == D_MSD_MAX_COLORS)
+			{
+				if (threadIndex)
+				{
+					return;
+				}
+				threadCount = 1;
+			}
+
+			const dInt32 colorStart = body->m_colorScans[context->m_color];
+			const dInt32 colorCount = body->m_colorScans[context->m_color + 1] - colorStart;
+			const dInt32 step = colorCount / threadCount;
+			const dInt32 start = colorStart + threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : colorCount - threadIndex * step;
+
+			// the relative velocity along the spring is reduced,
+			// the momentum of the pair does not change.
+			const dFloat32 damping = context->m_damping;
+			const dInt32* const spring0 = &body->m_spring0[0];
+			const dInt32* const spring1 = &body->m_spring1[0];
+			const dFloat32* const invMass = &body->m_invMass[0];
+			const dVector* const posit = &body->m_posit[0];
+			dVector* const veloc = &body->m_velocity[0];
+			for (dInt32 i = 0; i < count; i++)
+			{
+				const dInt32 i0 = spring0[start + i];
+				const dInt32 i1 = spring1[start + i];
+				const dFloat32 den = invMass[i0] + invMass[i1];
+				if (den > dFloat32(0.0f))
+				{
+					const dVector dist((posit[i0] - posit[i1]) & dVector::m_triplexMask);
+					const dFloat32 length2 = dist.DotProduct(dist).GetScalar();
+					if (length2 > dFloat32(1.0e-12f))
+					{
+						const dVector dir(dist.Scale(dRsqrt(length2)));
+						const dFloat32 relativeSpeed = dir.DotProduct(veloc[i0] - veloc[i1]).GetScalar();
+						const dVector impulse(dir.Scale(damping * relativeSpeed / den));
+						veloc[i0] -= impulse.Scale(invMass[i0]);
+						veloc[i1] += impulse.Scale(invMass[i1]);
+					}
+				}
+			}
+		}
+	};
+
+	ndScene* const scene = world->GetScene();
+	for (dInt32 i = 0; i <= D_MSD_MAX_COLORS; i++)
+	{
+		if (m_colorScans[i + 1] > m_colorScans[i])
+		{
+			context.m_color = i;
+			scene->SubmitJobs<ndDampSprings>(&context);
+		}
+	}
+}
+
+void ndBodyMassSpringDamper::ApplyContactForces(const ndWorld* const world, ndSolverContext& context)
+{
+	D_TRACKTIME();
+	class ndCalculateContactForces: public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			const ndSolverContext* const context = (ndSolverContext*)m_context;
+			ndBodyMassSpringDamper* const body = context->m_body;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 particleCount = body->m_posit.GetCount();
+
+			const dArray<ndBoundaryBody>& boundaryBodies = body->m_boundaryBodies;
+			dArray<ndJacobian>& reactions = body->m_boundaryForces[threadIndex];
+			reactions.SetCount(boundaryBodies.GetCount());
+			for (dInt32 i = 0; i < reactions.GetCount(); i++)
+			{
+				reactions[i].m_linear = dVector::m_zero;
+				reactions[i].m_angular = dVector::m_zero;
+			}
+
+			const dInt32 step = particleCount / threadCount;
+			const dInt32 start = threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : particleCount - start;
+
+			// a position correction is a velocity change of the particle over 
+			// the substep, the opposite momentum goes to the body over the step.
+			const dFloat32 invTimestep2 = dFloat32(1.0f) / (context->m_substep * m_timestep);
+			const dFloat32 radius = body->m_radius;
+			const dInt32* const contactBody = &body->m_contactBody[0];
+			const dVector* const contactPlane = &body->m_contactPlane[0];
+			const dVector* const contactImpulse = &body->m_contactImpulse[0];
+			const dFloat32* const invMass = &body->m_invMass[0];
+			const dVector* const posit = &body->m_posit[0];
+			for (dInt32 i = 0; i < count; i++)
+			{
+				const dInt32 index = start + i;
+				if ((contactBody[index] >= 0) && (invMass[index] > dFloat32(0.0f)))
+				{
+					ndBodyKinematic* const boundary = boundaryBodies[contactBody[index]].m_body;
+					if (boundary->GetInvMass() > dFloat32(0.0f))
+					{
+						const dVector normal(contactPlane[index] & dVector::m_triplexMask);
+						const dVector point(posit[index] - normal.Scale(radius));
+						const dVector com(boundary->GetMatrix().TransformVector(boundary->GetCentreOfMass()));
+						const dVector force(contactImpulse[index].Scale(-invTimestep2 / invMass[index]));
+						ndJacobian& reaction = reactions[contactBody[index]];
+						reaction.m_linear += force;
+						reaction.m_angular += (point - com).CrossProduct(force);
+					}
+				}
+			}
+		}
+	};
+
+	ndScene* const scene = world->GetScene();
+	scene->SubmitJobs<ndCalculateContactForces>(&context);
+	ApplyBoundaryForces(world);
+}
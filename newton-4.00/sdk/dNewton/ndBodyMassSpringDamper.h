@@ -0,0 +1,180 @@
+/* Copyright (c) <2003-2021> <Julio Jerez, Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef __D_BODY_MASS_SPRING_DAMPER_H__
+#define __D_BODY_MASS_SPRING_DAMPER_H__
+
+#include "ndNewtonStdafx.h"
+#include "ndBodyParticleSet.h"
+
+// springs are colored so that no two springs of a color share a particle,
+// the colors of the springs of a particle are the bits of a 64 bit mask.
+// the springs of a particle with more springs than colors go to one extra 
+// color solved by a single thread.
+#define D_MSD_MAX_COLORS		64
+
+// the particles are collided in blocks of consecutive particles,
+// cloth and lattices are built row by row so a block is compact.
+#define D_MSD_BOUNDARY_BLOCK	64
+
+// a deformable body made of point masses and springs solved as position
+// constraints, cloth is a sheet of particles with stretch, shear and bend
+// springs and a soft body is a lattice of particles. particles with zero
+// mass do not move, they pin the body to the world.
+// the springs are stored as a structure of arrays sorted by color, each
+// color is solved in parallel, the particles collide with the rigid bodies
+// of the scene and push them back.
+D_MSV_NEWTON_ALIGN_32
+class ndBodyMassSpringDamper: public ndBodyParticleSet
+{
+	public:
+	D_NEWTON_API ndBodyMassSpringDamper();
+	D_NEWTON_API ndBodyMassSpringDamper(const nd::TiXmlNode* const xmlNode, const dTree<const ndShape*, dUnsigned32>& shapesCache);
+	D_NEWTON_API virtual ~ndBodyMassSpringDamper ();
+
+	D_NEWTON_API virtual void Save(nd::TiXmlElement* const rootNode, const char* const assetPath, dInt32 nodeid, const dTree<dUnsigned32, const ndShape*>& shapesCache) const;
+
+	D_NEWTON_API virtual void AddParticle(const dFloat32 mass, const dVector& position, const dVector& velocity);
+
+	// a particle with zero mass stays in place
+	D_NEWTON_API void SetParticleMass(dInt32 particle, dFloat32 mass);
+
+	// the rest length is the distance between the particles when the spring is
+	// added, the compliance is the inverse of the stiffness, zero is rigid.
+	// the springs are sorted by color before the next step.
+	D_NEWTON_API void AddSpring(dInt32 particle0, dInt32 particle1, dFloat32 compliance);
+
+	// a sheet of columns by rows particles in the x z plane of the matrix,
+	// returns the index of the first particle, the particles are row major.
+	D_NEWTON_API dInt32 AddClothPatch(const dMatrix& matrix, dInt32 columns, dInt32 rows, dFloat32 spacing, dFloat32 mass, dFloat32 stretchCompliance, dFloat32 bendCompliance);
+
+	// a box of columns by rows by layers particles along the x, z, y axis
+	// of the matrix, returns the index of the first particle.
+	D_NEWTON_API dInt32 AddSoftLattice(const dMatrix& matrix, dInt32 columns, dInt32 rows, dInt32 layers, dFloat32 spacing, dFloat32 mass, dFloat32 stretchCompliance, dFloat32 bendCompliance);
+
+	dInt32 GetSpringCount() const;
+	dInt32 GetColorCount() const;
+	const dArray<dFloat32>& GetInvMasses() const;
+
+	// the step is divided in substeps, the springs are solved once per substep
+	dInt32 GetSubsteps() const;
+	void SetSubsteps(dInt32 substeps);
+
+	// fraction of the relative velocity along a spring removed per second
+	dFloat32 GetDamping() const;
+	void SetDamping(dFloat32 damping);
+
+	dFloat32 GetFriction() const;
+	void SetFriction(dFloat32 friction);
+
+	protected:
+	D_NEWTON_API virtual void Update(const ndWorld* const world, dFloat32 timestep);
+
+	private:
+	class ndSolverContext;
+
+	void BuildColors();
+	void PredictPositions(const ndWorld* const world, dVector& sweptBox0, dVector& sweptBox1);
+	void FindContacts(const ndWorld* const world);
+	void IntegrateSubstep(const ndWorld* const world, ndSolverContext& context);
+	void SolveSprings(const ndWorld* const world, ndSolverContext& context);
+	void SolveContacts(const ndWorld* const world, ndSolverContext& context);
+	void UpdateVelocities(const ndWorld* const world, ndSolverContext& context);
+	void DampSprings(const ndWorld* const world, ndSolverContext& context);
+	void ApplyContactForces(const ndWorld* const world, ndSolverContext& context);
+
+	// the springs, sorted by color
+	dArray<dInt32> m_spring0;
+	dArray<dInt32> m_spring1;
+	dArray<dFloat32> m_restLength;
+	dArray<dFloat32> m_compliance;
+	dArray<dFloat32> m_lambda;
+	dArray<dInt32> m_colorScans;
+
+	// the particles, the previous positions are the positions
+	// at the start of the substep
+	dArray<dFloat32> m_invMass;
+	dArray<dVector> m_prevPosit;
+
+	// the rigid body plane each particle is pressed against
+	dArray<dVector> m_contactPlane;
+	dArray<dVector> m_contactVeloc;
+	dArray<dVector> m_contactImpulse;
+	dArray<dInt32> m_contactBody;
+
+	dFloat32 m_damping;
+	dFloat32 m_friction;
+	dInt32 m_substeps;
+	bool m_colorsAreValid;
+} D_GCC_NEWTON_ALIGN_32 ;
+
+inline dInt32 ndBodyMassSpringDamper::GetSpringCount() const
+{
+	return m_spring0.GetCount();
+}
+
+inline dInt32 ndBodyMassSpringDamper::GetColorCount() const
+{
+	dInt32 count = 0;
+	for (dInt32 i = 1; i < m_colorScans.GetCount(); i++)
+	{
+		count += (m_colorScans[i] > m_colorScans[i - 1]) ? 1 : 0;
+	}
+	return count;
+}
+
+inline const dArray<dFloat32>& ndBodyMassSpringDamper::GetInvMasses() const
+{
+	return m_invMass;
+}
+
+inline dInt32 ndBodyMassSpringDamper::GetSubsteps() const
+{
+	return m_substeps;
+}
+
+inline void ndBodyMassSpringDamper::SetSubsteps(dInt32 substeps)
+{
+	m_substeps = dMax(substeps, 1);
+}
+
+inline dFloat32 ndBodyMassSpringDamper::GetDamping() const
+{
+	return m_damping;
+}
+
+inline void ndBodyMassSpringDamper::SetDamping(dFloat32 damping)
+{
+	m_damping = dMax(damping, dFloat32(0.0f));
+}
+
+inline dFloat32 ndBodyMassSpringDamper::GetFriction() const
+{
+	return m_friction;
+}
+
+inline void ndBodyMassSpringDamper::SetFriction(dFloat32 friction)
+{
+	m_friction = dMax(friction, dFloat32(0.0f));
+}
+
+#endif
+
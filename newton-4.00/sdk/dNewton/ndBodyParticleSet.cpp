@@ -22,11 +22,13 @@
 #include "dCoreStdafx.h"
 #include "ndNewtonStdafx.h"
 #include "ndWorld.h"
+#include "ndBodyDynamic.h"
 #include "ndBodyParticleSet.h"
 
 ndBodyParticleSet::ndBodyParticleSet()
 	:ndBody()
 	,m_listNode(nullptr)
+	,m_radius(dFloat32(0.1f))
 	//,m_accel(dVector::m_zero)
 	//,m_alpha(dVector::m_zero)
 	//,m_externalForce(dVector::m_zero)
@@ -41,6 +43,8 @@ ndBodyParticleSet::ndBodyParticleSet()
 
 ndBodyParticleSet::ndBodyParticleSet(const nd::TiXmlNode* const xmlNode, const dTree<const ndShape*, dUnsigned32>& shapesCache)
 	:ndBody(xmlNode->FirstChild("ndBodyKinematic"), shapesCache)
+	,m_listNode(nullptr)
+	,m_radius(dFloat32(0.1f))
 	//,m_accel(dVector::m_zero)
 	//,m_alpha(dVector::m_zero)
 	//,m_externalForce(dVector::m_zero)
@@ -63,4 +67,234 @@ void ndBodyParticleSet::Save(nd::TiXmlElement* const rootNode, const char* const
 	dAssert(0);
 	nd::TiXmlElement* const paramNode = CreateRootElement(rootNode, "ndBodyParticleSet", nodeid);
 	ndBody::Save(paramNode, assetPath, nodeid, shapesCache);
-}
\ No newline at end of file
+}
+
+dInt32 ndBodyParticleSet::GetParticleId(dInt32 particle) const
+{
+	return particle;
+}
+
+bool ndBodyParticleSet::RayCast(ndRayCastNotify& callback, const dFastRayTest& ray, const dFloat32 maxT) const
+{
+	if (!m_posit.GetCount() || !callback.OnRayPrecastAction(this, nullptr))
+	{
+		return false;
+	}
+
+	dInt32 particle = -1;
+	const dFloat32 param = RayCastParticles(ray, 0, m_posit.GetCount(), dMin(maxT, dFloat32(1.0f)), particle);
+	return (particle >= 0) ? ReportRayHit(callback, ray, param, particle) : false;
+}
+
+void ndBodyParticleSet::ParticlesInAabb(const dVector& box0, const dVector& box1, dArray<dInt32>& particles) const
+{
+	particles.SetCount(0);
+	if (m_posit.GetCount())
+	{
+		AddParticlesInAabb(box0, box1, 0, m_posit.GetCount(), particles);
+	}
+}
+
+dFloat32 ndBodyParticleSet::RayCastParticles(const dFastRayTest& ray, dInt32 start, dInt32 count, dFloat32 maxT, dInt32& particle) const
+{
+	// four particles at a time, a particle is hit at the first root of 
+	// a * t * t - 2 * b * t + c = 0, where a = diff * diff, b = (center - p0) * diff 
+	// and c = (center - p0) * (center - p0) - radius * radius. the origin is 
+	// inside the particle when c < 0 and the particle is behind it when b < 0.
+	const dVector zero(dVector::m_zero);
+	const dVector originX(ray.m_p0.m_x);
+	const dVector originY(ray.m_p0.m_y);
+	const dVector originZ(ray.m_p0.m_z);
+	const dVector diffX(ray.m_diff.m_x);
+	const dVector diffY(ray.m_diff.m_y);
+	const dVector diffZ(ray.m_diff.m_z);
+	const dVector a(ray.m_diff.DotProduct(ray.m_diff));
+	const dVector invA(a.Reciproc());
+	const dVector radius2(m_radius * m_radius);
+
+	dFloat32 param = maxT;
+	const dInt32 last = start + count - 1;
+	const dVector* const posit = &m_posit[0];
+	for (dInt32 i = 0; i < count; i += 4)
+	{
+		// lanes past the end repeat the last particle
+		const dInt32 base = start + i;
+		dVector x;
+		dVector y;
+		dVector z;
+		dVector w;
+		dVector::Transpose4x4(x, y, z, w, 
+			posit[base], posit[dMin(base + 1, last)], posit[dMin(base + 2, last)], posit[dMin(base + 3, last)]);
+
+		const dVector dx(x - originX);
+		const dVector dy(y - originY);
+		const dVector dz(z - originZ);
+		const dVector b(dx * diffX + dy * diffY + dz * diffZ);
+		const dVector c(dx * dx + dy * dy + dz * dz - radius2);
+		const dVector disc(b * b - a * c);
+		const dVector valid((disc >= zero) & (c > zero) & (b > zero));
+		if (valid.GetSignMask())
+		{
+			const dVector t((b - disc.GetMax(zero).Sqrt()) * invA);
+			const dInt32 mask = (valid & (t < dVector(param))).GetSignMask();
+			for (dInt32 j = 0; j < 4; j++)
+			{
+				if ((mask & (1 << j)) && (t[j] < param))
+				{
+					param = t[j];
+					particle = dMin(base + j, last);
+				}
+			}
+		}
+	}
+	return param;
+}
+
+void ndBodyParticleSet::AddParticlesInAabb(const dVector& box0, const dVector& box1, dInt32 start, dInt32 count, dArray<dInt32>& particles) const
+{
+	const dVector radius(m_radius);
+	const dVector testBox0(box0 - radius);
+	const dVector testBox1(box1 + radius);
+	const dVector* const posit = &m_posit[start];
+	for (dInt32 i = 0; i < count; i++)
+	{
+		const dVector test((posit[i] >= testBox0) & (posit[i] <= testBox1));
+		if ((test.GetSignMask() & 0x07) == 0x07)
+		{
+			particles.PushBack(start + i);
+		}
+	}
+}
+
+bool ndBodyParticleSet::ReportRayHit(ndRayCastNotify& callback, const dFastRayTest& ray, dFloat32 param, dInt32 particle) const
+{
+	const dVector point(ray.m_p0 + ray.m_diff.Scale(param));
+	const dVector normal((point - m_posit[particle]) & dVector::m_triplexMask);
+
+	ndContactPoint contact;
+	contact.m_point = point | dVector::m_wOne;
+	contact.m_normal = normal.Normalize();
+	contact.m_body0 = nullptr;
+	contact.m_body1 = nullptr;
+	contact.m_shapeInstance0 = nullptr;
+	contact.m_shapeInstance1 = nullptr;
+	contact.m_shapeId0 = particle;
+	contact.m_shapeId1 = GetParticleId(particle);
+	contact.m_penetration = dFloat32(0.0f);
+	return callback.OnRayCastAction(contact, param) < dFloat32(1.0f);
+}
+
+void ndBodyParticleSet::FindBoundaryBodies(const ndWorld* const world, const dVector& sweptBox0, const dVector& sweptBox1)
+{
+	D_TRACKTIME();
+	// one pass over the scene bodies for the whole particle set, 
+	// the boxes are padded by the distance the bodies move this step
+	m_boundaryBodies.SetCount(0);
+	const ndScene* const scene = world->GetScene();
+	const dFloat32 timestep = scene->GetTimestep();
+	const dArray<ndBodyKinematic*>& bodyArray = scene->GetActiveBodyArray();
+	for (dInt32 i = 0; i < bodyArray.GetCount(); i++)
+	{
+		ndBodyKinematic* const body = bodyArray[i];
+		ndShapeInstance& shapeInstance = body->GetCollisionShape();
+		if (shapeInstance.GetShape()->GetAsShapeNull() || !shapeInstance.GetCollisionMode())
+		{
+			continue;
+		}
+
+		dVector box0;
+		dVector box1;
+		body->GetAABB(box0, box1);
+		const dVector size((box1 - box0) * dVector::m_half);
+		const dVector omega(body->GetOmega());
+		const dFloat32 angularSpeed = dSqrt(omega.DotProduct(omega).GetScalar() * size.DotProduct(size).GetScalar());
+		const dVector padding(((body->GetVelocity().Abs() + dVector(angularSpeed)).Scale(timestep)) & dVector::m_triplexMask);
+		box0 -= padding;
+		box1 += padding;
+		if (dOverlapTest(box0, box1, sweptBox0, sweptBox1))
+		{
+			ndBoundaryBody boundary;
+			boundary.m_box0 = box0;
+			boundary.m_box1 = box1;
+			boundary.m_body = body;
+			m_boundaryBodies.PushBack(boundary);
+		}
+	}
+
+	// the active body array is in a different order for each thread count and
+	// a particle stopped by a body is deflected into the next, sorting by id
+	// makes the collision the same for any number of threads.
+	if (m_boundaryBodies.GetCount() > 1)
+	{
+		dSort(&m_boundaryBodies[0], m_boundaryBodies.GetCount(), CompareBoundaryBodies);
+	}
+}
+
+dInt32 ndBodyParticleSet::CompareBoundaryBodies(const ndBoundaryBody* const bodyA, const ndBoundaryBody* const bodyB, void* const)
+{
+	const dUnsigned32 idA = bodyA->m_body->GetId();
+	const dUnsigned32 idB = bodyB->m_body->GetId();
+	if (idA < idB)
+	{
+		return -1;
+	}
+	else if (idA > idB)
+	{
+		return 1;
+	}
+	return 0;
+}
+
+void ndBodyParticleSet::ApplyBoundaryForces(const ndWorld* const world)
+{
+	D_TRACKTIME();
+	class ndApplyBoundaryForces: public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndBodyParticleSet* const particleSet = (ndBodyParticleSet*)m_context;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 bodyCount = particleSet->m_boundaryBodies.GetCount();
+
+			const dInt32 step = bodyCount / threadCount;
+			const dInt32 start = threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : bodyCount - start;
+
+			// each body is owned by one thread here, so the reactions
+			// of all the collision threads are added without locks
+			for (dInt32 i = 0; i < count; i++)
+			{
+				const dInt32 index = start + i;
+				ndBodyDynamic* const body = particleSet->m_boundaryBodies[index].m_body->GetAsBodyDynamic();
+				if (body && (body->GetInvMass() > dFloat32(0.0f)))
+				{
+					dVector force(dVector::m_zero);
+					dVector torque(dVector::m_zero);
+					for (dInt32 j = 0; j < threadCount; j++)
+					{
+						const ndJacobian& reaction = particleSet->m_boundaryForces[j][index];
+						force += reaction.m_linear;
+						torque += reaction.m_angular;
+					}
+					const dVector mag2(force.DotProduct(force) + torque.DotProduct(torque));
+					if (mag2.GetScalar() > dFloat32(0.0f))
+					{
+						const bool sleeping = body->GetSleepState();
+						body->SetForce(body->GetForce() + force);
+						body->SetTorque(body->GetTorque() + torque);
+						if (sleeping && !body->GetSleepState())
+						{
+							body->SetSleepState(false);
+						}
+					}
+				}
+			}
+		}
+	};
+
+	ndScene* const scene = world->GetScene();
+	scene->SubmitJobs<ndApplyBoundaryForces>(this);
+}
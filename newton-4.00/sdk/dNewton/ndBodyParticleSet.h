@@ -35,8 +35,14 @@ class ndBodyParticleSet: public ndBody
 	D_NEWTON_API virtual void Save(nd::TiXmlElement* const rootNode, const char* const assetPath, dInt32 nodeid, const dTree<dUnsigned32, const ndShape*>& shapesCache) const;
 
 	const dArray<dVector>& GetPositions() const;
+	const dArray<dVector>& GetVelocities() const;
 	virtual ndBodyParticleSet* GetAsBodyParticleSet();
 
+	// the id of a particle is the order it was added in, the index of a particle 
+	// is where it is in the arrays now. the sets that reorder their particles 
+	// keep the ids, the default id is the index.
+	D_NEWTON_API virtual dInt32 GetParticleId(dInt32 particle) const;
+
 	dFloat32 GetParticleRadius() const;
 	void SetParticleRadius(dFloat32 raidus);
 	
@@ -44,8 +50,45 @@ class ndBodyParticleSet: public ndBody
 
 	D_NEWTON_API virtual void Update(const ndWorld* const workd, dFloat32 timestep) = 0;
 
+	// the closest particle hit by the ray is reported as one hit of the set, 
+	// the first shape id of the contact is the particle index, the second is 
+	// the particle id and the contact bodies are null. particles that contain 
+	// the ray origin are not hit.
+	D_NEWTON_API virtual bool RayCast(ndRayCastNotify& callback, const dFastRayTest& ray, const dFloat32 maxT) const;
+
+	// the indices of the particles with the center inside the box grown by the radius
+	D_NEWTON_API virtual void ParticlesInAabb(const dVector& box0, const dVector& box1, dArray<dInt32>& particles) const;
+
 	protected:
+	// a rigid body the particles may hit this step
+	class ndBoundaryBody
+	{
+		public:
+		dVector m_box0;
+		dVector m_box1;
+		ndBodyKinematic* m_body;
+	};
+
+	// the reactions of the particles on the boundary bodies are 
+	// accumulated per thread in m_boundaryForces, one entry per body
+	void FindBoundaryBodies(const ndWorld* const world, const dVector& sweptBox0, const dVector& sweptBox1);
+	void ApplyBoundaryForces(const ndWorld* const world);
+	static dInt32 CompareBoundaryBodies(const ndBoundaryBody* const bodyA, const ndBoundaryBody* const bodyB, void* const);
+
+	// queries over a run of consecutive particles, the ray cast returns 
+	// the closest hit before maxT and sets the particle index on a hit
+	dFloat32 RayCastParticles(const dFastRayTest& ray, dInt32 start, dInt32 count, dFloat32 maxT, dInt32& particle) const;
+	void AddParticlesInAabb(const dVector& box0, const dVector& box1, dInt32 start, dInt32 count, dArray<dInt32>& particles) const;
+	bool ReportRayHit(ndRayCastNotify& callback, const dFastRayTest& ray, dFloat32 param, dInt32 particle) const;
+
+	// the particle state is kept as arrays of dVector, not split in x, y and z arrays. 
+	// the fluid kernels visit the neighbors of a particle in index order, a neighbor is 
+	// one aligned load and four of them are transposed to lanes in registers, where 
+	// split arrays would need three scalar loads per neighbor.
 	dArray<dVector> m_posit;
+	dArray<dVector> m_velocity;
+	dArray<ndBoundaryBody> m_boundaryBodies;
+	dArray<ndJacobian> m_boundaryForces[D_MAX_THREADS_COUNT];
 	ndBodyParticleSetList::dNode* m_listNode;
 	dFloat32 m_radius;
 	friend class ndWorld;
@@ -71,6 +114,11 @@ inline const dArray<dVector>& ndBodyParticleSet::GetPositions() const
 	return m_posit;
 }
 
+inline const dArray<dVector>& ndBodyParticleSet::GetVelocities() const
+{
+	return m_velocity;
+}
+
 #endif 
 
 
@@ -0,0 +1,913 @@
+/* Copyright (c) <2003-2021> <Julio Jerez, Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "dCoreStdafx.h"
+#include "ndNewtonStdafx.h"
+#include "ndWorld.h"
+#include "ndBodyPbfFluid.h"
+
+class ndBodyPbfFluid::ndPbfContext
+{
+	public:
+	// the neighbor lists are in the buffer of the thread that built them
+	const dInt32* GetNeighbors(dInt32 particleIndex) const
+	{
+		const dInt32 thread = m_neighborsStep ? dMin(particleIndex / m_neighborsStep, m_threadCount - 1) : m_threadCount - 1;
+		return m_neighbors[thread];
+	}
+
+	ndBodyPbfFluid* m_fluid;
+	const dInt32* m_neighbors[D_MAX_THREADS_COUNT];
+	dFloat32 m_restDensity;
+	dFloat32 m_relaxation;
+	dInt32 m_neighborsStep;
+	dInt32 m_threadCount;
+	dInt32 m_color;
+};
+
+ndBodyPbfFluid::ndBodyPbfFluid()
+	:ndBodySphFluid()
+	,m_lambda(1024)
+	,m_contacts(1024)
+	,m_colorCells(1024)
+	,m_relaxation(dFloat32(0.1f))
+	,m_friction(dFloat32(0.0f))
+	,m_iterations(4)
+{
+	memset(m_colorScans, 0, sizeof(m_colorScans));
+}
+
+ndBodyPbfFluid::ndBodyPbfFluid(const nd::TiXmlNode* const xmlNode, const dTree<const ndShape*, dUnsigned32>& shapesCache)
+	:ndBodySphFluid(xmlNode->FirstChild("ndBodySphFluid"), shapesCache)
+	,m_lambda()
+	,m_contacts()
+	,m_colorCells()
+	,m_relaxation(dFloat32(0.1f))
+	,m_friction(dFloat32(0.0f))
+	,m_iterations(4)
+{
+	// nothing was saved
+	dAssert(0);
+	memset(m_colorScans, 0, sizeof(m_colorScans));
+}
+
+ndBodyPbfFluid::~ndBodyPbfFluid()
+{
+}
+
+void ndBodyPbfFluid::Save(nd::TiXmlElement* const rootNode, const char* const assetPath, dInt32 nodeid, const dTree<dUnsigned32, const ndShape*>& shapesCache) const
+{
+	dAssert(0);
+	nd::TiXmlElement* const paramNode = CreateRootElement(rootNode, "ndBodyPbfFluid", nodeid);
+	ndBodySphFluid::Save(paramNode, assetPath, nodeid, shapesCache);
+}
+
+void ndBodyPbfFluid::Update(const ndWorld* const world, dFloat32 timestep)
+{
+	const dInt32 particleCount = m_posit.GetCount();
+	if (!particleCount)
+	{
+		return;
+	}
+
+	m_accel.SetCount(particleCount);
+	m_density.SetCount(particleCount);
+	m_lambda.SetCount(particleCount);
+	m_contacts.SetCount(particleCount);
+	m_neighborLists.SetCount(particleCount);
+
+	// the particles move freely and the neighbors are found at the predicted
+	// positions, then the positions are projected to the density constraint.
+	dVector sweptBox0;
+	dVector sweptBox1;
+	PredictPositions(world, timestep, sweptBox0, sweptBox1);
+
+	dVector boxP0;
+	dVector boxP1;
+	CaculateAABB(world, boxP0, boxP1);
+	UpdateGrids(world, boxP0, boxP1);
+	BuildNeighbors(world);
+	BuildColors(world);
+	SavePredictedPositions(world);
+	FindBoundaryBodies(world, sweptBox0, sweptBox1);
+
+	ndPbfContext context;
+	const dInt32 threadCount = world->GetScene()->GetThreadCount();
+	context.m_fluid = this;
+	context.m_threadCount = threadCount;
+	context.m_neighborsStep = particleCount / threadCount;
+	context.m_restDensity = (m_restDensity > dFloat32(0.0f)) ? m_restDensity : CalculateRestDensity();
+	context.m_relaxation = m_relaxation * CalculateRestGradient(context.m_restDensity);
+	context.m_color = 0;
+	for (dInt32 i = 0; i < threadCount; i++)
+	{
+		context.m_neighbors[i] = m_neighbors[i].GetCount() ? &m_neighbors[i][0] : nullptr;
+	}
+
+	// the rigid bodies a particle is pushed against are found after each
+	// iteration, the next iterations do not push the particle into them.
+	for (dInt32 i = 0; i < m_iterations; i++)
+	{
+		CalculateLambdas(world, context);
+		SolvePositions(world, context);
+		if (m_boundaryBodies.GetCount())
+		{
+			FindBoundaryContacts(world);
+		}
+	}
+	if (m_boundaryBodies.GetCount())
+	{
+		ApplyContactForces(world);
+	}
+
+	// the position change is applied as a velocity change, so the
+	// particles are moved and stopped by the rigid bodies as the sph fluid.
+	CalculateCorrections(world);
+	IntegrateParticles(world, timestep);
+	if (m_viscosity > dFloat32(0.0f))
+	{
+		ApplyViscosity(world, context);
+	}
+}
+
+dFloat32 ndBodyPbfFluid::CalculateRestGradient(dFloat32 restDensity) const
+{
+	// squared constraint gradients of a particle inside a cubic lattice of particles one radius apart
+	const dFloat32 h = dFloat32(2.0f) * m_radius;
+	const dFloat32 h6 = h * h * h * h * h * h;
+	const dFloat32 gradScale = m_mass * dFloat32(45.0f) / (restDensity * dPi * h6);
+
+	dFloat32 gradient2 = dFloat32(0.0f);
+	for (dInt32 z = -2; z <= 2; z++)
+	{
+		for (dInt32 y = -2; y <= 2; y++)
+		{
+			for (dInt32 x = -2; x <= 2; x++)
+			{
+				const dFloat32 dist = dSqrt(dFloat32(x * x + y * y + z * z)) * m_radius;
+				if ((dist > dFloat32(0.0f)) && (dist < h))
+				{
+					const dFloat32 grad = gradScale * (h - dist) * (h - dist);
+					gradient2 += grad * grad;
+				}
+			}
+		}
+	}
+	return gradient2;
+}
+
+void ndBodyPbfFluid::PredictPositions(const ndWorld* const world, dFloat32 timestep, dVector& sweptBox0, dVector& sweptBox1)
+{
+	D_TRACKTIME();
+	class ndPredictPositions: public ndScene::ndBaseJob
+	{
+		public:
+		class ndContext
+		{
+			public:
+			ndBodyPbfFluid* m_fluid;
+			dVector m_box0[D_MAX_THREADS_COUNT];
+			dVector m_box1[D_MAX_THREADS_COUNT];
+		};
+
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndContext* const context = (ndContext*)m_context;
+			ndBodyPbfFluid* const fluid = context->m_fluid;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 particleCount = fluid->m_posit.GetCount();
+
+			const dInt32 step = particleCount / threadCount;
+			const dInt32 start = threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : particleCount - start;
+
+			ndBodyNotify* const notify = fluid->GetNotifyCallback();
+			const dVector gravity(notify ? notify->GetGravity() & dVector::m_triplexMask : dVector::m_zero);
+
+			dVector box0(dFloat32(1.0e20f));
+			dVector box1(dFloat32(-1.0e20f));
+			const dVector timestep(m_timestep);
+			const dVector gravityStep(gravity * timestep);
+			dVector* const posit = &fluid->m_posit[start];
+			dVector* const veloc = &fluid->m_velocity[start];
+			for (dInt32 i = 0; i < count; i++)
+			{
+				veloc[i] += gravityStep;
+				const dVector target(posit[i] + veloc[i] * timestep);
+				box0 = box0.GetMin(posit[i].GetMin(target));
+				box1 = box1.GetMax(posit[i].GetMax(target));
+				posit[i] = target;
+			}
+			context->m_box0[threadIndex] = box0;
+			context->m_box1[threadIndex] = box1;
+		}
+	};
+
+	dAssert(dAbs(world->GetScene()->GetTimestep() - timestep) < dFloat32(1.0e-5f));
+	ndScene* const scene = world->GetScene();
+	ndPredictPositions::ndContext context;
+	context.m_fluid = this;
+	scene->SubmitJobs<ndPredictPositions>(&context);
+
+	// the solver moves the particles about one radius at most
+	const dVector padding(dFloat32(2.0f) * m_radius);
+	sweptBox0 = context.m_box0[0];
+	sweptBox1 = context.m_box1[0];
+	for (dInt32 i = 1; i < scene->GetThreadCount(); i++)
+	{
+		sweptBox0 = sweptBox0.GetMin(context.m_box0[i]);
+		sweptBox1 = sweptBox1.GetMax(context.m_box1[i]);
+	}
+	sweptBox0 = (sweptBox0 - padding) & dVector::m_triplexMask;
+	sweptBox1 = (sweptBox1 + padding) & dVector::m_triplexMask;
+}
+
+void ndBodyPbfFluid::SavePredictedPositions(const ndWorld* const world)
+{
+	D_TRACKTIME();
+	class ndSavePredictedPositions: public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndBodyPbfFluid* const fluid = (ndBodyPbfFluid*)m_context;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 particleCount = fluid->m_posit.GetCount();
+
+			const dInt32 step = particleCount / threadCount;
+			const dInt32 start = threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : particleCount - start;
+
+			const dVector* const posit = &fluid->m_posit[start];
+			dVector* const predicted = &fluid->m_accel[start];
+			ndBoundaryContact* const contacts = &fluid->m_contacts[start];
+			for (dInt32 i = 0; i < count; i++)
+			{
+				predicted[i] = posit[i];
+				contacts[i].m_body = -1;
+			}
+		}
+	};
+
+	// the particles were reordered by the grid, the accelerations
+	// are calculated at the end of the step so the array keeps the
+	// predicted positions while the constraints are solved.
+	ndScene* const scene = world->GetScene();
+	scene->SubmitJobs<ndSavePredictedPositions>(this);
+}
+
+void ndBodyPbfFluid::BuildColors(const ndWorld* const)
+{
+	D_TRACKTIME();
+	const dInt32 cellCount = m_gridKeys.GetCount();
+	m_colorCells.SetCount(cellCount);
+
+	dInt32 scans[D_PBF_COLOR_COUNT];
+	memset(scans, 0, sizeof(scans));
+	for (dInt32 i = 0; i < cellCount; i++)
+	{
+		const ndGridHash cell(m_gridKeys[i]);
+		const dInt32 color = dInt32((cell.m_x & 1) | ((cell.m_y & 1) << 1) | ((cell.m_z & 1) << 2));
+		scans[color]++;
+	}
+
+	dInt32 sum = 0;
+	for (dInt32 i = 0; i < D_PBF_COLOR_COUNT; i++)
+	{
+		m_colorScans[i] = sum;
+		sum += scans[i];
+		scans[i] = m_colorScans[i];
+	}
+	m_colorScans[D_PBF_COLOR_COUNT] = sum;
+
+	for (dInt32 i = 0; i < cellCount; i++)
+	{
+		const ndGridHash cell(m_gridKeys[i]);
+		const dInt32 color = dInt32((cell.m_x & 1) | ((cell.m_y & 1) << 1) | ((cell.m_z & 1) << 2));
+		m_colorCells[scans[color]] = i;
+		scans[color]++;
+	}
+}
+
+void ndBodyPbfFluid::CalculateLambdas(const ndWorld* const world, ndPbfContext& context)
+{
+	D_TRACKTIME();
+	class ndCalculateLambdas: public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			const ndPbfContext* const context = (ndPbfContext*)m_context;
+			ndBodyPbfFluid* const fluid = context->m_fluid;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 particleCount = fluid->m_posit.GetCount();
+
+			// same partition as the neighbors, so the lists are in this thread buffer
+			const dInt32 step = particleCount / threadCount;
+			const dInt32 start = threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : particleCount - start;
+
+			const dFloat32 h = dFloat32(2.0f) * fluid->m_radius;
+			const dFloat32 h2 = h * h;
+			const dFloat32 h6 = h2 * h2 * h2;
+			const dVector hVector(h);
+			const dVector h2Vector(h2);
+			const dFloat32 poly6 = dFloat32(315.0f) / (dFloat32(64.0f) * dPi * h6 * h2 * h);
+			const dFloat32 densityScale = fluid->m_mass * poly6;
+			const dFloat32 selfWeight = h6;
+			const dFloat32 restDensity = context->m_restDensity;
+			const dFloat32 invRestDensity = dFloat32(1.0f) / restDensity;
+			const dFloat32 relaxation = context->m_relaxation;
+			const dVector gradScale(fluid->m_mass * invRestDensity * dFloat32(45.0f) / (dPi * h6));
+
+			const dVector* const posit = &fluid->m_posit[0];
+			const ndNeighborList* const neighborLists = &fluid->m_neighborLists[0];
+			const dArray<dInt32>& neighborsBuffer = fluid->m_neighbors[threadIndex];
+			dFloat32* const density = &fluid->m_density[0];
+			dFloat32* const lambda = &fluid->m_lambda[0];
+
+			for (dInt32 i = 0; i < count; i++)
+			{
+				const dInt32 index = start + i;
+				const ndNeighborList& list = neighborLists[index];
+
+				dVector weight(dVector::m_zero);
+				dVector gradient2(dVector::m_zero);
+				dVector gx(dVector::m_zero);
+				dVector gy(dVector::m_zero);
+				dVector gz(dVector::m_zero);
+				if (list.m_count)
+				{
+					const dVector px(posit[index].BroadcastX());
+					const dVector py(posit[index].BroadcastY());
+					const dVector pz(posit[index].BroadcastZ());
+					const dInt32* const neighbors = &neighborsBuffer[list.m_start];
+					for (dInt32 j = 0; j < list.m_count; j += 4)
+					{
+						dInt32 m[4];
+						const dVector mask(GatherNeighbors(neighbors, j, list.m_count, m));
+
+						dVector x1;
+						dVector y1;
+						dVector z1;
+						dVector w1;
+						dVector::Transpose4x4(x1, y1, z1, w1, posit[m[0]], posit[m[1]], posit[m[2]], posit[m[3]]);
+						const dVector dx(px - x1);
+						const dVector dy(py - y1);
+						const dVector dz(pz - z1);
+						const dVector dist2(dx * dx + dy * dy + dz * dz);
+						const dVector dist(dist2.Sqrt().GetMax(dVector::m_epsilon));
+						const dVector w((h2Vector - dist2).GetMax(dVector::m_zero));
+						const dVector hr((hVector - dist).GetMax(dVector::m_zero));
+						const dVector grad((gradScale * hr * hr) & mask);
+						const dVector gradDir(grad * dist.Reciproc());
+
+						weight += (w * w * w) & mask;
+						gradient2 += grad * grad;
+						gx += dx * gradDir;
+						gy += dy * gradDir;
+						gz += dz * gradDir;
+					}
+				}
+
+				// the constraint only pushes, a fluid with tension clumps in small groups
+				const dFloat32 particleDensity = densityScale * (selfWeight + weight.AddHorizontal().GetScalar());
+				const dFloat32 constraint = dMax(particleDensity * invRestDensity - dFloat32(1.0f), dFloat32(0.0f));
+				const dVector selfGradient(gx.AddHorizontal().GetScalar(), gy.AddHorizontal().GetScalar(), gz.AddHorizontal().GetScalar(), dFloat32(0.0f));
+				const dFloat32 den = gradient2.AddHorizontal().GetScalar() + selfGradient.DotProduct(selfGradient).GetScalar() + relaxation;
+				density[index] = particleDensity;
+				lambda[index] = -constraint / den;
+			}
+		}
+	};
+
+	ndScene* const scene = world->GetScene();
+	scene->SubmitJobs<ndCalculateLambdas>(&context);
+}
+
+void ndBodyPbfFluid::SolvePositions(const ndWorld* const world, ndPbfContext& context)
+{
+	D_TRACKTIME();
+	class ndSolvePositions: public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			const ndPbfContext* const context = (ndPbfContext*)m_context;
+			ndBodyPbfFluid* const fluid = context->m_fluid;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+
+			const dInt32 colorStart = fluid->m_colorScans[context->m_color];
+			const dInt32 colorCount = fluid->m_colorScans[context->m_color + 1] - colorStart;
+			const dInt32 step = colorCount / threadCount;
+			const dInt32 start = colorStart + threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : colorCount - threadIndex * step;
+
+			const dFloat32 h = dFloat32(2.0f) * fluid->m_radius;
+			const dFloat32 h6 = h * h * h * h * h * h;
+			const dVector hVector(h);
+			const dVector gradScale(fluid->m_mass * dFloat32(45.0f) / (context->m_restDensity * dPi * h6));
+			const dVector friction(fluid->m_friction);
+			const dVector half(dVector::m_half);
+			const dVector timestep(m_timestep);
+			const bool hasFriction = fluid->m_friction > dFloat32(0.0f);
+
+			const dInt32* const colorCells = &fluid->m_colorCells[0];
+			const dInt32* const gridScans = &fluid->m_gridScans[0][0];
+			const ndNeighborList* const neighborLists = &fluid->m_neighborLists[0];
+			const dFloat32* const lambda = &fluid->m_lambda[0];
+			const dVector* const predicted = &fluid->m_accel[0];
+			const dVector* const veloc = &fluid->m_velocity[0];
+			ndBoundaryContact* const contacts = &fluid->m_contacts[0];
+			dVector* const posit = &fluid->m_posit[0];
+
+			// a particle only moves itself and its neighbors are in cells
+			// of a different color, so the new positions are written in place.
+			for (dInt32 i = 0; i < count; i++)
+			{
+				const dInt32 cell = colorCells[start + i];
+				for (dInt32 index = gridScans[cell]; index < gridScans[cell + 1]; index++)
+				{
+					const ndNeighborList& list = neighborLists[index];
+					if (!list.m_count)
+					{
+						continue;
+					}
+
+					const dVector px(posit[index].BroadcastX());
+					const dVector py(posit[index].BroadcastY());
+					const dVector pz(posit[index].BroadcastZ());
+					const dVector lambda0(lambda[index]);
+
+					// how far the particle moved this step, for the friction
+					const dVector move(posit[index] - predicted[index] + veloc[index] * timestep);
+					const dVector mx(move.BroadcastX());
+					const dVector my(move.BroadcastY());
+					const dVector mz(move.BroadcastZ());
+
+					dVector deltaX(dVector::m_zero);
+					dVector deltaY(dVector::m_zero);
+					dVector deltaZ(dVector::m_zero);
+					const dInt32* const neighbors = context->GetNeighbors(index) + list.m_start;
+					for (dInt32 j = 0; j < list.m_count; j += 4)
+					{
+						dInt32 m[4];
+						const dVector mask(GatherNeighbors(neighbors, j, list.m_count, m));
+
+						dVector x1;
+						dVector y1;
+						dVector z1;
+						dVector w1;
+						dVector::Transpose4x4(x1, y1, z1, w1, posit[m[0]], posit[m[1]], posit[m[2]], posit[m[3]]);
+						const dVector lambda1(lambda[m[0]], lambda[m[1]], lambda[m[2]], lambda[m[3]]);
+
+						const dVector dx(px - x1);
+						const dVector dy(py - y1);
+						const dVector dz(pz - z1);
+						const dVector dist(dVector(dx * dx + dy * dy + dz * dz).Sqrt().GetMax(dVector::m_epsilon));
+						const dVector invDist(dist.Reciproc());
+						const dVector nx(dx * invDist);
+						const dVector ny(dy * invDist);
+						const dVector nz(dz * invDist);
+						const dVector hr((hVector - dist).GetMax(dVector::m_zero));
+
+						// the lambdas are negative, the pair is pushed apart along the normal
+						const dVector push((dVector::m_zero - (lambda0 + lambda1) * gradScale * hr * hr) & mask);
+						deltaX += nx * push;
+						deltaY += ny * push;
+						deltaZ += nz * push;
+
+						if (hasFriction)
+						{
+							// the tangent part of the relative move is removed up to the friction
+							// cone of the normal push, each particle of the pair takes one half.
+							const dVector old0(predicted[m[0]] - veloc[m[0]] * timestep);
+							const dVector old1(predicted[m[1]] - veloc[m[1]] * timestep);
+							const dVector old2(predicted[m[2]] - veloc[m[2]] * timestep);
+							const dVector old3(predicted[m[3]] - veloc[m[3]] * timestep);
+							dVector ox;
+							dVector oy;
+							dVector oz;
+							dVector ow;
+							dVector::Transpose4x4(ox, oy, oz, ow, old0, old1, old2, old3);
+
+							const dVector rx(mx - x1 + ox);
+							const dVector ry(my - y1 + oy);
+							const dVector rz(mz - z1 + oz);
+							const dVector normalMove(rx * nx + ry * ny + rz * nz);
+							const dVector tx(rx - nx * normalMove);
+							const dVector ty(ry - ny * normalMove);
+							const dVector tz(rz - nz * normalMove);
+							const dVector tangentMove(dVector(tx * tx + ty * ty + tz * tz).Sqrt().GetMax(dVector::m_epsilon));
+							const dVector scale((half * (friction * push * tangentMove.Reciproc()).GetMin(dVector::m_one)) & mask);
+							deltaX -= tx * scale;
+							deltaY -= ty * scale;
+							deltaZ -= tz * scale;
+						}
+					}
+					dVector delta(deltaX.AddHorizontal().GetScalar(), deltaY.AddHorizontal().GetScalar(), deltaZ.AddHorizontal().GetScalar(), dFloat32(0.0f));
+
+					ndBoundaryContact& contact = contacts[index];
+					if (contact.m_body >= 0)
+					{
+						const dVector correction(fluid->CalculateContactCorrection(contact, posit[index] + delta, predicted[index] - veloc[index] * timestep, predicted[index]));
+						delta += correction;
+						contact.m_impulse += correction;
+					}
+					posit[index] += delta;
+				}
+			}
+		}
+	};
+
+	ndScene* const scene = world->GetScene();
+	for (dInt32 i = 0; i < D_PBF_COLOR_COUNT; i++)
+	{
+		if (m_colorScans[i + 1] > m_colorScans[i])
+		{
+			context.m_color = i;
+			scene->SubmitJobs<ndSolvePositions>(&context);
+		}
+	}
+}
+
+dVector ndBodyPbfFluid::CalculateContactCorrection(const ndBoundaryContact& contact, const dVector& target, const dVector& origin, const dVector& predicted) const
+{
+	// the solver does not push the particle deeper than the free motion put it,
+	// the free penetration is resolved by the collision after the solve. the
+	// tangent move is removed up to the friction cone of the whole penetration.
+	const dFloat32 dist = contact.m_plane.DotProduct(target).GetScalar();
+	if (dist >= dFloat32(0.0f))
+	{
+		return dVector::m_zero;
+	}
+
+	const dVector normal(contact.m_plane & dVector::m_triplexMask);
+	const dFloat32 bound = dMin(contact.m_plane.DotProduct(predicted).GetScalar(), dFloat32(0.0f));
+	dVector correction(normal.Scale(dMax(bound - dist, dFloat32(0.0f))));
+	if (m_friction > dFloat32(0.0f))
+	{
+		const dVector move((target - origin) & dVector::m_triplexMask);
+		const dVector tangent(move - normal.Scale(normal.DotProduct(move).GetScalar()));
+		const dVector tangentImpulse(contact.m_impulse - normal.Scale(normal.DotProduct(contact.m_impulse).GetScalar()));
+		const dFloat32 tangentMove = dSqrt(tangent.DotProduct(tangent).GetScalar());
+		const dFloat32 maxFriction = -m_friction * dist - dSqrt(tangentImpulse.DotProduct(tangentImpulse).GetScalar());
+		if ((tangentMove > dFloat32(1.0e-6f)) && (maxFriction > dFloat32(0.0f)))
+		{
+			correction -= tangent.Scale(dMin(maxFriction / tangentMove, dFloat32(1.0f)));
+		}
+	}
+	return correction;
+}
+
+void ndBodyPbfFluid::FindBoundaryContacts(const ndWorld* const world)
+{
+	D_TRACKTIME();
+	class ndFindBoundaryContacts: public ndScene::ndBaseJob
+	{
+		public:
+		#define D_PBF_BOUNDARY_BATCH 32
+
+		// cast a ray from the particle along a direction, extended by the particle radius
+		bool CastRay(const ndBoundaryBody& boundary, const dVector& origin, const dVector& step, dFloat32 radius, dVector& plane) const
+		{
+			const dFloat32 dist2 = step.DotProduct(step).GetScalar();
+			if (dist2 < dFloat32(1.0e-12f))
+			{
+				return false;
+			}
+
+			const dVector dir(step.Scale(dRsqrt(dist2)));
+			const dFastRayTest ray(origin, origin + step + dir.Scale(radius));
+			ndRayCastClosestHitCallback callback;
+			if (!boundary.m_body->RayCast(callback, ray, dFloat32(1.0f)))
+			{
+				return false;
+			}
+
+			const dVector normal(callback.m_contact.m_normal & dVector::m_triplexMask);
+			const dVector point(callback.m_contact.m_point & dVector::m_triplexMask);
+			plane = normal;
+			plane.m_w = -(normal.DotProduct(point).GetScalar() + radius);
+			return true;
+		}
+
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndBodyPbfFluid* const fluid = (ndBodyPbfFluid*)m_context;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+
+			const dArray<dInt32>& gridScans = fluid->m_gridScans[0];
+			const dInt32 cellCount = gridScans.GetCount() - 1;
+			const dInt32 step = cellCount / threadCount;
+			const dInt32 start = threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : cellCount - start;
+
+			const dFloat32 radius = fluid->m_radius;
+			const dVector padding(radius);
+			const dVector timestep(m_timestep);
+			ndBodyNotify* const notify = fluid->GetNotifyCallback();
+			const dVector gravity(notify ? notify->GetGravity() & dVector::m_triplexMask : dVector::m_zero);
+			const dFloat32 gravityMag2 = gravity.DotProduct(gravity).GetScalar();
+			const dVector down((gravityMag2 > dFloat32(1.0e-6f)) ? gravity.Scale(dFloat32(0.5f) * radius * dRsqrt(gravityMag2)) : dVector::m_zero);
+			const dArray<ndBoundaryBody>& boundaryBodies = fluid->m_boundaryBodies;
+			const dVector* const predicted = &fluid->m_accel[0];
+			const dVector* const veloc = &fluid->m_velocity[0];
+			ndBoundaryContact* const contacts = &fluid->m_contacts[0];
+			dVector* const posit = &fluid->m_posit[0];
+			for (dInt32 i = 0; i < count; i++)
+			{
+				const dInt32 cell = start + i;
+				const dInt32 cellStart = gridScans[cell];
+				const dInt32 cellEnd = gridScans[cell + 1];
+
+				dVector box0(dFloat32(1.0e20f));
+				dVector box1(dFloat32(-1.0e20f));
+				for (dInt32 j = cellStart; j < cellEnd; j++)
+				{
+					const dVector origin(predicted[j] - veloc[j] * timestep);
+					box0 = box0.GetMin(posit[j].GetMin(origin));
+					box1 = box1.GetMax(posit[j].GetMax(origin));
+				}
+				box0 = (box0 - padding) & dVector::m_triplexMask;
+				box1 = (box1 + padding) & dVector::m_triplexMask;
+
+				dInt32 overlapCount = 0;
+				dInt32 overlaps[D_PBF_BOUNDARY_BATCH];
+				for (dInt32 k = 0; (k < boundaryBodies.GetCount()) && (overlapCount < D_PBF_BOUNDARY_BATCH); k++)
+				{
+					const ndBoundaryBody& boundary = boundaryBodies[k];
+					if (dOverlapTest(box0, box1, boundary.m_box0, boundary.m_box1))
+					{
+						overlaps[overlapCount] = k;
+						overlapCount++;
+					}
+				}
+
+				for (dInt32 j = cellStart; overlapCount && (j < cellEnd); j++)
+				{
+					ndBoundaryContact& contact = contacts[j];
+					if (contact.m_body >= 0)
+					{
+						continue;
+					}
+
+					// the rays along the free motion, along the push of the solver and
+					// along the gravity find the surface the particle is pressed against,
+					// the plane closest to the particle is kept.
+					const dVector origin(predicted[j] & dVector::m_triplexMask);
+					const dVector motion(veloc[j] * timestep);
+					const dVector push((posit[j] - predicted[j]) & dVector::m_triplexMask);
+					const dVector rayOrigin[] = {origin - motion, origin, origin};
+					const dVector rayStep[] = {motion, push, down};
+					for (dInt32 k = 0; k < overlapCount; k++)
+					{
+						const ndBoundaryBody& boundary = boundaryBodies[overlaps[k]];
+						for (dInt32 n = 0; n < dInt32(sizeof(rayStep) / sizeof(rayStep[0])); n++)
+						{
+							dVector plane;
+							if (CastRay(boundary, rayOrigin[n], rayStep[n], radius, plane))
+							{
+								if ((contact.m_body < 0) || (plane.DotProduct(posit[j]).GetScalar() < contact.m_plane.DotProduct(posit[j]).GetScalar()))
+								{
+									contact.m_plane = plane;
+									contact.m_body = overlaps[k];
+								}
+							}
+						}
+					}
+
+					// undo the part of the last push that went into the body
+					if (contact.m_body >= 0)
+					{
+						contact.m_impulse = dVector::m_zero;
+						contact.m_impulse = fluid->CalculateContactCorrection(contact, posit[j], predicted[j] - veloc[j] * timestep, predicted[j]);
+						posit[j] += contact.m_impulse;
+					}
+				}
+			}
+		}
+	};
+
+	ndScene* const scene = world->GetScene();
+	scene->SubmitJobs<ndFindBoundaryContacts>(this);
+}
+
+void ndBodyPbfFluid::ApplyContactForces(const ndWorld* const world)
+{
+	D_TRACKTIME();
+	class ndCalculateContactForces: public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndBodyPbfFluid* const fluid = (ndBodyPbfFluid*)m_context;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 particleCount = fluid->m_posit.GetCount();
+
+			const dArray<ndBoundaryBody>& boundaryBodies = fluid->m_boundaryBodies;
+			dArray<ndJacobian>& reactions = fluid->m_boundaryForces[threadIndex];
+			reactions.SetCount(boundaryBodies.GetCount());
+			for (dInt32 i = 0; i < reactions.GetCount(); i++)
+			{
+				reactions[i].m_linear = dVector::m_zero;
+				reactions[i].m_angular = dVector::m_zero;
+			}
+
+			const dInt32 step = particleCount / threadCount;
+			const dInt32 start = threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : particleCount - start;
+
+			// a position correction is a velocity change of the particle, 
+			// the opposite momentum goes to the body over the time step.
+			const dFloat32 forceScale = -fluid->m_mass / (m_timestep * m_timestep);
+			const dFloat32 radius = fluid->m_radius;
+			const ndBoundaryContact* const contacts = &fluid->m_contacts[0];
+			const dVector* const posit = &fluid->m_posit[0];
+			for (dInt32 i = 0; i < count; i++)
+			{
+				const dInt32 index = start + i;
+				const ndBoundaryContact& contact = contacts[index];
+				if (contact.m_body >= 0)
+				{
+					ndBodyKinematic* const body = boundaryBodies[contact.m_body].m_body;
+					if (body->GetInvMass() > dFloat32(0.0f))
+					{
+						const dVector normal(contact.m_plane & dVector::m_triplexMask);
+						const dVector point(posit[index] - normal.Scale(radius));
+						const dVector com(body->GetMatrix().TransformVector(body->GetCentreOfMass()));
+						const dVector force(contact.m_impulse.Scale(forceScale));
+						ndJacobian& reaction = reactions[contact.m_body];
+						reaction.m_linear += force;
+						reaction.m_angular += (point - com).CrossProduct(force);
+					}
+				}
+			}
+		}
+	};
+
+	ndScene* const scene = world->GetScene();
+	scene->SubmitJobs<ndCalculateContactForces>(this);
+	ApplyBoundaryForces(world);
+}
+
+void ndBodyPbfFluid::CalculateCorrections(const ndWorld* const world)
+{
+	D_TRACKTIME();
+	class ndCalculateCorrections: public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndBodyPbfFluid* const fluid = (ndBodyPbfFluid*)m_context;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 particleCount = fluid->m_posit.GetCount();
+
+			const dInt32 step = particleCount / threadCount;
+			const dInt32 start = threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : particleCount - start;
+
+			// the particle goes back to the start of the step, and the
+			// correction becomes the acceleration that moves it to the
+			// solved position when the velocity is integrated.
+			const dVector timestep(m_timestep);
+			const dVector invTimestep2(dFloat32(1.0f) / (m_timestep * m_timestep));
+			dVector* const posit = &fluid->m_posit[start];
+			dVector* const accel = &fluid->m_accel[start];
+			const dVector* const veloc = &fluid->m_velocity[start];
+			for (dInt32 i = 0; i < count; i++)
+			{
+				const dVector predicted(accel[i]);
+				accel[i] = ((posit[i] - predicted) * invTimestep2) & dVector::m_triplexMask;
+				posit[i] = predicted - veloc[i] * timestep;
+			}
+		}
+	};
+
+	ndScene* const scene = world->GetScene();
+	scene->SubmitJobs<ndCalculateCorrections>(this);
+}
+
+void ndBodyPbfFluid::ApplyViscosity(const ndWorld* const world, ndPbfContext& context)
+{
+	D_TRACKTIME();
+	class ndApplyViscosity: public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			const ndPbfContext* const context = (ndPbfContext*)m_context;
+			ndBodyPbfFluid* const fluid = context->m_fluid;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 particleCount = fluid->m_posit.GetCount();
+
+			const dInt32 step = particleCount / threadCount;
+			const dInt32 start = threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : particleCount - start;
+
+			// the velocity of a particle is blended with the average
+			// velocity of its neighbors weighted by the density kernel.
+			const dFloat32 h = dFloat32(2.0f) * fluid->m_radius;
+			const dFloat32 h2 = h * h;
+			const dVector h2Vector(h2);
+			const dFloat32 poly6 = dFloat32(315.0f) / (dFloat32(64.0f) * dPi * h2 * h2 * h2 * h2 * h);
+			const dVector viscosityScale(fluid->m_viscosity * fluid->m_mass * poly6);
+
+			const dVector* const posit = &fluid->m_posit[0];
+			const dVector* const veloc = &fluid->m_velocity[0];
+			const dFloat32* const density = &fluid->m_density[0];
+			const ndNeighborList* const neighborLists = &fluid->m_neighborLists[0];
+			const dArray<dInt32>& neighborsBuffer = fluid->m_neighbors[threadIndex];
+			dVector* const viscousVeloc = &fluid->m_accel[0];
+
+			for (dInt32 i = 0; i < count; i++)
+			{
+				const dInt32 index = start + i;
+				const ndNeighborList& list = neighborLists[index];
+
+				dVector vx(dVector::m_zero);
+				dVector vy(dVector::m_zero);
+				dVector vz(dVector::m_zero);
+				if (list.m_count)
+				{
+					const dVector px(posit[index].BroadcastX());
+					const dVector py(posit[index].BroadcastY());
+					const dVector pz(posit[index].BroadcastZ());
+					const dVector vx0(veloc[index].BroadcastX());
+					const dVector vy0(veloc[index].BroadcastY());
+					const dVector vz0(veloc[index].BroadcastZ());
+					const dInt32* const neighbors = &neighborsBuffer[list.m_start];
+					for (dInt32 j = 0; j < list.m_count; j += 4)
+					{
+						dInt32 m[4];
+						const dVector mask(GatherNeighbors(neighbors, j, list.m_count, m));
+
+						dVector x1;
+						dVector y1;
+						dVector z1;
+						dVector w1;
+						dVector::Transpose4x4(x1, y1, z1, w1, posit[m[0]], posit[m[1]], posit[m[2]], posit[m[3]]);
+
+						dVector vx1;
+						dVector vy1;
+						dVector vz1;
+						dVector vw1;
+						dVector::Transpose4x4(vx1, vy1, vz1, vw1, veloc[m[0]], veloc[m[1]], veloc[m[2]], veloc[m[3]]);
+
+						const dVector invDensity1(dVector(density[m[0]], density[m[1]], density[m[2]], density[m[3]]).Reciproc());
+						const dVector dx(px - x1);
+						const dVector dy(py - y1);
+						const dVector dz(pz - z1);
+						const dVector dist2(dx * dx + dy * dy + dz * dz);
+						const dVector w((h2Vector - dist2).GetMax(dVector::m_zero));
+						const dVector weight((viscosityScale * w * w * w * invDensity1) & mask);
+						vx += (vx1 - vx0) * weight;
+						vy += (vy1 - vy0) * weight;
+						vz += (vz1 - vz0) * weight;
+					}
+				}
+
+				const dVector deltaVeloc(vx.AddHorizontal().GetScalar(), vy.AddHorizontal().GetScalar(), vz.AddHorizontal().GetScalar(), dFloat32(0.0f));
+				viscousVeloc[index] = veloc[index] + deltaVeloc;
+			}
+		}
+	};
+
+	ndScene* const scene = world->GetScene();
+	scene->SubmitJobs<ndApplyViscosity>(&context);
+	m_velocity.Swap(m_accel);
+}
@@ -0,0 +1,126 @@
+/* Copyright (c) <2003-2021> <Julio Jerez, Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef __D_BODY_PBF_FLUID_H__
+#define __D_BODY_PBF_FLUID_H__
+
+#include "ndNewtonStdafx.h"
+#include "ndBodySphFluid.h"
+
+// cells with the same parity in x, y and z are two cells apart,
+// so their particles do not see each other and are solved in parallel.
+#define D_PBF_COLOR_COUNT	8
+
+// position based fluid, the particles are moved to satisfy a density
+// constraint instead of being pushed by pressure forces, so it is stable
+// at large time steps. a friction between particles makes the set behave
+// like sand or gravel. the grid, the neighbors, the collision with rigid
+// bodies and the iso surface are the same as the sph fluid.
+D_MSV_NEWTON_ALIGN_32
+class ndBodyPbfFluid: public ndBodySphFluid
+{
+	public:
+	D_NEWTON_API ndBodyPbfFluid();
+	D_NEWTON_API ndBodyPbfFluid(const nd::TiXmlNode* const xmlNode, const dTree<const ndShape*, dUnsigned32>& shapesCache);
+	D_NEWTON_API virtual ~ndBodyPbfFluid ();
+
+	D_NEWTON_API virtual void Save(nd::TiXmlElement* const rootNode, const char* const assetPath, dInt32 nodeid, const dTree<dUnsigned32, const ndShape*>& shapesCache) const;
+
+	dInt32 GetSolverIterations() const;
+	void SetSolverIterations(dInt32 iterations);
+
+	// constraint softness as a fraction of the stiffness of a particle at rest density
+	dFloat32 GetRelaxation() const;
+	void SetRelaxation(dFloat32 relaxation);
+
+	// zero for liquids, sand and gravel are between 0.5 and 1.0
+	dFloat32 GetFriction() const;
+	void SetFriction(dFloat32 friction);
+
+	protected:
+	D_NEWTON_API virtual void Update(const ndWorld* const world, dFloat32 timestep);
+
+	private:
+	// a particle pressed against a rigid body, the center stays above the 
+	// plane and the corrections made by the plane push on the body.
+	class ndBoundaryContact
+	{
+		public:
+		dVector m_plane;
+		dVector m_impulse;
+		dInt32 m_body;
+	};
+
+	class ndPbfContext;
+
+	void PredictPositions(const ndWorld* const world, dFloat32 timestep, dVector& sweptBox0, dVector& sweptBox1);
+	void SavePredictedPositions(const ndWorld* const world);
+	void BuildColors(const ndWorld* const world);
+	void CalculateLambdas(const ndWorld* const world, ndPbfContext& context);
+	void SolvePositions(const ndWorld* const world, ndPbfContext& context);
+	void FindBoundaryContacts(const ndWorld* const world);
+	dVector CalculateContactCorrection(const ndBoundaryContact& contact, const dVector& target, const dVector& origin, const dVector& predicted) const;
+	void ApplyContactForces(const ndWorld* const world);
+	void CalculateCorrections(const ndWorld* const world);
+	void ApplyViscosity(const ndWorld* const world, ndPbfContext& context);
+	dFloat32 CalculateRestGradient(dFloat32 restDensity) const;
+
+	dArray<dFloat32> m_lambda;
+	dArray<ndBoundaryContact> m_contacts;
+	dArray<dInt32> m_colorCells;
+	dInt32 m_colorScans[D_PBF_COLOR_COUNT + 1];
+	dFloat32 m_relaxation;
+	dFloat32 m_friction;
+	dInt32 m_iterations;
+} D_GCC_NEWTON_ALIGN_32 ;
+
+inline dInt32 ndBodyPbfFluid::GetSolverIterations() const
+{
+	return m_iterations;
+}
+
+inline void ndBodyPbfFluid::SetSolverIterations(dInt32 iterations)
+{
+	m_iterations = dMax(iterations, 1);
+}
+
+inline dFloat32 ndBodyPbfFluid::GetRelaxation() const
+{
+	return m_relaxation;
+}
+
+inline void ndBodyPbfFluid::SetRelaxation(dFloat32 relaxation)
+{
+	m_relaxation = dMax(relaxation, dFloat32(1.0e-4f));
+}
+
+inline dFloat32 ndBodyPbfFluid::GetFriction() const
+{
+	return m_friction;
+}
+
+inline void ndBodyPbfFluid::SetFriction(dFloat32 friction)
+{
+	m_friction = dMax(friction, dFloat32(0.0f));
+}
+
+#endif
+
@@ -52,10 +52,24 @@ ndBodySphFluid::ndBodySphFluid()
 	:ndBodyParticleSet()
 	,m_box0(dFloat32(-1e10f))
 	,m_box1(dFloat32(1e10f))
+	,m_accel(1024)
+	,m_density(1024)
+	,m_pressure(1024)
 	,m_hashGridMap(1024)
-	,m_particlesPairs(1024)
 	,m_hashGridMapScratchBuffer(1024)
+	,m_stayedGridMap(1024)
+	,m_reorderBuffer(1024)
+	,m_particleId(1024)
+	,m_reorderIdBuffer(1024)
+	,m_gridKeys(1024)
 //	,m_gridScans(1024)
+	,m_neighborLists(1024)
+	,m_mass(dFloat32(1.0f))
+	,m_restDensity(dFloat32(0.0f))
+	,m_stiffness(dFloat32(20.0f))
+	,m_viscosity(dFloat32(0.05f))
+	,m_gridSize(dFloat32(0.0f))
+	,m_movedCount(0)
 {
 }
 
@@ -63,8 +77,23 @@ ndBodySphFluid::ndBodySphFluid(const nd::TiXmlNode* const xmlNode, const dTree<c
 	:ndBodyParticleSet(xmlNode->FirstChild("ndBodyKinematic"), shapesCache)
 	,m_box0(dFloat32(-1e10f))
 	,m_box1(dFloat32(1e10f))
+	,m_accel()
+	,m_density()
+	,m_pressure()
 	,m_hashGridMap()
 	,m_hashGridMapScratchBuffer()
+	,m_stayedGridMap()
+	,m_reorderBuffer()
+	,m_particleId()
+	,m_reorderIdBuffer()
+	,m_gridKeys()
+	,m_neighborLists()
+	,m_mass(dFloat32(1.0f))
+	,m_restDensity(dFloat32(0.0f))
+	,m_stiffness(dFloat32(20.0f))
+	,m_viscosity(dFloat32(0.05f))
+	,m_gridSize(dFloat32(0.0f))
+	,m_movedCount(0)
 {
 	// nothing was saved
 	dAssert(0);
@@ -81,11 +110,20 @@ void ndBodySphFluid::Save(nd::TiXmlElement* const rootNode, const char* const as
 	ndBodyParticleSet::Save(paramNode, assetPath, nodeid, shapesCache);
 }
 
-void ndBodySphFluid::AddParticle(const dFloat32, const dVector& position, const dVector&)
+void ndBodySphFluid::AddParticle(const dFloat32 mass, const dVector& position, const dVector& velocity)
 {
+	// all particles have the same mass
 	dVector point(position);
 	point.m_w = dFloat32(1.0f);
+	m_particleId.PushBack(m_posit.GetCount());
 	m_posit.PushBack(point);
+	m_velocity.PushBack(velocity & dVector::m_triplexMask);
+	m_mass = mass;
+}
+
+dInt32 ndBodySphFluid::GetParticleId(dInt32 particle) const
+{
+	return m_particleId[particle];
 }
 
 void ndBodySphFluid::CaculateAABB(const ndWorld* const, dVector& boxP0, dVector& boxP1) const
@@ -102,55 +140,27 @@ void ndBodySphFluid::CaculateAABB(const ndWorld* const, dVector& boxP0, dVector&
 	boxP1 = box1;
 }
 
-void ndBodySphFluid::Update(const ndWorld* const world, dFloat32)
-{
-	dVector boxP0;
-	dVector boxP1;
-	CaculateAABB(world, boxP0, boxP1);
-	const dFloat32 gridSize = CalculateGridSize();
-	m_box0 = boxP0 - dVector(gridSize);
-	m_box1 = boxP1 + dVector(gridSize);
-
-	CreateGrids(world);
-	SortGrids(world);
-	BuildPairs(world);
-	CalculateAccelerations(world);
-}
-
-void ndBodySphFluid::SortByCenterType()
+void ndBodySphFluid::Update(const ndWorld* const world, dFloat32 timestep)
 {
-	D_TRACKTIME();
-	const dInt32 count = m_hashGridMap.GetCount();
-
-	dInt32 histogram[2];
-	memset(histogram, 0, sizeof(histogram));
-
-	const ndGridHash* const srcArray = &m_hashGridMap[0];
-	for (dInt32 i = 0; i < count; i++)
+	const dInt32 particleCount = m_posit.GetCount();
+	if (!particleCount)
 	{
-		const ndGridHash& entry = srcArray[i];
-		const dInt32 index = dInt32(entry.m_cellType);
-		histogram[index] = histogram[index] + 1;
+		return;
 	}
 
-	dInt32 acc = 0;
-	for (dInt32 i = 0; i < 2; i++)
-	{
-		const dInt32 n = histogram[i];
-		histogram[i] = acc;
-		acc += n;
-	}
+	m_accel.SetCount(particleCount);
+	m_density.SetCount(particleCount);
+	m_pressure.SetCount(particleCount);
+	m_neighborLists.SetCount(particleCount);
 
-	ndGridHash* const dstArray = &m_hashGridMapScratchBuffer[0];
-	for (dInt32 i = 0; i < count; i++)
-	{
-		const ndGridHash& entry = srcArray[i];
-		const dInt32 key = dInt32(entry.m_cellType);
-		const dInt32 index = histogram[key];
-		dstArray[index] = entry;
-		histogram[key] = index + 1;
-	}
-	m_hashGridMap.Swap(m_hashGridMapScratchBuffer);
+	dVector boxP0;
+	dVector boxP1;
+	CaculateAABB(world, boxP0, boxP1);
+	UpdateGrids(world, boxP0, boxP1);
+	BuildNeighbors(world);
+	CalculateDensities(world);
+	CalculateAccelerations(world);
+	IntegrateParticles(world, timestep);
 }
 
 void ndBodySphFluid::SortSingleThreaded()
@@ -387,106 +397,441 @@ void ndBodySphFluid::SortParallel(const ndWorld* const world)
 }
 
 
-D_NEWTON_API void ndBodySphFluid::GenerateIsoSurface(const ndWorld* const)
+class ndBodySphFluid::ndIsoContext
+{
+	public:
+	dVector m_origin;
+	dVector m_invGridSize;
+	ndBodySphFluid* m_fluid;
+	dInt32 m_runsCount[D_MAX_THREADS_COUNT + 1];
+};
+
+void ndBodySphFluid::SplatIsoParticles(const ndWorld* const world, ndIsoContext& context)
 {
-return;
-#if 0
 	D_TRACKTIME();
-	dVector boxP0;
-	dVector boxP1;
-	CaculateAABB(world, boxP0, boxP1);
+	class ndSplatIsoParticles: public ndScene::ndBaseJob
+	{
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndIsoContext* const context = (ndIsoContext*)m_context;
+			ndBodySphFluid* const fluid = context->m_fluid;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 particleCount = fluid->m_posit.GetCount();
 
-	dFloat32 gridSize = m_radius * dFloat32(2.0f);
-	const dVector invGridSize (dFloat32 (1.0f) / gridSize);
+			const dInt32 step = particleCount / threadCount;
+			const dInt32 start = threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : particleCount - start;
 
-	dVector padd(dFloat32(2.0f) * gridSize);
-	boxP0 -= padd & dVector::m_triplexMask;
-	boxP1 += padd & dVector::m_triplexMask;
+			const dVector* const posit = &fluid->m_posit[0];
+			ndGridHash* const hashGridMap = &fluid->m_hashGridMap[0];
+			for (dInt32 i = 0; i < count; i++)
+			{
+				const dInt32 index = start + i;
+				const dVector p((posit[index] - context->m_origin) * context->m_invGridSize);
+				hashGridMap[index] = ndGridHash(p, index);
+			}
+		}
+	};
 
 	m_hashGridMap.SetCount(m_posit.GetCount());
-	m_hashGridMapScratchBuffer.SetCount(m_posit.GetCount());
-	const dVector* const posit = &m_posit[0];
-	
-	for (dInt32 i = m_posit.GetCount() - 1; i >= 0; i--)
+	world->GetScene()->SubmitJobs<ndSplatIsoParticles>(&context);
+}
+
+dInt32 ndBodySphFluid::CalculateIsoRuns(const ndWorld* const world, ndIsoContext& context)
+{
+	D_TRACKTIME();
+	class ndCountIsoRuns: public ndScene::ndBaseJob
+	{
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndIsoContext* const context = (ndIsoContext*)m_context;
+			ndBodySphFluid* const fluid = context->m_fluid;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 entriesCount = fluid->m_hashGridMap.GetCount();
+
+			const dInt32 step = entriesCount / threadCount;
+			const dInt32 start = threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : entriesCount - start;
+
+			dInt32 runs = 0;
+			const ndGridHash* const hashGridMap = &fluid->m_hashGridMap[0];
+			for (dInt32 i = 0; i < count; i++)
+			{
+				const dInt32 index = start + i;
+				runs += (!index || (hashGridMap[index].m_gridHash != hashGridMap[index - 1].m_gridHash)) ? 1 : 0;
+			}
+			context->m_runsCount[threadIndex] = runs;
+		}
+	};
+
+	class ndWriteIsoRuns: public ndScene::ndBaseJob
+	{
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndIsoContext* const context = (ndIsoContext*)m_context;
+			ndBodySphFluid* const fluid = context->m_fluid;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 entriesCount = fluid->m_hashGridMap.GetCount();
+
+			const dInt32 step = entriesCount / threadCount;
+			const dInt32 start = threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : entriesCount - start;
+
+			dInt32 runIndex = context->m_runsCount[threadIndex];
+			dInt32* const runs = &fluid->m_isoRuns[0];
+			const ndGridHash* const hashGridMap = &fluid->m_hashGridMap[0];
+			for (dInt32 i = 0; i < count; i++)
+			{
+				const dInt32 index = start + i;
+				if (!index || (hashGridMap[index].m_gridHash != hashGridMap[index - 1].m_gridHash))
+				{
+					runs[runIndex] = index;
+					runIndex++;
+				}
+			}
+		}
+	};
+
+	ndScene* const scene = world->GetScene();
+	scene->SubmitJobs<ndCountIsoRuns>(&context);
+
+	dInt32 acc = 0;
+	const dInt32 threadCount = world->GetThreadCount();
+	for (dInt32 i = 0; i < threadCount; i++)
 	{
-		dAssert(0);
-		//dVector r(posit[i] - boxP0);
-		//dVector p(r * invGridSize);
-		//ndGridHash hashKey(p, i, ndHomeGrid);
-		//m_hashGridMap[i] = hashKey;
+		const dInt32 runs = context.m_runsCount[i];
+		context.m_runsCount[i] = acc;
+		acc += runs;
 	}
 
-	ndContext context;
+	// the last run ends at a sentinel
+	m_isoRuns.SetCount(acc + 1);
+	m_isoRuns[acc] = m_hashGridMap.GetCount();
+	scene->SubmitJobs<ndWriteIsoRuns>(&context);
+	return acc;
+}
+
+void ndBodySphFluid::SplatIsoCells(const ndWorld* const world, ndIsoContext& context)
+{
+	D_TRACKTIME();
+	class ndSplatIsoCells: public ndScene::ndBaseJob
+	{
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndIsoContext* const context = (ndIsoContext*)m_context;
+			ndBodySphFluid* const fluid = context->m_fluid;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 cellsCount = fluid->m_isoRuns.GetCount() - 1;
+
+			const dInt32 step = cellsCount / threadCount;
+			const dInt32 start = threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : cellsCount - start;
+
+			const dVector one(dVector::m_one);
+			const dVector* const posit = &fluid->m_posit[0];
+			const dInt32* const runs = &fluid->m_isoRuns[0];
+			const ndGridHash* const hashGridMap = &fluid->m_hashGridMap[0];
+			ndGridHash* const corners = &fluid->m_hashGridMapScratchBuffer[0];
+			dFloat32* const cornerValues = &fluid->m_isoCorners[0];
+
+			// a particle packed one radius apart weights one eighth of a diameter cell
+			const dFloat32 scale = dFloat32(1.0f / 8.0f);
+			for (dInt32 i = 0; i < count; i++)
+			{
+				const dInt32 cell = start + i;
+				const ndGridHash& cellHash = hashGridMap[runs[cell]];
+				const dVector cellOrigin(dFloat32(cellHash.m_x), dFloat32(cellHash.m_y), dFloat32(cellHash.m_z), dFloat32(0.0f));
+
+				dFloat32 values[2][2][2];
+				memset(values, 0, sizeof(values));
+				for (dInt32 j = runs[cell]; j < runs[cell + 1]; j++)
+				{
+					const dInt32 index = hashGridMap[j].m_particleIndex;
+					const dVector t(((posit[index] - context->m_origin) * context->m_invGridSize - cellOrigin).GetMax(dVector::m_zero).GetMin(one));
+					const dVector s(one - t);
+					values[0][0][0] += s.m_z * s.m_y * s.m_x;
+					values[0][0][1] += s.m_z * s.m_y * t.m_x;
+					values[0][1][0] += s.m_z * t.m_y * s.m_x;
+					values[0][1][1] += s.m_z * t.m_y * t.m_x;
+					values[1][0][0] += t.m_z * s.m_y * s.m_x;
+					values[1][0][1] += t.m_z * s.m_y * t.m_x;
+					values[1][1][0] += t.m_z * t.m_y * s.m_x;
+					values[1][1][1] += t.m_z * t.m_y * t.m_x;
+				}
+
+				for (dInt32 j = 0; j < 8; j++)
+				{
+					const dInt32 x = j & 1;
+					const dInt32 y = (j >> 1) & 1;
+					const dInt32 z = (j >> 2) & 1;
+					const dInt32 index = cell * 8 + j;
+					ndGridHash corner(dInt32(cellHash.m_x) + x, dInt32(cellHash.m_y) + y, dInt32(cellHash.m_z) + z);
+					corner.m_particleIndex = index;
+					corners[index] = corner;
+					cornerValues[index] = values[z][y][x] * scale;
+				}
+			}
+		}
+	};
+
+	const dInt32 cellsCount = m_isoRuns.GetCount() - 1;
+	m_isoCorners.SetCount(cellsCount * 8);
+	m_hashGridMapScratchBuffer.SetCount(cellsCount * 8);
+	world->GetScene()->SubmitJobs<ndSplatIsoCells>(&context);
+	m_hashGridMap.Swap(m_hashGridMapScratchBuffer);
+}
+
+void ndBodySphFluid::SumIsoPoints(const ndWorld* const world, ndIsoContext& context)
+{
+	D_TRACKTIME();
+	class ndSumIsoPoints: public ndScene::ndBaseJob
+	{
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndIsoContext* const context = (ndIsoContext*)m_context;
+			ndBodySphFluid* const fluid = context->m_fluid;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 pointsCount = fluid->m_isoPoints.GetCount();
+
+			const dInt32 step = pointsCount / threadCount;
+			const dInt32 start = threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : pointsCount - start;
+
+			const dInt32* const runs = &fluid->m_isoRuns[0];
+			const dFloat32* const cornerValues = &fluid->m_isoCorners[0];
+			const ndGridHash* const hashGridMap = &fluid->m_hashGridMap[0];
+			dIsoSurface::dIsoPoint* const points = &fluid->m_isoPoints[0];
+			for (dInt32 i = 0; i < count; i++)
+			{
+				// the sort is stable, so the sum is always added in the same order
+				const dInt32 index = start + i;
+				dFloat32 value = dFloat32(0.0f);
+				for (dInt32 j = runs[index]; j < runs[index + 1]; j++)
+				{
+					value += cornerValues[hashGridMap[j].m_particleIndex];
+				}
+				const ndGridHash& pointHash = hashGridMap[runs[index]];
+				dIsoSurface::dIsoPoint& point = points[index];
+				point.m_x = dInt32(pointHash.m_x);
+				point.m_y = dInt32(pointHash.m_y);
+				point.m_z = dInt32(pointHash.m_z);
+				point.m_value = value;
+			}
+		}
+	};
+
+	world->GetScene()->SubmitJobs<ndSumIsoPoints>(&context);
+}
+
+void ndBodySphFluid::GenerateIsoSurface(const ndWorld* const world)
+{
+	D_TRACKTIME();
+	// the field is the particles added to the corners of cells one diameter wide with 
+	// trilinear weights, so it is one inside the fluid at rest and the surface is at one half. 
+	// the grids are sorted with the simulation radix sort, the simulation grids are put aside.
+	dVector boxP0(dVector::m_zero);
+	dVector boxP1(dVector::m_zero);
+	if (m_posit.GetCount())
+	{
+		CaculateAABB(world, boxP0, boxP1);
+	}
+	const dFloat32 gridSize = m_radius * dFloat32(2.0f);
+
+	ndIsoContext context;
 	context.m_fluid = this;
+	context.m_origin = (boxP0 - dVector(gridSize * dFloat32(2.0f))) & dVector::m_triplexMask;
+	context.m_invGridSize = dVector(dFloat32(1.0f) / gridSize);
+
+	const dVector extends((boxP1 - context.m_origin) * context.m_invGridSize + dVector(dFloat32(4.0f)));
+	dAssert(extends.m_x < dFloat32((1 << (D_RADIX_DIGIT_SIZE * 2)) - 2));
+	dAssert(extends.m_y < dFloat32((1 << (D_RADIX_DIGIT_SIZE * 2)) - 2));
+	dAssert(extends.m_z < dFloat32((1 << (D_RADIX_DIGIT_SIZE * 2)) - 2));
+
+	dInt32 upperDigisIsValid[3];
+	memcpy(upperDigisIsValid, m_upperDigisIsValid, sizeof(upperDigisIsValid));
+	m_upperDigisIsValid[0] = extends.m_x >= dFloat32(1 << D_RADIX_DIGIT_SIZE);
+	m_upperDigisIsValid[1] = extends.m_y >= dFloat32(1 << D_RADIX_DIGIT_SIZE);
+	m_upperDigisIsValid[2] = extends.m_z >= dFloat32(1 << D_RADIX_DIGIT_SIZE);
+	m_hashGridMap.Swap(m_isoGridMap);
+	m_hashGridMapScratchBuffer.Swap(m_isoGridMapScratchBuffer);
+
+	m_isoPoints.SetCount(0);
+	if (m_posit.GetCount())
+	{
+		// find the particles of each cell
+		SplatIsoParticles(world, context);
+		SortGrids(world);
+		CalculateIsoRuns(world, context);
+
+		// add the cells to their corners
+		SplatIsoCells(world, context);
+		SortGrids(world);
+		const dInt32 pointsCount = CalculateIsoRuns(world, context);
+		m_isoPoints.SetCount(pointsCount);
+		SumIsoPoints(world, context);
+	}
+
+	m_hashGridMap.Swap(m_isoGridMap);
+	m_hashGridMapScratchBuffer.Swap(m_isoGridMapScratchBuffer);
+	memcpy(m_upperDigisIsValid, upperDigisIsValid, sizeof(upperDigisIsValid));
+
+	const dIsoSurface::dIsoPoint* const points = m_isoPoints.GetCount() ? &m_isoPoints[0] : nullptr;
+	m_isoSurcase.GenerateMesh(points, m_isoPoints.GetCount(), context.m_origin, gridSize, dFloat32(0.5f), world->GetScene());
+}
 
-	SortSingleThreaded(world);
-	dInt32 uniqueCount = 0;
-	for (dInt32 i = 0; i < m_hashGridMap.GetCount();)
+void ndBodySphFluid::GetCellSpan(dInt32 x0, dInt32 x1, dInt32 y, dInt32 z, dInt32& start, dInt32& count) const
+{
+	// the particles are sorted by cell, so the cells x0 to x1 of a row are a 
+	// contiguous span of particles, only a few cells are scanned for the end.
+	const dUnsigned64* const gridKeys = &m_gridKeys[0];
+	const dInt32* const gridScans = &m_gridScans[0][0];
+	const dInt32 cellCount = m_gridKeys.GetCount();
+	const ndGridHash rowHash0(x0, y, z);
+	const ndGridHash rowHash1(x1 + 1, y, z);
+	const dInt32 cell0 = LowerBound(gridKeys, cellCount, rowHash0.m_gridHash);
+	dInt32 cell1 = cell0;
+	while ((cell1 < cellCount) && (gridKeys[cell1] < rowHash1.m_gridHash))
 	{
-		dUnsigned64 key0 = m_hashGridMap[i].m_gridHash;
-		m_hashGridMap[uniqueCount].m_gridHash = m_hashGridMap[i].m_gridHash;
-		uniqueCount++;
-		for (i ++; (i < m_hashGridMap.GetCount()) && (key0 == m_hashGridMap[i].m_gridHash); i++);
+		cell1++;
 	}
+	start = gridScans[cell0];
+	count = gridScans[cell1] - start;
+}
 
-	dAssert(0);
-	//ndGridHash hashBox0(dVector::m_zero, 0, ndHomeGrid);
-	//ndGridHash hashBox1((boxP1 - boxP0) * invGridSize, 0, ndHomeGrid);
-	//
-	//dUnsigned64 cellCount = (hashBox1.m_z - hashBox0.m_z) * (hashBox1.m_y - hashBox0.m_y) * (hashBox1.m_x - hashBox0.m_x);
-	//
-	////if (cellCount <= 128)
-	//if (cellCount <= 256)
-	//{
-	//	dAssert((hashBox1.m_z - hashBox0.m_z) > 1);
-	//	dAssert((hashBox1.m_y - hashBox0.m_y) > 1);
-	//	dAssert((hashBox1.m_x - hashBox0.m_x) > 1);
-	//
-	//	const dInt32 x_ = 6;
-	//	const dInt32 y_ = 6;
-	//	const dInt32 z_ = 20;
-	//	dFloat32 xxx[z_][y_][x_];
-	//	memset(xxx, 0, sizeof(xxx));
-	//	for (dInt32 i = 0; i < uniqueCount; i++)
-	//	{
-	//		dInt32 x = m_hashGridMap[i].m_x;
-	//		dInt32 y = m_hashGridMap[i].m_y;
-	//		dInt32 z = m_hashGridMap[i].m_z;
-	//		xxx[z][y][x] = 1.0f;
-	//	}
-	//	
-	//	dInt32 gridCountX = dInt32(hashBox1.m_x - hashBox0.m_x) + 32;
-	//	dInt32 gridCountY = dInt32(hashBox1.m_y - hashBox0.m_y) + 32;
-	//	dInt32 gridCountZ = dInt32(hashBox1.m_z - hashBox0.m_z) + 32;
-	//	m_isoSurcase.Begin(boxP0, dFloat32(0.5f), gridSize, gridCountX, gridCountY, gridCountZ);
-	//	
-	//	dIsoSurface::dIsoCell cell;
-	//	for (dInt32 z = 0; z < z_-1; z++)
-	//	{
-	//		cell.m_z = z;
-	//		for (dInt32 y = 0; y < y_-1; y++)
-	//		{
-	//			cell.m_y = y;
-	//			for (dInt32 x = 0; x < x_-1; x++)
-	//			{
-	//				cell.m_x = x;
-	//				cell.m_isoValues[0][0][0] = xxx[z + 0][y + 0][x + 0];
-	//				cell.m_isoValues[0][0][1] = xxx[z + 0][y + 0][x + 1];
-	//				cell.m_isoValues[0][1][0] = xxx[z + 0][y + 1][x + 0];
-	//				cell.m_isoValues[0][1][1] = xxx[z + 0][y + 1][x + 1];
-	//				cell.m_isoValues[1][0][0] = xxx[z + 1][y + 0][x + 0];
-	//				cell.m_isoValues[1][0][1] = xxx[z + 1][y + 0][x + 1];
-	//				cell.m_isoValues[1][1][0] = xxx[z + 1][y + 1][x + 0];
-	//				cell.m_isoValues[1][1][1] = xxx[z + 1][y + 1][x + 1];
-	//				m_isoSurcase.ProcessCell(cell);
-	//			}
-	//		}
-	//	}
-	//	m_isoSurcase.End();
-	//}
-#endif
+bool ndBodySphFluid::RayCast(ndRayCastNotify& callback, const dFastRayTest& ray, const dFloat32 maxT) const
+{
+	if (!HasValidGrid())
+	{
+		return ndBodyParticleSet::RayCast(callback, ray, maxT);
+	}
+	if (!callback.OnRayPrecastAction(this, nullptr))
+	{
+		return false;
+	}
+
+	dFloat32 param = dMin(maxT, dFloat32(1.0f));
+	const dFloat32 enterParam = ray.BoxIntersect(m_box0, m_box1);
+	if (enterParam >= param)
+	{
+		return false;
+	}
+
+	// walk the cells the ray crosses in order (3d dda). the particles moved a 
+	// fraction of a cell since the grid was made and the grid is four radius 
+	// wide, so a particle hit inside a cell has its cell next to it, the cells 
+	// around each crossed cell are tested. the walk ends when the next cell 
+	// starts past the closest hit.
+	const dFloat32 gridSize = m_gridSize;
+	const dVector invGridSize(dFloat32(1.0f) / gridSize);
+	const dVector enterPoint(ray.m_p0 + ray.m_diff.Scale(enterParam));
+	const dVector cellsCount(((m_box1 - m_box0) * invGridSize).Floor());
+	const dVector enterCell(((enterPoint - m_box0) * invGridSize).Floor().GetMax(dVector::m_zero).GetMin(cellsCount));
+
+	dInt32 cell[3];
+	dInt32 cellStep[3];
+	dInt32 cellLimit[3];
+	dFloat32 nextParam[3];
+	dFloat32 deltaParam[3];
+	for (dInt32 i = 0; i < 3; i++)
+	{
+		cell[i] = dInt32(enterCell[i]);
+		cellLimit[i] = dInt32(cellsCount[i]);
+		const dFloat32 diff = ray.m_diff[i];
+		if (dAbs(diff) < dFloat32(1.0e-8f))
+		{
+			cellStep[i] = 0;
+			nextParam[i] = dFloat32(1.0e10f);
+			deltaParam[i] = dFloat32(0.0f);
+		}
+		else
+		{
+			cellStep[i] = (diff > dFloat32(0.0f)) ? 1 : -1;
+			const dFloat32 plane = m_box0[i] + dFloat32(cell[i] + ((diff > dFloat32(0.0f)) ? 1 : 0)) * gridSize;
+			nextParam[i] = (plane - ray.m_p0[i]) / diff;
+			deltaParam[i] = gridSize / dAbs(diff);
+		}
+	}
+
+	dInt32 particle = -1;
+	dFloat32 cellParam = enterParam;
+	while (cellParam < param)
+	{
+		for (dInt32 z = cell[2] - 1; z <= cell[2] + 1; z++)
+		{
+			for (dInt32 y = cell[1] - 1; y <= cell[1] + 1; y++)
+			{
+				if ((y >= 0) && (z >= 0))
+				{
+					dInt32 start;
+					dInt32 count;
+					GetCellSpan(dMax(cell[0] - 1, 0), cell[0] + 1, y, z, start, count);
+					if (count)
+					{
+						param = RayCastParticles(ray, start, count, param, particle);
+					}
+				}
+			}
+		}
+
+		const dInt32 axis = (nextParam[0] < nextParam[1]) ? ((nextParam[0] < nextParam[2]) ? 0 : 2) : ((nextParam[1] < nextParam[2]) ? 1 : 2);
+		cellParam = nextParam[axis];
+		nextParam[axis] += deltaParam[axis];
+		cell[axis] += cellStep[axis];
+		if ((cell[axis] < 0) || (cell[axis] > cellLimit[axis]))
+		{
+			break;
+		}
+	}
+
+	return (particle >= 0) ? ReportRayHit(callback, ray, param, particle) : false;
 }
 
+void ndBodySphFluid::ParticlesInAabb(const dVector& box0, const dVector& box1, dArray<dInt32>& particles) const
+{
+	if (!HasValidGrid())
+	{
+		ndBodyParticleSet::ParticlesInAabb(box0, box1, particles);
+		return;
+	}
+
+	// the rows of cells under the box grown by one cell for the motion 
+	// of the particles since the grid was made.
+	particles.SetCount(0);
+	const dVector invGridSize(dFloat32(1.0f) / m_gridSize);
+	const dVector cellsCount(((m_box1 - m_box0) * invGridSize).Floor());
+	const dVector cell0(((box0 - m_box0) * invGridSize).Floor() - dVector::m_one);
+	const dVector cell1(((box1 - m_box0) * invGridSize).Floor() + dVector::m_one);
+	if ((((cell1 < dVector::m_zero) | (cell0 > cellsCount)).GetSignMask() & 0x07))
+	{
+		return;
+	}
+
+	const dVector start(cell0.GetMax(dVector::m_zero).GetInt());
+	const dVector end(cell1.GetMin(cellsCount).GetInt());
+	for (dInt32 z = start.m_iz; z <= end.m_iz; z++)
+	{
+		for (dInt32 y = start.m_iy; y <= end.m_iy; y++)
+		{
+			dInt32 spanStart;
+			dInt32 spanCount;
+			GetCellSpan(start.m_ix, end.m_ix, y, z, spanStart, spanCount);
+			if (spanCount)
+			{
+				AddParticlesInAabb(box0, box1, spanStart, spanCount, particles);
+			}
+		}
+	}
+}
 
 void ndBodySphFluid::CalculateScansDebug(dArray<dInt32>& gridScans)
 {
@@ -540,8 +885,8 @@ void ndBodySphFluid::CalculateScans(const ndWorld* const world)
 				for (dInt32 threadIndex = 0; threadIndex < threadCount; threadIndex++)
 				{
 					m_scan[threadIndex] = acc0;
-					acc0 += stride;
-					while (acc0 < particleCount && (hashGridMap[acc0].m_gridHash == hashGridMap[acc0 - 1].m_gridHash))
+					acc0 = dMin(acc0 + stride, particleCount);
+					while ((acc0 > 0) && (acc0 < particleCount) && (hashGridMap[acc0].m_gridHash == hashGridMap[acc0 - 1].m_gridHash))
 					{
 						acc0++;
 					}
@@ -567,10 +912,14 @@ void ndBodySphFluid::CalculateScans(const ndWorld* const world)
 			const dInt32 start = context->m_scan[threadIndex];
 			const dInt32 strideCount = context->m_scan[threadIndex + 1] - start;
 			dArray<dInt32>& gridScans = fluid->m_gridScans[threadIndex];
-			dUnsigned64 gridHash0 = hashGridMap[start].m_gridHash;
+			gridScans.SetCount(0);
+			if (!strideCount)
+			{
+				return;
+			}
 
 			dInt32 count = 0;
-			gridScans.SetCount(0);
+			dUnsigned64 gridHash0 = hashGridMap[start].m_gridHash;
 			for (dInt32 i = 0; i < strideCount; i++)
 			{
 				dUnsigned64 gridHash = hashGridMap[start + i].m_gridHash;
@@ -617,6 +966,14 @@ void ndBodySphFluid::CalculateScans(const ndWorld* const world)
 	}
 	gridScans.PushBack(acc);
 
+	// the sorted key of each cell, used for finding the cells under a particle
+	const dInt32 cellCount = gridScans.GetCount() - 1;
+	m_gridKeys.SetCount(cellCount);
+	for (dInt32 i = 0; i < cellCount; i++)
+	{
+		m_gridKeys[i] = m_hashGridMap[gridScans[i]].m_gridHash;
+	}
+
 	#ifdef _DEBUG
 	CalculateScansDebug(m_gridScans[1]);
 	dAssert(m_gridScans[1].GetCount() == m_gridScans[0].GetCount());
@@ -627,80 +984,95 @@ void ndBodySphFluid::CalculateScans(const ndWorld* const world)
 	#endif
 }
 
-void ndBodySphFluid::CreateGrids(const ndWorld* const world)
+class ndBodySphFluid::ndGridContext
 {
-	D_TRACKTIME();
-	class ndCreateGrids : public ndScene::ndBaseJob
+	public:
+	ndGridContext(ndBodySphFluid* const fluid)
+		:m_fluid(fluid)
+		,m_movedCount(0)
+		,m_isCoherent(false)
 	{
-		public:
-		class ndContext
-		{
-			public:
-			ndContext(ndBodySphFluid* const fluid)
-				:m_fluid(fluid)
-				, m_lock()
-			{
-			}
-
-			ndBodySphFluid* m_fluid;
-			dSpinLock m_lock;
-		};
+		memset(m_shift, 0, sizeof(m_shift));
+		memset(m_movedScan, 0, sizeof(m_movedScan));
+		memset(m_upperDigits, 0, sizeof(m_upperDigits));
+	}
 
-		// size of the level one cache minus few values for local variables.
-		#define D_SCRATCH_BUFFER_SIZE		(1024 * 24 / sizeof (ndGridHash))
-		#define D_SCRATCH_BUFFER_SIZE_PADD	(32)
+	// a particle moved when its cell is not the cell of the last step, 
+	// the cells of the last step are shifted by the motion of the origin.
+	bool HasMoved(const ndGridHash& hash, const ndGridHash& cell) const
+	{
+		return 
+			(dInt32(cell.m_x) + m_shift[0] != dInt32(hash.m_x)) ||
+			(dInt32(cell.m_y) + m_shift[1] != dInt32(hash.m_y)) ||
+			(dInt32(cell.m_z) + m_shift[2] != dInt32(hash.m_z));
+	}
 
-		class ndHashCacheBuffer : public dFixSizeArray<ndGridHash, D_SCRATCH_BUFFER_SIZE + D_SCRATCH_BUFFER_SIZE_PADD>
+	// entries are ordered by cell and by particle index inside the cell, 
+	// this is the same order the stable radix sort makes.
+	static bool IsLess(const ndGridHash& hashA, const ndGridHash& hashB)
+	{
+		if (hashA.m_gridHash != hashB.m_gridHash)
 		{
-			public:
-			ndHashCacheBuffer()
-				:dFixSizeArray<ndGridHash, D_SCRATCH_BUFFER_SIZE + D_SCRATCH_BUFFER_SIZE_PADD>()
-				, m_size(0)
-			{
-				// check the local scratch buffer is smaller than level one cache
-				dAssert(GetCapacity() * sizeof(ndGridHash) < 32 * 1024);
-			}
-
-			void PushBack(const ndGridHash& element)
-			{
-				dInt32 index = m_size;
-				m_size++;
-				(*this)[index] = element;
-			}
-
-			void AddCell(dInt32 count, const ndGridHash& origin, const ndGridHash& cell, const ndGridHash* const neigborgh)
-			{
-				#ifdef _DEBUG 
-				dInt32 debugCheck = 0;
-				#endif
-
-				for (dInt32 j = 0; j < count; j++)
-				{
-					ndGridHash quadrand(cell);
-					quadrand.m_gridHash += neigborgh[j].m_gridHash;
-					quadrand.m_cellType = ndGridType(quadrand.m_gridHash == origin.m_gridHash);
-					dAssert(quadrand.m_cellType == ((quadrand.m_gridHash == origin.m_gridHash) ? ndHomeGrid : ndAdjacentGrid));
-
-					PushBack(quadrand);
-					#ifdef _DEBUG 
-					debugCheck += quadrand.m_cellType ? 1 : 0;
-					#endif
-				}
-				dAssert(debugCheck == 1);
-			}
+			return hashA.m_gridHash < hashB.m_gridHash;
+		}
+		return hashA.m_particleIndex < hashB.m_particleIndex;
+	}
 
-			dInt32 m_size;
-		};
+	ndBodySphFluid* m_fluid;
+	dInt32 m_shift[4];
+	dInt32 m_movedCount;
+	dInt32 m_movedScan[D_MAX_THREADS_COUNT + 1];
+	dInt32 m_upperDigits[D_MAX_THREADS_COUNT][4];
+	bool m_isCoherent;
+};
 
-		virtual void Execute()
-		{
-			D_TRACKTIME();
+void ndBodySphFluid::UpdateGrids(const ndWorld* const world, const dVector& boxP0, const dVector& boxP1)
+{
+	D_TRACKTIME();
+	// the origin is snapped to the grid, so a particle that stays 
+	// in the same cell gets the same cell hash as in the last step.
+	const dFloat32 gridSize = CalculateGridSize();
+	const dVector invGridSize(dFloat32(1.0f) / gridSize);
+	const dVector origin(((boxP0 * invGridSize).Floor() - dVector::m_one).Scale(gridSize));
 
-			dVector m_neighborkDirs[8];
+	ndGridContext context(this);
+	context.m_isCoherent = (gridSize == m_gridSize) && (m_hashGridMap.GetCount() == m_posit.GetCount());
+	if (context.m_isCoherent)
+	{
+		const dVector shift(((m_box0 - origin) * invGridSize + dVector::m_half).GetInt());
+		context.m_shift[0] = shift.m_ix;
+		context.m_shift[1] = shift.m_iy;
+		context.m_shift[2] = shift.m_iz;
+	}
 
-			ndBodySphFluid* const fluid = ((ndContext*)m_context)->m_fluid;
-			const dFloat32 radius = fluid->m_radius;
+	m_box0 = origin;
+	m_box1 = boxP1 + dVector(gridSize);
+	m_gridSize = gridSize;
 
+	CreateGrids(world, context);
+	if (context.m_isCoherent)
+	{
+		MergeGrids(world, context);
+	}
+	else
+	{
+		SortGrids(world);
+	}
+	m_movedCount = context.m_movedCount;
+	ReorderParticles(world);
+}
+
+void ndBodySphFluid::CreateGrids(const ndWorld* const world, ndGridContext& context)
+{
+	D_TRACKTIME();
+	class ndCountMovedParticles: public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndGridContext* const context = (ndGridContext*)m_context;
+			ndBodySphFluid* const fluid = context->m_fluid;
 			const dInt32 threadIndex = GetThreadId();
 			const dInt32 threadCount = m_owner->GetThreadCount();
 			const dInt32 particleCount = fluid->m_posit.GetCount();
@@ -709,170 +1081,263 @@ void ndBodySphFluid::CreateGrids(const ndWorld* const world)
 			const dInt32 start = threadIndex * step;
 			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : particleCount - start;
 
-			const dFloat32 gridSize = fluid->CalculateGridSize();
-
 			const dVector origin(fluid->m_box0);
-			const dVector invGridSize(dFloat32(1.0f) / gridSize);
+			const dVector invGridSize(dFloat32(1.0f) / fluid->m_gridSize);
 			const dVector* const posit = &fluid->m_posit[0];
+			const ndGridHash* const hashGridMap = &fluid->m_hashGridMap[0];
 
-			const dVector box0(-radius, -radius, -radius, dFloat32(0.0f));
-			const dVector box1(radius, radius, radius, dFloat32(0.0f));
-
-			ndGridHash stepsCode_xyz[8];
-			stepsCode_xyz[0] = ndGridHash(0, 0, 0);
-			stepsCode_xyz[1] = ndGridHash(1, 0, 0);
-			stepsCode_xyz[2] = ndGridHash(0, 1, 0);
-			stepsCode_xyz[3] = ndGridHash(1, 1, 0);
-			stepsCode_xyz[4] = ndGridHash(0, 0, 1);
-			stepsCode_xyz[5] = ndGridHash(1, 0, 1);
-			stepsCode_xyz[6] = ndGridHash(0, 1, 1);
-			stepsCode_xyz[7] = ndGridHash(1, 1, 1);
-
-			ndGridHash stepsCode_xy[4];
-			stepsCode_xy[0] = ndGridHash(0, 0, 0);
-			stepsCode_xy[1] = ndGridHash(1, 0, 0);
-			stepsCode_xy[2] = ndGridHash(0, 1, 0);
-			stepsCode_xy[3] = ndGridHash(1, 1, 0);
-
-			ndGridHash stepsCode_yz[4];
-			stepsCode_yz[0] = ndGridHash(0, 0, 0);
-			stepsCode_yz[1] = ndGridHash(0, 1, 0);
-			stepsCode_yz[2] = ndGridHash(0, 0, 1);
-			stepsCode_yz[3] = ndGridHash(0, 1, 1);
-
-			ndGridHash stepsCode_xz[4];
-			stepsCode_xz[0] = ndGridHash(0, 0, 0);
-			stepsCode_xz[1] = ndGridHash(1, 0, 0);
-			stepsCode_xz[2] = ndGridHash(0, 0, 1);
-			stepsCode_xz[3] = ndGridHash(1, 0, 1);
-
-			ndGridHash stepsCode_x[2];
-			stepsCode_x[0] = ndGridHash(0, 0, 0);
-			stepsCode_x[1] = ndGridHash(1, 0, 0);
-
-			ndGridHash stepsCode_y[2];
-			stepsCode_y[0] = ndGridHash(0, 0, 0);
-			stepsCode_y[1] = ndGridHash(0, 1, 0);
-
-			ndGridHash stepsCode_z[2];
-			stepsCode_z[0] = ndGridHash(0, 0, 0);
-			stepsCode_z[1] = ndGridHash(0, 0, 1);
-
-			ndHashCacheBuffer bufferOut;
+			dInt32 movedCount = 0;
 			for (dInt32 i = 0; i < count; i++)
 			{
-				dVector r(posit[start + i] - origin);
-				dVector p(r * invGridSize);
-				ndGridHash hashKey(p, i);
-
-				fluid->m_upperDigisIsValid[0] |= hashKey.m_xHigh;
-				fluid->m_upperDigisIsValid[1] |= hashKey.m_yHigh;
-				fluid->m_upperDigisIsValid[2] |= hashKey.m_zHigh;
-				dVector p0((r + box0) * invGridSize);
-				dVector p1((r + box1) * invGridSize);
-
-				ndGridHash box0Hash(p0, i);
-				ndGridHash box1Hash(p1, i);
-				ndGridHash codeHash(box1Hash.m_gridHash - box0Hash.m_gridHash);
-
-				dAssert(codeHash.m_x <= 1);
-				dAssert(codeHash.m_y <= 1);
-				dAssert(codeHash.m_z <= 1);
-				dUnsigned32 code = dUnsigned32(codeHash.m_z * 4 + codeHash.m_y * 2 + codeHash.m_x);
-
-				switch (code)
+				const dInt32 index = start + i;
+				const ndGridHash hash((posit[index] - origin) * invGridSize, index);
+				dAssert(hashGridMap[index].m_particleIndex == index);
+				movedCount += context->HasMoved(hash, hashGridMap[index]) ? 1 : 0;
+			}
+			context->m_movedScan[threadIndex] = movedCount;
+		}
+	};
+
+	class ndCreateGrids: public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndGridContext* const context = (ndGridContext*)m_context;
+			ndBodySphFluid* const fluid = context->m_fluid;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 particleCount = fluid->m_posit.GetCount();
+
+			const dInt32 step = particleCount / threadCount;
+			const dInt32 start = threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : particleCount - start;
+
+			const dVector origin(fluid->m_box0);
+			const dVector invGridSize(dFloat32(1.0f) / fluid->m_gridSize);
+			const dVector* const posit = &fluid->m_posit[0];
+			ndGridHash* const hashGridMap = &fluid->m_hashGridMap[0];
+			dInt32* const upperDigits = context->m_upperDigits[threadIndex];
+
+			if (context->m_isCoherent)
+			{
+				// the particles that did not move are still sorted, 
+				// they are separated from the few that changed cell.
+				dInt32 movedIndex = context->m_movedScan[threadIndex];
+				dInt32 stayedIndex = start - movedIndex;
+				ndGridHash* const stayedGridMap = &fluid->m_stayedGridMap[0];
+				ndGridHash* const movedGridMap = &fluid->m_hashGridMapScratchBuffer[0];
+				for (dInt32 i = 0; i < count; i++)
 				{
-					case 0:
+					const dInt32 index = start + i;
+					const ndGridHash hash((posit[index] - origin) * invGridSize, index);
+					if (context->HasMoved(hash, hashGridMap[index]))
 					{
-						box0Hash.m_cellType = ndHomeGrid;
-						bufferOut.PushBack(box0Hash);
-						break;
+						upperDigits[0] |= hash.m_xHigh;
+						upperDigits[1] |= hash.m_yHigh;
+						upperDigits[2] |= hash.m_zHigh;
+						movedGridMap[movedIndex] = hash;
+						movedIndex++;
 					}
-
-					case 1:
+					else
 					{
-						// this grid goes across all cell.
-						bufferOut.AddCell(2, hashKey, box0Hash, stepsCode_x);
-						break;
+						stayedGridMap[stayedIndex] = hash;
+						stayedIndex++;
 					}
+				}
+				dAssert(movedIndex == context->m_movedScan[threadIndex + 1]);
+			}
+			else
+			{
+				for (dInt32 i = 0; i < count; i++)
+				{
+					const dInt32 index = start + i;
+					const ndGridHash hash((posit[index] - origin) * invGridSize, index);
+					upperDigits[0] |= hash.m_xHigh;
+					upperDigits[1] |= hash.m_yHigh;
+					upperDigits[2] |= hash.m_zHigh;
+					hashGridMap[index] = hash;
+				}
+			}
+		}
+	};
 
-					case 2:
-					{
-						// this grid goes across all cell.
-						bufferOut.AddCell(2, hashKey, box0Hash, stepsCode_y);
-						break;
-					}
+	ndScene* const scene = world->GetScene();
+	const dInt32 particleCount = m_posit.GetCount();
+	if (context.m_isCoherent)
+	{
+		scene->SubmitJobs<ndCountMovedParticles>(&context);
 
-					case 4:
-					{
-						// this grid goes across all cell.
-						bufferOut.AddCell(2, hashKey, box0Hash, stepsCode_z);
-						break;
-					}
+		dInt32 acc = 0;
+		const dInt32 threadCount = scene->GetThreadCount();
+		for (dInt32 i = 0; i <= threadCount; i++)
+		{
+			const dInt32 movedCount = context.m_movedScan[i];
+			context.m_movedScan[i] = acc;
+			acc += movedCount;
+		}
+		context.m_movedCount = acc;
+		context.m_isCoherent = (acc * D_GRID_REBUILD_FACTOR) <= particleCount;
+	}
+	else
+	{
+		context.m_movedCount = particleCount;
+	}
 
+	if (context.m_isCoherent)
+	{
+		m_stayedGridMap.SetCount(particleCount);
+		m_hashGridMapScratchBuffer.SetCount(particleCount);
+	}
+	else
+	{
+		m_hashGridMap.SetCount(particleCount);
+	}
+	scene->SubmitJobs<ndCreateGrids>(&context);
 
-					case 3:
-					{
-						// this grid goes across all cell.
-						bufferOut.AddCell(4, hashKey, box0Hash, stepsCode_xy);
-						break;
-					}
+	const dInt32 threadCount = scene->GetThreadCount();
+	memset(m_upperDigisIsValid, 0, sizeof(m_upperDigisIsValid));
+	for (dInt32 i = 0; i < threadCount; i++)
+	{
+		m_upperDigisIsValid[0] |= context.m_upperDigits[i][0];
+		m_upperDigisIsValid[1] |= context.m_upperDigits[i][1];
+		m_upperDigisIsValid[2] |= context.m_upperDigits[i][2];
+	}
+}
 
-					case 5:
-					{
-						// this grid goes across all cell.
-						bufferOut.AddCell(4, hashKey, box0Hash, stepsCode_xz);
-						break;
-					}
+void ndBodySphFluid::MergeGrids(const ndWorld* const world, ndGridContext& context)
+{
+	D_TRACKTIME();
+	class ndMergeGrids: public ndScene::ndBaseJob
+	{
+		public:
+		// number of stayed entries in the first diagonal entries of the merged array
+		dInt32 FindSplit(const ndGridHash* const stayed, dInt32 stayedCount, const ndGridHash* const moved, dInt32 movedCount, dInt32 diagonal) const
+		{
+			dInt32 i0 = dMax(diagonal - movedCount, 0);
+			dInt32 i1 = dMin(diagonal, stayedCount);
+			while (i0 < i1)
+			{
+				const dInt32 mid = (i0 + i1) >> 1;
+				if (ndGridContext::IsLess(stayed[mid], moved[diagonal - mid - 1]))
+				{
+					i0 = mid + 1;
+				}
+				else
+				{
+					i1 = mid;
+				}
+			}
+			return i0;
+		}
 
-					case 6:
-					{
-						// this grid goes across all cell.
-						bufferOut.AddCell(4, hashKey, box0Hash, stepsCode_yz);
-						break;
-					}
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndGridContext* const context = (ndGridContext*)m_context;
+			ndBodySphFluid* const fluid = context->m_fluid;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 particleCount = fluid->m_posit.GetCount();
 
-					case 7:
-					{
-						// this grid goes across all cell.
-						bufferOut.AddCell(8, hashKey, box0Hash, stepsCode_xyz);
-						break;
-					}
+			const dInt32 step = particleCount / threadCount;
+			const dInt32 start = threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : particleCount - start;
 
-					default:
-						dAssert(0);
-				}
+			const dInt32 movedCount = context->m_movedCount;
+			const dInt32 stayedCount = particleCount - movedCount;
+			const ndGridHash* const stayed = &fluid->m_stayedGridMap[0];
+			const ndGridHash* const moved = movedCount ? &fluid->m_hashGridMap[0] : nullptr;
+			ndGridHash* const hashGridMap = &fluid->m_hashGridMapScratchBuffer[0];
 
-				if (bufferOut.m_size > dInt32 (D_SCRATCH_BUFFER_SIZE))
+			// each thread merges the entries that land in its part of the array
+			dInt32 i = FindSplit(stayed, stayedCount, moved, movedCount, start);
+			dInt32 j = start - i;
+			for (dInt32 k = 0; k < count; k++)
+			{
+				if ((j >= movedCount) || ((i < stayedCount) && ndGridContext::IsLess(stayed[i], moved[j])))
 				{
-					D_TRACKTIME();
-					dScopeSpinLock criticalLock(((ndContext*)m_context)->m_lock);
-					dInt32 dstIndex = fluid->m_hashGridMap.GetCount();
-					fluid->m_hashGridMap.SetCount(dstIndex + bufferOut.m_size);
-					memcpy(&fluid->m_hashGridMap[dstIndex], &bufferOut[0], bufferOut.m_size * sizeof(ndGridHash));
-					bufferOut.m_size = 0;
+					hashGridMap[start + k] = stayed[i];
+					i++;
+				}
+				else
+				{
+					hashGridMap[start + k] = moved[j];
+					j++;
 				}
 			}
+		}
+	};
+
+	// the moved particles are radix sorted by their new cells, 
+	// the sort is stable so they stay in particle order inside a cell.
+	m_hashGridMap.Swap(m_hashGridMapScratchBuffer);
+	m_hashGridMap.SetCount(context.m_movedCount);
+	if (context.m_movedCount)
+	{
+		SortGrids(world);
+	}
+
+	ndScene* const scene = world->GetScene();
+	m_hashGridMapScratchBuffer.SetCount(m_posit.GetCount());
+	scene->SubmitJobs<ndMergeGrids>(&context);
+	m_hashGridMap.Swap(m_hashGridMapScratchBuffer);
+
+	#ifdef _DEBUG
+	for (dInt32 i = 0; i < (m_hashGridMap.GetCount() - 1); i++)
+	{
+		dAssert(ndGridContext::IsLess(m_hashGridMap[i], m_hashGridMap[i + 1]));
+	}
+	#endif
+}
+
+void ndBodySphFluid::ReorderParticles(const ndWorld* const world)
+{
+	D_TRACKTIME();
+	class ndReorderParticles: public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndBodySphFluid* const fluid = (ndBodySphFluid*)m_context;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 particleCount = fluid->m_posit.GetCount();
+
+			const dInt32 step = particleCount / threadCount;
+			const dInt32 start = threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : particleCount - start;
 
-			if (bufferOut.m_size)
+			const dVector* const posit = &fluid->m_posit[0];
+			const dVector* const veloc = &fluid->m_velocity[0];
+			dVector* const sortedPosit = &fluid->m_accel[0];
+			dVector* const sortedVeloc = &fluid->m_reorderBuffer[0];
+			const dInt32* const ids = &fluid->m_particleId[0];
+			dInt32* const sortedIds = &fluid->m_reorderIdBuffer[0];
+			ndGridHash* const hashGridMap = &fluid->m_hashGridMap[0];
+			for (dInt32 i = 0; i < count; i++)
 			{
-				D_TRACKTIME();
-				dScopeSpinLock criticalLock(((ndContext*)m_context)->m_lock);
-				dInt32 dstIndex = fluid->m_hashGridMap.GetCount();
-				fluid->m_hashGridMap.SetCount(dstIndex + bufferOut.m_size);
-				memcpy(&fluid->m_hashGridMap[dstIndex], &bufferOut[0], bufferOut.m_size * sizeof(ndGridHash));
+				const dInt32 index = start + i;
+				ndGridHash& entry = hashGridMap[index];
+				sortedPosit[index] = posit[entry.m_particleIndex];
+				sortedVeloc[index] = veloc[entry.m_particleIndex];
+				sortedIds[index] = ids[entry.m_particleIndex];
+				entry.m_particleIndex = index;
 			}
 		}
 	};
 
+	// particles in the same cell are next to each other in memory, 
+	// the accelerations are calculated later so the array is used as scratch.
 	ndScene* const scene = world->GetScene();
-	m_upperDigisIsValid[0] = 0;
-	m_upperDigisIsValid[1] = 0;
-	m_upperDigisIsValid[2] = 0;
-
-	ndCreateGrids::ndContext context(this);
-	m_hashGridMap.SetCount(0);
-	scene->SubmitJobs<ndCreateGrids>(&context);
+	m_reorderBuffer.SetCount(m_posit.GetCount());
+	m_reorderIdBuffer.SetCount(m_posit.GetCount());
+	scene->SubmitJobs<ndReorderParticles>(this);
+	m_posit.Swap(m_accel);
+	m_velocity.Swap(m_reorderBuffer);
+	m_particleId.Swap(m_reorderIdBuffer);
 }
 
 void ndBodySphFluid::SortGrids(const ndWorld* const world)
@@ -881,7 +1346,6 @@ void ndBodySphFluid::SortGrids(const ndWorld* const world)
 	const dInt32 threadCount = world->GetThreadCount();
 	m_hashGridMapScratchBuffer.SetCount(m_hashGridMap.GetCount());
 
-	SortByCenterType();
 	if (threadCount <= 1)
 	{
 		dAssert(threadCount == 1);
@@ -904,178 +1368,627 @@ void ndBodySphFluid::SortGrids(const ndWorld* const world)
 	#endif
 }
 
-void ndBodySphFluid::BuildPairs(const ndWorld* const world)
+dFloat32 ndBodySphFluid::CalculateRestDensity() const
 {
-	D_TRACKTIME();
-	class ndBodySphFluidCreatePair : public ndScene::ndBaseJob
-	{
-		public:
-		class ndContext
-		{
-			public:
-			ndContext(ndBodySphFluid* const fluid)
-				:m_fluid(fluid)
-				, m_lock()
-			{
-			}
-
-			ndBodySphFluid* m_fluid;
-			dSpinLock m_lock;
-		};
-
-		#define D_SCRATCH_PAIR_BUFFER_SIZE		(1024 * 24 / sizeof (ndParticlePair))
-		#define D_SCRATCH_PAIR_BUFFER_SIZE_PADD (256)
+	// density of a particle inside a cubic lattice of particles one radius apart
+	const dFloat32 h = dFloat32(2.0f) * m_radius;
+	const dFloat32 h2 = h * h;
+	const dFloat32 poly6 = dFloat32(315.0f) / (dFloat32(64.0f) * dPi * h2 * h2 * h2 * h2 * h);
 
-		class ndParticlePairCacheBuffer : public dFixSizeArray<ndParticlePair, D_SCRATCH_PAIR_BUFFER_SIZE + D_SCRATCH_PAIR_BUFFER_SIZE_PADD>
+	dFloat32 weight = dFloat32(0.0f);
+	for (dInt32 z = -2; z <= 2; z++)
+	{
+		for (dInt32 y = -2; y <= 2; y++)
 		{
-			public:
-			ndParticlePairCacheBuffer()
-				:dFixSizeArray<ndParticlePair, D_SCRATCH_PAIR_BUFFER_SIZE + D_SCRATCH_PAIR_BUFFER_SIZE_PADD>()
-				, m_size(0)
-			{
-				// check the local scratch buffer is smaller than level one cache
-				dAssert(GetCapacity() * sizeof(ndParticlePair) < 32 * 1024);
-			}
-
-			void PushBack(dInt32 m0, dInt32 m1)
+			for (dInt32 x = -2; x <= 2; x++)
 			{
-				dAssert(0);
-				dInt32 index = m_size;
-				m_size++;
-				dAssert(m_size < GetCapacity());
-				ndParticlePair& pair = (*this)[index];
-				pair.m_m0 = m0;
-				pair.m_m1 = m1;
+				const dFloat32 dist2 = dFloat32(x * x + y * y + z * z) * m_radius * m_radius;
+				if (dist2 < h2)
+				{
+					const dFloat32 w = h2 - dist2;
+					weight += w * w * w;
+				}
 			}
-			dInt32 m_size;
-		};
+		}
+	}
+	return m_mass * poly6 * weight;
+}
 
+void ndBodySphFluid::BuildNeighbors(const ndWorld* const world)
+{
+	D_TRACKTIME();
+	class ndBuildNeighbors: public ndScene::ndBaseJob
+	{
+		public:
 		virtual void Execute()
 		{
 			D_TRACKTIME();
-			ndWorld* const world = m_owner->GetWorld();
-			ndBodySphFluid* const fluid = ((ndContext*)m_context)->m_fluid;
-			const dInt32 threadId = GetThreadId();
-			const dInt32 threadCount = world->GetThreadCount();
-			
-			const dArray<dInt32>& gridCounts = fluid->m_gridScans[0];
-			const dInt32 count = gridCounts.GetCount() - 1;
-			const dInt32 size = count / threadCount;
-			const dInt32 start = threadId * size;
-			const dInt32 batchSize = (threadId == threadCount - 1) ? count - start : size;
-			const ndGridHash* const srcArray = &fluid->m_hashGridMap[0];
+			ndBodySphFluid* const fluid = (ndBodySphFluid*)m_context;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 particleCount = fluid->m_posit.GetCount();
 
-			//const dVector* const positions = &fluid->m_posit[0];
-			//const dFloat32 diameter = dFloat32(2.0f) * fluid->m_radius;
-			//const dFloat32 diameter2 = diameter * diameter;
-			
-			ndParticlePairCacheBuffer buffer;
-			for (dInt32 i = 0; i < batchSize; i++)
+			const dInt32 step = particleCount / threadCount;
+			const dInt32 start = threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : particleCount - start;
+
+			const dFloat32 diameter = dFloat32(2.0f) * fluid->m_radius;
+			const dVector diameter2(diameter * diameter);
+
+			const dVector origin(fluid->m_box0);
+			const dVector invGridSize(dFloat32(1.0f) / fluid->m_gridSize);
+			const dVector box0(-diameter, -diameter, -diameter, dFloat32(0.0f));
+			const dVector box1(diameter, diameter, diameter, dFloat32(0.0f));
+
+			const dVector* const posit = &fluid->m_posit[0];
+			const ndGridHash* const hashGridMap = &fluid->m_hashGridMap[0];
+			const dInt32* const gridScans = &fluid->m_gridScans[0][0];
+			const dUnsigned64* const gridKeys = &fluid->m_gridKeys[0];
+			const dInt32 cellCount = fluid->m_gridKeys.GetCount();
+			ndNeighborList* const neighborLists = &fluid->m_neighborLists[0];
+
+			// the grid is twice the particle diameter, so the neighbors of a particle are 
+			// in the home cell or in the cells next to it. since the particles are sorted 
+			// by cell, the cells x - 1 to x + 1 of a row are a contiguous span of particles, 
+			// for the nine rows around the home cell the bounds of the four cells are saved.
+			dInt32 rowBounds[3][3][4];
+			dUnsigned64 homeKey = dUnsigned64(-1);
+
+			dArray<dInt32>& neighbors = fluid->m_neighbors[threadIndex];
+			neighbors.SetCount(0);
+			for (dInt32 i = 0; i < count; i++)
 			{
-				const dInt32 cellStart = gridCounts[i + start];
-				const dInt32 cellCount = gridCounts[i + start + 1] - cellStart;
-			
-				const ndGridHash* const ptr = &srcArray[cellStart];
-				for (dInt32 j = cellCount - 1; j > 0; j--)
+				const dInt32 index = start + i;
+				const ndGridHash& home = hashGridMap[index];
+				dAssert(home.m_particleIndex == index);
+				if (home.m_gridHash != homeKey)
 				{
-					const ndGridHash& cell0 = ptr[j];
-					if (cell0.m_cellType == ndHomeGrid)
+					homeKey = home.m_gridHash;
+					for (dInt32 z = 0; z < 3; z++)
 					{
-						const dInt32 m0 = cell0.m_particleIndex;
-						//const dVector& posit0 = positions[m0];
-			
-						for (dInt32 k = j - 1; k >= 0; k--)
+						for (dInt32 y = 0; y < 3; y++)
 						{
-							const ndGridHash& cell1 = ptr[k];
-							const dInt32 m1 = cell1.m_particleIndex;
-							bool test = (cell1.m_cellType == ndHomeGrid);
-							dAssert(0);
-							//const dVector& posit1 = positions[m1];
-							//const dVector dist(posit1 - posit0);
-							//dFloat32 dist2 = dist.DotProduct(dist).GetScalar();
-							//test = test | (cell0.m_particleIndex <= cell1.m_gridHash);
-							//test = test & (dist2 <= diameter2);
-							if (test)
+							const ndGridHash rowHash(dInt32(home.m_x) - 1, dInt32(home.m_y) + y - 1, dInt32(home.m_z) + z - 1);
+							dInt32 cell = LowerBound(gridKeys, cellCount, rowHash.m_gridHash);
+							for (dInt32 x = 0; x < 4; x++)
 							{
-								buffer.PushBack(m0, m1);
+								const dUnsigned64 key = rowHash.m_gridHash + x;
+								while ((cell < cellCount) && (gridKeys[cell] < key))
+								{
+									cell++;
+								}
+								rowBounds[z][y][x] = gridScans[cell];
 							}
 						}
 					}
 				}
-			
-				if (buffer.m_size > dInt32 (D_SCRATCH_PAIR_BUFFER_SIZE))
+
+				const dVector r(posit[index] - origin);
+				const ndGridHash box0Hash((r + box0) * invGridSize, index);
+				const ndGridHash box1Hash((r + box1) * invGridSize, index);
+				dAssert((dInt32(home.m_x) - dInt32(box0Hash.m_x)) <= 1);
+				dAssert((dInt32(box1Hash.m_x) - dInt32(home.m_x)) <= 1);
+				const dInt32 boundX0 = dInt32(box0Hash.m_x) - dInt32(home.m_x) + 1;
+				const dInt32 boundX1 = dInt32(box1Hash.m_x) - dInt32(home.m_x) + 2;
+
+				const dVector px(posit[index].BroadcastX());
+				const dVector py(posit[index].BroadcastY());
+				const dVector pz(posit[index].BroadcastZ());
+
+				ndNeighborList& list = neighborLists[index];
+				list.m_start = neighbors.GetCount();
+				for (dInt32 z = dInt32(box0Hash.m_z); z <= dInt32(box1Hash.m_z); z++)
 				{
-					dScopeSpinLock criticalLock(((ndContext*)m_context)->m_lock);
-					dInt32 dstIndex = fluid->m_particlesPairs.GetCount();
-					fluid->m_particlesPairs.SetCount(dstIndex + buffer.m_size);
-					memcpy(&fluid->m_particlesPairs[dstIndex], &buffer[0], buffer.m_size * sizeof(ndParticlePair));
-					buffer.m_size = 0;
+					for (dInt32 y = dInt32(box0Hash.m_y); y <= dInt32(box1Hash.m_y); y++)
+					{
+						const dInt32* const bounds = rowBounds[z - dInt32(home.m_z) + 1][y - dInt32(home.m_y) + 1];
+						const dInt32 spanStart = bounds[boundX0];
+						const dInt32 spanCount = bounds[boundX1] - spanStart;
+						for (dInt32 j = 0; j < spanCount; j += 4)
+						{
+							dInt32 m[4];
+							for (dInt32 k = 0; k < 4; k++)
+							{
+								m[k] = ((j + k) < spanCount) ? spanStart + j + k : index;
+							}
+
+							dVector x0;
+							dVector y0;
+							dVector z0;
+							dVector w0;
+							dVector::Transpose4x4(x0, y0, z0, w0, posit[m[0]], posit[m[1]], posit[m[2]], posit[m[3]]);
+							const dVector dx(x0 - px);
+							const dVector dy(y0 - py);
+							const dVector dz(z0 - pz);
+							const dVector dist2(dx * dx + dy * dy + dz * dz);
+							const dInt32 mask = (dist2 < diameter2).GetSignMask();
+							if (mask)
+							{
+								for (dInt32 k = 0; k < 4; k++)
+								{
+									if ((mask & (1 << k)) && (m[k] != index))
+									{
+										neighbors.PushBack(m[k]);
+									}
+								}
+							}
+						}
+					}
 				}
+				list.m_count = neighbors.GetCount() - list.m_start;
 			}
-			
-			if (buffer.m_size)
+		}
+	};
+
+	CalculateScans(world);
+	ndScene* const scene = world->GetScene();
+	scene->SubmitJobs<ndBuildNeighbors>(this);
+}
+
+void ndBodySphFluid::CalculateDensities(const ndWorld* const world)
+{
+	D_TRACKTIME();
+	class ndCalculateDensities: public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndBodySphFluid* const fluid = (ndBodySphFluid*)m_context;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 particleCount = fluid->m_posit.GetCount();
+
+			// same partition as the neighbors, so the lists are in this thread buffer
+			const dInt32 step = particleCount / threadCount;
+			const dInt32 start = threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : particleCount - start;
+
+			const dFloat32 h = dFloat32(2.0f) * fluid->m_radius;
+			const dFloat32 h2 = h * h;
+			const dVector h2Vector(h2);
+			const dFloat32 poly6 = dFloat32(315.0f) / (dFloat32(64.0f) * dPi * h2 * h2 * h2 * h2 * h);
+			const dFloat32 densityScale = fluid->m_mass * poly6;
+			const dFloat32 selfWeight = h2 * h2 * h2;
+			const dFloat32 stiffness = fluid->m_stiffness;
+			const dFloat32 restDensity = (fluid->m_restDensity > dFloat32(0.0f)) ? fluid->m_restDensity : fluid->CalculateRestDensity();
+
+			const dVector* const posit = &fluid->m_posit[0];
+			const ndNeighborList* const neighborLists = &fluid->m_neighborLists[0];
+			const dArray<dInt32>& neighborsBuffer = fluid->m_neighbors[threadIndex];
+			dFloat32* const density = &fluid->m_density[0];
+			dFloat32* const pressure = &fluid->m_pressure[0];
+
+			for (dInt32 i = 0; i < count; i++)
 			{
-				D_TRACKTIME();
-				dScopeSpinLock criticalLock(((ndContext*)m_context)->m_lock);
-				dInt32 dstIndex = fluid->m_particlesPairs.GetCount();
-				fluid->m_particlesPairs.SetCount(dstIndex + buffer.m_size);
-				memcpy(&fluid->m_particlesPairs[dstIndex], &buffer[0], buffer.m_size * sizeof(ndParticlePair));
+				const dInt32 index = start + i;
+				const ndNeighborList& list = neighborLists[index];
+
+				dVector weight(dVector::m_zero);
+				if (list.m_count)
+				{
+					const dVector px(posit[index].BroadcastX());
+					const dVector py(posit[index].BroadcastY());
+					const dVector pz(posit[index].BroadcastZ());
+					const dInt32* const neighbors = &neighborsBuffer[list.m_start];
+					for (dInt32 j = 0; j < list.m_count; j += 4)
+					{
+						dInt32 m[4];
+						const dVector mask(GatherNeighbors(neighbors, j, list.m_count, m));
+
+						dVector x0;
+						dVector y0;
+						dVector z0;
+						dVector w0;
+						dVector::Transpose4x4(x0, y0, z0, w0, posit[m[0]], posit[m[1]], posit[m[2]], posit[m[3]]);
+						const dVector dx(x0 - px);
+						const dVector dy(y0 - py);
+						const dVector dz(z0 - pz);
+						const dVector dist2(dx * dx + dy * dy + dz * dz);
+						const dVector w((h2Vector - dist2).GetMax(dVector::m_zero));
+						weight += (w * w * w) & mask;
+					}
+				}
+
+				// no negative pressure, a fluid with tension clumps in small groups
+				const dFloat32 particleDensity = densityScale * (selfWeight + weight.AddHorizontal().GetScalar());
+				density[index] = particleDensity;
+				pressure[index] = dMax(stiffness * (particleDensity - restDensity), dFloat32(0.0f));
 			}
 		}
 	};
 
-	CalculateScans(world);
 	ndScene* const scene = world->GetScene();
-	m_particlesPairs.SetCount(0);
-	ndBodySphFluidCreatePair::ndContext context(this);
-	scene->SubmitJobs<ndBodySphFluidCreatePair>(&context);
+	scene->SubmitJobs<ndCalculateDensities>(this);
 }
 
 void ndBodySphFluid::CalculateAccelerations(const ndWorld* const world)
 {
 	D_TRACKTIME();
+	class ndCalculateAccelerations: public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndBodySphFluid* const fluid = (ndBodySphFluid*)m_context;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 particleCount = fluid->m_posit.GetCount();
+
+			const dInt32 step = particleCount / threadCount;
+			const dInt32 start = threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : particleCount - start;
+
+			// spiky kernel gradient for the pressure and viscosity kernel laplacian,
+			// the viscosity is kinematic so it does not depend on the particle mass.
+			const dFloat32 h = dFloat32(2.0f) * fluid->m_radius;
+			const dFloat32 h6 = h * h * h * h * h * h;
+			const dVector hVector(h);
+			const dFloat32 kernelScale = dFloat32(45.0f) / (dPi * h6);
+			const dVector pressureScale(dFloat32(0.5f) * fluid->m_mass * kernelScale);
+			const dVector viscosityScale(fluid->m_viscosity * fluid->m_mass * kernelScale);
+
+			ndBodyNotify* const notify = fluid->GetNotifyCallback();
+			const dVector gravity(notify ? notify->GetGravity() & dVector::m_triplexMask : dVector::m_zero);
+
+			const dVector* const posit = &fluid->m_posit[0];
+			const dVector* const veloc = &fluid->m_velocity[0];
+			const dFloat32* const density = &fluid->m_density[0];
+			const dFloat32* const pressure = &fluid->m_pressure[0];
+			const ndNeighborList* const neighborLists = &fluid->m_neighborLists[0];
+			const dArray<dInt32>& neighborsBuffer = fluid->m_neighbors[threadIndex];
+			dVector* const accel = &fluid->m_accel[0];
+
+			for (dInt32 i = 0; i < count; i++)
+			{
+				const dInt32 index = start + i;
+				const ndNeighborList& list = neighborLists[index];
+
+				dVector fx(dVector::m_zero);
+				dVector fy(dVector::m_zero);
+				dVector fz(dVector::m_zero);
+				if (list.m_count)
+				{
+					const dVector px(posit[index].BroadcastX());
+					const dVector py(posit[index].BroadcastY());
+					const dVector pz(posit[index].BroadcastZ());
+					const dVector vx(veloc[index].BroadcastX());
+					const dVector vy(veloc[index].BroadcastY());
+					const dVector vz(veloc[index].BroadcastZ());
+					const dVector p0(pressure[index]);
+
+					const dInt32* const neighbors = &neighborsBuffer[list.m_start];
+					for (dInt32 j = 0; j < list.m_count; j += 4)
+					{
+						dInt32 m[4];
+						const dVector mask(GatherNeighbors(neighbors, j, list.m_count, m));
+
+						dVector x1;
+						dVector y1;
+						dVector z1;
+						dVector w1;
+						dVector::Transpose4x4(x1, y1, z1, w1, posit[m[0]], posit[m[1]], posit[m[2]], posit[m[3]]);
+
+						dVector vx1;
+						dVector vy1;
+						dVector vz1;
+						dVector vw1;
+						dVector::Transpose4x4(vx1, vy1, vz1, vw1, veloc[m[0]], veloc[m[1]], veloc[m[2]], veloc[m[3]]);
+
+						const dVector p1(pressure[m[0]], pressure[m[1]], pressure[m[2]], pressure[m[3]]);
+						const dVector invDensity1(dVector(density[m[0]], density[m[1]], density[m[2]], density[m[3]]).Reciproc());
+
+						const dVector dx(px - x1);
+						const dVector dy(py - y1);
+						const dVector dz(pz - z1);
+						const dVector dist(dVector(dx * dx + dy * dy + dz * dz).Sqrt().GetMax(dVector::m_epsilon));
+						const dVector invDist(dist.Reciproc());
+						const dVector hr((hVector - dist).GetMax(dVector::m_zero));
+
+						const dVector pressureForce(pressureScale * (p0 + p1) * invDensity1 * hr * hr * invDist);
+						const dVector viscosityForce(viscosityScale * invDensity1 * hr);
+						fx += (dx * pressureForce + (vx1 - vx) * viscosityForce) & mask;
+						fy += (dy * pressureForce + (vy1 - vy) * viscosityForce) & mask;
+						fz += (dz * pressureForce + (vz1 - vz) * viscosityForce) & mask;
+					}
+				}
+
+				const dVector force(fx.AddHorizontal().GetScalar(), fy.AddHorizontal().GetScalar(), fz.AddHorizontal().GetScalar(), dFloat32(0.0f));
+				accel[index] = force.Scale(dFloat32(1.0f) / density[index]) + gravity;
+			}
+		}
+	};
+
+	ndScene* const scene = world->GetScene();
+	scene->SubmitJobs<ndCalculateAccelerations>(this);
+}
+
+void ndBodySphFluid::IntegrateParticles(const ndWorld* const world, dFloat32 timestep)
+{
+	D_TRACKTIME();
+	dAssert(dAbs(world->GetScene()->GetTimestep() - timestep) < dFloat32(1.0e-5f));
+
+	// symplectic euler, velocities first, then the positions are moved 
+	// along the new velocities and stopped by the rigid bodies they hit
+	dVector sweptBox0;
+	dVector sweptBox1;
+	IntegrateVelocities(world, sweptBox0, sweptBox1);
+	FindBoundaryBodies(world, sweptBox0, sweptBox1);
+	if (m_boundaryBodies.GetCount())
+	{
+		CollideBoundaryBodies(world);
+		ApplyBoundaryForces(world);
+	}
+	else
+	{
+		IntegratePositions(world);
+	}
+}
 
-	class ndCalculateDensity: public ndScene::ndBaseJob
+void ndBodySphFluid::IntegrateVelocities(const ndWorld* const world, dVector& sweptBox0, dVector& sweptBox1)
+{
+	D_TRACKTIME();
+	class ndIntegrateVelocities: public ndScene::ndBaseJob
 	{
 		public:
 		class ndContext
 		{
 			public:
-			ndContext(ndBodySphFluid* const fluid)
-				:m_fluid(fluid)
+			ndBodySphFluid* m_fluid;
+			dVector m_box0[D_MAX_THREADS_COUNT];
+			dVector m_box1[D_MAX_THREADS_COUNT];
+		};
+
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndContext* const context = (ndContext*)m_context;
+			ndBodySphFluid* const fluid = context->m_fluid;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 particleCount = fluid->m_posit.GetCount();
+
+			const dInt32 step = particleCount / threadCount;
+			const dInt32 start = threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : particleCount - start;
+
+			dVector box0(dFloat32(1.0e20f));
+			dVector box1(dFloat32(-1.0e20f));
+			const dVector timestep(m_timestep);
+			const dVector* const posit = &fluid->m_posit[start];
+			dVector* const veloc = &fluid->m_velocity[start];
+			const dVector* const accel = &fluid->m_accel[start];
+			for (dInt32 i = 0; i < count; i++)
 			{
+				const dVector velocity(veloc[i] + accel[i] * timestep);
+				const dVector target(posit[i] + velocity * timestep);
+				veloc[i] = velocity;
+				box0 = box0.GetMin(posit[i].GetMin(target));
+				box1 = box1.GetMax(posit[i].GetMax(target));
 			}
+			context->m_box0[threadIndex] = box0;
+			context->m_box1[threadIndex] = box1;
+		}
+	};
 
-			ndBodySphFluid* m_fluid;
-		};
+	ndScene* const scene = world->GetScene();
+	ndIntegrateVelocities::ndContext context;
+	context.m_fluid = this;
+	scene->SubmitJobs<ndIntegrateVelocities>(&context);
 
+	const dVector radius(m_radius);
+	sweptBox0 = context.m_box0[0];
+	sweptBox1 = context.m_box1[0];
+	for (dInt32 i = 1; i < scene->GetThreadCount(); i++)
+	{
+		sweptBox0 = sweptBox0.GetMin(context.m_box0[i]);
+		sweptBox1 = sweptBox1.GetMax(context.m_box1[i]);
+	}
+	sweptBox0 = (sweptBox0 - radius) & dVector::m_triplexMask;
+	sweptBox1 = (sweptBox1 + radius) & dVector::m_triplexMask;
+}
 
+void ndBodySphFluid::IntegratePositions(const ndWorld* const world)
+{
+	D_TRACKTIME();
+	class ndIntegratePositions: public ndScene::ndBaseJob
+	{
+		public:
 		virtual void Execute()
 		{
 			D_TRACKTIME();
-			ndWorld* const world = m_owner->GetWorld();
-			ndBodySphFluid* const fluid = ((ndContext*)m_context)->m_fluid;
-			const dInt32 threadId = GetThreadId();
-			const dInt32 threadCount = world->GetThreadCount();
-			
+			ndBodySphFluid* const fluid = (ndBodySphFluid*)m_context;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 particleCount = fluid->m_posit.GetCount();
 
-			dArray<ndParticlePair>& particlesPairs = fluid->m_particlesPairs;
-			const dInt32 count = particlesPairs.GetCount();
-			const dInt32 stride = count / threadCount;
-			const dInt32 start = threadId * stride;
-			const dInt32 batchStride = (threadId == threadCount - 1) ? count - start : stride;
+			const dInt32 step = particleCount / threadCount;
+			const dInt32 start = threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : particleCount - start;
 
-			for (dInt32 i = 0; i < batchStride; i++)
+			const dVector timestep(m_timestep);
+			dVector* const posit = &fluid->m_posit[start];
+			const dVector* const veloc = &fluid->m_velocity[start];
+			for (dInt32 i = 0; i < count; i++)
 			{
-				//ndParticlePair& pair = particlesPairs[i];
+				posit[i] += veloc[i] * timestep;
 			}
 		}
 	};
 
 	ndScene* const scene = world->GetScene();
-	//m_particlesPairs.SetCount(0);
-	//ndBodySphFluidCreatePair::ndContext context(this);
+	scene->SubmitJobs<ndIntegratePositions>(this);
+}
+
+void ndBodySphFluid::CollideBoundaryBodies(const ndWorld* const world)
+{
+	D_TRACKTIME();
+	class ndCollideBoundaryBodies: public ndScene::ndBaseJob
+	{
+		public:
+		#define D_SPH_BOUNDARY_BATCH 32
+		#define D_SPH_BOUNDARY_PASSES 3
+
+		// move one particle to its target and stop it at the surface of the body, 
+		// the particle loses the normal speed relative to the surface and the 
+		// momentum it loses is added to the reaction on the body.
+		// returns true if the body changed the particle motion.
+		bool CollideParticle(ndBodySphFluid* const fluid, const ndBoundaryBody& boundary, ndJacobian& reaction, const dVector& posit, dVector& veloc, dVector& target) const
+		{
+			ndBodyKinematic* const body = boundary.m_body;
+			const dFloat32 radius = fluid->m_radius;
+			const dVector step((veloc - body->GetVelocityAtPoint(posit)).Scale(m_timestep) & dVector::m_triplexMask);
+			const dFloat32 dist2 = step.DotProduct(step).GetScalar();
+			if (dist2 < dFloat32(1.0e-12f))
+			{
+				return false;
+			}
+
+			// the ray is extended by the particle radius along the relative motion
+			const dVector dir(step.Scale(dRsqrt(dist2)));
+			const dVector origin(posit & dVector::m_triplexMask);
+			const dFastRayTest ray(origin, origin + step + dir.Scale(radius));
+			ndRayCastClosestHitCallback callback;
+			if (!body->RayCast(callback, ray, dFloat32(1.0f)))
+			{
+				return false;
+			}
+
+			bool changed = false;
+
+			const dVector normal(callback.m_contact.m_normal & dVector::m_triplexMask);
+			const dVector point(callback.m_contact.m_point | dVector::m_wOne);
+			const dVector pointVeloc(body->GetVelocityAtPoint(point) & dVector::m_triplexMask);
+			const dFloat32 normalSpeed = normal.DotProduct(veloc - pointVeloc).GetScalar();
+			if (normalSpeed < dFloat32(0.0f))
+			{
+				const dVector deltaVeloc(normal.Scale(-normalSpeed));
+				veloc += deltaVeloc;
+				target += deltaVeloc.Scale(m_timestep);
+				changed = true;
+				if (body->GetInvMass() > dFloat32(0.0f))
+				{
+					const dVector com(body->GetMatrix().TransformVector(body->GetCentreOfMass()));
+					const dVector force(deltaVeloc.Scale(-fluid->m_mass / m_timestep));
+					reaction.m_linear += force;
+					reaction.m_angular += (point - com).CrossProduct(force);
+				}
+			}
 
-	ndCalculateDensity::ndContext densityContext(this);
-	scene->SubmitJobs<ndCalculateDensity>(&densityContext);
-}
\ No newline at end of file
+			// keep the particle one radius away from where the surface will be
+			const dVector relativeTarget(target - pointVeloc.Scale(m_timestep));
+			const dFloat32 penetration = radius - normal.DotProduct(relativeTarget - point).GetScalar();
+			if (penetration > dFloat32(0.0f))
+			{
+				target += normal.Scale(penetration);
+				changed = true;
+			}
+			return changed;
+		}
+
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndBodySphFluid* const fluid = (ndBodySphFluid*)m_context;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+
+			const dArray<ndBoundaryBody>& boundaryBodies = fluid->m_boundaryBodies;
+			dArray<ndJacobian>& reactions = fluid->m_boundaryForces[threadIndex];
+			reactions.SetCount(boundaryBodies.GetCount());
+			for (dInt32 i = 0; i < reactions.GetCount(); i++)
+			{
+				reactions[i].m_linear = dVector::m_zero;
+				reactions[i].m_angular = dVector::m_zero;
+			}
+
+			// the bodies are found per cell, all the particles in a cell are tested
+			// against the few bodies that overlap the box swept by the cell particles
+			const dArray<dInt32>& gridScans = fluid->m_gridScans[0];
+			const dInt32 cellCount = gridScans.GetCount() - 1;
+			const dInt32 step = cellCount / threadCount;
+			const dInt32 start = threadIndex * step;
+			const dInt32 count = ((threadIndex + 1) < threadCount) ? step : cellCount - start;
+
+			const dVector timestep(m_timestep);
+			const dVector radius(fluid->m_radius);
+			const ndGridHash* const hashGridMap = &fluid->m_hashGridMap[0];
+			dVector* const posit = &fluid->m_posit[0];
+			dVector* const veloc = &fluid->m_velocity[0];
+			for (dInt32 i = 0; i < count; i++)
+			{
+				const dInt32 cell = start + i;
+				const dInt32 cellStart = gridScans[cell];
+				const dInt32 cellEnd = gridScans[cell + 1];
+
+				dVector box0(dFloat32(1.0e20f));
+				dVector box1(dFloat32(-1.0e20f));
+				for (dInt32 j = cellStart; j < cellEnd; j++)
+				{
+					const dInt32 index = hashGridMap[j].m_particleIndex;
+					const dVector target(posit[index] + veloc[index] * timestep);
+					box0 = box0.GetMin(posit[index].GetMin(target));
+					box1 = box1.GetMax(posit[index].GetMax(target));
+				}
+				box0 = (box0 - radius) & dVector::m_triplexMask;
+				box1 = (box1 + radius) & dVector::m_triplexMask;
+
+				// when too many bodies overlap the cell, every body is tested 
+				dInt32 overlapCount = 0;
+				dInt32 overlaps[D_SPH_BOUNDARY_BATCH];
+				for (dInt32 k = 0; k < boundaryBodies.GetCount(); k++)
+				{
+					const ndBoundaryBody& boundary = boundaryBodies[k];
+					if (dOverlapTest(box0, box1, boundary.m_box0, boundary.m_box1))
+					{
+						if (overlapCount < D_SPH_BOUNDARY_BATCH)
+						{
+							overlaps[overlapCount] = k;
+						}
+						overlapCount++;
+					}
+				}
+
+				for (dInt32 j = cellStart; j < cellEnd; j++)
+				{
+					const dInt32 index = hashGridMap[j].m_particleIndex;
+					dVector velocity(veloc[index]);
+					dVector target(posit[index] + velocity * timestep);
+
+					// a particle stopped by one body can be deflected into a body 
+					// that was already tested, so the bodies are tested again 
+					// until none of them changes the particle motion.
+					for (dInt32 pass = 0; pass < D_SPH_BOUNDARY_PASSES; pass++)
+					{
+						bool changed = false;
+						if (overlapCount <= D_SPH_BOUNDARY_BATCH)
+						{
+							for (dInt32 k = 0; k < overlapCount; k++)
+							{
+								const dInt32 bodyIndex = overlaps[k];
+								changed = CollideParticle(fluid, boundaryBodies[bodyIndex], reactions[bodyIndex], posit[index], velocity, target) || changed;
+							}
+						}
+						else
+						{
+							for (dInt32 k = 0; k < boundaryBodies.GetCount(); k++)
+							{
+								changed = CollideParticle(fluid, boundaryBodies[k], reactions[k], posit[index], velocity, target) || changed;
+							}
+						}
+						if (!changed)
+						{
+							break;
+						}
+					}
+					veloc[index] = velocity;
+					posit[index] = target;
+				}
+			}
+		}
+	};
+
+	ndScene* const scene = world->GetScene();
+	scene->SubmitJobs<ndCollideBoundaryBodies>(this);
+}
@@ -28,6 +28,11 @@
 #define D_RADIX_DIGIT_SIZE	10
 //#define D_GRID_SIZE_FACTOR	dFloat32(4.0f)
 
+// the particles stay sorted by cell from one step to the next, only the ones 
+// that changed cell are sorted and merged back. the grid is sorted from scratch 
+// when more than one in this many particles moved to a different cell.
+#define D_GRID_REBUILD_FACTOR	2
+
 D_MSV_NEWTON_ALIGN_32
 class ndBodySphFluid: public ndBodyParticleSet
 {
@@ -43,18 +48,39 @@ class ndBodySphFluid: public ndBodyParticleSet
 
 	D_NEWTON_API virtual void GenerateIsoSurface(const ndWorld* const world);
 
+	// the queries walk the grid of the last step, the particles 
+	// added after the last step are tested one by one.
+	D_NEWTON_API virtual bool RayCast(ndRayCastNotify& callback, const dFastRayTest& ray, const dFloat32 maxT) const;
+	D_NEWTON_API virtual void ParticlesInAabb(const dVector& box0, const dVector& box1, dArray<dInt32>& particles) const;
+
 	const dIsoSurface& GetIsoSurface() const;
+	const dArray<dFloat32>& GetDensities() const;
+
+	dFloat32 GetParticleMass() const;
+
+	// the particles are kept sorted by grid cell, so the index of a particle 
+	// changes from one step to the next. the moved count is the number of 
+	// particles that changed cell in the last step, or all of them when 
+	// there was not a last step to compare with.
+	dInt32 GetMovedParticlesCount() const;
+
+	// the id of the particle at each index, ids are given in the order the 
+	// particles are added and stay with the particle when it is reordered.
+	const dArray<dInt32>& GetParticleIds() const;
+	D_NEWTON_API virtual dInt32 GetParticleId(dInt32 particle) const;
+
+	// rest density of zero means the density of particles packed one radius apart
+	dFloat32 GetRestDensity() const;
+	void SetRestDensity(dFloat32 restDensity);
+
+	dFloat32 GetStiffness() const;
+	void SetStiffness(dFloat32 stiffness);
+
+	dFloat32 GetViscosity() const;
+	void SetViscosity(dFloat32 viscosity);
 
 	protected:
 	D_NEWTON_API virtual void Update(const ndWorld* const world, dFloat32 timestep);
-	virtual bool RayCast(ndRayCastNotify& callback, const dFastRayTest& ray, const dFloat32 maxT) const;
-
-	private:
-	enum ndGridType
-	{
-		ndAdjacentGrid = 0,
-		ndHomeGrid = 1,
-	};
 
 	class ndGridHash
 	{
@@ -92,7 +118,6 @@ class ndBodySphFluid: public ndBodyParticleSet
 			m_y = hash.m_iy;
 			m_z = hash.m_iz;
 
-			m_cellType = ndAdjacentGrid;
 			m_particleIndex = particelIndex;
 		}
 
@@ -118,14 +143,13 @@ class ndBodySphFluid: public ndBodyParticleSet
 		};
 
 		dInt32 m_particleIndex;
-		ndGridType m_cellType;
 	};
 
-	class ndParticlePair
+	class ndNeighborList
 	{
 		public:
-		dInt32 m_m0;
-		dInt32 m_m1;
+		dInt32 m_start;
+		dInt32 m_count;
 	};
 
 	class ndContext
@@ -137,35 +161,69 @@ class ndBodySphFluid: public ndBodyParticleSet
 		dInt32 m_histogram[D_MAX_THREADS_COUNT][1 << D_RADIX_DIGIT_SIZE];
 	};
 
+	class ndGridContext;
+	class ndIsoContext;
+
 	void SortGrids(const ndWorld* const world);
-	void BuildPairs(const ndWorld* const world);
-	void CreateGrids(const ndWorld* const world);
+	void BuildNeighbors(const ndWorld* const world);
+	void UpdateGrids(const ndWorld* const world, const dVector& boxP0, const dVector& boxP1);
+	void CreateGrids(const ndWorld* const world, ndGridContext& context);
+	void MergeGrids(const ndWorld* const world, ndGridContext& context);
+	void ReorderParticles(const ndWorld* const world);
+	void CalculateDensities(const ndWorld* const world);
 	void CalculateAccelerations(const ndWorld* const world);
+	void IntegrateParticles(const ndWorld* const world, dFloat32 timestep);
+	void IntegrateVelocities(const ndWorld* const world, dVector& sweptBox0, dVector& sweptBox1);
+	void IntegratePositions(const ndWorld* const world);
+	void CollideBoundaryBodies(const ndWorld* const world);
 	void AddCounters(const ndWorld* const world, ndContext& context) const;
 	void CaculateAABB(const ndWorld* const world, dVector& boxP0, dVector& boxP1) const;
+	void SplatIsoParticles(const ndWorld* const world, ndIsoContext& context);
+	void SplatIsoCells(const ndWorld* const world, ndIsoContext& context);
+	void SumIsoPoints(const ndWorld* const world, ndIsoContext& context);
+	dInt32 CalculateIsoRuns(const ndWorld* const world, ndIsoContext& context);
 
-	void SortByCenterType();
 	void SortSingleThreaded();
 	void SortParallel(const ndWorld* const world);
 	void CalculateScans(const ndWorld* const world);
 	void CalculateScansDebug(dArray<dInt32>& gridScans);
 	dFloat32 CalculateGridSize() const;
+	dFloat32 CalculateRestDensity() const;
+	bool HasValidGrid() const;
+	void GetCellSpan(dInt32 x0, dInt32 x1, dInt32 y, dInt32 z, dInt32& start, dInt32& count) const;
+	static dInt32 LowerBound(const dUnsigned64* const gridKeys, dInt32 cellCount, dUnsigned64 key);
+	static dVector GatherNeighbors(const dInt32* const neighbors, dInt32 base, dInt32 count, dInt32* const index);
 
 	dVector m_box0;
 	dVector m_box1;
+	dArray<dVector> m_accel;
+	dArray<dFloat32> m_density;
+	dArray<dFloat32> m_pressure;
 	dArray<ndGridHash> m_hashGridMap;
-	dArray<ndParticlePair> m_particlesPairs;
 	dArray<ndGridHash> m_hashGridMapScratchBuffer;
+	dArray<ndGridHash> m_stayedGridMap;
+	dArray<dVector> m_reorderBuffer;
+	dArray<dInt32> m_particleId;
+	dArray<dInt32> m_reorderIdBuffer;
+	dArray<dUnsigned64> m_gridKeys;
 	dArray<dInt32> m_gridScans[D_MAX_THREADS_COUNT];
+	dArray<ndNeighborList> m_neighborLists;
+	dArray<dInt32> m_neighbors[D_MAX_THREADS_COUNT];
+	dArray<ndGridHash> m_isoGridMap;
+	dArray<ndGridHash> m_isoGridMapScratchBuffer;
+	dArray<dInt32> m_isoRuns;
+	dArray<dFloat32> m_isoCorners;
+	dArray<dIsoSurface::dIsoPoint> m_isoPoints;
+	dFloat32 m_mass;
+	dFloat32 m_restDensity;
+	dFloat32 m_stiffness;
+	dFloat32 m_viscosity;
+	dFloat32 m_gridSize;
+	dInt32 m_movedCount;
 	dInt32 m_upperDigisIsValid[3];
 	dIsoSurface m_isoSurcase;
 } D_GCC_NEWTON_ALIGN_32 ;
 
-inline bool ndBodySphFluid::RayCast(ndRayCastNotify&, const dFastRayTest&, const dFloat32) const
-{
-	return false;
-}
-
 inline ndBodySphFluid* ndBodySphFluid::GetAsBodySphFluid()
 { 
 	return this; 
@@ -176,12 +234,101 @@ inline const dIsoSurface& ndBodySphFluid::GetIsoSurface() const
 	return m_isoSurcase;
 }
 
+inline const dArray<dFloat32>& ndBodySphFluid::GetDensities() const
+{
+	return m_density;
+}
+
+inline dFloat32 ndBodySphFluid::GetParticleMass() const
+{
+	return m_mass;
+}
+
+inline dInt32 ndBodySphFluid::GetMovedParticlesCount() const
+{
+	return m_movedCount;
+}
+
+inline const dArray<dInt32>& ndBodySphFluid::GetParticleIds() const
+{
+	return m_particleId;
+}
+
+inline dFloat32 ndBodySphFluid::GetRestDensity() const
+{
+	return m_restDensity;
+}
+
+inline void ndBodySphFluid::SetRestDensity(dFloat32 restDensity)
+{
+	m_restDensity = dMax(restDensity, dFloat32(0.0f));
+}
+
+inline dFloat32 ndBodySphFluid::GetStiffness() const
+{
+	return m_stiffness;
+}
+
+inline void ndBodySphFluid::SetStiffness(dFloat32 stiffness)
+{
+	m_stiffness = dMax(stiffness, dFloat32(0.0f));
+}
+
+inline dFloat32 ndBodySphFluid::GetViscosity() const
+{
+	return m_viscosity;
+}
+
+inline void ndBodySphFluid::SetViscosity(dFloat32 viscosity)
+{
+	m_viscosity = dMax(viscosity, dFloat32(0.0f));
+}
+
 inline dFloat32 ndBodySphFluid::CalculateGridSize() const
 {
 	//return m_radius * dFloat32(2.0f) * dFloat32(1.125f);
 	return m_radius * (dFloat32(2.0f) * dFloat32(2.0f));
 }
 
+// the grid of the last step has one entry per particle
+inline bool ndBodySphFluid::HasValidGrid() const
+{
+	return m_gridKeys.GetCount() && (m_hashGridMap.GetCount() == m_posit.GetCount());
+}
+
+// index of the first cell with a key not smaller than the key
+inline dInt32 ndBodySphFluid::LowerBound(const dUnsigned64* const gridKeys, dInt32 cellCount, dUnsigned64 key)
+{
+	dInt32 i0 = 0;
+	dInt32 i1 = cellCount;
+	while (i0 < i1)
+	{
+		const dInt32 mid = (i0 + i1) >> 1;
+		if (gridKeys[mid] < key)
+		{
+			i0 = mid + 1;
+		}
+		else
+		{
+			i1 = mid;
+		}
+	}
+	return i0;
+}
+
+// load four neighbors of a particle, lanes past the end of the list 
+// repeat the last neighbor and are cleared by the returned mask.
+inline dVector ndBodySphFluid::GatherNeighbors(const dInt32* const neighbors, dInt32 base, dInt32 count, dInt32* const index)
+{
+	const dInt32 last = count - 1;
+	index[0] = neighbors[dMin(base + 0, last)];
+	index[1] = neighbors[dMin(base + 1, last)];
+	index[2] = neighbors[dMin(base + 2, last)];
+	index[3] = neighbors[dMin(base + 3, last)];
+	const dVector lanes(dFloat32(0.0f), dFloat32(1.0f), dFloat32(2.0f), dFloat32(3.0f));
+	return lanes < dVector(dFloat32(count - base));
+}
+
 #endif 
 
 
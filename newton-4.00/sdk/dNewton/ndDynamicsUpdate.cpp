@@ -34,6 +34,10 @@ ndDynamicsUpdate::ndDynamicsUpdate(ndWorld* const world)
 	,m_internalForces(D_DEFAULT_BUFFER_SIZE)
 	,m_leftHandSide(D_DEFAULT_BUFFER_SIZE * 4)
 	,m_rightHandSide(D_DEFAULT_BUFFER_SIZE)
+	,m_jointForces(D_DEFAULT_BUFFER_SIZE)
+	,m_jointAccelNorm(D_DEFAULT_BUFFER_SIZE)
+	,m_bodyJointScans(D_DEFAULT_BUFFER_SIZE)
+	,m_bodyJoints(D_DEFAULT_BUFFER_SIZE)
 	,m_world(world)
 	,m_timestep(dFloat32(0.0f))
 	,m_invTimestep(dFloat32(0.0f))
@@ -64,6 +68,10 @@ void ndDynamicsUpdate::Clear()
 	m_rightHandSide.Resize(D_DEFAULT_BUFFER_SIZE);
 	m_internalForces.Resize(D_DEFAULT_BUFFER_SIZE);
 	m_bodyIslandOrder.Resize(D_DEFAULT_BUFFER_SIZE);
+	m_jointForces.Resize(D_DEFAULT_BUFFER_SIZE);
+	m_jointAccelNorm.Resize(D_DEFAULT_BUFFER_SIZE);
+	m_bodyJointScans.Resize(D_DEFAULT_BUFFER_SIZE);
+	m_bodyJoints.Resize(D_DEFAULT_BUFFER_SIZE);
 }
 
 dInt32 ndDynamicsUpdate::CompareIslands(const ndIsland* const islandA, const ndIsland* const islandB, void* const)
@@ -668,7 +676,7 @@ void ndDynamicsUpdate::InitJacobianMatrix()
 		{
 		}
 
-		void BuildJacobianMatrix(ndConstraint* const joint)
+		void BuildJacobianMatrix(ndConstraint* const joint, dInt32 jointIndex)
 		{
 			dAssert(joint->GetBody0());
 			dAssert(joint->GetBody1());
@@ -778,13 +786,24 @@ void ndDynamicsUpdate::InitJacobianMatrix()
 				torqueAcc1 = torqueAcc1 + JtM1.m_angular * f1;
 			}
 
-			ndJacobian& outBody0 = m_internalForces[m0];
-			outBody0.m_linear += forceAcc0;
-			outBody0.m_angular += torqueAcc0;
+			if (m_jointForces)
+			{
+				ndJacobian* const out = &m_jointForces[jointIndex * 2];
+				out[0].m_linear = forceAcc0;
+				out[0].m_angular = torqueAcc0;
+				out[1].m_linear = forceAcc1;
+				out[1].m_angular = torqueAcc1;
+			}
+			else
+			{
+				ndJacobian& outBody0 = m_internalForces[m0];
+				outBody0.m_linear += forceAcc0;
+				outBody0.m_angular += torqueAcc0;
 
-			ndJacobian& outBody1 = m_internalForces[m1];
-			outBody1.m_linear += forceAcc1;
-			outBody1.m_angular += torqueAcc1;
+				ndJacobian& outBody1 = m_internalForces[m1];
+				outBody1.m_linear += forceAcc1;
+				outBody1.m_angular += torqueAcc1;
+			}
 		}
 
 		virtual void Execute()
@@ -803,17 +822,19 @@ void ndDynamicsUpdate::InitJacobianMatrix()
 			const dInt32 threadCount = dMax(m_owner->GetThreadCount(), 1);
 
 			m_internalForces = &me->m_internalForces[threadIndex * bodyCount];
+			m_jointForces = m_owner->IsDeterministic() ? &me->m_jointForces[0] : nullptr;
 
 			me->ClearJacobianBuffer(bodyCount, m_internalForces);
 			for (dInt32 i = threadIndex; i < jointCount; i += threadCount)
 			{
 				ndConstraint* const joint = jointArray[i];
 				me->GetJacobianDerivatives(joint);
-				BuildJacobianMatrix(joint);
+				BuildJacobianMatrix(joint, i);
 			}
 		}
 
 		dVector m_zero;
+		ndJacobian* m_jointForces;
 		ndJacobian* m_internalForces;
 		ndRightHandSide* m_rightHandSide;
 		ndLeftHandSide* m_leftHandSide;
@@ -853,10 +874,19 @@ void ndDynamicsUpdate::InitJacobianMatrix()
 	{
 		D_TRACKTIME();
 		m_rightHandSide[0].m_force = dFloat32(1.0f);
-		scene->SubmitJobs<ndInitJacobianMatrix>();
-		if (scene->GetThreadCount() > 1)
+		if (scene->IsDeterministic())
 		{
-			scene->SubmitJobs<ndInitJacobianAccumulatePartialForces>();
+			BuildBodyJointList();
+			scene->SubmitJobs<ndInitJacobianMatrix>();
+			AccumulateJointForces();
+		}
+		else
+		{
+			scene->SubmitJobs<ndInitJacobianMatrix>();
+			if (scene->GetThreadCount() > 1)
+			{
+				scene->SubmitJobs<ndInitJacobianAccumulatePartialForces>();
+			}
 		}
 	}
 }
@@ -1405,7 +1435,7 @@ void ndDynamicsUpdate::CalculateJointsForce()
 		{
 		}
 		
-		dFloat32 JointForce(ndConstraint* const joint)
+		dFloat32 JointForce(ndConstraint* const joint, dInt32 jointIndex)
 		{
 			dVector accNorm(m_zero);
 
@@ -1527,13 +1557,24 @@ void ndDynamicsUpdate::CalculateJointsForce()
 				rhs->m_maxImpact = dMax(dAbs(f.GetScalar()), rhs->m_maxImpact);
 			}
 
-			ndJacobian& outBody0 = m_outputForces[m0];
-			outBody0.m_linear += forceM0;
-			outBody0.m_angular += torqueM0;
+			if (m_jointForces)
+			{
+				ndJacobian* const out = &m_jointForces[jointIndex * 2];
+				out[0].m_linear = forceM0;
+				out[0].m_angular = torqueM0;
+				out[1].m_linear = forceM1;
+				out[1].m_angular = torqueM1;
+			}
+			else
+			{
+				ndJacobian& outBody0 = m_outputForces[m0];
+				outBody0.m_linear += forceM0;
+				outBody0.m_angular += torqueM0;
 
-			ndJacobian& outBody1 = m_outputForces[m1];
-			outBody1.m_linear += forceM1;
-			outBody1.m_angular += torqueM1;
+				ndJacobian& outBody1 = m_outputForces[m1];
+				outBody1.m_linear += forceM1;
+				outBody1.m_angular += torqueM1;
+			}
 
 			return accNorm.GetScalar();
 		}
@@ -1554,13 +1595,26 @@ void ndDynamicsUpdate::CalculateJointsForce()
 
 			const dInt32 threadIndex = GetThreadId();
 			const dInt32 threadCount = dMax(m_owner->GetThreadCount(), 1);
+			if (m_owner->IsDeterministic())
+			{
+				m_jointForces = &me->m_jointForces[0];
+				dFloat32* const jointAccelNorm = &me->m_jointAccelNorm[0];
+				for (dInt32 i = threadIndex; i < jointCount; i += threadCount)
+				{
+					ndConstraint* const joint = jointArray[i];
+					jointAccelNorm[i] = JointForce(joint, i);
+				}
+				return;
+			}
+
+			m_jointForces = nullptr;
 			m_outputForces = &m_internalForces[bodyCount * (threadIndex + 1)];
 			me->ClearJacobianBuffer(bodyCount, m_outputForces);
 
 			for (dInt32 i = threadIndex; i < jointCount; i += threadCount)
 			{
 				ndConstraint* const joint = jointArray[i];
-				accNorm += JointForce(joint);
+				accNorm += JointForce(joint, i);
 			}
 
 			dFloat32* const accelNorm = (dFloat32*)m_context;
@@ -1568,6 +1622,7 @@ void ndDynamicsUpdate::CalculateJointsForce()
 		}
 
 		dVector m_zero;
+		ndJacobian* m_jointForces;
 		ndJacobian* m_outputForces;
 		ndJacobian* m_internalForces;
 		ndRightHandSide* m_rightHandSide;
@@ -1624,6 +1679,24 @@ void ndDynamicsUpdate::CalculateJointsForce()
 	dFloat32 m_accelNorm[D_MAX_THREADS_COUNT];
 	dFloat32 accNorm = D_SOLVER_MAX_ERROR * dFloat32(2.0f);
 
+	if (scene->IsDeterministic())
+	{
+		// the error is added in joint order, the same as a single thread
+		const dInt32 jointCount = scene->GetActiveContactArray().GetCount();
+		for (dInt32 i = 0; (i < passes) && (accNorm > D_SOLVER_MAX_ERROR); i++)
+		{
+			scene->SubmitJobs<ndCalculateJointsForce>();
+			AccumulateJointForces();
+
+			accNorm = dFloat32(0.0f);
+			for (dInt32 j = 0; j < jointCount; j++)
+			{
+				accNorm += m_jointAccelNorm[j];
+			}
+		}
+		return;
+	}
+
 	for (dInt32 i = 0; (i < passes) && (accNorm > D_SOLVER_MAX_ERROR); i++)
 	{
 		scene->SubmitJobs<ndCalculateJointsForce>(m_accelNorm);
@@ -1637,6 +1710,95 @@ void ndDynamicsUpdate::CalculateJointsForce()
 	}
 }
 
+void ndDynamicsUpdate::BuildBodyJointList()
+{
+	D_TRACKTIME();
+	ndScene* const scene = m_world->GetScene();
+	const ndConstraintArray& jointArray = scene->GetActiveContactArray();
+	const dInt32 jointCount = jointArray.GetCount();
+	const dInt32 bodyCount = scene->GetActiveBodyArray().GetCount();
+
+	m_jointForces.SetCount(jointCount * 2);
+	m_jointAccelNorm.SetCount(jointCount);
+	m_bodyJoints.SetCount(jointCount * 2);
+	m_bodyJointScans.SetCount(bodyCount + 1);
+
+	dInt32* const scans = &m_bodyJointScans[0];
+	memset(scans, 0, (bodyCount + 1) * sizeof(dInt32));
+	for (dInt32 i = 0; i < jointCount; i++)
+	{
+		const ndConstraint* const joint = jointArray[i];
+		scans[joint->GetBody0()->m_index] ++;
+		scans[joint->GetBody1()->m_index] ++;
+	}
+
+	dInt32 acc = 0;
+	for (dInt32 i = 0; i <= bodyCount; i++)
+	{
+		const dInt32 val = scans[i];
+		scans[i] = acc;
+		acc += val;
+	}
+
+	// the entries of a body are sorted by joint, the scans end up shifted 
+	// by one body and are restored after the pass.
+	for (dInt32 i = 0; i < jointCount; i++)
+	{
+		const ndConstraint* const joint = jointArray[i];
+		const dInt32 m0 = joint->GetBody0()->m_index;
+		const dInt32 m1 = joint->GetBody1()->m_index;
+		m_bodyJoints[scans[m0]] = i * 2 + 0;
+		scans[m0] ++;
+		m_bodyJoints[scans[m1]] = i * 2 + 1;
+		scans[m1] ++;
+	}
+	for (dInt32 i = bodyCount; i > 0; i--)
+	{
+		scans[i] = scans[i - 1];
+	}
+	scans[0] = 0;
+}
+
+void ndDynamicsUpdate::AccumulateJointForces()
+{
+	D_TRACKTIME();
+	class ndAccumulateJointForces : public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndWorld* const world = m_owner->GetWorld();
+			ndDynamicsUpdate* const me = world->m_solver;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 bodyCount = m_owner->GetActiveBodyArray().GetCount();
+
+			const dVector zero(dVector::m_zero);
+			const dInt32* const scans = &me->m_bodyJointScans[0];
+			const dInt32* const bodyJoints = &me->m_bodyJoints[0];
+			const ndJacobian* const jointForces = &me->m_jointForces[0];
+			ndJacobian* const internalForces = &me->m_internalForces[0];
+			for (dInt32 i = threadIndex; i < bodyCount; i += threadCount)
+			{
+				dVector force(zero);
+				dVector torque(zero);
+				for (dInt32 j = scans[i]; j < scans[i + 1]; j++)
+				{
+					const ndJacobian& jointForce = jointForces[bodyJoints[j]];
+					force += jointForce.m_linear;
+					torque += jointForce.m_angular;
+				}
+				internalForces[i].m_linear = force;
+				internalForces[i].m_angular = torque;
+			}
+		}
+	};
+
+	ndScene* const scene = m_world->GetScene();
+	scene->SubmitJobs<ndAccumulateJointForces>();
+}
+
 void ndDynamicsUpdate::CalculateForces()
 {
 	D_TRACKTIME();
@@ -118,6 +118,8 @@ class ndDynamicsUpdate: public dClassAlloc
 	void InitJacobianMatrix();
 	void UpdateForceFeedback();
 	void CalculateJointsForce();
+	void BuildBodyJointList();
+	void AccumulateJointForces();
 	void IntegrateBodiesVelocity();
 	void CalculateJointsAcceleration();
 	void IntegrateUnconstrainedBodies();
@@ -139,6 +141,13 @@ class ndDynamicsUpdate: public dClassAlloc
 	dArray<ndLeftHandSide> m_leftHandSide;
 	dArray<ndRightHandSide> m_rightHandSide;
 
+	// in deterministic mode each joint writes the forces on its two bodies 
+	// and each body adds the forces of its joints in joint order.
+	dArray<ndJacobian> m_jointForces;
+	dArray<dFloat32> m_jointAccelNorm;
+	dArray<dInt32> m_bodyJointScans;
+	dArray<dInt32> m_bodyJoints;
+
 	ndWorld* m_world;
 	dFloat32 m_timestep;
 	dFloat32 m_invTimestep;
@@ -52,7 +52,13 @@
 #include <ndContactList.h>
 #include <ndJointFix6dof.h>
 #include <ndBodySphFluid.h>
+#include <ndBodyPbfFluid.h>
 #include <ndSkeletonList.h>
+#include <ndWorldSnapshot.h>
+#include <ndWorldCheckpoint.h>
+#include <ndReplication.h>
+#include <ndReplicationExporter.h>
+#include <ndReplicationImporter.h>
 #include <ndBodyKinematic.h>
 #include <ndContactSolver.h>
 #include <ndShapeInstance.h>
@@ -71,6 +77,7 @@
 #include <ndDynamicsUpdateAvx2.h>
 #include <ndJointBallAndSocket.h>
 #include <ndBodyParticleSetList.h>
+#include <ndBodyMassSpringDamper.h>
 #include <ndDynamicsUpdateOpencl.h>
 #include <ndMultiBodyVehicleMotor.h>
 #include <ndMultiBodyVehicleGearBox.h>
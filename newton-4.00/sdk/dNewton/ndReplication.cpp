@@ -0,0 +1,160 @@
+/* Copyright (c) <2003-2021> <Julio Jerez, Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "dCoreStdafx.h"
+#include "ndNewtonStdafx.h"
+#include "ndReplication.h"
+
+// values far from the origin are clamped instead of wrapping around
+#define D_REPLICATION_MAX_VALUE		dFloat32 (1 << 30)
+
+// the three smallest components of a unit quaternion are in [-1/sqrt(2), 1/sqrt(2)]
+#define D_REPLICATION_ROTATION_SCALE	dFloat32 (32767.0f * 1.41421356f)
+
+const dInt32 ndReplication::m_groupFields[] = { m_positX, m_rotationAxis, m_velocX, m_omegaX, m_sleepState, m_fieldCount };
+
+ndReplication::ndReplication(const dVector& origin, dFloat32 positionStep, dFloat32 velocityStep, dFloat32 omegaStep)
+	:dClassAlloc()
+	,m_origin(origin & dVector::m_triplexMask)
+	,m_step(positionStep, velocityStep, omegaStep, dFloat32(1.0f))
+	,m_invStep(m_step.Reciproc())
+{
+	dAssert(positionStep > dFloat32(0.0f));
+	dAssert(velocityStep > dFloat32(0.0f));
+	dAssert(omegaStep > dFloat32(0.0f));
+}
+
+ndReplication::~ndReplication()
+{
+}
+
+static inline dInt32 dQuantize(dFloat32 value)
+{
+	return dInt32(dFloor(dClamp(value, -D_REPLICATION_MAX_VALUE, D_REPLICATION_MAX_VALUE) + dFloat32(0.5f)));
+}
+
+void ndReplication::Quantize(ndBodyState& state, const ndBodyKinematic* const body) const
+{
+	const dVector posit((body->GetMatrix().m_posit - m_origin).Scale(m_invStep.m_x));
+	const dVector veloc(body->GetVelocity().Scale(m_invStep.m_y));
+	const dVector omega(body->GetOmega().Scale(m_invStep.m_z));
+	for (dInt32 i = 0; i < 3; i++)
+	{
+		state.m_data[m_positX + i] = dQuantize(posit[i]);
+		state.m_data[m_velocX + i] = dQuantize(veloc[i]);
+		state.m_data[m_omegaX + i] = dQuantize(omega[i]);
+	}
+
+	// the largest component is dropped and made positive,
+	// the decoder gets it back from the unit length
+	const dQuaternion rotation(body->GetRotation());
+	dInt32 axis = 0;
+	for (dInt32 i = 1; i < 4; i++)
+	{
+		if (dAbs(rotation[i]) > dAbs(rotation[axis]))
+		{
+			axis = i;
+		}
+	}
+	const dFloat32 scale = (rotation[axis] < dFloat32(0.0f)) ? -D_REPLICATION_ROTATION_SCALE : D_REPLICATION_ROTATION_SCALE;
+	for (dInt32 i = 0, j = 0; i < 4; i++)
+	{
+		if (i != axis)
+		{
+			state.m_data[m_rotation0 + j] = dQuantize(rotation[i] * scale);
+			j++;
+		}
+	}
+	state.m_data[m_rotationAxis] = axis;
+	state.m_data[m_sleepState] = body->GetSleepState() ? 1 : 0;
+	state.m_id = body->GetId();
+	state.m_pad = 0;
+}
+
+void ndReplication::Dequantize(const ndBodyState& state, dVector& posit, dQuaternion& rotation, dVector& veloc, dVector& omega) const
+{
+	for (dInt32 i = 0; i < 3; i++)
+	{
+		posit[i] = dFloat32(state.m_data[m_positX + i]);
+		veloc[i] = dFloat32(state.m_data[m_velocX + i]);
+		omega[i] = dFloat32(state.m_data[m_omegaX + i]);
+	}
+	posit = m_origin + posit.Scale(m_step.m_x);
+	posit.m_w = dFloat32(1.0f);
+	veloc = veloc.Scale(m_step.m_y) & dVector::m_triplexMask;
+	omega = omega.Scale(m_step.m_z) & dVector::m_triplexMask;
+
+	const dInt32 axis = dClamp(state.m_data[m_rotationAxis], 0, 3);
+	dFloat32 mag2 = dFloat32(0.0f);
+	dVector q(dVector::m_zero);
+	for (dInt32 i = 0, j = 0; i < 4; i++)
+	{
+		if (i != axis)
+		{
+			q[i] = dFloat32(state.m_data[m_rotation0 + j]) * (dFloat32(1.0f) / D_REPLICATION_ROTATION_SCALE);
+			mag2 += q[i] * q[i];
+			j++;
+		}
+	}
+	q[axis] = dSqrt(dMax(dFloat32(1.0f) - mag2, dFloat32(0.0f)));
+	rotation = dQuaternion(q).Normalize();
+}
+
+dInt32 ndReplication::FindBody(const ndFrame& frame, dUnsigned32 id)
+{
+	dInt32 i0 = 0;
+	dInt32 i1 = frame.m_bodies.GetCount() - 1;
+	while (i0 <= i1)
+	{
+		const dInt32 mid = (i0 + i1) >> 1;
+		const dUnsigned32 midId = frame.m_bodies[mid].m_id;
+		if (midId == id)
+		{
+			return mid;
+		}
+		else if (midId < id)
+		{
+			i0 = mid + 1;
+		}
+		else
+		{
+			i1 = mid - 1;
+		}
+	}
+	return -1;
+}
+
+dUnsigned8 ndReplication::ChangedGroups(const ndBodyState& state, const ndBodyState& base)
+{
+	dUnsigned8 mask = 0;
+	for (dInt32 group = 0; group < m_groupCount; group++)
+	{
+		for (dInt32 i = m_groupFields[group]; i < m_groupFields[group + 1]; i++)
+		{
+			if (state.m_data[i] != base.m_data[i])
+			{
+				mask |= dUnsigned8(1 << group);
+				break;
+			}
+		}
+	}
+	return mask;
+}
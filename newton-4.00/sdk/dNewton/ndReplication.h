@@ -0,0 +1,216 @@
+/* Copyright (c) <2003-2021> <Julio Jerez, Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef __D_REPLICATION_H__
+#define __D_REPLICATION_H__
+
+#include "ndNewtonStdafx.h"
+
+// number of frames kept by both ends of a stream, a packet is encoded
+// against a frame the client acknowledged less than this many frames ago
+#define D_REPLICATION_HISTORY		16
+
+// worse case size of the record of one body in a packet
+#define D_REPLICATION_MAX_RECORD	80
+
+#define D_REPLICATION_NO_BASE		0xffffffff
+
+// state shared by the two ends of a replication stream.
+// the state of a body is quantized to integers, positions to a grid with
+// its origin at m_origin, rotations as the three smallest components of
+// the quaternion and velocities to fixed steps. a packet holds the bodies
+// whose quantized state is different from the frame the client acknowledged,
+// each changed field is written as the difference to that frame with a
+// variable length code, so the bodies at rest cost nothing.
+// the exporter and the importer must be created with the same parameters.
+class ndReplication: public dClassAlloc
+{
+	public:
+	enum ndFields
+	{
+		m_positX = 0,
+		m_positY,
+		m_positZ,
+		m_rotationAxis,
+		m_rotation0,
+		m_rotation1,
+		m_rotation2,
+		m_velocX,
+		m_velocY,
+		m_velocZ,
+		m_omegaX,
+		m_omegaY,
+		m_omegaZ,
+		m_sleepState,
+		m_fieldCount,
+	};
+
+	// the fields are sent in groups, one bit of the record mask per group
+	enum ndFieldGroups
+	{
+		m_positionGroup = 0,
+		m_rotationGroup,
+		m_velocityGroup,
+		m_omegaGroup,
+		m_stateGroup,
+		m_groupCount,
+	};
+
+	class ndBodyState
+	{
+		public:
+		dInt32 m_data[m_fieldCount];
+		dUnsigned32 m_id;
+		dInt32 m_pad;
+	};
+
+	// the quantized state of all bodies at one frame, sorted by id
+	class ndFrame
+	{
+		public:
+		ndFrame();
+		dArray<ndBodyState> m_bodies;
+		dUnsigned32 m_sequence;
+		bool m_valid;
+	};
+
+	class ndHeader
+	{
+		public:
+		dUnsigned32 m_sequence;
+		dUnsigned32 m_baseSequence;
+		dInt32 m_bodyCount;
+		dInt32 m_removedCount;
+	};
+
+	D_NEWTON_API virtual ~ndReplication();
+
+	const dVector& GetOrigin() const;
+	dFloat32 GetPositionStep() const;
+	dFloat32 GetVelocityStep() const;
+	dFloat32 GetOmegaStep() const;
+
+	protected:
+	D_NEWTON_API ndReplication(const dVector& origin, dFloat32 positionStep, dFloat32 velocityStep, dFloat32 omegaStep);
+
+	void Quantize(ndBodyState& state, const ndBodyKinematic* const body) const;
+	void Dequantize(const ndBodyState& state, dVector& posit, dQuaternion& rotation, dVector& veloc, dVector& omega) const;
+
+	ndFrame* FindFrame(dUnsigned32 sequence);
+	const ndFrame* FindFrame(dUnsigned32 sequence) const;
+	ndFrame& GetFrameSlot(dUnsigned32 sequence);
+
+	static dInt32 FindBody(const ndFrame& frame, dUnsigned32 id);
+	static dUnsigned8 ChangedGroups(const ndBodyState& state, const ndBodyState& base);
+
+	static dUnsigned8* WriteCode(dUnsigned8* ptr, dUnsigned32 value);
+	static const dUnsigned8* ReadCode(const dUnsigned8* ptr, const dUnsigned8* const end, dUnsigned32& value);
+	static dUnsigned32 ZigZag(dInt32 value);
+	static dInt32 UnZigZag(dUnsigned32 value);
+
+	ndFrame m_frames[D_REPLICATION_HISTORY];
+	dVector m_origin;
+	dVector m_step;
+	dVector m_invStep;
+
+	static const dInt32 m_groupFields[m_groupCount + 1];
+};
+
+inline ndReplication::ndFrame::ndFrame()
+	:m_bodies()
+	,m_sequence(D_REPLICATION_NO_BASE)
+	,m_valid(false)
+{
+}
+
+inline const dVector& ndReplication::GetOrigin() const
+{
+	return m_origin;
+}
+
+inline dFloat32 ndReplication::GetPositionStep() const
+{
+	return m_step.m_x;
+}
+
+inline dFloat32 ndReplication::GetVelocityStep() const
+{
+	return m_step.m_y;
+}
+
+inline dFloat32 ndReplication::GetOmegaStep() const
+{
+	return m_step.m_z;
+}
+
+inline ndReplication::ndFrame& ndReplication::GetFrameSlot(dUnsigned32 sequence)
+{
+	return m_frames[sequence % D_REPLICATION_HISTORY];
+}
+
+inline ndReplication::ndFrame* ndReplication::FindFrame(dUnsigned32 sequence)
+{
+	ndFrame& frame = GetFrameSlot(sequence);
+	return (frame.m_valid && (frame.m_sequence == sequence)) ? &frame : nullptr;
+}
+
+inline const ndReplication::ndFrame* ndReplication::FindFrame(dUnsigned32 sequence) const
+{
+	const ndFrame& frame = m_frames[sequence % D_REPLICATION_HISTORY];
+	return (frame.m_valid && (frame.m_sequence == sequence)) ? &frame : nullptr;
+}
+
+inline dUnsigned32 ndReplication::ZigZag(dInt32 value)
+{
+	return (dUnsigned32(value) << 1) ^ dUnsigned32(value >> 31);
+}
+
+inline dInt32 ndReplication::UnZigZag(dUnsigned32 value)
+{
+	return dInt32(value >> 1) ^ -dInt32(value & 1);
+}
+
+inline dUnsigned8* ndReplication::WriteCode(dUnsigned8* ptr, dUnsigned32 value)
+{
+	for (; value >= 0x80; value >>= 7)
+	{
+		*ptr++ = dUnsigned8(value | 0x80);
+	}
+	*ptr++ = dUnsigned8(value);
+	return ptr;
+}
+
+inline const dUnsigned8* ndReplication::ReadCode(const dUnsigned8* ptr, const dUnsigned8* const end, dUnsigned32& value)
+{
+	value = 0;
+	for (dInt32 shift = 0; (ptr < end) && (shift < 35); shift += 7)
+	{
+		const dUnsigned8 code = *ptr++;
+		value |= dUnsigned32(code & 0x7f) << shift;
+		if (!(code & 0x80))
+		{
+			return ptr;
+		}
+	}
+	return nullptr;
+}
+
+#endif
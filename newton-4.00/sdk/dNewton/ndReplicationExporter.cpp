@@ -0,0 +1,337 @@
+/* Copyright (c) <2003-2021> <Julio Jerez, Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "dCoreStdafx.h"
+#include "ndNewtonStdafx.h"
+#include "ndWorld.h"
+#include "ndReplicationExporter.h"
+
+ndReplicationExporter::ndReplicationExporter(const dVector& origin, dFloat32 positionStep, dFloat32 velocityStep, dFloat32 omegaStep)
+	:ndReplication(origin, positionStep, velocityStep, omegaStep)
+	,m_base()
+	,m_current()
+	,m_bodyArray()
+	,m_exportList()
+	,m_recordOffsets()
+	,m_records()
+	,m_removedCodes()
+	,m_packet(nullptr)
+	,m_removedCount(0)
+	,m_packetSize(0)
+	,m_sequence(0)
+{
+}
+
+ndReplicationExporter::~ndReplicationExporter()
+{
+}
+
+dInt64 ndReplicationExporter::CalculateBufferSize(const ndWorld* const world) const
+{
+	const dInt64 bodyCount = world->GetBodyList().GetCount();
+	const dInt64 removedCount = m_base.m_valid ? m_base.m_bodies.GetCount() : 0;
+	return sizeof(ndHeader) + bodyCount * D_REPLICATION_MAX_RECORD + removedCount * 5;
+}
+
+void ndReplicationExporter::Acknowledge(dUnsigned32 sequence)
+{
+	D_TRACKTIME();
+	const ndFrame* const frame = FindFrame(sequence);
+	if (frame && (!m_base.m_valid || (sequence > m_base.m_sequence)))
+	{
+		m_base.m_bodies.SetCount(frame->m_bodies.GetCount());
+		if (frame->m_bodies.GetCount())
+		{
+			memcpy(&m_base.m_bodies[0], &frame->m_bodies[0], frame->m_bodies.GetCount() * sizeof(ndBodyState));
+		}
+		m_base.m_sequence = sequence;
+		m_base.m_valid = true;
+	}
+}
+
+void ndReplicationExporter::GatherBodies(const ndWorld* const world)
+{
+	D_TRACKTIME();
+	class ndSortBodies
+	{
+		public:
+		static dInt32 Compare(ndBodyKinematic* const* const bodyA, ndBodyKinematic* const* const bodyB, void* const)
+		{
+			const dUnsigned32 idA = (*bodyA)->GetId();
+			const dUnsigned32 idB = (*bodyB)->GetId();
+			return (idA < idB) ? -1 : ((idA > idB) ? 1 : 0);
+		}
+	};
+
+	// bodies are appended to the list as they are created,
+	// so the list is already sorted unless ids were assigned
+	const ndBodyList& bodyList = world->GetBodyList();
+	m_bodyArray.SetCount(bodyList.GetCount());
+
+	dInt32 index = 0;
+	bool isSorted = true;
+	dUnsigned32 lastId = 0;
+	for (ndBodyList::dNode* node = bodyList.GetFirst(); node; node = node->GetNext())
+	{
+		ndBodyKinematic* const body = node->GetInfo();
+		isSorted = isSorted && (!index || (body->GetId() > lastId));
+		lastId = body->GetId();
+		m_bodyArray[index] = body;
+		index++;
+	}
+
+	if (!isSorted)
+	{
+		dSort(&m_bodyArray[0], index, ndSortBodies::Compare);
+	}
+}
+
+void ndReplicationExporter::QuantizeBodies(const ndWorld* const world)
+{
+	D_TRACKTIME();
+	class ndQuantizeBodies : public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndReplicationExporter* const me = (ndReplicationExporter*)m_context;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 count = me->m_bodyArray.GetCount();
+			const ndFrame& base = me->m_base;
+			dInt32* const changed = &me->m_recordOffsets[0];
+			for (dInt32 i = threadIndex; i < count; i += threadCount)
+			{
+				ndBodyState& state = me->m_current.m_bodies[i];
+				const ndBodyKinematic* const body = me->m_bodyArray[i];
+				const dInt32 baseIndex = base.m_valid ? FindBody(base, body->GetId()) : -1;
+
+				// the sleep state is not a proof of rest, the solver sets the equilibrium
+				// flag on bodies without mass and on kinematic bodies the application moves
+				me->Quantize(state, body);
+				changed[i] = ((baseIndex < 0) || ChangedGroups(state, base.m_bodies[baseIndex])) ? 1 : 0;
+			}
+		}
+	};
+
+	const dInt32 count = m_bodyArray.GetCount();
+	m_current.m_bodies.SetCount(count);
+	m_recordOffsets.SetCount(count + 1);
+	if (count)
+	{
+		world->GetScene()->SubmitJobs<ndQuantizeBodies>(this);
+	}
+
+	dInt32 exportCount = 0;
+	m_exportList.SetCount(count);
+	for (dInt32 i = 0; i < count; i++)
+	{
+		if (m_recordOffsets[i])
+		{
+			m_exportList[exportCount] = i;
+			exportCount++;
+		}
+	}
+	m_exportList.SetCount(exportCount);
+}
+
+void ndReplicationExporter::FindRemovedBodies()
+{
+	D_TRACKTIME();
+	m_removedCount = 0;
+	m_removedCodes.SetCount(0);
+	if (!m_base.m_valid)
+	{
+		return;
+	}
+
+	// both frames are sorted by id
+	dInt32 j = 0;
+	dUnsigned32 lastId = 0;
+	const dInt32 currentCount = m_current.m_bodies.GetCount();
+	m_removedCodes.SetCount(m_base.m_bodies.GetCount() * 5);
+	dUnsigned8* ptr = m_removedCodes.GetCount() ? &m_removedCodes[0] : nullptr;
+	for (dInt32 i = 0; i < m_base.m_bodies.GetCount(); i++)
+	{
+		const dUnsigned32 id = m_base.m_bodies[i].m_id;
+		while ((j < currentCount) && (m_current.m_bodies[j].m_id < id))
+		{
+			j++;
+		}
+		if ((j == currentCount) || (m_current.m_bodies[j].m_id != id))
+		{
+			ptr = WriteCode(ptr, id - lastId);
+			lastId = id;
+			m_removedCount++;
+		}
+	}
+	m_removedCodes.SetCount(m_removedCount ? dInt32(ptr - &m_removedCodes[0]) : 0);
+}
+
+dUnsigned8* ndReplicationExporter::EncodeBody(dUnsigned8* ptr, const ndBodyState& state, dUnsigned32 previousId) const
+{
+	ndBodyState zero;
+	memset(&zero, 0, sizeof(zero));
+	const dInt32 baseIndex = m_base.m_valid ? FindBody(m_base, state.m_id) : -1;
+	const ndBodyState& base = (baseIndex >= 0) ? m_base.m_bodies[baseIndex] : zero;
+	const dUnsigned8 mask = ChangedGroups(state, base);
+
+	ptr = WriteCode(ptr, state.m_id - previousId);
+	*ptr++ = mask;
+	for (dInt32 group = 0; group < m_groupCount; group++)
+	{
+		if (mask & (1 << group))
+		{
+			for (dInt32 i = m_groupFields[group]; i < m_groupFields[group + 1]; i++)
+			{
+				ptr = WriteCode(ptr, ZigZag(dInt32(dUnsigned32(state.m_data[i]) - dUnsigned32(base.m_data[i]))));
+			}
+		}
+	}
+	return ptr;
+}
+
+void ndReplicationExporter::EncodeBodies(const ndWorld* const world)
+{
+	D_TRACKTIME();
+	class ndEncodeBodies : public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndReplicationExporter* const me = (ndReplicationExporter*)m_context;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 count = me->m_exportList.GetCount();
+			const ndFrame& current = me->m_current;
+			for (dInt32 i = threadIndex; i < count; i += threadCount)
+			{
+				const ndBodyState& state = current.m_bodies[me->m_exportList[i]];
+				const dUnsigned32 previousId = i ? current.m_bodies[me->m_exportList[i - 1]].m_id : 0;
+				dUnsigned8* const ptr = &me->m_records[i * D_REPLICATION_MAX_RECORD];
+				const dUnsigned8* const end = me->EncodeBody(ptr, state, previousId);
+				dAssert((end - ptr) <= D_REPLICATION_MAX_RECORD);
+				me->m_recordOffsets[i] = dInt32(end - ptr);
+			}
+		}
+	};
+
+	const dInt32 count = m_exportList.GetCount();
+	m_records.SetCount(count * D_REPLICATION_MAX_RECORD);
+	if (count)
+	{
+		world->GetScene()->SubmitJobs<ndEncodeBodies>(this);
+	}
+
+	// the records go after the header and the removed ids
+	dInt32 offset = sizeof(ndHeader) + m_removedCodes.GetCount();
+	for (dInt32 i = 0; i < count; i++)
+	{
+		const dInt32 size = m_recordOffsets[i];
+		m_recordOffsets[i] = offset;
+		offset += size;
+	}
+	m_recordOffsets[count] = offset;
+	m_packetSize = offset;
+}
+
+void ndReplicationExporter::WritePacket(const ndWorld* const world, dUnsigned8* const buffer)
+{
+	D_TRACKTIME();
+	class ndCopyRecords : public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndReplicationExporter* const me = (ndReplicationExporter*)m_context;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 count = me->m_exportList.GetCount();
+			const dInt32* const offsets = &me->m_recordOffsets[0];
+			for (dInt32 i = threadIndex; i < count; i += threadCount)
+			{
+				memcpy(&me->m_packet[offsets[i]], &me->m_records[i * D_REPLICATION_MAX_RECORD], size_t(offsets[i + 1] - offsets[i]));
+			}
+		}
+	};
+
+	ndHeader header;
+	header.m_sequence = m_current.m_sequence;
+	header.m_baseSequence = GetBaseSequence();
+	header.m_bodyCount = m_exportList.GetCount();
+	header.m_removedCount = m_removedCount;
+	memcpy(buffer, &header, sizeof(header));
+	if (m_removedCodes.GetCount())
+	{
+		memcpy(buffer + sizeof(header), &m_removedCodes[0], size_t(m_removedCodes.GetCount()));
+	}
+
+	m_packet = buffer;
+	if (m_exportList.GetCount())
+	{
+		world->GetScene()->SubmitJobs<ndCopyRecords>(this);
+	}
+	m_packet = nullptr;
+}
+
+dInt64 ndReplicationExporter::Export(const ndWorld* const world, void* const buffer, dInt64 capacity)
+{
+	D_TRACKTIME();
+	const dUnsigned32 sequence = m_sequence + 1;
+
+	// the client only keeps the last few frames it decoded
+	if (m_base.m_valid && ((sequence - m_base.m_sequence) >= D_REPLICATION_HISTORY))
+	{
+		m_base.m_valid = false;
+	}
+	m_current.m_sequence = sequence;
+
+	// the worker threads only take jobs inside an update
+	ndScene* const scene = world->GetScene();
+	scene->Begin();
+	GatherBodies(world);
+	QuantizeBodies(world);
+	FindRemovedBodies();
+	EncodeBodies(world);
+	const bool fits = m_packetSize <= capacity;
+	if (fits)
+	{
+		WritePacket(world, (dUnsigned8*)buffer);
+	}
+	scene->End();
+
+	if (!fits)
+	{
+		return -1;
+	}
+
+	// the quantized state of every body is the frame the client will have
+	// after decoding this packet, later packets can be encoded against it
+	ndFrame& frame = GetFrameSlot(sequence);
+	frame.m_bodies.Swap(m_current.m_bodies);
+	frame.m_sequence = sequence;
+	frame.m_valid = true;
+	m_sequence = sequence;
+	return m_packetSize;
+}
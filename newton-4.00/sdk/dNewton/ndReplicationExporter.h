@@ -0,0 +1,91 @@
+/* Copyright (c) <2003-2021> <Julio Jerez, Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef __D_REPLICATION_EXPORTER_H__
+#define __D_REPLICATION_EXPORTER_H__
+
+#include "ndNewtonStdafx.h"
+#include "ndReplication.h"
+
+class ndWorld;
+
+// server end of a replication stream, one exporter per client.
+// each call to Export writes a packet with a new sequence number, the
+// packet is encoded against the last frame the client acknowledged, or
+// holds every body when there is none.
+// export must be called between steps, after ndWorld::Sync.
+class ndReplicationExporter: public ndReplication
+{
+	public:
+	D_NEWTON_API ndReplicationExporter(const dVector& origin, dFloat32 positionStep, dFloat32 velocityStep, dFloat32 omegaStep);
+	D_NEWTON_API virtual ~ndReplicationExporter();
+
+	// size of a buffer that can hold any packet of the world
+	D_NEWTON_API dInt64 CalculateBufferSize(const ndWorld* const world) const;
+
+	// returns the size of the packet, or -1 if it does not fit in the
+	// buffer, in which case nothing is recorded.
+	D_NEWTON_API dInt64 Export(const ndWorld* const world, void* const buffer, dInt64 capacity);
+
+	// the client decoded the packet with this sequence
+	D_NEWTON_API void Acknowledge(dUnsigned32 sequence);
+
+	dUnsigned32 GetSequence() const;
+	dUnsigned32 GetBaseSequence() const;
+	dInt32 GetExportedCount() const;
+
+	private:
+	void GatherBodies(const ndWorld* const world);
+	void QuantizeBodies(const ndWorld* const world);
+	void FindRemovedBodies();
+	void EncodeBodies(const ndWorld* const world);
+	void WritePacket(const ndWorld* const world, dUnsigned8* const buffer);
+	dUnsigned8* EncodeBody(dUnsigned8* ptr, const ndBodyState& state, dUnsigned32 previousId) const;
+
+	ndFrame m_base;
+	ndFrame m_current;
+	dArray<ndBodyKinematic*> m_bodyArray;
+	dArray<dInt32> m_exportList;
+	dArray<dInt32> m_recordOffsets;
+	dArray<dUnsigned8> m_records;
+	dArray<dUnsigned8> m_removedCodes;
+	dUnsigned8* m_packet;
+	dInt32 m_removedCount;
+	dInt64 m_packetSize;
+	dUnsigned32 m_sequence;
+};
+
+inline dUnsigned32 ndReplicationExporter::GetSequence() const
+{
+	return m_sequence;
+}
+
+inline dUnsigned32 ndReplicationExporter::GetBaseSequence() const
+{
+	return m_base.m_valid ? m_base.m_sequence : D_REPLICATION_NO_BASE;
+}
+
+inline dInt32 ndReplicationExporter::GetExportedCount() const
+{
+	return m_exportList.GetCount();
+}
+
+#endif
@@ -0,0 +1,356 @@
+/* Copyright (c) <2003-2021> <Julio Jerez, Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "dCoreStdafx.h"
+#include "ndNewtonStdafx.h"
+#include "ndWorld.h"
+#include "ndReplicationImporter.h"
+
+ndReplicationImporter::ndReplicationImporter(const dVector& origin, dFloat32 positionStep, dFloat32 velocityStep, dFloat32 omegaStep)
+	:ndReplication(origin, positionStep, velocityStep, omegaStep)
+	,m_bodyMap()
+	,m_decoded()
+	,m_records()
+	,m_removed()
+	,m_applyFrame0(nullptr)
+	,m_applyFrame1(nullptr)
+	,m_applyParam(dFloat32(0.0f))
+	,m_lastSequence(0)
+	,m_hasSequence(false)
+{
+}
+
+ndReplicationImporter::~ndReplicationImporter()
+{
+}
+
+void ndReplicationImporter::BindBodies(const ndWorld* const world)
+{
+	const ndBodyList& bodyList = world->GetBodyList();
+	for (ndBodyList::dNode* node = bodyList.GetFirst(); node; node = node->GetNext())
+	{
+		ndBodyKinematic* const body = node->GetInfo();
+		BindBody(body->GetId(), body);
+	}
+}
+
+void ndReplicationImporter::BindBody(dUnsigned32 id, ndBodyKinematic* const body)
+{
+	dTree<ndBodyKinematic*, dUnsigned32>::dNode* const node = m_bodyMap.Find(id);
+	if (node)
+	{
+		node->GetInfo() = body;
+	}
+	else
+	{
+		m_bodyMap.Insert(body, id);
+	}
+}
+
+void ndReplicationImporter::UnbindBody(dUnsigned32 id)
+{
+	m_bodyMap.Remove(id);
+}
+
+bool ndReplicationImporter::Decode(const dUnsigned8* ptr, const dUnsigned8* const end, const ndHeader& header, const ndFrame* const base)
+{
+	D_TRACKTIME();
+	// every code takes at least one byte
+	if ((header.m_removedCount < 0) || (header.m_bodyCount < 0) || ((header.m_removedCount + dInt64(header.m_bodyCount) * 2) > (end - ptr)))
+	{
+		return false;
+	}
+
+	dUnsigned32 id = 0;
+	m_removed.SetCount(header.m_removedCount);
+	for (dInt32 i = 0; i < header.m_removedCount; i++)
+	{
+		dUnsigned32 code;
+		ptr = ReadCode(ptr, end, code);
+		if (!ptr || (i && !code))
+		{
+			return false;
+		}
+		id += code;
+		m_removed[i] = id;
+	}
+
+	ndBodyState zero;
+	memset(&zero, 0, sizeof(zero));
+	const dInt32 baseCount = base ? base->m_bodies.GetCount() : 0;
+
+	id = 0;
+	m_records.SetCount(header.m_bodyCount);
+	for (dInt32 i = 0; i < header.m_bodyCount; i++)
+	{
+		dUnsigned32 code;
+		ptr = ReadCode(ptr, end, code);
+		if (!ptr || (i && !code) || (ptr >= end))
+		{
+			return false;
+		}
+		id += code;
+
+		const dUnsigned8 mask = *ptr++;
+		if (mask >= (1 << m_groupCount))
+		{
+			return false;
+		}
+
+		const dInt32 baseIndex = baseCount ? FindBody(*base, id) : -1;
+		ndBodyState& state = m_records[i];
+		state = (baseIndex >= 0) ? base->m_bodies[baseIndex] : zero;
+		state.m_id = id;
+		for (dInt32 group = 0; group < m_groupCount; group++)
+		{
+			if (mask & (1 << group))
+			{
+				for (dInt32 j = m_groupFields[group]; j < m_groupFields[group + 1]; j++)
+				{
+					ptr = ReadCode(ptr, end, code);
+					if (!ptr)
+					{
+						return false;
+					}
+					state.m_data[j] = dInt32(dUnsigned32(state.m_data[j]) + dUnsigned32(UnZigZag(code)));
+				}
+			}
+		}
+	}
+
+	// the new frame is the base without the removed bodies, with
+	// the records replacing or adding bodies, all sorted by id.
+	dInt32 count = 0;
+	dInt32 baseIndex = 0;
+	dInt32 recordIndex = 0;
+	dInt32 removedIndex = 0;
+	const dInt32 recordCount = m_records.GetCount();
+	const dInt32 removedCount = m_removed.GetCount();
+	m_decoded.m_bodies.SetCount(baseCount + recordCount);
+	while ((baseIndex < baseCount) || (recordIndex < recordCount))
+	{
+		if ((recordIndex < recordCount) && ((baseIndex == baseCount) || (m_records[recordIndex].m_id <= base->m_bodies[baseIndex].m_id)))
+		{
+			if ((baseIndex < baseCount) && (m_records[recordIndex].m_id == base->m_bodies[baseIndex].m_id))
+			{
+				baseIndex++;
+			}
+			m_decoded.m_bodies[count] = m_records[recordIndex];
+			recordIndex++;
+			count++;
+		}
+		else
+		{
+			const dUnsigned32 baseId = base->m_bodies[baseIndex].m_id;
+			while ((removedIndex < removedCount) && (m_removed[removedIndex] < baseId))
+			{
+				removedIndex++;
+			}
+			if ((removedIndex == removedCount) || (m_removed[removedIndex] != baseId))
+			{
+				m_decoded.m_bodies[count] = base->m_bodies[baseIndex];
+				count++;
+			}
+			baseIndex++;
+		}
+	}
+	m_decoded.m_bodies.SetCount(count);
+	return ptr == end;
+}
+
+dInt64 ndReplicationImporter::Import(const void* const packet, dInt64 size)
+{
+	D_TRACKTIME();
+	ndHeader header;
+	if (size < dInt64(sizeof(header)))
+	{
+		return -1;
+	}
+	memcpy(&header, packet, sizeof(header));
+
+	const ndFrame* base = nullptr;
+	if (header.m_baseSequence != D_REPLICATION_NO_BASE)
+	{
+		base = FindFrame(header.m_baseSequence);
+		if (!base || (header.m_baseSequence >= header.m_sequence))
+		{
+			return -1;
+		}
+	}
+
+	// a frame that was already decoded, or older than the one in its slot
+	ndFrame& frame = GetFrameSlot(header.m_sequence);
+	if (frame.m_valid && (frame.m_sequence >= header.m_sequence))
+	{
+		return (frame.m_sequence == header.m_sequence) ? dInt64(header.m_sequence) : -1;
+	}
+	if (base == &frame)
+	{
+		return -1;
+	}
+
+	const dUnsigned8* const ptr = (const dUnsigned8*)packet;
+	if (!Decode(ptr + sizeof(header), ptr + size, header, base))
+	{
+		return -1;
+	}
+
+	frame.m_bodies.Swap(m_decoded.m_bodies);
+	frame.m_sequence = header.m_sequence;
+	frame.m_valid = true;
+	if (!m_hasSequence || (header.m_sequence > m_lastSequence))
+	{
+		m_lastSequence = header.m_sequence;
+		m_hasSequence = true;
+	}
+	return header.m_sequence;
+}
+
+const ndReplication::ndFrame* ndReplicationImporter::FindFrameAtOrBefore(dUnsigned32 sequence) const
+{
+	const ndFrame* best = nullptr;
+	for (dInt32 i = 0; i < D_REPLICATION_HISTORY; i++)
+	{
+		const ndFrame& frame = m_frames[i];
+		if (frame.m_valid && (frame.m_sequence <= sequence) && (!best || (frame.m_sequence > best->m_sequence)))
+		{
+			best = &frame;
+		}
+	}
+	return best;
+}
+
+const ndReplication::ndFrame* ndReplicationImporter::FindFrameAfter(dUnsigned32 sequence) const
+{
+	const ndFrame* best = nullptr;
+	for (dInt32 i = 0; i < D_REPLICATION_HISTORY; i++)
+	{
+		const ndFrame& frame = m_frames[i];
+		if (frame.m_valid && (frame.m_sequence > sequence) && (!best || (frame.m_sequence < best->m_sequence)))
+		{
+			best = &frame;
+		}
+	}
+	return best;
+}
+
+void ndReplicationImporter::ApplyBody(ndBodyKinematic* const body, const ndBodyState& state0, const ndBodyState* const state1, dFloat32 param) const
+{
+	// setting the state wakes the body up, so bodies already where the stream
+	// says are left alone. the streamed sleep flag is not used for this, 
+	// kinematic and teleported bodies are flagged at rest while they move
+	if (!state1 || !memcmp(state0.m_data, state1->m_data, sizeof(state0.m_data)))
+	{
+		ndBodyState current;
+		Quantize(current, body);
+		if (!memcmp(state0.m_data, current.m_data, m_sleepState * sizeof(dInt32)))
+		{
+			return;
+		}
+	}
+
+	dVector posit;
+	dVector veloc;
+	dVector omega;
+	dQuaternion rotation;
+	Dequantize(state0, posit, rotation, veloc, omega);
+	if (state1)
+	{
+		dVector posit1;
+		dVector veloc1;
+		dVector omega1;
+		dQuaternion rotation1;
+		Dequantize(*state1, posit1, rotation1, veloc1, omega1);
+
+		// slerp does not pick the shorter arc
+		if (rotation.DotProduct(rotation1).GetScalar() < dFloat32(0.0f))
+		{
+			rotation1 = rotation1.Scale(dFloat32(-1.0f));
+		}
+		posit += (posit1 - posit).Scale(param);
+		veloc += (veloc1 - veloc).Scale(param);
+		omega += (omega1 - omega).Scale(param);
+		rotation = rotation.Slerp(rotation1, param);
+	}
+
+	body->SetMatrix(dMatrix(rotation, posit));
+	body->SetVelocity(veloc);
+	body->SetOmega(omega);
+}
+
+void ndReplicationImporter::Apply(ndWorld* const world, dFloat64 frameTime)
+{
+	D_TRACKTIME();
+	class ndApplyBodies : public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndReplicationImporter* const me = (ndReplicationImporter*)m_context;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const ndFrame* const frame0 = me->m_applyFrame0;
+			const ndFrame* const frame1 = me->m_applyFrame1;
+			const dInt32 count = frame0->m_bodies.GetCount();
+			for (dInt32 i = threadIndex; i < count; i += threadCount)
+			{
+				const ndBodyState& state0 = frame0->m_bodies[i];
+				dTree<ndBodyKinematic*, dUnsigned32>::dNode* const node = me->m_bodyMap.Find(state0.m_id);
+				if (node)
+				{
+					const dInt32 index1 = frame1 ? FindBody(*frame1, state0.m_id) : -1;
+					const ndBodyState* const state1 = (index1 >= 0) ? &frame1->m_bodies[index1] : nullptr;
+					me->ApplyBody(node->GetInfo(), state0, state1, me->m_applyParam);
+				}
+			}
+		}
+	};
+
+	if (frameTime < dFloat64(0.0f))
+	{
+		return;
+	}
+
+	// lost packets leave gaps, interpolate across them
+	const dFloat64 sequence = floor(frameTime);
+	m_applyFrame0 = FindFrameAtOrBefore(dUnsigned32(sequence));
+	if (!m_applyFrame0 || !m_applyFrame0->m_bodies.GetCount())
+	{
+		return;
+	}
+	m_applyFrame1 = FindFrameAfter(m_applyFrame0->m_sequence);
+	m_applyParam = dFloat32(0.0f);
+	if (m_applyFrame1)
+	{
+		const dFloat64 span = dFloat64(m_applyFrame1->m_sequence - m_applyFrame0->m_sequence);
+		const dFloat64 param = (frameTime - dFloat64(m_applyFrame0->m_sequence)) / span;
+		m_applyParam = dFloat32(dClamp(param, dFloat64(0.0f), dFloat64(1.0f)));
+	}
+
+	ndScene* const scene = world->GetScene();
+	scene->Begin();
+	scene->SubmitJobs<ndApplyBodies>(this);
+	scene->End();
+
+	m_applyFrame0 = nullptr;
+	m_applyFrame1 = nullptr;
+}
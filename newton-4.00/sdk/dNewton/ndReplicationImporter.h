@@ -0,0 +1,78 @@
+/* Copyright (c) <2003-2021> <Julio Jerez, Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef __D_REPLICATION_IMPORTER_H__
+#define __D_REPLICATION_IMPORTER_H__
+
+#include "ndNewtonStdafx.h"
+#include "ndReplication.h"
+
+class ndWorld;
+
+// client end of a replication stream.
+// bodies in the stream are matched to local bodies by id, the sequence
+// returned by Import is what the client sends back to be acknowledged.
+class ndReplicationImporter: public ndReplication
+{
+	public:
+	D_NEWTON_API ndReplicationImporter(const dVector& origin, dFloat32 positionStep, dFloat32 velocityStep, dFloat32 omegaStep);
+	D_NEWTON_API virtual ~ndReplicationImporter();
+
+	// binds every body of the world to its own id, for worlds
+	// created the same way on both ends
+	D_NEWTON_API void BindBodies(const ndWorld* const world);
+	D_NEWTON_API void BindBody(dUnsigned32 id, ndBodyKinematic* const body);
+	D_NEWTON_API void UnbindBody(dUnsigned32 id);
+
+	// returns the sequence of the packet, or -1 if the packet is corrupted,
+	// older than the frames kept or the frame it is encoded against is gone.
+	D_NEWTON_API dInt64 Import(const void* const packet, dInt64 size);
+
+	// moves the bound bodies to the state at frameTime, in sequence units,
+	// interpolating between the two decoded frames around it.
+	// must be called between steps.
+	D_NEWTON_API void Apply(ndWorld* const world, dFloat64 frameTime);
+
+	dUnsigned32 GetLastSequence() const;
+
+	private:
+	bool Decode(const dUnsigned8* ptr, const dUnsigned8* const end, const ndHeader& header, const ndFrame* const base);
+	void ApplyBody(ndBodyKinematic* const body, const ndBodyState& state0, const ndBodyState* const state1, dFloat32 param) const;
+	const ndFrame* FindFrameAtOrBefore(dUnsigned32 sequence) const;
+	const ndFrame* FindFrameAfter(dUnsigned32 sequence) const;
+
+	dTree<ndBodyKinematic*, dUnsigned32> m_bodyMap;
+	ndFrame m_decoded;
+	dArray<ndBodyState> m_records;
+	dArray<dUnsigned32> m_removed;
+	const ndFrame* m_applyFrame0;
+	const ndFrame* m_applyFrame1;
+	dFloat32 m_applyParam;
+	dUnsigned32 m_lastSequence;
+	bool m_hasSequence;
+};
+
+inline dUnsigned32 ndReplicationImporter::GetLastSequence() const
+{
+	return m_lastSequence;
+}
+
+#endif
@@ -32,6 +32,7 @@
 #include "ndDynamicsUpdateAvx2.h"
 #include "ndDynamicsUpdateOpencl.h"
 #include "ndJointBilateralConstraint.h"
+#include "ndWorldSnapshot.h"
 
 class ndSkeletonQueue : public dFixSizeArray<ndSkeletonContainer::ndNode*, 1024 * 4>
 {
@@ -240,10 +241,8 @@ void ndWorld::ClearCache()
 	ndJointList::FlushFreeList();
 	ndContactList::FlushFreeList();
 	ndSkeletonList::FlushFreeList();
-	ndContactPointList::FlushFreeList();
 	ndBodyParticleSetList::FlushFreeList();
-	ndScene::ndFitnessList::FlushFreeList();
-	dIsoSurface::dIsoVertexMap::FlushFreeList();
+	ndFitnessList::FlushFreeList();
 	ndBodyKinematic::ndContactMap::FlushFreeList();
 	ndSkeletonContainer::ndNodeList::FlushFreeList();
 }
@@ -328,6 +327,33 @@ void ndWorld::RemoveBody(ndBody* const body)
 	}
 }
 
+ndSceneAggregate* ndWorld::CreateAggregate()
+{
+	dAssert(!m_inUpdate);
+	return m_scene->CreateAggregate();
+}
+
+void ndWorld::DestroyAggregate(ndSceneAggregate* const aggregate)
+{
+	dAssert(!m_inUpdate);
+	m_scene->DestroyAggregate(aggregate);
+}
+
+bool ndWorld::AddToAggregate(ndSceneAggregate* const aggregate, ndBody* const body)
+{
+	dAssert(!m_inUpdate);
+	ndBodyKinematic* const kinematicBody = body->GetAsBodyKinematic();
+	dAssert(kinematicBody != m_sentinelBody);
+	return kinematicBody ? m_scene->AddToAggregate(aggregate, kinematicBody) : false;
+}
+
+bool ndWorld::RemoveFromAggregate(ndSceneAggregate* const aggregate, ndBody* const body)
+{
+	dAssert(!m_inUpdate);
+	ndBodyKinematic* const kinematicBody = body->GetAsBodyKinematic();
+	return kinematicBody ? m_scene->RemoveFromAggregate(aggregate, kinematicBody) : false;
+}
+
 void ndWorld::DeleteBody(ndBody* const body)
 {
 	dAssert(!m_inUpdate);
@@ -557,6 +583,45 @@ void ndWorld::Load(const char* const path)
 	setlocale(LC_ALL, oldloc);
 }
 
+bool ndWorld::SaveSnapshot(const char* const path, bool compress) const
+{
+	dArray<dUnsigned8> image;
+	ndWorldSnapshot::Save(this, image, compress);
+	if (!image.GetCount())
+	{
+		return false;
+	}
+
+	FILE* const file = fopen(path, "wb");
+	if (!file)
+	{
+		return false;
+	}
+	// a short write or a failed flush leaves a truncated file, that LoadSnapshot rejects
+	bool state = fwrite(&image[0], size_t(image.GetCount()), 1, file) == 1;
+	state = (fclose(file) == 0) && state;
+	return state;
+}
+
+bool ndWorld::LoadSnapshot(const void* const image, dInt64 size)
+{
+	dAssert(!m_inUpdate);
+	return ndWorldSnapshot::Load(this, image, size);
+}
+
+bool ndWorld::LoadSnapshot(const char* const path)
+{
+	// the file is mapped, so uncompressed sections are read without extra copies
+	bool state = false;
+	dMappedFile* const file = dMappedFile::Open(path);
+	if (file)
+	{
+		state = LoadSnapshot(file->GetData(), file->GetSize());
+		file->Release();
+	}
+	return state;
+}
+
 void ndWorld::LoadSettings(const nd::TiXmlNode* const)
 {
 	//const nd::TiXmlNode* const settings = rootNode->FirstChild("settings");
@@ -769,7 +834,7 @@ void ndWorld::ParticleUpdate()
 	for (ndBodyParticleSetList::dNode* node = m_particleSetList.GetFirst(); node; node = node->GetNext())
 	{
 		ndBodyParticleSet* const body = node->GetInfo();
-		body->Update(this, m_timestep);
+		body->Update(this, m_scene->GetTimestep());
 	}
 }
 
@@ -1158,6 +1223,11 @@ bool ndWorld::ConvexCast(ndConvexCastNotify& callback, const ndShapeInstance& co
 	return m_scene->ConvexCast(callback, convexShape, globalOrigin, globalDest);
 }
 
+void ndWorld::ConvexCastBatch(ndConvexCastQuery* const queries, dInt32 count)
+{
+	m_scene->ConvexCastBatch(queries, count);
+}
+
 void ndWorld::BodiesInAabb(ndBodiesInAabbNotify& callback) const
 {
 	m_scene->BodiesInAabb(callback);
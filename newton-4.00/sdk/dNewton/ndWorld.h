@@ -34,6 +34,7 @@ class ndBodyDynamic;
 class ndRayCastNotify;
 class ndDynamicsUpdate;
 class ndConvexCastNotify;
+class ndConvexCastQuery;
 class ndBodiesInAabbNotify;
 class ndJointBilateralConstraint;
 
@@ -76,6 +77,12 @@ class ndWorld: public dClassAlloc
 	dInt32 GetSubSteps() const;
 	void SetSubSteps(dInt32 subSteps);
 
+	// the same scene stepped with the same inputs gives bitwise identical
+	// results with any thread count, it only covers the default solver.
+	// ndTest checks this and measures the cost (determinism_benchmark).
+	bool IsDeterministic() const;
+	void SetDeterministic(bool state);
+
 	ndSolverModes GetSelectedSolver() const;
 	D_NEWTON_API void SelectSolver(ndSolverModes solverMode);
 	D_NEWTON_API const char* GetSolverString() const;
@@ -90,6 +97,11 @@ class ndWorld: public dClassAlloc
 	D_NEWTON_API virtual void AddModel(ndModel* const model);
 	D_NEWTON_API virtual void RemoveModel(ndModel* const model);
 
+	D_NEWTON_API ndSceneAggregate* CreateAggregate();
+	D_NEWTON_API void DestroyAggregate(ndSceneAggregate* const aggregate);
+	D_NEWTON_API bool AddToAggregate(ndSceneAggregate* const aggregate, ndBody* const body);
+	D_NEWTON_API bool RemoveFromAggregate(ndSceneAggregate* const aggregate, ndBody* const body);
+
 	D_NEWTON_API void Load(const char* const path);
 	D_NEWTON_API void Load(const nd::TiXmlElement* const rootNode, const char* const assetPath);
 	D_NEWTON_API virtual ndBody* LoadUserDefinedBody(const nd::TiXmlNode* const parentNode, const char* const bodyClassName, dTree<const ndShape*, dUnsigned32>& shapesCache, const char* const assetPath) const;
@@ -97,6 +109,10 @@ class ndWorld: public dClassAlloc
 	D_NEWTON_API void Save(const char* const path) const;
 	D_NEWTON_API void Save(nd::TiXmlElement* const rootNode, const char* const assetPath) const;
 
+	D_NEWTON_API bool SaveSnapshot(const char* const path, bool compress = false) const;
+	D_NEWTON_API bool LoadSnapshot(const char* const path);
+	D_NEWTON_API bool LoadSnapshot(const void* const image, dInt64 size);
+
 	const ndBodyList& GetBodyList() const;
 	const ndJointList& GetJointList() const;
 	const ndModelList& GetModelList() const;
@@ -125,6 +141,8 @@ class ndWorld: public dClassAlloc
 	D_NEWTON_API void BodiesInAabb(ndBodiesInAabbNotify& callback) const;
 	D_NEWTON_API bool RayCast(ndRayCastNotify& callback, const dVector& globalOrigin, const dVector& globalDest) const;
 	D_NEWTON_API bool ConvexCast(ndConvexCastNotify& callback, const ndShapeInstance& convexShape, const dMatrix& globalOrigin, const dVector& globalDest) const;
+	// see ndScene::ConvexCastBatch, the notify callbacks run on worker threads
+	D_NEWTON_API void ConvexCastBatch(ndConvexCastQuery* const queries, dInt32 count);
 
 	private:
 	void ThreadFunction();
@@ -201,6 +219,7 @@ class ndWorld: public dClassAlloc
 	friend class ndDynamicsUpdateAvx2;
 	friend class ndDynamicsUpdateOpencl;
 	friend class ndWorldSegregatedScene;
+	friend class ndWorldCheckpoint;
 } D_GCC_NEWTON_ALIGN_32;
 
 inline void ndWorld::Sync() const
@@ -228,6 +247,16 @@ inline void ndWorld::SetSubSteps(dInt32 subSteps)
 	m_subSteps = dClamp(subSteps, 1, 16);
 }
 
+inline bool ndWorld::IsDeterministic() const
+{
+	return m_scene->IsDeterministic();
+}
+
+inline void ndWorld::SetDeterministic(bool state)
+{
+	m_scene->SetDeterministic(state);
+}
+
 inline ndScene* ndWorld::GetScene() const
 {
 	return m_scene;
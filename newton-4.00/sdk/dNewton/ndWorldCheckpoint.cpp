@@ -0,0 +1,613 @@
+/* Copyright (c) <2003-2021> <Julio Jerez, Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "dCoreStdafx.h"
+#include "ndNewtonStdafx.h"
+#include "ndWorld.h"
+#include "ndBodyDynamic.h"
+#include "ndWorldCheckpoint.h"
+
+ndWorldCheckpoint::ndWorldCheckpoint()
+	:dClassAlloc()
+	,m_bodies()
+	,m_contacts()
+	,m_contactPoints()
+	,m_joints()
+	,m_bodyScans()
+	,m_contactRefs()
+	,m_base(nullptr)
+	,m_frameIndex(0)
+	,m_sceneLru(0)
+{
+}
+
+ndWorldCheckpoint::~ndWorldCheckpoint()
+{
+}
+
+void ndWorldCheckpoint::Reserve(dInt32 bodies, dInt32 contacts, dInt32 contactPoints, dInt32 joints)
+{
+	m_bodies.Resize(dMax(bodies, m_bodies.GetCapacity()));
+	m_bodyScans.Resize(dMax(bodies + 1, m_bodyScans.GetCapacity()));
+	m_contacts.Resize(dMax(contacts, m_contacts.GetCapacity()));
+	m_contactRefs.Resize(dMax(contacts, m_contactRefs.GetCapacity()));
+	m_contactPoints.Resize(dMax(contactPoints, m_contactPoints.GetCapacity()));
+	m_joints.Resize(dMax(joints, m_joints.GetCapacity()));
+}
+
+dInt64 ndWorldCheckpoint::GetSize() const
+{
+	return
+		dInt64(m_bodies.GetCount()) * sizeof(ndBodyState) +
+		dInt64(m_contacts.GetCount()) * sizeof(ndContactState) +
+		dInt64(m_contactPoints.GetCount()) * sizeof(ndContactMaterial) +
+		dInt64(m_joints.GetCount()) * sizeof(ndJointState);
+}
+
+void ndWorldCheckpoint::SaveBody(ndBodyState& state, const ndBodyKinematic* const body)
+{
+	// the padding is cleared so that records can be compared as memory
+	memset(&state, 0, sizeof(ndBodyState));
+	state.m_body = (ndBodyKinematic*)body;
+	state.m_matrix = body->m_matrix;
+	state.m_shapeMatrix = body->m_shapeInstance.GetGlobalMatrix();
+	state.m_invWorldInertiaMatrix = body->m_invWorldInertiaMatrix;
+	state.m_rotation = body->m_rotation;
+	state.m_gyroRotation = body->m_gyroRotation;
+	state.m_veloc = body->m_veloc;
+	state.m_omega = body->m_omega;
+	state.m_globalCentreOfMass = body->m_globalCentreOfMass;
+	state.m_minAabb = body->m_minAabb;
+	state.m_maxAabb = body->m_maxAabb;
+	state.m_residualVeloc = body->m_residualVeloc;
+	state.m_residualOmega = body->m_residualOmega;
+	state.m_gyroAlpha = body->m_gyroAlpha;
+	state.m_gyroTorque = body->m_gyroTorque;
+	state.m_flags = body->m_flags;
+	state.m_sleepingCounter = body->m_sleepingCounter;
+
+	const ndBodyDynamic* const dynBody = state.m_body->GetAsBodyDynamic();
+	if (dynBody)
+	{
+		state.m_accel = dynBody->m_accel;
+		state.m_alpha = dynBody->m_alpha;
+		state.m_externalForce = dynBody->m_externalForce;
+		state.m_externalTorque = dynBody->m_externalTorque;
+		state.m_impulseForce = dynBody->m_impulseForce;
+		state.m_impulseTorque = dynBody->m_impulseTorque;
+		state.m_savedExternalForce = dynBody->m_savedExternalForce;
+		state.m_savedExternalTorque = dynBody->m_savedExternalTorque;
+	}
+
+	const ndSceneBodyNode* const bodyNode = body->GetSceneBodyNode();
+	if (bodyNode)
+	{
+		state.m_nodeMinBox = bodyNode->m_minBox;
+		state.m_nodeMaxBox = bodyNode->m_maxBox;
+	}
+}
+
+bool ndWorldCheckpoint::HasBodyChanged(const ndBodyState& state, const ndBodyKinematic* const body)
+{
+	ndBodyState current;
+	SaveBody(current, body);
+	current.m_slot = state.m_slot;
+	return memcmp(&current, &state, sizeof(ndBodyState)) ? true : false;
+}
+
+void ndWorldCheckpoint::SaveBodies(const ndWorld* const world)
+{
+	D_TRACKTIME();
+	class ndSaveBodies : public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndWorldCheckpoint* const me = (ndWorldCheckpoint*)m_context;
+			const ndWorldCheckpoint* const base = me->m_base;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32* const scans = base ? &me->m_bodyScans[0] : nullptr;
+
+			dInt32 index = threadIndex;
+			ndBodyList::dNode* node = m_owner->GetBodyList().GetFirst();
+			for (dInt32 i = 0; i < threadIndex; i++)
+			{
+				node = node ? node->GetNext() : nullptr;
+			}
+
+			while (node)
+			{
+				const ndBodyKinematic* const body = node->GetInfo();
+				if (!base)
+				{
+					SaveBody(me->m_bodies[index], body);
+					me->m_bodies[index].m_slot = index;
+				}
+				else if (scans[index + 1] != scans[index])
+				{
+					ndBodyState& state = me->m_bodies[scans[index]];
+					SaveBody(state, body);
+					state.m_slot = index;
+				}
+
+				index += threadCount;
+				for (dInt32 i = 0; i < threadCount; i++)
+				{
+					node = node ? node->GetNext() : nullptr;
+				}
+			}
+		}
+	};
+
+	class ndCompareBodies : public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndWorldCheckpoint* const me = (ndWorldCheckpoint*)m_context;
+			const ndWorldCheckpoint* const base = me->m_base;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 baseCount = base->m_bodies.GetCount();
+			dInt32* const changed = &me->m_bodyScans[0];
+
+			dInt32 index = threadIndex;
+			ndBodyList::dNode* node = m_owner->GetBodyList().GetFirst();
+			for (dInt32 i = 0; i < threadIndex; i++)
+			{
+				node = node ? node->GetNext() : nullptr;
+			}
+
+			while (node)
+			{
+				const ndBodyKinematic* const body = node->GetInfo();
+				const ndBodyState* const state = (index < baseCount) ? &base->m_bodies[index] : nullptr;
+				const bool sameBody = state && (state->m_body == body);
+				changed[index] = (sameBody && !HasBodyChanged(*state, body)) ? 0 : 1;
+
+				index += threadCount;
+				for (dInt32 i = 0; i < threadCount; i++)
+				{
+					node = node ? node->GetNext() : nullptr;
+				}
+			}
+		}
+	};
+
+	ndScene* const scene = world->GetScene();
+	const dInt32 bodyCount = scene->GetBodyList().GetCount();
+	if (!m_base)
+	{
+		m_bodies.SetCount(bodyCount);
+		scene->SubmitJobs<ndSaveBodies>(this);
+		return;
+	}
+
+	dAssert(!m_base->m_base);
+	dAssert(m_base->m_bodies.GetCount() == bodyCount);
+	m_bodyScans.SetCount(bodyCount + 1);
+	scene->SubmitJobs<ndCompareBodies>(this);
+
+	dInt32 sum = 0;
+	for (dInt32 i = 0; i <= bodyCount; i++)
+	{
+		const dInt32 count = (i < bodyCount) ? m_bodyScans[i] : 0;
+		m_bodyScans[i] = sum;
+		sum += count;
+	}
+
+	m_bodies.SetCount(sum);
+	if (sum)
+	{
+		scene->SubmitJobs<ndSaveBodies>(this);
+	}
+}
+
+void ndWorldCheckpoint::SaveContacts(const ndWorld* const world)
+{
+	D_TRACKTIME();
+	class ndSaveContacts : public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndWorldCheckpoint* const me = (ndWorldCheckpoint*)m_context;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 count = me->m_contacts.GetCount();
+			for (dInt32 i = threadIndex; i < count; i += threadCount)
+			{
+				const ndContact* const contact = me->m_contactRefs[i];
+				ndContactState& state = me->m_contacts[i];
+				state.m_positAcc = contact->m_positAcc;
+				state.m_rotationAcc = contact->m_rotationAcc;
+				state.m_separatingVector = contact->m_separatingVector;
+				state.m_manifoldRotation = contact->m_manifoldRotation;
+				state.m_material = contact->m_material;
+				state.m_body0 = contact->m_body0;
+				state.m_body1 = contact->m_body1;
+				state.m_timeOfImpact = contact->m_timeOfImpact;
+				state.m_separationDistance = contact->m_separationDistance;
+				state.m_contactPruningTolereance = contact->m_contactPruningTolereance;
+				state.m_maxDOF = contact->m_maxDOF;
+				state.m_sceneLru = contact->m_sceneLru;
+				state.m_active = contact->m_active;
+				state.m_isIntersetionTestOnly = contact->m_isIntersetionTestOnly ? true : false;
+
+				const ndContactPointList& points = contact->m_contacPointsList;
+				ndContactMaterial* const dst = &me->m_contactPoints[state.m_pointStart];
+				for (dInt32 j = 0; j < state.m_pointCount; j++)
+				{
+					dst[j] = points[j];
+				}
+			}
+		}
+	};
+
+	// the points of each contact are stored after the points of the previous one
+	ndScene* const scene = world->GetScene();
+	const ndContactList& contactList = scene->m_contactList;
+	m_contacts.SetCount(contactList.GetCount());
+	m_contactRefs.SetCount(contactList.GetCount());
+
+	dInt32 index = 0;
+	dInt32 pointCount = 0;
+	for (ndContactList::dNode* node = contactList.GetFirst(); node; node = node->GetNext())
+	{
+		ndContact* const contact = &node->GetInfo();
+		m_contactRefs[index] = contact;
+		m_contacts[index].m_pointStart = pointCount;
+		m_contacts[index].m_pointCount = contact->m_contacPointsList.GetCount();
+		pointCount += contact->m_contacPointsList.GetCount();
+		index++;
+	}
+	m_contactPoints.SetCount(pointCount);
+
+	if (index)
+	{
+		scene->SubmitJobs<ndSaveContacts>(this);
+	}
+}
+
+void ndWorldCheckpoint::SaveJoints(const ndWorld* const world)
+{
+	D_TRACKTIME();
+	class ndSaveJoints : public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			ndWorldCheckpoint* const me = (ndWorldCheckpoint*)m_context;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+
+			dInt32 index = threadIndex;
+			ndJointList::dNode* node = m_owner->GetWorld()->GetJointList().GetFirst();
+			for (dInt32 i = 0; i < threadIndex; i++)
+			{
+				node = node ? node->GetNext() : nullptr;
+			}
+
+			while (node)
+			{
+				const ndJointBilateralConstraint* const joint = node->GetInfo();
+				ndJointState& state = me->m_joints[index];
+				state.m_forceBody0 = joint->m_forceBody0;
+				state.m_torqueBody0 = joint->m_torqueBody0;
+				state.m_forceBody1 = joint->m_forceBody1;
+				state.m_torqueBody1 = joint->m_torqueBody1;
+				for (dInt32 i = 0; i < DG_BILATERAL_CONTRAINT_DOF; i++)
+				{
+					state.m_jointForce[i] = joint->m_jointForce[i];
+					state.m_motorAcceleration[i] = joint->m_motorAcceleration[i];
+				}
+				state.m_joint = (ndJointBilateralConstraint*)joint;
+				state.m_active = joint->m_active;
+
+				index += threadCount;
+				for (dInt32 i = 0; i < threadCount; i++)
+				{
+					node = node ? node->GetNext() : nullptr;
+				}
+			}
+		}
+	};
+
+	m_joints.SetCount(world->GetJointList().GetCount());
+	if (m_joints.GetCount())
+	{
+		world->GetScene()->SubmitJobs<ndSaveJoints>(this);
+	}
+}
+
+void ndWorldCheckpoint::Save(const ndWorld* const world)
+{
+	Save(world, nullptr);
+}
+
+void ndWorldCheckpoint::Save(const ndWorld* const world, const ndWorldCheckpoint* const base)
+{
+	D_TRACKTIME();
+	dAssert(base != this);
+	m_base = base;
+	ndScene* const scene = world->GetScene();
+	m_frameIndex = world->m_frameIndex;
+	m_sceneLru = scene->m_lru;
+
+	// the worker threads only take jobs inside an update
+	scene->Begin();
+	SaveBodies(world);
+	SaveContacts(world);
+	SaveJoints(world);
+	scene->End();
+}
+
+void ndWorldCheckpoint::RestoreBody(ndScene* const scene, const ndBodyState& state)
+{
+	ndBodyKinematic* const body = state.m_body;
+	const bool moved = memcmp(&body->m_matrix, &state.m_matrix, sizeof(dMatrix)) ? true : false;
+
+	body->m_matrix = state.m_matrix;
+	body->m_shapeInstance.SetGlobalMatrix(state.m_shapeMatrix);
+	body->m_invWorldInertiaMatrix = state.m_invWorldInertiaMatrix;
+	body->m_rotation = state.m_rotation;
+	body->m_gyroRotation = state.m_gyroRotation;
+	body->m_veloc = state.m_veloc;
+	body->m_omega = state.m_omega;
+	body->m_globalCentreOfMass = state.m_globalCentreOfMass;
+	body->m_minAabb = state.m_minAabb;
+	body->m_maxAabb = state.m_maxAabb;
+	body->m_residualVeloc = state.m_residualVeloc;
+	body->m_residualOmega = state.m_residualOmega;
+	body->m_gyroAlpha = state.m_gyroAlpha;
+	body->m_gyroTorque = state.m_gyroTorque;
+	const dUnsigned32 transformIsDirty = body->m_transformIsDirty;
+	body->m_flags = state.m_flags;
+	body->m_transformIsDirty = transformIsDirty;
+	body->m_sleepingCounter = state.m_sleepingCounter;
+
+	ndBodyDynamic* const dynBody = body->GetAsBodyDynamic();
+	if (dynBody)
+	{
+		dynBody->m_accel = state.m_accel;
+		dynBody->m_alpha = state.m_alpha;
+		dynBody->m_externalForce = state.m_externalForce;
+		dynBody->m_externalTorque = state.m_externalTorque;
+		dynBody->m_impulseForce = state.m_impulseForce;
+		dynBody->m_impulseTorque = state.m_impulseTorque;
+		dynBody->m_savedExternalForce = state.m_savedExternalForce;
+		dynBody->m_savedExternalTorque = state.m_savedExternalTorque;
+	}
+
+	if (moved)
+	{
+		// the transform callback is called on the next update
+		body->m_transformIsDirty = 1;
+	}
+
+	ndSceneBodyNode* const bodyNode = body->GetSceneBodyNode();
+	if (bodyNode)
+	{
+		const dVector mask((bodyNode->m_minBox == state.m_nodeMinBox) & (bodyNode->m_maxBox == state.m_nodeMaxBox));
+		if (mask.GetSignMask() != 0x0f)
+		{
+			bodyNode->m_minBox = state.m_nodeMinBox;
+			bodyNode->m_maxBox = state.m_nodeMaxBox;
+			scene->UpdateParentsAabb(bodyNode);
+		}
+	}
+}
+
+void ndWorldCheckpoint::RestoreBodies(ndWorld* const world)
+{
+	D_TRACKTIME();
+	class ndRestoreBodies : public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			const ndWorldCheckpoint* const me = (ndWorldCheckpoint*)m_context;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 count = me->m_bodies.GetCount();
+			for (dInt32 i = threadIndex; i < count; i += threadCount)
+			{
+				RestoreBody(m_owner, me->m_bodies[i]);
+			}
+		}
+	};
+
+	class ndRestoreDeltaBodies : public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			const ndWorldCheckpoint* const me = (ndWorldCheckpoint*)m_context;
+			const ndWorldCheckpoint* const base = me->m_base;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 count = base->m_bodies.GetCount();
+			const dInt32* const scans = &me->m_bodyScans[0];
+			for (dInt32 i = threadIndex; i < count; i += threadCount)
+			{
+				if (scans[i + 1] != scans[i])
+				{
+					RestoreBody(m_owner, me->m_bodies[scans[i]]);
+				}
+				else
+				{
+					// the body was at the base state when the delta was saved
+					const ndBodyState& state = base->m_bodies[i];
+					if (HasBodyChanged(state, state.m_body))
+					{
+						RestoreBody(m_owner, state);
+					}
+				}
+			}
+		}
+	};
+
+	if (m_base)
+	{
+		world->GetScene()->SubmitJobs<ndRestoreDeltaBodies>(this);
+	}
+	else if (m_bodies.GetCount())
+	{
+		world->GetScene()->SubmitJobs<ndRestoreBodies>(this);
+	}
+}
+
+void ndWorldCheckpoint::RestoreContacts(ndWorld* const world)
+{
+	D_TRACKTIME();
+	class ndRestoreContacts : public ndScene::ndBaseJob
+	{
+		public:
+		virtual void Execute()
+		{
+			D_TRACKTIME();
+			const ndWorldCheckpoint* const me = (ndWorldCheckpoint*)m_context;
+			const dInt32 threadIndex = GetThreadId();
+			const dInt32 threadCount = m_owner->GetThreadCount();
+			const dInt32 count = me->m_contacts.GetCount();
+			for (dInt32 i = threadIndex; i < count; i += threadCount)
+			{
+				const ndContactState& state = me->m_contacts[i];
+				ndContact* const contact = me->m_contactRefs[i];
+				dAssert(contact->m_body0 == state.m_body0);
+
+				contact->m_positAcc = state.m_positAcc;
+				contact->m_rotationAcc = state.m_rotationAcc;
+				contact->m_separatingVector = state.m_separatingVector;
+				contact->m_manifoldRotation = state.m_manifoldRotation;
+				contact->m_material = state.m_material;
+				contact->m_timeOfImpact = state.m_timeOfImpact;
+				contact->m_separationDistance = state.m_separationDistance;
+				contact->m_contactPruningTolereance = state.m_contactPruningTolereance;
+				contact->m_maxDOF = state.m_maxDOF;
+				contact->m_sceneLru = state.m_sceneLru;
+				contact->m_active = state.m_active;
+				contact->m_isIntersetionTestOnly = state.m_isIntersetionTestOnly ? 1 : 0;
+
+				ndContactPointList& points = contact->m_contacPointsList;
+				const ndContactMaterial* const src = &me->m_contactPoints[state.m_pointStart];
+				points.SetCount(state.m_pointCount);
+				for (dInt32 j = 0; j < state.m_pointCount; j++)
+				{
+					points[j] = src[j];
+				}
+			}
+		}
+	};
+
+	// contacts that did not exist at the checkpoint stay marked and are deleted
+	ndScene* const scene = world->GetScene();
+	ndContactList& contactList = scene->m_contactList;
+	for (ndContactList::dNode* node = contactList.GetFirst(); node; node = node->GetNext())
+	{
+		node->GetInfo().m_isDead = 1;
+	}
+
+	// the body contact maps are not safe to search while another thread
+	// inserts, so the contacts are found or created here
+	m_contactRefs.SetCount(m_contacts.GetCount());
+	for (dInt32 i = 0; i < m_contacts.GetCount(); i++)
+	{
+		const ndContactState& state = m_contacts[i];
+		ndContact* contact = state.m_body0->FindContact(state.m_body1);
+		if (contact && (contact->m_body0 != state.m_body0))
+		{
+			// the pair was found in the other order, the normals would be flipped
+			contactList.DeleteContact(contact);
+			contact = nullptr;
+		}
+		if (!contact)
+		{
+			contact = contactList.CreateContact(state.m_body0, state.m_body1);
+		}
+		contact->m_isDead = 0;
+		m_contactRefs[i] = contact;
+	}
+
+	if (m_contacts.GetCount())
+	{
+		scene->SubmitJobs<ndRestoreContacts>(this);
+	}
+
+	// the list is put back in the saved order, the solver order depends on it
+	for (dInt32 i = 0; i < m_contactRefs.GetCount(); i++)
+	{
+		contactList.RotateToEnd(m_contactRefs[i]->m_linkNode);
+	}
+	for (ndContactList::dNode* node = contactList.GetFirst(); node && node->GetInfo().m_isDead; node = contactList.GetFirst())
+	{
+		scene->DeleteContact(&node->GetInfo());
+	}
+
+	// the active array is rebuilt on the next update
+	scene->m_activeConstraintArray.SetCount(0);
+}
+
+void ndWorldCheckpoint::RestoreJoints(ndWorld* const) const
+{
+	D_TRACKTIME();
+	for (dInt32 i = 0; i < m_joints.GetCount(); i++)
+	{
+		const ndJointState& state = m_joints[i];
+		ndJointBilateralConstraint* const joint = state.m_joint;
+		joint->m_forceBody0 = state.m_forceBody0;
+		joint->m_torqueBody0 = state.m_torqueBody0;
+		joint->m_forceBody1 = state.m_forceBody1;
+		joint->m_torqueBody1 = state.m_torqueBody1;
+		for (dInt32 j = 0; j < DG_BILATERAL_CONTRAINT_DOF; j++)
+		{
+			joint->m_jointForce[j] = state.m_jointForce[j];
+			joint->m_motorAcceleration[j] = state.m_motorAcceleration[j];
+		}
+		joint->m_active = state.m_active;
+	}
+}
+
+void ndWorldCheckpoint::Restore(ndWorld* const world)
+{
+	D_TRACKTIME();
+	dAssert(!m_base || (m_base->m_bodies.GetCount() == world->GetBodyList().GetCount()));
+	dAssert(m_base || (m_bodies.GetCount() == world->GetBodyList().GetCount()));
+
+	ndScene* const scene = world->GetScene();
+	world->m_frameIndex = m_frameIndex;
+	scene->m_lru = m_sceneLru;
+
+	// attaching and detaching contacts changes the sleep flags of
+	// the bodies, so the bodies are restored last
+	scene->Begin();
+	RestoreContacts(world);
+	RestoreJoints(world);
+	RestoreBodies(world);
+	scene->End();
+}
@@ -0,0 +1,186 @@
+/* Copyright (c) <2003-2021> <Julio Jerez, Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef __D_WORLD_CHECKPOINT_H__
+#define __D_WORLD_CHECKPOINT_H__
+
+#include "ndNewtonStdafx.h"
+
+class ndWorld;
+
+// in memory copy of the dynamic state of a world, for rolling a simulation
+// back and stepping it again. it saves the body transforms, velocities and
+// sleep state, the contacts with their points and warm start forces, and
+// the forces of the bilateral joints. values the solver derives from the
+// transform, like the bounding box and the inertia, are saved as they are,
+// since they lag one step behind the transform of a body.
+// records keep pointers to the bodies and joints, so a checkpoint can only be
+// restored to the world it was saved from, and only while no body or joint
+// was added or removed. the state of particle sets, models and the private
+// members of joint classes is not saved.
+// save and restore must be called between steps, after ndWorld::Sync.
+class ndWorldCheckpoint: public dClassAlloc
+{
+	public:
+	D_MSV_NEWTON_ALIGN_32
+	class ndBodyState
+	{
+		public:
+		dMatrix m_matrix;
+		dMatrix m_shapeMatrix;
+		dMatrix m_invWorldInertiaMatrix;
+		dQuaternion m_rotation;
+		dQuaternion m_gyroRotation;
+		dVector m_veloc;
+		dVector m_omega;
+		dVector m_globalCentreOfMass;
+		dVector m_minAabb;
+		dVector m_maxAabb;
+		dVector m_residualVeloc;
+		dVector m_residualOmega;
+		dVector m_gyroAlpha;
+		dVector m_gyroTorque;
+		dVector m_accel;
+		dVector m_alpha;
+		dVector m_externalForce;
+		dVector m_externalTorque;
+		dVector m_impulseForce;
+		dVector m_impulseTorque;
+		dVector m_savedExternalForce;
+		dVector m_savedExternalTorque;
+		dVector m_nodeMinBox;
+		dVector m_nodeMaxBox;
+		ndBodyKinematic* m_body;
+		dUnsigned32 m_flags;
+		dInt32 m_sleepingCounter;
+		dInt32 m_slot;
+	} D_GCC_NEWTON_ALIGN_32;
+
+	D_MSV_NEWTON_ALIGN_32
+	class ndContactState
+	{
+		public:
+		dVector m_positAcc;
+		dQuaternion m_rotationAcc;
+		dVector m_separatingVector;
+		dQuaternion m_manifoldRotation;
+		ndMaterial m_material;
+		ndBodyKinematic* m_body0;
+		ndBodyKinematic* m_body1;
+		dFloat32 m_timeOfImpact;
+		dFloat32 m_separationDistance;
+		dFloat32 m_contactPruningTolereance;
+		dUnsigned32 m_maxDOF;
+		dUnsigned32 m_sceneLru;
+		dInt32 m_pointStart;
+		dInt32 m_pointCount;
+		bool m_active;
+		bool m_isIntersetionTestOnly;
+	} D_GCC_NEWTON_ALIGN_32;
+
+	D_MSV_NEWTON_ALIGN_32
+	class ndJointState
+	{
+		public:
+		dVector m_forceBody0;
+		dVector m_torqueBody0;
+		dVector m_forceBody1;
+		dVector m_torqueBody1;
+		ndForceImpactPair m_jointForce[DG_BILATERAL_CONTRAINT_DOF];
+		dFloat32 m_motorAcceleration[DG_BILATERAL_CONTRAINT_DOF];
+		ndJointBilateralConstraint* m_joint;
+		bool m_active;
+	} D_GCC_NEWTON_ALIGN_32;
+
+	D_NEWTON_API ndWorldCheckpoint();
+	D_NEWTON_API ~ndWorldCheckpoint();
+
+	// sizes the records, saving a world that fits does not allocate memory
+	D_NEWTON_API void Reserve(dInt32 bodies, dInt32 contacts, dInt32 contactPoints, dInt32 joints);
+
+	D_NEWTON_API void Save(const ndWorld* const world);
+
+	// only the bodies whose state is different from the base are saved.
+	// the base must be a full checkpoint of the same world and must not
+	// change while this checkpoint is in use.
+	D_NEWTON_API void Save(const ndWorld* const world, const ndWorldCheckpoint* const base);
+
+	// restoring a delta writes the saved bodies, and the base record of the
+	// bodies that moved away from the base since, the other bodies are only compared.
+	// contacts come from the free list of the scene contact list, so a restore
+	// only allocates memory when the checkpoint has more contacts than the world
+	// ever had alive, but each created or deleted contact takes the list lock.
+	// restore uses the checkpoint as scratch, a checkpoint can not be
+	// restored by two threads at the same time.
+	D_NEWTON_API void Restore(ndWorld* const world);
+
+	const ndWorldCheckpoint* GetBase() const;
+	dInt32 GetBodyCount() const;
+	dInt32 GetContactCount() const;
+	dUnsigned32 GetFrameIndex() const;
+
+	// bytes used by the records
+	D_NEWTON_API dInt64 GetSize() const;
+
+	private:
+	static void SaveBody(ndBodyState& state, const ndBodyKinematic* const body);
+	static bool HasBodyChanged(const ndBodyState& state, const ndBodyKinematic* const body);
+	static void RestoreBody(ndScene* const scene, const ndBodyState& state);
+
+	void SaveBodies(const ndWorld* const world);
+	void SaveContacts(const ndWorld* const world);
+	void SaveJoints(const ndWorld* const world);
+	void RestoreBodies(ndWorld* const world);
+	void RestoreContacts(ndWorld* const world);
+	void RestoreJoints(ndWorld* const world) const;
+
+	dArray<ndBodyState> m_bodies;
+	dArray<ndContactState> m_contacts;
+	dArray<ndContactMaterial> m_contactPoints;
+	dArray<ndJointState> m_joints;
+	dArray<dInt32> m_bodyScans;
+	dArray<ndContact*> m_contactRefs;
+	const ndWorldCheckpoint* m_base;
+	dUnsigned32 m_frameIndex;
+	dUnsigned32 m_sceneLru;
+};
+
+inline const ndWorldCheckpoint* ndWorldCheckpoint::GetBase() const
+{
+	return m_base;
+}
+
+inline dInt32 ndWorldCheckpoint::GetBodyCount() const
+{
+	return m_bodies.GetCount();
+}
+
+inline dInt32 ndWorldCheckpoint::GetContactCount() const
+{
+	return m_contacts.GetCount();
+}
+
+inline dUnsigned32 ndWorldCheckpoint::GetFrameIndex() const
+{
+	return m_frameIndex;
+}
+
+#endif
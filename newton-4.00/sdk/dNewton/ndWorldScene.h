@@ -21,6 +21,7 @@
 
 #include "ndNewtonStdafx.h"
 #include "ndWorld.h"
+#include "ndBodyParticleSet.h"
 
 template<class scene>
 class ndWorldScene: public scene
@@ -37,6 +38,47 @@ class ndWorldScene: public scene
 		return m_world;
 	}
 
+	// the particle sets are not in the broad phase, they are 
+	// tested after the bodies against the closest hit so far.
+	bool RayCast(ndRayCastNotify& callback, const dVector& globalOrigin, const dVector& globalDest) const
+	{
+		bool state = scene::RayCast(callback, globalOrigin, globalDest);
+		const ndBodyParticleSetList& particleSets = m_world->GetParticleList();
+		if (particleSets.GetCount())
+		{
+			const dVector p0(globalOrigin & dVector::m_triplexMask);
+			const dVector p1(globalDest & dVector::m_triplexMask);
+			const dVector segment(p1 - p0);
+			if (segment.DotProduct(segment).GetScalar() > dFloat32(1.0e-8f))
+			{
+				const dFastRayTest ray(p0, p1);
+				for (ndBodyParticleSetList::dNode* node = particleSets.GetFirst(); node; node = node->GetNext())
+				{
+					ndBodyParticleSet* const particleSet = node->GetInfo();
+					if (particleSet->RayCast(callback, ray, callback.m_param))
+					{
+						state = true;
+					}
+				}
+			}
+		}
+		return state;
+	}
+
+	void BodiesInAabb(ndBodiesInAabbNotify& callback) const
+	{
+		scene::BodiesInAabb(callback);
+		const ndBodyParticleSetList& particleSets = m_world->GetParticleList();
+		for (ndBodyParticleSetList::dNode* node = particleSets.GetFirst(); node; node = node->GetNext())
+		{
+			ndBodyParticleSet* const particleSet = node->GetInfo();
+			if (callback.OnOverlap(particleSet))
+			{
+				callback.m_bodyArray.PushBack(particleSet);
+			}
+		}
+	}
+
 	ndWorld* m_world;
 };
 
@@ -0,0 +1,700 @@
+/* Copyright (c) <2003-2021> <Julio Jerez, Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "dCoreStdafx.h"
+#include "ndNewtonStdafx.h"
+#include "ndWorld.h"
+#include "ndBodyDynamic.h"
+#include "ndJointHinge.h"
+#include "ndJointSlider.h"
+#include "ndJointFix6dof.h"
+#include "ndWorldSnapshot.h"
+#include "ndJointBallAndSocket.h"
+
+static const char ndSnapshotMagic[8] = { 'n', 'd', 'W', 'o', 'r', 'l', 'd', 0 };
+
+static bool ndSnapshotSupportedShape(const ndShape* const shape)
+{
+	switch (shape->GetShapeInfo().m_collisionType)
+	{
+		case m_box:
+		case m_cone:
+		case m_sphere:
+		case m_capsule:
+		case m_cylinder:
+		case m_chamferCylinder:
+		case m_convexHull:
+		case m_boundingBoxHierachy:
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+bool ndWorldSnapshot::ValidateHeader(const ndHeader* const header, dInt64 size)
+{
+	if (memcmp(header->m_magic, ndSnapshotMagic, sizeof(ndSnapshotMagic)))
+	{
+		return false;
+	}
+	if ((header->m_version != D_SNAPSHOT_VERSION) || (header->m_floatSize != sizeof(dFloat32)))
+	{
+		return false;
+	}
+	for (dInt32 i = 0; i < m_sectionsCount; i++)
+	{
+		// compared against the space left, so a large offset or size can not wrap around
+		const ndSection& section = header->m_sections[i];
+		if ((section.m_offset < 0) || (section.m_offset > size) || (section.m_storedSize < 0) || (section.m_storedSize > (size - section.m_offset)))
+		{
+			return false;
+		}
+		if ((section.m_size < 0) || (section.m_size > 0x7fffffff) || (section.m_count < 0))
+		{
+			return false;
+		}
+		if (!section.m_compressed && (section.m_storedSize != section.m_size))
+		{
+			return false;
+		}
+	}
+	const ndSection& shapes = header->m_sections[m_shapes];
+	const ndSection& bodies = header->m_sections[m_bodies];
+	const ndSection& joints = header->m_sections[m_joints];
+	if ((shapes.m_size != dInt64(sizeof(ndShapeRecord)) * shapes.m_count) || 
+		(bodies.m_size != dInt64(sizeof(ndBodyRecord)) * bodies.m_count) ||
+		(joints.m_size != dInt64(sizeof(ndJointRecord)) * joints.m_count))
+	{
+		return false;
+	}
+	return true;
+}
+
+bool ndWorldSnapshot::ValidateBody(const ndBodyRecord& record, dInt32 shapesCount)
+{
+	if ((record.m_shapeIndex < 0) || (record.m_shapeIndex >= shapesCount))
+	{
+		return false;
+	}
+	if ((record.m_bodyType < m_kinematicBody) || (record.m_bodyType > m_triggerVolume))
+	{
+		return false;
+	}
+	if ((record.m_scaleType < ndShapeInstance::m_unit) || (record.m_scaleType > ndShapeInstance::m_global))
+	{
+		return false;
+	}
+	return true;
+}
+
+bool ndWorldSnapshot::ValidateJoint(const ndJointRecord& record, dInt32 bodiesCount)
+{
+	if ((record.m_jointType < 0) || (record.m_jointType >= m_jointTypesCount))
+	{
+		return false;
+	}
+	if ((record.m_solverModel < m_jointIterativeSoft) || (record.m_solverModel >= m_jointModesCount))
+	{
+		return false;
+	}
+	return (record.m_body0 >= 0) && (record.m_body0 < bodiesCount) && (record.m_body1 >= -1) && (record.m_body1 < bodiesCount) && (record.m_body0 != record.m_body1);
+}
+
+bool ndWorldSnapshot::SaveJoint(const ndJointBilateralConstraint* const joint, ndJointRecord& record)
+{
+	// derived joints (actuators, ...) have their own class name, so they do not pass for their base
+	const char* const className = joint->ClassName();
+	memset((void*)&record, 0, sizeof(record));
+	if (!strcmp(className, "ndJointBallAndSocket"))
+	{
+		const ndJointBallAndSocket* const ball = (ndJointBallAndSocket*)joint;
+		record.m_jointType = m_ballAndSocketJoint;
+		record.m_param[0] = ball->m_maxConeAngle;
+		record.m_param[1] = ball->m_coneFriction;
+		record.m_param[2] = ball->m_minTwistAngle;
+		record.m_param[3] = ball->m_maxTwistAngle;
+		record.m_param[4] = ball->m_twistFriction;
+		record.m_param[5] = ball->m_coneFrictionRegularizer;
+		record.m_param[6] = ball->m_twistFrictionRegularizer;
+	}
+	else if (!strcmp(className, "ndJointHinge"))
+	{
+		const ndJointHinge* const hinge = (ndJointHinge*)joint;
+		record.m_jointType = m_hingeJoint;
+		record.m_param[0] = hinge->m_springK;
+		record.m_param[1] = hinge->m_damperC;
+		record.m_param[2] = hinge->m_minLimit;
+		record.m_param[3] = hinge->m_maxLimit;
+		record.m_param[4] = hinge->m_friction;
+		record.m_param[5] = hinge->m_springDamperRegularizer;
+		record.m_flags |= (hinge->m_hasLimits ? m_hasLimits : 0) | (hinge->m_isSpringDamper ? m_isSpringDamper : 0);
+	}
+	else if (!strcmp(className, "ndJointSlider"))
+	{
+		const ndJointSlider* const slider = (ndJointSlider*)joint;
+		record.m_jointType = m_sliderJoint;
+		record.m_param[0] = slider->m_springK;
+		record.m_param[1] = slider->m_damperC;
+		record.m_param[2] = slider->m_minLimit;
+		record.m_param[3] = slider->m_maxLimit;
+		record.m_param[4] = slider->m_friction;
+		record.m_param[5] = slider->m_springDamperRegularizer;
+		record.m_flags |= (slider->m_hasLimits ? m_hasLimits : 0) | (slider->m_isSpringDamper ? m_isSpringDamper : 0);
+	}
+	else if (!strcmp(className, "ndJointFix6dof"))
+	{
+		const ndJointFix6dof* const fix = (ndJointFix6dof*)joint;
+		record.m_jointType = m_fix6dofJoint;
+		record.m_param[0] = fix->m_softness;
+		record.m_param[1] = fix->m_maxForce;
+		record.m_param[2] = fix->m_maxTorque;
+	}
+	else
+	{
+		return false;
+	}
+
+	record.m_localMatrix0 = joint->m_localMatrix0;
+	record.m_localMatrix1 = joint->m_localMatrix1;
+	record.m_solverModel = joint->m_solverModel;
+	record.m_maxAngleError = joint->m_maxAngleError;
+	record.m_regularizer = joint->m_defualtDiagonalRegularizer;
+	record.m_flags |= joint->m_enableCollision ? m_collidable : 0;
+	return true;
+}
+
+ndJointBilateralConstraint* ndWorldSnapshot::LoadJoint(const ndJointRecord& record, ndBodyKinematic* const body0, ndBodyKinematic* const body1)
+{
+	// the constructors only need a frame, the saved local matrices replace the ones they calculate
+	const dMatrix frame(record.m_localMatrix0 * body0->GetMatrix());
+	ndJointBilateralConstraint* joint = nullptr;
+	switch (record.m_jointType)
+	{
+		case m_ballAndSocketJoint:
+		{
+			ndJointBallAndSocket* const ball = new ndJointBallAndSocket(frame, body0, body1);
+			ball->m_maxConeAngle = record.m_param[0];
+			ball->m_coneFriction = record.m_param[1];
+			ball->m_minTwistAngle = record.m_param[2];
+			ball->m_maxTwistAngle = record.m_param[3];
+			ball->m_twistFriction = record.m_param[4];
+			ball->m_coneFrictionRegularizer = record.m_param[5];
+			ball->m_twistFrictionRegularizer = record.m_param[6];
+			joint = ball;
+			break;
+		}
+
+		case m_hingeJoint:
+		{
+			ndJointHinge* const hinge = new ndJointHinge(frame, body0, body1);
+			hinge->m_springK = record.m_param[0];
+			hinge->m_damperC = record.m_param[1];
+			hinge->m_minLimit = record.m_param[2];
+			hinge->m_maxLimit = record.m_param[3];
+			hinge->m_friction = record.m_param[4];
+			hinge->m_springDamperRegularizer = record.m_param[5];
+			hinge->m_hasLimits = (record.m_flags & m_hasLimits) ? true : false;
+			hinge->m_isSpringDamper = (record.m_flags & m_isSpringDamper) ? true : false;
+			joint = hinge;
+			break;
+		}
+
+		case m_sliderJoint:
+		{
+			ndJointSlider* const slider = new ndJointSlider(frame, body0, body1);
+			slider->m_springK = record.m_param[0];
+			slider->m_damperC = record.m_param[1];
+			slider->m_minLimit = record.m_param[2];
+			slider->m_maxLimit = record.m_param[3];
+			slider->m_friction = record.m_param[4];
+			slider->m_springDamperRegularizer = record.m_param[5];
+			slider->m_hasLimits = (record.m_flags & m_hasLimits) ? true : false;
+			slider->m_isSpringDamper = (record.m_flags & m_isSpringDamper) ? true : false;
+			joint = slider;
+			break;
+		}
+
+		case m_fix6dofJoint:
+		{
+			ndJointFix6dof* const fix = new ndJointFix6dof(frame, body0, body1);
+			fix->m_softness = record.m_param[0];
+			fix->m_maxForce = record.m_param[1];
+			fix->m_maxTorque = record.m_param[2];
+			joint = fix;
+			break;
+		}
+
+		default:
+			dAssert(0);
+			return nullptr;
+	}
+
+	joint->m_localMatrix0 = record.m_localMatrix0;
+	joint->m_localMatrix1 = record.m_localMatrix1;
+	joint->m_solverModel = ndJointBilateralSolverModel(record.m_solverModel);
+	joint->m_maxAngleError = record.m_maxAngleError;
+	joint->m_defualtDiagonalRegularizer = record.m_regularizer;
+	joint->m_enableCollision = (record.m_flags & m_collidable) ? 1 : 0;
+	return joint;
+}
+
+void ndWorldSnapshot::Save(const ndWorld* const world, dArray<dUnsigned8>& image, bool compress)
+{
+	D_TRACKTIME();
+	// player capsules, particles and bodies with shapes the format
+	// does not support yet (compounds, heightfields) only go to xml
+	dArray<const ndShape*> shapes;
+	dArray<ndBodyKinematic*> bodies;
+	dTree<dInt32, const ndShape*> uniqueShapes;
+	dTree<dInt32, const ndBodyKinematic*> bodyIndex;
+	const ndBodyList& bodyList = world->GetBodyList();
+	for (ndBodyList::dNode* bodyNode = bodyList.GetFirst(); bodyNode; bodyNode = bodyNode->GetNext())
+	{
+		ndBodyKinematic* const body = bodyNode->GetInfo();
+		const ndShape* const shape = body->GetCollisionShape().GetShape();
+		if (!body->GetAsBodyPlayerCapsule() && ndSnapshotSupportedShape(shape))
+		{
+			if (!uniqueShapes.Find(shape))
+			{
+				uniqueShapes.Insert(shapes.GetCount(), shape);
+				shapes.PushBack(shape);
+			}
+			bodyIndex.Insert(bodies.GetCount(), body);
+			bodies.PushBack(body);
+		}
+	}
+
+	// joints are only kept when both bodies are in the image
+	dArray<ndJointRecord> joints;
+	const ndJointList& jointList = world->GetJointList();
+	const ndBodyKinematic* const sentinel = world->GetSentinelBody();
+	for (ndJointList::dNode* jointNode = jointList.GetFirst(); jointNode; jointNode = jointNode->GetNext())
+	{
+		const ndJointBilateralConstraint* const joint = jointNode->GetInfo();
+		dTree<dInt32, const ndBodyKinematic*>::dNode* const body0Node = bodyIndex.Find(joint->GetBody0());
+		dTree<dInt32, const ndBodyKinematic*>::dNode* const body1Node = bodyIndex.Find(joint->GetBody1());
+		const bool attachedToWorld = (joint->GetBody1() == sentinel);
+		ndJointRecord record;
+		if (body0Node && (body1Node || attachedToWorld) && SaveJoint(joint, record))
+		{
+			record.m_body0 = body0Node->GetInfo();
+			record.m_body1 = attachedToWorld ? -1 : body1Node->GetInfo();
+			joints.PushBack(record);
+		}
+	}
+
+	ndHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.m_magic, ndSnapshotMagic, sizeof(ndSnapshotMagic));
+	header.m_version = D_SNAPSHOT_VERSION;
+	header.m_floatSize = sizeof(dFloat32);
+	header.m_subSteps = world->GetSubSteps();
+	header.m_solverIterations = world->GetSolverIterations();
+
+	dInt64 shapesDataSize = 0;
+	for (dInt32 i = 0; i < shapes.GetCount(); i++)
+	{
+		const ndShape* const shape = shapes[i];
+		const ndShapeInfo info(shape->GetShapeInfo());
+		if (info.m_collisionType == m_convexHull)
+		{
+			ndShapeConvexHull* const hull = (ndShapeConvexHull*)shape;
+			shapesDataSize += Align(hull->SerializeToBuffer(nullptr));
+		}
+		else if (info.m_collisionType == m_boundingBoxHierachy)
+		{
+			ndShapeStatic_bvh* const bvh = ((ndShape*)shape)->GetAsShapeStaticBVH();
+			shapesDataSize += Align(bvh->SerializeToBuffer(nullptr));
+		}
+	}
+
+	dInt64 offset = Align(sizeof(ndHeader));
+	const dInt64 sectionSize[m_sectionsCount] =
+	{
+		dInt64(sizeof(ndShapeRecord)) * shapes.GetCount(),
+		shapesDataSize,
+		dInt64(sizeof(ndBodyRecord)) * bodies.GetCount(),
+		dInt64(sizeof(ndJointRecord)) * joints.GetCount()
+	};
+	const dInt32 sectionCount[m_sectionsCount] = { shapes.GetCount(), shapes.GetCount(), bodies.GetCount(), joints.GetCount() };
+	for (dInt32 i = 0; i < m_sectionsCount; i++)
+	{
+		ndSection& section = header.m_sections[i];
+		section.m_offset = offset;
+		section.m_size = sectionSize[i];
+		section.m_storedSize = sectionSize[i];
+		section.m_count = sectionCount[i];
+		section.m_compressed = 0;
+		offset += Align(sectionSize[i]);
+	}
+
+	dArray<dUnsigned8> raw;
+	raw.Resize(dInt32(offset));
+	raw.SetCount(dInt32(offset));
+	memset(&raw[0], 0, size_t(offset));
+
+	dUnsigned8* const shapesData = &raw[0] + header.m_sections[m_shapesData].m_offset;
+	ndShapeRecord* const shapeRecords = (ndShapeRecord*)(&raw[0] + header.m_sections[m_shapes].m_offset);
+	dInt64 dataOffset = 0;
+	for (dInt32 i = 0; i < shapes.GetCount(); i++)
+	{
+		const ndShape* const shape = shapes[i];
+		const ndShapeInfo info(shape->GetShapeInfo());
+
+		ndShapeRecord record;
+		memset(&record, 0, sizeof(record));
+		record.m_shapeId = info.m_collisionType;
+		switch (info.m_collisionType)
+		{
+			case m_box:
+				record.m_param[0] = info.m_box.m_x;
+				record.m_param[1] = info.m_box.m_y;
+				record.m_param[2] = info.m_box.m_z;
+				break;
+
+			case m_sphere:
+				record.m_param[0] = info.m_sphere.m_radius;
+				break;
+
+			case m_capsule:
+				record.m_param[0] = info.m_capsule.m_radio0;
+				record.m_param[1] = info.m_capsule.m_radio1;
+				record.m_param[2] = info.m_capsule.m_height;
+				break;
+
+			case m_cylinder:
+				record.m_param[0] = info.m_cylinder.m_radio0;
+				record.m_param[1] = info.m_cylinder.m_radio1;
+				record.m_param[2] = info.m_cylinder.m_height;
+				break;
+
+			case m_cone:
+				record.m_param[0] = info.m_cone.m_radius;
+				record.m_param[1] = info.m_cone.m_height;
+				break;
+
+			case m_chamferCylinder:
+				record.m_param[0] = info.m_chamferCylinder.m_r;
+				record.m_param[1] = info.m_chamferCylinder.m_height;
+				break;
+
+			case m_convexHull:
+			{
+				// save the cooked hull, so loading does not build the hull again
+				const ndShapeConvexHull* const hull = (ndShapeConvexHull*)shape;
+				record.m_dataOffset = dataOffset;
+				record.m_dataSize = hull->SerializeToBuffer(&shapesData[dataOffset]);
+				dataOffset += Align(record.m_dataSize);
+				break;
+			}
+
+			case m_boundingBoxHierachy:
+			{
+				ndShapeStatic_bvh* const bvh = ((ndShape*)shape)->GetAsShapeStaticBVH();
+				record.m_dataOffset = dataOffset;
+				record.m_dataSize = bvh->SerializeToBuffer(&shapesData[dataOffset]);
+				dataOffset += Align(record.m_dataSize);
+				break;
+			}
+
+			default:
+				dAssert(0);
+		}
+		memcpy(&shapeRecords[i], &record, sizeof(record));
+	}
+	dAssert(dataOffset == shapesDataSize);
+
+	ndBodyRecord* const bodyRecords = (ndBodyRecord*)(&raw[0] + header.m_sections[m_bodies].m_offset);
+	for (dInt32 i = 0; i < bodies.GetCount(); i++)
+	{
+		ndBodyKinematic* const body = bodies[i];
+		const ndShapeInstance& instance = body->GetCollisionShape();
+		ndBodyNotify* const notify = body->GetNotifyCallback();
+
+		ndBodyRecord record;
+		memset((void*)&record, 0, sizeof(record));
+		record.m_matrix = body->GetMatrix();
+		record.m_localMatrix = instance.m_localMatrix;
+		record.m_aligmentMatrix = instance.m_aligmentMatrix;
+		record.m_veloc = body->GetVelocity();
+		record.m_omega = body->GetOmega();
+		record.m_centreOfMass = body->GetCentreOfMass();
+		record.m_massMatrix = body->GetMassMatrix();
+		record.m_scale = instance.m_scale;
+		record.m_gravity = notify ? notify->GetGravity() : dVector::m_zero;
+		record.m_material = instance.m_shapeMaterial;
+		record.m_skinThickness = instance.m_skinThickness;
+		record.m_scaleType = instance.m_scaleType;
+		record.m_shapeIndex = uniqueShapes.Find(instance.GetShape())->GetInfo();
+		record.m_bodyType = body->GetAsBodyTriggerVolume() ? m_triggerVolume : (body->GetAsBodyDynamic() ? m_dynamicBody : m_kinematicBody);
+		record.m_flags = (body->GetAutoSleep() ? m_autoSleep : 0) | (instance.m_collisionMode ? m_collisionMode : 0) | (notify ? m_hasNotify : 0);
+		memcpy((void*)&bodyRecords[i], &record, sizeof(record));
+	}
+
+	if (joints.GetCount())
+	{
+		memcpy(&raw[0] + header.m_sections[m_joints].m_offset, &joints[0], sizeof(ndJointRecord) * joints.GetCount());
+	}
+
+	if (!compress)
+	{
+		memcpy(&raw[0], &header, sizeof(header));
+		image.Swap(raw);
+		return;
+	}
+
+	// compressed images have each section packed after the header
+	dInt64 capacity = Align(sizeof(ndHeader));
+	for (dInt32 i = 0; i < m_sectionsCount; i++)
+	{
+		capacity += Align(dCompressBound(header.m_sections[i].m_size));
+	}
+	image.Resize(dInt32(capacity));
+	image.SetCount(dInt32(capacity));
+	memset(&image[0], 0, size_t(capacity));
+
+	offset = Align(sizeof(ndHeader));
+	for (dInt32 i = 0; i < m_sectionsCount; i++)
+	{
+		ndSection& section = header.m_sections[i];
+		const dInt64 storedSize = dCompress(&raw[0] + section.m_offset, section.m_size, &image[0] + offset);
+		section.m_offset = offset;
+		section.m_storedSize = storedSize;
+		section.m_compressed = 1;
+		offset += Align(storedSize);
+	}
+	memcpy(&image[0], &header, sizeof(header));
+	image.SetCount(dInt32(offset));
+}
+
+bool ndWorldSnapshot::Load(ndWorld* const world, const void* const image, dInt64 size)
+{
+	D_TRACKTIME();
+	ndHeader header;
+	if (size < dInt64(sizeof(header)))
+	{
+		return false;
+	}
+	memcpy(&header, image, sizeof(header));
+	if (!ValidateHeader(&header, size))
+	{
+		return false;
+	}
+
+	// uncompressed sections are read in place from the image
+	const dUnsigned8* sections[m_sectionsCount];
+	dArray<dUnsigned8> unpacked[m_sectionsCount];
+	for (dInt32 i = 0; i < m_sectionsCount; i++)
+	{
+		const ndSection& section = header.m_sections[i];
+		sections[i] = (dUnsigned8*)image + section.m_offset;
+		if (section.m_compressed && section.m_size)
+		{
+			dArray<dUnsigned8>& buffer = unpacked[i];
+			buffer.Resize(dInt32(section.m_size));
+			buffer.SetCount(dInt32(section.m_size));
+			if (dDecompress(sections[i], section.m_storedSize, &buffer[0], section.m_size) != section.m_size)
+			{
+				return false;
+			}
+			sections[i] = &buffer[0];
+		}
+	}
+
+	const dInt32 shapesCount = header.m_sections[m_shapes].m_count;
+	const dInt64 shapesDataSize = header.m_sections[m_shapesData].m_size;
+	const dUnsigned8* const shapesData = sections[m_shapesData];
+
+	// every record is validated before anything is added to the world,
+	// so a bad image leaves the world the way it was
+	bool valid = true;
+	dArray<ndShape*> shapes;
+	for (dInt32 i = 0; valid && (i < shapesCount); i++)
+	{
+		ndShapeRecord record;
+		memcpy(&record, sections[m_shapes] + sizeof(ndShapeRecord) * i, sizeof(record));
+		if ((record.m_dataOffset < 0) || (record.m_dataOffset > shapesDataSize) || (record.m_dataSize < 0) || (record.m_dataSize > (shapesDataSize - record.m_dataOffset)))
+		{
+			valid = false;
+			break;
+		}
+
+		ndShape* shape = nullptr;
+		switch (record.m_shapeId)
+		{
+			case m_box:
+				shape = new ndShapeBox(record.m_param[0], record.m_param[1], record.m_param[2]);
+				break;
+
+			case m_sphere:
+				shape = new ndShapeSphere(record.m_param[0]);
+				break;
+
+			case m_capsule:
+				shape = new ndShapeCapsule(record.m_param[0], record.m_param[1], record.m_param[2]);
+				break;
+
+			case m_cylinder:
+				shape = new ndShapeCylinder(record.m_param[0], record.m_param[1], record.m_param[2]);
+				break;
+
+			case m_cone:
+				shape = new ndShapeCone(record.m_param[0], record.m_param[1]);
+				break;
+
+			case m_chamferCylinder:
+				shape = new ndShapeChamferCylinder(record.m_param[0], record.m_param[1]);
+				break;
+
+			case m_convexHull:
+				if (ndShapeConvexHull::ValidateCookedData(&shapesData[record.m_dataOffset], record.m_dataSize))
+				{
+					shape = new ndShapeConvexHull(&shapesData[record.m_dataOffset]);
+				}
+				else
+				{
+					valid = false;
+				}
+				break;
+
+			case m_boundingBoxHierachy:
+				if (dAabbPolygonSoup::ValidateImage(&shapesData[record.m_dataOffset], record.m_dataSize))
+				{
+					shape = new ndShapeStatic_bvh(&shapesData[record.m_dataOffset], record.m_dataSize);
+				}
+				else
+				{
+					valid = false;
+				}
+				break;
+
+			default:
+				valid = false;
+		}
+		if (shape)
+		{
+			shape->AddRef();
+			shapes.PushBack(shape);
+		}
+	}
+
+	const dInt32 bodiesCount = header.m_sections[m_bodies].m_count;
+	for (dInt32 i = 0; valid && (i < bodiesCount); i++)
+	{
+		ndBodyRecord record;
+		memcpy((void*)&record, sections[m_bodies] + sizeof(ndBodyRecord) * i, sizeof(record));
+		valid = ValidateBody(record, shapes.GetCount());
+	}
+
+	const dInt32 jointsCount = header.m_sections[m_joints].m_count;
+	for (dInt32 i = 0; valid && (i < jointsCount); i++)
+	{
+		ndJointRecord record;
+		memcpy((void*)&record, sections[m_joints] + sizeof(ndJointRecord) * i, sizeof(record));
+		valid = ValidateJoint(record, bodiesCount);
+	}
+
+	// bodies are staged outside the world until the joints are known to be valid
+	dArray<ndBodyKinematic*> bodies;
+	for (dInt32 i = 0; valid && (i < bodiesCount); i++)
+	{
+		ndBodyRecord record;
+		memcpy((void*)&record, sections[m_bodies] + sizeof(ndBodyRecord) * i, sizeof(record));
+
+		ndBodyKinematic* body = nullptr;
+		switch (record.m_bodyType)
+		{
+			case m_dynamicBody:
+				body = new ndBodyDynamic();
+				break;
+
+			case m_triggerVolume:
+				body = new ndBodyTriggerVolume();
+				break;
+
+			default:
+				body = new ndBodyKinematic();
+		}
+
+		ndShapeInstance instance(shapes[record.m_shapeIndex]);
+		instance.m_localMatrix = record.m_localMatrix;
+		instance.SetScale(record.m_scale);
+		instance.m_aligmentMatrix = record.m_aligmentMatrix;
+		instance.m_scaleType = ndShapeInstance::ndScaleType(record.m_scaleType);
+		instance.m_skinThickness = record.m_skinThickness;
+		instance.m_collisionMode = (record.m_flags & m_collisionMode) ? true : false;
+		instance.m_shapeMaterial = record.m_material;
+
+		body->SetCollisionShape(instance);
+		body->SetMassMatrix(record.m_massMatrix);
+		body->SetCentreOfMass(record.m_centreOfMass);
+		body->SetMatrix(record.m_matrix);
+		body->SetVelocity(record.m_veloc);
+		body->SetOmega(record.m_omega);
+		body->SetAutoSleep((record.m_flags & m_autoSleep) ? true : false);
+		if (record.m_flags & m_hasNotify)
+		{
+			body->SetNotifyCallback(new ndBodyNotify(record.m_gravity));
+		}
+		bodies.PushBack(body);
+	}
+
+	// the joint constructor swaps the bodies when body0 has no mass, 
+	// so a saved joint always has a body with mass in body0
+	for (dInt32 i = 0; valid && (i < jointsCount); i++)
+	{
+		ndJointRecord record;
+		memcpy((void*)&record, sections[m_joints] + sizeof(ndJointRecord) * i, sizeof(record));
+		valid = bodies[record.m_body0]->GetInvMass() > dFloat32(0.0f);
+	}
+
+	if (valid)
+	{
+		world->SetSubSteps(header.m_subSteps);
+		world->SetSolverIterations(header.m_solverIterations);
+		for (dInt32 i = 0; i < bodies.GetCount(); i++)
+		{
+			world->AddBody(bodies[i]);
+		}
+		for (dInt32 i = 0; i < jointsCount; i++)
+		{
+			ndJointRecord record;
+			memcpy((void*)&record, sections[m_joints] + sizeof(ndJointRecord) * i, sizeof(record));
+			ndBodyKinematic* const body0 = bodies[record.m_body0];
+			ndBodyKinematic* const body1 = (record.m_body1 >= 0) ? bodies[record.m_body1] : world->GetSentinelBody();
+			world->AddJoint(LoadJoint(record, body0, body1));
+		}
+	}
+	else
+	{
+		for (dInt32 i = 0; i < bodies.GetCount(); i++)
+		{
+			delete bodies[i];
+		}
+	}
+
+	for (dInt32 i = 0; i < shapes.GetCount(); i++)
+	{
+		shapes[i]->Release();
+	}
+	return valid;
+}
@@ -0,0 +1,175 @@
+/* Copyright (c) <2003-2021> <Julio Jerez, Newton Game Dynamics>
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef __D_WORLD_SNAPSHOT_H__
+#define __D_WORLD_SNAPSHOT_H__
+
+#include "ndNewtonStdafx.h"
+
+class ndWorld;
+class ndJointBilateralConstraint;
+
+#define D_SNAPSHOT_VERSION		3
+#define D_SNAPSHOT_ALIGNMENT	32
+
+// binary image of a world.
+// the file is a header followed by a table of sections, each section is an array
+// of fixed size records aligned to D_SNAPSHOT_ALIGNMENT and all references are
+// indices or offsets relative to the start of the section, so an uncompressed
+// image can be used directly from a memory mapped file.
+// xml is still the interchange format, snapshots are only valid for the same
+// engine build (float precision and version)
+// joints are saved for the ball and socket, hinge, slider and fix6dof types
+// connecting two saved bodies or a saved body and the world, other joints
+// are skipped, the same as bodies with unsupported shapes
+class ndWorldSnapshot
+{
+	public:
+	enum ndSectionType
+	{
+		m_shapes = 0,
+		m_shapesData,
+		m_bodies,
+		m_joints,
+		m_sectionsCount,
+	};
+
+	enum ndBodyType
+	{
+		m_kinematicBody = 0,
+		m_dynamicBody,
+		m_triggerVolume,
+	};
+
+	enum ndJointType
+	{
+		m_ballAndSocketJoint = 0,
+		m_hingeJoint,
+		m_sliderJoint,
+		m_fix6dofJoint,
+		m_jointTypesCount,
+	};
+
+	enum ndJointFlags
+	{
+		m_collidable = 1 << 0,
+		m_hasLimits = 1 << 1,
+		m_isSpringDamper = 1 << 2,
+	};
+
+	enum ndBodyFlags
+	{
+		m_autoSleep = 1 << 0,
+		m_collisionMode = 1 << 1,
+		m_hasNotify = 1 << 2,
+	};
+
+	class ndSection
+	{
+		public:
+		dInt64 m_offset;
+		dInt64 m_size;
+		dInt64 m_storedSize;
+		dInt32 m_count;
+		dInt32 m_compressed;
+	};
+
+	class ndHeader
+	{
+		public:
+		char m_magic[8];
+		dInt32 m_version;
+		dInt32 m_floatSize;
+		dInt32 m_subSteps;
+		dInt32 m_solverIterations;
+		ndSection m_sections[m_sectionsCount];
+	};
+
+	// shape parameters come from ndShapeInfo, hulls and meshes
+	// keep their vertex data in the shapes data section
+	class ndShapeRecord
+	{
+		public:
+		dInt64 m_dataOffset;
+		dInt64 m_dataSize;
+		dFloat32 m_param[4];
+		dInt32 m_shapeId;
+		dInt32 m_pad[3];
+	};
+
+	D_MSV_NEWTON_ALIGN_32
+	class ndBodyRecord
+	{
+		public:
+		dMatrix m_matrix;
+		dMatrix m_localMatrix;
+		dMatrix m_aligmentMatrix;
+		dVector m_veloc;
+		dVector m_omega;
+		dVector m_centreOfMass;
+		dVector m_massMatrix;
+		dVector m_scale;
+		dVector m_gravity;
+		ndShapeMaterial m_material;
+		dFloat32 m_skinThickness;
+		dInt32 m_scaleType;
+		dInt32 m_shapeIndex;
+		dInt32 m_bodyType;
+		dInt32 m_flags;
+	} D_GCC_NEWTON_ALIGN_32;
+
+	// body indices are into the bodies section, -1 is the world sentinel body.
+	// the parameters are the joint type limits, springs and friction
+	D_MSV_NEWTON_ALIGN_32
+	class ndJointRecord
+	{
+		public:
+		dMatrix m_localMatrix0;
+		dMatrix m_localMatrix1;
+		dFloat32 m_param[8];
+		dInt32 m_jointType;
+		dInt32 m_body0;
+		dInt32 m_body1;
+		dInt32 m_solverModel;
+		dInt32 m_flags;
+		dFloat32 m_maxAngleError;
+		dFloat32 m_regularizer;
+		dInt32 m_pad[1];
+	} D_GCC_NEWTON_ALIGN_32;
+
+	D_NEWTON_API static void Save(const ndWorld* const world, dArray<dUnsigned8>& image, bool compress);
+	D_NEWTON_API static bool Load(ndWorld* const world, const void* const image, dInt64 size);
+
+	private:
+	static dInt64 Align(dInt64 size);
+	static bool ValidateHeader(const ndHeader* const header, dInt64 size);
+	static bool ValidateBody(const ndBodyRecord& record, dInt32 shapesCount);
+	static bool ValidateJoint(const ndJointRecord& record, dInt32 bodiesCount);
+	static bool SaveJoint(const ndJointBilateralConstraint* const joint, ndJointRecord& record);
+	static ndJointBilateralConstraint* LoadJoint(const ndJointRecord& record, ndBodyKinematic* const body0, ndBodyKinematic* const body1);
+};
+
+inline dInt64 ndWorldSnapshot::Align(dInt64 size)
+{
+	return (size + D_SNAPSHOT_ALIGNMENT - 1) & -D_SNAPSHOT_ALIGNMENT;
+}
+
+#endif